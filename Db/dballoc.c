@@ -51,6 +51,8 @@ extern "C" {
 #include "dbfeatures.h"
 #include "dblock.h"
 #include "dbindex.h"
+#include "dbbtree.h"
+#include "dbrtree.h"
 
 /* don't output 'segment does not have enough space' messages */
 #define SUPPRESS_LOWLEVEL_ERR 1
@@ -67,6 +69,7 @@ static gint init_db_index_area_header(void* db);
 static gint init_logging(void* db);
 static gint init_strhash_area(void* db, db_hash_area_header* areah);
 static gint init_hash_subarea(void* db, db_hash_area_header* areah, gint arraylength);
+static gint hash_length_pow2(gint length);
 static gint init_db_recptr_bitmap(void* db);
 #ifdef USE_REASONER
 static gint init_anonconst_table(void* db);
@@ -173,6 +176,8 @@ gint wg_init_db_memsegment(void* db, gint key, gint size) {
 
   /* index structures also user fixlen object storage:
    *   tnode area - contains index nodes
+   *   bnode area - contains B-tree index nodes
+   *   rnode area - contains R-tree index nodes
    *   index header area - contains index headers
    *   index template area - contains template headers
    *   index hash area - varlen storage for hash buckets
@@ -186,6 +191,20 @@ gint wg_init_db_memsegment(void* db, gint key, gint size) {
   tmp=make_subarea_freelist(db,&(dbh->tnode_area_header),0);
   if (tmp) {  show_dballoc_error(db," cannot initialize tnode area"); return -1; }
 
+  tmp=init_db_subarea(db,&(dbh->bnode_area_header),0,INITIAL_SUBAREA_SIZE);
+  if (tmp) {  show_dballoc_error(db," cannot create bnode area"); return -1; }
+  (dbh->bnode_area_header).fixedlength=1;
+  (dbh->bnode_area_header).objlength=sizeof(struct wg_bnode);
+  tmp=make_subarea_freelist(db,&(dbh->bnode_area_header),0);
+  if (tmp) {  show_dballoc_error(db," cannot initialize bnode area"); return -1; }
+
+  tmp=init_db_subarea(db,&(dbh->rnode_area_header),0,INITIAL_SUBAREA_SIZE);
+  if (tmp) {  show_dballoc_error(db," cannot create rnode area"); return -1; }
+  (dbh->rnode_area_header).fixedlength=1;
+  (dbh->rnode_area_header).objlength=sizeof(struct wg_rnode);
+  tmp=make_subarea_freelist(db,&(dbh->rnode_area_header),0);
+  if (tmp) {  show_dballoc_error(db," cannot initialize rnode area"); return -1; }
+
   tmp=init_db_subarea(db,&(dbh->indexhdr_area_header),0,MINIMAL_SUBAREA_SIZE);
   if (tmp) {  show_dballoc_error(db," cannot create index header area"); return -1; }
   (dbh->indexhdr_area_header).fixedlength=1;
@@ -394,6 +413,9 @@ static gint init_db_index_area_header(void* db) {
   memset(dbh->index_control_area_header.index_template_table, 0,
     (MAX_INDEXED_FIELDNR+1)*sizeof(gint));
 #endif
+  dbh->index_control_area_header.column_map=0;
+  dbh->index_control_area_header.column_map_count=0;
+  dbh->index_control_area_header.column_map_size=0;
   return 0;
 }
 
@@ -418,12 +440,26 @@ static gint init_strhash_area(void* db, db_hash_area_header* areah) {
 
   if(STRHASH_SIZE > 0.01 && STRHASH_SIZE < 50) {
     arraylength = (gint) ((dbh->size+1) * (STRHASH_SIZE/100.0)) / sizeof(gint);
+    /* round down so that the array stays within the requested share */
+    if(hash_length_pow2(arraylength) > arraylength)
+      arraylength = hash_length_pow2(arraylength) / 2;
   } else {
     arraylength = DEFAULT_STRHASH_LENGTH;
   }
   return init_hash_subarea(db, areah, arraylength);
 }
 
+/** rounds a hash array length up to the nearest power of 2
+*
+* hash functions select the array slot with a bit mask
+*/
+static gint hash_length_pow2(gint length) {
+  gint pow2 = 1;
+  while(pow2 < length)
+    pow2 <<= 1;
+  return pow2;
+}
+
 /** initializes hash area
 *
 */
@@ -443,6 +479,10 @@ static gint init_hash_subarea(void* db, db_hash_area_header* areah, gint arrayle
   areah->offset=segmentchunk;
   areah->size=asize;
   areah->arraylength=arraylength;
+  areah->entries=0;
+  areah->oldarraystart=0;
+  areah->oldarraylength=0;
+  areah->migratepos=0;
   // set correct alignment for arraystart
   i=SUBAREA_ALIGNMENT_BYTES-(segmentchunk%SUBAREA_ALIGNMENT_BYTES);
   if (i==SUBAREA_ALIGNMENT_BYTES) i=0;
@@ -581,6 +621,15 @@ static gint make_subarea_freelist(void* db, void* area_header, gint arrayindex)
   //subarea info
   size=((areah->subarea_array)[arrayindex]).alignedsize;
   offset=((areah->subarea_array)[arrayindex]).alignedoffset;
+  // objects spanning whole cache lines should not straddle an extra one
+  if (objlength>=CACHE_LINE_BYTES && !(objlength%CACHE_LINE_BYTES)) {
+    i=CACHE_LINE_BYTES-(offset%CACHE_LINE_BYTES);
+    if (i==CACHE_LINE_BYTES) i=0;
+    offset=offset+i;
+    size=size-i;
+    ((areah->subarea_array)[arrayindex]).alignedoffset=offset;
+    ((areah->subarea_array)[arrayindex]).alignedsize=size;
+  }
   // create freelist
   max=(offset+size)-(2*objlength);
   for(i=offset;i<=max;i=i+objlength) {
@@ -843,6 +892,28 @@ void wg_free_tnode(void* db, gint offset) {
   (dbmemsegh(db)->tnode_area_header).freelist=offset;
 }
 
+/** free an existing B-tree node
+*
+* the object is added to the freelist
+*
+*/
+
+void wg_free_bnode(void* db, gint offset) {
+  dbstore(db,offset,(dbmemsegh(db)->bnode_area_header).freelist);
+  (dbmemsegh(db)->bnode_area_header).freelist=offset;
+}
+
+/** free an existing R-tree node
+*
+* the object is added to the freelist
+*
+*/
+
+void wg_free_rnode(void* db, gint offset) {
+  dbstore(db,offset,(dbmemsegh(db)->rnode_area_header).freelist);
+  (dbmemsegh(db)->rnode_area_header).freelist=offset;
+}
+
 /** free generic fixlen object
 *
 * the object is added to the freelist
@@ -963,6 +1034,10 @@ gint wg_alloc_gints(void* db, void* area_header, gint nr) {
         if (nextel!=0) dbstore(db,nextel+2*sizeof(gint),dbaddr(db,&freebuckets[i]));
         // prev elem cannot be free (no consecutive free elems)
         dbstore(db,res,makeusedobjectsizeprevused(wantedbytes)); // store wanted size to the returned object
+        /* next object should be marked as "prev used" */
+        nextobject=res+usedbytes;
+        tmp=dbfetch(db,nextobject);
+        if (isnormalusedobject(tmp)) dbstore(db,nextobject,makeusedobjectsizeprevused(tmp));
         return res;
       } else if (size>=usedbytes+MIN_VARLENOBJ_SIZE) {
         // found one somewhat larger: now split and store the rest
@@ -1384,13 +1459,33 @@ gint wg_register_external_db(void *db, void *extdb) {
 
 /*
  * Initialize a new hash table for an index.
+ * The array is allocated from the index hash area, so that
+ * it can be released when the table is resized. The size is
+ * rounded up to a power of 2.
  */
 gint wg_create_hash(void *db, db_hash_area_header* areah, gint size) {
+  db_memsegment_header* dbh = dbmemsegh(db);
+  gint object;
+
   if(size <= 0)
     size = DEFAULT_IDXHASH_LENGTH;
-  if(init_hash_subarea(db, areah, size)) {
-    return show_dballoc_error(db," cannot create strhash array area");
+  else
+    size = hash_length_pow2(size);
+  /* first gint of the object is the allocator header */
+  object = wg_alloc_gints(db, &(dbh->indexhash_area_header), size+1);
+  if(!object) {
+    return show_dballoc_error(db," cannot create index hash array");
   }
+  areah->offset=object;
+  areah->size=(size+1)*sizeof(gint);
+  areah->arraystart=object+sizeof(gint);
+  areah->arraysize=size*sizeof(gint);
+  areah->arraylength=size;
+  areah->entries=0;
+  areah->oldarraystart=0;
+  areah->oldarraylength=0;
+  areah->migratepos=0;
+  memset(offsettoptr(db, areah->arraystart), 0, areah->arraysize);
   return 0;
 }
 
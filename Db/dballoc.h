@@ -144,12 +144,30 @@ Varlen allocation follows the main ideas of the Doug Lea allocator:
 
 #define MEMSEGMENT_MAGIC_MARK 1232319011  /** enables to check that we really have db pointer */
 #define MEMSEGMENT_MAGIC_INIT 1916950123  /** init time magic */
-#define MEMSEGMENT_VERSION ((VERSION_REV<<16)|\
+/** Revision of the memory segment layout within a release. Increment
+ *  when the header or the stored data changes incompatibly, so that
+ *  older images and dumps are rejected instead of being misread.
+ *  0: release layout
+ *  1: hash index growth fields in the hash area header
+ *  2: word-at-a-time string and index hash, power of 2 hash arrays
+ *  3: B-tree index area and header
+ *  4: normalized key prefixes in B-tree nodes
+ *  5: index statistics in the index header
+ *  6: column map of the index area
+ *  7: full-text index header
+ *  8: R-tree index area and header
+ *  9: index expression in the index header
+ *  10: Bloom filters of hash indexes
+ *  11: deferred rows missing from the index in the index header
+ */
+#define MEMSEGMENT_LAYOUT 11
+#define MEMSEGMENT_VERSION ((MEMSEGMENT_LAYOUT<<24)|(VERSION_REV<<16)|\
   (VERSION_MINOR<<8)|(VERSION_MAJOR)) /** written to dump headers for compatibilty checking */
 #define SUBAREA_ARRAY_SIZE 64      /** nr of possible subareas in each area  */
 #define INITIAL_SUBAREA_SIZE 8192  /** size of the first created subarea (bytes)  */
 #define MINIMAL_SUBAREA_SIZE 8192  /** checked before subarea creation to filter out stupid requests */
 #define SUBAREA_ALIGNMENT_BYTES 8          /** subarea alignment     */
+#define CACHE_LINE_BYTES 64  /** fixlen objects of a multiple of this size are aligned to it */
 #define SYN_VAR_PADDING 128          /** sync variable padding in bytes */
 #if (LOCK_PROTO==3)
 #define MAX_LOCKS 64                /** queue size (currently fixed :-() */
@@ -165,8 +183,8 @@ Varlen allocation follows the main ideas of the Doug Lea allocator:
 #define SHORTSTR_SIZE 32 /** max len of short strings  */
 
 /* defaults, used when there is no user-supplied or computed value */
-#define DEFAULT_STRHASH_LENGTH 10000  /** length of the strhash array (nr of array elements) */
-#define DEFAULT_IDXHASH_LENGTH 10000  /** hash index hash size */
+#define DEFAULT_STRHASH_LENGTH 16384  /** length of the strhash array (nr of array elements, power of 2) */
+#define DEFAULT_IDXHASH_LENGTH 16384  /** hash index hash size (power of 2) */
 
 #define ANONCONST_TABLE_SIZE 200 /** length of the table containing predefined anonconst uri ptrs */
 
@@ -178,9 +196,13 @@ typedef ptrdiff_t gint;  /** always used instead of int. Pointers are also handl
 #ifndef _MSC_VER /* MSVC on Win32 */
 typedef int32_t gint32;    /** 32-bit fixed size storage */
 typedef int64_t gint64;    /** 64-bit fixed size storage */
+typedef uint32_t guint32;  /** 32-bit unsigned arithmetic */
+typedef uint64_t guint64;  /** 64-bit unsigned arithmetic */
 #else
 typedef __int32 gint32;    /** 32-bit fixed size storage */
 typedef __int64 gint64;    /** 64-bit fixed size storage */
+typedef unsigned __int32 guint32;  /** 32-bit unsigned arithmetic */
+typedef unsigned __int64 guint64;  /** 64-bit unsigned arithmetic */
 #endif
 
 #ifdef USE_DATABASE_HANDLE
@@ -255,7 +277,8 @@ gcell;
 
 /* index related stuff */
 #define MAX_INDEX_FIELDS 10       /** maximum number of fields in one index */
-#define MAX_INDEXED_FIELDNR 127   /** limits the size of field/index table */
+#define MAX_INDEXED_FIELDNR 127   /** columns in the fixed field/index table,
+                                   *  higher ones use the column map */
 
 #ifndef TTREE_CHAINED_NODES
 #define WG_TNODE_ARRAY_SIZE 10
@@ -353,8 +376,28 @@ typedef struct _db_hash_area_header {
   gint arraysize;      /** subarea object alloc usable size: not necessarily to end of area */
   gint arraystart;     /** subarea start as to be used for object allocation */
   gint arraylength;    /** nr of elements in the hash array */
+  gint entries;        /** nr of keys stored (index hashes only) */
+  gint oldarraystart;  /** array being migrated after a resize, 0 if none */
+  gint oldarraylength; /** nr of elements in the old array */
+  gint migratepos;     /** next element of the old array to migrate */
 } db_hash_area_header;
 
+/** Bloom filter of an index hash
+*  The filter is made of blocks of 8 32-bit words, a key sets one
+*  bit in each word of one block. The counters are updated by
+*  searches and are approximate when several readers run at once.
+*/
+
+typedef struct _db_bloom_header {
+  gint offset;         /** filter words, 0 if there is no filter */
+  gint blocks;         /** nr of blocks in the filter */
+  gint keys;           /** nr of keys the filter is sized for */
+  gint bits_per_key;   /** filter size in bits per key */
+  gint lookups;        /** searches checked against the filter */
+  gint negatives;      /** searches rejected by the filter */
+  gint false_positives; /** searches passed by the filter, key not found */
+} db_bloom_header;
+
 /**
  * T-tree specific index header fields
  */
@@ -366,11 +409,55 @@ struct __wg_ttree_header {
 #endif
 };
 
+/**
+ * B-tree specific index header fields
+ */
+struct __wg_btree_header {
+  gint offset_root_node;
+  gint offset_min_leaf;     /** first leaf in key order */
+  gint offset_max_leaf;     /** last leaf in key order */
+};
+
 /**
  * Hash-specific index header fields
  */
 struct __wg_hashidx_header {
   db_hash_area_header hasharea;
+  db_bloom_header bloom;    /** optional filter of the keys */
+};
+
+/**
+ * Bitmap index specific header fields
+ */
+struct __wg_bitmap_header {
+  gint offset_values;       /** first value in the list */
+  gint values;              /** number of distinct values */
+};
+
+/**
+ * Full-text index specific header fields
+ */
+struct __wg_fulltext_header {
+  db_hash_area_header hasharea; /** terms and their postings */
+  gint docs;                /** rows that have terms */
+  gint flags;               /** tokenizer flags */
+  gint min_len;             /** shortest term in characters */
+};
+
+/**
+ * R-tree specific index header fields
+ */
+struct __wg_rtree_header {
+  gint offset_root_node;
+  gint rows;                /** rows in the index */
+};
+
+/**
+ * JSON path index specific header fields
+ */
+struct __wg_jsonpath_header {
+  db_hash_area_header hasharea; /** values and their documents */
+  gint path_offset;         /** the path, a '\0' terminated string */
 };
 
 
@@ -383,9 +470,17 @@ typedef struct {
   gint rec_field_index[MAX_INDEX_FIELDS]; /** field numbers for this index */
   union {
     struct __wg_ttree_header t;
+    struct __wg_btree_header b;
     struct __wg_hashidx_header h;
+    struct __wg_bitmap_header m;
+    struct __wg_fulltext_header f;
+    struct __wg_rtree_header r;
+    struct __wg_jsonpath_header p;
   } ctl;                    /** shared fields for different index types */
   gint template_offset;     /** matchrec template, 0 if full index */
+  gint stats_offset;        /** statistics, 0 if not analyzed */
+  gint expr;                /** WG_EXPR_* of the indexed values, 0 if none */
+  gint pending;             /** rows missing while their updates are deferred */
 } wg_index_header;
 
 
@@ -401,6 +496,15 @@ typedef struct {
 #endif
 
 
+/** index lists of a column above MAX_INDEXED_FIELDNR
+*  Elements of the column map, which is sorted by column.
+*/
+typedef struct {
+  gint column;
+  gint index_list;              /** as index_table[column] */
+  gint template_list;           /** as index_template_table[column] */
+} wg_index_column;
+
 /** highest level index management data
 *  contains lookup table by field number and memory management data
 */
@@ -412,6 +516,9 @@ typedef struct {
   gint index_template_list;     /** sorted list of index masks */
   gint index_template_table[MAX_INDEXED_FIELDNR+1]; /** masks indexed by column */
 #endif
+  gint column_map;              /** wg_index_column array, 0 if none */
+  gint column_map_count;        /** columns in the map */
+  gint column_map_size;         /** allocated size of the map */
 } db_index_area_header;
 
 
@@ -487,6 +594,8 @@ typedef struct _db_memsegment_header {
   // index structures
   db_index_area_header index_control_area_header;
   db_area_header tnode_area_header;
+  db_area_header bnode_area_header;
+  db_area_header rnode_area_header;
   db_area_header indexhdr_area_header;
   db_area_header indextmpl_area_header;
   db_area_header indexhash_area_header;
@@ -511,6 +620,8 @@ typedef struct _db_memsegment_header {
 typedef struct {
   db_memsegment_header *db; /** shared memory header */
   void *logdata;            /** log data structure in local memory */
+  void *indexdelta;         /** deferred index updates, NULL if not
+                             *  deferring (see wg_defer_index_updates()) */
 } db_handle;
 #endif
 
@@ -580,6 +691,8 @@ void wg_free_shortstr(void* db, gint offset);
 void wg_free_word(void* db, gint offset);
 void wg_free_doubleword(void* db, gint offset);
 void wg_free_tnode(void* db, gint offset);
+void wg_free_bnode(void* db, gint offset);
+void wg_free_rnode(void* db, gint offset);
 void wg_free_fixlen_object(void* db, db_area_header *hdr, gint offset);
 
 gint wg_freebuckets_index(void* db, gint size);
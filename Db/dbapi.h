@@ -66,20 +66,35 @@ extern "C" {
 /* Illegal encoded data indicator */
 #define WG_ILLEGAL 0xff
 
-/* Query "arglist" parameters */
+/* Query "arglist" parameters. A condition may be combined with an
+ * expression (WG_EXPR_*), then the expression of the column value
+ * is compared. */
 #define WG_COND_EQUAL       0x0001      /** = */
 #define WG_COND_NOT_EQUAL   0x0002      /** != */
 #define WG_COND_LESSTHAN    0x0004      /** < */
 #define WG_COND_GREATER     0x0008      /** > */
 #define WG_COND_LTEQUAL     0x0010      /** <= */
 #define WG_COND_GTEQUAL     0x0020      /** >= */
+#define WG_COND_CONTAINS_TERM 0x0040    /** string has all the terms */
+#define WG_COND_PREFIX      0x0080      /** string starts with the value */
 
 /* Query types. Python extension module uses the API and needs these. */
 #define WG_QTYPE_TTREE      0x01
 #define WG_QTYPE_HASH       0x02
 #define WG_QTYPE_SCAN       0x04
+#define WG_QTYPE_BTREE      0x08
+#define WG_QTYPE_BITMAP     0x10
+#define WG_QTYPE_FULLTEXT   0x20
+#define WG_QTYPE_RTREE      0x40
 #define WG_QTYPE_PREFETCH   0x80
 
+/* Change event types */
+#define WG_CHANGE_CREATE 1
+#define WG_CHANGE_DELETE 2
+#define WG_CHANGE_SET 3
+#define WG_CHANGE_META 4
+#define WG_CHANGE_NEWLOG 5
+
 /* Direct access to field */
 #define RECORD_HEADER_GINTS 3
 #define wg_field_addr(db,record,fieldnr) (((wg_int*)(record))+RECORD_HEADER_GINTS+(fieldnr))
@@ -112,6 +127,12 @@ typedef struct {
   wg_int direction;
   /* Fields for full scan */
   wg_int curr_record;       /** offset of the current record */
+  /* Fields for bitmap index query */
+  void *bitmap;             /** cursor, NULL if not used */
+  /* Fields for full-text index query */
+  void *fulltext;           /** cursor, NULL if not used */
+  /* Fields for R-tree index query */
+  void *rtree;              /** cursor, NULL if not used */
   /* Fields for prefetch; with/without mpool */
   void *mpool;              /** storage for row offsets */
   void *curr_page;          /** current page of results */
@@ -119,6 +140,23 @@ typedef struct {
   wg_uint res_count;        /** number of rows in results */
 } wg_query;
 
+/** Change event decoded from the journal */
+typedef struct {
+  wg_int lsn;         /** journal position of the entry */
+  wg_int next_lsn;    /** journal position of the following entry */
+  wg_int serial;      /** journal serial number */
+  wg_int type;        /** WG_CHANGE_* */
+  wg_int record;      /** offset of the record */
+  wg_int column;      /** field number (SET) or record length (CREATE) */
+  wg_int value;       /** encoded value (SET) or metadata (META) */
+  wg_int valtype;     /** WG_*TYPE of the value (SET), 0 if not known */
+  wg_int intval;      /** value of WG_INTTYPE */
+  double doubleval;   /** value of WG_DOUBLETYPE */
+  char *str;          /** string or blob data, '\0' terminated */
+  char *extstr;       /** language or type of str, NULL if none */
+  wg_int len;         /** length of str in bytes */
+} wg_change_event;
+
 /* prototypes of wg database api functions
 
 */
@@ -301,10 +339,21 @@ wg_int wg_decode_var(void* db, wg_int data);
 
 
 wg_int wg_dump(void * db,char* fileName); // dump shared memory database to the disk
+wg_int wg_dump_online(void * db,char* fileName); // dump, lock only for a memory copy
+wg_int wg_dump_compact(void * db,char* fileName); // sparse, compressed dump
+wg_int wg_dump_incremental(void * db, char* base, char* fileName); // changes since base
 wg_int wg_import_dump(void * db,char* fileName); // import database from the disk
+wg_int wg_import_incremental(void * db, char* base, char** files,
+  wg_int count); // import a dump and a chain of increments
 wg_int wg_start_logging(void *db); /* activate journal logging globally */
 wg_int wg_stop_logging(void *db); /* deactivate journal logging */
 wg_int wg_replay_log(void *db, char *filename); /* restore from journal */
+wg_int wg_ship_log(void *db, int fd); /* stream journal to a replica */
+wg_int wg_follow_log(void *db, int fd); /* apply a streamed journal */
+void *wg_subscribe_changes(void *db, wg_int from_lsn); /* change feed */
+void *wg_subscribe_journal_file(void *db, char *filename, wg_int from_lsn);
+wg_int wg_fetch_change(void *db, void *feed, wg_change_event *ev, int wait);
+void wg_unsubscribe_changes(void *db, void *feed);
 
 /* ---------- concurrency support  ---------- */
 
@@ -330,6 +379,8 @@ wg_query *wg_make_query(void *db, void *matchrec, wg_int reclen,
 #define wg_make_prefetch_query wg_make_query
 wg_query *wg_make_query_rc(void *db, void *matchrec, wg_int reclen,
   wg_query_arg *arglist, wg_int argc, wg_uint rowlimit);
+wg_query *wg_make_nearest_query(void *db, wg_int xcol, wg_int ycol,
+  double x, double y, wg_uint k);
 void *wg_fetch(void *db, wg_query *query);
 void wg_free_query(void *db, wg_query *query);
 
@@ -0,0 +1,639 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbbitmap.c
+ *  Bitmap index operations.
+ *
+ *  A bitmap index keeps a list of the distinct values of a column.
+ *  The rows of each value are a compressed bitmap of row positions,
+ *  split into containers of 2^16 positions: a container is a sorted
+ *  array while it is small and a bitset when it is dense. Conditions
+ *  on several bitmap indexed columns are combined one container at a
+ *  time with word-wide OR and AND operations.
+ *
+ *  The index is meant for columns with few distinct values, the
+ *  values are searched sequentially.
+ */
+
+/* ====== Includes =============== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+#include "dbdata.h"
+#include "dbcompare.h"
+#include "dbbitmap.h"
+
+
+/* ====== Private headers and defs ======== */
+
+/* Records are aligned to 8 bytes, so the low bits of the offset
+ * are not needed for the position */
+#define BITMAP_ALIGN_BITS 3
+#define BITMAP_POS(o) (((wg_uint) (o)) >> BITMAP_ALIGN_BITS)
+#define BITMAP_REC(p) ((gint) (((wg_uint) (p)) << BITMAP_ALIGN_BITS))
+
+#define BITMAP_KEY(p) ((gint) ((p) >> WG_BITMAP_CHUNK_BITS))
+#define BITMAP_LOW(p) ((unsigned short) ((p) & (WG_BITMAP_CHUNK - 1)))
+
+#define BITMAP_INITIAL_ARRAY 4
+#define BITMAP_INITIAL_CONTAINERS 4
+
+#define CONTAINERS(d, v) ((wg_bitmap_container *) offsettoptr(d, (v)->containers))
+
+/* ======= Private protos ================ */
+
+static gint alloc_area(void *db, gint bytes);
+static void free_area(void *db, gint offset);
+static gint find_value(void *db, wg_index_header *hdr, gint key);
+static void unlink_value(void *db, wg_index_header *hdr, gint value);
+static gint find_container(void *db, wg_bitmap_value *v, gint key);
+static gint value_add(void *db, wg_bitmap_value *v, wg_uint pos);
+static gint value_remove(void *db, wg_bitmap_value *v, wg_uint pos);
+static gint container_add(void *db, wg_bitmap_container *c,
+  unsigned short low);
+static gint container_remove(void *db, wg_bitmap_container *c,
+  unsigned short low);
+static gint array_position(unsigned short *a, gint card, unsigned short low);
+static gint array_to_bitset(void *db, wg_bitmap_container *c);
+static gint bitset_to_array(void *db, wg_bitmap_container *c);
+static void container_or(void *db, wg_bitmap_container *c, wg_uint *bits);
+static gint group_next_key(void *db, wg_bitmap_cursor *cur, gint g, gint key);
+static gint next_container(void *db, wg_bitmap_cursor *cur);
+
+static gint show_bitmap_error(void* db, char* errmsg);
+
+
+/* ====== Functions ============== */
+
+/** Allocate storage for the index
+*  The first gint of the object is the allocator header.
+*  returns the offset of the usable area, 0 on error.
+*/
+static gint alloc_area(void *db, gint bytes) {
+  gint object = wg_alloc_gints(db,
+    &(dbmemsegh(db)->indexhash_area_header),
+    (bytes + sizeof(gint) - 1) / sizeof(gint) + 1);
+  return (object ? object + sizeof(gint) : 0);
+}
+
+static void free_area(void *db, gint offset) {
+  wg_free_object(db, &(dbmemsegh(db)->indexhash_area_header),
+    offset - sizeof(gint));
+}
+
+/** Create an empty bitmap index
+*  returns 0 on success, -1 on error.
+*/
+gint wg_bitmap_create(void *db, wg_index_header *hdr) {
+  BITMAP_VALUES(hdr) = 0;
+  hdr->ctl.m.values = 0;
+  return 0;
+}
+
+/** Release all values of a bitmap index
+*/
+void wg_bitmap_free(void *db, wg_index_header *hdr) {
+  while(BITMAP_VALUES(hdr))
+    unlink_value(db, hdr, BITMAP_VALUES(hdr));
+}
+
+/** Insert a row into a bitmap index
+*  rec - offset of the record, the value is read from it
+*  returns 0 on success, -1 on error.
+*/
+gint wg_bitmap_insert(void *db, wg_index_header *hdr, gint rec) {
+  gint key = wg_get_field(db, offsettoptr(db, rec), hdr->rec_field_index[0]);
+  gint value = find_value(db, hdr, key);
+  wg_bitmap_value *v;
+
+  if(!value) {
+    value = alloc_area(db, sizeof(wg_bitmap_value));
+    if(!value)
+      return show_bitmap_error(db, "Failed to allocate a value");
+    v = (wg_bitmap_value *) offsettoptr(db, value);
+    v->next = BITMAP_VALUES(hdr);
+    v->rows = 0;
+    v->count = 0;
+    v->size = 0;
+    v->containers = 0;
+    BITMAP_VALUES(hdr) = value;
+    hdr->ctl.m.values++;
+  }
+
+  v = (wg_bitmap_value *) offsettoptr(db, value);
+  if(value_add(db, v, BITMAP_POS(rec)) < 0) {
+    if(!v->rows)
+      unlink_value(db, hdr, value);
+    return -1;
+  }
+  return 0;
+}
+
+/** Delete a row from a bitmap index
+*  rec - offset of the record, the value is read from it
+*  returns 0 on success, -1 if the row was not in the index.
+*/
+gint wg_bitmap_delete(void *db, wg_index_header *hdr, gint rec) {
+  gint key = wg_get_field(db, offsettoptr(db, rec), hdr->rec_field_index[0]);
+  gint value = find_value(db, hdr, key);
+  wg_bitmap_value *v;
+
+  if(!value)
+    return -1;
+  v = (wg_bitmap_value *) offsettoptr(db, value);
+  if(!value_remove(db, v, BITMAP_POS(rec)))
+    return -1;
+  if(!v->rows)
+    unlink_value(db, hdr, value);
+  return 0;
+}
+
+/** Return the first row of a value
+*  The rows of a value have equal values in the indexed column, so
+*  the row represents the value in comparisons.
+*/
+gint wg_bitmap_value_row(void *db, gint value) {
+  wg_bitmap_value *v = (wg_bitmap_value *) offsettoptr(db, value);
+  wg_bitmap_container *c = CONTAINERS(db, v);
+  wg_uint pos = ((wg_uint) c->key) << WG_BITMAP_CHUNK_BITS;
+
+  if(c->size) {
+    pos |= ((unsigned short *) offsettoptr(db, c->data))[0];
+  } else {
+    wg_uint *words = (wg_uint *) offsettoptr(db, c->data);
+    gint i = 0, bit = 0;
+    while(!words[i])
+      i++;
+    while(!(words[i] & (((wg_uint) 1) << bit)))
+      bit++;
+    pos |= i * WG_BITMAP_WORD_BITS + bit;
+  }
+  return BITMAP_REC(pos);
+}
+
+/** Find the value of a row
+*  returns the offset of the value, 0 if the index does not have it.
+*/
+static gint find_value(void *db, wg_index_header *hdr, gint key) {
+  gint value = BITMAP_VALUES(hdr);
+  gint column = hdr->rec_field_index[0];
+
+  while(value) {
+    void *row = offsettoptr(db, wg_bitmap_value_row(db, value));
+    if(WG_COMPARE(db, wg_get_field(db, row, column), key) == WG_EQUAL)
+      return value;
+    value = ((wg_bitmap_value *) offsettoptr(db, value))->next;
+  }
+  return 0;
+}
+
+/** Remove a value from the index and release its storage
+*/
+static void unlink_value(void *db, wg_index_header *hdr, gint value) {
+  wg_bitmap_value *v = (wg_bitmap_value *) offsettoptr(db, value);
+  gint *prev = &BITMAP_VALUES(hdr);
+  gint i;
+
+  while(*prev != value)
+    prev = &((wg_bitmap_value *) offsettoptr(db, *prev))->next;
+  *prev = v->next;
+  hdr->ctl.m.values--;
+
+  for(i=0; i<v->count; i++)
+    free_area(db, CONTAINERS(db, v)[i].data);
+  if(v->containers)
+    free_area(db, v->containers);
+  free_area(db, value);
+}
+
+/** Find the position of a container
+*  returns the position of the first container with the same or
+*  a higher key.
+*/
+static gint find_container(void *db, wg_bitmap_value *v, gint key) {
+  wg_bitmap_container *c;
+  gint lo = 0, hi = v->count;
+
+  if(!hi)
+    return 0;
+  c = CONTAINERS(db, v);
+  while(lo < hi) {
+    gint mid = lo + (hi - lo) / 2;
+    if(c[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/** Add a position to the bitmap of a value
+*  returns 1 if added, 0 if it was already there, -1 on error.
+*/
+static gint value_add(void *db, wg_bitmap_value *v, wg_uint pos) {
+  gint key = BITMAP_KEY(pos);
+  gint i = find_container(db, v, key);
+  wg_bitmap_container *c;
+  gint res;
+
+  if(i == v->count || CONTAINERS(db, v)[i].key != key) {
+    gint data = alloc_area(db, BITMAP_INITIAL_ARRAY * sizeof(unsigned short));
+    if(!data)
+      return show_bitmap_error(db, "Failed to allocate a container");
+
+    if(v->count == v->size) {
+      gint size = (v->size ? 2 * v->size : BITMAP_INITIAL_CONTAINERS);
+      gint containers = alloc_area(db, size * sizeof(wg_bitmap_container));
+      if(!containers) {
+        free_area(db, data);
+        return show_bitmap_error(db, "Failed to allocate containers");
+      }
+      if(v->containers) {
+        memcpy(offsettoptr(db, containers), CONTAINERS(db, v),
+          v->count * sizeof(wg_bitmap_container));
+        free_area(db, v->containers);
+      }
+      v->containers = containers;
+      v->size = size;
+    }
+
+    c = CONTAINERS(db, v);
+    memmove(&c[i+1], &c[i], (v->count - i) * sizeof(wg_bitmap_container));
+    c[i].key = key;
+    c[i].card = 0;
+    c[i].size = BITMAP_INITIAL_ARRAY;
+    c[i].data = data;
+    v->count++;
+  }
+
+  c = &CONTAINERS(db, v)[i];
+  res = container_add(db, c, BITMAP_LOW(pos));
+  if(res > 0)
+    v->rows++;
+  return res;
+}
+
+/** Remove a position from the bitmap of a value
+*  returns 1 if removed, 0 if it was not there.
+*/
+static gint value_remove(void *db, wg_bitmap_value *v, wg_uint pos) {
+  gint key = BITMAP_KEY(pos);
+  gint i = find_container(db, v, key);
+  wg_bitmap_container *c;
+
+  if(i == v->count || CONTAINERS(db, v)[i].key != key)
+    return 0;
+  c = CONTAINERS(db, v);
+  if(!container_remove(db, &c[i], BITMAP_LOW(pos)))
+    return 0;
+  v->rows--;
+
+  if(!c[i].card) {
+    free_area(db, c[i].data);
+    memmove(&c[i], &c[i+1], (v->count - i - 1) * sizeof(wg_bitmap_container));
+    v->count--;
+  }
+  return 1;
+}
+
+/** Add a position to a container
+*  A full array is grown until it reaches WG_BITMAP_ARRAY_MAX
+*  elements, then it is converted to a bitset.
+*  returns 1 if added, 0 if it was already there, -1 on error.
+*/
+static gint container_add(void *db, wg_bitmap_container *c,
+  unsigned short low) {
+  if(c->size) {
+    unsigned short *a = (unsigned short *) offsettoptr(db, c->data);
+    gint i = array_position(a, c->card, low);
+
+    if(i < c->card && a[i] == low)
+      return 0;
+    if(c->card == c->size) {
+      if(c->card >= WG_BITMAP_ARRAY_MAX) {
+        if(array_to_bitset(db, c))
+          return -1;
+        goto bitset;
+      } else {
+        gint size = 2 * c->size;
+        gint data = alloc_area(db, size * sizeof(unsigned short));
+        if(!data)
+          return show_bitmap_error(db, "Failed to grow a container");
+        memcpy(offsettoptr(db, data), a, c->card * sizeof(unsigned short));
+        free_area(db, c->data);
+        c->data = data;
+        c->size = size;
+        a = (unsigned short *) offsettoptr(db, data);
+      }
+    }
+    memmove(&a[i+1], &a[i], (c->card - i) * sizeof(unsigned short));
+    a[i] = low;
+    c->card++;
+    return 1;
+  }
+
+bitset:
+  {
+    wg_uint *words = (wg_uint *) offsettoptr(db, c->data);
+    wg_uint bit = ((wg_uint) 1) << (low % WG_BITMAP_WORD_BITS);
+    if(words[low / WG_BITMAP_WORD_BITS] & bit)
+      return 0;
+    words[low / WG_BITMAP_WORD_BITS] |= bit;
+    c->card++;
+    return 1;
+  }
+}
+
+/** Remove a position from a container
+*  A bitset that becomes half full is converted back to an array.
+*  returns 1 if removed, 0 if it was not there.
+*/
+static gint container_remove(void *db, wg_bitmap_container *c,
+  unsigned short low) {
+  if(c->size) {
+    unsigned short *a = (unsigned short *) offsettoptr(db, c->data);
+    gint i = array_position(a, c->card, low);
+
+    if(i == c->card || a[i] != low)
+      return 0;
+    memmove(&a[i], &a[i+1], (c->card - i - 1) * sizeof(unsigned short));
+    c->card--;
+  } else {
+    wg_uint *words = (wg_uint *) offsettoptr(db, c->data);
+    wg_uint bit = ((wg_uint) 1) << (low % WG_BITMAP_WORD_BITS);
+
+    if(!(words[low / WG_BITMAP_WORD_BITS] & bit))
+      return 0;
+    words[low / WG_BITMAP_WORD_BITS] &= ~bit;
+    c->card--;
+    if(c->card && c->card <= WG_BITMAP_ARRAY_MAX / 2)
+      bitset_to_array(db, c); /* on failure, the bitset is kept */
+  }
+  return 1;
+}
+
+/** Find the position of a value in a sorted array
+*/
+static gint array_position(unsigned short *a, gint card, unsigned short low) {
+  gint lo = 0, hi = card;
+
+  while(lo < hi) {
+    gint mid = lo + (hi - lo) / 2;
+    if(a[mid] < low)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/** Convert an array container to a bitset
+*  returns 0 on success, -1 on error.
+*/
+static gint array_to_bitset(void *db, wg_bitmap_container *c) {
+  gint data = alloc_area(db, WG_BITMAP_WORDS * sizeof(wg_uint));
+  unsigned short *a;
+  wg_uint *words;
+  gint i;
+
+  if(!data)
+    return show_bitmap_error(db, "Failed to allocate a bitset");
+  words = (wg_uint *) offsettoptr(db, data);
+  memset(words, 0, WG_BITMAP_WORDS * sizeof(wg_uint));
+  a = (unsigned short *) offsettoptr(db, c->data);
+  for(i=0; i<c->card; i++)
+    words[a[i] / WG_BITMAP_WORD_BITS] |=\
+      ((wg_uint) 1) << (a[i] % WG_BITMAP_WORD_BITS);
+  free_area(db, c->data);
+  c->data = data;
+  c->size = 0;
+  return 0;
+}
+
+/** Convert a bitset container to an array
+*  returns 0 on success, -1 on error.
+*/
+static gint bitset_to_array(void *db, wg_bitmap_container *c) {
+  gint data = alloc_area(db, c->card * sizeof(unsigned short));
+  unsigned short *a;
+  wg_uint *words;
+  gint i, j = 0;
+
+  if(!data)
+    return -1;
+  a = (unsigned short *) offsettoptr(db, data);
+  words = (wg_uint *) offsettoptr(db, c->data);
+  for(i=0; i<WG_BITMAP_WORDS; i++) {
+    wg_uint w = words[i];
+    gint bit = 0;
+    while(w) {
+      if(w & 1)
+        a[j++] = (unsigned short) (i * WG_BITMAP_WORD_BITS + bit);
+      w >>= 1;
+      bit++;
+    }
+  }
+  free_area(db, c->data);
+  c->data = data;
+  c->size = c->card;
+  return 0;
+}
+
+/* ----------------- Query cursor functions -------------- */
+
+/** Create a query cursor
+*  groups - number of groups
+*  values - total number of values in the groups
+*  The caller fills in the group_end and values arrays.
+*  returns NULL on error.
+*/
+wg_bitmap_cursor *wg_bitmap_new_cursor(void *db, gint groups, gint values) {
+  wg_bitmap_cursor *cur = (wg_bitmap_cursor *) malloc(sizeof(wg_bitmap_cursor)
+    + (groups + values) * sizeof(gint));
+
+  if(!cur) {
+    show_bitmap_error(db, "Failed to allocate memory");
+    return NULL;
+  }
+  cur->groups = groups;
+  cur->group_end = (gint *) (cur + 1);
+  cur->values = cur->group_end + groups;
+  cur->key = -1;
+  cur->pos = WG_BITMAP_CHUNK;
+  cur->done = 0;
+  return cur;
+}
+
+void wg_bitmap_free_cursor(void *db, wg_bitmap_cursor *cur) {
+  free(cur);
+}
+
+/** Return the next row of the query result
+*  The rows are returned in the order of their offsets.
+*  returns the record offset, 0 if there are no more rows.
+*/
+gint wg_bitmap_next(void *db, wg_bitmap_cursor *cur) {
+  for(;;) {
+    while(cur->pos < WG_BITMAP_CHUNK) {
+      gint w = cur->pos / WG_BITMAP_WORD_BITS;
+      wg_uint word = cur->bits[w] >> (cur->pos % WG_BITMAP_WORD_BITS);
+
+      if(!word) {
+        cur->pos = (w + 1) * WG_BITMAP_WORD_BITS;
+        continue;
+      }
+      while(!(word & 1)) {
+        word >>= 1;
+        cur->pos++;
+      }
+      return BITMAP_REC((((wg_uint) cur->key) << WG_BITMAP_CHUNK_BITS) |\
+        (wg_uint) cur->pos++);
+    }
+    if(!next_container(db, cur))
+      return 0;
+  }
+}
+
+/** Find the smallest container key of a group
+*  returns the smallest key that is not less than key, -1 if none.
+*/
+static gint group_next_key(void *db, wg_bitmap_cursor *cur, gint g,
+  gint key) {
+  gint i = (g ? cur->group_end[g-1] : 0);
+  gint res = -1;
+
+  for(; i<cur->group_end[g]; i++) {
+    wg_bitmap_value *v = (wg_bitmap_value *) offsettoptr(db, cur->values[i]);
+    gint j = find_container(db, v, key);
+    if(j < v->count) {
+      gint k = CONTAINERS(db, v)[j].key;
+      if(res < 0 || k < res)
+        res = k;
+    }
+  }
+  return res;
+}
+
+/** OR a container into a bitset
+*/
+static void container_or(void *db, wg_bitmap_container *c, wg_uint *bits) {
+  gint i;
+
+  if(c->size) {
+    unsigned short *a = (unsigned short *) offsettoptr(db, c->data);
+    for(i=0; i<c->card; i++)
+      bits[a[i] / WG_BITMAP_WORD_BITS] |=\
+        ((wg_uint) 1) << (a[i] % WG_BITMAP_WORD_BITS);
+  } else {
+    wg_uint *words = (wg_uint *) offsettoptr(db, c->data);
+    for(i=0; i<WG_BITMAP_WORDS; i++)
+      bits[i] |= words[i];
+  }
+}
+
+/** Move the cursor to the next container of the result
+*  Only the keys that every group has are considered.
+*  returns 1 if a non-empty container was found, 0 at the end.
+*/
+static gint next_container(void *db, wg_bitmap_cursor *cur) {
+  gint key = cur->key + 1;
+
+  while(!cur->done) {
+    gint g, i, agreed = 1;
+    wg_uint any = 0;
+
+    for(g=0; g<cur->groups; g++) {
+      gint k = group_next_key(db, cur, g, key);
+      if(k < 0) {
+        cur->done = 1;
+        return 0;
+      }
+      if(k > key) {
+        key = k;
+        agreed = 0;
+      }
+    }
+    if(!cur->groups)
+      cur->done = 1;
+    if(!agreed || cur->done)
+      continue;
+
+    /* Every group has the key: combine the containers */
+    for(g=0; g<cur->groups; g++) {
+      wg_uint *bits = (g ? cur->tmp : cur->bits);
+      memset(bits, 0, WG_BITMAP_WORDS * sizeof(wg_uint));
+      for(i=(g ? cur->group_end[g-1] : 0); i<cur->group_end[g]; i++) {
+        wg_bitmap_value *v = (wg_bitmap_value *) offsettoptr(db,
+          cur->values[i]);
+        gint j = find_container(db, v, key);
+        if(j < v->count && CONTAINERS(db, v)[j].key == key)
+          container_or(db, &CONTAINERS(db, v)[j], bits);
+      }
+      if(g) {
+        for(i=0; i<WG_BITMAP_WORDS; i++)
+          cur->bits[i] &= cur->tmp[i];
+      }
+    }
+    for(i=0; i<WG_BITMAP_WORDS; i++)
+      any |= cur->bits[i];
+
+    if(any) {
+      cur->key = key;
+      cur->pos = 0;
+      return 1;
+    }
+    key++;
+  }
+  return 0;
+}
+
+/* --------------- error handling ------------------------------*/
+
+/** called with err msg
+*
+*  may print or log an error
+*  does not do any jumps etc
+*/
+
+static gint show_bitmap_error(void* db, char* errmsg) {
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"bitmap index error: %s\n",errmsg);
+#endif
+  return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
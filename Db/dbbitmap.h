@@ -0,0 +1,108 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbbitmap.h
+ * Public headers for bitmap index routines
+ */
+
+#ifndef DEFINED_DBBITMAP_H
+#define DEFINED_DBBITMAP_H
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+
+#include "dballoc.h"
+/* For gint data type */
+#include "dbdata.h"
+
+/* ==== Public macros ==== */
+
+#define WG_BITMAP_CHUNK_BITS 16   /** a container holds 2^16 positions */
+#define WG_BITMAP_CHUNK (1<<WG_BITMAP_CHUNK_BITS)
+#define WG_BITMAP_WORD_BITS ((gint) (sizeof(wg_uint) * 8))
+#define WG_BITMAP_WORDS (WG_BITMAP_CHUNK / WG_BITMAP_WORD_BITS)
+#define WG_BITMAP_ARRAY_MAX 4096  /** larger containers are bitsets */
+
+/* Index header helpers */
+#define BITMAP_VALUES(x) (x->ctl.m.offset_values)
+
+/* ====== data structures ======== */
+
+/** container of a bitmap
+*   Holds the positions that share the high bits (key). Up to
+*   WG_BITMAP_ARRAY_MAX positions are kept in a sorted array of
+*   unsigned shorts, more are kept in a bitset of WG_BITMAP_WORDS
+*   words.
+*/
+typedef struct {
+  gint key;             /** high bits of the positions */
+  gint card;            /** number of positions */
+  gint size;            /** allocated size of the array, 0 for a bitset */
+  gint data;            /** offset of the array or the bitset */
+} wg_bitmap_container;
+
+/** rows of a bitmap index that have the same value
+*   The position of a row is its offset divided by the alignment of
+*   the records. The value itself is read from the first row.
+*/
+typedef struct {
+  gint next;            /** next value of the index, 0 if last */
+  gint rows;            /** number of rows */
+  gint count;           /** containers in use */
+  gint size;            /** allocated size of the container array */
+  gint containers;      /** offset of the container array, sorted by key */
+} wg_bitmap_value;
+
+/** query cursor over bitmap indexes
+*   The values of a group are combined with OR, the groups with AND.
+*   The result is produced one container at a time in local memory.
+*/
+typedef struct {
+  gint groups;          /** number of groups */
+  gint *group_end;      /** end of each group in values[] */
+  gint *values;         /** wg_bitmap_value offsets */
+  gint key;             /** key of the current container */
+  gint pos;             /** next position in the current container */
+  int done;             /** no more containers */
+  wg_uint bits[WG_BITMAP_WORDS];  /** current container of the result */
+  wg_uint tmp[WG_BITMAP_WORDS];   /** OR of one group */
+} wg_bitmap_cursor;
+
+/* ==== Protos ==== */
+
+gint wg_bitmap_create(void *db, wg_index_header *hdr);
+void wg_bitmap_free(void *db, wg_index_header *hdr);
+
+gint wg_bitmap_insert(void *db, wg_index_header *hdr, gint rec);
+gint wg_bitmap_delete(void *db, wg_index_header *hdr, gint rec);
+
+gint wg_bitmap_value_row(void *db, gint value);
+
+wg_bitmap_cursor *wg_bitmap_new_cursor(void *db, gint groups, gint values);
+gint wg_bitmap_next(void *db, wg_bitmap_cursor *cur);
+void wg_bitmap_free_cursor(void *db, wg_bitmap_cursor *cur);
+
+#endif /* DEFINED_DBBITMAP_H */
@@ -0,0 +1,741 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbbtree.c
+ *  B-tree index operations.
+ *
+ *  The B-tree keeps the entries (record offsets) of an ordered index
+ *  in wide nodes. The entries are ordered by the indexed columns in
+ *  the order they were given when creating the index (the order of
+ *  hdr->rec_field_index), then by the record offset. Every
+ *  entry has the prefix of the normalized key of the first column
+ *  stored inline, so that a search only reads the records on a prefix
+ *  tie. Empty nodes are removed, but nodes are not merged or
+ *  rebalanced on delete.
+ */
+
+/* ====== Includes =============== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+#include "dbdata.h"
+#include "dbcompare.h"
+#include "dbbtree.h"
+
+
+/* ====== Private headers and defs ======== */
+
+/* Record offsets that sort before and after all entries of a value */
+#define BTREE_REC_FIRST 0
+#define BTREE_REC_LAST ((gint) (~((wg_uint) 0) >> 1))
+
+/* Enough for any tree that fits in the address space */
+#define BTREE_MAX_DEPTH 32
+
+#define LEAF_ENTRIES ((gint) WG_BNODE_LEAF_ENTRIES)
+#define INNER_ENTRIES ((gint) WG_BNODE_INNER_ENTRIES)
+
+/** Search key: values of the leading indexed columns, the prefix
+*  of the first value, and a record offset. A key with fewer values
+*  than the index has columns is used in range searches, with one of
+*  the BTREE_REC_* offsets.
+*/
+typedef struct {
+  wg_uint prefix;
+  gint values[MAX_INDEX_FIELDS];    /** encoded values */
+  gint count;                       /** number of values */
+  gint rec;         /** record offset or BTREE_REC_* */
+} btree_key;
+
+/* ======= Private protos ================ */
+
+static void make_key(void *db, btree_key *k, gint *values, gint count,
+  gint rec);
+static void make_row_key(void *db, wg_index_header *hdr, btree_key *k,
+  gint rec);
+static int compare_key(void *db, wg_index_header *hdr, btree_key *k,
+  wg_uint prefix, gint rec);
+static gint search_leaf(void *db, wg_index_header *hdr,
+  struct wg_bnode *node, btree_key *k);
+static gint search_inner(void *db, wg_index_header *hdr,
+  struct wg_bnode *node, btree_key *k);
+static gint find_leaf(void *db, wg_index_header *hdr, btree_key *k,
+  gint *path, gint *pathidx, gint *depth);
+static gint alloc_bnode(void *db, gint level);
+static gint insert_parent(void *db, wg_index_header *hdr, gint *path,
+  gint *pathidx, gint depth, gint left, wg_uint key, gint rec, gint right);
+static void free_subtree(void *db, gint offset);
+
+static gint show_btree_error(void* db, char* errmsg);
+
+
+/* ====== Functions ============== */
+
+/** Fill in a search key
+*  values - encoded values of the first count indexed columns
+*/
+static void make_key(void *db, btree_key *k, gint *values, gint count,
+  gint rec) {
+  gint i;
+
+  k->prefix = (count > 0 ? wg_normkey_prefix(db, values[0]) : 0);
+  for(i=0; i<count; i++)
+    k->values[i] = values[i];
+  k->count = count;
+  k->rec = rec;
+}
+
+/** Fill in the key of an indexed row
+*/
+static void make_row_key(void *db, wg_index_header *hdr, btree_key *k,
+  gint rec) {
+  void *recptr = offsettoptr(db, rec);
+  gint i;
+
+  for(i=0; i<hdr->fields; i++)
+    k->values[i] = wg_get_field(db, recptr, hdr->rec_field_index[i]);
+  k->prefix = wg_normkey_prefix(db, k->values[0]);
+  k->count = hdr->fields;
+  k->rec = rec;
+}
+
+/** Compare a search key to an entry
+*  The record of the entry is read only if the prefixes are equal
+*  and do not determine the first value, or if the key has values
+*  of the other columns.
+*/
+static int compare_key(void *db, wg_index_header *hdr, btree_key *k,
+  wg_uint prefix, gint rec) {
+  if(k->count > 0) {
+    gint i;
+    if(k->prefix != prefix)
+      return (k->prefix < prefix ? WG_LESSTHAN : WG_GREATER);
+    for(i=((prefix & WG_NORMKEY_EXACT) ? 1 : 0); i<k->count; i++) {
+      gint cr = WG_COMPARE(db, k->values[i],
+        wg_get_field(db, offsettoptr(db, rec), hdr->rec_field_index[i]));
+      if(cr != WG_EQUAL)
+        return (int) cr;
+    }
+  }
+  if(k->rec == rec)
+    return WG_EQUAL;
+  return (k->rec < rec ? WG_LESSTHAN : WG_GREATER);
+}
+
+/** Find the first slot in a leaf that is not smaller than the key
+*/
+static gint search_leaf(void *db, wg_index_header *hdr,
+  struct wg_bnode *node, btree_key *k) {
+  gint lo = 0, hi = node->count;
+
+  while(lo < hi) {
+    gint mid = (lo + hi) >> 1;
+    if(compare_key(db, hdr, k, node->u.leaf.key[mid],
+      node->u.leaf.rec[mid]) == WG_GREATER)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/** Find the child of an inner node that may contain the key
+*/
+static gint search_inner(void *db, wg_index_header *hdr,
+  struct wg_bnode *node, btree_key *k) {
+  gint lo = 1, hi = node->count;
+
+  while(lo < hi) {
+    gint mid = (lo + hi) >> 1;
+    if(compare_key(db, hdr, k, node->u.inner.key[mid],
+      node->u.inner.rec[mid]) == WG_LESSTHAN)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo - 1;
+}
+
+/** Descend to the leaf that may contain the key
+*  If path is not NULL, the inner nodes and the child positions
+*  are stored in path and pathidx, the number of them in depth.
+*  returns the offset of the leaf, 0 on error.
+*/
+static gint find_leaf(void *db, wg_index_header *hdr, btree_key *k,
+  gint *path, gint *pathidx, gint *depth) {
+  gint offset = BTREE_ROOT_NODE(hdr);
+  struct wg_bnode *node = (struct wg_bnode *) offsettoptr(db, offset);
+  gint d = 0;
+
+  while(node->level > 0) {
+    gint i = search_inner(db, hdr, node, k);
+    if(path) {
+      if(d >= BTREE_MAX_DEPTH) {
+        show_btree_error(db, "B-tree is too deep");
+        return 0;
+      }
+      path[d] = offset;
+      pathidx[d] = i;
+    }
+    d++;
+    offset = node->u.inner.child[i];
+    node = (struct wg_bnode *) offsettoptr(db, offset);
+  }
+  if(depth)
+    *depth = d;
+  return offset;
+}
+
+/** Allocate an empty node
+*  returns the offset of the node, 0 on error.
+*/
+static gint alloc_bnode(void *db, gint level) {
+  struct wg_bnode *node;
+  gint offset = wg_alloc_fixlen_object(db,
+    &(dbmemsegh(db)->bnode_area_header));
+
+  if(!offset) {
+    show_btree_error(db, "Failed to allocate a B-tree node");
+    return 0;
+  }
+  node = (struct wg_bnode *) offsettoptr(db, offset);
+  node->level = level;
+  node->count = 0;
+  node->next_offset = 0;
+  node->prev_offset = 0;
+  return offset;
+}
+
+/** Create an empty B-tree
+*  returns 0 on success, -1 on error.
+*/
+gint wg_btree_create(void *db, wg_index_header *hdr) {
+  gint root = alloc_bnode(db, 0);
+
+  if(!root)
+    return -1;
+  BTREE_ROOT_NODE(hdr) = root;
+  BTREE_MIN_LEAF(hdr) = root;
+  BTREE_MAX_LEAF(hdr) = root;
+  return 0;
+}
+
+/** Build a B-tree from entries sorted by the key and record offset
+*  The prefixes of the entries should be filled in.
+*  The nodes are packed full, leaves first, then each level of
+*  inner nodes on top of the previous one.
+*  returns 0 on success, -1 on error.
+*/
+gint wg_btree_build(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, gint count) {
+  gint *child, *minrec;
+  wg_uint *minkey;
+  gint i, j, n, level, prev = 0;
+
+  if(count < 1)
+    return wg_btree_create(db, hdr);
+
+  n = (count + LEAF_ENTRIES - 1) / LEAF_ENTRIES;
+  child = (gint *) malloc(n * sizeof(gint));
+  minrec = (gint *) malloc(n * sizeof(gint));
+  minkey = (wg_uint *) malloc(n * sizeof(wg_uint));
+  if(!child || !minrec || !minkey) {
+    show_btree_error(db, "Failed to allocate memory");
+    goto error;
+  }
+
+  /* Leaves */
+  for(i=0; i<n; i++) {
+    gint start = i * LEAF_ENTRIES;
+    gint end = (start + LEAF_ENTRIES < count ? start + LEAF_ENTRIES : count);
+    struct wg_bnode *node;
+
+    child[i] = alloc_bnode(db, 0);
+    if(!child[i])
+      goto error;
+    node = (struct wg_bnode *) offsettoptr(db, child[i]);
+    for(j=start; j<end; j++) {
+      node->u.leaf.key[j - start] = entries[j].prefix;
+      node->u.leaf.rec[j - start] = entries[j].rec;
+    }
+    node->count = end - start;
+    node->prev_offset = prev;
+    if(prev)
+      ((struct wg_bnode *) offsettoptr(db, prev))->next_offset = child[i];
+    prev = child[i];
+    minkey[i] = node->u.leaf.key[0];
+    minrec[i] = node->u.leaf.rec[0];
+  }
+  BTREE_MIN_LEAF(hdr) = child[0];
+  BTREE_MAX_LEAF(hdr) = prev;
+
+  /* Inner levels, the new nodes replace their children in the arrays */
+  for(level=1; n>1; level++) {
+    gint m = (n + INNER_ENTRIES - 1) / INNER_ENTRIES;
+    for(i=0; i<m; i++) {
+      gint start = i * INNER_ENTRIES;
+      gint end = (start + INNER_ENTRIES < n ? start + INNER_ENTRIES : n);
+      gint offset = alloc_bnode(db, level);
+      struct wg_bnode *node;
+
+      if(!offset)
+        goto error;
+      node = (struct wg_bnode *) offsettoptr(db, offset);
+      for(j=start; j<end; j++) {
+        node->u.inner.child[j - start] = child[j];
+        node->u.inner.key[j - start] = minkey[j];
+        node->u.inner.rec[j - start] = minrec[j];
+      }
+      node->count = end - start;
+      child[i] = offset;
+      minkey[i] = minkey[start];
+      minrec[i] = minrec[start];
+    }
+    n = m;
+  }
+  BTREE_ROOT_NODE(hdr) = child[0];
+
+  free(minkey);
+  free(minrec);
+  free(child);
+  return 0;
+
+error:
+  if(minkey) free(minkey);
+  if(minrec) free(minrec);
+  if(child) free(child);
+  return -1;
+}
+
+/** Release all nodes of a B-tree
+*/
+void wg_btree_free(void *db, wg_index_header *hdr) {
+  if(BTREE_ROOT_NODE(hdr))
+    free_subtree(db, BTREE_ROOT_NODE(hdr));
+  BTREE_ROOT_NODE(hdr) = 0;
+  BTREE_MIN_LEAF(hdr) = 0;
+  BTREE_MAX_LEAF(hdr) = 0;
+}
+
+static void free_subtree(void *db, gint offset) {
+  struct wg_bnode *node = (struct wg_bnode *) offsettoptr(db, offset);
+
+  if(node->level > 0) {
+    gint i;
+    for(i=0; i<node->count; i++)
+      free_subtree(db, node->u.inner.child[i]);
+  }
+  wg_free_bnode(db, offset);
+}
+
+/** Insert an entry into a B-tree
+*  rec - offset of the record, the key is read from it
+*  returns 0 on success, -1 on error.
+*/
+gint wg_btree_insert(void *db, wg_index_header *hdr, gint rec) {
+  gint path[BTREE_MAX_DEPTH], pathidx[BTREE_MAX_DEPTH], depth;
+  gint leafoff, rightoff, slot, split;
+  struct wg_bnode *leaf, *right;
+  btree_key k;
+
+  make_row_key(db, hdr, &k, rec);
+  leafoff = find_leaf(db, hdr, &k, path, pathidx, &depth);
+  if(!leafoff)
+    return -1;
+  leaf = (struct wg_bnode *) offsettoptr(db, leafoff);
+  slot = search_leaf(db, hdr, leaf, &k);
+
+  if(leaf->count < LEAF_ENTRIES) {
+    memmove(&leaf->u.leaf.key[slot + 1], &leaf->u.leaf.key[slot],
+      (leaf->count - slot) * sizeof(wg_uint));
+    memmove(&leaf->u.leaf.rec[slot + 1], &leaf->u.leaf.rec[slot],
+      (leaf->count - slot) * sizeof(gint));
+    leaf->u.leaf.key[slot] = k.prefix;
+    leaf->u.leaf.rec[slot] = rec;
+    leaf->count++;
+    return 0;
+  }
+
+  /* Split the leaf. When appending to the last leaf, it is kept
+   * full, so that ascending keys produce packed leaves. */
+  rightoff = alloc_bnode(db, 0);
+  if(!rightoff)
+    return -1;
+  right = (struct wg_bnode *) offsettoptr(db, rightoff);
+  split = ((slot == LEAF_ENTRIES && !leaf->next_offset) ?
+    LEAF_ENTRIES : LEAF_ENTRIES / 2);
+  memcpy(right->u.leaf.key, &leaf->u.leaf.key[split],
+    (LEAF_ENTRIES - split) * sizeof(wg_uint));
+  memcpy(right->u.leaf.rec, &leaf->u.leaf.rec[split],
+    (LEAF_ENTRIES - split) * sizeof(gint));
+  right->count = LEAF_ENTRIES - split;
+  leaf->count = split;
+
+  right->next_offset = leaf->next_offset;
+  right->prev_offset = leafoff;
+  if(leaf->next_offset)
+    ((struct wg_bnode *) offsettoptr(db,
+      leaf->next_offset))->prev_offset = rightoff;
+  else
+    BTREE_MAX_LEAF(hdr) = rightoff;
+  leaf->next_offset = rightoff;
+
+  if(slot < split) {
+    memmove(&leaf->u.leaf.key[slot + 1], &leaf->u.leaf.key[slot],
+      (leaf->count - slot) * sizeof(wg_uint));
+    memmove(&leaf->u.leaf.rec[slot + 1], &leaf->u.leaf.rec[slot],
+      (leaf->count - slot) * sizeof(gint));
+    leaf->u.leaf.key[slot] = k.prefix;
+    leaf->u.leaf.rec[slot] = rec;
+    leaf->count++;
+  } else {
+    slot -= split;
+    memmove(&right->u.leaf.key[slot + 1], &right->u.leaf.key[slot],
+      (right->count - slot) * sizeof(wg_uint));
+    memmove(&right->u.leaf.rec[slot + 1], &right->u.leaf.rec[slot],
+      (right->count - slot) * sizeof(gint));
+    right->u.leaf.key[slot] = k.prefix;
+    right->u.leaf.rec[slot] = rec;
+    right->count++;
+  }
+
+  return insert_parent(db, hdr, path, pathidx, depth, leafoff,
+    right->u.leaf.key[0], right->u.leaf.rec[0], rightoff);
+}
+
+/** Add a new child to the parent of a split node
+*  left - the node that was split
+*  key, rec - smallest entry of the new node
+*  right - the new node
+*  Splits the inner nodes up the path as needed.
+*  returns 0 on success, -1 on error.
+*/
+static gint insert_parent(void *db, wg_index_header *hdr, gint *path,
+  gint *pathidx, gint depth, gint left, wg_uint key, gint rec, gint right) {
+  struct wg_bnode *node;
+  gint root;
+
+  while(depth > 0) {
+    gint offset, pos, split, newoff;
+    struct wg_bnode *newnode, *dest;
+
+    depth--;
+    offset = path[depth];
+    node = (struct wg_bnode *) offsettoptr(db, offset);
+    pos = pathidx[depth] + 1;
+    dest = node;
+
+    if(node->count == INNER_ENTRIES) {
+      newoff = alloc_bnode(db, node->level);
+      if(!newoff)
+        return -1;
+      newnode = (struct wg_bnode *) offsettoptr(db, newoff);
+      split = INNER_ENTRIES / 2;
+      memcpy(newnode->u.inner.key, &node->u.inner.key[split],
+        (INNER_ENTRIES - split) * sizeof(wg_uint));
+      memcpy(newnode->u.inner.rec, &node->u.inner.rec[split],
+        (INNER_ENTRIES - split) * sizeof(gint));
+      memcpy(newnode->u.inner.child, &node->u.inner.child[split],
+        (INNER_ENTRIES - split) * sizeof(gint));
+      newnode->count = INNER_ENTRIES - split;
+      node->count = split;
+      if(pos > split) {
+        dest = newnode;
+        pos -= split;
+      }
+    } else {
+      newoff = 0;
+      newnode = NULL;
+    }
+
+    memmove(&dest->u.inner.key[pos + 1], &dest->u.inner.key[pos],
+      (dest->count - pos) * sizeof(wg_uint));
+    memmove(&dest->u.inner.rec[pos + 1], &dest->u.inner.rec[pos],
+      (dest->count - pos) * sizeof(gint));
+    memmove(&dest->u.inner.child[pos + 1], &dest->u.inner.child[pos],
+      (dest->count - pos) * sizeof(gint));
+    dest->u.inner.key[pos] = key;
+    dest->u.inner.rec[pos] = rec;
+    dest->u.inner.child[pos] = right;
+    dest->count++;
+
+    if(!newnode)
+      return 0;
+    left = offset;
+    key = newnode->u.inner.key[0];
+    rec = newnode->u.inner.rec[0];
+    right = newoff;
+  }
+
+  /* The root was split */
+  node = (struct wg_bnode *) offsettoptr(db, left);
+  root = alloc_bnode(db, node->level + 1);
+  if(!root)
+    return -1;
+  node = (struct wg_bnode *) offsettoptr(db, root);
+  node->u.inner.key[0] = 0;
+  node->u.inner.rec[0] = 0;
+  node->u.inner.child[0] = left;
+  node->u.inner.key[1] = key;
+  node->u.inner.rec[1] = rec;
+  node->u.inner.child[1] = right;
+  node->count = 2;
+  BTREE_ROOT_NODE(hdr) = root;
+  return 0;
+}
+
+/** Delete an entry from a B-tree
+*  rec - offset of the record, the key is read from it
+*  Nodes that become empty are removed. The separators that
+*  pointed to the deleted entry are replaced by the next entry,
+*  since the record may change after it is removed from the index.
+*  returns 0 on success, -1 if the entry was not found.
+*/
+gint wg_btree_delete(void *db, wg_index_header *hdr, gint rec) {
+  gint path[BTREE_MAX_DEPTH], pathidx[BTREE_MAX_DEPTH], depth;
+  gint offset, slot, lastidx = 0, succrec = 0;
+  wg_uint succkey = 0;
+  struct wg_bnode *node;
+  btree_key k;
+
+  make_row_key(db, hdr, &k, rec);
+  offset = find_leaf(db, hdr, &k, path, pathidx, &depth);
+  if(!offset)
+    return -1;
+  node = (struct wg_bnode *) offsettoptr(db, offset);
+  slot = search_leaf(db, hdr, node, &k);
+  if(slot >= node->count || node->u.leaf.rec[slot] != rec)
+    return -1;
+
+  node->count--;
+  memmove(&node->u.leaf.key[slot], &node->u.leaf.key[slot + 1],
+    (node->count - slot) * sizeof(wg_uint));
+  memmove(&node->u.leaf.rec[slot], &node->u.leaf.rec[slot + 1],
+    (node->count - slot) * sizeof(gint));
+
+  /* The entry that follows the deleted one */
+  if(!slot) {
+    if(node->count) {
+      succkey = node->u.leaf.key[0];
+      succrec = node->u.leaf.rec[0];
+    } else if(node->next_offset) {
+      struct wg_bnode *next = \
+        (struct wg_bnode *) offsettoptr(db, node->next_offset);
+      succkey = next->u.leaf.key[0];
+      succrec = next->u.leaf.rec[0];
+    }
+  }
+
+  /* Remove the empty nodes */
+  while(!node->count && depth > 0) {
+    struct wg_bnode *parent;
+    gint idx;
+
+    if(!node->level) {
+      if(node->prev_offset)
+        ((struct wg_bnode *) offsettoptr(db,
+          node->prev_offset))->next_offset = node->next_offset;
+      else
+        BTREE_MIN_LEAF(hdr) = node->next_offset;
+      if(node->next_offset)
+        ((struct wg_bnode *) offsettoptr(db,
+          node->next_offset))->prev_offset = node->prev_offset;
+      else
+        BTREE_MAX_LEAF(hdr) = node->prev_offset;
+    }
+    wg_free_bnode(db, offset);
+
+    depth--;
+    offset = path[depth];
+    idx = pathidx[depth];
+    parent = (struct wg_bnode *) offsettoptr(db, offset);
+    parent->count--;
+    memmove(&parent->u.inner.key[idx], &parent->u.inner.key[idx + 1],
+      (parent->count - idx) * sizeof(wg_uint));
+    memmove(&parent->u.inner.rec[idx], &parent->u.inner.rec[idx + 1],
+      (parent->count - idx) * sizeof(gint));
+    memmove(&parent->u.inner.child[idx], &parent->u.inner.child[idx + 1],
+      (parent->count - idx) * sizeof(gint));
+    lastidx = idx;
+    node = parent;
+  }
+
+  /* If the deleted entry was the smallest in the remaining subtree,
+   * it is the separator in the nearest ancestor where the subtree
+   * is not the leftmost child. A separator removed together with
+   * its child needs no update. */
+  if(!slot && !lastidx) {
+    while(depth > 0) {
+      depth--;
+      if(pathidx[depth] > 0) {
+        struct wg_bnode *parent = \
+          (struct wg_bnode *) offsettoptr(db, path[depth]);
+        parent->u.inner.key[pathidx[depth]] = succkey;
+        parent->u.inner.rec[pathidx[depth]] = succrec;
+        break;
+      }
+    }
+  }
+
+  /* Shrink the tree from the top */
+  offset = BTREE_ROOT_NODE(hdr);
+  node = (struct wg_bnode *) offsettoptr(db, offset);
+  if(node->level > 0 && !node->count) {
+    node->level = 0;
+    BTREE_MIN_LEAF(hdr) = offset;
+    BTREE_MAX_LEAF(hdr) = offset;
+  }
+  while(node->level > 0 && node->count == 1) {
+    BTREE_ROOT_NODE(hdr) = node->u.inner.child[0];
+    wg_free_bnode(db, offset);
+    offset = BTREE_ROOT_NODE(hdr);
+    node = (struct wg_bnode *) offsettoptr(db, offset);
+  }
+  return 0;
+}
+
+/** Find the entries of a B-tree that are in the given range
+*  prefix - values of the first prefix_count indexed columns that
+*    the entries must be equal to (NULL if prefix_count is 0)
+*  The bounds are encoded values of the next indexed column,
+*  WG_ILLEGAL means no bound. The first and the last entry in range
+*  are returned as leaf offsets and slots. If the range is empty,
+*  both offsets are 0.
+*  returns 0 on success, -1 on error.
+*/
+gint wg_btree_find_range(void *db, wg_index_header *hdr,
+  gint *prefix, gint prefix_count,
+  gint start_bound, gint end_bound, gint start_inclusive, gint end_inclusive,
+  gint *curr_offset, gint *curr_slot, gint *end_offset, gint *end_slot) {
+  gint values[MAX_INDEX_FIELDS];
+  gint co, cs, eo, es, i;
+  struct wg_bnode *node;
+  btree_key k;
+
+  if(prefix_count < 0 || prefix_count >= hdr->fields) {
+    show_btree_error(db, "Invalid number of prefix values");
+    return -1;
+  }
+  for(i=0; i<prefix_count; i++)
+    values[i] = prefix[i];
+
+  /* First entry that is in range */
+  if(start_bound == WG_ILLEGAL && !prefix_count) {
+    co = BTREE_MIN_LEAF(hdr);
+    cs = 0;
+  } else {
+    if(start_bound == WG_ILLEGAL) {
+      make_key(db, &k, values, prefix_count, BTREE_REC_FIRST);
+    } else {
+      values[prefix_count] = start_bound;
+      make_key(db, &k, values, prefix_count + 1,
+        (start_inclusive ? BTREE_REC_FIRST : BTREE_REC_LAST));
+    }
+    co = find_leaf(db, hdr, &k, NULL, NULL, NULL);
+    if(!co)
+      return -1;
+    cs = search_leaf(db, hdr, (struct wg_bnode *) offsettoptr(db, co), &k);
+  }
+  node = (struct wg_bnode *) offsettoptr(db, co);
+  if(cs >= node->count) {
+    co = node->next_offset;
+    cs = 0;
+  }
+
+  /* Last entry that is in range */
+  if(end_bound == WG_ILLEGAL && !prefix_count) {
+    eo = BTREE_MAX_LEAF(hdr);
+    es = ((struct wg_bnode *) offsettoptr(db, eo))->count - 1;
+  } else {
+    if(end_bound == WG_ILLEGAL) {
+      make_key(db, &k, values, prefix_count, BTREE_REC_LAST);
+    } else {
+      values[prefix_count] = end_bound;
+      make_key(db, &k, values, prefix_count + 1,
+        (end_inclusive ? BTREE_REC_LAST : BTREE_REC_FIRST));
+    }
+    eo = find_leaf(db, hdr, &k, NULL, NULL, NULL);
+    if(!eo)
+      return -1;
+    es = search_leaf(db, hdr,
+      (struct wg_bnode *) offsettoptr(db, eo), &k) - 1;
+  }
+  if(es < 0) {
+    eo = ((struct wg_bnode *) offsettoptr(db, eo))->prev_offset;
+    if(eo)
+      es = ((struct wg_bnode *) offsettoptr(db, eo))->count - 1;
+  }
+
+  /* The range is empty if the first entry is after the last one */
+  if(co && eo && (co != eo || cs > es)) {
+    struct wg_bnode *last = (struct wg_bnode *) offsettoptr(db, eo);
+
+    node = (struct wg_bnode *) offsettoptr(db, co);
+    make_row_key(db, hdr, &k, node->u.leaf.rec[cs]);
+    if(compare_key(db, hdr, &k,
+      last->u.leaf.key[es], last->u.leaf.rec[es]) == WG_GREATER)
+      co = 0;
+  }
+  if(!co || !eo) {
+    co = 0;
+    eo = 0;
+  }
+
+  *curr_offset = co;
+  *curr_slot = cs;
+  *end_offset = eo;
+  *end_slot = es;
+  return 0;
+}
+
+
+/* --------------- error handling ------------------------------*/
+
+/** called with err msg
+*
+*  may print or log an error
+*  does not do any jumps etc
+*/
+
+static gint show_btree_error(void* db, char* errmsg) {
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"B-tree index error: %s\n",errmsg);
+#endif
+  return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,104 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbbtree.h
+ * Public headers for B-tree index routines
+ */
+
+#ifndef DEFINED_DBBTREE_H
+#define DEFINED_DBBTREE_H
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+
+#include "dballoc.h"
+/* For gint data type */
+#include "dbdata.h"
+/* For wg_index_entry */
+#include "dbindex.h"
+
+/* ==== Public macros ==== */
+
+/** Node size in bytes, a multiple of CACHE_LINE_BYTES */
+#define WG_BNODE_SIZE 512
+
+#define WG_BNODE_LEAF_ENTRIES \
+  ((WG_BNODE_SIZE - 4*sizeof(gint)) / (2*sizeof(gint)))
+#define WG_BNODE_INNER_ENTRIES \
+  ((WG_BNODE_SIZE - 4*sizeof(gint)) / (3*sizeof(gint)))
+
+/* Index header helpers */
+#define BTREE_ROOT_NODE(x) (x->ctl.b.offset_root_node)
+#define BTREE_MIN_LEAF(x) (x->ctl.b.offset_min_leaf)
+#define BTREE_MAX_LEAF(x) (x->ctl.b.offset_max_leaf)
+
+/* ====== data structures ======== */
+
+/** structure of B-tree node
+*   Entries are ordered by the values of the indexed columns (in the
+*   order of hdr->rec_field_index) and then by the record offset. Each
+*   entry carries the prefix of the normalized key of the first
+*   column (see wg_normkey_prefix()), so most comparisons are done
+*   inside the node, without fetching the record. Leaves are chained
+*   for range scans.
+*
+*   In an inner node, key[i] and rec[i] hold the smallest entry of
+*   the subtree of child[i]. Slot 0 of the separators is not used.
+*/
+struct wg_bnode {
+  gint level;           /** 0 for leaves */
+  gint count;           /** number of entries */
+  gint next_offset;     /** next leaf, 0 for inner nodes */
+  gint prev_offset;     /** previous leaf, 0 for inner nodes */
+  union {
+    struct {
+      wg_uint key[WG_BNODE_LEAF_ENTRIES];    /** key prefixes */
+      gint rec[WG_BNODE_LEAF_ENTRIES];       /** record offsets */
+    } leaf;
+    struct {
+      wg_uint key[WG_BNODE_INNER_ENTRIES];   /** separator prefixes */
+      gint rec[WG_BNODE_INNER_ENTRIES];      /** separator records */
+      gint child[WG_BNODE_INNER_ENTRIES];    /** child node offsets */
+    } inner;
+  } u;
+};
+
+/* ==== Protos ==== */
+
+gint wg_btree_create(void *db, wg_index_header *hdr);
+gint wg_btree_build(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, gint count);
+void wg_btree_free(void *db, wg_index_header *hdr);
+
+gint wg_btree_insert(void *db, wg_index_header *hdr, gint rec);
+gint wg_btree_delete(void *db, wg_index_header *hdr, gint rec);
+
+gint wg_btree_find_range(void *db, wg_index_header *hdr,
+  gint *prefix, gint prefix_count,
+  gint start_bound, gint end_bound, gint start_inclusive, gint end_inclusive,
+  gint *curr_offset, gint *curr_slot, gint *end_offset, gint *end_slot);
+
+#endif /* DEFINED_DBBTREE_H */
@@ -39,6 +39,23 @@ extern "C" {
 
 #include "dbcompare.h"
 
+/* Length byte of normalized integers. Non-negative values use
+ * NORMKEY_INT_BIAS plus the number of bytes, negative values
+ * NORMKEY_INT_BIAS - 1 minus the number of bytes. */
+#define NORMKEY_INT_BIAS 0x80
+
+/* ======= Private protos ================ */
+
+static gint normkey_byte(unsigned char *buf, gint size, gint pos,
+  unsigned char c);
+static gint normkey_int(unsigned char *buf, gint size, gint pos, gint val);
+static gint normkey_double(unsigned char *buf, gint size, gint pos,
+  double val);
+static gint normkey_str(unsigned char *buf, gint size, gint pos,
+  const char *str);
+static gint normkey_blob(unsigned char *buf, gint size, gint pos,
+  const char *data, gint len);
+
 /* ====== Functions ============== */
 
 /** Compare two encoded values
@@ -269,6 +286,182 @@ gint wg_compare(void *db, gint a, gint b, int depth) {
     return (typea>typeb ? WG_GREATER : WG_LESSTHAN);
 }
 
+/** Encode a value as a normalized key
+ * enc - encoded value
+ * buf - buffer for the key
+ * size - size of the buffer. If the key is longer, it is truncated.
+ *
+ * Normalized keys are byte strings that order like the values:
+ * comparing the keys of a and b with memcmp(), and the shorter key
+ * first if one is a prefix of the other, gives the same result as
+ * wg_compare(a, b). The first byte is the type code, so different
+ * types are ordered as in wg_compare(). No key is a prefix of
+ * another key.
+ *
+ * returns the length of the whole key. If the value has no normalized
+ * form (records), returns -1 and only the type byte is written;
+ * values of such types have to be compared with wg_compare().
+ */
+gint wg_encode_normkey(void *db, gint enc, unsigned char *buf, gint size) {
+  gint type = wg_get_encoded_type(db, enc);
+  gint len;
+  char *str;
+
+  len = normkey_byte(buf, size, 0, (unsigned char) type);
+  switch(type) {
+    case WG_NULLTYPE:
+      break;
+    case WG_INTTYPE:
+      len = normkey_int(buf, size, len, wg_decode_int(db, enc));
+      break;
+    case WG_DATETYPE:
+      len = normkey_int(buf, size, len, wg_decode_date(db, enc));
+      break;
+    case WG_TIMETYPE:
+      len = normkey_int(buf, size, len, wg_decode_time(db, enc));
+      break;
+    case WG_VARTYPE:
+      len = normkey_int(buf, size, len, wg_decode_var(db, enc));
+      break;
+    case WG_ANONCONSTTYPE:
+      /* wg_compare() orders these by the encoded value */
+      len = normkey_int(buf, size, len, enc);
+      break;
+    case WG_DOUBLETYPE:
+      len = normkey_double(buf, size, len, wg_decode_double(db, enc));
+      break;
+    case WG_FIXPOINTTYPE:
+      len = normkey_double(buf, size, len, wg_decode_fixpoint(db, enc));
+      break;
+    case WG_STRTYPE:
+      /* lang is ignored */
+      len = normkey_str(buf, size, len, wg_decode_str(db, enc));
+      break;
+    case WG_URITYPE:
+      len = normkey_str(buf, size, len, wg_decode_uri_prefix(db, enc));
+      len = normkey_str(buf, size, len, wg_decode_uri(db, enc));
+      break;
+    case WG_XMLLITERALTYPE:
+      len = normkey_str(buf, size, len,
+        wg_decode_xmlliteral_xsdtype(db, enc));
+      len = normkey_str(buf, size, len, wg_decode_xmlliteral(db, enc));
+      break;
+    case WG_CHARTYPE:
+      len = normkey_byte(buf, size, len,
+        (unsigned char) wg_decode_char(db, enc));
+      break;
+    case WG_BLOBTYPE:
+      str = wg_decode_blob(db, enc);
+      len = normkey_blob(buf, size, len, str,
+        (str ? wg_decode_blob_len(db, enc) : 0));
+      break;
+    default:
+      return -1;
+  }
+  return len;
+}
+
+/** Compute the one-word prefix of a normalized key
+ * The prefix holds the first bytes of the key in the order of
+ * significance and WG_NORMKEY_EXACT in the lowest byte, if the
+ * whole key fits. Prefixes compare as unsigned integers in the
+ * same order as the values, and if two prefixes are equal and
+ * exact, so are the values. Otherwise the values need to be
+ * compared with wg_compare() to break the tie.
+ */
+wg_uint wg_normkey_prefix(void *db, gint enc) {
+  unsigned char buf[sizeof(wg_uint)];
+  wg_uint prefix = 0;
+  gint len, i, n = sizeof(wg_uint) - 1;
+
+  len = wg_encode_normkey(db, enc, buf, n);
+  for(i=0; i<n; i++) {
+    prefix <<= 8;
+    if(i < len || !i)
+      prefix |= buf[i];
+  }
+  prefix <<= 8;
+  if(len >= 0 && len <= n)
+    prefix |= WG_NORMKEY_EXACT;
+  return prefix;
+}
+
+/** Store a byte of the key, if there is space for it
+ *  returns the new length of the key.
+ */
+static gint normkey_byte(unsigned char *buf, gint size, gint pos,
+  unsigned char c) {
+  if(pos < size)
+    buf[pos] = c;
+  return pos + 1;
+}
+
+/** Integer key: a length byte followed by the significant bytes
+ *  Negative values store the bytes of the value itself, which
+ *  are the complement of the magnitude bytes.
+ */
+static gint normkey_int(unsigned char *buf, gint size, gint pos, gint val) {
+  wg_uint mag = (val < 0 ? ~((wg_uint) val) : (wg_uint) val);
+  gint n = 0, i;
+
+  while(n < (gint) sizeof(wg_uint) && (mag >> (8*n)))
+    n++;
+  pos = normkey_byte(buf, size, pos, (unsigned char) (val < 0 ?
+    NORMKEY_INT_BIAS - 1 - n : NORMKEY_INT_BIAS + n));
+  for(i=n-1; i>=0; i--)
+    pos = normkey_byte(buf, size, pos,
+      (unsigned char) (((wg_uint) val) >> (8*i)));
+  return pos;
+}
+
+/** Floating point key: IEEE 754 bits with the sign handled so
+ *  that the bytes order like the numbers.
+ */
+static gint normkey_double(unsigned char *buf, gint size, gint pos,
+  double val) {
+  guint64 bits;
+  int i;
+
+  if(val == 0.0)
+    val = 0.0; /* -0.0 is equal to 0.0 */
+  memcpy(&bits, &val, sizeof(guint64));
+  if(bits & (((guint64) 1) << 63))
+    bits = ~bits;
+  else
+    bits |= ((guint64) 1) << 63;
+  for(i=7; i>=0; i--)
+    pos = normkey_byte(buf, size, pos, (unsigned char) (bits >> (8*i)));
+  return pos;
+}
+
+/** String key: the characters and the terminating 0
+ *  A missing string is treated as an empty one.
+ */
+static gint normkey_str(unsigned char *buf, gint size, gint pos,
+  const char *str) {
+  if(str) {
+    for(; *str; str++)
+      pos = normkey_byte(buf, size, pos, (unsigned char) *str);
+  }
+  return normkey_byte(buf, size, pos, 0);
+}
+
+/** Blob key: 0 bytes are escaped as 0 0xff and the key is
+ *  terminated with 0 0, so that a shorter blob orders first.
+ */
+static gint normkey_blob(unsigned char *buf, gint size, gint pos,
+  const char *data, gint len) {
+  gint i;
+
+  for(i=0; i<len; i++) {
+    pos = normkey_byte(buf, size, pos, (unsigned char) data[i]);
+    if(!data[i])
+      pos = normkey_byte(buf, size, pos, 0xff);
+  }
+  pos = normkey_byte(buf, size, pos, 0);
+  return normkey_byte(buf, size, pos, 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
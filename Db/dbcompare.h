@@ -60,8 +60,14 @@
 #define WG_COMPARE(d,a,b) (a==b ? WG_EQUAL :\
   wg_compare(d,a,b,WG_COMPARE_REC_DEPTH))
 
+/* Lowest byte of a normalized key prefix, set if the prefix
+ * contains the whole key */
+#define WG_NORMKEY_EXACT 1
+
 /* ==== Protos ==== */
 
 gint wg_compare(void *db, gint a, gint b, int depth);
+gint wg_encode_normkey(void *db, gint enc, unsigned char *buf, gint size);
+wg_uint wg_normkey_prefix(void *db, gint enc);
 
 #endif /* DEFINED_DBCOMPARE_H */
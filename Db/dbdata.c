@@ -471,7 +471,6 @@ void *wg_get_next_parent(void* db, void* record, void *parent) {
 static gint remove_backlink_index_entries(void *db, gint *record,
   gint value, gint depth) {
   gint col, length, err = 0;
-  db_memsegment_header *dbh = dbmemsegh(db);
 
   if(!is_special_record(record)) {
     /* Find all fields in the record that match value (which is actually
@@ -479,8 +478,6 @@ static gint remove_backlink_index_entries(void *db, gint *record,
      * indexes. It will be recreated in the indexes by wg_set_field() later.
      */
     length = getusedobjectwantedgintsnr(*record) - RECORD_HEADER_GINTS;
-    if(length > MAX_INDEXED_FIELDNR)
-      length = MAX_INDEXED_FIELDNR + 1;
 
     for(col=0; col<length; col++) {
       if(*(record + RECORD_HEADER_GINTS + col) == value) {
@@ -488,7 +485,8 @@ static gint remove_backlink_index_entries(void *db, gint *record,
          * we don't need to deal with index templates here
          * (record links are not allowed in templates).
          */
-        if(dbh->index_control_area_header.index_table[col]) {
+        gint *ilist = wg_index_column_list(db, col, 0);
+        if(ilist && *ilist) {
           if(wg_index_del_field(db, record, col) < -1)
             return -1;
         }
@@ -529,7 +527,6 @@ static gint remove_backlink_index_entries(void *db, gint *record,
 static gint restore_backlink_index_entries(void *db, gint *record,
   gint value, gint depth) {
   gint col, length, err = 0;
-  db_memsegment_header *dbh = dbmemsegh(db);
 
   if(!is_special_record(record)) {
     /* Find all fields in the record that match value (which is actually
@@ -537,12 +534,11 @@ static gint restore_backlink_index_entries(void *db, gint *record,
      * indexes.
      */
     length = getusedobjectwantedgintsnr(*record) - RECORD_HEADER_GINTS;
-    if(length > MAX_INDEXED_FIELDNR)
-      length = MAX_INDEXED_FIELDNR + 1;
 
     for(col=0; col<length; col++) {
       if(*(record + RECORD_HEADER_GINTS + col) == value) {
-        if(dbh->index_control_area_header.index_table[col]) {
+        gint *ilist = wg_index_column_list(db, col, 0);
+        if(ilist && *ilist) {
           if(wg_index_add_field(db, record, col) < -1)
             return -1;
         }
@@ -615,7 +611,9 @@ wg_int wg_set_field(void* db, void* record, wg_int fieldnr, wg_int data) {
   gint backlink_list;           /** start of backlinks for this record */
   gint rec_enc = WG_ILLEGAL;    /** this record as encoded value. */
 #endif
+#ifdef USE_DBLOG
   db_memsegment_header *dbh = dbmemsegh(db);
+#endif
 #ifdef USE_CHILD_DB
   void *offset_owner = dbmemseg(db);
 #endif
@@ -637,14 +635,7 @@ wg_int wg_set_field(void* db, void* record, wg_int fieldnr, wg_int data) {
   fielddata=*fieldadr;
 
   /* Update index(es) while the old value is still in the db */
-#ifdef USE_INDEX_TEMPLATE
-  if(!is_special_record(record) && fieldnr<=MAX_INDEXED_FIELDNR &&\
-    (dbh->index_control_area_header.index_table[fieldnr] ||\
-     dbh->index_control_area_header.index_template_table[fieldnr])) {
-#else
-  if(!is_special_record(record) && fieldnr<=MAX_INDEXED_FIELDNR &&\
-    dbh->index_control_area_header.index_table[fieldnr]) {
-#endif
+  if(!is_special_record(record) && COLUMN_INDEXED(db, fieldnr)) {
     if(wg_index_del_field(db, record, fieldnr) < -1)
       return -3; /* index error */
   }
@@ -736,14 +727,7 @@ setfld_backlink_removed:
   }
 
   /* Update index after new value is written */
-#ifdef USE_INDEX_TEMPLATE
-  if(!is_special_record(record) && fieldnr<=MAX_INDEXED_FIELDNR &&\
-    (dbh->index_control_area_header.index_table[fieldnr] ||\
-     dbh->index_control_area_header.index_template_table[fieldnr])) {
-#else
-  if(!is_special_record(record) && fieldnr<=MAX_INDEXED_FIELDNR &&\
-    dbh->index_control_area_header.index_table[fieldnr]) {
-#endif
+  if(!is_special_record(record) && COLUMN_INDEXED(db, fieldnr)) {
     if(wg_index_add_field(db, record, fieldnr) < -1)
       return -3;
   }
@@ -817,7 +801,9 @@ wg_int wg_set_new_field(void* db, void* record, wg_int fieldnr, wg_int data) {
 #ifdef USE_BACKLINKING
   gint backlink_list;           /** start of backlinks for this record */
 #endif
+#ifdef USE_DBLOG
   db_memsegment_header *dbh = dbmemsegh(db);
+#endif
 #ifdef USE_CHILD_DB
   void *offset_owner = dbmemseg(db);
 #endif
@@ -866,14 +852,7 @@ wg_int wg_set_new_field(void* db, void* record, wg_int fieldnr, wg_int data) {
   }
 
   /* Update index after new value is written */
-#ifdef USE_INDEX_TEMPLATE
-  if(!is_special_record(record) && fieldnr<=MAX_INDEXED_FIELDNR &&\
-    (dbh->index_control_area_header.index_table[fieldnr] ||\
-     dbh->index_control_area_header.index_template_table[fieldnr])) {
-#else
-  if(!is_special_record(record) && fieldnr<=MAX_INDEXED_FIELDNR &&\
-    dbh->index_control_area_header.index_table[fieldnr]) {
-#endif
+  if(!is_special_record(record) && COLUMN_INDEXED(db, fieldnr)) {
     if(wg_index_add_field(db, record, fieldnr) < -1)
       return -3;
   }
@@ -999,7 +978,9 @@ wg_int wg_set_rec_field(void* db, void* record, wg_int fieldnr, void* data) {
 
 wg_int wg_update_atomic_field(void* db, void* record, wg_int fieldnr, wg_int data, wg_int old_data) {
   gint* fieldadr;
+#ifdef USE_DBLOG
   db_memsegment_header *dbh = dbmemsegh(db);
+#endif
   gint tmp;
 
   // basic sanity check
@@ -1010,14 +991,7 @@ wg_int wg_update_atomic_field(void* db, void* record, wg_int fieldnr, wg_int dat
   if (!isimmediatedata(data)) return -10;
   if (!isimmediatedata(old_data)) return -11;
   // check whether there is index on the field
-#ifdef USE_INDEX_TEMPLATE
-  if(!is_special_record(record) && fieldnr<=MAX_INDEXED_FIELDNR &&\
-    (dbh->index_control_area_header.index_table[fieldnr] ||\
-     dbh->index_control_area_header.index_template_table[fieldnr])) {
-#else
-  if(!is_special_record(record) && fieldnr<=MAX_INDEXED_FIELDNR &&\
-    dbh->index_control_area_header.index_table[fieldnr]) {
-#endif
+  if(!is_special_record(record) && COLUMN_INDEXED(db, fieldnr)) {
     return -13;
   }
   // check that no logging is used
@@ -30,6 +30,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -47,6 +48,7 @@ extern "C" {
 #include "../config.h"
 #endif
 #include "dballoc.h"
+#include "dbdata.h"
 #include "dbmem.h"
 #include "dblock.h"
 #include "dblog.h"
@@ -59,6 +61,8 @@ extern "C" {
 /* ======= Private protos ================ */
 
 
+static gint load_dump(void *db, char *fileName);
+static gint init_imported(void *db, gint active);
 static gint show_dump_error(void *db, char *errmsg);
 static gint show_dump_error_str(void *db, char *errmsg, char *str);
 
@@ -180,6 +184,549 @@ gint wg_dump_internal(void * db, char fileName[], int locking) {
 }
 
 
+/** Copy the used area of the database to local memory.
+ *  The lock is held only while copying. If logging is active, the
+ *  journal is restarted at the time of the copy.
+ *
+ *  Returns 0 when successful, *image then points to the copy (or is NULL
+ *  if there was not enough memory, in which case nothing was done).
+ *  -1 non-fatal error (db may continue)
+ *  -2 fatal error (should abort db), *image may still hold a copy.
+ */
+static gint take_snapshot(void *db, char **image, gint *dbsize) {
+  db_memsegment_header* dbh = dbmemsegh(db);
+#ifdef USE_DBLOG
+  gint active;
+#endif
+  gint err = 0;
+  gint lock_id;
+
+#ifdef CHECK
+  if(dbh->extdbs.count != 0) {
+    show_dump_error(db, "Database contains external references");
+  }
+#endif
+
+#ifndef USE_DBLOG
+  lock_id = db_rlock(db, DEFAULT_LOCK_TIMEOUT);
+#else
+  /* Exclusive lock is needed to restart the journal */
+  lock_id = db_wlock(db, DEFAULT_LOCK_TIMEOUT);
+#endif
+  if(!lock_id) {
+    show_dump_error(db, "Failed to lock the database for dump");
+    *image = NULL;
+    return -1;
+  }
+
+  *dbsize = dbh->free; /* first unused offset - 0 = db size */
+  *image = (char *) malloc(*dbsize);
+  if(*image) {
+#ifdef USE_DBLOG
+    active = dbh->logging.active;
+    if(active) {
+      wg_stop_logging(db);
+    }
+#endif
+
+    memcpy(*image, dbmemseg(db), *dbsize);
+    ((db_memsegment_header *) *image)->checksum = 0;
+
+#ifdef USE_DBLOG
+    /* restart logging at the snapshot point */
+    if(active) {
+      dbh->logging.dirty = 0;
+      if(wg_start_logging(db)) {
+        err = -2; /* Failed to re-initialize log */
+      }
+    }
+#endif
+  }
+
+#ifndef USE_DBLOG
+  if(!db_rulock(db, lock_id)) {
+#else
+  if(!db_wulock(db, lock_id)) {
+#endif
+    show_dump_error(db, "Failed to unlock the database");
+    err = -2; /* Lock failure --> fatal */
+  }
+  return err;
+}
+
+/** Dump the database without holding the lock during I/O.
+ *  The used area of the memory segment is copied to local memory
+ *  while holding the lock, and the copy is written to disk after the
+ *  lock is released. If logging is active, the journal is restarted
+ *  at the time of the copy, so the dump and the new journal are
+ *  sufficient for recovery, same as with wg_dump().
+ *
+ *  The shared memory segment is not copy-on-write, so the snapshot
+ *  requires free local memory of the size of the used database area.
+ *  If that is not available, falls back to the regular dump.
+ *
+ *  Returns 0 when successful (no error).
+ *  -1 non-fatal error (db may continue)
+ *  -2 fatal error (should abort db)
+ */
+gint wg_dump_online(void * db, char fileName[]) {
+  FILE *f;
+  gint dbsize, err;
+  char *image;
+  gint32 crc;
+
+  /* Open the dump file */
+#ifdef _WIN32
+  if(fopen_s(&f, fileName, "wb")) {
+#else
+  if(!(f = fopen(fileName, "wb"))) {
+#endif
+    show_dump_error(db, "Error opening file");
+    return -1;
+  }
+
+  err = take_snapshot(db, &image, &dbsize);
+  if(!image) {
+    fclose(f);
+    if(err)
+      return err;
+    return wg_dump_internal(db, fileName, 1);
+  }
+
+  /* The rest is done without locking */
+  crc = update_crc32(image, dbsize, 0x0);
+  ((db_memsegment_header *) image)->checksum = crc;
+
+  if(fwrite(image, dbsize, 1, f) != 1) {
+    show_dump_error(db, "Error writing file");
+    if(!err)
+      err = -1;
+  }
+
+  free(image);
+  fflush(f);
+  fclose(f);
+
+  return err;
+}
+
+/** Clear the contents of free objects in a memory image.
+ *  Only the allocator markup (sizes and freelist links) is kept,
+ *  so that the free space compresses well.
+ */
+static void clear_free_objects(char *image) {
+  db_memsegment_header *dbh = (db_memsegment_header *) image;
+  db_area_header *areas[] = {
+    &(dbh->datarec_area_header),
+    &(dbh->longstr_area_header),
+    &(dbh->listcell_area_header),
+    &(dbh->shortstr_area_header),
+    &(dbh->word_area_header),
+    &(dbh->doubleword_area_header),
+    &(dbh->tnode_area_header),
+    &(dbh->bnode_area_header),
+    &(dbh->rnode_area_header),
+    &(dbh->indexhdr_area_header),
+    &(dbh->indextmpl_area_header),
+    &(dbh->indexhash_area_header)
+  };
+  int i, j;
+
+  for(i=0; i<sizeof(areas)/sizeof(db_area_header *); i++) {
+    db_area_header *areah = areas[i];
+    if(areah->fixedlength) {
+      /* first gint of a free object links to the next one */
+      gint obj = areah->freelist;
+      while(obj) {
+        memset(image + obj + sizeof(gint), 0,
+          areah->objlength - sizeof(gint));
+        obj = *((gint *) (image + obj));
+      }
+    } else {
+      /* size, next and prev in the beginning, size at the end */
+      for(j=0; j<EXACTBUCKETS_NR+VARBUCKETS_NR; j++) {
+        gint obj = areah->freebuckets[j];
+        while(obj) {
+          gint size = getfreeobjectsize(*((gint *) (image + obj)));
+          if(size > 4*sizeof(gint)) {
+            memset(image + obj + 3*sizeof(gint), 0, size - 4*sizeof(gint));
+          }
+          obj = *((gint *) (image + obj + sizeof(gint)));
+        }
+      }
+      /* designated victim: size and dv marker in the beginning */
+      if(areah->freebuckets[DVBUCKET] &&
+        areah->freebuckets[DVSIZEBUCKET] > 2*sizeof(gint)) {
+        memset(image + areah->freebuckets[DVBUCKET] + 2*sizeof(gint), 0,
+          areah->freebuckets[DVSIZEBUCKET] - 2*sizeof(gint));
+      }
+    }
+  }
+}
+
+/** Store an unsigned varint.
+ *  Returns the number of bytes written.
+ */
+static size_t put_varint(unsigned char *buf, wg_uint val) {
+  size_t len = 0;
+  while(val >= 0x80) {
+    buf[len++] = (unsigned char) (val | 0x80);
+    val >>= 7;
+  }
+  buf[len++] = (unsigned char) val;
+  return len;
+}
+
+/** Read an unsigned varint.
+ *  Returns the number of bytes consumed, 0 on error.
+ */
+static size_t get_varint(unsigned char *buf, size_t buflen, wg_uint *val) {
+  wg_uint tmp = 0;
+  size_t len = 0;
+  while(len < buflen && 7*len < 8*sizeof(wg_uint)) {
+    tmp |= (wg_uint) (buf[len] & 0x7f) << (7*len);
+    if(!(buf[len++] & 0x80)) {
+      *val = tmp;
+      return len;
+    }
+  }
+  return 0;
+}
+
+/** Compress a block by run-length encoding zero words.
+ *  The output consists of (zero word count, literal word count,
+ *  literal words) triplets.
+ *  Returns the length of the compressed data, or 0 if it would not
+ *  be shorter than the input. len must be a multiple of gint size.
+ */
+static gint zrle_encode(char *in, gint len, unsigned char *out) {
+  gint *words = (gint *) in;
+  gint nwords = len / sizeof(gint), i = 0;
+  gint outlen = 0;
+
+  while(i < nwords) {
+    gint zeros = 0, lit = 0;
+    while(i + zeros < nwords && !words[i + zeros])
+      zeros++;
+    i += zeros;
+    /* literals end at two consecutive zero words */
+    while(i + lit < nwords && (words[i + lit] ||
+      (i + lit + 1 < nwords && words[i + lit + 1])))
+      lit++;
+    if(outlen + 2*WG_DUMP_VARINT_BYTES + lit*sizeof(gint) >= len)
+      return 0;
+    outlen += put_varint(out + outlen, (wg_uint) zeros);
+    outlen += put_varint(out + outlen, (wg_uint) lit);
+    memcpy(out + outlen, words + i, lit*sizeof(gint));
+    outlen += lit*sizeof(gint);
+    i += lit;
+  }
+  return outlen;
+}
+
+/** Decompress a block created by zrle_encode().
+ *  Returns 0 on success, -1 if the data is corrupt.
+ */
+static gint zrle_decode(unsigned char *in, gint len, char *out,
+  gint outlen)
+{
+  gint inpos = 0, outpos = 0;
+
+  while(inpos < len) {
+    wg_uint zeros, lit;
+    size_t vlen;
+    if(!(vlen = get_varint(in + inpos, len - inpos, &zeros)))
+      return -1;
+    inpos += vlen;
+    if(!(vlen = get_varint(in + inpos, len - inpos, &lit)))
+      return -1;
+    inpos += vlen;
+    zeros *= sizeof(gint);
+    lit *= sizeof(gint);
+    if(zeros > (wg_uint) (outlen - outpos) ||\
+      lit > (wg_uint) (outlen - outpos) - zeros ||\
+      lit > (wg_uint) (len - inpos))
+      return -1;
+    memset(out + outpos, 0, zeros);
+    outpos += zeros;
+    memcpy(out + outpos, in + inpos, lit);
+    outpos += lit;
+    inpos += lit;
+  }
+  return (outpos == outlen ? 0 : -1);
+}
+
+/** Write a block of a compact dump.
+ *  buf is used for the compressed data and should have room
+ *  for rawlen bytes.
+ *  Returns 0 on success, -1 on write error.
+ */
+static gint write_dump_block(FILE *f, char *data, gint rawlen,
+  unsigned char *buf)
+{
+  gint32 bhdr[WG_DUMP_BLOCKHDR_INTS];
+  gint storedlen = 0;
+
+  if(!(rawlen % sizeof(gint)))
+    storedlen = zrle_encode(data, rawlen, buf);
+  bhdr[0] = (storedlen ? WG_DUMP_BLOCK_ZRLE : WG_DUMP_BLOCK_RAW);
+  bhdr[1] = (gint32) rawlen;
+  bhdr[2] = (gint32) (storedlen ? storedlen : rawlen);
+  bhdr[3] = update_crc32(data, rawlen, 0x0);
+
+  if(fwrite(bhdr, sizeof(bhdr), 1, f) != 1)
+    return -1;
+  if(storedlen) {
+    if(fwrite(buf, storedlen, 1, f) != 1)
+      return -1;
+  } else {
+    if(fwrite(data, rawlen, 1, f) != 1)
+      return -1;
+  }
+  return 0;
+}
+
+/** Dump the database in the compact (v2) format.
+ *  Works like wg_dump_online(), but the free objects are cleared and
+ *  the image is written as a sequence of blocks. Each block is
+ *  compressed and has its own CRC32. wg_import_dump() and
+ *  wg_check_dump() recognize the format automatically.
+ *
+ *  Returns 0 when successful (no error).
+ *  -1 non-fatal error (db may continue)
+ *  -2 fatal error (should abort db)
+ */
+gint wg_dump_compact(void * db, char fileName[]) {
+  FILE *f;
+  gint dbsize, err, pos;
+  gint hdr[2];
+  char *image;
+  unsigned char *buf;
+
+#ifdef _WIN32
+  if(fopen_s(&f, fileName, "wb")) {
+#else
+  if(!(f = fopen(fileName, "wb"))) {
+#endif
+    show_dump_error(db, "Error opening file");
+    return -1;
+  }
+
+  buf = (unsigned char *) malloc(WG_DUMP_BLOCKSIZE);
+  if(!buf) {
+    show_dump_error(db, "malloc error in wg_dump_compact");
+    fclose(f);
+    return -1;
+  }
+
+  err = take_snapshot(db, &image, &dbsize);
+  if(!image) {
+    if(!err)
+      show_dump_error(db, "Not enough memory for the database snapshot");
+    free(buf);
+    fclose(f);
+    return (err ? err : -1);
+  }
+
+  /* The rest is done without locking */
+  clear_free_objects(image);
+
+  hdr[0] = dbsize;
+  hdr[1] = WG_DUMP_BLOCKSIZE;
+  if(fwrite(WG_DUMP_V2_MAGIC, WG_DUMP_V2_MAGIC_BYTES, 1, f) != 1 ||\
+    fwrite(hdr, sizeof(hdr), 1, f) != 1) {
+    goto writeerr;
+  }
+
+  for(pos=0; pos<dbsize; pos+=WG_DUMP_BLOCKSIZE) {
+    gint rawlen = dbsize - pos;
+    if(rawlen > WG_DUMP_BLOCKSIZE)
+      rawlen = WG_DUMP_BLOCKSIZE;
+    if(write_dump_block(f, image + pos, rawlen, buf))
+      goto writeerr;
+  }
+
+  free(image);
+  free(buf);
+  fflush(f);
+  fclose(f);
+  return err;
+
+writeerr:
+  show_dump_error(db, "Error writing file");
+  free(image);
+  free(buf);
+  fclose(f);
+  return (err ? err : -1);
+}
+
+/** Read the next block of a compact dump.
+ *  out should have room for WG_DUMP_BLOCKSIZE bytes, buf is
+ *  used for compressed data and should be of the same size.
+ *  Returns the decoded length, 0 at the end of file,
+ *  -1 on read error, -3 on integrity error.
+ */
+static gint read_dump_block(void *db, FILE *f, char *out,
+  unsigned char *buf)
+{
+  gint32 bhdr[WG_DUMP_BLOCKHDR_INTS];
+  size_t len = fread(bhdr, 1, sizeof(bhdr), f);
+
+  if(!len)
+    return (feof(f) ? 0 : -1);
+  if(len != sizeof(bhdr) || bhdr[1] <= 0 || bhdr[1] > WG_DUMP_BLOCKSIZE ||\
+    bhdr[2] <= 0 || bhdr[2] > WG_DUMP_BLOCKSIZE) {
+    show_dump_error(db, "Invalid block header");
+    return -3;
+  }
+  if(bhdr[0] == WG_DUMP_BLOCK_RAW && bhdr[1] == bhdr[2]) {
+    if(fread(out, bhdr[1], 1, f) != 1) {
+      show_dump_error(db, "Error reading dump file");
+      return -1;
+    }
+  } else if(bhdr[0] == WG_DUMP_BLOCK_ZRLE) {
+    if(fread(buf, bhdr[2], 1, f) != 1) {
+      show_dump_error(db, "Error reading dump file");
+      return -1;
+    }
+    if(zrle_decode(buf, bhdr[2], out, bhdr[1])) {
+      show_dump_error(db, "Corrupt block data");
+      return -3;
+    }
+  } else {
+    show_dump_error(db, "Unknown block type");
+    return -3;
+  }
+  if(update_crc32(out, bhdr[1], 0x0) != bhdr[3]) {
+    show_dump_error(db, "Block CRC32 incorrect");
+    return -3;
+  }
+  return bhdr[1];
+}
+
+/** Check whether the file is in the compact format.
+ *  Reads the file header if it is, otherwise rewinds the file.
+ *  Returns 1 if the format is v2, 0 otherwise.
+ */
+static int is_compact_dump(FILE *f, gint *dbsize) {
+  char magic[WG_DUMP_V2_MAGIC_BYTES];
+  gint hdr[2];
+
+  if(fread(magic, WG_DUMP_V2_MAGIC_BYTES, 1, f) == 1 &&\
+    !memcmp(magic, WG_DUMP_V2_MAGIC, WG_DUMP_V2_MAGIC_BYTES) &&\
+    fread(hdr, sizeof(hdr), 1, f) == 1 && hdr[1] == WG_DUMP_BLOCKSIZE) {
+    *dbsize = hdr[0];
+    return 1;
+  }
+  fseek(f, 0, SEEK_SET);
+  return 0;
+}
+
+/** Check a compact dump file.
+ *  The file position should be at the first block. Parameters
+ *  and return values are the same as for wg_check_dump().
+ */
+static gint check_compact_dump(void *db, FILE *f, char *fileName,
+  gint dbsize, gint *minsize, gint *maxsize)
+{
+  char *out;
+  unsigned char *buf;
+  gint len, total = 0;
+  gint err = -1;
+
+  out = (char *) malloc(WG_DUMP_BLOCKSIZE);
+  buf = (unsigned char *) malloc(WG_DUMP_BLOCKSIZE);
+  if(!out || !buf) {
+    show_dump_error(db, "malloc error in wg_check_dump");
+    goto abort;
+  }
+
+  while((len = read_dump_block(db, f, out, buf)) > 0) {
+    if(!total) {
+      if(len < sizeof(db_memsegment_header) ||\
+        wg_check_header_compat((db_memsegment_header *) out)) {
+        show_dump_error_str(db, "Incompatible dump file", fileName);
+        wg_print_code_version();
+        if(len >= sizeof(db_memsegment_header))
+          wg_print_header_version((db_memsegment_header *) out, 1);
+        err = -2;
+        goto abort;
+      }
+      *minsize = ((db_memsegment_header *) out)->free;
+      *maxsize = ((db_memsegment_header *) out)->size;
+    }
+    total += len;
+  }
+
+  if(len < 0) {
+    err = len;
+  }
+  else if(!total || total != dbsize || total != *minsize) {
+    show_dump_error_str(db, "File size incorrect", fileName);
+    err = -3;
+  }
+  else
+    err = 0;
+
+abort:
+  if(out) free(out);
+  if(buf) free(buf);
+  return err;
+}
+
+/** Import a compact dump file.
+ *  The file position should be at the first block.
+ *  Returns 0 when successful, -1 if the database was not
+ *  modified, -2 if the database is in undetermined state.
+ */
+static gint import_compact_dump(void *db, FILE *f, gint dbsize) {
+  db_memsegment_header* dbh = dbmemsegh(db);
+  char *out;
+  unsigned char *buf;
+  gint len, pos = 0, newsize = dbh->size;
+  gint err = -1;
+
+  if(dbh->size < dbsize) {
+    show_dump_error(db, "Data does not fit in shared memory area");
+    return -1;
+  }
+
+  out = (char *) malloc(WG_DUMP_BLOCKSIZE);
+  buf = (unsigned char *) malloc(WG_DUMP_BLOCKSIZE);
+  if(!out || !buf) {
+    show_dump_error(db, "malloc error in wg_import_dump");
+    goto abort;
+  }
+
+  while((len = read_dump_block(db, f, out, buf)) > 0) {
+    if(!pos && (len < sizeof(db_memsegment_header) ||\
+      ((db_memsegment_header *) out)->extdbs.count != 0)) {
+      show_dump_error(db, "Dump contains external references");
+      goto abort;
+    }
+    if(len > dbsize - pos) {
+      show_dump_error(db, "Dump size incorrect");
+      break;
+    }
+    memcpy(dbmemsegbytes(db) + pos, out, len);
+    pos += len;
+  }
+
+  if(len || pos != dbsize) {
+    if(pos)
+      err = -2; /* database is in undetermined state now */
+  } else {
+    err = 0;
+    dbh->size = newsize;
+    dbh->checksum = 0;
+  }
+
+abort:
+  if(out) free(out);
+  if(buf) free(buf);
+  return err;
+}
+
 /* This has to be large enough to hold all the relevant
  * fields in the header during the first pass of the read.
  * (Currently this is the first 24 bytes of the dump file)
@@ -213,6 +760,11 @@ gint wg_check_dump(void *db, char fileName[], gint *minsize, gint *maxsize) {
     return -1;
   }
 
+  if(is_compact_dump(f, &filesize)) {
+    err = check_compact_dump(db, f, fileName, filesize, minsize, maxsize);
+    goto abort1;
+  }
+
   buf = (char *) malloc(BUFSIZE);
   if(!buf) {
     show_dump_error(db, "malloc error in wg_import_dump");
@@ -276,14 +828,32 @@ abort1:
  *  db concurrently may cause undefined behaviour (including data loss)
  */
 gint wg_import_dump(void * db,char fileName[]) {
+  gint err;
+#ifdef USE_DBLOG
+  gint active = dbmemsegh(db)->logging.active;
+#else
+  gint active = 0;
+#endif
+
+  err = load_dump(db, fileName);
+
+  /* any errors up to now? */
+  if(err) return err;
+
+  return init_imported(db, active);
+}
+
+/** Read the memory image from a dump file.
+ *  Returns 0 when successful (no error).
+ *  -1 non-fatal error (db was not modified)
+ *  -2 fatal error (db is in undetermined state)
+ */
+static gint load_dump(void *db, char *fileName) {
   db_memsegment_header* dumph;
   FILE *f;
   db_memsegment_header* dbh = dbmemsegh(db);
   gint dbsize = -1, newsize;
   gint err = -1;
-#ifdef USE_DBLOG
-  gint active = dbh->logging.active;
-#endif
 
 
   /* Attempt to open the dump file */
@@ -296,6 +866,11 @@ gint wg_import_dump(void * db,char fileName[]) {
     return -1;
   }
 
+  if(is_compact_dump(f, &dbsize)) {
+    err = import_compact_dump(db, f, dbsize);
+    goto abort;
+  }
+
   /* Examine the dump header. We only read the size, it is
    * implied that the integrity and compatibility were verified
    * earlier.
@@ -337,9 +912,16 @@ gint wg_import_dump(void * db,char fileName[]) {
 
 abort:
   fclose(f);
+  return err;
+}
 
-  /* any errors up to now? */
-  if(err) return err;
+/** Initialize the state of the database after import.
+ *  active indicates whether the journal should be restarted.
+ */
+static gint init_imported(void *db, gint active) {
+#ifdef USE_DBLOG
+  db_memsegment_header* dbh = dbmemsegh(db);
+#endif
 
   /* Initialize db state */
 #ifdef USE_DBLOG
@@ -355,6 +937,455 @@ abort:
   return wg_init_locks(db);
 }
 
+/* ------------ incremental dumps ---------------- */
+
+/** Compute the signature of a page of a memory image.
+ *  The signature consists of the CRC32 and the FNV-1a hash of the page.
+ *  The size and checksum fields of the segment header are excluded,
+ *  as these are modified on import.
+ */
+static void sign_page(char *page, gint len, gint pageno, gint32 *sig) {
+  db_memsegment_header *dbh = (db_memsegment_header *) page;
+  gint size = 0;
+  gint32 checksum = 0;
+  unsigned int fnv = 2166136261U;
+  gint i;
+
+  if(!pageno) {
+    size = dbh->size;
+    checksum = dbh->checksum;
+    dbh->size = 0;
+    dbh->checksum = 0;
+  }
+
+  for(i=0; i<len; i++) {
+    fnv ^= (unsigned char) page[i];
+    fnv *= 16777619U;
+  }
+  sig[0] = update_crc32(page, len, 0x0);
+  sig[1] = (gint32) fnv;
+
+  if(!pageno) {
+    dbh->size = size;
+    dbh->checksum = checksum;
+  }
+}
+
+/** Compute the page signatures of a memory image.
+ *  table should have room for 2 entries per page.
+ */
+static void sign_image(char *image, gint size, gint32 *table) {
+  gint pos;
+  for(pos=0; pos<size; pos+=WG_DUMP_PAGESIZE) {
+    gint len = size - pos;
+    if(len > WG_DUMP_PAGESIZE)
+      len = WG_DUMP_PAGESIZE;
+    sign_page(image + pos, len, pos/WG_DUMP_PAGESIZE,
+      table + 2*(pos/WG_DUMP_PAGESIZE));
+  }
+}
+
+/** Read the header of an incremental dump.
+ *  hdr receives the image size, base image size, page size and
+ *  page count, sigs the hashes of the base and new signature tables.
+ *  If table is not NULL, the signature table is read and returned
+ *  in a newly allocated buffer.
+ *  Returns 1 if the file is an incremental dump, 0 if it is not
+ *  (the file is rewound) and -1 on error.
+ */
+static gint read_incremental_header(void *db, FILE *f, gint *hdr,
+  gint32 *sigs, gint32 **table)
+{
+  char magic[WG_DUMP_INC_MAGIC_BYTES];
+
+  if(fread(magic, WG_DUMP_INC_MAGIC_BYTES, 1, f) != 1 ||\
+    memcmp(magic, WG_DUMP_INC_MAGIC, WG_DUMP_INC_MAGIC_BYTES)) {
+    fseek(f, 0, SEEK_SET);
+    return 0;
+  }
+  if(fread(hdr, sizeof(gint), WG_DUMP_INC_HDR_INTS, f) !=\
+    WG_DUMP_INC_HDR_INTS || fread(sigs, sizeof(gint32), 2, f) != 2) {
+    show_dump_error(db, "Error reading incremental dump header");
+    return -1;
+  }
+  if(hdr[0] <= 0 || hdr[1] <= 0 || hdr[2] != WG_DUMP_PAGESIZE ||\
+    hdr[3] != (hdr[0] + WG_DUMP_PAGESIZE - 1)/WG_DUMP_PAGESIZE) {
+    show_dump_error(db, "Invalid incremental dump header");
+    return -1;
+  }
+  if(table) {
+    *table = (gint32 *) malloc(2*sizeof(gint32)*hdr[3]);
+    if(!*table) {
+      show_dump_error(db, "malloc error in read_incremental_header");
+      return -1;
+    }
+    if(fread(*table, 2*sizeof(gint32), hdr[3], f) != (size_t) hdr[3]) {
+      show_dump_error(db, "Error reading incremental dump header");
+      free(*table);
+      return -1;
+    }
+  }
+  return 1;
+}
+
+/** Compute the page signatures of the image stored in a dump file.
+ *  The file may be a regular dump, a compact dump or an incremental
+ *  dump (in which case the signatures of the resulting image are
+ *  returned). The table is allocated by this function.
+ *  Returns 0 on success, -1 on error.
+ */
+static gint sign_dump_file(void *db, char *fileName, gint32 **table,
+  gint *size)
+{
+  FILE *f;
+  char *out = NULL;
+  unsigned char *buf = NULL;
+  gint hdr[WG_DUMP_INC_HDR_INTS];
+  gint32 sigs[2];
+  gint len, pos = 0;
+  gint err = -1;
+  int compact;
+
+#ifdef _WIN32
+  if(fopen_s(&f, fileName, "rb")) {
+#else
+  if(!(f = fopen(fileName, "rb"))) {
+#endif
+    show_dump_error_str(db, "Error opening file", fileName);
+    return -1;
+  }
+
+  *table = NULL;
+  len = read_incremental_header(db, f, hdr, sigs, table);
+  if(len) {
+    fclose(f);
+    if(len < 0)
+      return -1;
+    *size = hdr[0];
+    return 0;
+  }
+
+  out = (char *) malloc(WG_DUMP_BLOCKSIZE);
+  buf = (unsigned char *) malloc(WG_DUMP_BLOCKSIZE);
+  if(!out || !buf) {
+    show_dump_error(db, "malloc error in sign_dump_file");
+    goto abort;
+  }
+
+  compact = is_compact_dump(f, size);
+  if(!compact) {
+    /* regular dump, the size is in the header */
+    if(fread(out, sizeof(db_memsegment_header), 1, f) != 1) {
+      show_dump_error_str(db, "Error reading dump header", fileName);
+      goto abort;
+    }
+    *size = ((db_memsegment_header *) out)->free;
+    fseek(f, 0, SEEK_SET);
+  }
+  if(*size <= 0) {
+    show_dump_error_str(db, "Invalid dump file", fileName);
+    goto abort;
+  }
+
+  *table = (gint32 *) malloc(2*sizeof(gint32)*
+    ((*size + WG_DUMP_PAGESIZE - 1)/WG_DUMP_PAGESIZE));
+  if(!*table) {
+    show_dump_error(db, "malloc error in sign_dump_file");
+    goto abort;
+  }
+
+  /* Both formats are read in chunks that are a multiple of the
+   * page size, except for the last one. */
+  while(pos < *size) {
+    if(compact) {
+      len = read_dump_block(db, f, out, buf);
+    } else {
+      len = *size - pos;
+      if(len > WG_DUMP_BLOCKSIZE)
+        len = WG_DUMP_BLOCKSIZE;
+      if(fread(out, len, 1, f) != 1)
+        len = -1;
+    }
+    if(len <= 0 || len > *size - pos) {
+      show_dump_error_str(db, "Error reading dump file", fileName);
+      goto abort;
+    }
+    sign_image(out, len, *table + 2*(pos/WG_DUMP_PAGESIZE));
+    pos += len;
+  }
+  err = 0;
+
+abort:
+  if(err && *table) {
+    free(*table);
+    *table = NULL;
+  }
+  if(out) free(out);
+  if(buf) free(buf);
+  fclose(f);
+  return err;
+}
+
+/** Dump the pages that have changed since the base dump.
+ *  The base may be a regular, compact or incremental dump. The pages
+ *  of the current image are compared to the base by their signatures
+ *  and only the differing pages are written (in the compact format).
+ *  A chain of increments is restored with wg_import_incremental().
+ *
+ *  The free objects are cleared in compact dumps and in the pages
+ *  written here, but not in regular dumps. So a page is unchanged if
+ *  either the image as it is or the cleared image matches the base,
+ *  and the signature that matched is kept for the resulting image.
+ *  When the base is an increment, only its signature table is read.
+ *
+ *  The snapshot of the image is taken like in wg_dump_online().
+ *
+ *  Returns 0 when successful (no error).
+ *  -1 non-fatal error (db may continue)
+ *  -2 fatal error (should abort db)
+ */
+gint wg_dump_incremental(void * db, char base[], char fileName[]) {
+  FILE *f;
+  gint32 *basetable = NULL, *newtable = NULL, *rawtable = NULL;
+  gint32 sigs[2];
+  gint hdr[WG_DUMP_INC_HDR_INTS];
+  gint basesize, basepages, dbsize, i;
+  gint err = -1;
+  char *image = NULL;
+  unsigned char *buf;
+
+  if(sign_dump_file(db, base, &basetable, &basesize))
+    return -1;
+  basepages = (basesize + WG_DUMP_PAGESIZE - 1)/WG_DUMP_PAGESIZE;
+
+#ifdef _WIN32
+  if(fopen_s(&f, fileName, "wb")) {
+#else
+  if(!(f = fopen(fileName, "wb"))) {
+#endif
+    show_dump_error(db, "Error opening file");
+    free(basetable);
+    return -1;
+  }
+
+  buf = (unsigned char *) malloc(WG_DUMP_PAGESIZE);
+  if(!buf) {
+    show_dump_error(db, "malloc error in wg_dump_incremental");
+    goto abort;
+  }
+
+  err = take_snapshot(db, &image, &dbsize);
+  if(!image) {
+    if(!err) {
+      show_dump_error(db, "Not enough memory for the database snapshot");
+      err = -1;
+    }
+    goto abort;
+  }
+
+  /* The rest is done without locking */
+  hdr[0] = dbsize;
+  hdr[1] = basesize;
+  hdr[2] = WG_DUMP_PAGESIZE;
+  hdr[3] = (dbsize + WG_DUMP_PAGESIZE - 1)/WG_DUMP_PAGESIZE;
+
+  newtable = (gint32 *) malloc(2*sizeof(gint32)*hdr[3]);
+  rawtable = (gint32 *) malloc(2*sizeof(gint32)*hdr[3]);
+  if(!newtable || !rawtable) {
+    show_dump_error(db, "malloc error in wg_dump_incremental");
+    if(!err)
+      err = -1;
+    goto abort;
+  }
+  sign_image(image, dbsize, rawtable);
+  clear_free_objects(image);
+  sign_image(image, dbsize, newtable);
+
+  /* Pages of the base that were not cleared match the raw image.
+   * The last pages may only match if the images have the same size. */
+  for(i=0; i<hdr[3] && i<basepages; i++) {
+    if((dbsize == basesize || (i < hdr[3] - 1 && i < basepages - 1)) &&\
+      memcmp(newtable + 2*i, basetable + 2*i, 2*sizeof(gint32)) &&\
+      !memcmp(rawtable + 2*i, basetable + 2*i, 2*sizeof(gint32))) {
+      newtable[2*i] = rawtable[2*i];
+      newtable[2*i+1] = rawtable[2*i+1];
+    }
+  }
+
+  sigs[0] = update_crc32((char *) basetable, 2*sizeof(gint32)*basepages, 0x0);
+  sigs[1] = update_crc32((char *) newtable, 2*sizeof(gint32)*hdr[3], 0x0);
+
+  if(fwrite(WG_DUMP_INC_MAGIC, WG_DUMP_INC_MAGIC_BYTES, 1, f) != 1 ||\
+    fwrite(hdr, sizeof(hdr), 1, f) != 1 ||\
+    fwrite(sigs, sizeof(sigs), 1, f) != 1 ||\
+    fwrite(newtable, 2*sizeof(gint32), hdr[3], f) != (size_t) hdr[3]) {
+    goto writeerr;
+  }
+
+  for(i=0; i<hdr[3]; i++) {
+    gint len = dbsize - i*WG_DUMP_PAGESIZE;
+    gint baselen = basesize - i*WG_DUMP_PAGESIZE;
+    if(len > WG_DUMP_PAGESIZE)
+      len = WG_DUMP_PAGESIZE;
+    if(baselen > WG_DUMP_PAGESIZE)
+      baselen = WG_DUMP_PAGESIZE;
+
+    if(i >= basepages || len != baselen ||\
+      memcmp(newtable + 2*i, basetable + 2*i, 2*sizeof(gint32))) {
+      gint32 pageno = (gint32) i;
+      if(fwrite(&pageno, sizeof(gint32), 1, f) != 1 ||\
+        write_dump_block(f, image + i*WG_DUMP_PAGESIZE, len, buf)) {
+        goto writeerr;
+      }
+    }
+  }
+  goto abort;
+
+writeerr:
+  show_dump_error(db, "Error writing file");
+  if(!err)
+    err = -1;
+
+abort:
+  if(image) free(image);
+  if(buf) free(buf);
+  if(newtable) free(newtable);
+  if(rawtable) free(rawtable);
+  free(basetable);
+  fflush(f);
+  fclose(f);
+  return err;
+}
+
+/** Apply an incremental dump to the memory image.
+ *  The image must match the base of the increment.
+ *  Returns 0 when successful, -1 if the database was not
+ *  modified, -2 if the database is in undetermined state.
+ */
+static gint apply_increment(void *db, char *fileName) {
+  db_memsegment_header* dbh = dbmemsegh(db);
+  FILE *f;
+  gint32 *table = NULL, *curtable = NULL;
+  gint32 sigs[2], pageno;
+  gint hdr[WG_DUMP_INC_HDR_INTS];
+  gint segsize = dbh->size;
+  gint len, err = -1;
+  char *out = NULL;
+  unsigned char *buf = NULL;
+
+#ifdef _WIN32
+  if(fopen_s(&f, fileName, "rb")) {
+#else
+  if(!(f = fopen(fileName, "rb"))) {
+#endif
+    show_dump_error_str(db, "Error opening file", fileName);
+    return -1;
+  }
+
+  len = read_incremental_header(db, f, hdr, sigs, &table);
+  if(len <= 0) {
+    if(!len)
+      show_dump_error_str(db, "Not an incremental dump", fileName);
+    fclose(f);
+    return -1;
+  }
+
+  if(dbh->free != hdr[1]) {
+    show_dump_error_str(db, "Increment does not match the image", fileName);
+    goto abort;
+  }
+  if(segsize < hdr[0]) {
+    show_dump_error(db, "Data does not fit in shared memory area");
+    goto abort;
+  }
+
+  /* verify the base */
+  curtable = (gint32 *) malloc(2*sizeof(gint32)*
+    ((segsize + WG_DUMP_PAGESIZE - 1)/WG_DUMP_PAGESIZE));
+  out = (char *) malloc(WG_DUMP_BLOCKSIZE);
+  buf = (unsigned char *) malloc(WG_DUMP_BLOCKSIZE);
+  if(!curtable || !out || !buf) {
+    show_dump_error(db, "malloc error in wg_import_incremental");
+    goto abort;
+  }
+  sign_image(dbmemsegbytes(db), hdr[1], curtable);
+  if(update_crc32((char *) curtable, 2*sizeof(gint32)*\
+    ((hdr[1] + WG_DUMP_PAGESIZE - 1)/WG_DUMP_PAGESIZE), 0x0) != sigs[0]) {
+    show_dump_error_str(db, "Increment does not match the image", fileName);
+    goto abort;
+  }
+
+  /* copy the changed pages */
+  while(fread(&pageno, sizeof(gint32), 1, f) == 1) {
+    gint explen = hdr[0] - (gint) pageno*WG_DUMP_PAGESIZE;
+    if(explen > WG_DUMP_PAGESIZE)
+      explen = WG_DUMP_PAGESIZE;
+    if(pageno < 0 || pageno >= hdr[3] ||\
+      read_dump_block(db, f, out, buf) != explen) {
+      show_dump_error_str(db, "Invalid page in increment", fileName);
+      err = -2;
+      goto abort;
+    }
+    memcpy(dbmemsegbytes(db) + (gint) pageno*WG_DUMP_PAGESIZE, out, explen);
+    err = -2; /* database modified */
+  }
+  dbh->size = segsize;
+  dbh->checksum = 0;
+
+  /* verify the result */
+  sign_image(dbmemsegbytes(db), hdr[0], curtable);
+  if(dbh->free != hdr[0] ||\
+    memcmp(curtable, table, 2*sizeof(gint32)*hdr[3])) {
+    show_dump_error_str(db, "Image signature mismatch after increment",
+      fileName);
+    err = -2;
+  }
+  else
+    err = 0;
+
+abort:
+  if(table) free(table);
+  if(curtable) free(curtable);
+  if(out) free(out);
+  if(buf) free(buf);
+  fclose(f);
+  return err;
+}
+
+/** Restore the database from a dump and a chain of increments.
+ *  base is a regular or compact dump, files[] contains count
+ *  incremental dumps that are applied in order. Each increment
+ *  must have been created against the preceding file in the chain.
+ *
+ *  Returns 0 when successful (no error).
+ *  -1 non-fatal error (db may continue)
+ *  -2 fatal error (should abort db)
+ *
+ *  this function is NOT parallel-safe, same as wg_import_dump().
+ */
+gint wg_import_incremental(void * db, char base[], char *files[],
+  gint count)
+{
+  gint err, i;
+#ifdef USE_DBLOG
+  gint active = dbmemsegh(db)->logging.active;
+#else
+  gint active = 0;
+#endif
+
+  err = load_dump(db, base);
+  if(err) return err;
+
+  for(i=0; i<count; i++) {
+    if(apply_increment(db, files[i])) {
+      /* The image is valid, but not what was requested */
+      return -2;
+    }
+  }
+
+  return init_imported(db, active);
+}
+
 /* ------------ error handling ---------------- */
 
 static gint show_dump_error(void *db, char *errmsg) {
@@ -33,6 +33,21 @@
 #include "../config.h"
 #endif
 
+/* Compact dump format (see wg_dump_compact()) */
+#define WG_DUMP_V2_MAGIC "wgdbdmp2"
+#define WG_DUMP_V2_MAGIC_BYTES 8
+#define WG_DUMP_BLOCKSIZE (1<<20)     /** raw bytes per block */
+#define WG_DUMP_BLOCKHDR_INTS 4       /** type, rawlen, storedlen, crc32 */
+#define WG_DUMP_BLOCK_RAW 0
+#define WG_DUMP_BLOCK_ZRLE 1          /** zero words run-length encoded */
+#define WG_DUMP_VARINT_BYTES ((8*sizeof(gint)+6)/7) /** max varint length */
+
+/* Incremental dumps (see wg_dump_incremental()) */
+#define WG_DUMP_INC_MAGIC "wgdbinc1"
+#define WG_DUMP_INC_MAGIC_BYTES 8
+#define WG_DUMP_INC_HDR_INTS 4        /** size, base size, page size, pages */
+#define WG_DUMP_PAGESIZE (1<<16)      /** change tracking granularity */
+
 /* ====== data structures ======== */
 
 
@@ -40,7 +55,13 @@
 
 gint wg_dump(void * db,char fileName[]); /* dump shared memory database to the disk */
 gint wg_dump_internal(void * db,char fileName[], int locking); /* handle the dump */
+gint wg_dump_online(void * db,char fileName[]); /* dump without blocking during I/O */
+gint wg_dump_compact(void * db,char fileName[]); /* sparse, compressed dump */
+gint wg_dump_incremental(void * db, char base[],
+  char fileName[]); /* dump pages changed since base */
 gint wg_import_dump(void * db,char fileName[]); /* import database from the disk */
+gint wg_import_incremental(void * db, char base[], char *files[],
+  gint count); /* import a dump and a chain of increments */
 gint wg_check_dump(void *db, char fileName[],
   gint *mixsize, gint *maxsize); /* check the dump file and get the db size */
 
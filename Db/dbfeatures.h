@@ -41,6 +41,7 @@
 #define FEATURE_BITS_BACKLINK 0x8
 #define FEATURE_BITS_CHILD_DB 0x10
 #define FEATURE_BITS_INDEX_TMPL 0x20
+#define FEATURE_BITS_TTREE_KEYS 0x40
 
 /* Construct the bit vector */
 #ifdef HAVE_64BIT_GINT
@@ -79,11 +80,18 @@
   #define FEATURE_BITS_06 0x0
 #endif
 
+#ifdef TTREE_NODE_KEYS
+  #define FEATURE_BITS_07 FEATURE_BITS_TTREE_KEYS
+#else
+  #define FEATURE_BITS_07 0x0
+#endif
+
 #define MEMSEGMENT_FEATURES (FEATURE_BITS_01 |\
   FEATURE_BITS_02 |\
   FEATURE_BITS_03 |\
   FEATURE_BITS_04 |\
   FEATURE_BITS_05 |\
-  FEATURE_BITS_06)
+  FEATURE_BITS_06 |\
+  FEATURE_BITS_07)
 
 #endif /* DEFINED_DBFEATURES_H */
@@ -0,0 +1,862 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbfulltext.c
+ *  Full-text index operations.
+ *
+ *  The string values of the indexed column are split into terms. The
+ *  terms are kept in an index hash, each with a compressed postings
+ *  list of the rows that contain it. Term queries are answered by
+ *  merging the postings lists; ranked queries score the rows with
+ *  BM25 without document length normalization.
+ */
+
+/* ====== Includes =============== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+#include "dbdata.h"
+#include "dbhash.h"
+#include "dbstats.h"
+#include "dbfulltext.h"
+
+
+/* ====== Private headers and defs ======== */
+
+/* Records are aligned to 8 bytes, so the low bits of the offset
+ * are not needed for the position */
+#define FULLTEXT_ALIGN_BITS 3
+#define FULLTEXT_POS(o) (((wg_uint) (o)) >> FULLTEXT_ALIGN_BITS)
+#define FULLTEXT_REC(p) ((gint) (((wg_uint) (p)) << FULLTEXT_ALIGN_BITS))
+
+#define POSTINGS_DATA(p) ((unsigned char *) ((p) + 1))
+#define POSTINGS_INITIAL 16       /** initial size of the data */
+#define VARINT_MAX 10             /** bytes of the largest varint */
+
+#define BM25_K1 1.2               /** term frequency saturation */
+
+/** A term of a row or a query */
+typedef struct {
+  char term[WG_FULLTEXT_MAX_TERM];
+  gint len;
+  gint tf;                        /** occurrences */
+} fulltext_term;
+
+/** Terms collected by the tokenizer */
+typedef struct {
+  fulltext_term *terms;
+  gint count;
+  gint size;
+} fulltext_term_list;
+
+/* ======= Private protos ================ */
+
+static gint utf8_char(unsigned char *p, wg_uint *cp);
+static int utf8_separator(wg_uint cp);
+static gint collect_term(void *ctx, char *term, gint len);
+static int compare_terms(const void *a, const void *b);
+static gint collect_terms(char *text, gint flags, gint min_len,
+  fulltext_term_list *list);
+static gint collect_field_terms(void *db, wg_index_header *hdr, gint enc,
+  fulltext_term_list *list);
+
+static gint alloc_area(void *db, gint bytes);
+static void free_area(void *db, gint offset);
+static gint put_varint(unsigned char *buf, wg_uint v);
+static gint get_varint(unsigned char *buf, wg_uint *v);
+static gint postings_new(void *db, wg_uint pos, gint tf);
+static gint postings_splice(void *db, gint *offset, gint at, gint oldlen,
+  unsigned char *bytes, gint newlen);
+static gint postings_insert(void *db, gint *offset, wg_uint pos, gint tf);
+static gint postings_delete(void *db, gint *offset, wg_uint pos);
+static void free_postings_array(void *db, gint arraystart,
+  gint arraylength);
+
+static void term_advance(void *db, wg_fulltext_term_cursor *t);
+static void heap_sift_down(void **rows, double *scores, gint count, gint i);
+
+static gint show_fulltext_error(void* db, char* errmsg);
+
+
+/* ====== Functions ============== */
+
+/* ----------------- Tokenizer functions -------------- */
+
+/** Split a string into terms
+*  A term is a run of ASCII letters, digits, underscores and non-ASCII
+*  UTF-8 characters that are not punctuation or spaces. ASCII and
+*  Latin-1 letters are folded to lower case unless WG_FULLTEXT_KEEP_CASE
+*  is set. With WG_FULLTEXT_ASCII, any non-ASCII byte separates terms.
+*  Terms shorter than min_len characters are skipped, terms longer than
+*  WG_FULLTEXT_MAX_TERM bytes are truncated.
+*
+*  fn is called for each term. If it returns non-0, tokenizing stops.
+*  returns 0, or the value returned by fn.
+*/
+gint wg_fulltext_tokenize(char *text, gint flags, gint min_len,
+  wg_fulltext_term_fn fn, void *ctx) {
+  unsigned char *p = (unsigned char *) text;
+  char term[WG_FULLTEXT_MAX_TERM];
+  gint len = 0, chars = 0, res;
+
+  for(;;) {
+    unsigned char c = *p;
+    gint clen = 1;
+    int word = 0;
+
+    if(c < 0x80) {
+      word = ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||\
+        (c >= 'A' && c <= 'Z') || c == '_');
+    } else if(!(flags & WG_FULLTEXT_ASCII)) {
+      wg_uint cp;
+      clen = utf8_char(p, &cp);
+      if(clen)
+        word = !utf8_separator(cp);
+      else
+        clen = 1; /* invalid byte */
+    }
+
+    if(word) {
+      if(len + clen <= WG_FULLTEXT_MAX_TERM) {
+        memcpy(term + len, p, clen);
+        if(!(flags & WG_FULLTEXT_KEEP_CASE)) {
+          if(clen == 1 && c >= 'A' && c <= 'Z')
+            term[len] = (char) (c + 0x20);
+          else if(clen == 2 && c == 0xc3 && p[1] <= 0x9e && p[1] != 0x97)
+            term[len+1] = (char) (p[1] + 0x20); /* U+00C0 - U+00DE */
+        }
+        len += clen;
+        chars++;
+      }
+    } else if(len) {
+      if(chars >= min_len) {
+        res = fn(ctx, term, len);
+        if(res)
+          return res;
+      }
+      len = chars = 0;
+    }
+
+    if(!c)
+      break;
+    p += clen;
+  }
+  return 0;
+}
+
+/** Decode a multibyte UTF-8 character
+*  returns the length of the character, 0 if the sequence is invalid.
+*/
+static gint utf8_char(unsigned char *p, wg_uint *cp) {
+  gint len, i;
+
+  if(p[0] >= 0xc2 && p[0] <= 0xdf) {
+    len = 2;
+    *cp = p[0] & 0x1f;
+  } else if(p[0] >= 0xe0 && p[0] <= 0xef) {
+    len = 3;
+    *cp = p[0] & 0x0f;
+  } else if(p[0] >= 0xf0 && p[0] <= 0xf4) {
+    len = 4;
+    *cp = p[0] & 0x07;
+  } else {
+    return 0;
+  }
+  for(i=1; i<len; i++) {
+    if((p[i] & 0xc0) != 0x80)
+      return 0; /* also stops at the terminating 0 */
+    *cp = (*cp << 6) | (p[i] & 0x3f);
+  }
+  return len;
+}
+
+/** Check if a non-ASCII character separates terms
+*  Covers the Latin-1 punctuation and symbols, the general punctuation
+*  block and the most common CJK and full width punctuation.
+*/
+static int utf8_separator(wg_uint cp) {
+  return ((cp >= 0x80 && cp <= 0xbf) || cp == 0xd7 || cp == 0xf7 ||\
+    (cp >= 0x2000 && cp <= 0x206f) || (cp >= 0x3000 && cp <= 0x3003) ||\
+    (cp >= 0xff01 && cp <= 0xff0f) || cp == 0xfeff);
+}
+
+/** Add a term to a list (tokenizer callback)
+*/
+static gint collect_term(void *ctx, char *term, gint len) {
+  fulltext_term_list *list = (fulltext_term_list *) ctx;
+
+  if(list->count == list->size) {
+    gint size = (list->size ? 2 * list->size : 16);
+    fulltext_term *tmp = (fulltext_term *) realloc(list->terms,
+      size * sizeof(fulltext_term));
+    if(!tmp)
+      return -1;
+    list->terms = tmp;
+    list->size = size;
+  }
+  memcpy(list->terms[list->count].term, term, len);
+  list->terms[list->count].len = len;
+  list->terms[list->count++].tf = 1;
+  return 0;
+}
+
+static int compare_terms(const void *a, const void *b) {
+  const fulltext_term *ta = (const fulltext_term *) a;
+  const fulltext_term *tb = (const fulltext_term *) b;
+  if(ta->len != tb->len)
+    return (ta->len < tb->len ? -1 : 1);
+  return memcmp(ta->term, tb->term, ta->len);
+}
+
+/** Collect the distinct terms of a string
+*  The list is sorted and tf is set to the number of occurrences.
+*  The caller frees list->terms.
+*  returns 0 on success, -1 on error.
+*/
+static gint collect_terms(char *text, gint flags, gint min_len,
+  fulltext_term_list *list) {
+  gint i, j;
+
+  list->terms = NULL;
+  list->count = list->size = 0;
+  if(wg_fulltext_tokenize(text, flags, min_len, collect_term, list)) {
+    free(list->terms);
+    list->terms = NULL;
+    list->count = 0;
+    return -1;
+  }
+  if(list->count < 2)
+    return 0;
+
+  qsort(list->terms, list->count, sizeof(fulltext_term), compare_terms);
+  for(i=1, j=0; i<list->count; i++) {
+    if(!compare_terms(&list->terms[i], &list->terms[j]))
+      list->terms[j].tf++;
+    else
+      list->terms[++j] = list->terms[i];
+  }
+  list->count = j + 1;
+  return 0;
+}
+
+/** Collect the terms of a field of an indexed row
+*  Only WG_STRTYPE values have terms.
+*/
+static gint collect_field_terms(void *db, wg_index_header *hdr, gint enc,
+  fulltext_term_list *list) {
+  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+    list->terms = NULL;
+    list->count = list->size = 0;
+    return 0;
+  }
+  return collect_terms(wg_decode_str(db, enc), hdr->ctl.f.flags,
+    hdr->ctl.f.min_len, list);
+}
+
+/* ----------------- Postings list functions -------------- */
+
+/** Allocate storage for the index
+*  The first gint of the object is the allocator header.
+*  returns the offset of the usable area, 0 on error.
+*/
+static gint alloc_area(void *db, gint bytes) {
+  gint object = wg_alloc_gints(db,
+    &(dbmemsegh(db)->indexhash_area_header),
+    (bytes + sizeof(gint) - 1) / sizeof(gint) + 1);
+  return (object ? object + sizeof(gint) : 0);
+}
+
+static void free_area(void *db, gint offset) {
+  wg_free_object(db, &(dbmemsegh(db)->indexhash_area_header),
+    offset - sizeof(gint));
+}
+
+static gint put_varint(unsigned char *buf, wg_uint v) {
+  gint n = 0;
+  while(v >= 0x80) {
+    buf[n++] = (unsigned char) (v | 0x80);
+    v >>= 7;
+  }
+  buf[n++] = (unsigned char) v;
+  return n;
+}
+
+static gint get_varint(unsigned char *buf, wg_uint *v) {
+  gint n = 0;
+  int shift = 0;
+
+  *v = 0;
+  do {
+    *v |= ((wg_uint) (buf[n] & 0x7f)) << shift;
+    shift += 7;
+  } while(buf[n++] & 0x80);
+  return n;
+}
+
+/** Create a postings list with one row
+*  returns the offset of the list, 0 on error.
+*/
+static gint postings_new(void *db, wg_uint pos, gint tf) {
+  gint offset = alloc_area(db,
+    sizeof(wg_fulltext_postings) + POSTINGS_INITIAL);
+  wg_fulltext_postings *p;
+
+  if(!offset)
+    return 0;
+  p = (wg_fulltext_postings *) offsettoptr(db, offset);
+  p->size = POSTINGS_INITIAL;
+  p->used = put_varint(POSTINGS_DATA(p), pos);
+  p->used += put_varint(POSTINGS_DATA(p) + p->used, tf);
+  p->rows = 1;
+  p->last = (gint) pos;
+  return offset;
+}
+
+/** Replace oldlen bytes at position at with new bytes
+*  The list is moved to a larger object if needed, *offset is
+*  updated then. Shrinking never fails.
+*  returns 0 on success, -1 on error.
+*/
+static gint postings_splice(void *db, gint *offset, gint at, gint oldlen,
+  unsigned char *bytes, gint newlen) {
+  wg_fulltext_postings *p = (wg_fulltext_postings *) offsettoptr(db, *offset);
+  gint need = p->used - oldlen + newlen;
+
+  if(need > p->size) {
+    gint size = 2 * p->size, moved;
+    wg_fulltext_postings *np;
+
+    while(size < need)
+      size *= 2;
+    moved = alloc_area(db, sizeof(wg_fulltext_postings) + size);
+    if(!moved)
+      return show_fulltext_error(db, "Failed to grow a postings list");
+    np = (wg_fulltext_postings *) offsettoptr(db, moved);
+    *np = *p;
+    np->size = size;
+    memcpy(POSTINGS_DATA(np), POSTINGS_DATA(p), at);
+    memcpy(POSTINGS_DATA(np) + at + newlen, POSTINGS_DATA(p) + at + oldlen,
+      p->used - at - oldlen);
+    free_area(db, *offset);
+    *offset = moved;
+    p = np;
+  } else {
+    memmove(POSTINGS_DATA(p) + at + newlen, POSTINGS_DATA(p) + at + oldlen,
+      p->used - at - oldlen);
+  }
+  if(newlen)
+    memcpy(POSTINGS_DATA(p) + at, bytes, newlen);
+  p->used = need;
+  return 0;
+}
+
+/** Add a row to a postings list
+*  Rows added after the last one are appended, others are merged
+*  in place.
+*  returns 0 on success, -1 on error.
+*/
+static gint postings_insert(void *db, gint *offset, wg_uint pos, gint tf) {
+  wg_fulltext_postings *p = (wg_fulltext_postings *) offsettoptr(db, *offset);
+  unsigned char buf[3*VARINT_MAX];
+  gint n;
+
+  if(pos > (wg_uint) p->last) {
+    n = put_varint(buf, pos - (wg_uint) p->last);
+    n += put_varint(buf + n, tf);
+    if(postings_splice(db, offset, p->used, 0, buf, n))
+      return -1;
+    p = (wg_fulltext_postings *) offsettoptr(db, *offset);
+    p->last = (gint) pos;
+  } else {
+    unsigned char *data = POSTINGS_DATA(p);
+    wg_uint prev = 0, cur, delta, t;
+    gint at = 0, dl;
+
+    for(;;) {
+      dl = get_varint(data + at, &delta);
+      cur = prev + delta;
+      if(cur == pos)
+        return 0; /* already in the list */
+      if(cur > pos)
+        break;
+      prev = cur;
+      at += dl + get_varint(data + at + dl, &t);
+    }
+    /* the next row is now relative to the new one */
+    n = put_varint(buf, pos - prev);
+    n += put_varint(buf + n, tf);
+    n += put_varint(buf + n, cur - pos);
+    if(postings_splice(db, offset, at, dl, buf, n))
+      return -1;
+    p = (wg_fulltext_postings *) offsettoptr(db, *offset);
+  }
+  p->rows++;
+  return 0;
+}
+
+/** Remove a row from a postings list
+*  returns 1 if removed, 0 if the row was not in the list.
+*/
+static gint postings_delete(void *db, gint *offset, wg_uint pos) {
+  wg_fulltext_postings *p = (wg_fulltext_postings *) offsettoptr(db, *offset);
+  unsigned char *data = POSTINGS_DATA(p);
+  unsigned char buf[VARINT_MAX];
+  wg_uint prev = 0, cur, delta, t;
+  gint at = 0, len = 0;
+
+  while(at < p->used) {
+    len = get_varint(data + at, &delta);
+    len += get_varint(data + at + len, &t);
+    cur = prev + delta;
+    if(cur == pos)
+      break;
+    if(cur > pos)
+      return 0;
+    prev = cur;
+    at += len;
+  }
+  if(at >= p->used)
+    return 0;
+
+  if(at + len < p->used) {
+    /* the next row becomes relative to the previous one */
+    gint nl = get_varint(data + at + len, &delta);
+    postings_splice(db, offset, at, len + nl, buf,
+      put_varint(buf, pos + delta - prev));
+  } else {
+    postings_splice(db, offset, at, len, NULL, 0);
+    p->last = (gint) prev;
+  }
+  p->rows--;
+  return 1;
+}
+
+/* ----------------- Index maintenance functions -------------- */
+
+/** Initialize a full-text index
+*  returns 0 on success, -1 on error.
+*/
+gint wg_fulltext_create(void *db, wg_index_header *hdr, gint flags,
+  gint min_len) {
+  hdr->ctl.f.docs = 0;
+  hdr->ctl.f.flags = flags;
+  hdr->ctl.f.min_len = (min_len > 0 ? min_len : 1);
+  if(wg_create_hash(db, FULLTEXT_HASHP(hdr), 0))
+    return show_fulltext_error(db, "Failed to create the term hash");
+  return 0;
+}
+
+/** Release the terms and the postings lists of an index
+*  returns 0 on success, -1 on error.
+*/
+gint wg_fulltext_free(void *db, wg_index_header *hdr) {
+  db_hash_area_header *ha = FULLTEXT_HASHP(hdr);
+
+  if(ha->oldarraystart)
+    free_postings_array(db, ha->oldarraystart, ha->oldarraylength);
+  if(ha->arraystart)
+    free_postings_array(db, ha->arraystart, ha->arraylength);
+  if(wg_idxhash_free(db, ha))
+    return show_fulltext_error(db, "Failed to release the term hash");
+  hdr->ctl.f.docs = 0;
+  return 0;
+}
+
+/** Free the postings lists of the terms in a hash array
+*  Each term has a single list cell that holds the postings offset.
+*/
+static void free_postings_array(void *db, gint arraystart,
+  gint arraylength) {
+  gint i;
+
+  for(i=0; i<arraylength; i++) {
+    gint bucket = dbfetch(db, arraystart + i*sizeof(gint));
+    while(bucket) {
+      gint cell = dbfetch(db, bucket + HASHIDX_RECLIST_POS*sizeof(gint));
+      if(cell)
+        free_area(db, ((gcell *) offsettoptr(db, cell))->car);
+      bucket = dbfetch(db, bucket + HASHIDX_HASHCHAIN_POS*sizeof(gint));
+    }
+  }
+}
+
+/** Add the terms of a row to the index
+*  rec - offset of the record
+*  returns 0 on success, -1 on error.
+*/
+gint wg_fulltext_insert(void *db, wg_index_header *hdr, gint rec) {
+  fulltext_term_list list;
+  wg_uint pos = FULLTEXT_POS(rec);
+  gint i;
+
+  if(collect_field_terms(db, hdr,
+    wg_get_field(db, offsettoptr(db, rec), hdr->rec_field_index[0]), &list))
+    return show_fulltext_error(db, "Failed to allocate memory");
+
+  for(i=0; i<list.count; i++) {
+    fulltext_term *t = &list.terms[i];
+    gint cell = wg_idxhash_find(db, FULLTEXT_HASHP(hdr), t->term, t->len);
+    if(cell) {
+      if(postings_insert(db, &((gcell *) offsettoptr(db, cell))->car,
+        pos, t->tf))
+        break;
+    } else {
+      gint postings = postings_new(db, pos, t->tf);
+      if(!postings) {
+        show_fulltext_error(db, "Failed to allocate a postings list");
+        break;
+      }
+      if(wg_idxhash_store(db, FULLTEXT_HASHP(hdr), t->term, t->len,
+        postings)) {
+        free_area(db, postings);
+        show_fulltext_error(db, "Failed to store a term");
+        break;
+      }
+    }
+  }
+
+  if(list.count)
+    hdr->ctl.f.docs++;
+  free(list.terms);
+  return (i < list.count ? -1 : 0);
+}
+
+/** Remove the terms of a row from the index
+*  rec - offset of the record
+*  returns 0 on success, -1 if the row was not in the index.
+*/
+gint wg_fulltext_delete(void *db, wg_index_header *hdr, gint rec) {
+  fulltext_term_list list;
+  wg_uint pos = FULLTEXT_POS(rec);
+  gint i, removed = 0;
+
+  if(collect_field_terms(db, hdr,
+    wg_get_field(db, offsettoptr(db, rec), hdr->rec_field_index[0]), &list))
+    return show_fulltext_error(db, "Failed to allocate memory");
+
+  for(i=0; i<list.count; i++) {
+    fulltext_term *t = &list.terms[i];
+    gint cell = wg_idxhash_find(db, FULLTEXT_HASHP(hdr), t->term, t->len);
+    gint *postings;
+
+    if(!cell)
+      continue;
+    postings = &((gcell *) offsettoptr(db, cell))->car;
+    if(postings_delete(db, postings, pos))
+      removed = 1;
+    if(!((wg_fulltext_postings *) offsettoptr(db, *postings))->rows) {
+      gint offset = *postings;
+      wg_idxhash_remove(db, FULLTEXT_HASHP(hdr), t->term, t->len, offset);
+      free_area(db, offset);
+    }
+  }
+
+  if(removed)
+    hdr->ctl.f.docs--;
+  free(list.terms);
+  return (removed ? 0 : -1);
+}
+
+/** Check if a value contains all the terms of a string
+*  Both are tokenized with the default settings. Used when no
+*  full-text index answers the query.
+*  field - encoded value
+*  text - encoded string with the terms
+*  returns 1 if the terms are found, 0 if not or if there are no terms.
+*/
+gint wg_fulltext_contains(void *db, gint field, gint text) {
+  fulltext_term_list terms, fterms;
+  gint i, res = 0;
+
+  if(wg_get_encoded_type(db, field) != WG_STRTYPE ||\
+    wg_get_encoded_type(db, text) != WG_STRTYPE)
+    return 0;
+  if(collect_terms(wg_decode_str(db, text), 0, WG_FULLTEXT_MIN_LEN, &terms))
+    return 0;
+  if(!terms.count || collect_terms(wg_decode_str(db, field), 0,
+    WG_FULLTEXT_MIN_LEN, &fterms)) {
+    free(terms.terms);
+    return 0;
+  }
+
+  for(i=0; i<terms.count; i++) {
+    if(!bsearch(&terms.terms[i], fterms.terms, fterms.count,
+      sizeof(fulltext_term), compare_terms))
+      break;
+  }
+  res = (i == terms.count);
+  free(terms.terms);
+  free(fterms.terms);
+  return res;
+}
+
+/* ----------------- Query functions -------------- */
+
+/** Create a term query cursor
+*  text is tokenized like the indexed values. If it has no terms,
+*  the cursor returns no rows.
+*  returns NULL on error.
+*/
+wg_fulltext_cursor *wg_fulltext_new_cursor(void *db, wg_index_header *hdr,
+  char *text, gint mode) {
+  fulltext_term_list list;
+  wg_fulltext_cursor *cur;
+  gint i;
+
+  if(collect_terms(text, hdr->ctl.f.flags, hdr->ctl.f.min_len, &list)) {
+    show_fulltext_error(db, "Failed to allocate memory");
+    return NULL;
+  }
+  cur = (wg_fulltext_cursor *) malloc(sizeof(wg_fulltext_cursor) +\
+    list.count * sizeof(wg_fulltext_term_cursor));
+  if(!cur) {
+    free(list.terms);
+    show_fulltext_error(db, "Failed to allocate memory");
+    return NULL;
+  }
+  cur->mode = mode;
+  cur->count = list.count;
+  cur->pos = 0;
+  cur->started = 0;
+  cur->terms = (wg_fulltext_term_cursor *) (cur + 1);
+
+  for(i=0; i<list.count; i++) {
+    wg_fulltext_term_cursor *t = &cur->terms[i];
+    gint cell = wg_idxhash_find(db, FULLTEXT_HASHP(hdr),
+      list.terms[i].term, list.terms[i].len);
+    t->postings = (cell ? ((gcell *) offsettoptr(db, cell))->car : 0);
+    t->at = 0;
+    t->pos = 0;
+    t->tf = 0;
+    t->done = !cell;
+    term_advance(db, t);
+  }
+  free(list.terms);
+  return cur;
+}
+
+void wg_fulltext_free_cursor(void *db, wg_fulltext_cursor *cur) {
+  free(cur);
+}
+
+/** Move a term cursor to the next row of its postings list
+*/
+static void term_advance(void *db, wg_fulltext_term_cursor *t) {
+  wg_fulltext_postings *p;
+  wg_uint delta, tf;
+
+  if(t->done)
+    return;
+  p = (wg_fulltext_postings *) offsettoptr(db, t->postings);
+  if(t->at >= p->used) {
+    t->done = 1;
+    return;
+  }
+  t->at += get_varint(POSTINGS_DATA(p) + t->at, &delta);
+  t->at += get_varint(POSTINGS_DATA(p) + t->at, &tf);
+  t->pos += delta;
+  t->tf = (gint) tf;
+}
+
+/** Return the next row of a term query
+*  In WG_FULLTEXT_AND mode the postings lists are intersected, in
+*  WG_FULLTEXT_OR mode they are merged. After a row is returned, the
+*  term cursors that are on the row have its term frequency.
+*  returns the record offset, 0 if there are no more rows.
+*/
+gint wg_fulltext_next(void *db, wg_fulltext_cursor *cur) {
+  gint i;
+
+  if(!cur->count)
+    return 0;
+
+  if(cur->mode == WG_FULLTEXT_AND) {
+    if(cur->started)
+      term_advance(db, &cur->terms[0]);
+    cur->started = 1;
+    for(;;) {
+      wg_uint target = 0;
+      int agreed = 1;
+
+      for(i=0; i<cur->count; i++) {
+        if(cur->terms[i].done)
+          return 0;
+        if(cur->terms[i].pos > target)
+          target = cur->terms[i].pos;
+      }
+      for(i=0; i<cur->count; i++) {
+        wg_fulltext_term_cursor *t = &cur->terms[i];
+        while(!t->done && t->pos < target)
+          term_advance(db, t);
+        if(t->done)
+          return 0;
+        if(t->pos != target)
+          agreed = 0;
+      }
+      if(agreed) {
+        cur->pos = target;
+        return FULLTEXT_REC(target);
+      }
+    }
+  } else {
+    wg_uint prev = cur->pos;
+    int found = 0;
+
+    for(i=0; i<cur->count; i++) {
+      wg_fulltext_term_cursor *t = &cur->terms[i];
+      if(cur->started && !t->done && t->pos == prev)
+        term_advance(db, t);
+      if(!t->done && (!found || t->pos < cur->pos)) {
+        cur->pos = t->pos;
+        found = 1;
+      }
+    }
+    cur->started = 1;
+    return (found ? FULLTEXT_REC(cur->pos) : 0);
+  }
+}
+
+/** Find the best matching rows of a term query
+*  The score of a row is the sum of the BM25 weights of the query
+*  terms that it contains. Up to k rows are stored in rows, with the
+*  scores in scores (may be NULL), the best first.
+*  returns the number of rows stored, -1 on error.
+*/
+gint wg_fulltext_rank(void *db, wg_index_header *hdr, char *text, gint mode,
+  gint k, void **rows, double *scores) {
+  wg_fulltext_cursor *cur;
+  double *idf, *sc = scores;
+  double docs = (double) hdr->ctl.f.docs;
+  gint i, rec, found = 0;
+
+  cur = wg_fulltext_new_cursor(db, hdr, text, mode);
+  if(!cur)
+    return -1;
+  idf = (double *) malloc((cur->count + (scores ? 0 : k)) * sizeof(double));
+  if(!idf) {
+    wg_fulltext_free_cursor(db, cur);
+    return show_fulltext_error(db, "Failed to allocate memory");
+  }
+  if(!scores)
+    sc = idf + cur->count;
+
+  for(i=0; i<cur->count; i++) {
+    double df = 0;
+    if(cur->terms[i].postings)
+      df = (double) ((wg_fulltext_postings *) offsettoptr(db,
+        cur->terms[i].postings))->rows;
+    idf[i] = wg_stats_log(1.0 + (docs - df + 0.5) / (df + 0.5));
+  }
+
+  /* Keep the best k rows in a min-heap */
+  while((rec = wg_fulltext_next(db, cur))) {
+    double score = 0;
+    for(i=0; i<cur->count; i++) {
+      wg_fulltext_term_cursor *t = &cur->terms[i];
+      if(!t->done && t->pos == cur->pos)
+        score += idf[i] * (t->tf * (BM25_K1 + 1)) / (t->tf + BM25_K1);
+    }
+    if(found < k) {
+      gint j = found++;
+      while(j && sc[(j-1)/2] > score) {
+        rows[j] = rows[(j-1)/2];
+        sc[j] = sc[(j-1)/2];
+        j = (j-1)/2;
+      }
+      rows[j] = offsettoptr(db, rec);
+      sc[j] = score;
+    } else if(k && score > sc[0]) {
+      rows[0] = offsettoptr(db, rec);
+      sc[0] = score;
+      heap_sift_down(rows, sc, found, 0);
+    }
+  }
+
+  /* Sort: the smallest score is moved to the end each time */
+  for(i=found-1; i>0; i--) {
+    void *r = rows[0];
+    double s = sc[0];
+    rows[0] = rows[i];
+    sc[0] = sc[i];
+    rows[i] = r;
+    sc[i] = s;
+    heap_sift_down(rows, sc, i, 0);
+  }
+
+  free(idf);
+  wg_fulltext_free_cursor(db, cur);
+  return found;
+}
+
+static void heap_sift_down(void **rows, double *scores, gint count, gint i) {
+  for(;;) {
+    gint smallest = i, l = 2*i + 1, r = 2*i + 2;
+    void *tr;
+    double ts;
+
+    if(l < count && scores[l] < scores[smallest])
+      smallest = l;
+    if(r < count && scores[r] < scores[smallest])
+      smallest = r;
+    if(smallest == i)
+      return;
+    tr = rows[i];
+    ts = scores[i];
+    rows[i] = rows[smallest];
+    scores[i] = scores[smallest];
+    rows[smallest] = tr;
+    scores[smallest] = ts;
+    i = smallest;
+  }
+}
+
+/* --------------- error handling ------------------------------*/
+
+/** called with err msg
+*
+*  may print or log an error
+*  does not do any jumps etc
+*/
+
+static gint show_fulltext_error(void* db, char* errmsg) {
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"full-text index error: %s\n",errmsg);
+#endif
+  return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,114 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbfulltext.h
+ * Public headers for full-text index routines
+ */
+
+#ifndef DEFINED_DBFULLTEXT_H
+#define DEFINED_DBFULLTEXT_H
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+
+#include "dballoc.h"
+/* For gint data type */
+#include "dbdata.h"
+
+/* ==== Public macros ==== */
+
+/* Tokenizer flags */
+#define WG_FULLTEXT_KEEP_CASE 0x1 /** terms are case sensitive */
+#define WG_FULLTEXT_ASCII     0x2 /** non-ASCII characters separate terms */
+
+#define WG_FULLTEXT_MIN_LEN 2     /** default shortest term (characters) */
+#define WG_FULLTEXT_MAX_TERM 64   /** longer terms are truncated (bytes) */
+
+/* Term query modes */
+#define WG_FULLTEXT_AND 1         /** rows with all terms */
+#define WG_FULLTEXT_OR 2          /** rows with any of the terms */
+
+/* Index header helpers */
+#define FULLTEXT_HASHP(x) (&(x->ctl.f.hasharea))
+
+/* ====== data structures ======== */
+
+/** postings list of a term
+*   The rows are sorted by position (record offset divided by the
+*   record alignment). Each row is stored as the difference from the
+*   previous position and the number of occurrences of the term,
+*   both as variable length integers of 7 bits per byte. The bytes
+*   follow this header.
+*/
+typedef struct {
+  gint size;            /** bytes allocated for the data */
+  gint used;            /** bytes in use */
+  gint rows;            /** number of rows */
+  gint last;            /** position of the last row */
+} wg_fulltext_postings;
+
+/** position of a term query in one postings list */
+typedef struct {
+  gint postings;        /** offset of the postings, 0 if not found */
+  gint at;              /** next byte to read */
+  wg_uint pos;          /** current row position */
+  gint tf;              /** occurrences in the current row */
+  int done;             /** no more rows */
+} wg_fulltext_term_cursor;
+
+/** term query cursor
+*   The rows are returned in the order of their offsets.
+*/
+typedef struct {
+  gint mode;            /** WG_FULLTEXT_AND or WG_FULLTEXT_OR */
+  gint count;           /** number of terms */
+  wg_uint pos;          /** last row returned */
+  int started;
+  wg_fulltext_term_cursor *terms;
+} wg_fulltext_cursor;
+
+typedef gint (*wg_fulltext_term_fn)(void *ctx, char *term, gint len);
+
+/* ==== Protos ==== */
+
+gint wg_fulltext_tokenize(char *text, gint flags, gint min_len,
+  wg_fulltext_term_fn fn, void *ctx);
+
+gint wg_fulltext_create(void *db, wg_index_header *hdr, gint flags,
+  gint min_len);
+gint wg_fulltext_free(void *db, wg_index_header *hdr);
+gint wg_fulltext_insert(void *db, wg_index_header *hdr, gint rec);
+gint wg_fulltext_delete(void *db, wg_index_header *hdr, gint rec);
+gint wg_fulltext_contains(void *db, gint field, gint text);
+gint wg_fulltext_rank(void *db, wg_index_header *hdr, char *text, gint mode,
+  gint k, void **rows, double *scores);
+
+wg_fulltext_cursor *wg_fulltext_new_cursor(void *db, wg_index_header *hdr,
+  char *text, gint mode);
+gint wg_fulltext_next(void *db, wg_fulltext_cursor *cur);
+void wg_fulltext_free_cursor(void *db, wg_fulltext_cursor *cur);
+
+#endif /* DEFINED_DBFULLTEXT_H */
@@ -54,6 +54,12 @@ extern "C" {
 
 /* ====== Private headers and defs ======== */
 
+/* Index hash is resized when there are more keys than this per array slot */
+#define IDXHASH_MAX_LOAD 1
+
+/* Number of old array slots migrated per insert or delete during resize */
+#define IDXHASH_MIGRATE_STEP 4
+
 /* Bucket capacity > 1 reduces the impact of collisions */
 #define GINTHASH_BUCKETCAP 7
 
@@ -100,6 +106,26 @@ typedef struct {
 #define FNV_prime ((wg_uint) 16777619UL)
 #endif
 
+/* Constants of the MurmurHash64A mixing function */
+#define MURMUR_MULT ((guint64) 0xc6a4a7935bd1e995ULL)
+#define MURMUR_SHIFT 47
+#define MURMUR_SEED ((guint64) 0x9e3779b97f4a7c15ULL)
+
+/* Slot in a hash array. Array lengths are always powers of two. */
+#define HASH_SLOT(h, len) ((h) & ((wg_uint) (len) - 1))
+
+/* Blocked Bloom filter of an index hash. A block is 8 32-bit words
+ * (one cache line on most systems is 2 blocks), a key sets one bit
+ * in each word. The filter has its own hash seed, so the bits do not
+ * depend on the slot of the key in the hash array. */
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 32)
+#define BLOOM_SEED ((guint64) 0x2545f4914f6cdd1dULL)
+#define BLOOM_DEFAULT_BITS 12 /* bits per key, about 0.5% false positives */
+#define BLOOM_MAX_BITS 64
+#define BLOOM_MIN_KEYS 64
+#define BLOOM_BIT(h, i) (((guint32) 1) << (((guint32) (h) * bloom_salt[i]) >> 27))
+
 /* ======= Private protos ================ */
 
 
@@ -111,9 +137,20 @@ static gint show_consistency_error_nr(void* db, char* errmsg, gint nr) ;
 static gint show_hash_error(void* db, char* errmsg);
 static gint show_ginthash_error(void *db, char* errmsg);
 
-static wg_uint hash_bytes(void *db, char *data, gint length, gint hashsz);
+static guint64 hash_mix(const char *data, gint length, guint64 h);
+static wg_uint hash_fold(guint64 h);
 static gint find_idxhash_bucket(void *db, char *data, gint length,
   gint *chainoffset);
+static gint find_idxhash_key(void *db, db_hash_area_header *ha,
+  char *data, gint length, wg_uint *hash, gint *chainoffset);
+static gint grow_idxhash(void *db, db_hash_area_header *ha);
+static void migrate_idxhash(void *db, db_hash_area_header *ha, gint steps);
+static gint free_idxhash_array(void *db, gint arraystart, gint arraylength);
+static gint bloom_build(void *db, db_hash_area_header *ha,
+  db_bloom_header *bf, gint bits_per_key);
+static void bloom_fill(void *db, db_bloom_header *bf, gint arraystart,
+  gint from, gint arraylength);
+static guint32 *bloom_block(void *db, db_bloom_header *bf, guint64 h);
 
 static gint rehash_gint(gint val);
 static gint grow_ginthash(void *db, ext_ginthash *tbl);
@@ -133,28 +170,23 @@ static gint remove_from_bucket(ginthash_bucket *bucket, int idx);
 
 /* Hash function for two-part strings and blobs.
 *
-* Based on sdbm.
+* The extra string is chained to the hash of the main part.
 *
 */
 
 int wg_hash_typedstr(void* db, char* data, char* extrastr, gint type, gint length) {
-  char* endp;
-  unsigned long hash = 0;
-  int c;
+  guint64 hash = MURMUR_SEED;
 
   //printf("in wg_hash_typedstr %s %s %d %d \n",data,extrastr,type,length);
   if (data!=NULL) {
-    for(endp=data+length; data<endp; data++) {
-      c = (int)(*data);
-      hash = c + (hash << 6) + (hash << 16) - hash;
-    }
+    hash = hash_mix(data, length, hash);
   }
   if (extrastr!=NULL) {
-    while ((c = *extrastr++))
-      hash = c + (hash << 6) + (hash << 16) - hash;
+    hash = hash_mix(extrastr, strlen(extrastr), hash);
   }
 
-  return (int)(hash % (dbmemsegh(db)->strhash_area_header).arraylength);
+  return (int) HASH_SLOT(hash_fold(hash),
+    (dbmemsegh(db)->strhash_area_header).arraylength);
 }
 
 
@@ -265,38 +297,52 @@ gint wg_remove_from_strhash(void* db, gint longstr) {
 
 /* -------------- hash index support ------------------ */
 
-#define CONCAT_FOR_HASHING(d, b, e, l, bb, en) \
-  if(e) { \
-    gint xl = wg_decode_xmlliteral_xsdtype_len(d, en); \
-    bb = malloc(xl + l + 1); \
-    if(!bb) \
-      return 0; \
-    memcpy(bb, e, xl); \
-    bb[xl] = '\0'; \
-    memcpy(bb + xl + 1, b, l); \
-    b = bb; \
-    l += xl + 1; \
-  }
-
 /*
  * Return an encoded value as a decoded byte array.
  * It should be freed afterwards.
  * returns the number of bytes in the array.
  * returns 0 if the decode failed.
  *
+ * See wg_decode_for_hashing_copy() for the format.
+ */
+gint wg_decode_for_hashing(void *db, gint enc, char **decbytes) {
+  gint len;
+  char *outbuf;
+
+  len = wg_decode_for_hashing_copy(db, enc, NULL, 0);
+  if(len < 1)
+    return 0;
+  outbuf = malloc(len);
+  if(!outbuf)
+    return 0; /* Indicate failure */
+  wg_decode_for_hashing_copy(db, enc, outbuf, len);
+  *decbytes = outbuf;
+  return len;
+}
+
+/*
+ * Decode an encoded value into a byte array for hashing.
+ * The bytes are written to buf if they fit in buflen bytes,
+ * so the function can be called with buflen 0 to get the length.
+ * No memory is allocated.
+ * returns the number of bytes needed.
+ * returns 0 if the decode failed.
+ *
  * NOTE: to differentiate between identical byte strings
- * the value is prefixed with a type identifier.
+ * the value is prefixed with a type identifier. For URI-s and
+ * XML literals, the prefix or type string is prepended, separated
+ * by a '\0' byte.
  * TODO: For values with varying length that can contain
  * '\0' bytes, add length to the prefix.
  */
-gint wg_decode_for_hashing(void *db, gint enc, char **decbytes) {
-  gint len;
+gint wg_decode_for_hashing_copy(void *db, gint enc, char *buf, gint buflen) {
+  gint len, exlen = 0;
   gint type;
   gint ptrdata;
   int intdata;
   double doubledata;
   char *bytedata;
-  char *exdata, *buf = NULL, *outbuf;
+  char *exdata = NULL;
 
   type = wg_get_encoded_type(db, enc);
   switch(type) {
@@ -333,13 +379,11 @@ gint wg_decode_for_hashing(void *db, gint enc, char **decbytes) {
       len = wg_decode_uri_len(db, enc);
       bytedata = wg_decode_uri(db, enc);
       exdata = wg_decode_uri_prefix(db, enc);
-      CONCAT_FOR_HASHING(db, bytedata, exdata, len, buf, enc)
       break;
     case WG_XMLLITERALTYPE:
       len = wg_decode_xmlliteral_len(db, enc);
       bytedata = wg_decode_xmlliteral(db, enc);
       exdata = wg_decode_xmlliteral_xsdtype(db, enc);
-      CONCAT_FOR_HASHING(db, bytedata, exdata, len, buf, enc)
       break;
     case WG_CHARTYPE:
       len = sizeof(int);
@@ -367,35 +411,83 @@ gint wg_decode_for_hashing(void *db, gint enc, char **decbytes) {
       return 0;
   }
 
+  if(exdata) {
+    /* same length accessor for both types */
+    exlen = wg_decode_xmlliteral_xsdtype_len(db, enc) + 1;
+  }
+
   /* Form the hashable buffer. It is not 0-terminated */
-  outbuf = malloc(len + 1);
-  if(outbuf) {
-    outbuf[0] = (char) type;
-    memcpy(outbuf + 1, bytedata, len++);
-    *decbytes = outbuf;
-  } else {
-    /* Indicate failure */
-    len = 0;
+  if(buf && 1 + exlen + len <= buflen) {
+    buf[0] = (char) type;
+    if(exlen) {
+      memcpy(buf + 1, exdata, exlen - 1);
+      buf[exlen] = '\0';
+    }
+    memcpy(buf + 1 + exlen, bytedata, len);
   }
+  return 1 + exlen + len;
+}
 
-  if(buf)
-    free(buf);
-  return len;
+/*
+ * Calculate a hash for a byte buffer.
+ */
+wg_uint wg_hash_bytes(char *data, gint length) {
+  if (data==NULL)
+    return 0;
+  return hash_fold(hash_mix(data, length, MURMUR_SEED));
 }
 
 /*
- * Calculate a hash for a byte buffer. Truncates the hash to given size.
+ * Mix a byte buffer into a hash value, eight bytes at a time.
+ * Based on MurmurHash64A by Austin Appleby (public domain). The
+ * input hash is used as the seed, so buffers can be chained.
  */
-static wg_uint hash_bytes(void *db, char *data, gint length, gint hashsz) {
-  char* endp;
-  wg_uint hash = 0;
+static guint64 hash_mix(const char *data, gint length, guint64 h) {
+  const char *endp = data + (length & ~((gint) 7));
+  guint64 k;
+
+  h ^= (guint64) length * MURMUR_MULT;
+  for(; data<endp; data+=8) {
+    memcpy(&k, data, 8); /* unaligned and strict aliasing safe */
+    k *= MURMUR_MULT;
+    k ^= k >> MURMUR_SHIFT;
+    k *= MURMUR_MULT;
+    h ^= k;
+    h *= MURMUR_MULT;
+  }
 
-  if (data!=NULL) {
-    for(endp=data+length; data<endp; data++) {
-      hash = *data + (hash << 6) + (hash << 16) - hash;
-    }
+  switch(length & 7) {
+    case 7: h ^= (guint64) ((unsigned char) data[6]) << 48;
+      /* fall through */
+    case 6: h ^= (guint64) ((unsigned char) data[5]) << 40;
+      /* fall through */
+    case 5: h ^= (guint64) ((unsigned char) data[4]) << 32;
+      /* fall through */
+    case 4: h ^= (guint64) ((unsigned char) data[3]) << 24;
+      /* fall through */
+    case 3: h ^= (guint64) ((unsigned char) data[2]) << 16;
+      /* fall through */
+    case 2: h ^= (guint64) ((unsigned char) data[1]) << 8;
+      /* fall through */
+    case 1: h ^= (guint64) ((unsigned char) data[0]);
+      h *= MURMUR_MULT;
   }
-  return hash % hashsz;
+
+  h ^= h >> MURMUR_SHIFT;
+  h *= MURMUR_MULT;
+  h ^= h >> MURMUR_SHIFT;
+  return h;
+}
+
+/*
+ * Reduce a 64-bit hash to the native word size.
+ */
+static wg_uint hash_fold(guint64 h) {
+#ifdef HAVE_64BIT_GINT
+  return (wg_uint) h;
+#else
+  return (wg_uint) (h ^ (h >> 32));
+#endif
 }
 
 /*
@@ -423,6 +515,91 @@ static gint find_idxhash_bucket(void *db, char *data, gint length,
   return 0;
 }
 
+/*
+ * Finds the bucket of a hash string in an index hash. If the hash
+ * is being resized, the not yet migrated part of the old array is
+ * searched as well.
+ * hash is set to the hash value of the string. If the bucket is found,
+ * chainoffset will point to the offset storing the bucket.
+ */
+static gint find_idxhash_key(void *db, db_hash_area_header *ha,
+  char *data, gint length, wg_uint *hash, gint *chainoffset)
+{
+  gint bucket;
+
+  *hash = wg_hash_bytes(data, length);
+  *chainoffset = (ha->arraystart)+(sizeof(gint) *\
+    HASH_SLOT(*hash, ha->arraylength));
+  bucket = find_idxhash_bucket(db, data, length, chainoffset);
+  if(!bucket && ha->oldarraystart) {
+    gint slot = HASH_SLOT(*hash, ha->oldarraylength);
+    if(slot >= ha->migratepos) {
+      *chainoffset = (ha->oldarraystart)+(sizeof(gint) * slot);
+      bucket = find_idxhash_bucket(db, data, length, chainoffset);
+    }
+  }
+  return bucket;
+}
+
+/*
+ * Start resizing the index hash. A new array of double size is
+ * allocated and the buckets of the old array are moved to it
+ * gradually by migrate_idxhash().
+ *
+ * Returns 0 on success
+ * Returns -1 on error (the hash remains usable).
+ */
+static gint grow_idxhash(void *db, db_hash_area_header *ha) {
+  db_hash_area_header newha;
+
+  if(wg_create_hash(db, &newha, 2*ha->arraylength))
+    return -1;
+  ha->oldarraystart = ha->arraystart;
+  ha->oldarraylength = ha->arraylength;
+  ha->migratepos = 0;
+  ha->offset = newha.offset;
+  ha->size = newha.size;
+  ha->arraystart = newha.arraystart;
+  ha->arraysize = newha.arraysize;
+  ha->arraylength = newha.arraylength;
+  return 0;
+}
+
+/*
+ * Move the hash chains of the given number of old array slots
+ * to the new array. Frees the old array when all slots are done.
+ */
+static void migrate_idxhash(void *db, db_hash_area_header *ha, gint steps) {
+  while(steps-- && ha->migratepos < ha->oldarraylength) {
+    gint slot = (ha->oldarraystart)+(sizeof(gint) * ha->migratepos);
+    gint bucket = dbfetch(db, slot);
+    while(bucket) {
+      gint next = dbfetch(db, bucket + HASHIDX_HASHCHAIN_POS*sizeof(gint));
+      gint length = dbfetch(db, bucket + HASHIDX_META_POS*sizeof(gint));
+      char *bucket_data = offsettoptr(db, bucket + \
+        HASHIDX_HEADER_SIZE*sizeof(gint));
+      gint head_offset = (ha->arraystart)+(sizeof(gint) *\
+        HASH_SLOT(wg_hash_bytes(bucket_data, length), ha->arraylength));
+
+      dbstore(db, bucket + HASHIDX_HASHCHAIN_POS*sizeof(gint),
+        dbfetch(db, head_offset));
+      dbstore(db, head_offset, bucket);
+      bucket = next;
+    }
+    dbstore(db, slot, 0);
+    ha->migratepos++;
+  }
+
+  if(ha->migratepos >= ha->oldarraylength) {
+    /* array object starts with the allocator header */
+    wg_free_object(db, &(dbmemsegh(db)->indexhash_area_header),
+      ha->oldarraystart - sizeof(gint));
+    ha->oldarraystart = 0;
+    ha->oldarraylength = 0;
+    ha->migratepos = 0;
+  }
+}
+
 /*
  * Store a hash string and an offset to the index hash.
  * Based on longstr hash, with some simplifications.
@@ -439,14 +616,13 @@ gint wg_idxhash_store(void* db, db_hash_area_header *ha,
   gint rec_head, rec_offset;
   gcell *rec_cell;
 
-  hash = hash_bytes(db, data, length, ha->arraylength);
-  head_offset = (ha->arraystart)+(sizeof(gint) * hash);
-  head = dbfetch(db, head_offset);
+  if(ha->oldarraystart)
+    migrate_idxhash(db, ha, IDXHASH_MIGRATE_STEP);
 
   /* Traverse the hash chain to check if there is a matching
    * hash string already
    */
-  bucket = find_idxhash_bucket(db, data, length, &head_offset);
+  bucket = find_idxhash_key(db, ha, data, length, &hash, &head_offset);
   if(!bucket) {
     size_t i;
     gint lengints, lenrest;
@@ -476,9 +652,18 @@ gint wg_idxhash_store(void* db, db_hash_area_header *ha,
     dbstore(db, bucket + HASHIDX_META_POS*sizeof(gint), length);
     dbstore(db, bucket + HASHIDX_RECLIST_POS*sizeof(gint), 0);
 
-    /* Prepend to hash chain */
-    dbstore(db, ((ha->arraystart)+(sizeof(gint) * hash)), bucket);
+    /* Prepend to hash chain (new keys always go to the current array) */
+    head_offset = (ha->arraystart)+(sizeof(gint) *\
+      HASH_SLOT(hash, ha->arraylength));
+    head = dbfetch(db, head_offset);
+    dbstore(db, head_offset, bucket);
     dbstore(db, bucket + HASHIDX_HASHCHAIN_POS*sizeof(gint), head);
+
+    ha->entries++;
+    if(!ha->oldarraystart &&\
+      ha->entries > ha->arraylength * IDXHASH_MAX_LOAD) {
+      grow_idxhash(db, ha); /* failure is not fatal */
+    }
   }
 
   /* Add the record offset to the list. */
@@ -505,11 +690,11 @@ gint wg_idxhash_remove(void* db, db_hash_area_header *ha,
   gint bucket_offset, bucket;
   gint *next_offset, *reclist_offset;
 
-  hash = hash_bytes(db, data, length, ha->arraylength);
-  bucket_offset = (ha->arraystart)+(sizeof(gint) * hash); /* points to head */
+  if(ha->oldarraystart)
+    migrate_idxhash(db, ha, IDXHASH_MIGRATE_STEP);
 
   /* Find the correct bucket. */
-  bucket = find_idxhash_bucket(db, data, length, &bucket_offset);
+  bucket = find_idxhash_key(db, ha, data, length, &hash, &bucket_offset);
   if(!bucket) {
     return show_hash_error(db, "wg_idxhash_remove: Hash value not found.");
   }
@@ -534,6 +719,7 @@ is_bucket_empty:
     gint nextchain = dbfetch(db, bucket + HASHIDX_HASHCHAIN_POS*sizeof(gint));
     dbstore(db, bucket_offset, nextchain);
     wg_free_object(db, &(dbmemsegh(db)->indexhash_area_header), bucket);
+    ha->entries--;
   }
 
   return 0;
@@ -541,6 +727,7 @@ is_bucket_empty:
 
 /*
  * Retrieve the list of matching offsets from the hash.
+ * Does not modify the hash, so this is safe under a read lock.
  *
  * Returns the offset to head of the linked list.
  * Returns 0 if value was not found.
@@ -551,17 +738,234 @@ gint wg_idxhash_find(void* db, db_hash_area_header *ha,
   wg_uint hash;
   gint head_offset, bucket;
 
-  hash = hash_bytes(db, data, length, ha->arraylength);
-  head_offset = (ha->arraystart)+(sizeof(gint) * hash); /* points to head */
-
   /* Find the correct bucket. */
-  bucket = find_idxhash_bucket(db, data, length, &head_offset);
+  bucket = find_idxhash_key(db, ha, data, length, &hash, &head_offset);
   if(!bucket)
     return 0;
 
   return dbfetch(db, bucket + HASHIDX_RECLIST_POS*sizeof(gint));
 }
 
+/*
+ * Release the index hash: the buckets, their offset lists and the
+ * hash array. If the hash was being resized, the old array is
+ * released as well.
+ *
+ * Returns 0 on success
+ * Returns -1 on error.
+ */
+gint wg_idxhash_free(void* db, db_hash_area_header *ha)
+{
+  if(ha->oldarraystart) {
+    if(free_idxhash_array(db, ha->oldarraystart, ha->oldarraylength))
+      return -1;
+    ha->oldarraystart = 0;
+    ha->oldarraylength = 0;
+    ha->migratepos = 0;
+  }
+  if(ha->arraystart) {
+    if(free_idxhash_array(db, ha->arraystart, ha->arraylength))
+      return -1;
+    ha->arraystart = 0;
+    ha->arraylength = 0;
+  }
+  ha->entries = 0;
+  return 0;
+}
+
+/*
+ * Free all buckets in a hash array and the array itself.
+ */
+static gint free_idxhash_array(void *db, gint arraystart, gint arraylength)
+{
+  void *area = &(dbmemsegh(db)->indexhash_area_header);
+  gint i;
+
+  for(i=0; i<arraylength; i++) {
+    gint bucket = dbfetch(db, arraystart + i*sizeof(gint));
+    while(bucket) {
+      gint next = dbfetch(db, bucket + HASHIDX_HASHCHAIN_POS*sizeof(gint));
+      gint cell = dbfetch(db, bucket + HASHIDX_RECLIST_POS*sizeof(gint));
+      while(cell) {
+        gint nextcell = ((gcell *) offsettoptr(db, cell))->cdr;
+        wg_free_listcell(db, cell);
+        cell = nextcell;
+      }
+      if(wg_free_object(db, area, bucket))
+        return show_hash_error(db, "Failed to free an index hash bucket");
+      bucket = next;
+    }
+  }
+  /* array object starts with the allocator header */
+  if(wg_free_object(db, area, arraystart - sizeof(gint)))
+    return show_hash_error(db, "Failed to free the index hash array");
+  return 0;
+}
+
+/* ------- Bloom filter of an index hash ---------- */
+
+/* Salts of the bit positions in the words of a block */
+static const guint32 bloom_salt[BLOOM_BLOCK_WORDS] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+/*
+ * Create a Bloom filter of the keys in an index hash.
+ * If the filter exists, it is rebuilt, which also drops the bits of
+ * the removed keys. bits_per_key <= 0 uses the default size.
+ * The filter is sized for twice the current keys (at least the hash
+ * array length) and rebuilt larger when the keys no longer fit.
+ *
+ * Returns 0 on success
+ * Returns -1 on error (an existing filter is kept).
+ */
+gint wg_idxhash_bloom_create(void *db, db_hash_area_header *ha,
+  db_bloom_header *bf, gint bits_per_key)
+{
+  if(bits_per_key <= 0)
+    bits_per_key = BLOOM_DEFAULT_BITS;
+  else if(bits_per_key > BLOOM_MAX_BITS)
+    bits_per_key = BLOOM_MAX_BITS;
+  if(bloom_build(db, ha, bf, bits_per_key))
+    return -1;
+  bf->lookups = 0;
+  bf->negatives = 0;
+  bf->false_positives = 0;
+  return 0;
+}
+
+/*
+ * Release the Bloom filter of an index hash.
+ */
+void wg_idxhash_bloom_free(void *db, db_bloom_header *bf)
+{
+  if(bf->offset) {
+    /* filter object starts with the allocator header */
+    wg_free_object(db, &(dbmemsegh(db)->indexhash_area_header),
+      bf->offset - sizeof(gint));
+  }
+  memset(bf, 0, sizeof(db_bloom_header));
+}
+
+/*
+ * Add a key to the Bloom filter. The key must already be stored
+ * in the index hash, since a filter that has grown too small is
+ * rebuilt from the hash.
+ */
+void wg_idxhash_bloom_add(void *db, db_hash_area_header *ha,
+  db_bloom_header *bf, char *data, gint length)
+{
+  guint64 h;
+  guint32 *block;
+  int i;
+
+  if(ha->entries > bf->keys && !bloom_build(db, ha, bf, bf->bits_per_key))
+    return; /* the new filter has all the keys */
+
+  h = hash_mix(data, length, BLOOM_SEED);
+  block = bloom_block(db, bf, h);
+  for(i=0; i<BLOOM_BLOCK_WORDS; i++)
+    block[i] |= BLOOM_BIT(h, i);
+}
+
+/*
+ * Check a key against the Bloom filter. Reads a single block.
+ *
+ * Returns 0 if the key is not in the hash
+ * Returns 1 if the key may be in the hash.
+ */
+gint wg_idxhash_bloom_check(void *db, db_bloom_header *bf,
+  char *data, gint length)
+{
+  guint64 h = hash_mix(data, length, BLOOM_SEED);
+  guint32 *block = bloom_block(db, bf, h);
+  int i;
+
+  for(i=0; i<BLOOM_BLOCK_WORDS; i++) {
+    if(!(block[i] & BLOOM_BIT(h, i)))
+      return 0;
+  }
+  return 1;
+}
+
+/*
+ * Allocate a new filter and fill it with the keys of the hash. The
+ * old filter is released only when the new one is complete.
+ */
+static gint bloom_build(void *db, db_hash_area_header *ha,
+  db_bloom_header *bf, gint bits_per_key)
+{
+  db_bloom_header newbf;
+  gint keys, object;
+
+  keys = 2*ha->entries;
+  if(keys < ha->arraylength)
+    keys = ha->arraylength;
+  if(keys < BLOOM_MIN_KEYS)
+    keys = BLOOM_MIN_KEYS;
+
+  newbf = *bf;
+  newbf.keys = keys;
+  newbf.bits_per_key = bits_per_key;
+  newbf.blocks = (keys * bits_per_key + BLOOM_BLOCK_BITS - 1) /\
+    BLOOM_BLOCK_BITS;
+  object = wg_alloc_gints(db, &(dbmemsegh(db)->indexhash_area_header),
+    newbf.blocks * (BLOOM_BLOCK_BITS / 8 / sizeof(gint)) + 1);
+  if(!object)
+    return show_hash_error(db, "Failed to allocate a Bloom filter");
+  newbf.offset = object + sizeof(gint);
+  memset(offsettoptr(db, newbf.offset), 0, newbf.blocks * BLOOM_BLOCK_BITS / 8);
+
+  bloom_fill(db, &newbf, ha->arraystart, 0, ha->arraylength);
+  if(ha->oldarraystart)
+    bloom_fill(db, &newbf, ha->oldarraystart, ha->migratepos,
+      ha->oldarraylength);
+
+  if(bf->offset) {
+    wg_free_object(db, &(dbmemsegh(db)->indexhash_area_header),
+      bf->offset - sizeof(gint));
+  }
+  *bf = newbf;
+  return 0;
+}
+
+/*
+ * Add the keys in the slots from .. arraylength of a hash array
+ * to the filter.
+ */
+static void bloom_fill(void *db, db_bloom_header *bf, gint arraystart,
+  gint from, gint arraylength)
+{
+  gint i;
+
+  for(i=from; i<arraylength; i++) {
+    gint bucket = dbfetch(db, arraystart + i*sizeof(gint));
+    while(bucket) {
+      gint length = dbfetch(db, bucket + HASHIDX_META_POS*sizeof(gint));
+      char *bucket_data = offsettoptr(db, bucket + \
+        HASHIDX_HEADER_SIZE*sizeof(gint));
+      guint64 h = hash_mix(bucket_data, length, BLOOM_SEED);
+      guint32 *block = bloom_block(db, bf, h);
+      int j;
+
+      for(j=0; j<BLOOM_BLOCK_WORDS; j++)
+        block[j] |= BLOOM_BIT(h, j);
+      bucket = dbfetch(db, bucket + HASHIDX_HASHCHAIN_POS*sizeof(gint));
+    }
+  }
+}
+
+/*
+ * Find the block of a key hash. The high half of the hash selects
+ * the block, the low half the bits.
+ */
+static guint32 *bloom_block(void *db, db_bloom_header *bf, guint64 h) {
+  gint block = (gint) (((h >> 32) * (guint64) bf->blocks) >> 32);
+  return ((guint32 *) offsettoptr(db, bf->offset)) + \
+    block * BLOOM_BLOCK_WORDS;
+}
+
 /* ------- local-memory extendible gint hash ---------- */
 
 /*
@@ -649,6 +1053,27 @@ gint wg_ginthash_getkey(void *db, void *tbl, gint key, gint *val) {
   return -1;
 }
 
+/** Replace the value of a key in the hash table.
+ *  If the key is not present, it is added.
+ *  Returns 0 on success
+ *  Returns -1 on failure
+ */
+gint wg_ginthash_setkey(void *db, void *tbl, gint key, gint val) {
+  size_t dirsize = 1<<((ext_ginthash *)tbl)->level;
+  size_t hash = GINTHASH_SCRAMBLE(key) & (dirsize - 1);
+  ginthash_bucket *bucket = ((ext_ginthash *)tbl)->directory[hash];
+  if(bucket) {
+    int i;
+    for(i=0; i<bucket->fill; i++) {
+      if(bucket->key[i] == key) {
+        bucket->value[i] = val;
+        return 0;
+      }
+    }
+  }
+  return wg_ginthash_addkey(db, tbl, key, val);
+}
+
 /** Release all memory allocated for the hash table.
  *
  */
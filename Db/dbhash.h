@@ -37,6 +37,8 @@
 #include "../config.h"
 #endif
 #include "dballoc.h"
+/* For wg_uint data type */
+#include "dbdata.h"
 
 /* ==== Public macros ==== */
 
@@ -48,22 +50,33 @@
 /* ==== Protos ==== */
 
 int wg_hash_typedstr(void* db, char* data, char* extrastr, gint type, gint length);
+wg_uint wg_hash_bytes(char *data, gint length);
 gint wg_find_strhash_bucket(void* db, char* data, char* extrastr, gint type, gint size, gint hashchain);
 int wg_right_strhash_bucket
             (void* db, gint longstr, char* cstr, char* cextrastr, gint ctype, gint cstrsize);
 gint wg_remove_from_strhash(void* db, gint longstr);
 
 gint wg_decode_for_hashing(void *db, gint enc, char **decbytes);
+gint wg_decode_for_hashing_copy(void *db, gint enc, char *buf, gint buflen);
 gint wg_idxhash_store(void* db, db_hash_area_header *ha,
   char* data, gint length, gint offset);
 gint wg_idxhash_remove(void* db, db_hash_area_header *ha,
   char* data, gint length, gint offset);
+gint wg_idxhash_free(void* db, db_hash_area_header *ha);
 gint wg_idxhash_find(void* db, db_hash_area_header *ha,
   char* data, gint length);
+gint wg_idxhash_bloom_create(void *db, db_hash_area_header *ha,
+  db_bloom_header *bf, gint bits_per_key);
+void wg_idxhash_bloom_free(void *db, db_bloom_header *bf);
+void wg_idxhash_bloom_add(void *db, db_hash_area_header *ha,
+  db_bloom_header *bf, char *data, gint length);
+gint wg_idxhash_bloom_check(void *db, db_bloom_header *bf,
+  char *data, gint length);
 
 void *wg_ginthash_init(void *db);
 gint wg_ginthash_addkey(void *db, void *tbl, gint key, gint val);
 gint wg_ginthash_getkey(void *db, void *tbl, gint key, gint *val);
+gint wg_ginthash_setkey(void *db, void *tbl, gint key, gint val);
 void wg_ginthash_free(void *db, void *tbl);
 
 void *wg_dhash_init(void *db, size_t entries);
@@ -41,10 +41,31 @@ extern "C" {
 #include "../config.h"
 #endif
 
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
 #include "dbdata.h"
 #include "dbindex.h"
 #include "dbcompare.h"
 #include "dbhash.h"
+#include "dbbtree.h"
+#include "dbbitmap.h"
+#include "dbfulltext.h"
+#include "dbrtree.h"
+#include "dbstats.h"
+#include "dbquery.h"
+#include "dbschema.h"
+
+/* SIMD search inside T-tree nodes, the instruction set is picked
+ * at run time */
+#if defined(TTREE_NODE_KEYS) && (defined(__x86_64__) || defined(__i386__)) &&\
+  (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define TNODE_SIMD
+#include <immintrin.h>
+#endif
 
 
 /* ====== Private defs =========== */
@@ -54,6 +75,8 @@ extern "C" {
 #define RL_CASE 2
 #define RR_CASE 3
 
+#define JSONPATH_MAX_DEPTH 99 /** objects and arrays followed on a path */
+
 #ifndef max
 #define max(a,b) (a>b ? a : b)
 #endif
@@ -62,6 +85,71 @@ extern "C" {
 #define HASHIDX_OP_REMOVE 2
 #define HASHIDX_OP_FIND 3
 
+/* Keys that fit in this buffer are built without heap allocation */
+#define HASHIDX_KEYBUF_SIZE 256
+
+/* Check if a hash index has a Bloom filter */
+#define HASHIDX_HAS_BLOOM(x) (((x)->type == WG_INDEX_TYPE_HASH ||\
+  (x)->type == WG_INDEX_TYPE_HASH_JSON) && (x)->ctl.h.bloom.offset)
+
+/* Sorted runs shorter than this are built with insertion sort */
+#define TTREE_BULK_RUN 16
+
+/* Upper limit of sorting threads in wg_create_indexes() */
+#define INDEX_BUILD_MAX_THREADS 64
+
+/* Index types that are built from sorted keys */
+#define ORDERED_INDEX(t) ((t) == WG_INDEX_TYPE_TTREE ||\
+  (t) == WG_INDEX_TYPE_BTREE)
+
+/** Build state of one index in wg_create_indexes() */
+typedef struct {
+  gint index_id;
+  wg_index_header *hdr;
+  wg_index_entry *entries;   /** tree keys collected during the scan */
+  gint size;              /** allocated size of entries */
+  gint count;             /** rows collected or inserted */
+  int fallback;           /** build row by row (trees and bitmaps) */
+} index_build_job;
+
+/** Share of the sorting work for one thread */
+typedef struct {
+  void *db;
+  index_build_job *jobs;
+  gint count;
+  gint first;
+  gint step;
+} sort_worker;
+
+/** Row of an index in the deferred index updates */
+typedef struct {
+  gint index_id;
+  gint rec;               /** row offset */
+} index_delta_entry;
+
+/** Deferred index updates of a database handle
+ *  The rows have been removed from the indexes by field updates
+ *  (or are new in the indexes) and are added with their current
+ *  values when the updates are applied. The slots are an open
+ *  addressing table for finding the entry of an index and a row.
+ */
+typedef struct {
+  index_delta_entry *entries;
+  gint count;             /** entries in use */
+  gint size;              /** allocated entries */
+  gint *slots;            /** entry number + 1, 0 if the slot is free */
+} index_delta;
+
+#ifdef USE_DATABASE_HANDLE
+#define INDEX_DELTA(d) ((index_delta *) (((db_handle *) (d))->indexdelta))
+#else
+#define INDEX_DELTA(d) ((index_delta *) NULL)
+#endif
+
+/* Initial size of the deferred index updates, grows as needed. There
+ * are twice as many slots as entries. */
+#define INDEX_DELTA_SIZE 1024
+
 /* ======= Private protos ================ */
 
 #ifndef TTREE_SINGLE_COMPARE
@@ -76,9 +164,29 @@ static gint ttree_remove_row(void *db, gint index_id, void * rec);
 
 static gint create_ttree_index(void *db, gint index_id);
 static gint drop_ttree_index(void *db, gint column);
+static int ttree_accepts_row(void *db, wg_index_header *hdr, void *rec);
+static gint ttree_bulk_load(void *db, wg_index_header *hdr,
+  gint *rowsprocessed);
+static gint ttree_build_sorted(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, gint count);
+static int compare_index_entries(void *db, wg_index_header *hdr,
+  wg_index_entry *a, wg_index_entry *b);
+static void sort_index_entries(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, wg_index_entry *tmp, gint count);
+static wg_index_entry *collect_index_entries(void *db, wg_index_header *hdr,
+  gint *count);
+static gint build_ttree(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, gint count, gint first, gint last, gint parent,
+  gint *prev, unsigned char *height);
+static void free_ttree_nodes(void *db, gint node);
 
 static gint insert_into_list(void *db, gint *head, gint value);
 static void delete_from_list(void *db, gint *head);
+static gint column_map_position(void *db, gint column);
+static gint *column_list(void *db, gint column, int tmpl, int create);
+static void release_map_column(void *db, gint column);
+static gint add_rec_column(void *db, void *rec, gint reclen, gint column);
+static gint del_rec_column(void *db, void *rec, gint reclen, gint column);
 #ifdef USE_INDEX_TEMPLATE
 static gint add_index_template(void *db, gint *matchrec, gint reclen);
 static gint find_index_template(void *db, gint *matchrec, gint reclen);
@@ -88,15 +196,80 @@ static gint remove_index_template(void *db, gint template_offset);
 static gint hash_add_row(void *db, gint index_id, void *rec);
 static gint hash_remove_row(void *db, gint index_id, void *rec);
 static gint hash_recurse(void *db, wg_index_header *hdr, char *prefix,
-  gint prefixlen, gint *values, gint count, void *rec, gint op, gint expand);
+  gint prefixlen, gint prefixsz, gint *values, gint count, void *rec,
+  gint op, gint expand);
 static gint hash_extend_prefix(void *db, wg_index_header *hdr, char *prefix,
-  gint prefixlen, gint nextval, gint *values, gint count, void *rec, gint op,
-  gint expand);
+  gint prefixlen, gint prefixsz, gint nextval, gint *values, gint count,
+  void *rec, gint op, gint expand);
 
-static gint create_hash_index(void *db, gint index_id);
+static int hash_accepts_row(void *db, wg_index_header *hdr, void *rec);
+static gint hash_expr_row(void *db, wg_index_header *hdr, void *rec,
+  gint op);
+static gint create_hash_index(void *db, gint index_id, gint size_hint);
 static gint drop_hash_index(void *db, gint index_id);
 
+static gint btree_add_row(void *db, gint index_id, void *rec);
+static gint btree_remove_row(void *db, gint index_id, void *rec);
+static gint create_btree_index(void *db, gint index_id);
+static gint drop_btree_index(void *db, gint index_id);
+
+static gint bitmap_add_row(void *db, gint index_id, void *rec);
+static gint bitmap_remove_row(void *db, gint index_id, void *rec);
+static gint create_bitmap_index(void *db, gint index_id);
+static gint drop_bitmap_index(void *db, gint index_id);
+
+static gint fulltext_add_row(void *db, gint index_id, void *rec);
+static gint fulltext_remove_row(void *db, gint index_id, void *rec);
+static gint create_fulltext_index(void *db, gint index_id, gint flags,
+  gint min_len);
+static gint drop_fulltext_index(void *db, gint index_id);
+
+static gint rtree_add_row(void *db, gint index_id, void *rec);
+static gint rtree_remove_row(void *db, gint index_id, void *rec);
+static gint create_rtree_index(void *db, gint index_id);
+static gint drop_rtree_index(void *db, gint index_id);
+
+static gint jsonpath_recurse(void *db, wg_index_header *hdr, char *path,
+  gint enc, void *doc, gint op, int depth);
+static gint jsonpath_document(void *db, wg_index_header *hdr, void *doc,
+  gint op);
+static gint drop_jsonpath_index(void *db, gint index_id);
+
+static gint analyze_index(void *db, wg_index_header *hdr);
+
+static gint new_index_header(void *db, gint *columns, gint col_count,
+  gint type, gint expr, gint *matchrec, gint reclen);
+static gint find_index_id(void *db, gint *columns, gint col_count,
+  gint type, gint expr, gint *matchrec, gint reclen);
+static gint register_index(void *db, gint index_id, gint *matchrec,
+  gint reclen);
+static void unlink_index_columns(void *db, wg_index_header *hdr,
+  gint index_id);
+static void discard_index_header(void *db, gint index_id);
+static void sort_build_jobs(void *db, index_build_job *jobs, gint count,
+  gint nthreads);
+static void sort_jobs(sort_worker *w);
+#if defined(_WIN32)
+static DWORD WINAPI sort_worker_main(LPVOID arg);
+#elif defined(HAVE_PTHREAD)
+static void *sort_worker_main(void *arg);
+#endif
+
 static gint sort_columns(gint *sorted_cols, gint *columns, gint col_count);
+static gint last_index_column(wg_index_header *hdr);
+
+static gint add_index_row(void *db, wg_index_header *hdr, gint index_id,
+  void *rec);
+static gint add_field_row(void *db, wg_index_header *hdr, gint index_id,
+  void *rec);
+static gint remove_field_row(void *db, wg_index_header *hdr, gint index_id,
+  void *rec);
+static gint delta_slot(index_delta *delta, gint index_id, gint rec);
+static gint delta_add_row(void *db, index_delta *delta, gint index_id,
+  gint rec);
+static int compare_delta_entries(const void *a, const void *b);
+static gint apply_index_delta(void *db, index_delta *delta);
+static gint check_index_rows(void *db, wg_index_header *hdr);
 
 static gint show_index_error(void* db, char* errmsg);
 static gint show_index_error_nr(void* db, char* errmsg, gint nr);
@@ -137,6 +310,11 @@ static gint show_index_error_nr(void* db, char* errmsg, gint nr);
  *  In the above example, A is a (hash) index on columns 2 and 5, while B
  *  is an index on column 5.
  *
+ *  index_table covers the columns up to MAX_INDEXED_FIELDNR. The lists
+ *  of higher columns are kept in the column map, an array of
+ *  wg_index_column elements sorted by column number, which only has
+ *  the columns that are indexed (see column_list()).
+ *
  * Note: offset to index header struct is also used as an index id.
  */
 
@@ -302,16 +480,15 @@ static int db_rotate_ttree(void *db, gint index_id, struct wg_tnode *root, int o
       int i;
 
       /* Create space for elements from B */
-      ee->array_of_values[bb->number_of_elements - 1] = ee->array_of_values[0];
+      TNODE_COPY(ee, bb->number_of_elements - 1, ee, 0);
 
       /* All the values moved are smaller than in E */
       for(i=1; i<bb->number_of_elements; i++)
-        ee->array_of_values[i-1] = bb->array_of_values[i];
+        TNODE_COPY(ee, i-1, bb, i);
       ee->number_of_elements = bb->number_of_elements;
 
       /* Examine the new leftmost element to find current_min */
-      ee->current_min = wg_get_field(db, (void *)offsettoptr(db,
-        ee->array_of_values[0]), column);
+      ee->current_min = TNODE_KEY(db, ee, 0, column);
 
       bb -> number_of_elements = 1;
       bb -> current_max = bb -> current_min;
@@ -365,16 +542,14 @@ static int db_rotate_ttree(void *db, gint index_id, struct wg_tnode *root, int o
 
       /* All the values moved are larger than in E */
       for(i=1; i<bb->number_of_elements; i++)
-        ee->array_of_values[i] = bb->array_of_values[i-1];
+        TNODE_COPY(ee, i, bb, i-1);
       ee->number_of_elements = bb->number_of_elements;
 
       /* Examine the new rightmost element to find current_max */
-      ee->current_max = wg_get_field(db, (void *)offsettoptr(db,
-        ee->array_of_values[ee->number_of_elements - 1]), column);
+      ee->current_max = TNODE_KEY(db, ee, ee->number_of_elements - 1, column);
 
       /* Remaining B node array element should sit in slot 0 */
-      bb->array_of_values[0] = \
-        bb->array_of_values[bb->number_of_elements - 1];
+      TNODE_COPY(bb, 0, bb, bb->number_of_elements - 1);
       bb -> number_of_elements = 1;
       bb -> current_min = bb -> current_max;
     }
@@ -468,20 +643,18 @@ static gint ttree_add_row(void *db, gint index_id, void *rec) {
          * since here the compare is more expensive than the slot
          * copying.
          */
-        cr = WG_COMPARE(db, wg_get_field(db,
-          (void *)offsettoptr(db,node->array_of_values[i]), column),
-          newvalue);
+        cr = WG_COMPARE(db, TNODE_KEY(db, node, i, column), newvalue);
 
         if(cr != WG_LESSTHAN) { /* value >= newvalue */
           /* Push remaining values to the right */
           for(j=node->number_of_elements; j>i; j--)
-            node->array_of_values[j] = node->array_of_values[j-1];
+            TNODE_COPY(node, j, node, j-1);
           break;
         }
       }
       /* i is either number_of_elements or a vacated slot
        * in the array now. */
-      node->array_of_values[i] = ptrtooffset(db,rec);
+      TNODE_SET(node, i, ptrtooffset(db,rec), newvalue);
       node->number_of_elements++;
 
       /* Update min. Due to the >= comparison max is preserved
@@ -508,26 +681,23 @@ static gint ttree_add_row(void *db, gint index_id, void *rec) {
        * do this scan (and sort) in reverse order, compared to the case
        * where array had some space left. */
       for(i=WG_TNODE_ARRAY_SIZE-1; i>0; i--) {
-        cr = WG_COMPARE(db, wg_get_field(db,
-          (void *)offsettoptr(db,node->array_of_values[i]), column),
-          newvalue);
+        cr = WG_COMPARE(db, TNODE_KEY(db, node, i, column), newvalue);
         if(cr != WG_GREATER) { /* value <= newvalue */
           /* Push remaining values to the left */
           for(j=0; j<i; j++)
-            node->array_of_values[j] = node->array_of_values[j+1];
+            TNODE_COPY(node, j, node, j+1);
           break;
         }
       }
       /* i is either 0 or a freshly vacated slot */
-      node->array_of_values[i] = ptrtooffset(db,rec);
+      TNODE_SET(node, i, ptrtooffset(db,rec), newvalue);
 
       /* Update minimum. Thanks to the sorted array, we know for a fact
        * that the minimum sits in slot 0. */
       if(i==0) {
         node->current_min = newvalue;
       } else {
-        node->current_min = wg_get_field(db,
-          (void *)offsettoptr(db,node->array_of_values[0]), column);
+        node->current_min = TNODE_KEY(db, node, 0, column);
         /* The scan for the free slot starts from the right and
          * tries to exit as fast as possible. So it's possible that
          * the rightmost slot was changed.
@@ -550,7 +720,7 @@ static gint ttree_add_row(void *db, gint index_id, void *rec) {
       //otherwise make the new node as right child and put the value there
       if(node->number_of_elements < WG_TNODE_ARRAY_SIZE){
         //add array entry and update control data
-        node->array_of_values[node->number_of_elements] = minvaluerowoffset;//save offset, use first free slot
+        TNODE_SET(node, node->number_of_elements, minvaluerowoffset, minvalue);//save offset, use first free slot
         node->number_of_elements++;
         node->current_max = minvalue;
 
@@ -568,7 +738,7 @@ static gint ttree_add_row(void *db, gint index_id, void *rec) {
         leaf->number_of_elements = 1;
         leaf->left_child_offset = 0;
         leaf->right_child_offset = 0;
-        leaf->array_of_values[0] = minvaluerowoffset;
+        TNODE_SET(leaf, 0, minvaluerowoffset, minvalue);
         /* If the original, full node did not have a left child, then
          * there also wasn't a separate GLB node, so we are adding one now
          * as the left child. Otherwise, the new node is added as the right
@@ -633,12 +803,13 @@ static gint ttree_add_row(void *db, gint index_id, void *rec) {
       if(boundtype == DEAD_END_LEFT_NOT_BOUNDING) {
         /* our new value is the new min, push everything right */
         for(i=node->number_of_elements; i>0; i--)
-          node->array_of_values[i] = node->array_of_values[i-1];
-        node->array_of_values[0] = ptrtooffset(db,rec);
+          TNODE_COPY(node, i, node, i-1);
+        TNODE_SET(node, 0, ptrtooffset(db,rec), newvalue);
         node->current_min = newvalue;
       } else { /* DEAD_END_RIGHT_NOT_BOUNDING */
         /* even simpler case, new value is added to the right */
-        node->array_of_values[node->number_of_elements] = ptrtooffset(db,rec);
+        TNODE_SET(node, node->number_of_elements, ptrtooffset(db,rec),
+          newvalue);
         node->current_max = newvalue;
       }
 
@@ -664,7 +835,7 @@ static gint ttree_add_row(void *db, gint index_id, void *rec) {
       leaf->number_of_elements = 1;
       leaf->left_child_offset = 0;
       leaf->right_child_offset = 0;
-      leaf->array_of_values[0] = ptrtooffset(db,rec);
+      TNODE_SET(leaf, 0, ptrtooffset(db,rec), newvalue);
       newoffset = newnode;
       //set new node as left or right leaf
       if(boundtype == DEAD_END_LEFT_NOT_BOUNDING){
@@ -821,19 +992,18 @@ found_row:
     /* slide the elements to the right of the found value
      * one step to the left */
     for(i=found; i<node->number_of_elements; i++)
-      node->array_of_values[i] = node->array_of_values[i+1];
+      TNODE_COPY(node, i, node, i+1);
   }
 
   /* Update min/max */
   if(found==node->number_of_elements && node->number_of_elements != 0) {
     /* Rightmost element was removed, so new max should be updated to
      * the new rightmost value */
-    node->current_max = wg_get_field(db, (void *)offsettoptr(db,
-      node->array_of_values[node->number_of_elements - 1]), column);
+    node->current_max = TNODE_KEY(db, node,
+      node->number_of_elements - 1, column);
   } else if(found==0 && node->number_of_elements != 0) {
     /* current_min removed, update to new leftmost value */
-    node->current_min = wg_get_field(db, (void *)offsettoptr(db,
-      node->array_of_values[0]), column);
+    node->current_min = TNODE_KEY(db, node, 0, column);
   }
 
   //check underflow and take some actions if needed
@@ -849,12 +1019,11 @@ found_row:
 
       /* Make space for a new min value */
       for(i=node->number_of_elements; i>0; i--)
-        node->array_of_values[i] = node->array_of_values[i-1];
+        TNODE_COPY(node, i, node, i-1);
 
       /* take the glb value (always the rightmost in the array) and
        * insert it in our node */
-      node -> array_of_values[0] = \
-        glbnode->array_of_values[glbnode->number_of_elements-1];
+      TNODE_COPY(node, 0, glbnode, glbnode->number_of_elements-1);
       node -> number_of_elements++;
       node -> current_min = glbnode -> current_max;
       if(node->number_of_elements == 1) /* we just got our first element */
@@ -863,8 +1032,8 @@ found_row:
 
       //reset new max for glbnode
       if(glbnode->number_of_elements != 0) {
-        glbnode->current_max = wg_get_field(db, (void *)offsettoptr(db,
-          glbnode->array_of_values[glbnode->number_of_elements - 1]), column);
+        glbnode->current_max = TNODE_KEY(db, glbnode,
+          glbnode->number_of_elements - 1, column);
       }
 
       node = glbnode;
@@ -946,11 +1115,10 @@ found_row:
       if(left){
         /* Left child elements are all smaller than in current node */
         for(j=i-1; j>=0; j--){
-          node->array_of_values[j + child->number_of_elements] = \
-            node->array_of_values[j];
+          TNODE_COPY(node, j + child->number_of_elements, node, j);
         }
         for(j=0;j<child->number_of_elements;j++){
-          node->array_of_values[j]=child->array_of_values[j];
+          TNODE_COPY(node, j, child, j);
         }
         node->left_subtree_height=0;
         node->left_child_offset=0;
@@ -959,7 +1127,7 @@ found_row:
       }else{
         /* Right child elements are all larger than in current node */
         for(j=0;j<child->number_of_elements;j++){
-          node->array_of_values[i+j]=child->array_of_values[j];
+          TNODE_COPY(node, i+j, child, j);
         }
         node->right_subtree_height=0;
         node->right_child_offset=0;
@@ -1058,6 +1226,10 @@ gint wg_search_ttree_index(void *db, gint index_id, gint key){
   }
 #endif
 
+  /* The search sees the deferred index updates of this handle */
+  if(check_index_rows(db, hdr))
+    return -1;
+
   /* Find the leftmost bounding node */
   bnodeoffset = wg_search_ttree_leftmost(db,
           rootoffset, key, &bnodetype, NULL);
@@ -1070,9 +1242,7 @@ gint wg_search_ttree_index(void *db, gint index_id, gint key){
   for(;;) {
     for(i=0;i<node->number_of_elements;i++){
       rowoffset = node->array_of_values[i];
-      if(WG_COMPARE(db,
-        wg_get_field(db, (void *)offsettoptr(db,rowoffset), column),
-        key) == WG_EQUAL) {
+      if(WG_COMPARE(db, TNODE_KEY(db, node, i, column), key) == WG_EQUAL) {
         return rowoffset;
       }
     }
@@ -1317,6 +1487,110 @@ gint wg_search_ttree_leftmost(void *db, gint rootoffset,
 #endif
 }
 
+#ifdef TTREE_NODE_KEYS
+/** Check if the keys of a node can be compared to a value as gints
+ *  Small integers, dates, times and fixpoint values are immediate
+ *  and their encoded values of the same type are ordered like the
+ *  values themselves. Since the keys are sorted, if the smallest
+ *  and the largest key have the same type as the value, so do all
+ *  the others (a full integer is never between two small ones).
+ *  On 32-bit platforms times may overflow into the sign bit.
+ */
+static int tnode_raw_keys(struct wg_tnode *node, gint key) {
+  gint minkey = node->current_min, maxkey = node->current_max;
+
+  if(issmallint(key))
+    return issmallint(minkey) && issmallint(maxkey);
+  else if(isdate(key))
+    return isdate(minkey) && isdate(maxkey);
+  else if(isfixpoint(key))
+    return isfixpoint(minkey) && isfixpoint(maxkey);
+#ifdef HAVE_64BIT_GINT
+  else if(istime(key))
+    return istime(minkey) && istime(maxkey);
+#endif
+  return 0;
+}
+
+/** Count the keys that are smaller than the value, as gints
+ */
+static gint count_less_scalar(const gint *keys, gint n, gint key) {
+  gint i, cnt = 0;
+  for(i=0; i<n; i++)
+    cnt += (keys[i] < key);
+  return cnt;
+}
+
+#ifdef TNODE_SIMD
+#ifdef HAVE_64BIT_GINT
+#define TNODE_SSE_TARGET "sse4.2"
+#else
+#define TNODE_SSE_TARGET "sse2"
+#endif
+
+__attribute__((target(TNODE_SSE_TARGET)))
+static gint count_less_sse(const gint *keys, gint n, gint key) {
+  gint i = 0, cnt = 0;
+#ifdef HAVE_64BIT_GINT
+  __m128i k = _mm_set1_epi64x(key);
+  for(; i+2<=n; i+=2) {
+    __m128i v = _mm_loadu_si128((const __m128i *) &keys[i]);
+    cnt += __builtin_popcount(_mm_movemask_pd(
+      _mm_castsi128_pd(_mm_cmpgt_epi64(k, v))));
+  }
+#else
+  __m128i k = _mm_set1_epi32(key);
+  for(; i+4<=n; i+=4) {
+    __m128i v = _mm_loadu_si128((const __m128i *) &keys[i]);
+    cnt += __builtin_popcount(_mm_movemask_ps(
+      _mm_castsi128_ps(_mm_cmpgt_epi32(k, v))));
+  }
+#endif
+  return cnt + count_less_scalar(keys + i, n - i, key);
+}
+
+__attribute__((target("avx2")))
+static gint count_less_avx2(const gint *keys, gint n, gint key) {
+  gint i = 0, cnt = 0;
+#ifdef HAVE_64BIT_GINT
+  __m256i k = _mm256_set1_epi64x(key);
+  for(; i+4<=n; i+=4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) &keys[i]);
+    cnt += __builtin_popcount(_mm256_movemask_pd(
+      _mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v))));
+  }
+#else
+  __m256i k = _mm256_set1_epi32(key);
+  for(; i+8<=n; i+=8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) &keys[i]);
+    cnt += __builtin_popcount(_mm256_movemask_ps(
+      _mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v))));
+  }
+#endif
+  return cnt + count_less_scalar(keys + i, n - i, key);
+}
+#endif /* TNODE_SIMD */
+
+static gint count_less_dispatch(const gint *keys, gint n, gint key);
+
+/* The implementation is selected on the first call */
+static gint (*tnode_count_less)(const gint *keys, gint n, gint key) =\
+  count_less_dispatch;
+
+static gint count_less_dispatch(const gint *keys, gint n, gint key) {
+#ifdef TNODE_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    tnode_count_less = count_less_avx2;
+  else if(__builtin_cpu_supports(TNODE_SSE_TARGET))
+    tnode_count_less = count_less_sse;
+  else
+#endif
+    tnode_count_less = count_less_scalar;
+  return tnode_count_less(keys, n, key);
+}
+#endif /* TTREE_NODE_KEYS */
+
 /** Find first occurrence of a value in a T-tree node
  *  returns the number of the slot. If the value itself
  *  is missing, the location of the first value that
@@ -1328,10 +1602,15 @@ gint wg_search_tnode_first(void *db, gint nodeoffset, gint key,
   gint i, encoded;
   struct wg_tnode *node = (struct wg_tnode *) offsettoptr(db, nodeoffset);
 
+#ifdef TTREE_NODE_KEYS
+  if(tnode_raw_keys(node, key)) {
+    i = tnode_count_less(node->keys, node->number_of_elements, key);
+    return (i < node->number_of_elements ? i : -1);
+  }
+#endif
   for(i=0; i<node->number_of_elements; i++) {
     /* Naive scan is ok for small values of WG_TNODE_ARRAY_SIZE. */
-    encoded = wg_get_field(db,
-      (void *)offsettoptr(db,node->array_of_values[i]), column);
+    encoded = TNODE_KEY(db, node, i, column);
     if(WG_COMPARE(db, encoded, key) != WG_LESSTHAN)
       /* encoded >= key */
       return i;
@@ -1351,9 +1630,16 @@ gint wg_search_tnode_last(void *db, gint nodeoffset, gint key,
   gint i, encoded;
   struct wg_tnode *node = (struct wg_tnode *) offsettoptr(db, nodeoffset);
 
+#ifdef TTREE_NODE_KEYS
+  if(tnode_raw_keys(node, key)) {
+    /* keys <= key are the keys < key + 1, the tag bits of the
+     * encoded values keep key + 1 from overflowing */
+    return tnode_count_less(node->keys, node->number_of_elements,
+      key + 1) - 1;
+  }
+#endif
   for(i=node->number_of_elements -1; i>=0; i--) {
-    encoded = wg_get_field(db,
-      (void *)offsettoptr(db,node->array_of_values[i]), column);
+    encoded = TNODE_KEY(db, node, i, column);
     if(WG_COMPARE(db, encoded, key) != WG_GREATER)
       /* encoded <= key */
       return i;
@@ -1369,16 +1655,26 @@ gint wg_search_tnode_last(void *db, gint nodeoffset, gint key,
 */
 static gint create_ttree_index(void *db, gint index_id){
   gint node;
-  unsigned int rowsprocessed;
+  gint rowsprocessed;
   struct wg_tnode *nodest;
   void *rec;
   db_memsegment_header* dbh = dbmemsegh(db);
   wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
   gint column = hdr->rec_field_index[0];
 
+  /* Build the tree from sorted data, if there is enough local memory.
+   * Otherwise fall back to inserting the rows one by one.
+   */
+  if(ttree_bulk_load(db, hdr, &rowsprocessed))
+    goto done;
+
   /* allocate (+ init) root node for new index tree and save
    * the offset into index_array */
   node = wg_alloc_fixlen_object(db, &dbh->tnode_area_header);
+  if(!node) {
+    show_index_error(db, "Failed to allocate the T-tree root node");
+    return -1;
+  }
   nodest =(struct wg_tnode *)offsettoptr(db,node);
   nodest->parent_offset = 0;
   nodest->left_subtree_height = 0;
@@ -1404,25 +1700,289 @@ static gint create_ttree_index(void *db, gint index_id){
   rowsprocessed = 0;
 
   while(rec != NULL) {
-    if(column >= wg_get_record_len(db, rec)) {
-      rec=wg_get_next_record(db,rec);
-      continue;
-    }
-    if(MATCH_TEMPLATE(db, hdr, rec)) {
-      ttree_add_row(db, index_id, rec);
+    if(ttree_accepts_row(db, hdr, rec)) {
+      if(ttree_add_row(db, index_id, rec)) {
+        drop_ttree_index(db, index_id);
+        show_index_error(db, "Failed to allocate T-tree nodes");
+        return -1;
+      }
       rowsprocessed++;
     }
     rec=wg_get_next_record(db,rec);
   }
+done:
 #ifdef WG_NO_ERRPRINT
 #else
   fprintf(stderr,"new index created on rec field %d into slot %d and %d data rows inserted\n",
-    (int) column, (int) index_id, rowsprocessed);
+    (int) column, (int) index_id, (int) rowsprocessed);
 #endif
 
   return 0;
 }
 
+/** Check if a row belongs to a T-tree or B-tree index being built
+*  The row must have all the indexed columns.
+*/
+static int ttree_accepts_row(void *db, wg_index_header *hdr, void *rec) {
+  if(last_index_column(hdr) >= wg_get_record_len(db, rec))
+    return 0;
+  return MATCH_TEMPLATE(db, hdr, rec);
+}
+
+/** Build a T-tree index from sorted data
+*  The matching rows are collected in local memory, sorted by the
+*  key and placed in fully packed nodes of a perfectly balanced
+*  tree, bottom-up. This avoids the search and the rotations of
+*  inserting the rows one by one.
+*  returns:
+*  1 - on success
+*  0 - if there is no data or not enough memory
+*/
+static gint ttree_bulk_load(void *db, wg_index_header *hdr,
+  gint *rowsprocessed) {
+  wg_index_entry *entries;
+  gint count, err;
+
+  entries = collect_index_entries(db, hdr, &count);
+  if(!entries)
+    return 0;
+  err = ttree_build_sorted(db, hdr, entries, count);
+  free(entries);
+  if(err)
+    return 0; /* the nodes were freed, insert the rows one by one */
+  *rowsprocessed = count;
+  return 1;
+}
+
+/** Collect the keys of an ordered index, sorted
+*  returns a NEW allocated array of count entries, NULL if there
+*  is no data or not enough local memory.
+*/
+static wg_index_entry *collect_index_entries(void *db, wg_index_header *hdr,
+  gint *count) {
+  wg_index_entry *entries, *tmp;
+  gint size, column = hdr->rec_field_index[0];
+  void *rec;
+
+  /* Count the rows first, so that one allocation is enough */
+  *count = 0;
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec))
+    (*count)++;
+  if(!*count)
+    return NULL;
+
+  size = *count * sizeof(wg_index_entry);
+  entries = (wg_index_entry *) malloc(size);
+  if(!entries)
+    return NULL;
+  tmp = (wg_index_entry *) malloc(size);
+  if(!tmp) {
+    free(entries);
+    return NULL;
+  }
+
+  *count = 0;
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(ttree_accepts_row(db, hdr, rec)) {
+      entries[*count].key = wg_get_field(db, rec, column);
+      entries[*count].rec = ptrtooffset(db, rec);
+      (*count)++;
+    }
+  }
+  if(*count)
+    sort_index_entries(db, hdr, entries, tmp, *count);
+  free(tmp);
+  if(!*count) {
+    free(entries);
+    return NULL;
+  }
+  return entries;
+}
+
+/** Create the T-tree of an index from sorted entries
+*  On failure the nodes that were already allocated are freed
+*  and the index is left without a tree.
+*  returns 0 on success, -1 if the T-node area is full.
+*/
+static gint ttree_build_sorted(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, gint count) {
+  gint prev = 0;
+  unsigned char height;
+
+  TTREE_ROOT_NODE(hdr) = build_ttree(db, hdr, entries, count, 0,
+    (count - 1) / WG_TNODE_ARRAY_SIZE, 0, &prev, &height);
+  if(!TTREE_ROOT_NODE(hdr)) {
+#ifdef TTREE_CHAINED_NODES
+    TTREE_MIN_NODE(hdr) = 0;
+    TTREE_MAX_NODE(hdr) = 0;
+#endif
+    return -1;
+  }
+#ifdef TTREE_CHAINED_NODES
+  TTREE_MAX_NODE(hdr) = prev;
+#endif
+  return 0;
+}
+
+/** Compare index entries
+*  The prefixes decide unless they are equal and do not contain the
+*  whole keys. The other columns of a multi-column index are read
+*  from the rows.
+*/
+static int compare_index_entries(void *db, wg_index_header *hdr,
+  wg_index_entry *a, wg_index_entry *b) {
+  gint i;
+
+  if(a->prefix != b->prefix)
+    return (a->prefix < b->prefix ? WG_LESSTHAN : WG_GREATER);
+  if(!(a->prefix & WG_NORMKEY_EXACT)) {
+    gint cr = WG_COMPARE(db, a->key, b->key);
+    if(cr != WG_EQUAL)
+      return (int) cr;
+  }
+  for(i=1; i<hdr->fields; i++) {
+    gint cr = WG_COMPARE(db,
+      wg_get_field(db, offsettoptr(db, a->rec), hdr->rec_field_index[i]),
+      wg_get_field(db, offsettoptr(db, b->rec), hdr->rec_field_index[i]));
+    if(cr != WG_EQUAL)
+      return (int) cr;
+  }
+  return WG_EQUAL;
+}
+
+/** Sort the index entries by key
+*  Stable bottom-up merge sort. Short runs are sorted in place first.
+*  Entries with equal keys stay in the scan order, which is the order
+*  of the row offsets, as B-tree indexes require. The normalized key
+*  prefixes are filled in and decide most of the comparisons.
+*/
+static void sort_index_entries(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, wg_index_entry *tmp, gint count) {
+  gint i, j, width;
+  wg_index_entry *src = entries, *dst = tmp, *swap;
+
+  for(i=0; i<count; i++)
+    entries[i].prefix = wg_normkey_prefix(db, entries[i].key);
+
+  for(i=0; i<count; i+=TTREE_BULK_RUN) {
+    gint end = (i + TTREE_BULK_RUN < count ? i + TTREE_BULK_RUN : count);
+    for(j=i+1; j<end; j++) {
+      wg_index_entry e = entries[j];
+      gint k = j;
+      while(k > i &&\
+        compare_index_entries(db, hdr, &entries[k-1], &e) == WG_GREATER) {
+        entries[k] = entries[k-1];
+        k--;
+      }
+      entries[k] = e;
+    }
+  }
+
+  for(width=TTREE_BULK_RUN; width<count; width*=2) {
+    for(i=0; i<count; i+=2*width) {
+      gint left = i, mid, right, end, k = i;
+      mid = (i + width < count ? i + width : count);
+      end = (i + 2*width < count ? i + 2*width : count);
+      right = mid;
+      while(left < mid && right < end) {
+        if(compare_index_entries(db, hdr,
+          &src[right], &src[left]) == WG_LESSTHAN)
+          dst[k++] = src[right++];
+        else
+          dst[k++] = src[left++];
+      }
+      while(left < mid)
+        dst[k++] = src[left++];
+      while(right < end)
+        dst[k++] = src[right++];
+    }
+    swap = src; src = dst; dst = swap;
+  }
+
+  if(src != entries)
+    memcpy(entries, src, count * sizeof(wg_index_entry));
+}
+
+/** Build a balanced subtree from nodes first..last (inclusive)
+*  Node n holds the entries starting from n*WG_TNODE_ARRAY_SIZE.
+*  prev tracks the previous node in key order for chaining.
+*  returns the offset of the subtree root, 0 on allocation failure
+*  (the nodes of the subtree are freed then).
+*/
+static gint build_ttree(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, gint count, gint first, gint last, gint parent,
+  gint *prev, unsigned char *height) {
+  gint i, mid, node, start, end;
+  struct wg_tnode *nodest;
+  unsigned char lh = 0, rh = 0;
+
+  if(first > last) {
+    *height = 0;
+    return 0;
+  }
+
+  /* rounding down keeps the last, possibly partial, node in a leaf */
+  mid = first + (last - first) / 2;
+  node = wg_alloc_fixlen_object(db, &(dbmemsegh(db)->tnode_area_header));
+  if(!node)
+    return 0;
+  nodest = (struct wg_tnode *) offsettoptr(db, node);
+  nodest->parent_offset = parent;
+
+  nodest->left_child_offset = build_ttree(db, hdr, entries, count,
+    first, mid - 1, node, prev, &lh);
+  if(first < mid && !nodest->left_child_offset) {
+    wg_free_tnode(db, node);
+    return 0;
+  }
+
+  /* Fill the node and link it into the chain in key order */
+  start = mid * WG_TNODE_ARRAY_SIZE;
+  end = start + WG_TNODE_ARRAY_SIZE;
+  if(end > count)
+    end = count;
+  for(i=start; i<end; i++)
+    TNODE_SET(nodest, i - start, entries[i].rec, entries[i].key);
+  nodest->number_of_elements = (short) (end - start);
+  nodest->current_min = entries[start].key;
+  nodest->current_max = entries[end - 1].key;
+#ifdef TTREE_CHAINED_NODES
+  nodest->pred_offset = *prev;
+  nodest->succ_offset = 0;
+  if(*prev)
+    ((struct wg_tnode *) offsettoptr(db, *prev))->succ_offset = node;
+  else
+    TTREE_MIN_NODE(hdr) = node;
+#endif
+  *prev = node;
+
+  nodest->right_child_offset = build_ttree(db, hdr, entries, count,
+    mid + 1, last, node, prev, &rh);
+  if(mid < last && !nodest->right_child_offset) {
+    free_ttree_nodes(db, nodest->left_child_offset);
+    wg_free_tnode(db, node);
+    return 0;
+  }
+
+  nodest->left_subtree_height = lh;
+  nodest->right_subtree_height = rh;
+  *height = (unsigned char) (max(lh, rh) + 1);
+  return node;
+}
+
+/** Free the nodes of a subtree created by build_ttree()
+*/
+static void free_ttree_nodes(void *db, gint node) {
+  struct wg_tnode *nodest;
+
+  if(!node)
+    return;
+  nodest = (struct wg_tnode *) offsettoptr(db, node);
+  free_ttree_nodes(db, nodest->left_child_offset);
+  free_ttree_nodes(db, nodest->right_child_offset);
+  wg_free_tnode(db, node);
+}
+
 /** Drop T-tree index by id
 *  Frees the memory in the T-node area
 *  returns:
@@ -1474,12 +2034,16 @@ static gint hash_add_row(void *db, gint index_id, void *rec) {
   wg_index_header *hdr = (wg_index_header *)offsettoptr(db,index_id);
   gint i;
   gint values[MAX_INDEX_FIELDS];
+  char keybuf[HASHIDX_KEYBUF_SIZE];
 
+  if(hdr->expr)
+    return hash_expr_row(db, hdr, rec, HASHIDX_OP_STORE);
   for(i=0; i<hdr->fields; i++) {
     values[i] = wg_get_field(db, rec, hdr->rec_field_index[i]);
   }
-  return hash_recurse(db, hdr, NULL, 0, values, hdr->fields, rec,
-    HASHIDX_OP_STORE, (hdr->type == WG_INDEX_TYPE_HASH_JSON));
+  return hash_recurse(db, hdr, keybuf, 0, HASHIDX_KEYBUF_SIZE,
+    values, hdr->fields, rec, HASHIDX_OP_STORE,
+    (hdr->type == WG_INDEX_TYPE_HASH_JSON));
 }
 
 /** Remove all entries connected to a row from hash index
@@ -1491,18 +2055,25 @@ static gint hash_remove_row(void *db, gint index_id, void *rec) {
   wg_index_header *hdr = (wg_index_header *)offsettoptr(db,index_id);
   gint i;
   gint values[MAX_INDEX_FIELDS];
+  char keybuf[HASHIDX_KEYBUF_SIZE];
 
+  if(hdr->expr)
+    return hash_expr_row(db, hdr, rec, HASHIDX_OP_REMOVE);
   for(i=0; i<hdr->fields; i++) {
     values[i] = wg_get_field(db, rec, hdr->rec_field_index[i]);
   }
-  return hash_recurse(db, hdr, NULL, 0, values, hdr->fields, rec,
-    HASHIDX_OP_REMOVE, (hdr->type == WG_INDEX_TYPE_HASH_JSON));
+  return hash_recurse(db, hdr, keybuf, 0, HASHIDX_KEYBUF_SIZE,
+    values, hdr->fields, rec, HASHIDX_OP_REMOVE,
+    (hdr->type == WG_INDEX_TYPE_HASH_JSON));
 }
 
 /**
  * Construct a byte array for hashing recursively.
  * Hash it when it is complete.
  *
+ * The key is built in place in the prefix buffer of prefixsz bytes,
+ * the first prefixlen bytes of which are already filled.
+ *
  * If we have a JSON index *and* we're acting on an indexable row,
  * all arrays are expanded. This does not happen if we're called
  * by updating a value *in* an array.
@@ -1512,7 +2083,8 @@ static gint hash_remove_row(void *db, gint index_id, void *rec) {
  * -1 - on error
  */
 static gint hash_recurse(void *db, wg_index_header *hdr, char *prefix,
-  gint prefixlen, gint *values, gint count, void *rec, gint op, gint expand) {
+  gint prefixlen, gint prefixsz, gint *values, gint count, void *rec,
+  gint op, gint expand) {
 
   if(count) {
     gint nextvalue = values[0];
@@ -1526,7 +2098,7 @@ static gint hash_recurse(void *db, wg_index_header *hdr, char *prefix,
           gint i, reclen, retv = 0;
           reclen = wg_get_record_len(db, valrec);
           for(i=0; i<reclen; i++) {
-            retv = hash_extend_prefix(db, hdr, prefix, prefixlen,
+            retv = hash_extend_prefix(db, hdr, prefix, prefixlen, prefixsz,
               wg_get_field(db, valrec, i),
               &values[1], count - 1, rec, op, expand);
             if(retv)
@@ -1538,20 +2110,38 @@ static gint hash_recurse(void *db, wg_index_header *hdr, char *prefix,
       }
     }
     /* Regular index. JSON/array index also falls back to this. */
-    return hash_extend_prefix(db, hdr, prefix, prefixlen,
+    return hash_extend_prefix(db, hdr, prefix, prefixlen, prefixsz,
       nextvalue, &values[1], count - 1, rec, op, expand);
   }
   else {
     /* No more values, the hash string is complete. Add it to the index */
+    db_bloom_header *bf = (HASHIDX_HAS_BLOOM(hdr) ?
+      &(hdr->ctl.h.bloom) : NULL);
     if(op == HASHIDX_OP_STORE) {
-      return wg_idxhash_store(db, HASHIDX_ARRAYP(hdr),
+      gint retv = wg_idxhash_store(db, HASHIDX_ARRAYP(hdr),
         prefix, prefixlen, ptrtooffset(db, rec));
+      if(!retv && bf)
+        wg_idxhash_bloom_add(db, HASHIDX_ARRAYP(hdr), bf, prefix, prefixlen);
+      return retv;
     } else if(op == HASHIDX_OP_REMOVE) {
+      /* the filter keeps the bits of removed keys until rebuilt */
       return wg_idxhash_remove(db, HASHIDX_ARRAYP(hdr),
         prefix, prefixlen, ptrtooffset(db, rec));
     } else {
-      /* assume HASHIDX_OP_FIND */
-      return wg_idxhash_find(db, HASHIDX_ARRAYP(hdr), prefix, prefixlen);
+      /* assume HASHIDX_OP_FIND. A key rejected by the filter is
+       * not looked up from the hash chains. */
+      gint list;
+      if(bf) {
+        bf->lookups++;
+        if(!wg_idxhash_bloom_check(db, bf, prefix, prefixlen)) {
+          bf->negatives++;
+          return 0;
+        }
+      }
+      list = wg_idxhash_find(db, HASHIDX_ARRAYP(hdr), prefix, prefixlen);
+      if(bf && !list)
+        bf->false_positives++;
+      return list;
     }
   }
   return 0; /* pacify the compiler */
@@ -1561,60 +2151,108 @@ static gint hash_recurse(void *db, wg_index_header *hdr, char *prefix,
  * Helper function to convert the next value into an array of
  * bytes and append it to the existing prefix. Always calls
  * hash_recurse() to complete the recursion.
+ *
+ * The value is appended directly to the prefix buffer. Only if the
+ * key does not fit, a larger buffer is allocated for the rest
+ * of the recursion.
  */
 static gint hash_extend_prefix(void *db, wg_index_header *hdr, char *prefix,
-  gint prefixlen, gint nextval, gint *values, gint count, void *rec, gint op,
-  gint expand) {
+  gint prefixlen, gint prefixsz, gint nextval, gint *values, gint count,
+  void *rec, gint op, gint expand) {
 
-  char *fldbytes, *newprefix;
-  gint newlen, fldlen, retv;
+  char *newprefix;
+  gint newlen, fldlen, sep, avail, retv;
 
-  fldlen = wg_decode_for_hashing(db, nextval, &fldbytes);
+  sep = (prefixlen ? 1 : 0); /* columns are separated by '\0' */
+  avail = prefixsz - prefixlen - sep;
+  if(avail < 0)
+    avail = 0;
+
+  fldlen = wg_decode_for_hashing_copy(db, nextval,
+    prefix + prefixlen + sep, avail);
   if(fldlen < 1) {
     show_index_error(db,"Failed to decode a field value for hash");
     return -1;
   }
+  newlen = prefixlen + sep + fldlen;
 
-  if(prefix && prefixlen) {
-    newlen = prefixlen + fldlen + 1;
-  } else {
-    newlen = fldlen;
+  if(fldlen <= avail) {
+    if(sep)
+      prefix[prefixlen] = '\0';
+    return hash_recurse(db, hdr, prefix, newlen, prefixsz,
+      values, count, rec, op, expand);
   }
 
-  newprefix = malloc(newlen);
+  /* Does not fit, leave room for the remaining columns too */
+  newprefix = malloc(2*newlen);
   if(!newprefix) {
-    free(fldbytes);
     show_index_error(db, "Failed to allocate memory");
     return -1;
   }
-  if(prefix) {
-    memcpy(newprefix, prefix, prefixlen);
-    newprefix[prefixlen] = '\0'; /* XXX: why? double-check this */
-  }
-
-  memcpy(newprefix + (newlen - fldlen), fldbytes, fldlen);
-  retv = hash_recurse(db, hdr, newprefix,
-    newlen, values, count, rec, op, expand);
-  free(fldbytes);
+  memcpy(newprefix, prefix, prefixlen);
+  if(sep)
+    newprefix[prefixlen] = '\0';
+  wg_decode_for_hashing_copy(db, nextval, newprefix + prefixlen + sep, fldlen);
+  retv = hash_recurse(db, hdr, newprefix, newlen, 2*newlen,
+    values, count, rec, op, expand);
   free(newprefix);
   return retv;
 }
 
+/** Add or remove the row of an expression index
+ *  The expression value of the column is hashed. Rows where the
+ *  expression has no value are not in the index.
+ *  returns:
+ *  0 - on success
+ *  -1 - if error
+ */
+static gint hash_expr_row(void *db, wg_index_header *hdr, void *rec,
+  gint op) {
+  char keybuf[HASHIDX_KEYBUF_SIZE];
+  gint value, retv;
+
+  retv = wg_index_expr_value(db, hdr->expr,
+    wg_get_field(db, rec, hdr->rec_field_index[0]), &value);
+  if(retv)
+    return (retv > 0 ? 0 : -1);
+  retv = hash_recurse(db, hdr, keybuf, 0, HASHIDX_KEYBUF_SIZE,
+    &value, 1, rec, op, 0);
+  wg_free_query_param(db, value);
+  return retv;
+}
+
+/*
+ * Check if a row belongs to a hash index being built.
+ */
+static int hash_accepts_row(void *db, wg_index_header *hdr, void *rec) {
+  /* as in the updates, the row must have all indexed columns */
+  if(last_index_column(hdr) >= wg_get_record_len(db, rec))
+    return 0;
+  if(!MATCH_TEMPLATE(db, hdr, rec))
+    return 0;
+  /* JSON index ignores array and object records. Their data is
+   * indexed from the rows that point to them.
+   */
+  if(hdr->type == WG_INDEX_TYPE_HASH_JSON && !is_plain_record(rec))
+    return 0;
+  return 1;
+}
+
 /*
  * Create hash index.
+ * size_hint is the expected number of distinct keys, 0 uses the
+ * default size. The hash grows automatically in either case.
  * Returns 0 on success
  * Returns -1 on failure.
  */
-static gint create_hash_index(void *db, gint index_id){
+static gint create_hash_index(void *db, gint index_id, gint size_hint){
   unsigned int rowsprocessed;
   void *rec;
   wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
-  gint type = hdr->type;
-  gint firstcol = hdr->rec_field_index[0];
   gint i;
 
   /* Initialize the hash table (0 - use default size) */
-  if(wg_create_hash(db, HASHIDX_ARRAYP(hdr), 0))
+  if(wg_create_hash(db, HASHIDX_ARRAYP(hdr), size_hint))
     return -1;
 
   /* Add existing records */
@@ -1622,24 +2260,13 @@ static gint create_hash_index(void *db, gint index_id){
   rowsprocessed = 0;
 
   while(rec != NULL) {
-    if(firstcol >= wg_get_record_len(db, rec)) {
-      rec=wg_get_next_record(db,rec);
-      continue;
-    }
-    if(MATCH_TEMPLATE(db, hdr, rec)) {
-      if(type == WG_INDEX_TYPE_HASH_JSON) {
-        /* Ignore array and object records. Their data is indexed
-         * from the rows that point to them.
-         */
-        if(is_plain_record(rec)) {
-          hash_add_row(db, index_id, rec);
-          rowsprocessed++;
-        }
-      } else {
-        /* Add all rows normally */
-        hash_add_row(db, index_id, rec);
-        rowsprocessed++;
+    if(hash_accepts_row(db, hdr, rec)) {
+      if(hash_add_row(db, index_id, rec)) {
+        /* a partial index is not kept */
+        wg_idxhash_free(db, HASHIDX_ARRAYP(hdr));
+        return -1;
       }
+      rowsprocessed++;
     }
     rec=wg_get_next_record(db,rec);
   }
@@ -1669,20 +2296,25 @@ static gint create_hash_index(void *db, gint index_id){
  *  returns:
  *  0 - on success
  *  -1 - error
- *
- * XXX: implement this. Needs some method of de-allocating or reusing
- * the main hash table (list cells/varlen storage can be freed piece by
- * piece if necessary).
  */
 static gint drop_hash_index(void *db, gint index_id){
-  show_index_error(db, "Cannot drop hash index: not implemented");
-  return -1;
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+  /* Buckets, row lists and the array(s) are all released for reuse */
+  if(wg_idxhash_free(db, HASHIDX_ARRAYP(hdr))) {
+    show_index_error(db, "Failed to release hash index memory");
+    return -1;
+  }
+  if(HASHIDX_HAS_BLOOM(hdr))
+    wg_idxhash_bloom_free(db, &(hdr->ctl.h.bloom));
+  return 0;
 }
 
 /* -------------- Hash index public functions -------------- */
 
 /**
  *  Search the hash index for given values.
+ *  The values of an expression index are the expression values.
  *
  *  returns offset to data row:
  *  -1 - error
@@ -1691,6 +2323,7 @@ static gint drop_hash_index(void *db, gint index_id){
  */
 gint wg_search_hash(void *db, gint index_id, gint *values, gint count) {
   wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  char keybuf[HASHIDX_KEYBUF_SIZE];
 #ifdef CHECK
   gint type = wg_get_index_type(db, index_id); /* also validates the id */
   if(type < 0)
@@ -1702,57 +2335,674 @@ gint wg_search_hash(void *db, gint index_id, gint *values, gint count) {
     return -1;
   }
 #endif
-  return hash_recurse(db, hdr, NULL, 0, values, count, NULL,
-    HASHIDX_OP_FIND, 0);
+  /* The search sees the deferred index updates of this handle */
+  if(check_index_rows(db, hdr))
+    return -1;
+  return hash_recurse(db, hdr, keybuf, 0, HASHIDX_KEYBUF_SIZE,
+    values, count, NULL, HASHIDX_OP_FIND, 0);
 }
 
-
-/* ----------------- Index template functions -------------- */
-
-/** Insert into list
+/**
+ *  Compute the value of an index expression.
  *
- * helper function to insert list elements. Takes address of
- * a variable containing an offset to the first element (that
- * offset may be 0 for empty lists or when appending).
+ *  WG_EXPR_LOWER - a string with the ASCII letters in lower case
+ *  WG_EXPR_STRLEN - the length of a string in bytes
+ *  WG_EXPR_DATE - the UTC date of an integer Unix timestamp (seconds)
+ *
+ *  The value is encoded like a query parameter and must be released
+ *  with wg_free_query_param().
+ *
+ *  returns:
+ *  0 - the value is stored in *result
+ *  1 - the expression has no value for enc (another type)
+ *  -1 - error
  */
-static gint insert_into_list(void *db, gint *head, gint value) {
-  db_memsegment_header* dbh = dbmemsegh(db);
-  gint old = *head;
-
-  *head = wg_alloc_fixlen_object(db, &dbh->listcell_area_header);
-  if(*head) {
-    gcell *listelem = (gcell *) offsettoptr(db, *head);
-    listelem->car = value;
-    listelem->cdr = old;
+gint wg_index_expr_value(void *db, gint expr, gint enc, gint *result) {
+  gint type = wg_get_encoded_type(db, enc);
+
+  switch(expr) {
+    case WG_EXPR_LOWER:
+      if(type == WG_STRTYPE) {
+        char *str = wg_decode_str(db, enc), *lower;
+        size_t i, len = strlen(str);
+        lower = (char *) malloc(len + 1);
+        if(!lower) {
+          show_index_error(db, "Failed to allocate memory");
+          return -1;
+        }
+        for(i=0; i<=len; i++) {
+          lower[i] = (str[i] >= 'A' && str[i] <= 'Z' ?
+            str[i] - 'A' + 'a' : str[i]);
+        }
+        *result = wg_encode_query_param_str(db, lower, NULL);
+        free(lower);
+        return (*result == WG_ILLEGAL ? -1 : 0);
+      }
+      break;
+    case WG_EXPR_STRLEN:
+      if(type == WG_STRTYPE) {
+        *result = wg_encode_query_param_int(db, wg_decode_str_len(db, enc));
+        return (*result == WG_ILLEGAL ? -1 : 0);
+      }
+      break;
+    case WG_EXPR_DATE:
+      if(type == WG_INTTYPE) {
+        gint secs = wg_decode_int(db, enc);
+        gint days = secs / 86400;
+        if(secs % 86400 < 0)
+          days--; /* rounded down before 1970 */
+        days += wg_ymd_to_date(db, 1970, 1, 1);
+        if(!fits_date(days))
+          return 1;
+        *result = wg_encode_query_param_date(db, (int) days);
+        return (*result == WG_ILLEGAL ? -1 : 0);
+      }
+      break;
+    default:
+      show_index_error(db, "Invalid index expression");
+      return -1;
   }
-  return *head;
+  return 1;
 }
 
-/** Delete from list
- *
- * helper function to delete list elements. Deletes the current
- * element.
+/* -------------- B-tree index private functions ----------- */
+
+/** Insert a row into a B-tree index
+ *  returns:
+ *  0 - on success
+ *  -1 - if error
  */
-static void delete_from_list(void *db, gint *head) {
-  db_memsegment_header* dbh = dbmemsegh(db);
-  gcell *listelem = (gcell *) offsettoptr(db, *head);
+static gint btree_add_row(void *db, gint index_id, void *rec) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
 
-  *head = listelem->cdr;
-  /* Free the vacated list element */
-  wg_free_fixlen_object(db, &dbh->listcell_area_header,
-    ptrtooffset(db, listelem));
+  return wg_btree_insert(db, hdr, ptrtooffset(db, rec));
 }
 
-#ifdef USE_INDEX_TEMPLATE
+/** Remove a row from a B-tree index
+ *  returns:
+ *  0 - on success
+ *  -1 - if the row was not in the index
+ */
+static gint btree_remove_row(void *db, gint index_id, void *rec) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
 
-/** Add index template
- *
- * Takes a gint array that represents an template for records
- * that are inserted into an index. Creates a database record
- * from that array and links the record into an ordered list.
- *
- * Returns offset to the created match record, if successful
- * Returns 0 on error.
+  return wg_btree_delete(db, hdr, ptrtooffset(db, rec));
+}
+
+/** Create B-tree index on a column
+ *  Packs the tree from sorted data if there is enough local memory,
+ *  otherwise inserts the rows one by one.
+ *  returns:
+ *  0 - on success
+ *  -1 - error (failed to create the index)
+ */
+static gint create_btree_index(void *db, gint index_id) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  wg_index_entry *entries;
+  gint rowsprocessed = 0;
+  void *rec;
+
+  entries = collect_index_entries(db, hdr, &rowsprocessed);
+  if(entries) {
+    gint err = wg_btree_build(db, hdr, entries, rowsprocessed);
+    free(entries);
+    if(err)
+      return -1;
+  } else {
+    if(wg_btree_create(db, hdr))
+      return -1;
+    rowsprocessed = 0;
+    for(rec = wg_get_first_record(db); rec;
+      rec = wg_get_next_record(db, rec)) {
+      if(ttree_accepts_row(db, hdr, rec)) {
+        if(btree_add_row(db, index_id, rec))
+          return -1;
+        rowsprocessed++;
+      }
+    }
+  }
+
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"new B-tree index created on rec field %d into slot %d"\
+    " and %d data rows inserted\n",
+    (int) hdr->rec_field_index[0], (int) index_id, (int) rowsprocessed);
+#endif
+  return 0;
+}
+
+/** Drop a B-tree index by id
+ *  returns:
+ *  0 - on success
+ *  -1 - error
+ */
+static gint drop_btree_index(void *db, gint index_id) {
+  wg_btree_free(db, (wg_index_header *) offsettoptr(db, index_id));
+  return 0;
+}
+
+/* -------------- Bitmap index private functions ----------- */
+
+/** Insert a row into a bitmap index
+ *  returns:
+ *  0 - on success
+ *  -1 - if error
+ */
+static gint bitmap_add_row(void *db, gint index_id, void *rec) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+  return wg_bitmap_insert(db, hdr, ptrtooffset(db, rec));
+}
+
+/** Remove a row from a bitmap index
+ *  returns:
+ *  0 - on success
+ *  -1 - if the row was not in the index
+ */
+static gint bitmap_remove_row(void *db, gint index_id, void *rec) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+  return wg_bitmap_delete(db, hdr, ptrtooffset(db, rec));
+}
+
+/** Create bitmap index on a column
+ *  returns:
+ *  0 - on success
+ *  -1 - error (failed to create the index)
+ */
+static gint create_bitmap_index(void *db, gint index_id) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  gint rowsprocessed = 0;
+  void *rec;
+
+  if(wg_bitmap_create(db, hdr))
+    return -1;
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(ttree_accepts_row(db, hdr, rec)) {
+      if(bitmap_add_row(db, index_id, rec)) {
+        wg_bitmap_free(db, hdr);
+        return -1;
+      }
+      rowsprocessed++;
+    }
+  }
+
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"new bitmap index created on rec field %d into slot %d"\
+    " and %d data rows inserted (%d distinct values)\n",
+    (int) hdr->rec_field_index[0], (int) index_id, (int) rowsprocessed,
+    (int) hdr->ctl.m.values);
+#endif
+  return 0;
+}
+
+/** Drop a bitmap index by id
+ *  returns:
+ *  0 - on success
+ *  -1 - error
+ */
+static gint drop_bitmap_index(void *db, gint index_id) {
+  wg_bitmap_free(db, (wg_index_header *) offsettoptr(db, index_id));
+  return 0;
+}
+
+/* -------------- Full-text index private functions ----------- */
+
+/** Insert the terms of a row into a full-text index
+ *  returns:
+ *  0 - on success
+ *  -1 - if error
+ */
+static gint fulltext_add_row(void *db, gint index_id, void *rec) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+  return wg_fulltext_insert(db, hdr, ptrtooffset(db, rec));
+}
+
+/** Remove the terms of a row from a full-text index
+ *  returns:
+ *  0 - on success
+ *  -1 - if the row was not in the index
+ */
+static gint fulltext_remove_row(void *db, gint index_id, void *rec) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+  return wg_fulltext_delete(db, hdr, ptrtooffset(db, rec));
+}
+
+/** Create full-text index on a column
+ *  flags and min_len configure the tokenizer (see
+ *  wg_fulltext_tokenize()).
+ *  returns:
+ *  0 - on success
+ *  -1 - error (failed to create the index)
+ */
+static gint create_fulltext_index(void *db, gint index_id, gint flags,
+  gint min_len) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  gint rowsprocessed = 0;
+  void *rec;
+
+  if(wg_fulltext_create(db, hdr, flags, min_len))
+    return -1;
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(ttree_accepts_row(db, hdr, rec)) {
+      if(fulltext_add_row(db, index_id, rec)) {
+        wg_fulltext_free(db, hdr);
+        return -1;
+      }
+      rowsprocessed++;
+    }
+  }
+
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"new full-text index created on rec field %d into slot %d"\
+    " and %d data rows inserted (%d terms)\n",
+    (int) hdr->rec_field_index[0], (int) index_id, (int) rowsprocessed,
+    (int) FULLTEXT_HASHP(hdr)->entries);
+#endif
+  return 0;
+}
+
+/** Drop a full-text index by id
+ *  returns:
+ *  0 - on success
+ *  -1 - error
+ */
+static gint drop_fulltext_index(void *db, gint index_id) {
+  if(wg_fulltext_free(db, (wg_index_header *) offsettoptr(db, index_id))) {
+    show_index_error(db, "Failed to release full-text index memory");
+    return -1;
+  }
+  return 0;
+}
+
+/* -------------- R-tree index private functions ----------- */
+
+/** Insert the point of a row into an R-tree index
+ *  returns:
+ *  0 - on success
+ *  -1 - if error
+ */
+static gint rtree_add_row(void *db, gint index_id, void *rec) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+  return wg_rtree_insert(db, hdr, ptrtooffset(db, rec));
+}
+
+/** Remove the point of a row from an R-tree index
+ *  returns:
+ *  0 - on success
+ *  -1 - if the row was not in the index
+ */
+static gint rtree_remove_row(void *db, gint index_id, void *rec) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+  return wg_rtree_delete(db, hdr, ptrtooffset(db, rec));
+}
+
+/** Create R-tree index on a pair of columns
+ *  The points of the existing rows are packed into the tree in
+ *  Hilbert curve order. If there is not enough local memory for
+ *  that, the rows are inserted one by one.
+ *  returns:
+ *  0 - on success
+ *  -1 - error (failed to create the index)
+ */
+static gint create_rtree_index(void *db, gint index_id) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  wg_rtree_entry *entries = NULL;
+  gint count = 0, size = 0;
+  void *rec;
+
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    double x, y;
+    if(!ttree_accepts_row(db, hdr, rec) ||\
+      wg_rtree_point(db, hdr, rec, &x, &y))
+      continue;
+    if(count == size) {
+      gint newsize = (size ? 2*size : 1024);
+      wg_rtree_entry *tmp = (wg_rtree_entry *) realloc(entries,
+        newsize * sizeof(wg_rtree_entry));
+      if(!tmp) {
+        free(entries);
+        entries = NULL;
+        break;
+      }
+      entries = tmp;
+      size = newsize;
+    }
+    entries[count].x = x;
+    entries[count].y = y;
+    entries[count].rec = ptrtooffset(db, rec);
+    count++;
+  }
+
+  if(entries || !size) {
+    gint err = wg_rtree_build(db, hdr, entries, count);
+    free(entries);
+    if(err)
+      return -1;
+  } else {
+    if(wg_rtree_create(db, hdr))
+      return -1;
+    for(rec = wg_get_first_record(db); rec;
+      rec = wg_get_next_record(db, rec)) {
+      if(ttree_accepts_row(db, hdr, rec)) {
+        if(rtree_add_row(db, index_id, rec)) {
+          wg_rtree_free(db, hdr);
+          return -1;
+        }
+      }
+    }
+  }
+
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"new R-tree index created on rec fields %d and %d into "\
+    "slot %d and %d data rows inserted\n",
+    (int) hdr->rec_field_index[0], (int) hdr->rec_field_index[1],
+    (int) index_id, (int) hdr->ctl.r.rows);
+#endif
+  return 0;
+}
+
+/** Drop an R-tree index by id
+ *  returns:
+ *  0 - on success
+ *  -1 - error
+ */
+static gint drop_rtree_index(void *db, gint index_id) {
+  wg_rtree_free(db, (wg_index_header *) offsettoptr(db, index_id));
+  return 0;
+}
+
+/* ------------ JSON path index private functions ----------- */
+
+/** Add or remove the values of a document at a path
+ *  enc is the value reached so far and path the rest of the path.
+ *  An object is entered by the key of the next path element, an
+ *  array element by element. The literal values at the end of the
+ *  path (also in an array) are hashed, objects are not indexed.
+ *  returns:
+ *  0 - on success
+ *  -1 - if error
+ */
+static gint jsonpath_recurse(void *db, wg_index_header *hdr, char *path,
+  gint enc, void *doc, gint op, int depth) {
+  char keybuf[HASHIDX_KEYBUF_SIZE];
+  void *rec;
+  gint i, reclen, retv, seglen;
+  char *next;
+
+  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+    if(*path)
+      return 0; /* the path continues past a literal */
+    retv = hash_recurse(db, hdr, keybuf, 0, HASHIDX_KEYBUF_SIZE,
+      &enc, 1, doc, op, 0);
+    /* a missing value is skipped when removing */
+    return (op == HASHIDX_OP_REMOVE ? 0 : retv);
+  }
+  if(depth <= 0)
+    return show_index_error(db, "JSON path index: document too deep");
+
+  rec = wg_decode_record(db, enc);
+  reclen = wg_get_record_len(db, rec);
+  if(is_schema_array(rec)) {
+    for(i=0; i<reclen; i++) {
+      retv = jsonpath_recurse(db, hdr, path, wg_get_field(db, rec, i),
+        doc, op, depth-1);
+      if(retv)
+        return retv;
+    }
+    return 0;
+  }
+  if(!*path || !is_schema_object(rec))
+    return 0;
+
+  seglen = strcspn(path, ".");
+  next = path + seglen + (path[seglen] ? 1 : 0);
+  for(i=0; i<reclen; i++) {
+    gint kv = wg_get_field(db, rec, i), key;
+    void *kvrec;
+
+    if(wg_get_encoded_type(db, kv) != WG_RECORDTYPE)
+      continue;
+    kvrec = wg_decode_record(db, kv);
+    if(wg_get_record_len(db, kvrec) <= WG_SCHEMA_VALUE_OFFSET)
+      continue;
+    key = wg_get_field(db, kvrec, WG_SCHEMA_KEY_OFFSET);
+    if(wg_get_encoded_type(db, key) == WG_STRTYPE &&\
+      wg_decode_str_len(db, key) == seglen &&\
+      !memcmp(wg_decode_str(db, key), path, seglen)) {
+      retv = jsonpath_recurse(db, hdr, next,
+        wg_get_field(db, kvrec, WG_SCHEMA_VALUE_OFFSET), doc, op, depth-1);
+      if(retv)
+        return retv;
+    }
+  }
+  return 0;
+}
+
+/** Add or remove a document in a JSON path index
+ *  returns:
+ *  0 - on success
+ *  -1 - if error
+ */
+static gint jsonpath_document(void *db, wg_index_header *hdr, void *doc,
+  gint op) {
+  return jsonpath_recurse(db, hdr,
+    (char *) offsettoptr(db, hdr->ctl.p.path_offset),
+    wg_encode_record(db, doc), doc, op, JSONPATH_MAX_DEPTH);
+}
+
+/** Drop a JSON path index by id
+ *  returns:
+ *  0 - on success
+ *  -1 - error
+ */
+static gint drop_jsonpath_index(void *db, gint index_id) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+  if(drop_hash_index(db, index_id))
+    return -1;
+  wg_free_object(db, &(dbmemsegh(db)->indexhash_area_header),
+    hdr->ctl.p.path_offset - sizeof(gint));
+  return 0;
+}
+
+/** Search a JSON path index for a value
+ *  returns:
+ *  -1 - error
+ *  0 - if no document has the value
+ *  >0 - offset to the linked list that contains the document offsets
+ */
+gint wg_search_json_path(void *db, gint index_id, gint value) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  char keybuf[HASHIDX_KEYBUF_SIZE];
+#ifdef CHECK
+  if(wg_get_index_type(db, index_id) != WG_INDEX_TYPE_JSON_PATH)
+    return show_index_error(db, "wg_search_json_path: Not a path index");
+#endif
+  if(check_index_rows(db, hdr))
+    return -1;
+  return hash_recurse(db, hdr, keybuf, 0, HASHIDX_KEYBUF_SIZE,
+    &value, 1, NULL, HASHIDX_OP_FIND, 0);
+}
+
+
+/* ----------------- Index template functions -------------- */
+
+/** Insert into list
+ *
+ * helper function to insert list elements. Takes address of
+ * a variable containing an offset to the first element (that
+ * offset may be 0 for empty lists or when appending).
+ */
+static gint insert_into_list(void *db, gint *head, gint value) {
+  db_memsegment_header* dbh = dbmemsegh(db);
+  gint old = *head;
+
+  *head = wg_alloc_fixlen_object(db, &dbh->listcell_area_header);
+  if(*head) {
+    gcell *listelem = (gcell *) offsettoptr(db, *head);
+    listelem->car = value;
+    listelem->cdr = old;
+  }
+  return *head;
+}
+
+/** Delete from list
+ *
+ * helper function to delete list elements. Deletes the current
+ * element.
+ */
+static void delete_from_list(void *db, gint *head) {
+  db_memsegment_header* dbh = dbmemsegh(db);
+  gcell *listelem = (gcell *) offsettoptr(db, *head);
+
+  *head = listelem->cdr;
+  /* Free the vacated list element */
+  wg_free_fixlen_object(db, &dbh->listcell_area_header,
+    ptrtooffset(db, listelem));
+}
+
+/** Find the position of a column in the column map
+ *
+ * The map is sorted, returns the position of the first element
+ * with the same or a higher column number.
+ */
+static gint column_map_position(void *db, gint column) {
+  db_index_area_header *ihdr = &(dbmemsegh(db)->index_control_area_header);
+  wg_index_column *map;
+  gint lo = 0, hi = ihdr->column_map_count;
+
+  if(!hi)
+    return 0;
+  map = (wg_index_column *) offsettoptr(db, ihdr->column_map);
+  while(lo < hi) {
+    gint mid = lo + (hi - lo) / 2;
+    if(map[mid].column < column)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/** Find the index list of a column
+ *
+ * Returns the address of the variable containing the offset to the
+ * first element of the list (index templates, if tmpl is set).
+ * Columns up to MAX_INDEXED_FIELDNR are in the fixed tables, the
+ * others in the column map. If the column is not in the map, it is
+ * added when create is set, otherwise NULL is returned.
+ *
+ * Adding a column may move the map, so the addresses returned
+ * earlier are only valid until the next call with create set.
+ */
+static gint *column_list(void *db, gint column, int tmpl, int create) {
+  db_memsegment_header* dbh = dbmemsegh(db);
+  db_index_area_header *ihdr = &dbh->index_control_area_header;
+  wg_index_column *map;
+  gint pos;
+
+  if(column <= MAX_INDEXED_FIELDNR) {
+#ifdef USE_INDEX_TEMPLATE
+    if(tmpl)
+      return &ihdr->index_template_table[column];
+#endif
+    return &ihdr->index_table[column];
+  }
+
+  pos = column_map_position(db, column);
+  map = (wg_index_column *) offsettoptr(db, ihdr->column_map);
+  if(pos == ihdr->column_map_count || map[pos].column != column) {
+    if(!create)
+      return NULL;
+
+    if(ihdr->column_map_count == ihdr->column_map_size) {
+      /* Grow the map. The first gint of the object is
+       * the allocator header. */
+      gint size = (ihdr->column_map_size ? 2 * ihdr->column_map_size : 8);
+      gint object = wg_alloc_gints(db, &dbh->indexhash_area_header,
+        size * (sizeof(wg_index_column) / sizeof(gint)) + 1);
+      if(!object) {
+        show_index_error(db, "Failed to allocate the column map");
+        return NULL;
+      }
+      if(ihdr->column_map) {
+        memcpy(offsettoptr(db, object + sizeof(gint)), map,
+          ihdr->column_map_count * sizeof(wg_index_column));
+        wg_free_object(db, &dbh->indexhash_area_header,
+          ihdr->column_map - sizeof(gint));
+      }
+      ihdr->column_map = object + sizeof(gint);
+      ihdr->column_map_size = size;
+      map = (wg_index_column *) offsettoptr(db, ihdr->column_map);
+    }
+
+    memmove(&map[pos+1], &map[pos],
+      (ihdr->column_map_count - pos) * sizeof(wg_index_column));
+    map[pos].column = column;
+    map[pos].index_list = 0;
+    map[pos].template_list = 0;
+    ihdr->column_map_count++;
+  }
+  return (tmpl ? &map[pos].template_list : &map[pos].index_list);
+}
+
+/** Remove a column from the column map
+ *
+ * The column is only removed if it has no indexes left.
+ */
+static void release_map_column(void *db, gint column) {
+  db_memsegment_header* dbh = dbmemsegh(db);
+  db_index_area_header *ihdr = &dbh->index_control_area_header;
+  wg_index_column *map;
+  gint pos;
+
+  if(column <= MAX_INDEXED_FIELDNR)
+    return;
+  pos = column_map_position(db, column);
+  map = (wg_index_column *) offsettoptr(db, ihdr->column_map);
+  if(pos == ihdr->column_map_count || map[pos].column != column ||\
+    map[pos].index_list || map[pos].template_list)
+    return;
+
+  ihdr->column_map_count--;
+  if(!ihdr->column_map_count) {
+    wg_free_object(db, &dbh->indexhash_area_header,
+      ihdr->column_map - sizeof(gint));
+    ihdr->column_map = 0;
+    ihdr->column_map_size = 0;
+  } else {
+    memmove(&map[pos], &map[pos+1],
+      (ihdr->column_map_count - pos) * sizeof(wg_index_column));
+  }
+}
+
+/** Find the index list of a column
+ *
+ * Returns the address of the list head (see column_list()) or NULL
+ * if the column has no indexes.
+ */
+gint *wg_index_column_list(void *db, gint column, int tmpl) {
+  return column_list(db, column, tmpl, 0);
+}
+
+#ifdef USE_INDEX_TEMPLATE
+
+/** Add index template
+ *
+ * Takes a gint array that represents an template for records
+ * that are inserted into an index. Creates a database record
+ * from that array and links the record into an ordered list.
+ *
+ * Returns offset to the created match record, if successful
+ * Returns 0 on error.
  */
 static gint add_index_template(void *db, gint *matchrec, gint reclen) {
   gint *ilist, *meta;
@@ -2003,13 +3253,13 @@ static gint sort_columns(gint *sorted_cols, gint *columns,
   gint i = 0;
   gint prev = -1;
   while(i < col_count) {
-    gint lowest = MAX_INDEXED_FIELDNR + 1;
+    gint lowest = -1;
     gint j;
     for(j=0; j<col_count; j++) {
-      if(columns[j] < lowest && columns[j] > prev)
+      if(columns[j] > prev && (lowest < 0 || columns[j] < lowest))
         lowest = columns[j];
     }
-    if(lowest == MAX_INDEXED_FIELDNR + 1)
+    if(lowest < 0)
       break;
     sorted_cols[i++] = lowest;
     prev = lowest;
@@ -2017,6 +3267,22 @@ static gint sort_columns(gint *sorted_cols, gint *columns,
   return i;
 }
 
+/*
+ * Return the highest column number of an index. The rows that are
+ * shorter than this are not indexed. The columns are sorted, except
+ * in a multi-column B-tree where they are in the key order.
+ */
+static gint last_index_column(wg_index_header *hdr) {
+  gint i, last = hdr->rec_field_index[hdr->fields - 1];
+  if(hdr->type == WG_INDEX_TYPE_BTREE) {
+    for(i=0; i<hdr->fields - 1; i++) {
+      if(hdr->rec_field_index[i] > last)
+        last = hdr->rec_field_index[i];
+    }
+  }
+  return last;
+}
+
 /** Create an index.
  *
  * Single-column backward compatibility wrapper.
@@ -2034,6 +3300,14 @@ gint wg_create_index(void *db, gint column, gint type,
  *        WG_INDEX_TYPE_TTREE_JSON - T-tree for JSON schema
  *        WG_INDEX_TYPE_HASH - multi-column hash index
  *        WG_INDEX_TYPE_HASH_JSON - hash index with JSON features
+ *        WG_INDEX_TYPE_BTREE - B-tree index, a multi-column key is
+ *          ordered by the columns in the order of the array
+ *        WG_INDEX_TYPE_BITMAP - single-column bitmap index, for
+ *          columns with few distinct values
+ *        WG_INDEX_TYPE_FULLTEXT - single-column full-text index with
+ *          the default tokenizer (see wg_create_fulltext_index())
+ *        WG_INDEX_TYPE_RTREE - R-tree over two columns that hold
+ *          the coordinates of a point
  *
  * columns - array of column numbers
  * col_count - size of the column number array
@@ -2046,6 +3320,496 @@ gint wg_create_index(void *db, gint column, gint type,
  */
 gint wg_create_multi_index(void *db, gint *columns, gint col_count, gint type,
   gint *matchrec, gint reclen)
+{
+  return wg_create_multi_index_sized(db, columns, col_count, type,
+    matchrec, reclen, 0);
+}
+
+/** Create an index with a size hint.
+ *
+ * Same as wg_create_multi_index(). size_hint is the expected
+ * number of distinct keys, used to presize hash indexes (0 selects
+ * the default). Hash indexes grow as needed regardless of the hint.
+ */
+gint wg_create_multi_index_sized(void *db, gint *columns, gint col_count,
+  gint type, gint *matchrec, gint reclen, gint size_hint)
+{
+  gint index_id;
+
+  index_id = new_index_header(db, columns, col_count, type, 0,
+    matchrec, reclen);
+  if(index_id < 0)
+    return -1;
+
+  /* create the actual index */
+  switch(type) {
+    case WG_INDEX_TYPE_TTREE:
+      if(create_ttree_index(db, index_id)) {
+        discard_index_header(db, index_id);
+        return -1;
+      }
+      break;
+    case WG_INDEX_TYPE_HASH:
+    case WG_INDEX_TYPE_HASH_JSON:
+      if(create_hash_index(db, index_id, size_hint)) {
+        discard_index_header(db, index_id);
+        return -1;
+      }
+      break;
+    case WG_INDEX_TYPE_BTREE:
+      if(create_btree_index(db, index_id))
+        return -1;
+      break;
+    case WG_INDEX_TYPE_BITMAP:
+      if(create_bitmap_index(db, index_id))
+        return -1;
+      break;
+    case WG_INDEX_TYPE_FULLTEXT:
+      if(create_fulltext_index(db, index_id, 0, WG_FULLTEXT_MIN_LEN))
+        return -1;
+      break;
+    case WG_INDEX_TYPE_RTREE:
+      if(create_rtree_index(db, index_id))
+        return -1;
+      break;
+    case WG_INDEX_TYPE_TTREE_JSON:
+      /* Return an error, until proper implementation exists */
+    default:
+      show_index_error(db, "Invalid index type");
+      return -1;
+  }
+
+  return register_index(db, index_id, matchrec, reclen);
+}
+
+/** Create a full-text index with tokenizer settings.
+ *
+ * The strings in the column are split into terms: runs of letters,
+ * digits and underscores, where any UTF-8 character that is not
+ * punctuation or a space counts as a letter.
+ *
+ * flags - WG_FULLTEXT_KEEP_CASE - do not fold terms to lower case
+ *         WG_FULLTEXT_ASCII - non-ASCII characters separate terms
+ * min_len - terms shorter than this (in characters) are not indexed,
+ *   0 selects WG_FULLTEXT_MIN_LEN.
+ *
+ * Query terms are tokenized with the same settings.
+ */
+gint wg_create_fulltext_index(void *db, gint column, gint flags,
+  gint min_len)
+{
+  gint index_id;
+
+  index_id = new_index_header(db, &column, 1, WG_INDEX_TYPE_FULLTEXT, 0,
+    NULL, 0);
+  if(index_id < 0)
+    return -1;
+  if(create_fulltext_index(db, index_id, flags,
+    (min_len > 0 ? min_len : WG_FULLTEXT_MIN_LEN)))
+    return -1;
+  return register_index(db, index_id, NULL, 0);
+}
+
+/** Create an expression index.
+ *
+ * The index is a hash index on the value of an expression of the
+ * column (see wg_index_expr_value()):
+ *
+ * expr - WG_EXPR_LOWER - strings in ASCII lower case
+ *        WG_EXPR_STRLEN - length of strings in bytes
+ *        WG_EXPR_DATE - date of integer Unix timestamps
+ *
+ * Rows where the expression has no value are not indexed. Queries
+ * use the index for a WG_COND_EQUAL condition with the same
+ * expression, for example WG_COND_EQUAL|WG_EXPR_LOWER.
+ *
+ * matchrec and reclen are the template, as in wg_create_index().
+ */
+gint wg_create_expr_index(void *db, gint column, gint expr,
+  gint *matchrec, gint reclen)
+{
+  gint index_id;
+
+  if(!VALID_INDEX_EXPR(expr)) {
+    show_index_error(db, "Invalid index expression");
+    return -1;
+  }
+  index_id = new_index_header(db, &column, 1, WG_INDEX_TYPE_HASH, expr,
+    matchrec, reclen);
+  if(index_id < 0)
+    return -1;
+  if(create_hash_index(db, index_id, 0)) {
+    discard_index_header(db, index_id);
+    return -1;
+  }
+  return register_index(db, index_id, matchrec, reclen);
+}
+
+/** Create a JSON path index.
+ *
+ * path is a list of object keys separated by dots, such as
+ * "user.address.city". The index maps the values at the end of the
+ * path to the top-level documents that contain them. Arrays on the
+ * path are entered element by element, the elements of an array at
+ * the end of the path are indexed separately.
+ *
+ * The index is not on any column. Documents are added by
+ * wg_parse_json_document() and removed when they are deleted.
+ */
+gint wg_create_json_path_index(void *db, char *path)
+{
+  gint index_id, object, len, i;
+  unsigned int docs = 0;
+  wg_index_header *hdr;
+  void *rec;
+  db_memsegment_header* dbh = dbmemsegh(db);
+
+#ifdef CHECK
+  if (!dbcheck(db)) {
+    show_index_error(db, "Invalid database pointer in "\
+      "wg_create_json_path_index");
+    return -1;
+  }
+#endif
+  if(!path || !path[0]) {
+    show_index_error(db, "Empty JSON path");
+    return -1;
+  }
+  len = strlen(path);
+  for(i=0; i<len; i++) {
+    if(path[i] == '.' && (!i || i == len-1 || path[i+1] == '.')) {
+      show_index_error(db, "Empty key in JSON path");
+      return -1;
+    }
+  }
+  if(wg_json_path_to_index_id(db, path) > 0) {
+    show_index_error(db, "Identical index already exists on the path");
+    return -1;
+  }
+
+  /* first gint of the path object is the allocator header */
+  object = wg_alloc_gints(db, &(dbh->indexhash_area_header),
+    (len + sizeof(gint)) / sizeof(gint) + 1);
+  if(!object) {
+    show_index_error(db, "Failed to allocate the JSON path");
+    return -1;
+  }
+  index_id = wg_alloc_fixlen_object(db, &dbh->indexhdr_area_header);
+  if(!index_id) {
+    wg_free_object(db, &(dbh->indexhash_area_header), object);
+    show_index_error(db, "Failed to allocate the index header");
+    return -1;
+  }
+
+  hdr = (wg_index_header *) offsettoptr(db, index_id);
+  hdr->type = WG_INDEX_TYPE_JSON_PATH;
+  hdr->fields = 0;
+  hdr->template_offset = 0;
+  hdr->stats_offset = 0;
+  hdr->expr = 0;
+  hdr->pending = 0;
+  hdr->ctl.p.path_offset = object + sizeof(gint);
+  memcpy(offsettoptr(db, hdr->ctl.p.path_offset), path, len + 1);
+
+  if(wg_create_hash(db, HASHIDX_ARRAYP(hdr), 0))
+    return -1;
+
+  /* Add existing documents */
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(is_schema_document(rec)) {
+      if(jsonpath_document(db, hdr, rec, HASHIDX_OP_STORE))
+        return -1;
+      docs++;
+    }
+  }
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"new JSON path index created on %s into slot %d and "\
+    "%d documents inserted\n", path, (int) index_id, docs);
+#endif
+
+  return register_index(db, index_id, NULL, 0);
+}
+
+/** Create several indexes with a single scan of the database.
+ *
+ * specs - array of index descriptions, as accepted by
+ *   wg_create_multi_index_sized().
+ * count - size of the specs array
+ * nthreads - number of threads used for sorting the T-tree and
+ *   B-tree keys. 0 or 1 does all the work in the calling thread.
+ *
+ * The records are scanned once. Hash index keys are inserted during
+ * the scan, as are bitmap index rows. Tree keys are collected and
+ * sorted in parallel before the trees are built. Database memory is
+ * only modified by the calling thread.
+ *
+ * If a spec is invalid or its index cannot be set up, the indexes
+ * before it are still created. A hash index that runs out of memory
+ * during the scan is dropped.
+ * returns 0 on success, -1 on error.
+ */
+gint wg_create_indexes(void *db, wg_index_spec *specs, gint count,
+  gint nthreads)
+{
+  index_build_job *jobs;
+  gint i, ready, rows, result = 0;
+  void *rec;
+
+#ifdef CHECK
+  if (!dbcheck(db)) {
+    show_index_error(db, "Invalid database pointer in wg_create_indexes");
+    return -1;
+  }
+  if(!specs && count > 0) {
+    show_index_error(db, "specs list is a NULL pointer");
+    return -1;
+  }
+#endif
+  if(count < 1)
+    return 0;
+
+  jobs = (index_build_job *) calloc(count, sizeof(index_build_job));
+  if(!jobs) {
+    show_index_error(db, "Failed to allocate memory");
+    return -1;
+  }
+
+  /* Set up the headers. Stop at the first invalid spec. */
+  for(ready=0; ready<count; ready++) {
+    wg_index_spec *spec = &specs[ready];
+    if(spec->type != WG_INDEX_TYPE_TTREE &&\
+      spec->type != WG_INDEX_TYPE_BTREE &&\
+      spec->type != WG_INDEX_TYPE_BITMAP &&\
+      spec->type != WG_INDEX_TYPE_HASH &&\
+      spec->type != WG_INDEX_TYPE_HASH_JSON) {
+      show_index_error(db, "Invalid index type");
+      result = -1;
+      break;
+    }
+    jobs[ready].index_id = new_index_header(db, spec->columns,
+      spec->col_count, spec->type, 0, spec->matchrec, spec->reclen);
+    if(jobs[ready].index_id < 0) {
+      result = -1;
+      break;
+    }
+    jobs[ready].hdr = (wg_index_header *) offsettoptr(db,
+      jobs[ready].index_id);
+    if((spec->type == WG_INDEX_TYPE_BITMAP &&\
+        wg_bitmap_create(db, jobs[ready].hdr)) ||\
+      (spec->type != WG_INDEX_TYPE_BITMAP && !ORDERED_INDEX(spec->type) &&\
+        wg_create_hash(db, HASHIDX_ARRAYP(jobs[ready].hdr),
+        spec->size_hint))) {
+      discard_index_header(db, jobs[ready].index_id);
+      result = -1;
+      break;
+    }
+  }
+
+  /* The shared scan */
+  rows = 0;
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    for(i=0; i<ready; i++) {
+      index_build_job *job = &jobs[i];
+      if(!job->hdr || job->fallback)
+        continue;
+      if(ORDERED_INDEX(job->hdr->type)) {
+        if(!ttree_accepts_row(db, job->hdr, rec))
+          continue;
+        if(job->count == job->size) {
+          gint newsize = (job->size ? 2*job->size : 1024);
+          wg_index_entry *tmp = (wg_index_entry *) realloc(job->entries,
+            newsize * sizeof(wg_index_entry));
+          if(!tmp) {
+            /* built row by row later */
+            free(job->entries);
+            job->entries = NULL;
+            job->fallback = 1;
+            continue;
+          }
+          job->entries = tmp;
+          job->size = newsize;
+        }
+        job->entries[job->count].key = wg_get_field(db, rec,
+          job->hdr->rec_field_index[0]);
+        job->entries[job->count].rec = ptrtooffset(db, rec);
+        job->count++;
+      } else if(job->hdr->type == WG_INDEX_TYPE_BITMAP) {
+        if(!ttree_accepts_row(db, job->hdr, rec))
+          continue;
+        if(bitmap_add_row(db, job->index_id, rec)) {
+          /* built row by row later */
+          wg_bitmap_free(db, job->hdr);
+          job->fallback = 1;
+          continue;
+        }
+        job->count++;
+      } else if(hash_accepts_row(db, job->hdr, rec)) {
+        if(hash_add_row(db, job->index_id, rec)) {
+          /* a partial index is not kept */
+          wg_idxhash_free(db, HASHIDX_ARRAYP(job->hdr));
+          discard_index_header(db, job->index_id);
+          job->hdr = NULL;
+          result = -1;
+          continue;
+        }
+        job->count++;
+      }
+    }
+    rows++;
+  }
+
+  sort_build_jobs(db, jobs, ready, nthreads);
+
+  /* Build the trees and register the indexes */
+  for(i=0; i<ready; i++) {
+    index_build_job *job = &jobs[i];
+    if(!job->hdr)
+      continue;
+    if(job->hdr->type == WG_INDEX_TYPE_TTREE) {
+      gint err;
+      if(job->fallback || !job->count) {
+        /* no data creates the empty root node */
+        err = create_ttree_index(db, job->index_id);
+      } else {
+        /* the T-node area may be too fragmented for the packed tree */
+        err = ttree_build_sorted(db, job->hdr, job->entries, job->count);
+        if(err)
+          err = create_ttree_index(db, job->index_id);
+      }
+      free(job->entries);
+      if(err) {
+        discard_index_header(db, job->index_id);
+        result = -1;
+        continue;
+      }
+    } else if(job->hdr->type == WG_INDEX_TYPE_BTREE) {
+      if(job->fallback) {
+        if(create_btree_index(db, job->index_id))
+          result = -1;
+      } else if(wg_btree_build(db, job->hdr, job->entries, job->count)) {
+        result = -1;
+      }
+      free(job->entries);
+    } else if(job->hdr->type == WG_INDEX_TYPE_BITMAP && job->fallback) {
+      if(create_bitmap_index(db, job->index_id))
+        result = -1;
+    }
+    if(register_index(db, job->index_id, specs[i].matchrec, specs[i].reclen))
+      result = -1;
+  }
+
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"%d indexes created with a shared scan of %d rows\n",
+    (int) ready, (int) rows);
+#endif
+  free(jobs);
+  return result;
+}
+
+/** Sort the collected tree keys, using threads if requested.
+ *  Jobs that cannot be sorted are marked for the row by row build.
+ */
+static void sort_build_jobs(void *db, index_build_job *jobs, gint count,
+  gint nthreads) {
+  sort_worker workers[INDEX_BUILD_MAX_THREADS];
+  gint i;
+#if defined(_WIN32)
+  HANDLE threads[INDEX_BUILD_MAX_THREADS];
+#elif defined(HAVE_PTHREAD)
+  pthread_t threads[INDEX_BUILD_MAX_THREADS];
+#endif
+  int started[INDEX_BUILD_MAX_THREADS];
+
+  if(nthreads > INDEX_BUILD_MAX_THREADS)
+    nthreads = INDEX_BUILD_MAX_THREADS;
+  if(nthreads > count)
+    nthreads = count;
+  if(nthreads < 1)
+    nthreads = 1;
+
+  for(i=0; i<nthreads; i++) {
+    workers[i].db = db;
+    workers[i].jobs = jobs;
+    workers[i].count = count;
+    workers[i].first = i;
+    workers[i].step = nthreads;
+    started[i] = 0;
+  }
+
+  /* Worker 0 always runs in the calling thread. If a thread
+   * cannot be started, its share is done here too.
+   */
+  for(i=1; i<nthreads; i++) {
+#if defined(_WIN32)
+    threads[i] = CreateThread(NULL, 0, sort_worker_main,
+      (LPVOID) &workers[i], 0, NULL);
+    started[i] = (threads[i] != NULL);
+#elif defined(HAVE_PTHREAD)
+    started[i] = !pthread_create(&threads[i], NULL, sort_worker_main,
+      (void *) &workers[i]);
+#endif
+  }
+  sort_jobs(&workers[0]);
+  for(i=1; i<nthreads; i++) {
+    if(started[i]) {
+#if defined(_WIN32)
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+#elif defined(HAVE_PTHREAD)
+      pthread_join(threads[i], NULL);
+#endif
+    } else {
+      sort_jobs(&workers[i]);
+    }
+  }
+}
+
+/** Sort the tree keys of every step-th job, starting from first.
+ *  Only local memory is modified.
+ */
+static void sort_jobs(sort_worker *w) {
+  gint i;
+  for(i=w->first; i<w->count; i+=w->step) {
+    index_build_job *job = &w->jobs[i];
+    wg_index_entry *tmp;
+    if(!job->hdr || job->fallback || !job->entries)
+      continue;
+    tmp = (wg_index_entry *) malloc(job->count * sizeof(wg_index_entry));
+    if(!tmp) {
+      free(job->entries);
+      job->entries = NULL;
+      job->fallback = 1;
+      continue;
+    }
+    sort_index_entries(w->db, job->hdr, job->entries, tmp, job->count);
+    free(tmp);
+  }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI sort_worker_main(LPVOID arg) {
+  sort_jobs((sort_worker *) arg);
+  return 0;
+}
+#elif defined(HAVE_PTHREAD)
+static void *sort_worker_main(void *arg) {
+  sort_jobs((sort_worker *) arg);
+  return NULL;
+}
+#endif
+
+/** Validate the arguments and set up a new index header.
+ *
+ * The header is linked into the per-column index lists, but
+ * the index is not usable until it is built and registered
+ * with register_index().
+ *
+ * returns the index id, -1 on error.
+ */
+static gint new_index_header(void *db, gint *columns, gint col_count,
+  gint type, gint expr, gint *matchrec, gint reclen)
 {
   gint index_id, template_offset = 0, i;
   wg_index_header *hdr;
@@ -2054,7 +3818,7 @@ gint wg_create_multi_index(void *db, gint *columns, gint col_count, gint type,
   gint fixed_columns = 0;
 #endif
   gint *ilist[MAX_INDEX_FIELDS];
-  gint sorted_cols[MAX_INDEX_FIELDS];
+  gint sorted_cols[MAX_INDEX_FIELDS], *key_cols;
   db_memsegment_header* dbh = dbmemsegh(db);
 
   /* Check the arguments */
@@ -2089,20 +3853,25 @@ gint wg_create_multi_index(void *db, gint *columns, gint col_count, gint type,
     (type == WG_INDEX_TYPE_TTREE || type == WG_INDEX_TYPE_TTREE_JSON)) {
     show_index_error(db, "Cannot create a T-tree index on multiple columns");
     return -1;
+  } else if(col_count > 1 && type == WG_INDEX_TYPE_BITMAP) {
+    show_index_error(db, "Cannot create a bitmap index on multiple columns");
+    return -1;
+  } else if(col_count > 1 && type == WG_INDEX_TYPE_FULLTEXT) {
+    show_index_error(db,
+      "Cannot create a full-text index on multiple columns");
+    return -1;
+  } else if(col_count != 2 && type == WG_INDEX_TYPE_RTREE) {
+    show_index_error(db, "An R-tree index needs two columns");
+    return -1;
   }
 
   if(sort_columns(sorted_cols, columns, col_count) < col_count) {
     show_index_error(db, "Duplicate columns not allowed");
     return -1;
   }
-
-  for(i=0; i<col_count; i++) {
-    if(sorted_cols[i] > MAX_INDEXED_FIELDNR) {
-      show_index_error_nr(db, "Max allowed column number",
-        MAX_INDEXED_FIELDNR);
-      return -1;
-    }
-  }
+  /* A B-tree is ordered by the columns in the given order, other
+   * indexes do not depend on the order */
+  key_cols = (type == WG_INDEX_TYPE_BTREE ? columns : sorted_cols);
 
 #ifdef USE_INDEX_TEMPLATE
   /* Handle the template */
@@ -2112,12 +3881,6 @@ gint wg_create_multi_index(void *db, gint *columns, gint col_count, gint type,
       return -1;
     }
 
-    if(reclen > MAX_INDEXED_FIELDNR+1) {
-      show_index_error_nr(db, "Match record too long, max",
-        MAX_INDEXED_FIELDNR+1);
-      return -1;
-    }
-
     /* Sanity check */
     for(i=0; i<col_count; i++) {
       if(sorted_cols[i] < reclen &&\
@@ -2137,13 +3900,21 @@ gint wg_create_multi_index(void *db, gint *columns, gint col_count, gint type,
   }
 #endif
 
+  /* Add the columns that are missing from the column map first,
+   * as that may move the map.
+   */
+  for(i=0; i<col_count; i++) {
+    if(!column_list(db, sorted_cols[i], 0, 1))
+      return -1;
+  }
+
   /* Scan to the end of index chain for each column. If templates are used,
    * new indexes are inserted in between list elements to maintain
    * the chains sorted by number of fixed columns.
    */
   for(i=0; i<col_count; i++) {
     gint column = sorted_cols[i];
-    ilist[i] = &dbh->index_control_area_header.index_table[column];
+    ilist[i] = column_list(db, column, 0, 0);
     while(*(ilist[i])) {
       gcell *ilistelem = (gcell *) offsettoptr(db, *(ilist[i]));
 
@@ -2157,11 +3928,11 @@ gint wg_create_multi_index(void *db, gint *columns, gint col_count, gint type,
        * Note that this is simplified by having the column lists sorted.
        */
       if(!i && hdr->type==type && template_offset==hdr->template_offset &&\
-                                        hdr->fields==col_count) {
+                          hdr->fields==col_count && hdr->expr==expr) {
         gint j, match = 1;
         /* Compare the field lists */
         for(j=0; j<col_count; j++) {
-          if(hdr->rec_field_index[j] != sorted_cols[j]) {
+          if(hdr->rec_field_index[j] != key_cols[j]) {
             match = 0;
             break;
           }
@@ -2203,32 +3974,34 @@ gint wg_create_multi_index(void *db, gint *columns, gint col_count, gint type,
       }
     }
   }
-
-  /* Set up the header */
-  hdr = (wg_index_header *) offsettoptr(db, index_id);
-  hdr->type = type;
-  hdr->fields = col_count;
-  for(i=0; i < col_count; i++) {
-    hdr->rec_field_index[i] = sorted_cols[i];
-  }
-  hdr->template_offset = template_offset;
-
-  /* create the actual index */
-  switch(hdr->type) {
-    case WG_INDEX_TYPE_TTREE:
-      create_ttree_index(db, index_id);
-      break;
-    case WG_INDEX_TYPE_HASH:
-    case WG_INDEX_TYPE_HASH_JSON:
-      if(create_hash_index(db, index_id))
-        return -1;
-      break;
-    case WG_INDEX_TYPE_TTREE_JSON:
-      /* Return an error, until proper implementation exists */
-    default:
-      show_index_error(db, "Invalid index type");
-      return -1;
+
+  /* Set up the header */
+  hdr = (wg_index_header *) offsettoptr(db, index_id);
+  hdr->type = type;
+  hdr->fields = col_count;
+  for(i=0; i < col_count; i++) {
+    hdr->rec_field_index[i] = key_cols[i];
   }
+  hdr->template_offset = template_offset;
+  hdr->stats_offset = 0;
+  hdr->expr = expr;
+  hdr->pending = 0;
+  /* header memory may be reused, optional parts (like the Bloom
+   * filter of a hash index) must start empty */
+  memset(&(hdr->ctl), 0, sizeof(hdr->ctl));
+
+  return index_id;
+}
+
+/** Make a built index visible to queries and updates.
+ *
+ * returns 0 on success, -1 on error.
+ */
+static gint register_index(void *db, gint index_id, gint *matchrec,
+  gint reclen)
+{
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  db_memsegment_header* dbh = dbmemsegh(db);
 
   /* Add to master list */
   if(!insert_into_list(db,
@@ -2244,10 +4017,9 @@ gint wg_create_multi_index(void *db, gint *columns, gint col_count, gint type,
         /* No checking/sorting required here, so we can insert
          * the new element at the head of the list.
          */
-        if(!insert_into_list(db,
-          &(dbh->index_control_area_header.index_template_table[i]),
-          index_id))
-          return 0;
+        gint *tlist = column_list(db, i, 1, 1);
+        if(!tlist || !insert_into_list(db, tlist, index_id))
+          return -1;
       }
     }
   }
@@ -2256,13 +4028,60 @@ gint wg_create_multi_index(void *db, gint *columns, gint col_count, gint type,
   /* increase index counter */
   dbh->index_control_area_header.number_of_indexes++;
 #ifdef USE_INDEX_TEMPLATE
-  if(tmpl)
-    tmpl->refcount++;
+  if(hdr->template_offset)
+    ((wg_index_template *) offsettoptr(db, hdr->template_offset))->refcount++;
 #endif
 
   return 0;
 }
 
+/** Remove an index from the index lists of its columns.
+ */
+static void unlink_index_columns(void *db, wg_index_header *hdr,
+  gint index_id)
+{
+  gint *ilist;
+  gcell *ilistelem;
+  int i;
+
+  for(i=0; i<hdr->fields; i++) {
+    int column = hdr->rec_field_index[i];
+
+    ilist = column_list(db, column, 0, 0);
+    while(ilist && *ilist) {
+      ilistelem = (gcell *) offsettoptr(db, *ilist);
+      if(ilistelem->car == index_id) {
+        delete_from_list(db, ilist);
+        break;
+      }
+      ilist = &ilistelem->cdr;
+    }
+    release_map_column(db, column);
+  }
+}
+
+/** Remove the header of an index that could not be built.
+ *
+ * Undoes new_index_header() for an index that was not registered.
+ * The index structure itself must already be released.
+ */
+static void discard_index_header(void *db, gint index_id)
+{
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  db_memsegment_header* dbh = dbmemsegh(db);
+
+  unlink_index_columns(db, hdr, index_id);
+#ifdef USE_INDEX_TEMPLATE
+  if(hdr->template_offset) {
+    wg_index_template *tmpl = \
+      (wg_index_template *) offsettoptr(db, hdr->template_offset);
+    if(!tmpl->refcount)
+      remove_index_template(db, hdr->template_offset);
+  }
+#endif
+  wg_free_fixlen_object(db, &dbh->indexhdr_area_header, index_id);
+}
+
 
 /** Drop index by index id
 *
@@ -2277,6 +4096,10 @@ gint wg_drop_index(void *db, gint index_id){
   gcell *ilistelem;
   db_memsegment_header* dbh = dbmemsegh(db);
 
+  /* Deferred updates may refer to the index */
+  if(wg_flush_index_updates(db))
+    return -1;
+
   /* Locate the header */
   ilist = &dbh->index_control_area_header.index_list;
   while(*ilist) {
@@ -2296,19 +4119,7 @@ gint wg_drop_index(void *db, gint index_id){
   }
 
   /* Remove the index from index table */
-  for(i=0; i<hdr->fields; i++) {
-    int column = hdr->rec_field_index[i];
-
-    ilist = &dbh->index_control_area_header.index_table[column];
-    while(*ilist) {
-      ilistelem = (gcell *) offsettoptr(db, *ilist);
-      if(ilistelem->car == index_id) {
-        delete_from_list(db, ilist);
-        break;
-      }
-      ilist = &ilistelem->cdr;
-    }
-  }
+  unlink_index_columns(db, hdr, index_id);
 
 #ifdef USE_INDEX_TEMPLATE
   if(hdr->template_offset) {
@@ -2321,8 +4132,8 @@ gint wg_drop_index(void *db, gint index_id){
     for(i=0; i<reclen; i++) {
       if(wg_get_encoded_type(db,
         wg_get_field(db, matchrec, i)) != WG_VARTYPE) {
-        ilist = &dbh->index_control_area_header.index_template_table[i];
-        while(*ilist) {
+        ilist = column_list(db, i, 1, 0);
+        while(ilist && *ilist) {
           ilistelem = (gcell *) offsettoptr(db, *ilist);
           if(ilistelem->car == index_id) {
             delete_from_list(db, ilist);
@@ -2330,6 +4141,7 @@ gint wg_drop_index(void *db, gint index_id){
           }
           ilist = &ilistelem->cdr;
         }
+        release_map_column(db, i);
       }
     }
   }
@@ -2347,6 +4159,26 @@ gint wg_drop_index(void *db, gint index_id){
       if(drop_hash_index(db, index_id))
         return -1;
       break;
+    case WG_INDEX_TYPE_BTREE:
+      if(drop_btree_index(db, index_id))
+        return -1;
+      break;
+    case WG_INDEX_TYPE_BITMAP:
+      if(drop_bitmap_index(db, index_id))
+        return -1;
+      break;
+    case WG_INDEX_TYPE_FULLTEXT:
+      if(drop_fulltext_index(db, index_id))
+        return -1;
+      break;
+    case WG_INDEX_TYPE_RTREE:
+      if(drop_rtree_index(db, index_id))
+        return -1;
+      break;
+    case WG_INDEX_TYPE_JSON_PATH:
+      if(drop_jsonpath_index(db, index_id))
+        return -1;
+      break;
     default:
       show_index_error(db, "Invalid index type");
       return -1;
@@ -2361,6 +4193,8 @@ gint wg_drop_index(void *db, gint index_id){
   }
 #endif
 
+  wg_stats_free(db, hdr);
+
   /* Now free the header */
   wg_free_fixlen_object(db, &dbh->indexhdr_area_header, index_id);
 
@@ -2384,21 +4218,71 @@ gint wg_column_to_index_id(void *db, gint column, gint type,
 * Supports all types of indexes, calling program should examine the
 * header of returned index to decide how to proceed. Alternatively,
 * if type is not 0 then only indexes of the given type are
-* returned.
+* returned. The columns of a B-tree index must be given in the
+* key order, for the other types the order does not matter.
 *
 * If matchrec is NULL, "full" index is returned. Otherwise
 * the function attempts to locate a matching template.
 *
+*  Expression indexes are found with wg_expr_to_index_id().
+*
 *  returns:
 *  -1 if no index found
 *  offset > 0 if index found - index id
 */
 gint wg_multi_column_to_index_id(void *db, gint *columns, gint col_count,
   gint type, gint *matchrec, gint reclen)
+{
+  return find_index_id(db, columns, col_count, type, 0, matchrec, reclen);
+}
+
+/** Find the id of an expression index
+*  The index on the column with the expression expr is returned,
+*  see wg_create_expr_index().
+*
+*  returns:
+*  -1 if no index found
+*  offset > 0 if index found - index id
+*/
+gint wg_expr_to_index_id(void *db, gint column, gint expr,
+  gint *matchrec, gint reclen)
+{
+  return find_index_id(db, &column, 1, WG_INDEX_TYPE_HASH, expr,
+    matchrec, reclen);
+}
+
+/** Find the id of a JSON path index
+*  see wg_create_json_path_index().
+*
+*  returns:
+*  -1 if no index found
+*  offset > 0 if index found - index id
+*/
+gint wg_json_path_to_index_id(void *db, char *path)
+{
+  gint ilist = dbmemsegh(db)->index_control_area_header.index_list;
+
+  while(ilist) {
+    gcell *ilistelem = (gcell *) offsettoptr(db, ilist);
+    wg_index_header *hdr = \
+      (wg_index_header *) offsettoptr(db, ilistelem->car);
+    if(hdr->type == WG_INDEX_TYPE_JSON_PATH &&\
+      !strcmp((char *) offsettoptr(db, hdr->ctl.p.path_offset), path))
+      return ilistelem->car;
+    ilist = ilistelem->cdr;
+  }
+  return -1;
+}
+
+/** Find index id by column(s), type and expression
+*  type 0 matches any type, expr must be equal (0 if the
+*  index has no expression).
+*/
+static gint find_index_id(void *db, gint *columns, gint col_count,
+  gint type, gint expr, gint *matchrec, gint reclen)
 {
   int i;
   gint template_offset = 0;
-  db_memsegment_header* dbh = dbmemsegh(db);
   gint *ilist;
   gcell *ilistelem;
   gint sorted_cols[MAX_INDEX_FIELDS];
@@ -2411,12 +4295,6 @@ gint wg_multi_column_to_index_id(void *db, gint *columns, gint col_count,
       return -1;
     }
 
-    if(reclen > MAX_INDEXED_FIELDNR+1) {
-      show_index_error_nr(db, "Match record too long, max",
-        MAX_INDEXED_FIELDNR+1);
-      return -1;
-    }
-
     template_offset = find_index_template(db, matchrec, reclen);
     if(!template_offset) {
       /* No matching template */
@@ -2444,17 +4322,9 @@ gint wg_multi_column_to_index_id(void *db, gint *columns, gint col_count,
     sorted_cols[0] = columns[0];
   }
 
-  for(i=0; i<col_count; i++) {
-    if(sorted_cols[i] > MAX_INDEXED_FIELDNR) {
-      show_index_error_nr(db, "Max allowed column number",
-        MAX_INDEXED_FIELDNR);
-      return -1;
-    }
-  }
-
   /* Find all indexes on the first column */
-  ilist = &dbh->index_control_area_header.index_table[sorted_cols[0]];
-  while(*ilist) {
+  ilist = column_list(db, sorted_cols[0], 0, 0);
+  while(ilist && *ilist) {
     ilistelem = (gcell *) offsettoptr(db, *ilist);
     if(ilistelem->car) {
       wg_index_header *hdr = \
@@ -2465,9 +4335,12 @@ gint wg_multi_column_to_index_id(void *db, gint *columns, gint col_count,
       if((!type || type==hdr->type) &&\
          hdr->template_offset == template_offset) {
 #endif
-        if(hdr->fields == col_count) {
+        if(hdr->fields == col_count && hdr->expr == expr) {
+          /* the columns of a B-tree are in the key order */
+          gint *cols = (hdr->type == WG_INDEX_TYPE_BTREE ?
+            columns : sorted_cols);
           for(i=0; i<col_count; i++) {
-            if(hdr->rec_field_index[i]!=sorted_cols[i])
+            if(hdr->rec_field_index[i]!=cols[i])
               goto nextindex;
           }
           return ilistelem->car; /* index id */
@@ -2579,6 +4452,7 @@ void * wg_get_all_indexes(void *db, gint *count) {
   db_memsegment_header* dbh = dbmemsegh(db);
   gint *ilist;
   gint *res;
+  wg_index_column *map;
 
   *count = 0;
   if(!dbh->index_control_area_header.number_of_indexes) {
@@ -2593,8 +4467,14 @@ void * wg_get_all_indexes(void *db, gint *count) {
     return NULL;
   }
 
-  for(column=0; column<=MAX_INDEXED_FIELDNR; column++) {
-    ilist = &dbh->index_control_area_header.index_table[column];
+  map = (wg_index_column *) offsettoptr(db,
+    dbh->index_control_area_header.column_map);
+  for(column=0; column<=MAX_INDEXED_FIELDNR+\
+    dbh->index_control_area_header.column_map_count; column++) {
+    if(column <= MAX_INDEXED_FIELDNR)
+      ilist = &dbh->index_control_area_header.index_table[column];
+    else /* the rest are in the column map */
+      ilist = &map[column-MAX_INDEXED_FIELDNR-1].index_list;
     while(*ilist) {
       gcell *ilistelem = (gcell *) offsettoptr(db, *ilist);
       if(ilistelem->car) {
@@ -2612,6 +4492,256 @@ void * wg_get_all_indexes(void *db, gint *count) {
   return res;
 }
 
+/** Collect the statistics of an index for the query planner
+*  Builds the histogram of the first indexed column and the estimate
+*  of distinct keys from the rows in the index. After that, the
+*  row count and the distinct estimate follow the inserts and
+*  deletes. Call again to refresh the histogram.
+*  Only T-tree and B-tree indexes have statistics.
+*
+*  returns 0 on success, -1 on error.
+*/
+gint wg_analyze_index(void *db, gint index_id) {
+  wg_index_header *hdr = NULL;
+  gint *ilist;
+  gcell *ilistelem;
+  db_memsegment_header* dbh = dbmemsegh(db);
+
+  /* Locate the header */
+  ilist = &dbh->index_control_area_header.index_list;
+  while(*ilist) {
+    ilistelem = (gcell *) offsettoptr(db, *ilist);
+    if(ilistelem->car == index_id) {
+      hdr = (wg_index_header *) offsettoptr(db, index_id);
+      break;
+    }
+    ilist = &ilistelem->cdr;
+  }
+
+  if(!hdr) {
+    show_index_error_nr(db, "Invalid index for analyze", index_id);
+    return -1;
+  }
+  if(hdr->type != WG_INDEX_TYPE_TTREE && hdr->type != WG_INDEX_TYPE_BTREE) {
+    show_index_error(db, "Only T-tree and B-tree indexes can be analyzed");
+    return -1;
+  }
+  return analyze_index(db, hdr);
+}
+
+/** Collect the statistics of all T-tree and B-tree indexes
+*
+*  returns 0 on success, -1 on error.
+*/
+gint wg_analyze(void *db) {
+  gint *ilist;
+  gcell *ilistelem;
+  db_memsegment_header* dbh = dbmemsegh(db);
+
+  ilist = &dbh->index_control_area_header.index_list;
+  while(*ilist) {
+    wg_index_header *hdr;
+    ilistelem = (gcell *) offsettoptr(db, *ilist);
+    hdr = (wg_index_header *) offsettoptr(db, ilistelem->car);
+    if(hdr->type == WG_INDEX_TYPE_TTREE || hdr->type == WG_INDEX_TYPE_BTREE) {
+      if(analyze_index(db, hdr))
+        return -1;
+    }
+    ilist = &ilistelem->cdr;
+  }
+  return 0;
+}
+
+/** Get the statistics of an index
+*  rows is set to the number of rows in the index and distinct
+*  to the estimated number of distinct keys.
+*
+*  returns 0 on success, -1 if the index is not found or has not
+*  been analyzed.
+*/
+gint wg_get_index_stats(void *db, gint index_id, gint *rows,
+  gint *distinct) {
+  wg_index_header *hdr = NULL;
+  gint *ilist;
+  gcell *ilistelem;
+  wg_index_stats *stats;
+  db_memsegment_header* dbh = dbmemsegh(db);
+
+  /* Locate the header */
+  ilist = &dbh->index_control_area_header.index_list;
+  while(*ilist) {
+    ilistelem = (gcell *) offsettoptr(db, *ilist);
+    if(ilistelem->car == index_id) {
+      hdr = (wg_index_header *) offsettoptr(db, index_id);
+      break;
+    }
+    ilist = &ilistelem->cdr;
+  }
+
+  if(!hdr || !hdr->stats_offset)
+    return -1;
+  /* The statistics follow the rows in the index */
+  if(wg_flush_index_updates(db))
+    return -1;
+  stats = (wg_index_stats *) offsettoptr(db, hdr->stats_offset);
+  *rows = stats->rows;
+  *distinct = wg_stats_distinct(db, stats);
+  return 0;
+}
+
+/** Add a Bloom filter to a hash index
+*  bits_per_key is the size of the filter, 0 uses the default (12
+*  bits, about 0.5% false positives). Searches for keys that are
+*  not in the index are then mostly answered by the filter, without
+*  reading the hash chains.
+*
+*  The filter grows with the index. Removed keys are not cleared
+*  from the filter; calling this again rebuilds the filter from the
+*  keys in the index and resets the statistics.
+*  returns 0 on success, -1 on error.
+*/
+gint wg_create_bloom_filter(void *db, gint index_id, gint bits_per_key) {
+  wg_index_header *hdr;
+  gint type;
+
+#ifdef CHECK
+  if (!dbcheck(db)) {
+    show_index_error(db, "Invalid database pointer in "\
+      "wg_create_bloom_filter");
+    return -1;
+  }
+#endif
+  type = wg_get_index_type(db, index_id);
+  if(type < 0)
+    return -1;
+  if(type != WG_INDEX_TYPE_HASH && type != WG_INDEX_TYPE_HASH_JSON)
+    return show_index_error(db, "Bloom filter requires a hash index");
+  hdr = (wg_index_header *) offsettoptr(db, index_id);
+  return wg_idxhash_bloom_create(db, HASHIDX_ARRAYP(hdr),
+    &(hdr->ctl.h.bloom), bits_per_key);
+}
+
+/** Remove the Bloom filter of a hash index
+*  returns 0 on success, -1 on error.
+*/
+gint wg_drop_bloom_filter(void *db, gint index_id) {
+  wg_index_header *hdr;
+
+#ifdef CHECK
+  if (!dbcheck(db)) {
+    show_index_error(db, "Invalid database pointer in "\
+      "wg_drop_bloom_filter");
+    return -1;
+  }
+#endif
+  if(wg_get_index_type(db, index_id) < 0)
+    return -1;
+  hdr = (wg_index_header *) offsettoptr(db, index_id);
+  if(!HASHIDX_HAS_BLOOM(hdr))
+    return show_index_error(db, "Index has no Bloom filter");
+  wg_idxhash_bloom_free(db, &(hdr->ctl.h.bloom));
+  return 0;
+}
+
+/** Get the statistics of the Bloom filter of a hash index
+*  lookups is set to the number of searches checked against the
+*  filter, negatives to those the filter answered (the key was
+*  not in the index) and false_positives to those the filter passed,
+*  but the key was not found. The false positive rate is
+*  false_positives / (negatives + false_positives).
+*  The counts are approximate if several readers search at once.
+*
+*  returns 0 on success, -1 if the index is not found or has no
+*  filter.
+*/
+gint wg_get_bloom_stats(void *db, gint index_id, gint *lookups,
+  gint *negatives, gint *false_positives) {
+  wg_index_header *hdr;
+  db_bloom_header *bf;
+
+  if(wg_get_index_type(db, index_id) < 0)
+    return -1;
+  hdr = (wg_index_header *) offsettoptr(db, index_id);
+  if(!HASHIDX_HAS_BLOOM(hdr))
+    return -1;
+  bf = &(hdr->ctl.h.bloom);
+  *lookups = bf->lookups;
+  *negatives = bf->negatives;
+  *false_positives = bf->false_positives;
+  return 0;
+}
+
+/** Find the best matching rows with a full-text index
+*  text - terms to search for, tokenized like the indexed values
+*  mode - WG_FULLTEXT_AND: rows must contain all the terms
+*         WG_FULLTEXT_OR: rows must contain any of the terms
+*  k - size of the rows and scores arrays
+*
+*  Rows are ranked by BM25 weights of the terms they contain.
+*  The best k rows are stored in rows, the best first, and their
+*  scores in scores (may be NULL).
+*  returns the number of rows found, -1 on error.
+*/
+gint wg_fulltext_search(void *db, gint index_id, char *text, gint mode,
+  gint k, void **rows, double *scores) {
+  wg_index_header *hdr = NULL;
+  gint *ilist;
+  gcell *ilistelem;
+  db_memsegment_header* dbh = dbmemsegh(db);
+
+#ifdef CHECK
+  if (!dbcheck(db)) {
+    show_index_error(db, "Invalid database pointer in wg_fulltext_search");
+    return -1;
+  }
+#endif
+  /* Locate the header */
+  ilist = &dbh->index_control_area_header.index_list;
+  while(*ilist) {
+    ilistelem = (gcell *) offsettoptr(db, *ilist);
+    if(ilistelem->car == index_id) {
+      hdr = (wg_index_header *) offsettoptr(db, index_id);
+      break;
+    }
+    ilist = &ilistelem->cdr;
+  }
+
+  if(!hdr || hdr->type != WG_INDEX_TYPE_FULLTEXT) {
+    show_index_error_nr(db, "Not a full-text index", index_id);
+    return -1;
+  }
+  if(!text || k < 1 || !rows ||\
+    (mode != WG_FULLTEXT_AND && mode != WG_FULLTEXT_OR)) {
+    show_index_error(db, "Invalid full-text search arguments");
+    return -1;
+  }
+  if(check_index_rows(db, hdr))
+    return -1;
+  return wg_fulltext_rank(db, hdr, text, mode, k, rows, scores);
+}
+
+/** Build the statistics from the sorted keys of an index
+*  returns 0 on success, -1 on error.
+*/
+static gint analyze_index(void *db, wg_index_header *hdr) {
+  wg_index_entry *entries;
+  gint count, err;
+
+  /* The row count is taken from the data, deferred rows would be
+   * counted twice */
+  if(wg_flush_index_updates(db))
+    return -1;
+  entries = collect_index_entries(db, hdr, &count);
+  if(!entries && count) {
+    show_index_error(db, "Failed to allocate memory");
+    return -1;
+  }
+  err = wg_stats_build(db, hdr, entries, count);
+  if(entries)
+    free(entries);
+  return err;
+}
+
 #define INDEX_ADD_ROW(d, h, i, r) \
   switch(h->type) { \
     case WG_INDEX_TYPE_TTREE: \
@@ -2624,8 +4754,24 @@ void * wg_get_all_indexes(void *db, gint *count) {
           return -2; \
       } \
       break; \
-    case WG_INDEX_TYPE_HASH: \
-      if(hash_add_row(d, i, r)) \
+    case WG_INDEX_TYPE_HASH: \
+      if(hash_add_row(d, i, r)) \
+        return -2; \
+      break; \
+    case WG_INDEX_TYPE_BTREE: \
+      if(btree_add_row(d, i, r)) \
+        return -2; \
+      break; \
+    case WG_INDEX_TYPE_BITMAP: \
+      if(bitmap_add_row(d, i, r)) \
+        return -2; \
+      break; \
+    case WG_INDEX_TYPE_FULLTEXT: \
+      if(fulltext_add_row(d, i, r)) \
+        return -2; \
+      break; \
+    case WG_INDEX_TYPE_RTREE: \
+      if(rtree_add_row(d, i, r)) \
         return -2; \
       break; \
     case WG_INDEX_TYPE_HASH_JSON: \
@@ -2637,7 +4783,9 @@ void * wg_get_all_indexes(void *db, gint *count) {
     default: \
       show_index_error(db, "unknown index type, ignoring"); \
       break; \
-  }
+  } \
+  if(h->stats_offset) \
+    wg_stats_add_row(d, h, r);
 
 #define INDEX_REMOVE_ROW(d, h, i, r) \
   switch(h->type) { \
@@ -2655,6 +4803,19 @@ void * wg_get_all_indexes(void *db, gint *count) {
       if(hash_remove_row(d, i, r) < -2) \
         return -2; \
       break; \
+    case WG_INDEX_TYPE_BTREE: \
+      btree_remove_row(d, i, r); /* missing row is not an error */ \
+      break; \
+    case WG_INDEX_TYPE_BITMAP: \
+      bitmap_remove_row(d, i, r); /* missing row is not an error */ \
+      break; \
+    case WG_INDEX_TYPE_FULLTEXT: \
+      fulltext_remove_row(d, i, r); /* rows without terms are not indexed */ \
+      break; \
+    case WG_INDEX_TYPE_RTREE: \
+      if(rtree_remove_row(d, i, r)) \
+        return -2; \
+      break; \
     case WG_INDEX_TYPE_HASH_JSON: \
       if(is_plain_record(r)) { \
         if(hash_remove_row(d, i, r) < -2) \
@@ -2664,7 +4825,338 @@ void * wg_get_all_indexes(void *db, gint *count) {
     default: \
       show_index_error(db, "unknown index type, ignoring"); \
       break; \
+  } \
+  if(h->stats_offset) \
+    wg_stats_remove_row(d, h, r);
+
+/** Add a row to an index
+ *  returns 0 on success, -2 on error
+ */
+static gint add_index_row(void *db, wg_index_header *hdr, gint index_id,
+  void *rec) {
+  INDEX_ADD_ROW(db, hdr, index_id, rec)
+  return 0;
+}
+
+/** Add a row to an index after a field update
+ *  When the index updates are deferred, the row is only
+ *  remembered and added with its values at that time.
+ *  returns 0 on success, -2 on error
+ */
+static gint add_field_row(void *db, wg_index_header *hdr, gint index_id,
+  void *rec) {
+  index_delta *delta = INDEX_DELTA(db);
+
+  if(delta) {
+    gint added = delta_add_row(db, delta, index_id, ptrtooffset(db, rec));
+    if(added)
+      hdr->pending++; /* missing from the index until applied */
+    if(added < 0)
+      return -2;
+    return 0;
+  }
+  return add_index_row(db, hdr, index_id, rec);
+}
+
+/** Remove a row from an index before a field update
+ *  When the index updates are deferred, a row that is waiting to be
+ *  added is not in the index. Otherwise it is removed and remembered,
+ *  and whether it still belongs to the index is checked when the
+ *  updates are applied. The index counts the rows it is missing
+ *  until then, so that the other handles know not to use it.
+ *  returns 0 on success, -2 on error
+ */
+static gint remove_field_row(void *db, wg_index_header *hdr, gint index_id,
+  void *rec) {
+  index_delta *delta = INDEX_DELTA(db);
+
+  if(delta && delta->slots[delta_slot(delta, index_id,
+    ptrtooffset(db, rec))])
+    return 0;
+  INDEX_REMOVE_ROW(db, hdr, index_id, rec)
+  if(delta) {
+    hdr->pending++;
+    if(delta_add_row(db, delta, index_id, ptrtooffset(db, rec)) < 0)
+      return -2;
+  }
+  return 0;
+}
+
+/** Find the slot of a row of an index in the deferred updates
+ *  returns the slot of the entry, or the free slot where it belongs.
+ */
+static gint delta_slot(index_delta *delta, gint index_id, gint rec) {
+  wg_uint mask = (wg_uint) delta->size * 2 - 1;
+  wg_uint h = (wg_uint) rec * 2654435761UL + (wg_uint) index_id;
+
+  h ^= h >> 15;
+  h *= 2246822519UL;
+  h ^= h >> 13;
+  h &= mask;
+  while(delta->slots[h]) {
+    index_delta_entry *e = &delta->entries[delta->slots[h] - 1];
+    if(e->index_id == index_id && e->rec == rec)
+      break;
+    h = (h + 1) & mask;
+  }
+  return (gint) h;
+}
+
+/** Add a row of an index to the deferred updates
+ *  A row that is already there is not added twice.
+ *  returns 1 if the row was added, 0 if it was already there,
+ *  -1 on error
+ */
+static gint delta_add_row(void *db, index_delta *delta, gint index_id,
+  gint rec) {
+  gint slot = delta_slot(delta, index_id, rec);
+
+  if(delta->slots[slot])
+    return 0;
+  if(delta->count >= delta->size) {
+    /* Grow the entries and rebuild the slots */
+    gint i, size = delta->size * 2;
+    index_delta_entry *entries = (index_delta_entry *) realloc(
+      delta->entries, size * sizeof(index_delta_entry));
+    gint *slots;
+    if(!entries) {
+      show_index_error(db, "Failed to allocate memory");
+      return -1;
+    }
+    delta->entries = entries;
+    slots = (gint *) calloc(size * 2, sizeof(gint));
+    if(!slots) {
+      show_index_error(db, "Failed to allocate memory");
+      return -1;
+    }
+    free(delta->slots);
+    delta->slots = slots;
+    delta->size = size;
+    for(i=0; i<delta->count; i++)
+      slots[delta_slot(delta, entries[i].index_id, entries[i].rec)] = i + 1;
+    slot = delta_slot(delta, index_id, rec);
+  }
+  delta->entries[delta->count].index_id = index_id;
+  delta->entries[delta->count].rec = rec;
+  delta->slots[slot] = ++delta->count;
+  return 1;
+}
+
+/** Order the deferred updates by index, then by row
+ */
+static int compare_delta_entries(const void *a, const void *b) {
+  const index_delta_entry *ea = (const index_delta_entry *) a;
+  const index_delta_entry *eb = (const index_delta_entry *) b;
+
+  if(ea->index_id != eb->index_id)
+    return (ea->index_id < eb->index_id ? -1 : 1);
+  if(ea->rec != eb->rec)
+    return (ea->rec < eb->rec ? -1 : 1);
+  return 0;
+}
+
+/** Add the rows of the deferred updates to their indexes
+ *  The rows are checked against the index again, as their values
+ *  may have changed after they were removed. The rows of an ordered
+ *  index are added in key order, so that the inserts walk the tree
+ *  from one end to the other instead of jumping around. The deferred
+ *  updates are empty afterwards. An index is only cleared of its
+ *  missing rows once all its rows are added, if that fails, it stays
+ *  out of date (see wg_get_index_pending()).
+ *  returns 0 on success, -2 on error (the indexes are not consistent)
+ */
+static gint apply_index_delta(void *db, index_delta *delta) {
+  wg_index_entry *rows, *tmp = NULL;
+  gint i, j, start, retv = 0;
+
+  if(!delta->count)
+    return 0;
+  qsort(delta->entries, delta->count, sizeof(index_delta_entry),
+    compare_delta_entries);
+
+  /* Without the sort buffers the rows are added in offset order */
+  rows = (wg_index_entry *) malloc(delta->count * 2 * sizeof(wg_index_entry));
+  if(rows)
+    tmp = rows + delta->count;
+
+  for(start=0; start<delta->count && !retv; start=i) {
+    gint index_id = delta->entries[start].index_id;
+    wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+    gint n = 0;
+
+    for(i=start; i<delta->count &&\
+      delta->entries[i].index_id == index_id; i++) {
+      void *rec = offsettoptr(db, delta->entries[i].rec);
+      if(retv)
+        continue;
+      if(wg_get_record_len(db, rec) <= last_index_column(hdr))
+        continue;
+      if(!MATCH_TEMPLATE(db, hdr, rec))
+        continue;
+      if(rows) {
+        rows[n].key = wg_get_field(db, rec, hdr->rec_field_index[0]);
+        rows[n].rec = delta->entries[i].rec;
+        n++;
+      } else if(add_index_row(db, hdr, index_id, rec)) {
+        retv = -2;
+      }
+    }
+
+    if(n > 1 && ORDERED_INDEX(hdr->type))
+      sort_index_entries(db, hdr, rows, tmp, n);
+    for(j=0; j<n; j++) {
+      if(add_index_row(db, hdr, index_id, offsettoptr(db, rows[j].rec))) {
+        retv = -2;
+        break;
+      }
+    }
+    if(!retv)
+      hdr->pending -= i - start;
+  }
+
+  if(rows)
+    free(rows);
+  memset(delta->slots, 0, delta->size * 2 * sizeof(gint));
+  delta->count = 0;
+  return retv;
+}
+
+/** Check that an index has all its rows before searching it
+ *  The deferred updates of this handle are applied first.
+ *  returns 0 if the index can be searched, -1 otherwise
+ */
+static gint check_index_rows(void *db, wg_index_header *hdr) {
+  if(wg_flush_index_updates(db))
+    return -1;
+  if(hdr->pending) {
+    show_index_error_nr(db, "Rows missing from the index:", hdr->pending);
+    return -1;
+  }
+  return 0;
+}
+
+/** Defer the index updates of field changes
+ *  With a non-0 on, the rows changed by wg_set_field() and related
+ *  functions on this database handle are removed from their indexes
+ *  at the first change, and added back with their final values
+ *  when the updates are applied. Updating the same row many times,
+ *  or several columns of a multi-column index, costs one removal and
+ *  one insert. The updates are applied by wg_end_write(),
+ *  wg_flush_index_updates(), wg_detach_database(), before a record is
+ *  deleted or an index dropped, and before the queries,
+ *  wg_search_ttree_index(), wg_search_hash(), wg_search_json_path()
+ *  and wg_get_index_stats() of this handle use the indexes. The
+ *  T-tree node searches (wg_search_ttree_leftmost() etc.) do not
+ *  apply them, call wg_flush_index_updates() first.
+ *  The indexes count the rows they are missing until then. Queries
+ *  do not use such indexes and the index search functions fail on
+ *  them, so other handles do not get incomplete results. The rows
+ *  are only kept in the memory of this process: if it exits without
+ *  applying them, or applying them fails, the count stays above 0
+ *  (see wg_get_index_pending()) and the index must be dropped and
+ *  created again.
+ *  With on == 0, the deferred updates are applied and the updates
+ *  are made immediately again.
+ *  returns 0 on success, -1 on error, -2 if applying the updates
+ *  failed (the indexes are not consistent)
+ */
+gint wg_defer_index_updates(void *db, gint on) {
+#ifdef USE_DATABASE_HANDLE
+  db_handle *dbh = (db_handle *) db;
+  index_delta *delta;
+
+#ifdef CHECK
+  if (!dbcheck(db)) {
+    show_index_error(db, "wrong database pointer given to wg_defer_index_updates");
+    return -1;
+  }
+#endif
+
+  if(!on) {
+    gint err = wg_flush_index_updates(db);
+    wg_index_free_delta(db);
+    return err;
+  }
+  if(dbh->indexdelta)
+    return 0;
+  delta = (index_delta *) malloc(sizeof(index_delta));
+  if(!delta) {
+    show_index_error(db, "Failed to allocate memory");
+    return -1;
+  }
+  delta->count = 0;
+  delta->size = INDEX_DELTA_SIZE;
+  delta->entries = (index_delta_entry *) malloc(
+    delta->size * sizeof(index_delta_entry));
+  delta->slots = (gint *) calloc(delta->size * 2, sizeof(gint));
+  if(!delta->entries || !delta->slots) {
+    if(delta->entries)
+      free(delta->entries);
+    if(delta->slots)
+      free(delta->slots);
+    free(delta);
+    show_index_error(db, "Failed to allocate memory");
+    return -1;
+  }
+  dbh->indexdelta = delta;
+  return 0;
+#else
+  show_index_error(db, "Deferred index updates need database handles");
+  return -1;
+#endif
+}
+
+/** Apply the deferred index updates
+ *  The updates stay deferred, see wg_defer_index_updates().
+ *  returns 0 on success, -1 on error, -2 if applying the updates
+ *  failed (the indexes are not consistent)
+ */
+gint wg_flush_index_updates(void *db) {
+  index_delta *delta = INDEX_DELTA(db);
+
+  if(!delta || !delta->count)
+    return 0;
+  return apply_index_delta(db, delta);
+}
+
+/** Check if a handle has deferred index updates to apply
+ *  returns the number of rows waiting in the updates
+ */
+gint wg_index_delta_rows(void *db) {
+  index_delta *delta = INDEX_DELTA(db);
+
+  return (delta ? delta->count : 0);
+}
+
+/** Get the number of rows missing from an index
+ *  Rows are missing while their updates are deferred, on this or
+ *  another handle (see wg_defer_index_updates()). A count that stays
+ *  above 0 after the updates are applied means that they were lost
+ *  or failed; the index is not used until it is created again.
+ *  returns the number of rows, -1 if the index is not found
+ */
+gint wg_get_index_pending(void *db, gint index_id) {
+  if(wg_get_index_type(db, index_id) < 0) /* validates the id */
+    return -1;
+  return ((wg_index_header *) offsettoptr(db, index_id))->pending;
+}
+
+/** Free the deferred index updates of a database handle
+ *  Updates that were not applied are discarded, the indexes keep
+ *  counting their rows as missing.
+ */
+void wg_index_free_delta(void *db) {
+#ifdef USE_DATABASE_HANDLE
+  index_delta *delta = INDEX_DELTA(db);
+
+  if(delta) {
+    free(delta->entries);
+    free(delta->slots);
+    free(delta);
+    ((db_handle *) db)->indexdelta = NULL;
   }
+#endif
+}
 
 /** Add data of one field to all indexes
  * Loops over indexes in one field and inserts the data into
@@ -2676,12 +5168,11 @@ void * wg_get_all_indexes(void *db, gint *count) {
 gint wg_index_add_field(void *db, void *rec, gint column) {
   gint *ilist;
   gcell *ilistelem;
-  db_memsegment_header* dbh = dbmemsegh(db);
   gint reclen = wg_get_record_len(db, rec);
 
 #ifdef CHECK
   /* XXX: if used from wg_set_field() only, this is redundant */
-  if(column > MAX_INDEXED_FIELDNR || column >= reclen)
+  if(column >= reclen)
     return -1;
   if(is_special_record(rec))
     return -1;
@@ -2689,19 +5180,20 @@ gint wg_index_add_field(void *db, void *rec, gint column) {
 
 #if 0
   /* XXX: if used from wg_set_field() only, this is redundant */
-  if(!dbh->index_control_area_header.index_table[column])
+  if(!COLUMN_INDEXED(db, column))
     return -1;
 #endif
 
-  ilist = &dbh->index_control_area_header.index_table[column];
-  while(*ilist) {
+  ilist = column_list(db, column, 0, 0);
+  while(ilist && *ilist) {
     ilistelem = (gcell *) offsettoptr(db, *ilist);
     if(ilistelem->car) {
       wg_index_header *hdr = \
         (wg_index_header *) offsettoptr(db, ilistelem->car);
-      if(reclen > hdr->rec_field_index[hdr->fields - 1]) {
+      if(reclen > last_index_column(hdr)) {
         if(MATCH_TEMPLATE(db, hdr, rec)) {
-          INDEX_ADD_ROW(db, hdr, ilistelem->car, rec)
+          if(add_field_row(db, hdr, ilistelem->car, rec))
+            return -2;
         }
       }
     }
@@ -2713,15 +5205,16 @@ gint wg_index_add_field(void *db, void *rec, gint column) {
    * records. The current record may have become compatible
    * with their template.
    */
-  ilist = &dbh->index_control_area_header.index_template_table[column];
-  while(*ilist) {
+  ilist = column_list(db, column, 1, 0);
+  while(ilist && *ilist) {
     ilistelem = (gcell *) offsettoptr(db, *ilist);
     if(ilistelem->car) {
       wg_index_header *hdr = \
         (wg_index_header *) offsettoptr(db, ilistelem->car);
-      if(reclen > hdr->rec_field_index[hdr->fields - 1]) {
+      if(reclen > last_index_column(hdr)) {
         if(MATCH_TEMPLATE(db, hdr, rec)) {
-          INDEX_ADD_ROW(db, hdr, ilistelem->car, rec)
+          if(add_field_row(db, hdr, ilistelem->car, rec))
+            return -2;
         }
       }
     }
@@ -2732,6 +5225,86 @@ gint wg_index_add_field(void *db, void *rec, gint column) {
   return 0;
 }
 
+/** Add data of one record to the indexes of one column
+ * See wg_index_add_rec().
+ * returns 0 on success, -2 on error
+ */
+static gint add_rec_column(void *db, void *rec, gint reclen, gint column) {
+  gint *ilist;
+  gcell *ilistelem;
+
+  /* Find all indexes on the column */
+  ilist = column_list(db, column, 0, 0);
+  while(ilist && *ilist) {
+    ilistelem = (gcell *) offsettoptr(db, *ilist);
+    if(ilistelem->car) {
+      wg_index_header *hdr = \
+        (wg_index_header *) offsettoptr(db, ilistelem->car);
+      if(last_index_column(hdr) == column) {
+        /* Only add the record if we're at the last column
+         * of the index. This way we ensure that a.) a record
+         * is entered once into a multi-column index and b.) the
+         * record is long enough so that it qualifies for the
+         * multi-column index.
+         * For a single-column index, the indexed column is
+         * also the last column, therefore the above is valid,
+         * altough the check is unnecessary.
+         */
+        if(MATCH_TEMPLATE(db, hdr, rec)) {
+          INDEX_ADD_ROW(db, hdr, ilistelem->car, rec)
+        }
+      }
+    }
+    ilist = &ilistelem->cdr;
+  }
+
+#ifdef USE_INDEX_TEMPLATE
+  ilist = column_list(db, column, 1, 0);
+  while(ilist && *ilist) {
+    ilistelem = (gcell *) offsettoptr(db, *ilist);
+    if(ilistelem->car) {
+      wg_index_header *hdr = \
+        (wg_index_header *) offsettoptr(db, ilistelem->car);
+      wg_index_template *tmpl = \
+        (wg_index_template *) offsettoptr(db, hdr->template_offset);
+      void *matchrec;
+      gint mreclen;
+      int j, firstmatch = -1;
+
+      /* Here the check for a match is slightly more complicated.
+       * If there is a match *but* the current column is not the
+       * first fixed one in the template, the match has
+       * already occurred earlier.
+       */
+      matchrec = offsettoptr(db, tmpl->offset_matchrec);
+      mreclen = wg_get_record_len(db, matchrec);
+      if(mreclen > reclen) {
+        goto nexttmpl1;
+      }
+      for(j=0; j<mreclen; j++) {
+        gint enc = wg_get_field(db, matchrec, j);
+        if(wg_get_encoded_type(db, enc) != WG_VARTYPE) {
+          if(WG_COMPARE(db, enc, wg_get_field(db, rec, j)) != WG_EQUAL)
+            goto nexttmpl1;
+          if(firstmatch < 0)
+            firstmatch = j;
+        }
+      }
+      if(firstmatch==column &&\
+        reclen > last_index_column(hdr)) {
+        /* The record matches AND this is the first time we
+         * see this index. Update it.
+         */
+        INDEX_ADD_ROW(db, hdr, ilistelem->car, rec)
+      }
+    }
+nexttmpl1:
+    ilist = &ilistelem->cdr;
+  }
+#endif
+  return 0;
+}
+
 /** Add data of one record to all indexes
  * Convinience function to add an entire record into
  * all indexes in the database.
@@ -2742,89 +5315,29 @@ gint wg_index_add_rec(void *db, void *rec) {
   gint i;
   db_memsegment_header* dbh = dbmemsegh(db);
   gint reclen = wg_get_record_len(db, rec);
+  gint fixedlen;
 
 #ifdef CHECK
   if(is_special_record(rec))
     return -1;
 #endif
 
-  if(reclen > MAX_INDEXED_FIELDNR)
-    reclen = MAX_INDEXED_FIELDNR + 1;
+  fixedlen = (reclen > MAX_INDEXED_FIELDNR ? MAX_INDEXED_FIELDNR + 1 : reclen);
 
-  for(i=0;i<reclen;i++){
-    gint *ilist;
-    gcell *ilistelem;
-
-    /* Find all indexes on the column */
-    ilist = &dbh->index_control_area_header.index_table[i];
-    while(*ilist) {
-      ilistelem = (gcell *) offsettoptr(db, *ilist);
-      if(ilistelem->car) {
-        wg_index_header *hdr = \
-          (wg_index_header *) offsettoptr(db, ilistelem->car);
-        if(hdr->rec_field_index[hdr->fields - 1] == i) {
-          /* Only add the record if we're at the last column
-           * of the index. This way we ensure that a.) a record
-           * is entered once into a multi-column index and b.) the
-           * record is long enough so that it qualifies for the
-           * multi-column index.
-           * For a single-column index, the indexed column is
-           * also the last column, therefore the above is valid,
-           * altough the check is unnecessary.
-           */
-          if(MATCH_TEMPLATE(db, hdr, rec)) {
-            INDEX_ADD_ROW(db, hdr, ilistelem->car, rec)
-          }
-        }
-      }
-      ilist = &ilistelem->cdr;
-    }
+  for(i=0; i<fixedlen; i++) {
+    if(add_rec_column(db, rec, reclen, i))
+      return -2;
+  }
 
-#ifdef USE_INDEX_TEMPLATE
-    ilist = &dbh->index_control_area_header.index_template_table[i];
-    while(*ilist) {
-      ilistelem = (gcell *) offsettoptr(db, *ilist);
-      if(ilistelem->car) {
-        wg_index_header *hdr = \
-          (wg_index_header *) offsettoptr(db, ilistelem->car);
-        wg_index_template *tmpl = \
-          (wg_index_template *) offsettoptr(db, hdr->template_offset);
-        void *matchrec;
-        gint mreclen;
-        int j, firstmatch = -1;
-
-        /* Here the check for a match is slightly more complicated.
-         * If there is a match *but* the current column is not the
-         * first fixed one in the template, the match has
-         * already occurred earlier.
-         */
-        matchrec = offsettoptr(db, tmpl->offset_matchrec);
-        mreclen = wg_get_record_len(db, matchrec);
-        if(mreclen > reclen) {
-          goto nexttmpl1;
-        }
-        for(j=0; j<mreclen; j++) {
-          gint enc = wg_get_field(db, matchrec, j);
-          if(wg_get_encoded_type(db, enc) != WG_VARTYPE) {
-            if(WG_COMPARE(db, enc, wg_get_field(db, rec, j)) != WG_EQUAL)
-              goto nexttmpl1;
-            if(firstmatch < 0)
-              firstmatch = j;
-          }
-        }
-        if(firstmatch==i &&\
-          reclen > hdr->rec_field_index[hdr->fields - 1]) {
-          /* The record matches AND this is the first time we
-           * see this index. Update it.
-           */
-          INDEX_ADD_ROW(db, hdr, ilistelem->car, rec)
-        }
-      }
-nexttmpl1:
-      ilist = &ilistelem->cdr;
+  /* Higher columns, only the ones in the column map are indexed */
+  if(reclen > fixedlen) {
+    wg_index_column *map = (wg_index_column *) offsettoptr(db,
+      dbh->index_control_area_header.column_map);
+    for(i=0; i<dbh->index_control_area_header.column_map_count &&\
+      map[i].column < reclen; i++) {
+      if(add_rec_column(db, rec, reclen, map[i].column))
+        return -2;
     }
-#endif
-
   }
   return 0;
 }
@@ -2839,12 +5352,11 @@ nexttmpl1:
 gint wg_index_del_field(void *db, void *rec, gint column) {
   gint *ilist;
   gcell *ilistelem;
-  db_memsegment_header* dbh = dbmemsegh(db);
   gint reclen = wg_get_record_len(db, rec);
 
 #ifdef CHECK
   /* XXX: if used from wg_set_field() only, this is redundant */
-  if(column > MAX_INDEXED_FIELDNR || column >= reclen)
+  if(column >= reclen)
     return -1;
   if(is_special_record(rec))
     return -1;
@@ -2852,21 +5364,22 @@ gint wg_index_del_field(void *db, void *rec, gint column) {
 
 #if 0
   /* XXX: if used from wg_set_field() only, this is redundant */
-  if(!dbh->index_control_area_header.index_table[column])
+  if(!COLUMN_INDEXED(db, column))
     return -1;
 #endif
 
   /* Find all indexes on the column */
-  ilist = &dbh->index_control_area_header.index_table[column];
-  while(*ilist) {
+  ilist = column_list(db, column, 0, 0);
+  while(ilist && *ilist) {
     ilistelem = (gcell *) offsettoptr(db, *ilist);
     if(ilistelem->car) {
       wg_index_header *hdr = \
         (wg_index_header *) offsettoptr(db, ilistelem->car);
 
-      if(reclen > hdr->rec_field_index[hdr->fields - 1]) {
+      if(reclen > last_index_column(hdr)) {
         if(MATCH_TEMPLATE(db, hdr, rec)) {
-          INDEX_REMOVE_ROW(db, hdr, ilistelem->car, rec)
+          if(remove_field_row(db, hdr, ilistelem->car, rec))
+            return -2;
         }
       }
     }
@@ -2875,16 +5388,17 @@ gint wg_index_del_field(void *db, void *rec, gint column) {
 
 #ifdef USE_INDEX_TEMPLATE
   /* Find all indexes on the column */
-  ilist = &dbh->index_control_area_header.index_template_table[column];
-  while(*ilist) {
+  ilist = column_list(db, column, 1, 0);
+  while(ilist && *ilist) {
     ilistelem = (gcell *) offsettoptr(db, *ilist);
     if(ilistelem->car) {
       wg_index_header *hdr = \
         (wg_index_header *) offsettoptr(db, ilistelem->car);
 
-      if(reclen > hdr->rec_field_index[hdr->fields - 1]) {
+      if(reclen > last_index_column(hdr)) {
         if(MATCH_TEMPLATE(db, hdr, rec)) {
-          INDEX_REMOVE_ROW(db, hdr, ilistelem->car, rec)
+          if(remove_field_row(db, hdr, ilistelem->car, rec))
+            return -2;
         }
       }
     }
@@ -2895,6 +5409,76 @@ gint wg_index_del_field(void *db, void *rec, gint column) {
   return 0;
 }
 
+/** Delete data of one record from the indexes of one column
+ * See wg_index_del_rec().
+ * returns 0 on success, -2 on error
+ */
+static gint del_rec_column(void *db, void *rec, gint reclen, gint column) {
+  gint *ilist;
+  gcell *ilistelem;
+
+  /* Find all indexes on the column */
+  ilist = column_list(db, column, 0, 0);
+  while(ilist && *ilist) {
+    ilistelem = (gcell *) offsettoptr(db, *ilist);
+    if(ilistelem->car) {
+      wg_index_header *hdr = \
+        (wg_index_header *) offsettoptr(db, ilistelem->car);
+      if(last_index_column(hdr) == column) {
+        /* Only update once per index. See also comment for
+         * wg_index_add_rec function.
+         */
+        if(MATCH_TEMPLATE(db, hdr, rec)) {
+          INDEX_REMOVE_ROW(db, hdr, ilistelem->car, rec)
+        }
+      }
+    }
+    ilist = &ilistelem->cdr;
+  }
+
+#ifdef USE_INDEX_TEMPLATE
+  ilist = column_list(db, column, 1, 0);
+  while(ilist && *ilist) {
+    ilistelem = (gcell *) offsettoptr(db, *ilist);
+    if(ilistelem->car) {
+      wg_index_header *hdr = \
+        (wg_index_header *) offsettoptr(db, ilistelem->car);
+      wg_index_template *tmpl = \
+        (wg_index_template *) offsettoptr(db, hdr->template_offset);
+      void *matchrec;
+      gint mreclen;
+      int j, firstmatch = -1;
+
+      /* Similar check as in wg_index_add_rec() */
+      matchrec = offsettoptr(db, tmpl->offset_matchrec);
+      mreclen = wg_get_record_len(db, matchrec);
+      if(mreclen > reclen) {
+        goto nexttmpl2; /* no match */
+      }
+      for(j=0; j<mreclen; j++) {
+        gint enc = wg_get_field(db, matchrec, j);
+        if(wg_get_encoded_type(db, enc) != WG_VARTYPE) {
+          if(WG_COMPARE(db, enc, wg_get_field(db, rec, j)) != WG_EQUAL)
+            goto nexttmpl2;
+          if(firstmatch < 0)
+            firstmatch = j;
+        }
+      }
+      if(firstmatch==column &&\
+        reclen > last_index_column(hdr)) {
+        /* The record matches AND this is the first time we
+         * see this index. Update it.
+         */
+        INDEX_REMOVE_ROW(db, hdr, ilistelem->car, rec)
+      }
+    }
+nexttmpl2:
+    ilist = &ilistelem->cdr;
+  }
+#endif
+  return 0;
+}
+
 /* Delete data of one record from all indexes
  * Should be called from wg_delete_record()
  * returns 0 for success
@@ -2904,79 +5488,81 @@ gint wg_index_del_rec(void *db, void *rec) {
   gint i;
   db_memsegment_header* dbh = dbmemsegh(db);
   gint reclen = wg_get_record_len(db, rec);
+  gint fixedlen;
 
 #ifdef CHECK
   if(is_special_record(rec))
     return -1;
 #endif
 
-  if(reclen > MAX_INDEXED_FIELDNR)
-    reclen = MAX_INDEXED_FIELDNR + 1;
+  /* A document deleted as a record (not with wg_delete_document())
+   * still has its values */
+  if(is_schema_document(rec)) {
+    if(wg_index_del_document(db, rec) < -1)
+      return -2;
+  }
 
-  for(i=0;i<reclen;i++){
-    gint *ilist;
-    gcell *ilistelem;
+  /* The deferred updates may refer to the record */
+  if(wg_flush_index_updates(db))
+    return -2;
 
-    /* Find all indexes on the column */
-    ilist = &dbh->index_control_area_header.index_table[i];
-    while(*ilist) {
-      ilistelem = (gcell *) offsettoptr(db, *ilist);
-      if(ilistelem->car) {
-        wg_index_header *hdr = \
-          (wg_index_header *) offsettoptr(db, ilistelem->car);
-        if(hdr->rec_field_index[hdr->fields - 1] == i) {
-          /* Only update once per index. See also comment for
-           * wg_index_add_rec function.
-           */
-          if(MATCH_TEMPLATE(db, hdr, rec)) {
-            INDEX_REMOVE_ROW(db, hdr, ilistelem->car, rec)
-          }
-        }
-      }
-      ilist = &ilistelem->cdr;
+  fixedlen = (reclen > MAX_INDEXED_FIELDNR ? MAX_INDEXED_FIELDNR + 1 : reclen);
+
+  for(i=0; i<fixedlen; i++) {
+    if(del_rec_column(db, rec, reclen, i))
+      return -2;
+  }
+
+  /* Higher columns, only the ones in the column map are indexed */
+  if(reclen > fixedlen) {
+    wg_index_column *map = (wg_index_column *) offsettoptr(db,
+      dbh->index_control_area_header.column_map);
+    for(i=0; i<dbh->index_control_area_header.column_map_count &&\
+      map[i].column < reclen; i++) {
+      if(del_rec_column(db, rec, reclen, map[i].column))
+        return -2;
     }
+  }
+  return 0;
+}
 
-#ifdef USE_INDEX_TEMPLATE
-    ilist = &dbh->index_control_area_header.index_template_table[i];
-    while(*ilist) {
-      ilistelem = (gcell *) offsettoptr(db, *ilist);
-      if(ilistelem->car) {
-        wg_index_header *hdr = \
-          (wg_index_header *) offsettoptr(db, ilistelem->car);
-        wg_index_template *tmpl = \
-          (wg_index_template *) offsettoptr(db, hdr->template_offset);
-        void *matchrec;
-        gint mreclen;
-        int j, firstmatch = -1;
-
-        /* Similar check as in wg_index_add_rec() */
-        matchrec = offsettoptr(db, tmpl->offset_matchrec);
-        mreclen = wg_get_record_len(db, matchrec);
-        if(mreclen > reclen) {
-          goto nexttmpl2; /* no match */
-        }
-        for(j=0; j<mreclen; j++) {
-          gint enc = wg_get_field(db, matchrec, j);
-          if(wg_get_encoded_type(db, enc) != WG_VARTYPE) {
-            if(WG_COMPARE(db, enc, wg_get_field(db, rec, j)) != WG_EQUAL)
-              goto nexttmpl2;
-            if(firstmatch < 0)
-              firstmatch = j;
-          }
-        }
-        if(firstmatch==i &&\
-          reclen > hdr->rec_field_index[hdr->fields - 1]) {
-          /* The record matches AND this is the first time we
-           * see this index. Update it.
-           */
-          INDEX_REMOVE_ROW(db, hdr, ilistelem->car, rec)
-        }
-      }
-nexttmpl2:
-      ilist = &ilistelem->cdr;
+/** Add a JSON document to the path indexes
+ * Called when the document is complete.
+ * returns 0 for success
+ * returns -2 for error (insert failed, index is no longer consistent)
+ */
+gint wg_index_add_document(void *db, void *document) {
+  gint ilist = dbmemsegh(db)->index_control_area_header.index_list;
+
+  while(ilist) {
+    gcell *ilistelem = (gcell *) offsettoptr(db, ilist);
+    wg_index_header *hdr = \
+      (wg_index_header *) offsettoptr(db, ilistelem->car);
+    if(hdr->type == WG_INDEX_TYPE_JSON_PATH) {
+      if(jsonpath_document(db, hdr, document, HASHIDX_OP_STORE))
+        return -2;
     }
-#endif
+    ilist = ilistelem->cdr;
+  }
+  return 0;
+}
 
+/** Remove a JSON document from the path indexes
+ * Called before the contents of the document are deleted. Values
+ * that are not found (the document was changed after it was
+ * added) are skipped.
+ * returns 0 for success
+ */
+gint wg_index_del_document(void *db, void *document) {
+  gint ilist = dbmemsegh(db)->index_control_area_header.index_list;
+
+  while(ilist) {
+    gcell *ilistelem = (gcell *) offsettoptr(db, ilist);
+    wg_index_header *hdr = \
+      (wg_index_header *) offsettoptr(db, ilistelem->car);
+    if(hdr->type == WG_INDEX_TYPE_JSON_PATH)
+      jsonpath_document(db, hdr, document, HASHIDX_OP_REMOVE);
+    ilist = ilistelem->cdr;
   }
   return 0;
 }
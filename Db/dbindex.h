@@ -55,6 +55,22 @@
                     wg_ttree_find_leaf_predecessor(d, ptrtooffset(d, x)))
 #endif
 
+/* Access to the slots of a T-node. With TTREE_NODE_KEYS, the node
+ * also keeps the encoded value of each row, so the row does not need
+ * to be read when comparing. */
+#ifdef TTREE_NODE_KEYS
+#define TNODE_KEY(d, n, i, c) ((void) (c), (n)->keys[i])
+#define TNODE_SET(n, i, r, k) ((n)->array_of_values[i] = (r),\
+                    (n)->keys[i] = (k))
+#define TNODE_COPY(n, i, s, j) ((n)->array_of_values[i] = (s)->array_of_values[j],\
+                    (n)->keys[i] = (s)->keys[j])
+#else
+#define TNODE_KEY(d, n, i, c) wg_get_field(d,\
+                    offsettoptr(d, (n)->array_of_values[i]), c)
+#define TNODE_SET(n, i, r, k) ((n)->array_of_values[i] = (r))
+#define TNODE_COPY(n, i, s, j) ((n)->array_of_values[i] = (s)->array_of_values[j])
+#endif
+
 /* Check if record matches index (takes pointer arguments) */
 #ifndef USE_INDEX_TEMPLATE
 #define MATCH_TEMPLATE(d, h, r) 1
@@ -64,10 +80,36 @@
         (wg_index_template *) offsettoptr(d, h->template_offset), r) : 1)
 #endif
 
+/* Check if a column has indexes (takes the column number). Columns
+ * above MAX_INDEXED_FIELDNR are looked up from the column map. */
+#ifndef USE_INDEX_TEMPLATE
+#define COLUMN_INDEXED(d, c) ((c) <= MAX_INDEXED_FIELDNR ? \
+        dbmemsegh(d)->index_control_area_header.index_table[c] : \
+        (wg_index_column_list(d, c, 0) != NULL))
+#else
+#define COLUMN_INDEXED(d, c) ((c) <= MAX_INDEXED_FIELDNR ? \
+        (dbmemsegh(d)->index_control_area_header.index_table[c] || \
+        dbmemsegh(d)->index_control_area_header.index_template_table[c]) : \
+        (wg_index_column_list(d, c, 0) != NULL))
+#endif
+
 #define WG_INDEX_TYPE_TTREE         50
 #define WG_INDEX_TYPE_TTREE_JSON    51
 #define WG_INDEX_TYPE_HASH          60
 #define WG_INDEX_TYPE_HASH_JSON     61
+#define WG_INDEX_TYPE_BTREE         70
+#define WG_INDEX_TYPE_BITMAP        80
+#define WG_INDEX_TYPE_FULLTEXT      90
+#define WG_INDEX_TYPE_RTREE         100
+#define WG_INDEX_TYPE_JSON_PATH     110
+
+#define WG_EXPR_LOWER       0x0100  /** string in ASCII lower case */
+#define WG_EXPR_STRLEN      0x0200  /** length of a string in bytes */
+#define WG_EXPR_DATE        0x0300  /** date of a Unix timestamp */
+#define WG_EXPR_MASK        0x0f00
+
+#define VALID_INDEX_EXPR(e) ((e) == WG_EXPR_LOWER ||\
+  (e) == WG_EXPR_STRLEN || (e) == WG_EXPR_DATE)
 
 /* Index header helpers */
 #define TTREE_ROOT_NODE(x) (x->ctl.t.offset_root_node)
@@ -83,6 +125,8 @@
 *   (array of data pointers, pointers to parent/children nodes, control data)
 *   overall size is currently 64 bytes (cache line?) if array size is 10,
 *   with extra node chaining pointers the array size defaults to 8.
+*   With TTREE_NODE_KEYS the node also holds the encoded values of
+*   the rows, in the same order.
 */
 struct wg_tnode{
   gint parent_offset;
@@ -98,8 +142,28 @@ struct wg_tnode{
   gint succ_offset;     /** forward (smaller to larger) sequential chain */
   gint pred_offset;     /** backward sequential chain */
 #endif
+#ifdef TTREE_NODE_KEYS
+  gint keys[WG_TNODE_ARRAY_SIZE];   /** encoded values of the rows */
+#endif
 };
 
+/** Key and row pair, used when building ordered indexes from sorted data */
+typedef struct {
+  gint key;         /** encoded value */
+  gint rec;         /** row offset */
+  wg_uint prefix;   /** normalized key prefix, set when sorting */
+} wg_index_entry;
+
+/** Index description for wg_create_indexes() */
+typedef struct {
+  gint *columns;      /** array of column numbers */
+  gint col_count;     /** size of the columns array */
+  gint type;          /** WG_INDEX_TYPE_* */
+  gint *matchrec;     /** template, NULL for a full index */
+  gint reclen;        /** size of the template */
+  gint size_hint;     /** expected number of distinct keys (hash) */
+} wg_index_spec;
+
 /* ==== Protos ==== */
 
 /* API functions (copied in indexapi.h) */
@@ -108,6 +172,10 @@ gint wg_create_index(void *db, gint column, gint type,
   gint *matchrec, gint reclen);
 gint wg_create_multi_index(void *db, gint *columns, gint col_count,
   gint type, gint *matchrec, gint reclen);
+gint wg_create_multi_index_sized(void *db, gint *columns, gint col_count,
+  gint type, gint *matchrec, gint reclen, gint size_hint);
+gint wg_create_indexes(void *db, wg_index_spec *specs, gint count,
+  gint nthreads);
 gint wg_drop_index(void *db, gint index_id);
 gint wg_column_to_index_id(void *db, gint column, gint type,
   gint *matchrec, gint reclen);
@@ -116,6 +184,27 @@ gint wg_multi_column_to_index_id(void *db, gint *columns, gint col_count,
 gint wg_get_index_type(void *db, gint index_id);
 void * wg_get_index_template(void *db, gint index_id, gint *reclen);
 void * wg_get_all_indexes(void *db, gint *count);
+gint wg_analyze_index(void *db, gint index_id);
+gint wg_analyze(void *db);
+gint wg_get_index_stats(void *db, gint index_id, gint *rows,
+  gint *distinct);
+gint wg_create_fulltext_index(void *db, gint column, gint flags,
+  gint min_len);
+gint wg_fulltext_search(void *db, gint index_id, char *text, gint mode,
+  gint k, void **rows, double *scores);
+gint wg_create_expr_index(void *db, gint column, gint expr,
+  gint *matchrec, gint reclen);
+gint wg_expr_to_index_id(void *db, gint column, gint expr,
+  gint *matchrec, gint reclen);
+gint wg_create_json_path_index(void *db, char *path);
+gint wg_json_path_to_index_id(void *db, char *path);
+gint wg_create_bloom_filter(void *db, gint index_id, gint bits_per_key);
+gint wg_drop_bloom_filter(void *db, gint index_id);
+gint wg_get_bloom_stats(void *db, gint index_id, gint *lookups,
+  gint *negatives, gint *false_positives);
+gint wg_defer_index_updates(void *db, gint on);
+gint wg_flush_index_updates(void *db);
+gint wg_get_index_pending(void *db, gint index_id);
 
 /* WhiteDB internal functions */
 
@@ -137,15 +226,23 @@ gint wg_search_tnode_last(void *db, gint nodeoffset, gint key,
   gint column);
 
 gint wg_search_hash(void *db, gint index_id, gint *values, gint count);
+gint wg_index_expr_value(void *db, gint expr, gint enc, gint *result);
+gint wg_search_json_path(void *db, gint index_id, gint value);
 
 #ifdef USE_INDEX_TEMPLATE
 gint wg_match_template(void *db, wg_index_template *tmpl, void *rec);
 #endif
 
+gint *wg_index_column_list(void *db, gint column, int tmpl);
+
 gint wg_index_add_field(void *db, void *rec, gint column);
 gint wg_index_add_rec(void *db, void *rec);
 gint wg_index_del_field(void *db, void *rec, gint column);
 gint wg_index_del_rec(void *db, void *rec);
+gint wg_index_add_document(void *db, void *document);
+gint wg_index_del_document(void *db, void *document);
+gint wg_index_delta_rows(void *db);
+void wg_index_free_delta(void *db);
 
 
 #endif /* DEFINED_DBINDEX_H */
@@ -52,6 +52,7 @@ extern "C" {
 
 #include "dbdata.h"
 #include "dbcompare.h"
+#include "dbindex.h"
 #include "dbschema.h"
 #include "dbjson.h"
 #include "dbutil.h"
@@ -319,6 +320,7 @@ done:
  * If parsing is successful, the pointer referred to by
  * **document will point to the top-level record.
  * If **document is NULL, the pointer is discarded.
+ * The document is added to the JSON path indexes.
  *
  * returns 0 for success.
  * returns -1 on non-fatal error.
@@ -327,6 +329,10 @@ done:
 gint wg_parse_json_document(void *db, char *buf, void **document) {
   void *rec = NULL;
   gint retv = run_json_parser(db, buf, &input_cb, 0, 1, &rec);
+  if(!retv && rec) {
+    if(wg_index_add_document(db, rec) < -1)
+      retv = -2;
+  }
   if(document)
     *document = rec;
   return retv;
@@ -55,6 +55,7 @@ extern "C" {
 #endif
 #include "dballoc.h"
 #include "dblock.h"
+#include "dbindex.h"
 
 #if (LOCK_PROTO==TFQUEUE)
 #ifdef __linux__
@@ -475,10 +476,16 @@ gint wg_start_write(void * db) {
 }
 
 /** End write transaction
- *   Current implementation: release database level exclusive lock
+ *   Current implementation: apply the deferred index updates of the
+ *   handle (see wg_defer_index_updates()) and release database level
+ *   exclusive lock
+ *   The lock is released even if the index updates fail; the failed
+ *   indexes stay marked as missing rows. Call wg_flush_index_updates()
+ *   before this to check for the failure.
  */
 
 gint wg_end_write(void * db, gint lock) {
+  wg_flush_index_updates(db);
   return db_wulock(db, lock);
 }
 
@@ -36,6 +36,7 @@
 #include <string.h>
 
 #ifdef _WIN32
+#include <windows.h>
 #include <process.h>
 #include <errno.h>
 #include <malloc.h>
@@ -44,6 +45,7 @@
 #else
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/errno.h>
 #endif
 
@@ -59,6 +61,7 @@ extern "C" {
 #include "dballoc.h"
 #include "dbdata.h"
 #include "dbhash.h"
+#include "dblock.h"
 
 /* ====== Private headers and defs ======== */
 
@@ -87,16 +90,16 @@ extern "C" {
     return show_log_error(d, "Failed to read log entry"); \
   }
 
-#define GET_LOG_CMD(d, f, v) \
-  if((v = fgetc(f)) == EOF) { \
-    if(feof(f)) break; \
-    else return show_log_error(d, "Failed to read log entry"); \
-  }
-
-/* Does not emit a message as fget_varint() does that already. */
-#define GET_LOG_VARINT(d, f, v, e) \
-  if(fget_varint(d, f, (wg_uint *) &v))  { \
-    return e; \
+/* Decode a varint at position p of an entry read by read_log_entry() */
+#define GET_LOG_VARINT(d, ent, p, v, e) \
+  { \
+    size_t vlen = get_varint((ent)->buf + p, (ent)->len - p, \
+      (wg_uint *) &v); \
+    if(!vlen) { \
+      show_log_error(d, "Failed to read log entry"); \
+      return e; \
+    } \
+    p += vlen; \
   }
 
 #ifdef HAVE_64BIT_GINT
@@ -105,8 +108,54 @@ extern "C" {
 #define VARINT_SIZE 5
 #endif
 
+/* Initial size of the buffer holding a single journal entry */
+#define ENTRY_BUFSIZE 256
+
+/* Read buffer size and polling interval when shipping the journal */
+#define SHIP_BUFSIZE 8192
+#define SHIP_POLL_MSEC 20
+
+/* Number of recently encoded values a change feed remembers. The
+ * values are encoded before they are set, so the encode entries
+ * are kept until the set entries that use them are read. */
+#define CHANGE_VALUES 64
+
 /* ====== data structures ======== */
 
+#ifdef USE_DBLOG
+/** A single journal entry read from a stream (see read_log_entry()) */
+typedef struct {
+  unsigned char *buf;
+  size_t bufsize;
+  size_t len;             /* entry length, including the command byte */
+} log_entry;
+
+/** Value decoded from an encode entry of the journal */
+typedef struct {
+  gint enc;               /* encoded value in the journal */
+  gint type;              /* WG_*TYPE, 0 if the slot is unused */
+  gint intval;
+  double doubleval;
+  char *str;              /* string and extra string, '\0' terminated */
+  gint len;               /* length of the string */
+  gint extlen;            /* length of the extra string */
+} change_value;
+
+/** Change feed state (see wg_subscribe_changes()) */
+typedef struct {
+  int fd;                 /* journal file */
+  int follow;             /* follow journal rotation */
+  gint serial;            /* serial of the journal being read */
+  gint lsn;               /* journal position of buf[0] */
+  unsigned char *buf;     /* read buffer */
+  size_t bufsize;
+  size_t buflen;          /* bytes in buffer */
+  size_t bufpos;          /* next entry in buffer */
+  change_value values[CHANGE_VALUES]; /* recently encoded values */
+  int nextvalue;          /* slot of the next encoded value */
+} change_feed;
+#endif
+
 /* ======= Private protos ================ */
 
 #ifdef USE_DBLOG
@@ -118,8 +167,25 @@ static gint add_tran_offset(void *db, void *table, gint old, gint new);
 static gint add_tran_enc(void *db, void *table, gint old, gint new);
 static gint translate_offset(void *db, void *table, gint offset);
 static gint translate_encoded(void *db, void *table, gint enc);
-static gint recover_encode(void *db, FILE *f, gint type);
+static gint reserve_entry(void *db, log_entry *ent, size_t len);
+static gint read_log_entry(void *db, FILE *f, int c, log_entry *ent);
+static gint recover_encode(void *db, log_entry *ent, size_t *pos,
+  gint type);
+static gint recover_entry(void *db, log_entry *ent, void *table);
 static gint recover_journal(void *db, FILE *f, void *table);
+static int open_journal_readonly(void *db);
+static gint write_fd(int fd, char *buf, int buflen);
+static void ship_sleep(void);
+
+static size_t get_varint(unsigned char *buf, size_t buflen, wg_uint *val);
+static gint add_change_value(void *db, change_feed *cf, unsigned char *data,
+  gint type, gint len, gint extlen, gint enc);
+static void get_change_value(void *db, change_feed *cf, wg_change_event *ev);
+static gint parse_change(void *db, change_feed *cf, unsigned char *buf,
+  size_t buflen, wg_change_event *ev);
+static int open_journal_at(void *db, char *filename, gint lsn);
+static void *open_change_feed(void *db, char *filename, gint from_lsn,
+  int follow);
 
 static gint write_log_buffer(void *db, void *buf, int buflen);
 #endif /* USE_DBLOG */
@@ -393,62 +459,57 @@ static size_t dec_varint(unsigned char *buf, wg_uint *val) {
 }
 #endif
 
-/** Read varint from a buffered stream
+/** Varint decoder with bounds checking
+ *  returns the number of bytes consumed
+ *  returns 0 if the buffer ends before the varint.
+ */
+static size_t get_varint(unsigned char *buf, size_t buflen, wg_uint *val) {
+  wg_uint tmp = 0;
+  size_t i;
+
+  for(i=0; i<buflen; i++) {
+    if(i == VARINT_SIZE - 1) {
+      /* last byte carries 8 bits */
+      tmp |= ((wg_uint) buf[i] << (7*i));
+      *val = tmp;
+      return i + 1;
+    }
+    tmp |= ((wg_uint) (buf[i] & 0x7f) << (7*i));
+    if(!(buf[i] & 0x80)) {
+      *val = tmp;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+/** Copy a varint from a buffered stream to the end of an entry
  *  returns 0 on success
  *  returns -1 on error
  */
-static int fget_varint(void *db, FILE *f, wg_uint *val) {
-  register int c;
-  wg_uint tmp;
+static int copy_varint(void *db, FILE *f, log_entry *ent, wg_uint *val) {
+  size_t start = ent->len;
+  int c, i;
 
-  GET_LOG_BYTE(db, f, c)
-  tmp = c & 0x7f;
-  if(c & 0x80) {
+  for(i=0; i<VARINT_SIZE; i++) {
+    if(reserve_entry(db, ent, 1))
+      return -1;
     GET_LOG_BYTE(db, f, c)
-    tmp |= ((c & 0x7f) << 7);
-    if(c & 0x80) {
-      GET_LOG_BYTE(db, f, c)
-      tmp |= ((c & 0x7f) << 14);
-      if(c & 0x80) {
-        GET_LOG_BYTE(db, f, c)
-        tmp |= ((c & 0x7f) << 21);
-        if(c & 0x80) {
-          GET_LOG_BYTE(db, f, c)
-#ifndef HAVE_64BIT_GINT
-          tmp |= (c << 28);
-#else
-          tmp |= ((wg_uint) (c & 0x7f) << 28);
-          if(c & 0x80) {
-            GET_LOG_BYTE(db, f, c)
-            tmp |= ((wg_uint) (c & 0x7f) << 35);
-            if(c & 0x80) {
-              GET_LOG_BYTE(db, f, c)
-              tmp |= ((wg_uint) (c & 0x7f) << 42);
-              if(c & 0x80) {
-                GET_LOG_BYTE(db, f, c)
-                tmp |= ((wg_uint) (c & 0x7f) << 49);
-                if(c & 0x80) {
-                  GET_LOG_BYTE(db, f, c)
-                  tmp |= ((wg_uint) c << 56);
-                }
-              }
-            }
-          }
-#endif
-        }
-      }
-    }
+    ent->buf[ent->len++] = (unsigned char) c;
+    if(!(c & 0x80))
+      break;
   }
-  *val = tmp;
+  get_varint(ent->buf + start, ent->len - start, val);
   return 0;
 }
 
 /** Add a log recovery translation entry
- *  Uses extendible gint hashtable internally.
+ *  Uses extendible gint hashtable internally. An existing entry
+ *  is replaced, as offsets get reused when objects are freed.
  */
 static gint add_tran_offset(void *db, void *table, gint old, gint new)
 {
-  return wg_ginthash_addkey(db, table, old, new);
+  return wg_ginthash_setkey(db, table, old, new);
 }
 
 /** Wrapper around add_tran_offset() to handle encoded data
@@ -525,28 +586,134 @@ static gint translate_encoded(void *db, void *table, gint enc)
   return enc;
 }
 
+/** Make room for len more bytes in the entry buffer.
+ *  returns 0 on success
+ *  returns -1 on error
+ */
+static gint reserve_entry(void *db, log_entry *ent, size_t len)
+{
+  if(len > ent->bufsize - ent->len) {
+    size_t newsize = (ent->bufsize ? ent->bufsize : ENTRY_BUFSIZE);
+    unsigned char *newbuf;
+
+    if(len > ((size_t) -1) / 4 - ent->len) {
+      return show_log_error(db, "Invalid log entry");
+    }
+    while(newsize < ent->len + len)
+      newsize *= 2;
+    newbuf = (unsigned char *) realloc(ent->buf, newsize);
+    if(!newbuf) {
+      return show_log_error(db, "Failed to allocate buffers");
+    }
+    ent->buf = newbuf;
+    ent->bufsize = newsize;
+  }
+  return 0;
+}
+
+/** Read a single journal entry from the stream into a buffer.
+ *  c is the command byte that was already read from the stream.
+ *  Only the bytes belonging to the entry are read, so this does not
+ *  block on a stream where the entry is followed by nothing yet.
+ *  returns 0 on success
+ *  returns -1 on error
+ */
+static gint read_log_entry(void *db, FILE *f, int c, log_entry *ent)
+{
+  wg_uint v1, v2;
+  size_t len = 0;
+
+#define COPY_LOG_VARINT(v) \
+  if(copy_varint(db, f, ent, &v)) \
+    return -1;
+
+  ent->len = 0;
+  if(reserve_entry(db, ent, 1))
+    return -1;
+  ent->buf[ent->len++] = (unsigned char) c;
+
+  switch((unsigned char) c & WG_JOURNAL_ENTRY_CMDMASK) {
+    case WG_JOURNAL_ENTRY_CRE:
+    case WG_JOURNAL_ENTRY_META:
+      COPY_LOG_VARINT(v1)
+      COPY_LOG_VARINT(v2)
+      break;
+    case WG_JOURNAL_ENTRY_DEL:
+      COPY_LOG_VARINT(v1)
+      break;
+    case WG_JOURNAL_ENTRY_SET:
+      COPY_LOG_VARINT(v1)
+      COPY_LOG_VARINT(v2)
+      COPY_LOG_VARINT(v1)
+      break;
+    case WG_JOURNAL_ENTRY_ENC:
+      switch((unsigned char) c & WG_JOURNAL_ENTRY_TYPEMASK) {
+        case WG_INTTYPE:
+          len = sizeof(int);
+          break;
+        case WG_DOUBLETYPE:
+          len = sizeof(double);
+          break;
+        case WG_STRTYPE:
+        case WG_URITYPE:
+        case WG_XMLLITERALTYPE:
+        case WG_ANONCONSTTYPE:
+        case WG_BLOBTYPE:
+          /* strings with extdata */
+          COPY_LOG_VARINT(v1)
+          COPY_LOG_VARINT(v2)
+          if(v1 > ((size_t) -1) / 4 || v2 > ((size_t) -1) / 4) {
+            return show_log_error(db, "Invalid log entry");
+          }
+          len = (size_t) v1 + (size_t) v2;
+          break;
+        default:
+          return show_log_error(db, "Unsupported data type");
+      }
+      if(reserve_entry(db, ent, len))
+        return -1;
+      if(fread(ent->buf + ent->len, 1, len, f) != len) {
+        return show_log_error(db, "Failed to read log entry");
+      }
+      ent->len += len;
+      COPY_LOG_VARINT(v1)
+      break;
+    default:
+      return show_log_error(db, "Invalid log entry");
+  }
+#undef COPY_LOG_VARINT
+  return 0;
+}
+
 /** Parse an encode entry from the log.
- *
+ *  pos points to the data following the command byte and is
+ *  advanced past the encoded value.
  */
-gint recover_encode(void *db, FILE *f, gint type)
+static gint recover_encode(void *db, log_entry *ent, size_t *pos,
+  gint type)
 {
   char *strbuf, *extbuf;
   gint length = 0, extlength = 0, enc;
+  size_t p = *pos;
   int intval;
   double doubleval;
 
   switch(type) {
     case WG_INTTYPE:
-      if(fread((char *) &intval, sizeof(int), 1, f) != 1) {
+      if(ent->len - p < sizeof(int)) {
         show_log_error(db, "Failed to read log entry");
         return WG_ILLEGAL;
       }
+      memcpy((char *) &intval, ent->buf + p, sizeof(int));
+      *pos = p + sizeof(int);
       return wg_encode_int(db, intval);
     case WG_DOUBLETYPE:
-      if(fread((char *) &doubleval, sizeof(double), 1, f) != 1) {
+      if(ent->len - p < sizeof(double)) {
         show_log_error(db, "Failed to read log entry");
         return WG_ILLEGAL;
       }
+      memcpy((char *) &doubleval, ent->buf + p, sizeof(double));
+      *pos = p + sizeof(double);
       return wg_encode_double(db, doubleval);
     case WG_STRTYPE:
     case WG_URITYPE:
@@ -554,20 +721,22 @@ gint recover_encode(void *db, FILE *f, gint type)
     case WG_ANONCONSTTYPE:
     case WG_BLOBTYPE: /* XXX: no encode func for this yet */
       /* strings with extdata */
-      GET_LOG_VARINT(db, f, length, WG_ILLEGAL)
-      GET_LOG_VARINT(db, f, extlength, WG_ILLEGAL)
+      GET_LOG_VARINT(db, ent, p, length, WG_ILLEGAL)
+      GET_LOG_VARINT(db, ent, p, extlength, WG_ILLEGAL)
+      if(ent->len - p < (size_t) length ||
+        ent->len - p - length < (size_t) extlength) {
+        show_log_error(db, "Failed to read log entry");
+        return WG_ILLEGAL;
+      }
 
       strbuf = (char *) malloc(length + 1);
       if(!strbuf) {
         show_log_error(db, "Failed to allocate buffers");
         return WG_ILLEGAL;
       }
-      if(fread(strbuf, 1, length, f) != length) {
-        show_log_error(db, "Failed to read log entry");
-        free(strbuf);
-        return WG_ILLEGAL;
-      }
+      memcpy(strbuf, ent->buf + p, length);
       strbuf[length] = '\0';
+      p += length;
 
       if(extlength) {
         extbuf = (char *) malloc(extlength + 1);
@@ -576,16 +745,13 @@ gint recover_encode(void *db, FILE *f, gint type)
           show_log_error(db, "Failed to allocate buffers");
           return WG_ILLEGAL;
         }
-        if(fread(extbuf, 1, extlength, f) != extlength) {
-          show_log_error(db, "Failed to read log entry");
-          free(strbuf);
-          free(extbuf);
-          return WG_ILLEGAL;
-        }
+        memcpy(extbuf, ent->buf + p, extlength);
         extbuf[extlength] = '\0';
+        p += extlength;
       } else {
         extbuf = NULL;
       }
+      *pos = p;
 
       enc = wg_encode_unistr(db, strbuf, extbuf, type);
       free(strbuf);
@@ -599,86 +765,429 @@ gint recover_encode(void *db, FILE *f, gint type)
   return show_log_error(db, "Unsupported data type");
 }
 
-/** Parse the journal file. Used internally only.
- *
+/** Apply a single journal entry. Used internally only.
+ *  The entry has been read by read_log_entry().
  */
-static gint recover_journal(void *db, FILE *f, void *table)
+static gint recover_entry(void *db, log_entry *ent, void *table)
 {
-  int c;
   gint length = 0, offset = 0, newoffset;
   gint col = 0, enc = 0, newenc, meta = 0;
+  size_t pos = 1;
   void *rec;
 
-  for(;;) {
-    GET_LOG_CMD(db, f, c)
-    switch((unsigned char) c & WG_JOURNAL_ENTRY_CMDMASK) {
-      case WG_JOURNAL_ENTRY_CRE:
-        GET_LOG_VARINT(db, f, length, -1)
-        GET_LOG_VARINT(db, f, offset, -1)
-        rec = wg_create_record(db, length);
-        if(offset != 0) {
-          /* XXX: should we have even tried if this failed earlier? */
-          if(!rec) {
-            return show_log_error(db, "Failed to create a new record");
-          }
-          newoffset = ptrtooffset(db, rec);
-          if(newoffset != offset) {
-            if(add_tran_offset(db, table, offset, newoffset)) {
-              return show_log_error(db, "Failed to parse log "\
-                "(out of translation memory)");
-            }
+  switch(ent->buf[0] & WG_JOURNAL_ENTRY_CMDMASK) {
+    case WG_JOURNAL_ENTRY_CRE:
+      GET_LOG_VARINT(db, ent, pos, length, -1)
+      GET_LOG_VARINT(db, ent, pos, offset, -1)
+      rec = wg_create_record(db, length);
+      if(offset != 0) {
+        /* XXX: should we have even tried if this failed earlier? */
+        if(!rec) {
+          return show_log_error(db, "Failed to create a new record");
+        }
+        newoffset = ptrtooffset(db, rec);
+        if(newoffset != offset ||
+          translate_offset(db, table, offset) != offset) {
+          if(add_tran_offset(db, table, offset, newoffset)) {
+            return show_log_error(db, "Failed to parse log "\
+              "(out of translation memory)");
           }
         }
-        break;
-      case WG_JOURNAL_ENTRY_DEL:
-        GET_LOG_VARINT(db, f, offset, -1)
-        newoffset = translate_offset(db, table, offset);
-        rec = offsettoptr(db, newoffset);
-        if(wg_delete_record(db, rec) < -1) {
-          return show_log_error(db, "Failed to delete a record");
+      }
+      break;
+    case WG_JOURNAL_ENTRY_DEL:
+      GET_LOG_VARINT(db, ent, pos, offset, -1)
+      newoffset = translate_offset(db, table, offset);
+      rec = offsettoptr(db, newoffset);
+      if(wg_delete_record(db, rec) < -1) {
+        return show_log_error(db, "Failed to delete a record");
+      }
+      break;
+    case WG_JOURNAL_ENTRY_ENC:
+      newenc = recover_encode(db, ent, &pos,
+        ent->buf[0] & WG_JOURNAL_ENTRY_TYPEMASK);
+      GET_LOG_VARINT(db, ent, pos, enc, -1)
+      if(enc != WG_ILLEGAL) {
+        /* Encode was supposed to succeed */
+        if(newenc == WG_ILLEGAL) {
+          return -1;
         }
-        break;
-      case WG_JOURNAL_ENTRY_ENC:
-        newenc = recover_encode(db, f,
-          (unsigned char) c & WG_JOURNAL_ENTRY_TYPEMASK);
-        GET_LOG_VARINT(db, f, enc, -1)
-        if(enc != WG_ILLEGAL) {
-          /* Encode was supposed to succeed */
-          if(newenc == WG_ILLEGAL) {
-            return -1;
-          }
-          if(newenc != enc) {
-            if(add_tran_enc(db, table, enc, newenc)) {
-              return show_log_error(db, "Failed to parse log "\
-                "(out of translation memory)");
-            }
+        if(newenc != enc || translate_encoded(db, table, enc) != enc) {
+          if(add_tran_enc(db, table, enc, newenc)) {
+            return show_log_error(db, "Failed to parse log "\
+              "(out of translation memory)");
           }
         }
-        break;
-      case WG_JOURNAL_ENTRY_SET:
-        GET_LOG_VARINT(db, f, offset, -1)
-        GET_LOG_VARINT(db, f, col, -1)
-        GET_LOG_VARINT(db, f, enc, -1)
-        newoffset = translate_offset(db, table, offset);
-        rec = offsettoptr(db, newoffset);
-        newenc = translate_encoded(db, table, enc);
-        if(wg_set_field(db, rec, col, newenc)) {
-          return show_log_error(db, "Failed to set field data");
-        }
-        break;
-      case WG_JOURNAL_ENTRY_META:
-        GET_LOG_VARINT(db, f, offset, -1)
-        GET_LOG_VARINT(db, f, meta, -1)
-        newoffset = translate_offset(db, table, offset);
-        rec = offsettoptr(db, newoffset);
-        *((gint *) rec + RECORD_META_POS) = meta;
-        break;
-      default:
-        return show_log_error(db, "Invalid log entry");
+      }
+      break;
+    case WG_JOURNAL_ENTRY_SET:
+      GET_LOG_VARINT(db, ent, pos, offset, -1)
+      GET_LOG_VARINT(db, ent, pos, col, -1)
+      GET_LOG_VARINT(db, ent, pos, enc, -1)
+      newoffset = translate_offset(db, table, offset);
+      rec = offsettoptr(db, newoffset);
+      newenc = translate_encoded(db, table, enc);
+      if(wg_set_field(db, rec, col, newenc)) {
+        return show_log_error(db, "Failed to set field data");
+      }
+      break;
+    case WG_JOURNAL_ENTRY_META:
+      GET_LOG_VARINT(db, ent, pos, offset, -1)
+      GET_LOG_VARINT(db, ent, pos, meta, -1)
+      newoffset = translate_offset(db, table, offset);
+      rec = offsettoptr(db, newoffset);
+      *((gint *) rec + RECORD_META_POS) = meta;
+      break;
+    default:
+      return show_log_error(db, "Invalid log entry");
+  }
+  return 0;
+}
+
+/** Parse the journal file. Used internally only.
+ *
+ */
+static gint recover_journal(void *db, FILE *f, void *table)
+{
+  log_entry ent;
+  gint err = 0;
+  int c;
+
+  memset(&ent, 0, sizeof(log_entry));
+  for(;;) {
+    if((c = fgetc(f)) == EOF) {
+      if(!feof(f))
+        err = show_log_error(db, "Failed to read log entry");
+      break;
+    }
+    if(read_log_entry(db, f, c, &ent) || recover_entry(db, &ent, table)) {
+      err = -1;
+      break;
+    }
+  }
+  if(ent.buf)
+    free(ent.buf);
+  return err;
+}
+
+/** Open the current journal file for reading.
+ *  Does not emit an error message, the caller may retry.
+ */
+static int open_journal_readonly(void *db) {
+  char journal_fn[WG_JOURNAL_FN_BUFSIZE];
+  int fd = -1;
+
+  wg_journal_filename(db, journal_fn, WG_JOURNAL_FN_BUFSIZE);
+#ifndef _WIN32
+  fd = open(journal_fn, O_RDONLY);
+#else
+  if(_sopen_s(&fd, journal_fn, _O_RDONLY|_O_BINARY, _SH_DENYNO, 0))
+    fd = -1;
+#endif
+  return fd;
+}
+
+/** Write the whole buffer to a file descriptor.
+ *  Returns 0 on success, -1 on failure.
+ */
+static gint write_fd(int fd, char *buf, int buflen) {
+  while(buflen > 0) {
+#ifndef _WIN32
+    int len = write(fd, buf, buflen);
+#else
+    int len = _write(fd, buf, buflen);
+#endif
+    if(len <= 0) {
+      if(len < 0 && errno == EINTR)
+        continue;
+      return -1;
     }
+    buf += len;
+    buflen -= len;
   }
   return 0;
 }
+
+/** Wait before polling the journal again.
+ *
+ */
+static void ship_sleep(void) {
+#ifdef _WIN32
+  Sleep(SHIP_POLL_MSEC);
+#else
+  struct timespec ts;
+  ts.tv_sec = 0;
+  ts.tv_nsec = SHIP_POLL_MSEC * 1000000;
+  nanosleep(&ts, NULL);
+#endif
+}
+
+/** Remember the value of an encode entry of the journal.
+ *  data points to the value, len and extlen are the lengths of
+ *  the string and the extra string of string types. The oldest
+ *  value is replaced.
+ *  returns 0 on success
+ *  returns -1 on error
+ */
+static gint add_change_value(void *db, change_feed *cf, unsigned char *data,
+  gint type, gint len, gint extlen, gint enc)
+{
+  change_value *cv = &cf->values[cf->nextvalue];
+  char *str = NULL;
+  int intval;
+
+  if(type != WG_INTTYPE && type != WG_DOUBLETYPE) {
+    str = (char *) malloc(len + extlen + 2);
+    if(!str)
+      return show_log_error(db, "Failed to allocate the change feed");
+    memcpy(str, data, len);
+    str[len] = '\0';
+    memcpy(str + len + 1, data + len, extlen);
+    str[len + 1 + extlen] = '\0';
+  }
+  if(cv->str)
+    free(cv->str);
+  cv->enc = enc;
+  cv->type = type;
+  cv->str = str;
+  cv->len = len;
+  cv->extlen = extlen;
+  if(type == WG_INTTYPE) {
+    memcpy((char *) &intval, data, sizeof(int));
+    cv->intval = intval;
+  }
+  else if(type == WG_DOUBLETYPE)
+    memcpy((char *) &cv->doubleval, data, sizeof(double));
+  cf->nextvalue = (cf->nextvalue + 1) % CHANGE_VALUES;
+  return 0;
+}
+
+/** Attach the decoded value to a set event.
+ *  The value comes from the latest encode entry that produced the
+ *  encoded value. Values that are stored in the field itself are
+ *  decoded directly. Otherwise the type is left 0.
+ */
+static void get_change_value(void *db, change_feed *cf, wg_change_event *ev)
+{
+  int i, slot = cf->nextvalue;
+
+  for(i=0; i<CHANGE_VALUES; i++) {
+    change_value *cv;
+    slot = (slot ? slot : CHANGE_VALUES) - 1;
+    cv = &cf->values[slot];
+    if(cv->type && cv->enc == ev->value) {
+      ev->valtype = cv->type;
+      ev->intval = cv->intval;
+      ev->doubleval = cv->doubleval;
+      ev->str = cv->str;
+      ev->extstr = (cv->extlen ? cv->str + cv->len + 1 : NULL);
+      ev->len = cv->len;
+      return;
+    }
+  }
+  if(!isptr(ev->value)) {
+    /* tiny strings are stored in the field, but they are always
+     * encoded in the journal */
+    if((ev->value & LASTBYTEMASK) != TINYSTRBITS)
+      ev->valtype = wg_get_encoded_type(db, ev->value);
+    if(ev->valtype == WG_INTTYPE)
+      ev->intval = wg_decode_int(db, ev->value);
+  }
+  else if((ev->value & NORMALPTRMASK) == DATARECBITS)
+    ev->valtype = WG_RECORDTYPE;
+}
+
+/** Decode a journal entry from a memory buffer.
+ *
+ *  Encode entries do not produce an event, in that case ev->type
+ *  is set to 0. Their values are kept in the feed and attached to
+ *  the set events.
+ *  returns the number of bytes consumed
+ *  returns 0 if the buffer does not contain the complete entry
+ *  returns -1 if the entry is invalid
+ */
+static gint parse_change(void *db, change_feed *cf, unsigned char *buf,
+  size_t buflen, wg_change_event *ev)
+{
+  size_t pos = 1, data = 1, len;
+  wg_uint v1 = 0, v2 = 0, v3;
+  gint type;
+
+#define PARSE_VARINT(v) \
+  if(!(len = get_varint(buf + pos, buflen - pos, &v))) \
+    return 0; \
+  pos += len;
+
+  if(!buflen)
+    return 0;
+  ev->type = 0;
+  ev->valtype = 0;
+  ev->intval = 0;
+  ev->doubleval = 0;
+  ev->str = ev->extstr = NULL;
+  ev->len = 0;
+  switch(buf[0] & WG_JOURNAL_ENTRY_CMDMASK) {
+    case WG_JOURNAL_ENTRY_CRE:
+      PARSE_VARINT(v1)
+      PARSE_VARINT(v2)
+      if(v2) { /* zero offset means the create failed */
+        ev->type = WG_CHANGE_CREATE;
+        ev->record = (gint) v2;
+        ev->column = (gint) v1;
+        ev->value = 0;
+      }
+      break;
+    case WG_JOURNAL_ENTRY_DEL:
+      PARSE_VARINT(v1)
+      ev->type = WG_CHANGE_DELETE;
+      ev->record = (gint) v1;
+      ev->column = 0;
+      ev->value = 0;
+      break;
+    case WG_JOURNAL_ENTRY_ENC:
+      type = buf[0] & WG_JOURNAL_ENTRY_TYPEMASK;
+      switch(type) {
+        case WG_INTTYPE:
+          pos += sizeof(int);
+          break;
+        case WG_DOUBLETYPE:
+          pos += sizeof(double);
+          break;
+        case WG_STRTYPE:
+        case WG_URITYPE:
+        case WG_XMLLITERALTYPE:
+        case WG_ANONCONSTTYPE:
+        case WG_BLOBTYPE:
+          PARSE_VARINT(v1)
+          PARSE_VARINT(v2)
+          if(v1 > ((size_t) -1) / 4 || v2 > ((size_t) -1) / 4)
+            return show_log_error(db, "Invalid log entry");
+          data = pos;
+          pos += v1 + v2;
+          break;
+        default:
+          return show_log_error(db, "Unsupported data type");
+      }
+      if(pos >= buflen)
+        return 0;
+      PARSE_VARINT(v3)
+      /* a failed encode was not used */
+      if((gint) v3 != WG_ILLEGAL && add_change_value(db, cf, buf + data,
+        type, (gint) v1, (gint) v2, (gint) v3))
+        return -1;
+      break;
+    case WG_JOURNAL_ENTRY_SET:
+      PARSE_VARINT(v1)
+      PARSE_VARINT(v2)
+      PARSE_VARINT(v3)
+      ev->type = WG_CHANGE_SET;
+      ev->record = (gint) v1;
+      ev->column = (gint) v2;
+      ev->value = (gint) v3;
+      get_change_value(db, cf, ev);
+      break;
+    case WG_JOURNAL_ENTRY_META:
+      PARSE_VARINT(v1)
+      PARSE_VARINT(v2)
+      ev->type = WG_CHANGE_META;
+      ev->record = (gint) v1;
+      ev->column = 0;
+      ev->value = (gint) v2;
+      break;
+    default:
+      return show_log_error(db, "Invalid log entry");
+  }
+#undef PARSE_VARINT
+  return (gint) pos;
+}
+
+/** Open a journal file and position it for reading at lsn.
+ *  If filename is NULL, the current journal is opened.
+ *  Does not emit an error message, the caller may retry.
+ */
+static int open_journal_at(void *db, char *filename, gint lsn) {
+  char buf[WG_JOURNAL_MAGIC_BYTES];
+  int fd;
+
+  if(!filename) {
+    fd = open_journal_readonly(db);
+  } else {
+#ifndef _WIN32
+    fd = open(filename, O_RDONLY);
+#else
+    if(_sopen_s(&fd, filename, _O_RDONLY|_O_BINARY, _SH_DENYNO, 0))
+      fd = -1;
+#endif
+  }
+  if(fd == -1)
+    return -1;
+
+#ifndef _WIN32
+  if(read(fd, buf, WG_JOURNAL_MAGIC_BYTES) != WG_JOURNAL_MAGIC_BYTES ||\
+    strncmp(buf, WG_JOURNAL_MAGIC, WG_JOURNAL_MAGIC_BYTES) ||\
+    (lsn > WG_JOURNAL_MAGIC_BYTES && lseek(fd, lsn, SEEK_SET) != lsn)) {
+    close(fd);
+#else
+  if(_read(fd, buf, WG_JOURNAL_MAGIC_BYTES) != WG_JOURNAL_MAGIC_BYTES ||\
+    strncmp(buf, WG_JOURNAL_MAGIC, WG_JOURNAL_MAGIC_BYTES) ||\
+    (lsn > WG_JOURNAL_MAGIC_BYTES && _lseek(fd, lsn, SEEK_SET) != lsn)) {
+    _close(fd);
+#endif
+    return -1;
+  }
+  return fd;
+}
+
+/** Create the change feed state. Used internally only.
+ *
+ */
+static void *open_change_feed(void *db, char *filename, gint from_lsn,
+  int follow)
+{
+  db_memsegment_header* dbh = dbmemsegh(db);
+  change_feed *feed;
+
+  feed = (change_feed *) malloc(sizeof(change_feed));
+  if(!feed) {
+    show_log_error(db, "Failed to allocate the change feed");
+    return NULL;
+  }
+  feed->bufsize = SHIP_BUFSIZE;
+  feed->buf = (unsigned char *) malloc(feed->bufsize);
+  if(!feed->buf) {
+    show_log_error(db, "Failed to allocate the change feed");
+    free(feed);
+    return NULL;
+  }
+
+  if(from_lsn < WG_JOURNAL_MAGIC_BYTES)
+    from_lsn = WG_JOURNAL_MAGIC_BYTES;
+  do {
+    /* make sure the serial matches the opened file */
+    feed->serial = dbh->logging.serial;
+    feed->fd = open_journal_at(db, filename, from_lsn);
+    if(feed->fd == -1 || filename || feed->serial == dbh->logging.serial)
+      break;
+#ifndef _WIN32
+    close(feed->fd);
+#else
+    _close(feed->fd);
+#endif
+  } while(1);
+  if(feed->fd == -1) {
+    show_log_error(db, "Error opening log file");
+    free(feed->buf);
+    free(feed);
+    return NULL;
+  }
+  feed->follow = follow;
+  feed->lsn = from_lsn;
+  feed->buflen = 0;
+  feed->bufpos = 0;
+  memset(feed->values, 0, sizeof(feed->values));
+  feed->nextvalue = 0;
+  return (void *) feed;
+}
 #endif /* USE_DBLOG */
 
 /** Return the name of the current journal
@@ -934,6 +1443,388 @@ abort2:
 #endif /* USE_DBLOG */
 }
 
+/** Stream the journal to a follower.
+ *
+ * Writes the journal magic and the contents of the current journal
+ * file to the file descriptor (a pipe or a socket), then keeps polling
+ * the journal for new entries. When the journal is rotated (see
+ * backup_journal()), the rest of the old file is sent and shipping
+ * continues from the start of the new journal, so the stream looks
+ * like a single journal to the receiving end. The follower should
+ * start from the state the database had when the current journal was
+ * started, for example by importing a dump.
+ *
+ * Does not need any locks. Returns only when the stream can no longer
+ * be written (normally because the follower has disconnected).
+ *
+ * Returns -1 on error.
+ */
+gint wg_ship_log(void *db, int fd)
+{
+#ifdef USE_DBLOG
+  db_memsegment_header* dbh = dbmemsegh(db);
+  char buf[SHIP_BUFSIZE];
+  gint serial;
+  int jfd, len;
+
+  serial = dbh->logging.serial;
+  if((jfd = open_journal_readonly(db)) == -1) {
+    return show_log_error(db, "Error opening log file");
+  }
+  if(check_journal(db, jfd)) {
+    JOURNAL_FAIL(jfd, -1)
+  }
+  if(write_fd(fd, WG_JOURNAL_MAGIC, WG_JOURNAL_MAGIC_BYTES)) {
+    show_log_error(db, "Error writing to the replication stream");
+    JOURNAL_FAIL(jfd, -1)
+  }
+
+  for(;;) {
+#ifndef _WIN32
+    len = read(jfd, buf, SHIP_BUFSIZE);
+#else
+    len = _read(jfd, buf, SHIP_BUFSIZE);
+#endif
+    if(len < 0) {
+      show_log_error(db, "Error reading log file");
+      JOURNAL_FAIL(jfd, -1)
+    }
+    else if(len > 0) {
+      if(write_fd(fd, buf, len)) {
+        show_log_error(db, "Error writing to the replication stream");
+        JOURNAL_FAIL(jfd, -1)
+      }
+    }
+    else if(dbh->logging.serial != serial) {
+      /* The journal was rotated. Nothing more will be appended to
+       * the old file once the serial has changed, but the last entries
+       * may have been written after we hit the end of file.
+       */
+      gint newserial;
+      int nfd;
+#ifndef _WIN32
+      while((len = read(jfd, buf, SHIP_BUFSIZE)) > 0) {
+#else
+      while((len = _read(jfd, buf, SHIP_BUFSIZE)) > 0) {
+#endif
+        if(write_fd(fd, buf, len)) {
+          show_log_error(db, "Error writing to the replication stream");
+          JOURNAL_FAIL(jfd, -1)
+        }
+      }
+      /* The new journal is created after the serial is incremented,
+       * so it may not be available immediately. The old file is
+       * kept until the new one can be read, so that we come back
+       * here on the next round. */
+      newserial = dbh->logging.serial;
+      if((nfd = open_journal_readonly(db)) == -1) {
+        ship_sleep();
+        continue;
+      }
+      if(dbh->logging.serial != newserial || check_journal(db, nfd)) {
+        /* rotated again, or the header is not written yet */
+#ifndef _WIN32
+        close(nfd);
+#else
+        _close(nfd);
+#endif
+        ship_sleep();
+        continue;
+      }
+#ifndef _WIN32
+      close(jfd);
+#else
+      _close(jfd);
+#endif
+      jfd = nfd;
+      serial = newserial;
+    }
+    else {
+      ship_sleep();
+    }
+  }
+  return 0;
+#else
+  return show_log_error(db, "Logging is disabled");
+#endif /* USE_DBLOG */
+}
+
+/** Apply a journal stream continuously.
+ *
+ * Reads journal entries from the file descriptor (as produced by
+ * wg_ship_log() on the primary) and applies them to the database
+ * as they arrive, translating the offsets in the same way as
+ * wg_replay_log(). Each entry is read completely before the write
+ * lock is acquired for it, so the database may be read while following
+ * even if the stream stalls; the caller must not hold a lock.
+ *
+ * Logging is suspended while following. When the stream ends (the
+ * primary has stopped shipping), logging is re-activated if it was
+ * active before and the database may be used as the new primary.
+ *
+ * Returns 0 when the stream ended normally
+ * Returns -1 on non-fatal error (database unmodified)
+ * Returns -2 on fatal error (database inconsistent)
+ */
+gint wg_follow_log(void *db, int fd)
+{
+#ifdef USE_DBLOG
+  db_memsegment_header* dbh = dbmemsegh(db);
+  gint active, lock, err = 0;
+  void *tran_tbl;
+  log_entry ent;
+  FILE *f;
+  int c;
+
+  if(check_journal(db, fd)) {
+    return -1;
+  }
+
+#ifndef _WIN32
+  f = fdopen(fd, "r");
+#else
+  f = _fdopen(fd, "rb");
+#endif
+  if(!f) {
+    return show_log_error(db, "Error opening the replication stream");
+  }
+
+  tran_tbl = wg_ginthash_init(db);
+  if(!tran_tbl) {
+    show_log_error(db, "Failed to create log translation table");
+    fclose(f);
+    return -1;
+  }
+
+  active = dbh->logging.active;
+  dbh->logging.active = 0; /* updates from the stream are not logged */
+
+  memset(&ent, 0, sizeof(log_entry));
+  for(;;) {
+    if((c = fgetc(f)) == EOF) {
+      if(!feof(f)) {
+        show_log_error(db, "Error reading the replication stream");
+        err = -2;
+      }
+      break;
+    }
+    /* The whole entry is read before locking, so that a slow
+     * stream does not keep the readers waiting. */
+    if(read_log_entry(db, f, c, &ent)) {
+      err = -2;
+      break;
+    }
+    if(!(lock = wg_start_write(db))) {
+      show_log_error(db, "Failed to get the write lock");
+      err = -2;
+      break;
+    }
+    if(recover_entry(db, &ent, tran_tbl)) {
+      wg_end_write(db, lock);
+      err = -2;
+      break;
+    }
+    wg_end_write(db, lock);
+  }
+
+  if(ent.buf)
+    free(ent.buf);
+  wg_ginthash_free(db, tran_tbl);
+  fclose(f);
+
+  if(!err && active) {
+    if(wg_start_logging(db)) {
+      show_log_error(db, "Stream applied but failed to reactivate logging");
+      err = -2;
+    }
+  }
+  return err;
+#else
+  return show_log_error(db, "Logging is disabled");
+#endif /* USE_DBLOG */
+}
+
+/** Subscribe to the changes in the database.
+ *
+ * Returns a change feed that decodes the current journal starting
+ * from the journal position from_lsn (0 to start from the beginning).
+ * The events are read with wg_fetch_change(). The feed follows the
+ * journal when it is rotated.
+ *
+ * The journal is read directly, so no locks are needed and the
+ * database writers are not affected. Logging needs to be active for
+ * the journal to exist.
+ *
+ * Returns NULL on error.
+ */
+void *wg_subscribe_changes(void *db, gint from_lsn)
+{
+#ifdef USE_DBLOG
+  return open_change_feed(db, NULL, from_lsn, 1);
+#else
+  show_log_error(db, "Logging is disabled");
+  return NULL;
+#endif /* USE_DBLOG */
+}
+
+/** Subscribe to the changes stored in a journal file.
+ *
+ * Like wg_subscribe_changes(), but reads the given file, for example
+ * an archived journal. Rotation is not followed.
+ *
+ * Returns NULL on error.
+ */
+void *wg_subscribe_journal_file(void *db, char *filename, gint from_lsn)
+{
+#ifdef USE_DBLOG
+  return open_change_feed(db, filename, from_lsn, 0);
+#else
+  show_log_error(db, "Logging is disabled");
+  return NULL;
+#endif /* USE_DBLOG */
+}
+
+/** Fetch the next change event from the feed.
+ *
+ * The record offsets and encoded values in the events refer to
+ * the database at the time the change was made. The values are not
+ * guaranteed to be valid after later changes, so the consumer should
+ * read the current state of the record under a read lock when needed.
+ * The value of a set event is also decoded from the journal (see
+ * wg_change_event); the strings stay valid until the next call.
+ *
+ * When the journal is rotated, a WG_CHANGE_NEWLOG event is returned and
+ * the positions of the following events refer to the new journal.
+ *
+ * If wait is non-zero, blocks until an event is available.
+ *
+ * Returns 1 if an event was stored in ev.
+ * Returns 0 if there are no more events (wait == 0).
+ * Returns -1 on error.
+ */
+gint wg_fetch_change(void *db, void *feed, wg_change_event *ev, int wait)
+{
+#ifdef USE_DBLOG
+  db_memsegment_header* dbh = dbmemsegh(db);
+  change_feed *cf = (change_feed *) feed;
+
+  for(;;) {
+    int len, rotated;
+
+    /* Decode the entries already in the buffer */
+    while(cf->bufpos < cf->buflen) {
+      gint consumed = parse_change(db, cf, cf->buf + cf->bufpos,
+        cf->buflen - cf->bufpos, ev);
+      if(consumed < 0)
+        return -1;
+      else if(!consumed)
+        break; /* incomplete entry */
+      ev->lsn = cf->lsn + cf->bufpos;
+      cf->bufpos += consumed;
+      if(ev->type) {
+        ev->next_lsn = cf->lsn + cf->bufpos;
+        ev->serial = cf->serial;
+        return 1;
+      }
+    }
+
+    /* Keep the incomplete entry and read more */
+    if(cf->bufpos) {
+      memmove(cf->buf, cf->buf + cf->bufpos, cf->buflen - cf->bufpos);
+      cf->lsn += cf->bufpos;
+      cf->buflen -= cf->bufpos;
+      cf->bufpos = 0;
+    }
+    if(cf->buflen == cf->bufsize) {
+      unsigned char *tmp = (unsigned char *) realloc(cf->buf,
+        cf->bufsize * 2);
+      if(!tmp)
+        return show_log_error(db, "Failed to allocate the change feed");
+      cf->buf = tmp;
+      cf->bufsize *= 2;
+    }
+
+    /* If the rotation happened before we reached the end of
+     * the file, the old journal is complete. */
+    rotated = (cf->follow && dbh->logging.serial != cf->serial);
+#ifndef _WIN32
+    len = read(cf->fd, cf->buf + cf->buflen, cf->bufsize - cf->buflen);
+#else
+    len = _read(cf->fd, cf->buf + cf->buflen, cf->bufsize - cf->buflen);
+#endif
+    if(len < 0) {
+      return show_log_error(db, "Error reading log file");
+    }
+    else if(len > 0) {
+      cf->buflen += len;
+      continue;
+    }
+    else if(rotated) {
+      gint serial = dbh->logging.serial;
+      int fd = open_journal_at(db, NULL, 0);
+      if(fd != -1) {
+        if(serial == dbh->logging.serial) {
+          if(cf->buflen)
+            show_log_error(db, "Incomplete entry at the end of journal");
+#ifndef _WIN32
+          close(cf->fd);
+#else
+          _close(cf->fd);
+#endif
+          cf->fd = fd;
+          cf->serial = serial;
+          cf->lsn = WG_JOURNAL_MAGIC_BYTES;
+          cf->buflen = 0;
+          ev->type = WG_CHANGE_NEWLOG;
+          ev->lsn = ev->next_lsn = cf->lsn;
+          ev->serial = cf->serial;
+          ev->record = ev->column = ev->value = 0;
+          ev->valtype = ev->intval = ev->len = 0;
+          ev->doubleval = 0;
+          ev->str = ev->extstr = NULL;
+          return 1;
+        }
+#ifndef _WIN32
+        close(fd);
+#else
+        _close(fd);
+#endif
+      }
+      /* the new journal is not ready yet, try again */
+    }
+    if(!wait)
+      return 0;
+    ship_sleep();
+  }
+#else
+  return show_log_error(db, "Logging is disabled");
+#endif /* USE_DBLOG */
+}
+
+/** Release the change feed.
+ *
+ */
+void wg_unsubscribe_changes(void *db, void *feed)
+{
+#ifdef USE_DBLOG
+  change_feed *cf = (change_feed *) feed;
+  if(cf) {
+    int i;
+#ifndef _WIN32
+    close(cf->fd);
+#else
+    _close(cf->fd);
+#endif
+    for(i=0; i<CHANGE_VALUES; i++) {
+      if(cf->values[i].str)
+        free(cf->values[i].str);
+    }
+    free(cf->buf);
+    free(cf);
+  }
+#endif /* USE_DBLOG */
+}
+
 #ifdef USE_DBLOG
 /** Write a byte buffer to the log file.
  *
@@ -47,6 +47,13 @@
 #define WG_JOURNAL_ENTRY_CMDMASK (0xe0)
 #define WG_JOURNAL_ENTRY_TYPEMASK (0x1f)
 
+/* Change event types (see wg_fetch_change()) */
+#define WG_CHANGE_CREATE 1  /* record created */
+#define WG_CHANGE_DELETE 2  /* record deleted */
+#define WG_CHANGE_SET 3     /* field value set */
+#define WG_CHANGE_META 4    /* record metadata set */
+#define WG_CHANGE_NEWLOG 5  /* journal was rotated, lsn restarts */
+
 
 /* ====== data structures ======== */
 
@@ -57,6 +64,23 @@ typedef struct {
   int umask;
 } db_handle_logdata;
 
+/** Change event decoded from the journal */
+typedef struct {
+  gint lsn;         /** journal position of the entry */
+  gint next_lsn;    /** journal position of the following entry */
+  gint serial;      /** journal serial number */
+  gint type;        /** WG_CHANGE_* */
+  gint record;      /** offset of the record */
+  gint column;      /** field number (SET) or record length (CREATE) */
+  gint value;       /** encoded value (SET) or metadata (META) */
+  gint valtype;     /** WG_*TYPE of the value (SET), 0 if not known */
+  gint intval;      /** value of WG_INTTYPE */
+  double doubleval; /** value of WG_DOUBLETYPE */
+  char *str;        /** string or blob data, '\0' terminated */
+  char *extstr;     /** language or type of str, NULL if none */
+  gint len;         /** length of str in bytes */
+} wg_change_event;
+
 /* ==== Protos ==== */
 
 gint wg_init_handle_logdata(void *db);
@@ -67,6 +91,13 @@ void wg_journal_filename(void *db, char *buf, size_t buflen);
 gint wg_start_logging(void *db);
 gint wg_stop_logging(void *db);
 gint wg_replay_log(void *db, char *filename);
+gint wg_ship_log(void *db, int fd);
+gint wg_follow_log(void *db, int fd);
+
+void *wg_subscribe_changes(void *db, gint from_lsn);
+void *wg_subscribe_journal_file(void *db, char *filename, gint from_lsn);
+gint wg_fetch_change(void *db, void *feed, wg_change_event *ev, int wait);
+void wg_unsubscribe_changes(void *db, void *feed);
 
 gint wg_log_create_record(void *db, gint length);
 gint wg_log_delete_record(void *db, gint enc);
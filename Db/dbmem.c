@@ -56,6 +56,8 @@ extern "C" {
 #include "dbfeatures.h"
 #include "dbmem.h"
 #include "dblog.h"
+#include "dbindex.h"
+#include "dblock.h"
 
 /* ====== Private headers and defs ======== */
 
@@ -342,7 +344,17 @@ void* wg_attach_memsegment(char* dbasename, gint minsize,
  * returns 0 if OK
  */
 int wg_detach_database(void* dbase) {
-  int err = detach_shared_memory(dbmemseg(dbase));
+  int err;
+
+  /* Rows of deferred updates are not in the indexes yet. They are
+   * added under the write lock; if it cannot be taken, they are
+   * discarded and the indexes stay marked as missing them. */
+  if(wg_index_delta_rows(dbase)) {
+    gint lock = wg_start_write(dbase);
+    if(lock)
+      wg_end_write(dbase, lock); /* applies the updates */
+  }
+  err = detach_shared_memory(dbmemseg(dbase));
 #ifdef USE_DATABASE_HANDLE
   if(!err) {
     free_dbhandle(dbase);
@@ -451,6 +463,7 @@ static void free_dbhandle(void *dbhandle) {
 #ifdef USE_DBLOG
   wg_cleanup_handle_logdata(dbhandle);
 #endif
+  wg_index_free_delta(dbhandle);
   free(dbhandle);
 }
 
@@ -504,6 +517,7 @@ void wg_print_code_version(void) {
 
   printf("\nlibwgdb version: %d.%d.%d\n", VERSION_MAJOR, VERSION_MINOR,
     VERSION_REV);
+  printf("segment layout: %d\n", MEMSEGMENT_LAYOUT);
   printf("byte order: %s endian\n", (i_bytes[0]==1 ? "little" : "big"));
   printf("compile-time features:\n"\
     "  64-bit encoded data: %s\n"\
@@ -511,13 +525,15 @@ void wg_print_code_version(void) {
     "  chained nodes in T-tree: %s\n"\
     "  record backlinking: %s\n"\
     "  child databases: %s\n"\
-    "  index templates: %s\n",
+    "  index templates: %s\n"\
+    "  keys in T-tree nodes: %s\n",
     (MEMSEGMENT_FEATURES & FEATURE_BITS_64BIT ? "yes" : "no"),
     (MEMSEGMENT_FEATURES & FEATURE_BITS_QUEUED_LOCKS ? "yes" : "no"),
     (MEMSEGMENT_FEATURES & FEATURE_BITS_TTREE_CHAINED ? "yes" : "no"),
     (MEMSEGMENT_FEATURES & FEATURE_BITS_BACKLINK ? "yes" : "no"),
     (MEMSEGMENT_FEATURES & FEATURE_BITS_CHILD_DB ? "yes" : "no"),
-    (MEMSEGMENT_FEATURES & FEATURE_BITS_INDEX_TMPL ? "yes" : "no"));
+    (MEMSEGMENT_FEATURES & FEATURE_BITS_INDEX_TMPL ? "yes" : "no"),
+    (MEMSEGMENT_FEATURES & FEATURE_BITS_TTREE_KEYS ? "yes" : "no"));
 }
 
 void wg_print_header_version(db_memsegment_header *dbh, int verbose) {
@@ -550,6 +566,7 @@ void wg_print_header_version(db_memsegment_header *dbh, int verbose) {
   if(verbose) {
     printf("\nheader version: %d.%d.%d\n", (version & 0xff),
       ((version>>8) & 0xff), ((version>>16) & 0xff));
+    printf("segment layout: %d\n", ((version>>24) & 0xff));
     printf("byte order: %s endian\n",
       (header_bytes[0]==magic_lsb ? "little" : "big"));
     printf("compile-time features:\n"\
@@ -558,16 +575,19 @@ void wg_print_header_version(db_memsegment_header *dbh, int verbose) {
       "  chained nodes in T-tree: %s\n"\
       "  record backlinking: %s\n"\
       "  child databases: %s\n"\
-      "  index templates: %s\n",
+      "  index templates: %s\n"\
+      "  keys in T-tree nodes: %s\n",
       (features & FEATURE_BITS_64BIT ? "yes" : "no"),
       (features & FEATURE_BITS_QUEUED_LOCKS ? "yes" : "no"),
       (features & FEATURE_BITS_TTREE_CHAINED ? "yes" : "no"),
       (features & FEATURE_BITS_BACKLINK ? "yes" : "no"),
       (features & FEATURE_BITS_CHILD_DB ? "yes" : "no"),
-      (features & FEATURE_BITS_INDEX_TMPL ? "yes" : "no"));
+      (features & FEATURE_BITS_INDEX_TMPL ? "yes" : "no"),
+      (features & FEATURE_BITS_TTREE_KEYS ? "yes" : "no"));
   } else {
-    printf("%d.%d.%d%s\n",
+    printf("%d.%d.%d (layout %d)%s\n",
       (version & 0xff), ((version>>8) & 0xff), ((version>>16) & 0xff),
+      ((version>>24) & 0xff),
       (features & FEATURE_BITS_64BIT ? " (64-bit)" : ""));
   }
 }
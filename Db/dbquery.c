@@ -43,6 +43,11 @@ extern "C" {
 #include "dbmpool.h"
 #include "dbschema.h"
 #include "dbhash.h"
+#include "dbbtree.h"
+#include "dbstats.h"
+#include "dbbitmap.h"
+#include "dbfulltext.h"
+#include "dbrtree.h"
 
 /* T-tree based scoring */
 #define TTREE_SCORE_EQUAL 5
@@ -51,6 +56,12 @@ extern "C" {
                              *  are likely to be abundant */
 #define TTREE_SCORE_MASK 5  /** matching field in template */
 
+/* Estimates based on index statistics. The selectivity of the
+ * conditions on the columns of a multi-column index after the first
+ * one is not known. */
+#define STATS_EQUAL_FACTOR 0.1
+#define STATS_RANGE_FACTOR 0.3
+
 /* Query flags for internal use */
 #define QUERY_FLAGS_PREFETCH 0x1000
 
@@ -65,6 +76,13 @@ extern "C" {
  */
 #define JSON_SCAN_UNWRAP_ARRAY
 
+/* Path keys in a JSON query (see match_json_path()) */
+#define JSON_PATH_PREFIX_LEN (sizeof(WG_JSON_PATH_PREFIX) - 1)
+#define JSON_PATH_MAX_DEPTH 99 /** objects and arrays followed on a path */
+#define IS_JSON_PATH_KEY(db, k) \
+  (wg_get_encoded_type(db, k) == WG_STRTYPE &&\
+  !strncmp(wg_decode_str(db, k), WG_JSON_PATH_PREFIX, JSON_PATH_PREFIX_LEN))
+
 struct __query_result_page {
   gint rows[QUERY_RESULTSET_PAGESIZE];
   struct __query_result_page *next;
@@ -87,13 +105,38 @@ typedef struct {
 
 /* ======= Private protos ================ */
 
+static gint usable_index(void *db, gint index_id);
 static gint most_restricting_column(void *db,
   wg_query_arg *arglist, gint argc, gint *index_id);
+static double estimate_index_rows(void *db, wg_index_header *hdr,
+  wg_query_arg *arglist, gint argc);
+static gint bitmap_query(void *db, wg_query *query, wg_query_arg *arglist,
+  gint *argc, gint index_id);
+static gint expr_query(void *db, wg_query *query, wg_query_arg *arglist,
+  gint argc);
+static gint fulltext_query(void *db, wg_query *query, wg_query_arg *arglist,
+  gint *argc);
+static gint rtree_query(void *db, wg_query *query, wg_query_arg *arglist,
+  gint argc);
+static gint rtree_column_range(void *db, wg_query_arg *arglist, gint argc,
+  gint col, double *lo, double *hi);
 static gint check_arglist(void *db, void *rec, wg_query_arg *arglist,
   gint argc);
+static gint check_condition(void *db, gint encoded, gint cond, gint value);
+static gint prefix_match(void *db, gint enc, gint prefix);
+static gint prefix_end_bound(void *db, gint prefix);
+static void *find_hash_next(void *db, gint index_id, gint data,
+  void *lastrecord);
+static gint prepare_prefix_args(void *db, wg_query_arg *arglist, gint argc,
+  wg_query_arg **xarglist, gint *xargc, gint **ends, gint *endc);
+static wg_query *build_prefetch_query(void *db, void *matchrec, gint reclen,
+  wg_query_arg *arglist, gint argc, wg_uint rowlimit);
 static gint prepare_params(void *db, void *matchrec, gint reclen,
   wg_query_arg *arglist, gint argc,
   wg_query_arg **farglist, gint *fargc);
+static gint find_column_bounds(void *db, wg_query_arg *arglist, gint argc,
+  gint col, gint *start_bound, gint *end_bound,
+  int *start_inclusive, int *end_inclusive);
 static gint find_ttree_bounds(void *db, gint index_id, gint col,
   gint start_bound, gint end_bound, gint start_inclusive, gint end_inclusive,
   gint *curr_offset, gint *curr_slot, gint *end_offset, gint *end_slot);
@@ -113,6 +156,10 @@ static gint check_and_merge_by_key(void *db, void *rec,
   wg_json_query_arg *arg, query_result_set *next_set);
 static gint check_and_merge_recursively(void *db, void *rec,
   wg_json_query_arg *arg, query_result_set *next_set, int depth);
+static gint match_json_path(void *db, gint enc, char *path, gint value,
+  int depth);
+static gint check_and_merge_by_path(void *db, void *doc,
+  wg_json_query_arg *arg, query_result_set *next_set);
 static gint prepare_json_arglist(void *db, wg_json_query_arg *arglist,
   wg_json_query_arg **sorted_arglist, gint argc,
   gint *index_id, gint *vindex_id, gint *kindex_id);
@@ -126,6 +173,17 @@ static gint show_query_error(void* db, char* errmsg);
 /* ====== Functions ============== */
 
 
+/** Check that a query can use an index
+ *  An index that is missing the rows of deferred updates (see
+ *  wg_get_index_pending()) would give incomplete results.
+ *  returns index_id if the index is usable, -1 otherwise
+ */
+static gint usable_index(void *db, gint index_id) {
+  if(index_id > 0 &&\
+    !((wg_index_header *) offsettoptr(db, index_id))->pending)
+    return index_id;
+  return -1;
+}
 
 /** Find most restricting column from query argument list
  *  This is probably a reasonable approach to optimize queries
@@ -133,6 +191,13 @@ static gint show_query_error(void* db, char* errmsg);
  *  with hash indexes.
  *  XXX: currently only considers the existence of T-tree
  *  index and nothing else.
+ *  A multi-column B-tree index is scored by the columns that it
+ *  can restrict: the leading columns with equality conditions and
+ *  the column after them. If it is chosen, its first column is
+ *  returned.
+ *  If all the indexes that could be used have statistics (see
+ *  wg_analyze_index()), the scores are not used. The index with
+ *  the smallest estimated number of rows is chosen instead.
  */
 static gint most_restricting_column(void *db,
   wg_query_arg *arglist, gint argc, gint *index_id) {
@@ -141,10 +206,12 @@ static gint most_restricting_column(void *db,
     gint column;
     int score;
     int index_id;
+    int equal;    /* column has an equality condition */
   };
   struct column_score *sc;
-  int i, j, mrc_score = -1;
-  gint mrc = -1;
+  int i, j, mrc_score = -1, multi_score = 0;
+  gint mrc = -1, multi_id = 0;
+  gint *ilist;
   db_memsegment_header* dbh = dbmemsegh(db);
 
   sc = (struct column_score *) malloc(argc * sizeof(struct column_score));
@@ -161,6 +228,7 @@ static gint most_restricting_column(void *db,
     sc[i].column = -1;
     sc[i].score = 0;
     sc[i].index_id = 0;
+    sc[i].equal = 0;
 
     /* Locate the slot for the column */
     for(j=0; j<argc; j++) {
@@ -177,11 +245,13 @@ static gint most_restricting_column(void *db,
         sc[j].score += TTREE_SCORE_EQUAL;
         if(arglist[i].value == 0) /* NULL values get a small penalty */
           sc[j].score += TTREE_SCORE_NULL;
+        sc[j].equal = 1;
         break;
       case WG_COND_LESSTHAN:
       case WG_COND_GREATER:
       case WG_COND_LTEQUAL:
       case WG_COND_GTEQUAL:
+      case WG_COND_PREFIX:
         /* these all qualify as a bound. So two bounds
          * appearing in the argument list on the same column
          * score higher than one bound. */
@@ -193,21 +263,54 @@ static gint most_restricting_column(void *db,
     }
   }
 
+  /* Score the multi-column B-tree indexes, before the column scores
+   * are adjusted. Indexes with templates are not considered. */
+  ilist = &dbh->index_control_area_header.index_list;
+  while(*ilist) {
+    gcell *ilistelem = (gcell *) offsettoptr(db, *ilist);
+    wg_index_header *hdr = (wg_index_header *) offsettoptr(db, ilistelem->car);
+
+    if(hdr->type == WG_INDEX_TYPE_BTREE && hdr->fields > 1 && !hdr->pending
+#ifdef USE_INDEX_TEMPLATE
+      && !hdr->template_offset
+#endif
+      ) {
+      int score = 0, k;
+      for(k=0; k<hdr->fields; k++) {
+        for(j=0; j<argc && sc[j].column != -1; j++) {
+          if(sc[j].column == hdr->rec_field_index[k]) break;
+        }
+        if(j == argc || sc[j].column == -1)
+          break; /* no conditions on the column */
+        score += sc[j].score;
+        if(!sc[j].equal)
+          break; /* range on the column, the rest are not ordered */
+      }
+      if(score > multi_score) {
+        multi_score = score;
+        multi_id = ilistelem->car;
+      }
+    }
+    ilist = &ilistelem->cdr;
+  }
+
   /* Now loop over the scores to find the best. */
   for(i=0; i<argc; i++) {
     if(sc[i].column == -1) break;
     /* Find the index on the column. The score is modified by the
      * estimated quality of the index (0 if no index found).
      */
-    if(sc[i].column <= MAX_INDEXED_FIELDNR) {
-      gint *ilist = &dbh->index_control_area_header.index_table[sc[i].column];
+    ilist = wg_index_column_list(db, sc[i].column, 0);
+    if(ilist) {
       while(*ilist) {
         gcell *ilistelem = (gcell *) offsettoptr(db, *ilist);
         if(ilistelem->car) {
           wg_index_header *hdr = \
             (wg_index_header *) offsettoptr(db, ilistelem->car);
 
-          if(hdr->type == WG_INDEX_TYPE_TTREE) {
+          if(hdr->fields == 1 && !hdr->pending &&\
+            (hdr->type == WG_INDEX_TYPE_TTREE ||\
+            hdr->type == WG_INDEX_TYPE_BTREE)) {
 #ifdef USE_INDEX_TEMPLATE
             /* If index templates are available, we can increase the
              * score of the index if the template has any columns matching
@@ -270,6 +373,44 @@ nextindex:
     }
   }
 
+  /* The multi-column index is used only if it restricts more
+   * than any single-column index. */
+  if(multi_id && multi_score > mrc_score) {
+    mrc = ((wg_index_header *) offsettoptr(db, multi_id))->rec_field_index[0];
+    *index_id = multi_id;
+  }
+
+  /* Compare the estimates, if every candidate has them. */
+  if(mrc_score > 0 || multi_score > 0) {
+    double best = -1, est;
+    gint best_id = 0;
+    for(i=0; i<argc && sc[i].column != -1; i++) {
+      if(!sc[i].index_id || sc[i].score <= 0)
+        continue;
+      est = estimate_index_rows(db,
+        (wg_index_header *) offsettoptr(db, sc[i].index_id), arglist, argc);
+      if(est < 0)
+        goto nostats;
+      if(!best_id || est < best) {
+        best = est;
+        best_id = sc[i].index_id;
+      }
+    }
+    if(multi_id && multi_score > 0) {
+      est = estimate_index_rows(db,
+        (wg_index_header *) offsettoptr(db, multi_id), arglist, argc);
+      if(est < 0)
+        goto nostats;
+      if(!best_id || est < best)
+        best_id = multi_id;
+    }
+    if(best_id) {
+      mrc = ((wg_index_header *) offsettoptr(db, best_id))->rec_field_index[0];
+      *index_id = best_id;
+    }
+  }
+nostats:
+
   /* TODO: does the best score have no index? In that case,
    * try to locate an index that would restrict at least
    * some columns.
@@ -278,6 +419,317 @@ nextindex:
   return mrc;
 }
 
+/** Estimate the number of rows a query reads through an index
+ *  The histogram gives the rows matching the conditions on the first
+ *  column. If every column of a multi-column index has a single value,
+ *  the average number of rows per key is used. Otherwise the conditions
+ *  on the further columns that the index is ordered by reduce the
+ *  estimate by fixed factors.
+ *  returns -1 if the index has no statistics.
+ */
+static double estimate_index_rows(void *db, wg_index_header *hdr,
+  wg_query_arg *arglist, gint argc) {
+  wg_index_stats *stats;
+  double rows = 0;
+  gint i;
+
+  if(!hdr->stats_offset)
+    return -1;
+  stats = (wg_index_stats *) offsettoptr(db, hdr->stats_offset);
+
+  for(i=0; i<hdr->fields; i++) {
+    gint start_bound = WG_ILLEGAL, end_bound = WG_ILLEGAL;
+    int start_inclusive = 0, end_inclusive = 0, equal;
+
+    find_column_bounds(db, arglist, argc, hdr->rec_field_index[i],
+      &start_bound, &end_bound, &start_inclusive, &end_inclusive);
+    equal = (start_bound != WG_ILLEGAL && end_bound != WG_ILLEGAL &&\
+      WG_COMPARE(db, start_bound, end_bound) == WG_EQUAL);
+    if(!i)
+      rows = wg_stats_range_rows(db, stats, start_bound, end_bound);
+    else if(equal)
+      rows *= STATS_EQUAL_FACTOR;
+    else if(start_bound != WG_ILLEGAL || end_bound != WG_ILLEGAL)
+      rows *= STATS_RANGE_FACTOR;
+    if(!equal)
+      return rows; /* the rest of the columns are not ordered */
+  }
+
+  if(hdr->fields > 1)
+    rows = wg_stats_key_rows(db, stats);
+  return rows;
+}
+
+/** Set up a query that combines bitmap indexes
+ *  Used when at least two columns in the argument list have a bitmap
+ *  index, or one column has and no other index was found. The values
+ *  of each column that satisfy the conditions on that column are
+ *  combined with OR, the columns are combined with AND.
+ *
+ *  The conditions on the bitmap indexed columns are removed from
+ *  arglist and *argc is updated.
+ *  returns 1 if the query was set up, 0 if the bitmap indexes are
+ *  not used.
+ */
+static gint bitmap_query(void *db, wg_query *query, wg_query_arg *arglist,
+  gint *argc, gint index_id) {
+  wg_index_header **hdrs;
+  wg_bitmap_cursor *cur;
+  gint groups = 0, values = 0, g, i, j, k;
+
+  hdrs = (wg_index_header **) malloc(*argc * sizeof(wg_index_header *));
+  if(!hdrs)
+    return 0; /* the other indexes or a full scan will do */
+
+  /* Find a bitmap index for each distinct column */
+  for(i=0; i<*argc; i++) {
+    gint *ilist;
+    for(g=0; g<groups; g++) {
+      if(hdrs[g]->rec_field_index[0] == arglist[i].column)
+        break;
+    }
+    if(g < groups)
+      continue;
+    ilist = wg_index_column_list(db, arglist[i].column, 0);
+    if(!ilist)
+      continue;
+    while(*ilist) {
+      gcell *ilistelem = (gcell *) offsettoptr(db, *ilist);
+      wg_index_header *hdr = \
+        (wg_index_header *) offsettoptr(db, ilistelem->car);
+      if(hdr->type == WG_INDEX_TYPE_BITMAP && !hdr->pending
+#ifdef USE_INDEX_TEMPLATE
+        && !hdr->template_offset
+#endif
+        ) {
+        hdrs[groups++] = hdr;
+        values += hdr->ctl.m.values;
+        break;
+      }
+      ilist = &ilistelem->cdr;
+    }
+  }
+
+  if(groups < 2 && !(groups == 1 && index_id <= 0)) {
+    free(hdrs);
+    return 0;
+  }
+  cur = wg_bitmap_new_cursor(db, groups, values);
+  if(!cur) {
+    free(hdrs);
+    return 0;
+  }
+
+  /* Select the values of each column. All rows of a value are equal
+   * in the column, so the first row decides for the others. */
+  for(g=0, k=0; g<groups; g++) {
+    gint col = hdrs[g]->rec_field_index[0];
+    gint value = BITMAP_VALUES(hdrs[g]);
+    while(value) {
+      void *rec = offsettoptr(db, wg_bitmap_value_row(db, value));
+      for(i=0; i<*argc; i++) {
+        if(arglist[i].column == col &&\
+          !check_arglist(db, rec, &arglist[i], 1))
+          break;
+      }
+      if(i == *argc)
+        cur->values[k++] = value;
+      value = ((wg_bitmap_value *) offsettoptr(db, value))->next;
+    }
+    cur->group_end[g] = k;
+  }
+
+  /* Remove the conditions covered by the bitmaps */
+  for(i=0, j=0; i<*argc; i++) {
+    for(g=0; g<groups; g++) {
+      if(hdrs[g]->rec_field_index[0] == arglist[i].column)
+        break;
+    }
+    if(g == groups)
+      arglist[j++] = arglist[i];
+  }
+  *argc = j;
+
+  query->column = hdrs[0]->rec_field_index[0];
+  query->bitmap = cur;
+  free(hdrs);
+  return 1;
+}
+
+/** Set up a query that reads the rows from an expression index
+ *  Used when the argument list has a WG_COND_EQUAL condition on an
+ *  expression of a column, and the column has an expression index
+ *  with the same expression. The index lists the rows that have the
+ *  value, all the conditions are still checked for each row.
+ *  returns 1 if the query was set up, 0 if there is no suitable index.
+ */
+static gint expr_query(void *db, wg_query *query, wg_query_arg *arglist,
+  gint argc) {
+  gint i;
+
+  for(i=0; i<argc; i++) {
+    gint expr = arglist[i].cond & WG_EXPR_MASK;
+    gint index_id, list;
+
+    if((arglist[i].cond & ~WG_EXPR_MASK) != WG_COND_EQUAL ||\
+      !VALID_INDEX_EXPR(expr))
+      continue;
+    index_id = usable_index(db,
+      wg_expr_to_index_id(db, arglist[i].column, expr, NULL, 0));
+    if(index_id <= 0)
+      continue;
+    list = wg_search_hash(db, index_id, &arglist[i].value, 1);
+    if(list < 0)
+      return 0;
+    query->qtype = WG_QTYPE_HASH;
+    query->curr_offset = list;
+    return 1;
+  }
+  return 0;
+}
+
+/** Set up a query that reads the rows from a full-text index
+ *  Used when the argument list has a WG_COND_CONTAINS_TERM condition
+ *  on a column with a full-text index. The terms of all such
+ *  conditions on that column are looked up together, the rows must
+ *  contain every term.
+ *
+ *  The conditions served by the index are removed from arglist and
+ *  *argc is updated.
+ *  returns 1 if the query was set up, 0 if there is no suitable index.
+ */
+static gint fulltext_query(void *db, wg_query *query, wg_query_arg *arglist,
+  gint *argc) {
+  wg_index_header *hdr = NULL;
+  wg_fulltext_cursor *cur;
+  char *text;
+  gint col = -1, len = 0, i, j;
+
+  for(i=0; i<*argc && !hdr; i++) {
+    gint *ilist;
+    if(arglist[i].cond != WG_COND_CONTAINS_TERM ||\
+      wg_get_encoded_type(db, arglist[i].value) != WG_STRTYPE)
+      continue;
+    ilist = wg_index_column_list(db, arglist[i].column, 0);
+    while(ilist && *ilist) {
+      gcell *ilistelem = (gcell *) offsettoptr(db, *ilist);
+      wg_index_header *ihdr = \
+        (wg_index_header *) offsettoptr(db, ilistelem->car);
+      if(ihdr->type == WG_INDEX_TYPE_FULLTEXT && !ihdr->pending
+#ifdef USE_INDEX_TEMPLATE
+        && !ihdr->template_offset
+#endif
+        ) {
+        hdr = ihdr;
+        col = arglist[i].column;
+        break;
+      }
+      ilist = &ilistelem->cdr;
+    }
+  }
+  if(!hdr)
+    return 0;
+
+  /* Join the terms of the conditions on the column */
+  for(i=0; i<*argc; i++) {
+    if(arglist[i].column == col && arglist[i].cond == WG_COND_CONTAINS_TERM &&\
+      wg_get_encoded_type(db, arglist[i].value) == WG_STRTYPE)
+      len += strlen(wg_decode_str(db, arglist[i].value)) + 1;
+  }
+  text = (char *) malloc(len + 1);
+  if(!text)
+    return 0; /* the other indexes or a full scan will do */
+  text[0] = '\0';
+  for(i=0; i<*argc; i++) {
+    if(arglist[i].column == col && arglist[i].cond == WG_COND_CONTAINS_TERM &&\
+      wg_get_encoded_type(db, arglist[i].value) == WG_STRTYPE) {
+      strcat(text, wg_decode_str(db, arglist[i].value));
+      strcat(text, " ");
+    }
+  }
+  cur = wg_fulltext_new_cursor(db, hdr, text, WG_FULLTEXT_AND);
+  free(text);
+  if(!cur)
+    return 0;
+
+  /* Remove the conditions covered by the index */
+  for(i=0, j=0; i<*argc; i++) {
+    if(arglist[i].column != col || arglist[i].cond != WG_COND_CONTAINS_TERM ||\
+      wg_get_encoded_type(db, arglist[i].value) != WG_STRTYPE)
+      arglist[j++] = arglist[i];
+  }
+  *argc = j;
+
+  query->column = col;
+  query->fulltext = cur;
+  return 1;
+}
+
+/** Set up a query that reads the rows from an R-tree index
+ *  Used when both columns of an R-tree index are restricted to a
+ *  closed range of numbers. The index returns the rows with the point
+ *  inside the box of the two ranges.
+ *
+ *  The index compares the values as numbers, while the conditions
+ *  compare values of different types by the type. The bounds of
+ *  a column must therefore have the same type, and all the
+ *  conditions are still checked for each row.
+ *  returns 1 if the query was set up, 0 if there is no suitable index.
+ */
+static gint rtree_query(void *db, wg_query *query, wg_query_arg *arglist,
+  gint argc) {
+  gint i;
+
+  for(i=0; i<argc; i++) {
+    gint *ilist = wg_index_column_list(db, arglist[i].column, 0);
+    while(ilist && *ilist) {
+      gcell *ilistelem = (gcell *) offsettoptr(db, *ilist);
+      wg_index_header *hdr = \
+        (wg_index_header *) offsettoptr(db, ilistelem->car);
+      wg_rtree_box box;
+
+      if(hdr->type == WG_INDEX_TYPE_RTREE && !hdr->pending
+#ifdef USE_INDEX_TEMPLATE
+        && !hdr->template_offset
+#endif
+        && !rtree_column_range(db, arglist, argc, hdr->rec_field_index[0],
+          &box.lo[0], &box.hi[0])
+        && !rtree_column_range(db, arglist, argc, hdr->rec_field_index[1],
+          &box.lo[1], &box.hi[1])) {
+        wg_rtree_cursor *cur = wg_rtree_new_cursor(db, hdr, &box);
+        if(!cur)
+          return 0;
+        query->rtree = cur;
+        return 1;
+      }
+      ilist = &ilistelem->cdr;
+    }
+  }
+  return 0;
+}
+
+/** Find the numeric range of a column for the R-tree query
+ *  returns 0 if the column has both bounds and they are numbers
+ *  of the same type, -1 otherwise.
+ */
+static gint rtree_column_range(void *db, wg_query_arg *arglist, gint argc,
+  gint col, double *lo, double *hi) {
+  gint start_bound = WG_ILLEGAL, end_bound = WG_ILLEGAL;
+  int start_inclusive = 0, end_inclusive = 0;
+
+  /* Conditions that do not form a range only make the result smaller,
+   * they are checked for each row anyway. */
+  find_column_bounds(db, arglist, argc, col,
+    &start_bound, &end_bound, &start_inclusive, &end_inclusive);
+  if(start_bound == WG_ILLEGAL || end_bound == WG_ILLEGAL ||\
+    wg_get_encoded_type(db, start_bound) != \
+      wg_get_encoded_type(db, end_bound))
+    return -1;
+  if(wg_rtree_coord(db, start_bound, lo) || wg_rtree_coord(db, end_bound, hi))
+    return -1;
+  return 0;
+}
+
 /** Check a record against list of conditions
  *  returns 1 if the record matches
  *  returns 0 if the record fails at least one condition
@@ -299,39 +751,97 @@ static gint check_arglist(void *db, void *rec, wg_query_arg *arglist,
                  * concept of comparisons to NULL always failing.
                  */
 
-    switch(arglist[i].cond) {
-      case WG_COND_EQUAL:
-        if(WG_COMPARE(db, encoded, arglist[i].value) != WG_EQUAL)
-          return 0;
-        break;
-      case WG_COND_LESSTHAN:
-        if(WG_COMPARE(db, encoded, arglist[i].value) != WG_LESSTHAN)
-          return 0;
-        break;
-      case WG_COND_GREATER:
-        if(WG_COMPARE(db, encoded, arglist[i].value) != WG_GREATER)
-          return 0;
-        break;
-      case WG_COND_LTEQUAL:
-        if(WG_COMPARE(db, encoded, arglist[i].value) == WG_GREATER)
-          return 0;
-        break;
-      case WG_COND_GTEQUAL:
-        if(WG_COMPARE(db, encoded, arglist[i].value) == WG_LESSTHAN)
-          return 0;
-        break;
-      case WG_COND_NOT_EQUAL:
-        if(WG_COMPARE(db, encoded, arglist[i].value) == WG_EQUAL)
-          return 0;
-        break;
-      default:
-        break;
+    if(arglist[i].cond & WG_EXPR_MASK) {
+      /* The condition applies to the value of the expression */
+      gint exprval, match;
+      if(wg_index_expr_value(db, arglist[i].cond & WG_EXPR_MASK,
+        encoded, &exprval))
+        return 0;
+      match = check_condition(db, exprval, arglist[i].cond & ~WG_EXPR_MASK,
+        arglist[i].value);
+      wg_free_query_param(db, exprval);
+      if(!match)
+        return 0;
     }
+    else if(!check_condition(db, encoded, arglist[i].cond, arglist[i].value))
+      return 0;
   }
 
   return 1;
 }
 
+/** Check a value against a condition
+ *  returns 1 if the value matches
+ *  returns 0 otherwise
+ */
+static gint check_condition(void *db, gint encoded, gint cond, gint value) {
+  switch(cond) {
+    case WG_COND_EQUAL:
+      if(WG_COMPARE(db, encoded, value) != WG_EQUAL)
+        return 0;
+      break;
+    case WG_COND_LESSTHAN:
+      if(WG_COMPARE(db, encoded, value) != WG_LESSTHAN)
+        return 0;
+      break;
+    case WG_COND_GREATER:
+      if(WG_COMPARE(db, encoded, value) != WG_GREATER)
+        return 0;
+      break;
+    case WG_COND_LTEQUAL:
+      if(WG_COMPARE(db, encoded, value) == WG_GREATER)
+        return 0;
+      break;
+    case WG_COND_GTEQUAL:
+      if(WG_COMPARE(db, encoded, value) == WG_LESSTHAN)
+        return 0;
+      break;
+    case WG_COND_NOT_EQUAL:
+      if(WG_COMPARE(db, encoded, value) == WG_EQUAL)
+        return 0;
+      break;
+    case WG_COND_CONTAINS_TERM:
+      if(!wg_fulltext_contains(db, encoded, value))
+        return 0;
+      break;
+    case WG_COND_PREFIX:
+      if(!prefix_match(db, encoded, value))
+        return 0;
+      break;
+    default:
+      break;
+  }
+  return 1;
+}
+
+/** Check if a value starts with a prefix
+ *  Strings are compared by the characters only (the language is
+ *  ignored, as in wg_compare()). URIs must have the same namespace
+ *  prefix, the rest of the URI is compared.
+ *  returns 1 if the value matches, 0 otherwise.
+ */
+static gint prefix_match(void *db, gint enc, gint prefix) {
+  gint type = wg_get_encoded_type(db, prefix);
+  char *str, *pre;
+
+  if(wg_get_encoded_type(db, enc) != type)
+    return 0;
+  if(type == WG_STRTYPE) {
+    str = wg_decode_str(db, enc);
+    pre = wg_decode_str(db, prefix);
+  } else if(type == WG_URITYPE) {
+    char *ns = wg_decode_uri_prefix(db, enc);
+    char *prens = wg_decode_uri_prefix(db, prefix);
+    /* a missing namespace is the same as an empty one */
+    if(strcmp((ns ? ns : ""), (prens ? prens : "")))
+      return 0;
+    str = wg_decode_uri(db, enc);
+    pre = wg_decode_uri(db, prefix);
+  } else
+    return 0;
+  return !strncmp(str, pre, strlen(pre));
+}
+
 /** Prepare query parameters
  *
  * - Validates matchrec and arglist
@@ -435,9 +945,102 @@ static gint prepare_params(void *db, void *matchrec, gint reclen,
   return 0;
 }
 
+/** Find the bounds of the values of a column from the argument list
+ *  The bounds are left unchanged if there are no conditions on the column.
+ *  returns 1 if there is a WG_COND_NOT_EQUAL, WG_COND_CONTAINS_TERM or
+ *  WG_COND_PREFIX condition or a condition on an expression of the
+ *  column, 0 otherwise.
+ */
+static gint find_column_bounds(void *db, wg_query_arg *arglist, gint argc,
+  gint col, gint *start_bound, gint *end_bound,
+  int *start_inclusive, int *end_inclusive) {
+  int i;
+  gint not_equal = 0;
+
+  for(i=0; i<argc; i++) {
+    if(arglist[i].column != col) continue;
+    if(arglist[i].cond & WG_EXPR_MASK) {
+      /* A condition on an expression does not bound the values */
+      not_equal = 1;
+      continue;
+    }
+    switch(arglist[i].cond) {
+      case WG_COND_EQUAL:
+        /* Set bounds as if we had val >= 1 & val <= 1 */
+        if(*start_bound==WG_ILLEGAL ||\
+          WG_COMPARE(db, *start_bound, arglist[i].value)==WG_LESSTHAN) {
+          *start_bound = arglist[i].value;
+          *start_inclusive = 1;
+        }
+        if(*end_bound==WG_ILLEGAL ||\
+          WG_COMPARE(db, *end_bound, arglist[i].value)==WG_GREATER) {
+          *end_bound = arglist[i].value;
+          *end_inclusive = 1;
+        }
+        break;
+      case WG_COND_LESSTHAN:
+        /* No earlier right bound or new end bound is a smaller
+         * value (reducing the result set). The result set is also
+         * possibly reduced if the value is equal, because this
+         * condition is non-inclusive. */
+        if(*end_bound==WG_ILLEGAL ||\
+          WG_COMPARE(db, *end_bound, arglist[i].value)!=WG_LESSTHAN) {
+          *end_bound = arglist[i].value;
+          *end_inclusive = 0;
+        }
+        break;
+      case WG_COND_GREATER:
+        /* No earlier left bound or new left bound is >= of old value */
+        if(*start_bound==WG_ILLEGAL ||\
+          WG_COMPARE(db, *start_bound, arglist[i].value)!=WG_GREATER) {
+          *start_bound = arglist[i].value;
+          *start_inclusive = 0;
+        }
+        break;
+      case WG_COND_LTEQUAL:
+        /* Similar to "less than", but inclusive */
+        if(*end_bound==WG_ILLEGAL ||\
+          WG_COMPARE(db, *end_bound, arglist[i].value)==WG_GREATER) {
+          *end_bound = arglist[i].value;
+          *end_inclusive = 1;
+        }
+        break;
+      case WG_COND_GTEQUAL:
+        /* Similar to "greater", but inclusive */
+        if(*start_bound==WG_ILLEGAL ||\
+          WG_COMPARE(db, *start_bound, arglist[i].value)==WG_LESSTHAN) {
+          *start_bound = arglist[i].value;
+          *start_inclusive = 1;
+        }
+        break;
+      case WG_COND_PREFIX:
+        /* Only the prefixes that have no upper bound are left in
+         * the argument list (see prepare_prefix_args()). The prefix
+         * is the lower bound, the rest of the range is checked
+         * for each row. */
+        if(*start_bound==WG_ILLEGAL ||\
+          WG_COMPARE(db, *start_bound, arglist[i].value)==WG_LESSTHAN) {
+          *start_bound = arglist[i].value;
+          *start_inclusive = 1;
+        }
+        not_equal = 1;
+        break;
+      case WG_COND_NOT_EQUAL:
+      case WG_COND_CONTAINS_TERM:
+        /* Cannot be satisfied by a continuous range of values */
+        not_equal = 1;
+        break;
+      default:
+        show_query_error(db, "Invalid condition (ignoring)");
+        break;
+    }
+  }
+  return not_equal;
+}
+
 /*
  * Locate the node offset and slot for start and end bound
- * in a T-tree index.
+ * in a T-tree or B-tree index.
  *
  * return -1 on error
  * return 0 on success
@@ -454,6 +1057,12 @@ static gint find_ttree_bounds(void *db, gint index_id, gint col,
   wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
   struct wg_tnode *node;
 
+  if(hdr->type == WG_INDEX_TYPE_BTREE) {
+    return wg_btree_find_range(db, hdr, NULL, 0, start_bound, end_bound,
+      start_inclusive, end_inclusive,
+      curr_offset, curr_slot, end_offset, end_slot);
+  }
+
   if(start_bound==WG_ILLEGAL) {
     /* Find leftmost node in index */
 #ifdef TTREE_CHAINED_NODES
@@ -685,6 +1294,10 @@ static wg_query *internal_build_query(void *db, void *matchrec, gint reclen,
   }
 #endif
 
+  /* The query sees the deferred index updates of this handle */
+  if(wg_flush_index_updates(db))
+    return NULL;
+
   /* Check and prepare the parameters. If there was an error,
    * prepare_params() does it's own cleanup so we can (and should)
    * return immediately.
@@ -700,13 +1313,28 @@ static wg_query *internal_build_query(void *db, void *matchrec, gint reclen,
     if(full_arglist) free(full_arglist);
     return NULL;
   }
+  query->qtype = 0;
+  query->bitmap = NULL;
+  query->fulltext = NULL;
+  query->rtree = NULL;
 
   if(fargc) {
     /* Find the best (hopefully) index to base the query on.
      * Then initialise the query object to the first row in the
-     * query result set.
-     * XXX: only considering T-tree indexes now. */
+     * query result set. An expression index is used for an equal
+     * condition on the expression, a full-text index for term
+     * conditions, an R-tree index for a box on its two columns.
+     * Bitmap indexes are combined if there are several, otherwise
+     * T-tree and B-tree indexes are preferred. */
     col = most_restricting_column(db, full_arglist, fargc, &index_id);
+    if(expr_query(db, query, full_arglist, fargc))
+      index_id = -1;
+    else if(fulltext_query(db, query, full_arglist, &fargc))
+      index_id = -1;
+    else if(rtree_query(db, query, full_arglist, fargc))
+      index_id = -1;
+    else if(bitmap_query(db, query, full_arglist, &fargc, index_id))
+      index_id = -1;
   }
   else {
     /* Create a "full scan" query with no arguments. */
@@ -715,11 +1343,15 @@ static wg_query *internal_build_query(void *db, void *matchrec, gint reclen,
   }
 
   if(index_id > 0) {
+    wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
     int start_inclusive = 0, end_inclusive = 0;
     gint start_bound = WG_ILLEGAL; /* encoded values */
     gint end_bound = WG_ILLEGAL;
+    gint prefix[MAX_INDEX_FIELDS];
+    gint prefix_count = 0, err;
 
-    query->qtype = WG_QTYPE_TTREE;
+    query->qtype = (hdr->type == WG_INDEX_TYPE_BTREE ?
+      WG_QTYPE_BTREE : WG_QTYPE_TTREE);
     query->column = col;
     query->curr_offset = 0;
     query->curr_slot = -1;
@@ -748,67 +1380,32 @@ static wg_query *internal_build_query(void *db, void *matchrec, gint reclen,
      *      containing 1. The result set begins with that value, scan left
      *      until the end of chain is reached.
      */
-    for(i=0; i<fargc; i++) {
-      if(full_arglist[i].column != col) continue;
-      switch(full_arglist[i].cond) {
-        case WG_COND_EQUAL:
-          /* Set bounds as if we had val >= 1 & val <= 1 */
-          if(start_bound==WG_ILLEGAL ||\
-            WG_COMPARE(db, start_bound, full_arglist[i].value)==WG_LESSTHAN) {
-            start_bound = full_arglist[i].value;
-            start_inclusive = 1;
-          }
-          if(end_bound==WG_ILLEGAL ||\
-            WG_COMPARE(db, end_bound, full_arglist[i].value)==WG_GREATER) {
-            end_bound = full_arglist[i].value;
-            end_inclusive = 1;
-          }
-          break;
-        case WG_COND_LESSTHAN:
-          /* No earlier right bound or new end bound is a smaller
-           * value (reducing the result set). The result set is also
-           * possibly reduced if the value is equal, because this
-           * condition is non-inclusive. */
-          if(end_bound==WG_ILLEGAL ||\
-            WG_COMPARE(db, end_bound, full_arglist[i].value)!=WG_LESSTHAN) {
-            end_bound = full_arglist[i].value;
-            end_inclusive = 0;
-          }
-          break;
-        case WG_COND_GREATER:
-          /* No earlier left bound or new left bound is >= of old value */
-          if(start_bound==WG_ILLEGAL ||\
-            WG_COMPARE(db, start_bound, full_arglist[i].value)!=WG_GREATER) {
-            start_bound = full_arglist[i].value;
-            start_inclusive = 0;
-          }
-          break;
-        case WG_COND_LTEQUAL:
-          /* Similar to "less than", but inclusive */
-          if(end_bound==WG_ILLEGAL ||\
-            WG_COMPARE(db, end_bound, full_arglist[i].value)==WG_GREATER) {
-            end_bound = full_arglist[i].value;
-            end_inclusive = 1;
-          }
-          break;
-        case WG_COND_GTEQUAL:
-          /* Similar to "greater", but inclusive */
-          if(start_bound==WG_ILLEGAL ||\
-            WG_COMPARE(db, start_bound, full_arglist[i].value)==WG_LESSTHAN) {
-            start_bound = full_arglist[i].value;
-            start_inclusive = 1;
-          }
-          break;
-        case WG_COND_NOT_EQUAL:
-          /* Force use of full argument list to check each row in the result
-           * set since we have a condition we cannot satisfy using
-           * a continuous range of T-tree values alone
-           */
-          query->column = -1;
-          break;
-        default:
-          show_query_error(db, "Invalid condition (ignoring)");
+    if(hdr->fields == 1) {
+      if(find_column_bounds(db, full_arglist, fargc, col,
+          &start_bound, &end_bound, &start_inclusive, &end_inclusive)) {
+        /* Force use of full argument list to check each row in the result
+         * set since we have a condition we cannot satisfy using
+         * a continuous range of T-tree values alone
+         */
+        query->column = -1;
+      }
+    } else {
+      /* Multi-column B-tree index. The leading columns that are
+       * restricted to a single value are used as the key prefix, the
+       * bounds of the next column give the range. The other conditions
+       * are checked for each row.
+       */
+      query->column = -1;
+      for(i=0; i<hdr->fields; i++) {
+        start_bound = end_bound = WG_ILLEGAL;
+        start_inclusive = end_inclusive = 0;
+        find_column_bounds(db, full_arglist, fargc, hdr->rec_field_index[i],
+          &start_bound, &end_bound, &start_inclusive, &end_inclusive);
+        if(i == hdr->fields - 1 || start_bound == WG_ILLEGAL ||\
+          end_bound == WG_ILLEGAL || !start_inclusive || !end_inclusive ||\
+          WG_COMPARE(db, start_bound, end_bound) != WG_EQUAL)
           break;
+        prefix[prefix_count++] = start_bound;
       }
     }
 
@@ -823,10 +1420,17 @@ static wg_query *internal_build_query(void *db, void *matchrec, gint reclen,
     }
 
     /* Now find the bounding nodes for the query */
-    if(find_ttree_bounds(db, index_id, col,
+    if(hdr->fields > 1)
+      err = wg_btree_find_range(db, hdr, prefix, prefix_count,
+        start_bound, end_bound, start_inclusive, end_inclusive,
+        &query->curr_offset, &query->curr_slot, &query->end_offset,
+        &query->end_slot);
+    else
+      err = find_ttree_bounds(db, index_id, col,
         start_bound, end_bound, start_inclusive, end_inclusive,
         &query->curr_offset, &query->curr_slot, &query->end_offset,
-        &query->end_slot)) {
+        &query->end_slot);
+    if(err) {
       free(query);
       free(full_arglist);
       return NULL;
@@ -836,6 +1440,22 @@ static wg_query *internal_build_query(void *db, void *matchrec, gint reclen,
      * end nodes/slots, if "descending" sort order is needed.
      */
 
+  } else if(query->bitmap) {
+    /* The rows come from the bitmap cursor, query->column is already
+     * set and the bitmap conditions are removed from the arguments. */
+    query->qtype = WG_QTYPE_BITMAP;
+  } else if(query->fulltext) {
+    /* Same as above, the rows come from the full-text index. */
+    query->qtype = WG_QTYPE_FULLTEXT;
+  } else if(query->rtree) {
+    /* The rows come from the R-tree index, the whole argument list
+     * is checked for each row. */
+    query->qtype = WG_QTYPE_RTREE;
+    query->column = -1;
+  } else if(query->qtype == WG_QTYPE_HASH) {
+    /* The rows come from the row list of an expression index, the
+     * whole argument list is checked for each row. */
+    query->column = -1;
   } else {
     /* Nothing better than full scan available */
     void *rec;
@@ -853,9 +1473,11 @@ static wg_query *internal_build_query(void *db, void *matchrec, gint reclen,
 
   /* Now attach the argument list to the query. If the query is based
    * on a column index, we will create a slimmer copy that does not contain
-   * the conditions already satisfied by the index bounds.
+   * the conditions already satisfied by the index bounds. The full-text
+   * index only satisfies the term conditions, which fulltext_query()
+   * has already removed.
    */
-  if(query->column == -1) {
+  if(query->column == -1 || query->fulltext) {
     query->arglist = full_arglist;
     query->argc = fargc;
   }
@@ -935,6 +1557,18 @@ static wg_query *internal_build_query(void *db, void *matchrec, gint reclen,
     }
 
     /* Finally, convert the query type. */
+    if(query->bitmap) {
+      wg_bitmap_free_cursor(db, (wg_bitmap_cursor *) query->bitmap);
+      query->bitmap = NULL;
+    }
+    if(query->fulltext) {
+      wg_fulltext_free_cursor(db, (wg_fulltext_cursor *) query->fulltext);
+      query->fulltext = NULL;
+    }
+    if(query->rtree) {
+      wg_rtree_free_cursor(db, (wg_rtree_cursor *) query->rtree);
+      query->rtree = NULL;
+    }
     query->qtype = WG_QTYPE_PREFETCH;
   }
 
@@ -953,8 +1587,7 @@ static wg_query *internal_build_query(void *db, void *matchrec, gint reclen,
 wg_query *wg_make_query(void *db, void *matchrec, gint reclen,
   wg_query_arg *arglist, gint argc) {
 
-  return internal_build_query(db,
-    matchrec, reclen, arglist, argc, QUERY_FLAGS_PREFETCH, 0);
+  return build_prefetch_query(db, matchrec, reclen, arglist, argc, 0);
 }
 
 /** Create a query object and pre-fetch rowlimit number of rows.
@@ -965,8 +1598,39 @@ wg_query *wg_make_query(void *db, void *matchrec, gint reclen,
 wg_query *wg_make_query_rc(void *db, void *matchrec, gint reclen,
   wg_query_arg *arglist, gint argc, wg_uint rowlimit) {
 
-  return internal_build_query(db,
-    matchrec, reclen, arglist, argc, QUERY_FLAGS_PREFETCH, rowlimit);
+  return build_prefetch_query(db, matchrec, reclen, arglist, argc, rowlimit);
+}
+
+/** Build a query and pre-fetch the rows
+ *
+ * The prefix conditions are turned into ranges first. The upper bounds
+ * of the ranges are allocated for the query and released when the rows
+ * have been fetched; the query does not read its arguments after that.
+ *
+ * returns NULL if constructing the query fails. Otherwise returns a pointer
+ * to a wg_query object.
+ */
+static wg_query *build_prefetch_query(void *db, void *matchrec, gint reclen,
+  wg_query_arg *arglist, gint argc, wg_uint rowlimit) {
+  wg_query_arg *xarglist;
+  wg_query *query;
+  gint *ends, xargc, endc, i;
+
+  if(prepare_prefix_args(db, arglist, argc, &xarglist, &xargc, &ends, &endc))
+    return NULL;
+  if(!xarglist) {
+    return internal_build_query(db,
+      matchrec, reclen, arglist, argc, QUERY_FLAGS_PREFETCH, rowlimit);
+  }
+
+  query = internal_build_query(db,
+    matchrec, reclen, xarglist, xargc, QUERY_FLAGS_PREFETCH, rowlimit);
+  for(i=0; i<endc; i++)
+    wg_free_query_param(db, ends[i]);
+  if(ends)
+    free(ends);
+  free(xarglist);
+  return query;
 }
 
 
@@ -1078,6 +1742,85 @@ void *wg_fetch(void *db, wg_query *query) {
         return rec;
     }
   }
+  else if(query->qtype == WG_QTYPE_BTREE) {
+    struct wg_bnode *node;
+
+    for(;;) {
+      if(!query->curr_offset) {
+        /* No more leaves to examine */
+        return NULL;
+      }
+      node = (struct wg_bnode *) offsettoptr(db, query->curr_offset);
+      rec = offsettoptr(db, node->u.leaf.rec[query->curr_slot]);
+
+      /* Advance the cursor, following the leaf chain */
+      if(query->curr_offset==query->end_offset && \
+        query->curr_slot==query->end_slot) {
+        query->curr_offset = 0;
+      } else {
+        query->curr_slot += query->direction;
+        if(query->curr_slot < 0) {
+          query->curr_offset = node->prev_offset;
+          if(query->curr_offset) {
+            node = (struct wg_bnode *) offsettoptr(db, query->curr_offset);
+            query->curr_slot = node->count - 1;
+          }
+        } else if(query->curr_slot >= node->count) {
+          query->curr_offset = node->next_offset;
+          query->curr_slot = 0;
+        }
+      }
+
+      if(!query->arglist || \
+        check_arglist(db, rec, query->arglist, query->argc))
+        return rec;
+    }
+  }
+  else if(query->qtype == WG_QTYPE_BITMAP) {
+    gint offset;
+
+    while((offset = wg_bitmap_next(db,
+      (wg_bitmap_cursor *) query->bitmap))) {
+      rec = offsettoptr(db, offset);
+      if(!query->arglist || \
+        check_arglist(db, rec, query->arglist, query->argc))
+        return rec;
+    }
+    return NULL;
+  }
+  else if(query->qtype == WG_QTYPE_FULLTEXT) {
+    gint offset;
+
+    while((offset = wg_fulltext_next(db,
+      (wg_fulltext_cursor *) query->fulltext))) {
+      rec = offsettoptr(db, offset);
+      if(!query->arglist || \
+        check_arglist(db, rec, query->arglist, query->argc))
+        return rec;
+    }
+    return NULL;
+  }
+  else if(query->qtype == WG_QTYPE_RTREE) {
+    gint offset;
+
+    while((offset = wg_rtree_next(db,
+      (wg_rtree_cursor *) query->rtree))) {
+      rec = offsettoptr(db, offset);
+      if(check_arglist(db, rec, query->arglist, query->argc))
+        return rec;
+    }
+    return NULL;
+  }
+  else if(query->qtype == WG_QTYPE_HASH) {
+    while(query->curr_offset) {
+      gcell *rec_cell = (gcell *) offsettoptr(db, query->curr_offset);
+      rec = offsettoptr(db, rec_cell->car);
+      query->curr_offset = rec_cell->cdr;
+      if(check_arglist(db, rec, query->arglist, query->argc))
+        return rec;
+    }
+    return NULL;
+  }
   if(query->qtype == WG_QTYPE_PREFETCH) {
     if(query->curr_page) {
       query_result_page *currpage = (query_result_page *) query->curr_page;
@@ -1110,9 +1853,123 @@ void wg_free_query(void *db, wg_query *query) {
     free(query->arglist);
   if(query->qtype==WG_QTYPE_PREFETCH && query->mpool)
     wg_free_mpool(db, query->mpool);
+  if(query->bitmap)
+    wg_bitmap_free_cursor(db, (wg_bitmap_cursor *) query->bitmap);
+  if(query->fulltext)
+    wg_fulltext_free_cursor(db, (wg_fulltext_cursor *) query->fulltext);
+  if(query->rtree)
+    wg_rtree_free_cursor(db, (wg_rtree_cursor *) query->rtree);
   free(query);
 }
 
+/** Turn the prefix conditions into ranges
+ *
+ * A WG_COND_PREFIX condition with an upper bound (see prefix_end_bound())
+ * is replaced with "value >= prefix" and "value < bound". This is the
+ * same set of values, and the T-tree and B-tree indexes find it as
+ * a single range. The other prefix conditions are kept.
+ *
+ * Returns 0 on success, non-0 on error.
+ *
+ * If there are no prefix conditions, *xarglist is set to NULL. Otherwise
+ * *xarglist points to a newly allocated argument list of *xargc elements
+ * and *ends to an array of the *endc upper bounds that were encoded
+ * (NULL if there are none). The bounds need to be released with
+ * wg_free_query_param().
+ */
+static gint prepare_prefix_args(void *db, wg_query_arg *arglist, gint argc,
+  wg_query_arg **xarglist, gint *xargc, gint **ends, gint *endc) {
+  wg_query_arg *tmp;
+  gint i, prefixes = 0;
+
+  *xarglist = NULL;
+  *ends = NULL;
+  *endc = 0;
+  for(i=0; arglist && i<argc; i++) {
+    if(arglist[i].cond == WG_COND_PREFIX) {
+      gint type = wg_get_encoded_type(db, arglist[i].value);
+      if(type != WG_STRTYPE && type != WG_URITYPE) {
+        show_query_error(db, "Prefix condition needs a string or a URI");
+        return -1;
+      }
+      prefixes++;
+    }
+  }
+  if(!prefixes)
+    return 0;
+
+  tmp = (wg_query_arg *) malloc((argc + prefixes) * sizeof(wg_query_arg));
+  *ends = (gint *) malloc(prefixes * sizeof(gint));
+  if(!tmp || !*ends) {
+    show_query_error(db, "Failed to allocate memory");
+    if(tmp) free(tmp);
+    if(*ends) free(*ends);
+    *ends = NULL;
+    return -2;
+  }
+
+  *xargc = argc;
+  for(i=0; i<argc; i++) {
+    tmp[i] = arglist[i];
+    if(arglist[i].cond == WG_COND_PREFIX) {
+      gint end = prefix_end_bound(db, arglist[i].value);
+      if(end != WG_ILLEGAL) {
+        tmp[i].cond = WG_COND_GTEQUAL;
+        tmp[*xargc].column = arglist[i].column;
+        tmp[*xargc].cond = WG_COND_LESSTHAN;
+        tmp[(*xargc)++].value = end;
+        (*ends)[(*endc)++] = end;
+      }
+    }
+  }
+  *xarglist = tmp;
+  return 0;
+}
+
+/** Encode the upper bound of the values that start with a prefix
+ *
+ * The bound is the smallest string that is greater than all the
+ * strings with the prefix: the trailing 0xff bytes of the prefix are
+ * dropped and the last byte is incremented. A URI bound keeps the
+ * namespace prefix.
+ *
+ * Returns an encoded query parameter, WG_ILLEGAL if the prefix has no
+ * bound (it is empty or consists of 0xff bytes) or if encoding fails.
+ */
+static gint prefix_end_bound(void *db, gint prefix) {
+  gint type = wg_get_encoded_type(db, prefix);
+  gint end;
+  char *str, *succ;
+  size_t len;
+
+  if(type == WG_STRTYPE)
+    str = wg_decode_str(db, prefix);
+  else if(type == WG_URITYPE)
+    str = wg_decode_uri(db, prefix);
+  else
+    return WG_ILLEGAL;
+
+  len = (str ? strlen(str) : 0);
+  while(len && (unsigned char) str[len-1] == 0xff)
+    len--;
+  if(!len)
+    return WG_ILLEGAL;
+  succ = (char *) malloc(len + 1);
+  if(!succ)
+    return WG_ILLEGAL;
+  memcpy(succ, str, len);
+  succ[len-1] = (char) ((unsigned char) succ[len-1] + 1);
+  succ[len] = '\0';
+
+  if(type == WG_STRTYPE)
+    end = wg_encode_query_param_str(db, succ, NULL);
+  else
+    end = wg_encode_query_param_uri(db, succ,
+      wg_decode_uri_prefix(db, prefix));
+  free(succ);
+  return end;
+}
+
 /* ----------- query parameter preparing functions -------------*/
 
 /* Types that use no storage are encoded
@@ -1740,6 +2597,81 @@ static gint check_and_merge_recursively(void *db, void *rec,
   return 0; /* no match */
 }
 
+/*
+ * Check if a value of a document matches a path in a query clause.
+ * enc is the value reached so far and path the rest of the path.
+ * An object is entered by the key of the next path element, an
+ * array element by element, like the JSON path index does.
+ *
+ * returns 1 if the value matches
+ * returns 0 if the value does not match
+ */
+static gint match_json_path(void *db, gint enc, char *path, gint value,
+  int depth)
+{
+  void *rec;
+  gint i, reclen, seglen;
+  char *next;
+
+  if(!*path && WG_COMPARE(db, enc, value) == WG_EQUAL)
+    return 1;
+  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE || depth <= 0)
+    return 0;
+
+  rec = wg_decode_record(db, enc);
+  reclen = wg_get_record_len(db, rec);
+  if(is_schema_array(rec)) {
+    for(i=0; i<reclen; i++) {
+      if(match_json_path(db, wg_get_field(db, rec, i), path, value,
+        depth-1))
+        return 1;
+    }
+    return 0;
+  }
+  if(!*path || !is_schema_object(rec))
+    return 0;
+
+  seglen = strcspn(path, ".");
+  next = path + seglen + (path[seglen] ? 1 : 0);
+  for(i=0; i<reclen; i++) {
+    gint kv = wg_get_field(db, rec, i), key;
+    void *kvrec;
+
+    if(wg_get_encoded_type(db, kv) != WG_RECORDTYPE)
+      continue;
+    kvrec = wg_decode_record(db, kv);
+    if(wg_get_record_len(db, kvrec) <= WG_SCHEMA_VALUE_OFFSET)
+      continue;
+    key = wg_get_field(db, kvrec, WG_SCHEMA_KEY_OFFSET);
+    if(wg_get_encoded_type(db, key) == WG_STRTYPE &&\
+      wg_decode_str_len(db, key) == seglen &&\
+      !memcmp(wg_decode_str(db, key), path, seglen) &&\
+      match_json_path(db, wg_get_field(db, kvrec, WG_SCHEMA_VALUE_OFFSET),
+        next, value, depth-1))
+      return 1;
+  }
+  return 0;
+}
+
+/*
+ * Check if a document matches a path clause (the key is
+ * WG_JSON_PATH_PREFIX followed by the path).
+ *
+ * returns 1 if the document matches and is added to the resultset
+ * returns 0 if the document does not match
+ * returns -1 if the document matches, but adding fails
+ */
+static gint check_and_merge_by_path(void *db, void *doc,
+  wg_json_query_arg *arg, query_result_set *next_set)
+{
+  char *path = wg_decode_str(db, arg->key) + JSON_PATH_PREFIX_LEN;
+
+  if(!match_json_path(db, wg_encode_record(db, doc), path, arg->value,
+    JSON_PATH_MAX_DEPTH))
+    return 0;
+  return (append_resultset(db, next_set, ptrtooffset(db, doc)) ? -1 : 1);
+}
+
 /* Prepare argument list. This sorts clauses that are either less
  * costly to query or restrict the following processing the most
  * (not yet implemented, depends on statistics). Also determines
@@ -1762,8 +2694,8 @@ static gint prepare_json_arglist(void *db, wg_json_query_arg *arglist,
   /* Get index */
   icols[0] = WG_SCHEMA_KEY_OFFSET;
   icols[1] = WG_SCHEMA_VALUE_OFFSET;
-  *index_id = wg_multi_column_to_index_id(db, icols, 2,
-    WG_INDEX_TYPE_HASH_JSON, NULL, 0);
+  *index_id = usable_index(db, wg_multi_column_to_index_id(db, icols, 2,
+    WG_INDEX_TYPE_HASH_JSON, NULL, 0));
   *vindex_id = *kindex_id = -1;
 
   if(argc > 1) {
@@ -1810,11 +2742,11 @@ static gint prepare_json_arglist(void *db, wg_json_query_arg *arglist,
    * we'll settle for a key index.
    */
   if(*index_id == -1 || need_ttree) {
-    *vindex_id = wg_multi_column_to_index_id(db, &icols[1], 1,
-      WG_INDEX_TYPE_TTREE_JSON, NULL, 0);
+    *vindex_id = usable_index(db, wg_multi_column_to_index_id(db,
+      &icols[1], 1, WG_INDEX_TYPE_TTREE_JSON, NULL, 0));
     if(*vindex_id == -1) {
-      *kindex_id = wg_multi_column_to_index_id(db, &icols[0], 1,
-        WG_INDEX_TYPE_TTREE, NULL, 0);
+      *kindex_id = usable_index(db, wg_multi_column_to_index_id(db,
+        &icols[0], 1, WG_INDEX_TYPE_TTREE, NULL, 0));
     }
   }
 
@@ -1824,6 +2756,9 @@ static gint prepare_json_arglist(void *db, wg_json_query_arg *arglist,
 
 /*
  * Find a list of documents that contain the key-value pairs.
+ * A key that starts with WG_JSON_PATH_PREFIX is a path from the top
+ * level of the document (see match_json_path()); a JSON path index
+ * on the path is used to find the documents.
  * Returns a prefetch query object.
  * Returns NULL on error.
  */
@@ -1848,6 +2783,9 @@ wg_query *wg_make_json_query(void *db, wg_json_query_arg *arglist, gint argc) {
   }
 #endif
 
+  if(wg_flush_index_updates(db))
+    return NULL;
+
   /* Sort the argument list. This also checks for usable indexes, so
    * we're calling it even if we have just one argument.
    */
@@ -1875,7 +2813,53 @@ wg_query *wg_make_json_query(void *db, wg_json_query_arg *arglist, gint argc) {
       return NULL;
     }
 
-    if(index_id > 0 &&\
+    if(IS_JSON_PATH_KEY(db, arglist[i].key)) {
+      /* A path from the top level of the document. A JSON path index
+       * on the path gives the candidate documents, they are checked
+       * again as the index does not see the changes made to the
+       * documents after they were parsed. */
+      gint path_id = -1;
+
+      if(wg_get_encoded_type(db, arglist[i].value) != WG_RECORDTYPE)
+        path_id = usable_index(db, wg_json_path_to_index_id(db,
+          wg_decode_str(db, arglist[i].key) + JSON_PATH_PREFIX_LEN));
+      if(path_id > 0) {
+        gint reclist_offset = wg_search_json_path(db, path_id,
+          arglist[i].value);
+
+        while(reclist_offset > 0) {
+          gcell *rec_cell = (gcell *) offsettoptr(db, reclist_offset);
+          gint rc = check_and_merge_by_path(db,
+            offsettoptr(db, rec_cell->car), &arglist[i], next_set);
+          IF_ERR_CLEAN_UP(db, curr_res, next_set, sorted_arglist, rc)
+          reclist_offset = rec_cell->cdr;
+        }
+      }
+      else if(curr_res) {
+        gint offset;
+        rewind_resultset(db, curr_res);
+        while((offset = fetch_resultset(db, curr_res))) {
+          gint rc = check_and_merge_by_path(db, offsettoptr(db, offset),
+            &arglist[i], next_set);
+          IF_ERR_CLEAN_UP(db, curr_res, next_set, sorted_arglist, rc)
+        }
+        /* Skip merge in this iteration, next_set is a subset of curr_res */
+        free_resultset(db, curr_res);
+        curr_res = NULL;
+      }
+      else {
+        gint *rec = wg_get_first_record(db);
+        while(rec) {
+          if(is_schema_document(rec)) {
+            gint rc = check_and_merge_by_path(db, rec, &arglist[i],
+              next_set);
+            IF_ERR_CLEAN_UP(db, curr_res, next_set, sorted_arglist, rc)
+          }
+          rec = wg_get_next_record(db, rec);
+        }
+      }
+    }
+    else if(index_id > 0 &&\
       wg_get_encoded_type(db, arglist[i].value) != WG_RECORDTYPE) {
       /* Fetch the matching rows from the index, then retrieve the
        * documents they belong to.
@@ -2019,6 +3003,9 @@ wg_query *wg_make_json_query(void *db, wg_json_query_arg *arglist, gint argc) {
   query->arglist = NULL;
   query->argc = 0;
   query->column = -1;
+  query->bitmap = NULL;
+  query->fulltext = NULL;
+  query->rtree = NULL;
 
   /* Copy the result. */
   query->curr_page = curr_res->first_page;
@@ -2030,16 +3017,172 @@ wg_query *wg_make_json_query(void *db, wg_json_query_arg *arglist, gint argc) {
   return query;
 }
 
+/*
+ * Find the rows nearest to a point, using the R-tree index on
+ * the columns xcol and ycol. Up to k rows are returned, the nearest
+ * first. The distance is euclidean in the units of the column values.
+ * Returns a prefetch query object.
+ * Returns NULL on error.
+ */
+wg_query *wg_make_nearest_query(void *db, gint xcol, gint ycol,
+  double x, double y, wg_uint k) {
+  wg_query *query;
+  query_result_set *res;
+  wg_index_header *hdr;
+  gint cols[2], index_id, found, i;
+  gint *recs;
+
+#ifdef CHECK
+  if (!dbcheck(db)) {
+#ifdef WG_NO_ERRPRINT
+#else
+    fprintf(stderr, "Invalid database pointer in wg_make_nearest_query.\n");
+#endif
+    return NULL;
+  }
+#endif
+
+  if(wg_flush_index_updates(db))
+    return NULL;
+
+  /* The index keeps the lower column number as the first coordinate */
+  if(xcol > ycol) {
+    double tmp = x;
+    x = y;
+    y = tmp;
+    cols[0] = ycol;
+    cols[1] = xcol;
+  } else {
+    cols[0] = xcol;
+    cols[1] = ycol;
+  }
+  index_id = wg_multi_column_to_index_id(db, cols, 2,
+    WG_INDEX_TYPE_RTREE, NULL, 0);
+  if(index_id < 1) {
+    show_query_error(db, "No R-tree index on the columns");
+    return NULL;
+  }
+  if(usable_index(db, index_id) < 1) {
+    show_query_error(db, "R-tree index is missing rows");
+    return NULL;
+  }
+
+  hdr = (wg_index_header *) offsettoptr(db, index_id);
+  if(k > (wg_uint) hdr->ctl.r.rows)
+    k = hdr->ctl.r.rows;
+  recs = (gint *) malloc((k ? k : 1) * sizeof(gint));
+  if(!recs) {
+    show_query_error(db, "Failed to allocate memory");
+    return NULL;
+  }
+  found = wg_rtree_nearest(db, hdr, x, y, (gint) k, recs);
+  if(found < 0 || !(res = create_resultset(db))) {
+    free(recs);
+    return NULL;
+  }
+  for(i=0; i<found; i++) {
+    if(append_resultset(db, res, recs[i])) {
+      free(recs);
+      free_resultset(db, res);
+      return NULL;
+    }
+  }
+  free(recs);
+
+  query = (wg_query *) malloc(sizeof(wg_query));
+  if(!query) {
+    free_resultset(db, res);
+    show_query_error(db, "Failed to allocate memory");
+    return NULL;
+  }
+  query->qtype = WG_QTYPE_PREFETCH;
+  query->arglist = NULL;
+  query->argc = 0;
+  query->column = -1;
+  query->bitmap = NULL;
+  query->fulltext = NULL;
+  query->rtree = NULL;
+
+  query->curr_page = res->first_page;
+  query->curr_pidx = 0;
+  query->res_count = res->res_count;
+  query->mpool = res->mpool;
+  free(res);
+
+  return query;
+}
+
 /* ------------------ simple query functions -------------------*/
 
+/*
+ * Find the record after lastrecord (or the first one, if lastrecord
+ * is NULL) from the rows of a hash index that have the value data.
+ */
+static void *find_hash_next(void *db, gint index_id, gint data,
+  void *lastrecord) {
+  gint list = wg_search_hash(db, index_id, &data, 1);
+  void *prev = NULL;
+
+  while(list > 0) {
+    gcell *rec_cell = (gcell *) offsettoptr(db, list);
+    void *rec = offsettoptr(db, rec_cell->car);
+    if(prev == lastrecord)
+      return rec;
+    prev = rec;
+    list = rec_cell->cdr;
+  }
+  return NULL;
+}
+
 void *wg_find_record(void *db, gint fieldnr, gint cond, gint data,
     void* lastrecord) {
   gint index_id = -1;
+  gint prefix_end = WG_ILLEGAL;
+  int btree = 0;
+
+  /* The search sees the deferred index updates of this handle */
+  if(wg_flush_index_updates(db))
+    return NULL;
+
+  /* A prefix is found from the index as a range of values, if the
+   * range has an upper bound. */
+  if(cond == WG_COND_PREFIX) {
+    prefix_end = prefix_end_bound(db, data);
+  }
 
+  if(cond & WG_EXPR_MASK) {
+    /* An equal condition on an expression uses the expression index.
+     * The other conditions are checked by a scan. */
+    if((cond & ~WG_EXPR_MASK) == WG_COND_EQUAL &&\
+      VALID_INDEX_EXPR(cond & WG_EXPR_MASK)) {
+      index_id = usable_index(db, wg_expr_to_index_id(db, fieldnr,
+        cond & WG_EXPR_MASK, NULL, 0));
+    }
+    if(index_id > 0)
+      return find_hash_next(db, index_id, data, lastrecord);
+  }
   /* find index on colum */
-  if(cond != WG_COND_NOT_EQUAL) {
-    index_id = wg_multi_column_to_index_id(db, &fieldnr, 1,
-      WG_INDEX_TYPE_TTREE, NULL, 0);
+  else if(cond != WG_COND_NOT_EQUAL && cond != WG_COND_CONTAINS_TERM &&\
+    (cond != WG_COND_PREFIX || prefix_end != WG_ILLEGAL)) {
+    index_id = usable_index(db, wg_multi_column_to_index_id(db, &fieldnr, 1,
+      WG_INDEX_TYPE_TTREE, NULL, 0));
+    if(index_id <= 0) {
+      index_id = usable_index(db, wg_multi_column_to_index_id(db,
+        &fieldnr, 1, WG_INDEX_TYPE_BTREE, NULL, 0));
+      btree = 1;
+    }
+    /* Without an ordered index, an equal value is found from a hash
+     * index (a missing value is usually rejected by its Bloom filter).
+     * Records are compared by content and doubles have two zeros,
+     * those are not hashed like they are compared. */
+    if(index_id <= 0 && cond == WG_COND_EQUAL &&\
+      wg_get_encoded_type(db, data) != WG_RECORDTYPE &&\
+      wg_get_encoded_type(db, data) != WG_DOUBLETYPE) {
+      gint hash_id = usable_index(db, wg_multi_column_to_index_id(db,
+        &fieldnr, 1, WG_INDEX_TYPE_HASH, NULL, 0));
+      if(hash_id > 0)
+        return find_hash_next(db, hash_id, data, lastrecord);
+    }
   }
 
   if(index_id > 0) {
@@ -2068,6 +3211,11 @@ void *wg_find_record(void *db, gint fieldnr, gint cond, gint data,
       case WG_COND_GTEQUAL:
         start_bound = data;
         break;
+      case WG_COND_PREFIX:
+        start_bound = data;
+        end_bound = prefix_end;
+        end_inclusive = 0;
+        break;
       default:
         show_query_error(db, "Invalid condition (ignoring)");
         return NULL;
@@ -2076,11 +3224,29 @@ void *wg_find_record(void *db, gint fieldnr, gint cond, gint data,
     if(find_ttree_bounds(db, index_id, fieldnr,
         start_bound, end_bound, start_inclusive, end_inclusive,
         &curr_offset, &curr_slot, &end_offset, &end_slot)) {
+      if(prefix_end != WG_ILLEGAL)
+        wg_free_query_param(db, prefix_end);
       return NULL;
     }
+    if(prefix_end != WG_ILLEGAL)
+      wg_free_query_param(db, prefix_end);
 
     /* We have the bounds, scan to lastrecord */
-    while(curr_offset) {
+    while(btree && curr_offset) {
+      struct wg_bnode *node = (struct wg_bnode *) offsettoptr(db, curr_offset);
+      void *rec = offsettoptr(db, node->u.leaf.rec[curr_slot]);
+
+      if(prev == lastrecord)
+        return rec;
+      prev = rec;
+      if(curr_offset==end_offset && curr_slot==end_slot)
+        break;
+      if(++curr_slot >= node->count) {
+        curr_offset = node->next_offset;
+        curr_slot = 0;
+      }
+    }
+    while(!btree && curr_offset) {
       struct wg_tnode *node = (struct wg_tnode *) offsettoptr(db, curr_offset);
       void *rec = offsettoptr(db, node->array_of_values[curr_slot]);
 
@@ -2114,10 +3280,14 @@ void *wg_find_record(void *db, gint fieldnr, gint cond, gint data,
     }
   }
   else {
-    /* no index (or cond == WG_COND_NOT_EQUAL), do a scan */
+    /* no index (or cond is WG_COND_NOT_EQUAL or WG_COND_CONTAINS_TERM,
+     * a prefix without an upper bound or a condition on an expression),
+     * do a scan */
     wg_query_arg arg;
     void *rec;
 
+    if(prefix_end != WG_ILLEGAL)
+      wg_free_query_param(db, prefix_end);
     if(lastrecord) {
       rec = wg_get_next_record(db, lastrecord);
     } else {
@@ -38,16 +38,28 @@
 
 /* ==== Public macros ==== */
 
+/* A condition may be combined with an expression (WG_EXPR_*), then the
+ * expression of the column value is compared. */
 #define WG_COND_EQUAL       0x0001      /** = */
 #define WG_COND_NOT_EQUAL   0x0002      /** != */
 #define WG_COND_LESSTHAN    0x0004      /** < */
 #define WG_COND_GREATER     0x0008      /** > */
 #define WG_COND_LTEQUAL     0x0010      /** <= */
 #define WG_COND_GTEQUAL     0x0020      /** >= */
+#define WG_COND_CONTAINS_TERM 0x0040    /** string has all the terms */
+#define WG_COND_PREFIX      0x0080      /** string starts with the value */
+
+/* A JSON query key that starts with this is a path from the top level
+ * of the document, like "$.user.address.city" */
+#define WG_JSON_PATH_PREFIX "$."
 
 #define WG_QTYPE_TTREE      0x01
 #define WG_QTYPE_HASH       0x02
 #define WG_QTYPE_SCAN       0x04
+#define WG_QTYPE_BTREE      0x08
+#define WG_QTYPE_BITMAP     0x10
+#define WG_QTYPE_FULLTEXT   0x20
+#define WG_QTYPE_RTREE      0x40
 #define WG_QTYPE_PREFETCH   0x80
 
 /* ====== data structures ======== */
@@ -80,6 +92,12 @@ typedef struct {
   gint direction;
   /* Fields for full scan */
   gint curr_record;         /** offset of the current record */
+  /* Fields for bitmap index query */
+  void *bitmap;             /** wg_bitmap_cursor, NULL if not used */
+  /* Fields for full-text index query */
+  void *fulltext;           /** wg_fulltext_cursor, NULL if not used */
+  /* Fields for R-tree index query */
+  void *rtree;              /** wg_rtree_cursor, NULL if not used */
   /* Fields for prefetch */
   void *mpool;              /** storage for row offsets */
   void *curr_page;          /** current page of results */
@@ -95,6 +113,8 @@ wg_query *wg_make_query(void *db, void *matchrec, gint reclen,
 wg_query *wg_make_query_rc(void *db, void *matchrec, gint reclen,
   wg_query_arg *arglist, gint argc, wg_uint rowlimit);
 wg_query *wg_make_json_query(void *db, wg_json_query_arg *arglist, gint argc);
+wg_query *wg_make_nearest_query(void *db, gint xcol, gint ycol,
+  double x, double y, wg_uint k);
 void *wg_fetch(void *db, wg_query *query);
 void wg_free_query(void *db, wg_query *query);
 
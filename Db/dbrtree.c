@@ -0,0 +1,852 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbrtree.c
+ *  R-tree index operations.
+ *
+ *  An R-tree index is built over a pair of numeric columns that hold
+ *  the x and y coordinates of a point (for example latitude and
+ *  longitude). The column with the lower number is x. Nodes hold the
+ *  bounding boxes of their subtrees, so a box query only descends
+ *  into the subtrees that overlap the box.
+ *
+ *  Rows are inserted as in the R*-tree: the subtree is chosen by the
+ *  least overlap enlargement at the level above the leaves and by
+ *  the least area enlargement higher up, full nodes are split along
+ *  the axis with the smallest total margin. Forced reinsertion is not
+ *  done. An index created on existing rows is packed bottom-up from
+ *  the rows sorted by the Hilbert curve. Deletes remove empty nodes
+ *  but do not merge underfull ones.
+ */
+
+/* ====== Includes =============== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+#include "dbdata.h"
+#include "dbrtree.h"
+
+
+/* ====== Private headers and defs ======== */
+
+#define RTREE_HILBERT_BITS 16     /** grid of the Hilbert curve is
+                                   *  2^16 by 2^16 cells */
+#define RTREE_HILBERT_SIDE (((wg_uint) 1) << RTREE_HILBERT_BITS)
+#define RTREE_HEAP_INITIAL 64
+
+#define RNODE(d, o) ((struct wg_rnode *) offsettoptr(d, o))
+
+/** entry of a node that is being split */
+typedef struct {
+  wg_rtree_box box;
+  gint child;
+} rtree_slot;
+
+/** element of the nearest neighbour search queue */
+typedef struct {
+  double dist;          /** squared distance from the point */
+  gint offset;          /** node or record offset */
+  gint level;           /** level of the node, -1 for a record */
+} rtree_heap_item;
+
+/** priority queue of the nearest neighbour search */
+typedef struct {
+  rtree_heap_item *items;
+  gint count;
+  gint size;
+} rtree_heap;
+
+/* ======= Private protos ================ */
+
+static gint alloc_rnode(void *db, gint level);
+static void free_subtree(void *db, gint offset);
+
+static double box_area(wg_rtree_box *b);
+static double box_margin(wg_rtree_box *b);
+static double box_overlap(wg_rtree_box *a, wg_rtree_box *b);
+static void box_extend(wg_rtree_box *b, wg_rtree_box *add);
+static int box_intersects(wg_rtree_box *a, wg_rtree_box *b);
+static double box_distance(wg_rtree_box *b, double x, double y);
+static void node_box(struct wg_rnode *node, wg_rtree_box *b);
+
+static gint choose_subtree(struct wg_rnode *node, wg_rtree_box *box);
+static gint split_slots(rtree_slot *slots, gint n);
+static void group_boxes(rtree_slot *slots, gint n, wg_rtree_box *pre,
+  wg_rtree_box *suf);
+static int compare_lo0(const void *a, const void *b);
+static int compare_hi0(const void *a, const void *b);
+static int compare_lo1(const void *a, const void *b);
+static int compare_hi1(const void *a, const void *b);
+static int compare_hilbert(const void *a, const void *b);
+static wg_uint hilbert_key(wg_uint x, wg_uint y);
+
+static gint delete_entry(void *db, gint offset, wg_rtree_box *pt, gint rec);
+static gint heap_push(rtree_heap *heap, double dist, gint offset,
+  gint level);
+static void heap_pop(rtree_heap *heap, rtree_heap_item *item);
+
+static gint show_rtree_error(void* db, char* errmsg);
+
+/* Sort orders of the split, by axis and by the lower or upper bound */
+static int (*slot_compare[2][2])(const void *, const void *) = {
+  { compare_lo0, compare_hi0 },
+  { compare_lo1, compare_hi1 }
+};
+
+
+/* ====== Functions ============== */
+
+/** Create an empty R-tree
+*  returns 0 on success, -1 on error.
+*/
+gint wg_rtree_create(void *db, wg_index_header *hdr) {
+  gint root = alloc_rnode(db, 0);
+
+  if(!root)
+    return -1;
+  RTREE_ROOT_NODE(hdr) = root;
+  hdr->ctl.r.rows = 0;
+  return 0;
+}
+
+/** Build an R-tree from the points of the existing rows
+*  The entries are sorted by their position on the Hilbert curve over
+*  the bounding box of all points. Consecutive entries are packed into
+*  full leaves, consecutive nodes into full parents, until one node
+*  remains. Nearby points end up in the same nodes, so the boxes of
+*  the nodes overlap little.
+*  returns 0 on success, -1 on error.
+*/
+gint wg_rtree_build(void *db, wg_index_header *hdr,
+  wg_rtree_entry *entries, gint count) {
+  double minx, miny, maxx, maxy, scalex = 0, scaley = 0;
+  gint *nodes, n, made, i, j, level;
+
+  if(!count)
+    return wg_rtree_create(db, hdr);
+
+  minx = maxx = entries[0].x;
+  miny = maxy = entries[0].y;
+  for(i=1; i<count; i++) {
+    if(entries[i].x < minx) minx = entries[i].x;
+    if(entries[i].x > maxx) maxx = entries[i].x;
+    if(entries[i].y < miny) miny = entries[i].y;
+    if(entries[i].y > maxy) maxy = entries[i].y;
+  }
+  if(maxx > minx)
+    scalex = (RTREE_HILBERT_SIDE - 1) / (maxx - minx);
+  if(maxy > miny)
+    scaley = (RTREE_HILBERT_SIDE - 1) / (maxy - miny);
+  for(i=0; i<count; i++) {
+    wg_uint gx = (wg_uint) ((entries[i].x - minx) * scalex);
+    wg_uint gy = (wg_uint) ((entries[i].y - miny) * scaley);
+    if(gx >= RTREE_HILBERT_SIDE) gx = RTREE_HILBERT_SIDE - 1;
+    if(gy >= RTREE_HILBERT_SIDE) gy = RTREE_HILBERT_SIDE - 1;
+    entries[i].hilbert = hilbert_key(gx, gy);
+  }
+  qsort(entries, count, sizeof(wg_rtree_entry), compare_hilbert);
+
+  n = (count + WG_RNODE_ENTRIES - 1) / WG_RNODE_ENTRIES;
+  nodes = (gint *) malloc(n * sizeof(gint));
+  if(!nodes)
+    return show_rtree_error(db, "Failed to allocate memory");
+
+  /* Leaves */
+  for(made=0; made<n; made++) {
+    struct wg_rnode *node;
+    nodes[made] = alloc_rnode(db, 0);
+    if(!nodes[made]) {
+      for(j=0; j<made; j++)
+        wg_free_rnode(db, nodes[j]);
+      free(nodes);
+      return -1;
+    }
+    node = RNODE(db, nodes[made]);
+    for(i=made*WG_RNODE_ENTRIES; i<count && node->count<WG_RNODE_ENTRIES;
+      i++) {
+      wg_rtree_box *b = &node->box[node->count];
+      b->lo[0] = b->hi[0] = entries[i].x;
+      b->lo[1] = b->hi[1] = entries[i].y;
+      node->child[node->count++] = entries[i].rec;
+    }
+  }
+
+  /* Upper levels, the parents replace their children in nodes[] */
+  for(level=1; n>1; level++) {
+    gint parents = (n + WG_RNODE_ENTRIES - 1) / WG_RNODE_ENTRIES;
+    for(made=0; made<parents; made++) {
+      struct wg_rnode *node;
+      gint offset = alloc_rnode(db, level);
+      if(!offset) {
+        /* nodes[0..made) are the new parents, the rest are
+         * children that have no parent yet */
+        for(j=0; j<made; j++)
+          free_subtree(db, nodes[j]);
+        for(j=made*WG_RNODE_ENTRIES; j<n; j++)
+          free_subtree(db, nodes[j]);
+        free(nodes);
+        return -1;
+      }
+      node = RNODE(db, offset);
+      for(i=made*WG_RNODE_ENTRIES; i<n && node->count<WG_RNODE_ENTRIES;
+        i++) {
+        node_box(RNODE(db, nodes[i]), &node->box[node->count]);
+        node->child[node->count++] = nodes[i];
+      }
+      nodes[made] = offset;
+    }
+    n = parents;
+  }
+
+  RTREE_ROOT_NODE(hdr) = nodes[0];
+  hdr->ctl.r.rows = count;
+  free(nodes);
+  return 0;
+}
+
+/** Release all the nodes of an R-tree
+*/
+void wg_rtree_free(void *db, wg_index_header *hdr) {
+  if(RTREE_ROOT_NODE(hdr)) {
+    free_subtree(db, RTREE_ROOT_NODE(hdr));
+    RTREE_ROOT_NODE(hdr) = 0;
+  }
+}
+
+/** Decode a coordinate
+*  Integer, double and fixpoint values are accepted. Infinite and
+*  NaN values are not, as they cannot be placed in a box.
+*  returns 0 on success, -1 if the value is not a coordinate.
+*/
+gint wg_rtree_coord(void *db, gint enc, double *val) {
+  switch(wg_get_encoded_type(db, enc)) {
+    case WG_INTTYPE:
+      *val = (double) wg_decode_int(db, enc);
+      break;
+    case WG_DOUBLETYPE:
+      *val = wg_decode_double(db, enc);
+      break;
+    case WG_FIXPOINTTYPE:
+      *val = wg_decode_fixpoint(db, enc);
+      break;
+    default:
+      return -1;
+  }
+  if(*val - *val != 0.0)
+    return -1;
+  return 0;
+}
+
+/** Read the point of a row
+*  returns 0 on success, -1 if the row has no point (it is not
+*  indexed).
+*/
+gint wg_rtree_point(void *db, wg_index_header *hdr, void *rec,
+  double *x, double *y) {
+  if(hdr->rec_field_index[1] >= wg_get_record_len(db, rec))
+    return -1;
+  if(wg_rtree_coord(db, wg_get_field(db, rec, hdr->rec_field_index[0]), x) ||
+    wg_rtree_coord(db, wg_get_field(db, rec, hdr->rec_field_index[1]), y))
+    return -1;
+  return 0;
+}
+
+/** Insert a row into an R-tree
+*  The path from the root to a leaf is chosen first. The nodes that
+*  may be split on the way back up are allocated before any changes,
+*  so the tree stays consistent if the database is full.
+*  returns 0 on success (also if the row has no point), -1 on error.
+*/
+gint wg_rtree_insert(void *db, wg_index_header *hdr, gint rec) {
+  gint path[WG_RTREE_MAX_DEPTH], slot[WG_RTREE_MAX_DEPTH];
+  gint spare[WG_RTREE_MAX_DEPTH + 1];
+  gint depth, need, d, echild;
+  wg_rtree_box point, ebox;
+  struct wg_rnode *node;
+  int have;
+
+  if(wg_rtree_point(db, hdr, offsettoptr(db, rec),
+    &point.lo[0], &point.lo[1]))
+    return 0;
+  point.hi[0] = point.lo[0];
+  point.hi[1] = point.lo[1];
+
+  /* Choose the path */
+  path[0] = RTREE_ROOT_NODE(hdr);
+  node = RNODE(db, path[0]);
+  if(node->level >= WG_RTREE_MAX_DEPTH - 1)
+    return show_rtree_error(db, "Tree is too high");
+  for(depth=0; node->level > 0; depth++) {
+    slot[depth] = choose_subtree(node, &point);
+    path[depth+1] = node->child[slot[depth]];
+    node = RNODE(db, path[depth+1]);
+  }
+
+  /* A split goes up through the full nodes at the end of the path */
+  need = 0;
+  for(d=depth; d>=0 && RNODE(db, path[d])->count == WG_RNODE_ENTRIES; d--)
+    need++;
+  if(d < 0)
+    need++; /* new root */
+  for(d=0; d<need; d++) {
+    spare[d] = alloc_rnode(db, 0);
+    if(!spare[d]) {
+      while(d--)
+        wg_free_rnode(db, spare[d]);
+      return -1;
+    }
+  }
+
+  ebox = point;
+  echild = rec;
+  have = 1;
+  for(d=depth; d>=0; d--) {
+    int split = 0;
+    node = RNODE(db, path[d]);
+    if(have) {
+      if(node->count < WG_RNODE_ENTRIES) {
+        node->box[node->count] = ebox;
+        node->child[node->count++] = echild;
+        have = 0;
+      } else {
+        /* Split, the entry for the new node goes to the parent */
+        rtree_slot slots[WG_RNODE_ENTRIES + 1];
+        struct wg_rnode *newnode;
+        gint i, k, newoff = spare[--need];
+
+        for(i=0; i<WG_RNODE_ENTRIES; i++) {
+          slots[i].box = node->box[i];
+          slots[i].child = node->child[i];
+        }
+        slots[i].box = ebox;
+        slots[i].child = echild;
+        k = split_slots(slots, WG_RNODE_ENTRIES + 1);
+
+        newnode = RNODE(db, newoff);
+        newnode->level = node->level;
+        newnode->count = 0;
+        node->count = 0;
+        for(i=0; i<=WG_RNODE_ENTRIES; i++) {
+          struct wg_rnode *target = (i < k ? node : newnode);
+          target->box[target->count] = slots[i].box;
+          target->child[target->count++] = slots[i].child;
+        }
+        node_box(newnode, &ebox);
+        echild = newoff;
+        split = 1;
+      }
+    }
+    if(d > 0) {
+      wg_rtree_box *pb = &RNODE(db, path[d-1])->box[slot[d-1]];
+      if(split)
+        node_box(node, pb); /* the node lost some entries */
+      else
+        box_extend(pb, &point);
+    }
+  }
+
+  if(have) {
+    /* The root was split */
+    struct wg_rnode *root = RNODE(db, spare[--need]);
+    node = RNODE(db, path[0]);
+    root->level = node->level + 1;
+    root->count = 2;
+    node_box(node, &root->box[0]);
+    root->child[0] = path[0];
+    root->box[1] = ebox;
+    root->child[1] = echild;
+    RTREE_ROOT_NODE(hdr) = spare[need];
+  }
+  hdr->ctl.r.rows++;
+  return 0;
+}
+
+/** Delete a row from an R-tree
+*  Nodes that become empty are released. An inner root with a single
+*  child is replaced by the child.
+*  returns 0 on success (also if the row has no point), -1 if the row
+*  was not found.
+*/
+gint wg_rtree_delete(void *db, wg_index_header *hdr, gint rec) {
+  wg_rtree_box point;
+  struct wg_rnode *root;
+
+  if(wg_rtree_point(db, hdr, offsettoptr(db, rec),
+    &point.lo[0], &point.lo[1]))
+    return 0;
+  point.hi[0] = point.lo[0];
+  point.hi[1] = point.lo[1];
+
+  if(!delete_entry(db, RTREE_ROOT_NODE(hdr), &point, rec))
+    return -1;
+  hdr->ctl.r.rows--;
+
+  root = RNODE(db, RTREE_ROOT_NODE(hdr));
+  while(root->level > 0 && root->count == 1) {
+    gint child = root->child[0];
+    wg_free_rnode(db, RTREE_ROOT_NODE(hdr));
+    RTREE_ROOT_NODE(hdr) = child;
+    root = RNODE(db, child);
+  }
+  if(!root->count)
+    root->level = 0;
+  return 0;
+}
+
+/** Create a box query cursor
+*  returns NULL on error.
+*/
+wg_rtree_cursor *wg_rtree_new_cursor(void *db, wg_index_header *hdr,
+  wg_rtree_box *box) {
+  wg_rtree_cursor *cur = (wg_rtree_cursor *) malloc(sizeof(wg_rtree_cursor));
+
+  if(!cur) {
+    show_rtree_error(db, "Failed to allocate memory");
+    return NULL;
+  }
+  cur->box = *box;
+  cur->depth = 0;
+  cur->node[0] = RTREE_ROOT_NODE(hdr);
+  cur->slot[0] = 0;
+  return cur;
+}
+
+/** Fetch the next row with the point inside the box
+*  returns the record offset, 0 if there are no more rows.
+*/
+gint wg_rtree_next(void *db, wg_rtree_cursor *cur) {
+  while(cur->depth >= 0) {
+    struct wg_rnode *node = RNODE(db, cur->node[cur->depth]);
+    gint i = cur->slot[cur->depth]++;
+
+    if(i >= node->count) {
+      cur->depth--;
+      continue;
+    }
+    if(!box_intersects(&node->box[i], &cur->box))
+      continue;
+    if(!node->level)
+      return node->child[i];
+    cur->depth++;
+    cur->node[cur->depth] = node->child[i];
+    cur->slot[cur->depth] = 0;
+  }
+  return 0;
+}
+
+/** Release a box query cursor
+*/
+void wg_rtree_free_cursor(void *db, wg_rtree_cursor *cur) {
+  free(cur);
+}
+
+/** Find the rows nearest to a point
+*  Best-first search: the nodes and rows are taken from a priority
+*  queue ordered by their distance from the point, so the rows come
+*  out nearest first and only the nodes closer than the k-th row are
+*  read. The distance is euclidean in the units of the coordinates.
+*  Up to k record offsets are stored in recs.
+*  returns the number of rows found, -1 on error.
+*/
+gint wg_rtree_nearest(void *db, wg_index_header *hdr, double x, double y,
+  gint k, gint *recs) {
+  rtree_heap heap;
+  rtree_heap_item item;
+  gint found = 0, i;
+
+  heap.items = (rtree_heap_item *) malloc(RTREE_HEAP_INITIAL *
+    sizeof(rtree_heap_item));
+  if(!heap.items)
+    return show_rtree_error(db, "Failed to allocate memory");
+  heap.size = RTREE_HEAP_INITIAL;
+  heap.count = 0;
+  heap_push(&heap, 0, RTREE_ROOT_NODE(hdr),
+    RNODE(db, RTREE_ROOT_NODE(hdr))->level);
+
+  while(heap.count && found < k) {
+    struct wg_rnode *node;
+    heap_pop(&heap, &item);
+    if(item.level < 0) {
+      recs[found++] = item.offset;
+      continue;
+    }
+    node = RNODE(db, item.offset);
+    for(i=0; i<node->count; i++) {
+      if(heap_push(&heap, box_distance(&node->box[i], x, y),
+        node->child[i], node->level - 1)) {
+        free(heap.items);
+        return show_rtree_error(db, "Failed to allocate memory");
+      }
+    }
+  }
+  free(heap.items);
+  return found;
+}
+
+/* ----------------- Node functions -------------- */
+
+/** Allocate an empty node
+*  returns the offset of the node, 0 on error.
+*/
+static gint alloc_rnode(void *db, gint level) {
+  struct wg_rnode *node;
+  gint offset = wg_alloc_fixlen_object(db,
+    &(dbmemsegh(db)->rnode_area_header));
+
+  if(!offset) {
+    show_rtree_error(db, "Failed to allocate an R-tree node");
+    return 0;
+  }
+  node = RNODE(db, offset);
+  node->level = level;
+  node->count = 0;
+  return offset;
+}
+
+/** Release a node and its subtree
+*/
+static void free_subtree(void *db, gint offset) {
+  struct wg_rnode *node = RNODE(db, offset);
+  gint i;
+
+  if(node->level) {
+    for(i=0; i<node->count; i++)
+      free_subtree(db, node->child[i]);
+  }
+  wg_free_rnode(db, offset);
+}
+
+/** Remove a row from a subtree
+*  Only the subtrees with the point inside their box are searched.
+*  returns 1 if the row was removed, 0 if it was not found.
+*/
+static gint delete_entry(void *db, gint offset, wg_rtree_box *pt, gint rec) {
+  struct wg_rnode *node = RNODE(db, offset);
+  gint i;
+
+  for(i=0; i<node->count; i++) {
+    if(!box_intersects(&node->box[i], pt))
+      continue;
+    if(node->level) {
+      struct wg_rnode *child = RNODE(db, node->child[i]);
+      if(!delete_entry(db, node->child[i], pt, rec))
+        continue;
+      if(child->count) {
+        node_box(child, &node->box[i]);
+        return 1;
+      }
+      wg_free_rnode(db, node->child[i]);
+    } else if(node->child[i] != rec) {
+      continue;
+    }
+    /* Remove the entry, the last one takes its place */
+    node->count--;
+    node->box[i] = node->box[node->count];
+    node->child[i] = node->child[node->count];
+    return 1;
+  }
+  return 0;
+}
+
+/** Choose the subtree for a new entry
+*  Above the leaves the box whose growth overlaps the other boxes
+*  the least is chosen, higher up the one that grows the least.
+*  Ties are broken by the smaller area.
+*/
+static gint choose_subtree(struct wg_rnode *node, wg_rtree_box *box) {
+  double best_over = 0, best_enl = 0, best_area = 0;
+  gint i, j, best = 0;
+
+  for(i=0; i<node->count; i++) {
+    wg_rtree_box ext = node->box[i];
+    double area = box_area(&node->box[i]), over = 0, enl;
+
+    box_extend(&ext, box);
+    enl = box_area(&ext) - area;
+    if(node->level == 1) {
+      for(j=0; j<node->count; j++) {
+        if(j != i)
+          over += box_overlap(&ext, &node->box[j]) -\
+            box_overlap(&node->box[i], &node->box[j]);
+      }
+    }
+    if(!i || over < best_over || (over == best_over &&\
+      (enl < best_enl || (enl == best_enl && area < best_area)))) {
+      best = i;
+      best_over = over;
+      best_enl = enl;
+      best_area = area;
+    }
+  }
+  return best;
+}
+
+/** Split the entries of a full node into two groups
+*  The axis is chosen by the sum of the margins of all the allowed
+*  distributions along it. On that axis, the distribution with the
+*  least overlap (then the least area) of the two groups is used.
+*  The slots are reordered so that the first group comes first.
+*  returns the size of the first group.
+*/
+static gint split_slots(rtree_slot *slots, gint n) {
+  wg_rtree_box pre[WG_RNODE_ENTRIES + 1], suf[WG_RNODE_ENTRIES + 1];
+  double best_margin = 0, best_over = 0, best_area = 0;
+  gint axis, best_axis = 0, s, best_s = 0, k, best_k = 0;
+  gint m = WG_RNODE_MIN_ENTRIES;
+
+  for(axis=0; axis<2; axis++) {
+    double margin = 0;
+    for(s=0; s<2; s++) {
+      qsort(slots, n, sizeof(rtree_slot), slot_compare[axis][s]);
+      group_boxes(slots, n, pre, suf);
+      for(k=m; k<=n-m; k++)
+        margin += box_margin(&pre[k-1]) + box_margin(&suf[k]);
+    }
+    if(!axis || margin < best_margin) {
+      best_margin = margin;
+      best_axis = axis;
+    }
+  }
+
+  for(s=0; s<2; s++) {
+    qsort(slots, n, sizeof(rtree_slot), slot_compare[best_axis][s]);
+    group_boxes(slots, n, pre, suf);
+    for(k=m; k<=n-m; k++) {
+      double over = box_overlap(&pre[k-1], &suf[k]);
+      double area = box_area(&pre[k-1]) + box_area(&suf[k]);
+      if(!best_k || over < best_over ||\
+        (over == best_over && area < best_area)) {
+        best_s = s;
+        best_k = k;
+        best_over = over;
+        best_area = area;
+      }
+    }
+  }
+  if(best_s != 1)
+    qsort(slots, n, sizeof(rtree_slot), slot_compare[best_axis][best_s]);
+  return best_k;
+}
+
+/** Bounding boxes of the first i+1 and the last n-i slots
+*/
+static void group_boxes(rtree_slot *slots, gint n, wg_rtree_box *pre,
+  wg_rtree_box *suf) {
+  gint i;
+
+  pre[0] = slots[0].box;
+  for(i=1; i<n; i++) {
+    pre[i] = pre[i-1];
+    box_extend(&pre[i], &slots[i].box);
+  }
+  suf[n-1] = slots[n-1].box;
+  for(i=n-2; i>=0; i--) {
+    suf[i] = suf[i+1];
+    box_extend(&suf[i], &slots[i].box);
+  }
+}
+
+/** Bounding box of the entries of a node
+*/
+static void node_box(struct wg_rnode *node, wg_rtree_box *b) {
+  gint i;
+
+  *b = node->box[0];
+  for(i=1; i<node->count; i++)
+    box_extend(b, &node->box[i]);
+}
+
+/* ----------------- Box functions -------------- */
+
+static double box_area(wg_rtree_box *b) {
+  return (b->hi[0] - b->lo[0]) * (b->hi[1] - b->lo[1]);
+}
+
+static double box_margin(wg_rtree_box *b) {
+  return (b->hi[0] - b->lo[0]) + (b->hi[1] - b->lo[1]);
+}
+
+/** Area of the intersection of two boxes
+*/
+static double box_overlap(wg_rtree_box *a, wg_rtree_box *b) {
+  double w = (a->hi[0] < b->hi[0] ? a->hi[0] : b->hi[0]) -\
+    (a->lo[0] > b->lo[0] ? a->lo[0] : b->lo[0]);
+  double h = (a->hi[1] < b->hi[1] ? a->hi[1] : b->hi[1]) -\
+    (a->lo[1] > b->lo[1] ? a->lo[1] : b->lo[1]);
+  return (w > 0 && h > 0 ? w * h : 0);
+}
+
+static void box_extend(wg_rtree_box *b, wg_rtree_box *add) {
+  if(add->lo[0] < b->lo[0]) b->lo[0] = add->lo[0];
+  if(add->lo[1] < b->lo[1]) b->lo[1] = add->lo[1];
+  if(add->hi[0] > b->hi[0]) b->hi[0] = add->hi[0];
+  if(add->hi[1] > b->hi[1]) b->hi[1] = add->hi[1];
+}
+
+static int box_intersects(wg_rtree_box *a, wg_rtree_box *b) {
+  return a->lo[0] <= b->hi[0] && b->lo[0] <= a->hi[0] &&\
+    a->lo[1] <= b->hi[1] && b->lo[1] <= a->hi[1];
+}
+
+/** Squared distance from a point to the nearest point of a box
+*/
+static double box_distance(wg_rtree_box *b, double x, double y) {
+  double dx = 0, dy = 0;
+
+  if(x < b->lo[0]) dx = b->lo[0] - x;
+  else if(x > b->hi[0]) dx = x - b->hi[0];
+  if(y < b->lo[1]) dy = b->lo[1] - y;
+  else if(y > b->hi[1]) dy = y - b->hi[1];
+  return dx * dx + dy * dy;
+}
+
+/* ----------------- Sorting functions -------------- */
+
+#define RTREE_COMPARE_BOUND(a, b, f, i) \
+  (((rtree_slot *) a)->box.f[i] < ((rtree_slot *) b)->box.f[i] ? -1 :\
+  (((rtree_slot *) a)->box.f[i] > ((rtree_slot *) b)->box.f[i] ? 1 : 0))
+
+static int compare_lo0(const void *a, const void *b) {
+  return RTREE_COMPARE_BOUND(a, b, lo, 0);
+}
+
+static int compare_hi0(const void *a, const void *b) {
+  return RTREE_COMPARE_BOUND(a, b, hi, 0);
+}
+
+static int compare_lo1(const void *a, const void *b) {
+  return RTREE_COMPARE_BOUND(a, b, lo, 1);
+}
+
+static int compare_hi1(const void *a, const void *b) {
+  return RTREE_COMPARE_BOUND(a, b, hi, 1);
+}
+
+static int compare_hilbert(const void *a, const void *b) {
+  wg_uint ha = ((wg_rtree_entry *) a)->hilbert;
+  wg_uint hb = ((wg_rtree_entry *) b)->hilbert;
+  return (ha < hb ? -1 : (ha > hb ? 1 : 0));
+}
+
+/** Position of a grid cell on the Hilbert curve
+*/
+static wg_uint hilbert_key(wg_uint x, wg_uint y) {
+  wg_uint s, d = 0;
+
+  for(s=RTREE_HILBERT_SIDE/2; s>0; s/=2) {
+    wg_uint rx = (x & s) > 0;
+    wg_uint ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    /* Rotate the quadrant */
+    if(!ry) {
+      wg_uint t;
+      if(rx) {
+        x = RTREE_HILBERT_SIDE - 1 - x;
+        y = RTREE_HILBERT_SIDE - 1 - y;
+      }
+      t = x;
+      x = y;
+      y = t;
+    }
+  }
+  return d;
+}
+
+/* ----------------- Priority queue -------------- */
+
+/** Add an element to the nearest neighbour queue
+*  returns 0 on success, -1 if out of memory.
+*/
+static gint heap_push(rtree_heap *heap, double dist, gint offset,
+  gint level) {
+  gint i;
+
+  if(heap->count == heap->size) {
+    rtree_heap_item *tmp = (rtree_heap_item *) realloc(heap->items,
+      2 * heap->size * sizeof(rtree_heap_item));
+    if(!tmp)
+      return -1;
+    heap->items = tmp;
+    heap->size *= 2;
+  }
+  for(i=heap->count++; i>0; i=(i-1)/2) {
+    rtree_heap_item *parent = &heap->items[(i-1)/2];
+    if(parent->dist <= dist)
+      break;
+    heap->items[i] = *parent;
+  }
+  heap->items[i].dist = dist;
+  heap->items[i].offset = offset;
+  heap->items[i].level = level;
+  return 0;
+}
+
+/** Remove the nearest element from the queue
+*/
+static void heap_pop(rtree_heap *heap, rtree_heap_item *item) {
+  rtree_heap_item last;
+  gint i = 0, c;
+
+  *item = heap->items[0];
+  last = heap->items[--heap->count];
+  while((c = 2*i + 1) < heap->count) {
+    if(c + 1 < heap->count && heap->items[c+1].dist < heap->items[c].dist)
+      c++;
+    if(last.dist <= heap->items[c].dist)
+      break;
+    heap->items[i] = heap->items[c];
+    i = c;
+  }
+  heap->items[i] = last;
+}
+
+/* --------------- error handling ------------------------------*/
+
+/** called with err msg
+*
+*  may print or log an error
+*  does not do any jumps etc
+*/
+
+static gint show_rtree_error(void* db, char* errmsg) {
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"R-tree index error: %s\n",errmsg);
+#endif
+  return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
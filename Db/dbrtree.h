@@ -0,0 +1,118 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbrtree.h
+ * Public headers for R-tree index routines
+ */
+
+#ifndef DEFINED_DBRTREE_H
+#define DEFINED_DBRTREE_H
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+
+#include "dballoc.h"
+/* For gint data type */
+#include "dbdata.h"
+
+/* ==== Public macros ==== */
+
+/** Node size in bytes (upper limit) */
+#define WG_RNODE_SIZE 512
+
+/** entries in a node: the bounding box and the offset of each child */
+#define WG_RNODE_ENTRIES \
+  ((gint) ((WG_RNODE_SIZE - 2*sizeof(gint)) /\
+  (sizeof(wg_rtree_box) + sizeof(gint))))
+/** smallest number of entries in a node created by a split */
+#define WG_RNODE_MIN_ENTRIES (WG_RNODE_ENTRIES * 2 / 5)
+
+#define WG_RTREE_MAX_DEPTH 32     /** limit of the tree height */
+
+/* Index header helpers */
+#define RTREE_ROOT_NODE(x) (x->ctl.r.offset_root_node)
+
+/* ====== data structures ======== */
+
+/** bounding box, bounds are inclusive */
+typedef struct {
+  double lo[2];
+  double hi[2];
+} wg_rtree_box;
+
+/** structure of R-tree node
+*   An entry of a leaf is the point of a row and the record offset.
+*   An entry of an inner node is the bounding box of a subtree and
+*   the offset of its root node.
+*/
+struct wg_rnode {
+  gint level;           /** 0 for leaves */
+  gint count;           /** number of entries */
+  wg_rtree_box box[WG_RNODE_ENTRIES];
+  gint child[WG_RNODE_ENTRIES];
+};
+
+/** Point and row pair, used when building the tree from existing rows */
+typedef struct {
+  double x;
+  double y;
+  gint rec;             /** row offset */
+  wg_uint hilbert;      /** position on the Hilbert curve, set when sorting */
+} wg_rtree_entry;
+
+/** box query cursor
+*   Depth-first search with an explicit stack of the nodes
+*   being visited.
+*/
+typedef struct {
+  wg_rtree_box box;     /** search box */
+  gint depth;           /** top of the stack, -1 when done */
+  gint node[WG_RTREE_MAX_DEPTH];
+  gint slot[WG_RTREE_MAX_DEPTH];  /** next entry of each node */
+} wg_rtree_cursor;
+
+/* ==== Protos ==== */
+
+gint wg_rtree_create(void *db, wg_index_header *hdr);
+gint wg_rtree_build(void *db, wg_index_header *hdr,
+  wg_rtree_entry *entries, gint count);
+void wg_rtree_free(void *db, wg_index_header *hdr);
+
+gint wg_rtree_coord(void *db, gint enc, double *val);
+gint wg_rtree_point(void *db, wg_index_header *hdr, void *rec,
+  double *x, double *y);
+gint wg_rtree_insert(void *db, wg_index_header *hdr, gint rec);
+gint wg_rtree_delete(void *db, wg_index_header *hdr, gint rec);
+
+wg_rtree_cursor *wg_rtree_new_cursor(void *db, wg_index_header *hdr,
+  wg_rtree_box *box);
+gint wg_rtree_next(void *db, wg_rtree_cursor *cur);
+void wg_rtree_free_cursor(void *db, wg_rtree_cursor *cur);
+
+gint wg_rtree_nearest(void *db, wg_index_header *hdr, double x, double y,
+  gint k, gint *recs);
+
+#endif /* DEFINED_DBRTREE_H */
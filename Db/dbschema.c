@@ -219,6 +219,11 @@ gint wg_delete_document(void *db, void *document) {
     return show_schema_error(db, "wg_delete_document: not a document");
   }
 #endif
+  /* The values are removed from the path indexes while the
+   * document is still complete */
+  if(!is_special_record(document) &&\
+    wg_index_del_document(db, document) < -1)
+    return -1;
 #ifndef USE_BACKLINKING
   return delete_record_recursive(db, document, 99);
 #else
@@ -0,0 +1,312 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbstats.c
+ *  Index statistics for the query planner.
+ *
+ *  An analyzed index has a row count, a HyperLogLog sketch of the
+ *  distinct keys and an equi-depth histogram of the first indexed
+ *  column. The planner uses them to estimate the number of rows a
+ *  query reads through the index.
+ */
+
+/* ====== Includes =============== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+#include "dbdata.h"
+#include "dbcompare.h"
+#include "dbhash.h"
+#include "dbstats.h"
+
+
+/* ====== Private headers and defs ======== */
+
+#define STATS_HASH_BITS ((gint) (sizeof(wg_uint) * 8))
+#define STATS_HASH_TOPBIT (((wg_uint) 1) << (STATS_HASH_BITS - 1))
+#define STATS_HASH_MULT 31
+#define STATS_HASHBUF 64    /** values longer than this are hashed
+                             *  from an allocated copy */
+#define STATS_LN2 0.69314718055994530942
+#define STATS_RANGE_GUESS 0.3 /** fraction of rows in a range, when
+                               *  there is no histogram */
+
+/* ======= Private protos ================ */
+
+static wg_uint stats_key_hash(void *db, wg_index_header *hdr, void *rec);
+static void hll_add(unsigned char *reg, wg_uint hash);
+
+static gint show_stats_error(void* db, char* errmsg);
+
+
+/* ====== Functions ============== */
+
+/** Build the statistics of an index from its sorted entries
+*  The entries must be sorted by the key and have the prefixes
+*  set. The statistics object is allocated on the first call and
+*  rebuilt on later ones.
+*  returns 0 on success, -1 on error.
+*/
+gint wg_stats_build(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, gint count) {
+  wg_index_stats *stats;
+  gint b, i;
+
+  if(!hdr->stats_offset) {
+    /* first gint of the object is the allocator header */
+    gint size = (sizeof(wg_index_stats) + sizeof(gint) - 1) / sizeof(gint);
+    gint object = wg_alloc_gints(db,
+      &(dbmemsegh(db)->indexhash_area_header), size + 1);
+    if(!object)
+      return show_stats_error(db, "Failed to allocate index statistics");
+    hdr->stats_offset = object + sizeof(gint);
+  }
+
+  stats = (wg_index_stats *) offsettoptr(db, hdr->stats_offset);
+  memset(stats, 0, sizeof(wg_index_stats));
+  stats->rows = count;
+  stats->sample_rows = count;
+  for(i=0; i<count; i++)
+    hll_add(stats->hll, stats_key_hash(db, hdr,
+      offsettoptr(db, entries[i].rec)));
+
+  /* Equi-depth histogram: the buckets have (almost) the same
+   * number of rows, equal values may span several buckets. */
+  stats->buckets = (count < WG_STATS_BUCKETS ? count : WG_STATS_BUCKETS);
+  for(b=0; b<stats->buckets; b++) {
+    gint start = (gint) (((double) b * count) / stats->buckets);
+    gint end = (gint) (((double) (b + 1) * count) / stats->buckets);
+    stats->bound[b] = entries[start].prefix;
+    stats->count[b] = end - start;
+    stats->distinct[b] = 1;
+    for(i=start+1; i<end; i++) {
+      if(entries[i].prefix != entries[i-1].prefix)
+        stats->distinct[b]++;
+    }
+  }
+  if(count)
+    stats->bound[stats->buckets] = entries[count-1].prefix;
+  return 0;
+}
+
+/** Release the statistics of an index
+*/
+void wg_stats_free(void *db, wg_index_header *hdr) {
+  if(hdr->stats_offset) {
+    wg_free_object(db, &(dbmemsegh(db)->indexhash_area_header),
+      hdr->stats_offset - sizeof(gint));
+    hdr->stats_offset = 0;
+  }
+}
+
+/** Update the statistics for a row added to the index
+*/
+void wg_stats_add_row(void *db, wg_index_header *hdr, void *rec) {
+  wg_index_stats *stats = \
+    (wg_index_stats *) offsettoptr(db, hdr->stats_offset);
+  stats->rows++;
+  hll_add(stats->hll, stats_key_hash(db, hdr, rec));
+}
+
+/** Update the statistics for a row removed from the index
+*  The distinct key estimate is not decreased.
+*/
+void wg_stats_remove_row(void *db, wg_index_header *hdr, void *rec) {
+  wg_index_stats *stats = \
+    (wg_index_stats *) offsettoptr(db, hdr->stats_offset);
+  if(stats->rows > 0)
+    stats->rows--;
+}
+
+/** Estimate the number of distinct keys in the index
+*  HyperLogLog estimate with linear counting for small
+*  cardinalities. Never more than the number of rows.
+*/
+gint wg_stats_distinct(void *db, wg_index_stats *stats) {
+  double sum = 0, m = WG_STATS_HLL_REGISTERS, est;
+  gint i, zeros = 0;
+
+  for(i=0; i<WG_STATS_HLL_REGISTERS; i++) {
+    sum += 1.0 / (double) (((wg_uint) 1) << stats->hll[i]);
+    if(!stats->hll[i])
+      zeros++;
+  }
+  est = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+  if(est <= 2.5 * m && zeros)
+    est = m * wg_stats_log(m / zeros);
+
+  if(est > stats->rows)
+    return stats->rows;
+  if(est < 1.0)
+    return (stats->rows ? 1 : 0);
+  return (gint) (est + 0.5);
+}
+
+/** Estimate the number of rows with the first column in a range
+*  The bounds are encoded values, WG_ILLEGAL if the range is open.
+*  Inclusive and exclusive bounds are not distinguished.
+*/
+double wg_stats_range_rows(void *db, wg_index_stats *stats,
+  gint start_bound, gint end_bound) {
+  wg_uint lo, hi;
+  double rows = 0;
+  gint b;
+
+  if(start_bound == WG_ILLEGAL && end_bound == WG_ILLEGAL)
+    return (double) stats->rows;
+  if(!stats->buckets) {
+    /* Analyzed while empty */
+    if(start_bound != WG_ILLEGAL && end_bound != WG_ILLEGAL &&\
+      WG_COMPARE(db, start_bound, end_bound) == WG_EQUAL)
+      return wg_stats_key_rows(db, stats);
+    return stats->rows * STATS_RANGE_GUESS;
+  }
+
+  lo = (start_bound == WG_ILLEGAL ? 0 : wg_normkey_prefix(db, start_bound));
+  hi = (end_bound == WG_ILLEGAL ? ~((wg_uint) 0) :\
+    wg_normkey_prefix(db, end_bound));
+  if(lo > hi)
+    return 0;
+
+  for(b=0; b<stats->buckets; b++) {
+    wg_uint bl = stats->bound[b], bh = stats->bound[b+1];
+    wg_uint l = (lo > bl ? lo : bl), h = (hi < bh ? hi : bh);
+    if(l > h)
+      continue;
+    if(bl == bh)
+      rows += stats->count[b]; /* single value bucket */
+    else if(l == h)
+      rows += (double) stats->count[b] / stats->distinct[b];
+    else
+      rows += stats->count[b] * ((double) (h - l) / (double) (bh - bl));
+  }
+
+  /* The histogram describes the rows at the time of analyzing */
+  return rows * stats->rows / stats->sample_rows;
+}
+
+/** Estimate the number of rows with a given key
+*  This is the average over all keys of the index.
+*/
+double wg_stats_key_rows(void *db, wg_index_stats *stats) {
+  gint distinct = wg_stats_distinct(db, stats);
+  return (distinct ? (double) stats->rows / distinct : 0);
+}
+
+/** Hash the indexed values of a row
+*/
+static wg_uint stats_key_hash(void *db, wg_index_header *hdr, void *rec) {
+  char buf[STATS_HASHBUF];
+  wg_uint hash = 0;
+  gint i;
+
+  for(i=0; i<hdr->fields; i++) {
+    gint enc = wg_get_field(db, rec, hdr->rec_field_index[i]);
+    gint len = wg_decode_for_hashing_copy(db, enc, buf, STATS_HASHBUF);
+    wg_uint fieldhash;
+
+    if(len > STATS_HASHBUF) {
+      char *decbytes;
+      len = wg_decode_for_hashing(db, enc, &decbytes);
+      if(!len)
+        continue;
+      fieldhash = wg_hash_bytes(decbytes, len);
+      free(decbytes);
+    } else {
+      fieldhash = wg_hash_bytes(buf, len);
+    }
+    hash = hash * STATS_HASH_MULT + fieldhash;
+  }
+  return hash;
+}
+
+/** Add a hash to the HyperLogLog registers
+*  The high bits select the register, which keeps the largest
+*  position of the first set bit seen in the rest of the hash.
+*/
+static void hll_add(unsigned char *reg, wg_uint hash) {
+  gint idx = (gint) (hash >> (STATS_HASH_BITS - WG_STATS_HLL_BITS));
+  wg_uint rest = hash << WG_STATS_HLL_BITS;
+  unsigned char rank = 1;
+
+  while(rank <= STATS_HASH_BITS - WG_STATS_HLL_BITS &&\
+    !(rest & STATS_HASH_TOPBIT)) {
+    rest <<= 1;
+    rank++;
+  }
+  if(reg[idx] < rank)
+    reg[idx] = rank;
+}
+
+/** Natural logarithm of x >= 1
+*  Avoids linking with libm for the few estimates that need it.
+*/
+double wg_stats_log(double x) {
+  double res = 0, z, z2, term;
+  int k;
+
+  while(x >= 2.0) {
+    x /= 2.0;
+    res += STATS_LN2;
+  }
+  /* ln(x) = 2 atanh((x-1)/(x+1)), here |z| < 1/3 */
+  z = (x - 1.0) / (x + 1.0);
+  z2 = z * z;
+  term = z;
+  for(k=1; k<24; k+=2) {
+    res += 2.0 * term / k;
+    term *= z2;
+  }
+  return res;
+}
+
+/* --------------- error handling ------------------------------*/
+
+/** called with err msg
+*
+*  may print or log an error
+*  does not do any jumps etc
+*/
+
+static gint show_stats_error(void* db, char* errmsg) {
+#ifdef WG_NO_ERRPRINT
+#else
+  fprintf(stderr,"index statistics error: %s\n",errmsg);
+#endif
+  return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
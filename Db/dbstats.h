@@ -0,0 +1,85 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file dbstats.h
+ * Public headers for index statistics
+ */
+
+#ifndef DEFINED_DBSTATS_H
+#define DEFINED_DBSTATS_H
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+
+#include "dballoc.h"
+/* For gint data type */
+#include "dbdata.h"
+/* For wg_index_entry */
+#include "dbindex.h"
+
+/* ==== Public macros ==== */
+
+#define WG_STATS_BUCKETS 32       /** histogram buckets */
+#define WG_STATS_HLL_BITS 10      /** HyperLogLog register index bits */
+#define WG_STATS_HLL_REGISTERS (1<<WG_STATS_HLL_BITS)
+
+/* ====== data structures ======== */
+
+/** statistics of an ordered index
+*   The row count and the HyperLogLog registers (distinct keys of the
+*   whole index key) are kept up to date on every insert and delete.
+*   The equi-depth histogram of the first column is built by
+*   wg_analyze_index() and describes the rows at that time. Histogram
+*   bounds are normalized key prefixes (see wg_normkey_prefix()), so
+*   they do not refer to any data in the database.
+*/
+typedef struct {
+  gint rows;                /** rows in the index */
+  gint sample_rows;         /** rows when the histogram was built */
+  gint buckets;             /** histogram buckets in use */
+  wg_uint bound[WG_STATS_BUCKETS+1];  /** first key of each bucket,
+                                       *  then the last key */
+  gint count[WG_STATS_BUCKETS];       /** rows in each bucket */
+  gint distinct[WG_STATS_BUCKETS];    /** distinct prefixes in each bucket */
+  unsigned char hll[WG_STATS_HLL_REGISTERS];  /** HyperLogLog registers */
+} wg_index_stats;
+
+/* ==== Protos ==== */
+
+gint wg_stats_build(void *db, wg_index_header *hdr,
+  wg_index_entry *entries, gint count);
+void wg_stats_free(void *db, wg_index_header *hdr);
+
+void wg_stats_add_row(void *db, wg_index_header *hdr, void *rec);
+void wg_stats_remove_row(void *db, wg_index_header *hdr, void *rec);
+
+gint wg_stats_distinct(void *db, wg_index_stats *stats);
+double wg_stats_range_rows(void *db, wg_index_stats *stats,
+  gint start_bound, gint end_bound);
+double wg_stats_key_rows(void *db, wg_index_stats *stats);
+double wg_stats_log(double x);
+
+#endif /* DEFINED_DBSTATS_H */
@@ -37,6 +37,38 @@
 #define WG_INDEX_TYPE_TTREE_JSON    51
 #define WG_INDEX_TYPE_HASH          60
 #define WG_INDEX_TYPE_HASH_JSON     61
+#define WG_INDEX_TYPE_BTREE         70
+#define WG_INDEX_TYPE_BITMAP        80
+#define WG_INDEX_TYPE_FULLTEXT      90
+#define WG_INDEX_TYPE_RTREE         100
+#define WG_INDEX_TYPE_JSON_PATH     110
+
+/* Full-text tokenizer flags */
+#define WG_FULLTEXT_KEEP_CASE 0x1 /** terms are case sensitive */
+#define WG_FULLTEXT_ASCII     0x2 /** non-ASCII characters separate terms */
+
+/* Full-text search modes */
+#define WG_FULLTEXT_AND 1         /** rows with all terms */
+#define WG_FULLTEXT_OR 2          /** rows with any of the terms */
+
+/* Expressions of expression indexes, also combined with
+ * the query conditions (WG_COND_EQUAL|WG_EXPR_LOWER) */
+#define WG_EXPR_LOWER       0x0100  /** string in ASCII lower case */
+#define WG_EXPR_STRLEN      0x0200  /** length of a string in bytes */
+#define WG_EXPR_DATE        0x0300  /** date of a Unix timestamp */
+#define WG_EXPR_MASK        0x0f00
+
+/* Public data structures */
+
+/** Index description for wg_create_indexes() */
+typedef struct {
+  wg_int *columns;    /** array of column numbers */
+  wg_int col_count;   /** size of the columns array */
+  wg_int type;        /** WG_INDEX_TYPE_* */
+  wg_int *matchrec;   /** template, NULL for a full index */
+  wg_int reclen;      /** size of the template */
+  wg_int size_hint;   /** expected number of distinct keys (hash) */
+} wg_index_spec;
 
 /* Public protos */
 
@@ -44,6 +76,11 @@ wg_int wg_create_index(void *db, wg_int column, wg_int type,
   wg_int *matchrec, wg_int reclen);
 wg_int wg_create_multi_index(void *db, wg_int *columns, wg_int col_count,
   wg_int type, wg_int *matchrec, wg_int reclen);
+wg_int wg_create_multi_index_sized(void *db, wg_int *columns,
+  wg_int col_count, wg_int type, wg_int *matchrec, wg_int reclen,
+  wg_int size_hint);
+wg_int wg_create_indexes(void *db, wg_index_spec *specs, wg_int count,
+  wg_int nthreads);
 wg_int wg_drop_index(void *db, wg_int index_id);
 wg_int wg_column_to_index_id(void *db, wg_int column, wg_int type,
   wg_int *matchrec, wg_int reclen);
@@ -52,5 +89,26 @@ wg_int wg_multi_column_to_index_id(void *db, wg_int *columns,
 wg_int wg_get_index_type(void *db, wg_int index_id);
 void * wg_get_index_template(void *db, wg_int index_id, wg_int *reclen);
 void * wg_get_all_indexes(void *db, wg_int *count);
+wg_int wg_analyze_index(void *db, wg_int index_id);
+wg_int wg_analyze(void *db);
+wg_int wg_get_index_stats(void *db, wg_int index_id, wg_int *rows,
+  wg_int *distinct);
+wg_int wg_create_fulltext_index(void *db, wg_int column, wg_int flags,
+  wg_int min_len);
+wg_int wg_fulltext_search(void *db, wg_int index_id, char *text,
+  wg_int mode, wg_int k, void **rows, double *scores);
+wg_int wg_create_expr_index(void *db, wg_int column, wg_int expr,
+  wg_int *matchrec, wg_int reclen);
+wg_int wg_expr_to_index_id(void *db, wg_int column, wg_int expr,
+  wg_int *matchrec, wg_int reclen);
+wg_int wg_create_json_path_index(void *db, char *path);
+wg_int wg_json_path_to_index_id(void *db, char *path);
+wg_int wg_create_bloom_filter(void *db, wg_int index_id, wg_int bits_per_key);
+wg_int wg_drop_bloom_filter(void *db, wg_int index_id);
+wg_int wg_get_bloom_stats(void *db, wg_int index_id, wg_int *lookups,
+  wg_int *negatives, wg_int *false_positives);
+wg_int wg_defer_index_updates(void *db, wg_int on);
+wg_int wg_flush_index_updates(void *db);
+wg_int wg_get_index_pending(void *db, wg_int index_id);
 
 #endif /* DEFINED_INDEXAPI_H */
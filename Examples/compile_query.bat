@@ -1 +1 @@
-cl /Ox /W3 /I..\Db query.c ..\Db\dbmem.c ..\Db\dballoc.c ..\Db\dbdata.c ..\Db\dblock.c ..\DB\dbindex.c ..\Db\dblog.c ..\Db\dbhash.c ..\Db\dbcompare.c ..\Db\dbquery.c ..\Db\dbutil.c ..\Test\dbtest.c ..\Db\dbmpool.c ..\Db\dbjson.c ..\Db\dbschema.c ..\json\yajl_all.c
+cl /Ox /W3 /I..\Db query.c ..\Db\dbmem.c ..\Db\dballoc.c ..\Db\dbdata.c ..\Db\dblock.c ..\DB\dbindex.c ..\DB\dbbtree.c ..\DB\dbstats.c ..\DB\dbbitmap.c ..\DB\dbfulltext.c ..\DB\dbrtree.c ..\Db\dblog.c ..\Db\dbhash.c ..\Db\dbcompare.c ..\Db\dbquery.c ..\Db\dbutil.c ..\Test\dbtest.c ..\Db\dbmpool.c ..\Db\dbjson.c ..\Db\dbschema.c ..\json\yajl_all.c
@@ -0,0 +1,229 @@
+/*
+* $Id:  $
+* $Version: $
+*
+* Copyright (c) WhiteDB contributors 2026
+*
+* This file is part of WhiteDB
+*
+* WhiteDB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* WhiteDB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with WhiteDB.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+ /** @file hashbench.c
+ *  Benchmark for the string and index hash functions
+ *
+ *  Compares the chain length distribution and throughput of the
+ *  hash used by the string and index hashes against the older
+ *  byte-at-a-time (sdbm) function, on generated URIs and JSON
+ *  index keys.
+ */
+
+/* ====== Includes =============== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#include "../config-w32.h"
+#else
+#include "../config.h"
+#endif
+
+#include "../Db/dballoc.h"
+#include "../Db/dbdata.h"
+#include "../Db/dbhash.h"
+
+/* ====== Private headers and defs ======== */
+
+#define DEFAULT_KEYS 200000
+#define DEFAULT_ROUNDS 20
+#define KEYBUF_SIZE 128
+
+typedef wg_uint (*hashfunc)(char *data, gint length);
+
+typedef struct {
+  char *data;
+  gint length;
+} benchkey;
+
+/* ======= Private protos ================ */
+
+static wg_uint hash_sdbm(char *data, gint length);
+static benchkey *make_keys(int count, int json);
+static void free_keys(benchkey *keys, int count);
+static void run_bench(char *name, hashfunc func, benchkey *keys,
+  int count, int rounds, wg_uint arraylength, int pow2);
+
+
+/* ====== Functions ============== */
+
+int main(int argc, char **argv) {
+  int count = DEFAULT_KEYS, rounds = DEFAULT_ROUNDS, json;
+  wg_uint arraylength;
+
+  if(argc > 1) {
+    count = atoi(argv[1]);
+    if(count < 1) {
+      printf("usage: hashbench [keys] [rounds]\n");
+      return 1;
+    }
+  }
+  if(argc > 2) {
+    rounds = atoi(argv[2]);
+    if(rounds < 1)
+      rounds = 1;
+  }
+
+  /* one key per slot on average, as with a fully grown index hash */
+  for(arraylength = 1; arraylength < (wg_uint) count; arraylength <<= 1);
+
+  for(json=0; json<2; json++) {
+    benchkey *keys = make_keys(count, json);
+    if(!keys) {
+      fprintf(stderr, "Failed to allocate memory.\n");
+      return 1;
+    }
+    printf("%s: %d keys, %lu slots, %d rounds\n",
+      (json ? "JSON keys" : "URIs"), count,
+      (unsigned long) arraylength, rounds);
+    run_bench("sdbm, modulo", hash_sdbm, keys, count, rounds,
+      arraylength - 1, 0);
+    run_bench("sdbm, mask", hash_sdbm, keys, count, rounds,
+      arraylength, 1);
+    run_bench("wg_hash_bytes", wg_hash_bytes, keys, count, rounds,
+      arraylength, 1);
+    free_keys(keys, count);
+  }
+  return 0;
+}
+
+/*
+ * The byte-at-a-time hash used previously.
+ */
+static wg_uint hash_sdbm(char *data, gint length) {
+  char* endp;
+  wg_uint hash = 0;
+
+  for(endp=data+length; data<endp; data++) {
+    hash = *data + (hash << 6) + (hash << 16) - hash;
+  }
+  return hash;
+}
+
+/*
+ * Generate test keys in the format used by the index hash
+ * (type byte, followed by the value bytes). JSON keys consist
+ * of a key string and a value, separated by '\0'.
+ */
+static benchkey *make_keys(int count, int json) {
+  static const char *fields[] = {
+    "id", "name", "email", "address", "city", "created", "status", "tags"
+  };
+  benchkey *keys = (benchkey *) malloc(count * sizeof(benchkey));
+  char buf[KEYBUF_SIZE];
+  int i;
+
+  if(!keys)
+    return NULL;
+  srand(12345);
+  for(i=0; i<count; i++) {
+    int len;
+    buf[0] = (char) WG_STRTYPE;
+    if(json) {
+      const char *field = fields[rand() % 8];
+      len = 1 + strlen(field);
+      strcpy(buf + 1, field);
+      buf[len++] = '\0';
+      buf[len++] = (char) WG_STRTYPE;
+      len += snprintf(buf + len, KEYBUF_SIZE - len, "user%d", i);
+    } else {
+      len = 1 + snprintf(buf + 1, KEYBUF_SIZE - 1,
+        "http://www.example.org/data/%s/resource%d#item",
+        (i & 1 ? "people" : "places"), i);
+    }
+    keys[i].data = (char *) malloc(len);
+    if(!keys[i].data) {
+      free_keys(keys, i);
+      return NULL;
+    }
+    memcpy(keys[i].data, buf, len);
+    keys[i].length = len;
+  }
+  return keys;
+}
+
+static void free_keys(benchkey *keys, int count) {
+  int i;
+  for(i=0; i<count; i++)
+    free(keys[i].data);
+  free(keys);
+}
+
+/*
+ * Measure the hashing throughput and the resulting chain lengths.
+ * The average probe length is the expected number of keys compared
+ * on a successful lookup.
+ */
+static void run_bench(char *name, hashfunc func, benchkey *keys,
+  int count, int rounds, wg_uint arraylength, int pow2) {
+  gint *chains = (gint *) calloc(arraylength, sizeof(gint));
+  gint maxchain = 0, empty = 0;
+  double probes = 0, bytes = 0, secs;
+  wg_uint sum = 0;
+  clock_t start;
+  int i, r;
+
+  if(!chains) {
+    fprintf(stderr, "Failed to allocate memory.\n");
+    return;
+  }
+
+  for(i=0; i<count; i++) {
+    wg_uint h = func(keys[i].data, keys[i].length);
+    chains[pow2 ? (h & (arraylength - 1)) : (h % arraylength)]++;
+    bytes += keys[i].length;
+  }
+  for(i=0; i<(int) arraylength; i++) {
+    if(!chains[i])
+      empty++;
+    else if(chains[i] > maxchain)
+      maxchain = chains[i];
+    probes += (double) chains[i] * (chains[i] + 1) / 2;
+  }
+
+  start = clock();
+  for(r=0; r<rounds; r++) {
+    for(i=0; i<count; i++)
+      sum += func(keys[i].data, keys[i].length);
+  }
+  secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+  printf("  %-14s max chain %3d, avg probes %.3f, empty %5.1f%%, "\
+    "%8.1f MB/s (%lx)\n", name, (int) maxchain, probes / count,
+    100.0 * empty / arraylength,
+    (secs > 0 ? bytes * rounds / secs / 1048576 : 0.0),
+    (unsigned long) (sum & 0xf)); /* keep the loop from being optimized out */
+  free(chains);
+}
+
+#ifdef __cplusplus
+}
+#endif
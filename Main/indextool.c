@@ -59,6 +59,8 @@ extern "C" {
 void print_tree(void *db, FILE *file, struct wg_tnode *node, int col);
 int log_tree(void *db, char *file, struct wg_tnode *node, int col);
 void dump_hash(void *db, FILE *file, db_hash_area_header *ha);
+static void dump_hash_array(void *db, FILE *file, gint arraystart,
+  gint arraylength);
 wg_index_header *get_index_by_id(void *db, gint index_id);
 
 
@@ -222,9 +224,20 @@ int log_tree(void *db, char *file, struct wg_tnode *node, int col){
 }
 
 void dump_hash(void *db, FILE *file, db_hash_area_header *ha) {
+  dump_hash_array(db, file, ha->arraystart, ha->arraylength);
+  if(ha->oldarraystart) {
+    /* resize in progress */
+    fprintf(file, "old array:\n");
+    dump_hash_array(db, file, ha->oldarraystart, ha->oldarraylength);
+  }
+}
+
+static void dump_hash_array(void *db, FILE *file, gint arraystart,
+  gint arraylength)
+{
   gint i;
-  for(i=0; i<ha->arraylength; i++) {
-    gint bucket = dbfetch(db, (ha->arraystart)+(sizeof(gint) * i));
+  for(i=0; i<arraylength; i++) {
+    gint bucket = dbfetch(db, arraystart+(sizeof(gint) * i));
     if(bucket) {
 #ifdef _WIN32
       fprintf(file, "hash: %Id\n", i);
@@ -80,6 +80,8 @@ extern "C" {
 
 #define FLAGS_FORCE 0x1
 #define FLAGS_LOGGING 0x2
+#define FLAGS_ONLINE 0x4
+#define FLAGS_COMPACT 0x8
 
 
 /* Helper macros for database lock management */
@@ -110,6 +112,7 @@ extern "C" {
 gint parse_shmsize(char *arg);
 gint parse_flag(char *arg);
 int parse_memmode(char *arg);
+gint parse_expr(char *name);
 wg_query_arg *make_arglist(void *db, char **argv, int argc, int *sz);
 void free_arglist(void *db, wg_query_arg *arglist, int sz);
 void query(void *db, char **argv, int argc);
@@ -145,10 +148,15 @@ void usage(char *prog) {
     "    help (or \"-h\") - display this text.\n"\
     "    version (or \"-v\") - display libwgdb version.\n"\
     "    free - free shared memory.\n"\
-    "    export [-f] <filename> - write memory dump to disk (-f: force dump "\
-    "even if unable to get lock)\n"\
+    "    export [-f|-o|-c] <filename> - write memory dump to disk (-f: force "\
+    "dump even if unable to get lock, -o: online dump, lock only while "\
+    "copying the memory image, -c: online dump in compact format)\n"\
     "    import [-l] <filename> - read memory dump from disk. Overwrites "\
     " existing memory contents (-l: enable logging after import).\n"\
+    "    exportinc <base> <filename> - write the pages changed since the "\
+    "base dump to disk.\n"\
+    "    importinc <base> <filename> .. - read memory dump and a chain of "\
+    "incremental dumps from disk.\n"\
     "    exportcsv <filename> - export data to a CSV file.\n"\
     "    importcsv <filename> - import data from a CSV file.\n", prog);
 #ifdef USE_REASONER
@@ -163,7 +171,9 @@ void usage(char *prog) {
     "    importrdf <pref> <suff> <filename> - import data from a RDF file.\n");
 #endif
 #ifdef USE_DBLOG
-  printf("    replay <filename> - replay a journal file.\n");
+  printf("    replay <filename> - replay a journal file.\n"\
+    "    replicate - stream the journal to standard output.\n"\
+    "    follow - apply a journal stream from standard input.\n");
 #endif
   printf("    info - print information about the memory database.\n"\
     "    add <value1> .. - store data row (only int or str recognized)\n"\
@@ -174,7 +184,18 @@ void usage(char *prog) {
     "    addjson [filename] - store a json document.\n"\
     "    findjson <json> - find documents with matching keys/values.\n"\
     "    createindex <column> - create ttree index\n" \
+    "    createbtree <column> - create B-tree index\n" \
+    "    createbitmap <column> - create bitmap index\n" \
+    "    createfulltext <column> - create full-text index\n" \
+    "    createexpr <column> <lower|strlen|date> - create index on "\
+    "an expression of the column\n" \
+    "    creatertree <column1> <column2> - create R-tree index on "\
+    "x and y coordinates\n" \
     "    createhash <columns> - create hash index (JSON support)\n" \
+    "    createpath <path> - create JSON path index (like a.b.c)\n" \
+    "    createbloom <index id> [bits per key] - add a Bloom filter to "\
+    "a hash index\n" \
+    "    bloomstats <index id> - print the Bloom filter statistics\n" \
     "    dropindex <index id> - delete an index\n" \
     "    listindex - list all indexes in database\n");
 #ifdef _WIN32
@@ -246,6 +267,10 @@ gint parse_flag(char *arg) {
       return FLAGS_FORCE;
     case 'l':
       return FLAGS_LOGGING;
+    case 'o':
+      return FLAGS_ONLINE;
+    case 'c':
+      return FLAGS_COMPACT;
     default:
       fprintf(stderr, "Unrecognized option: `%c'\n", arg[0]);
       break;
@@ -363,6 +388,10 @@ int main(int argc, char **argv) {
       /* Locking is handled internally by the dbdump.c functions */
       if(flags & FLAGS_FORCE)
         err = wg_dump_internal(shmptr,argv[i+1], 0);
+      else if(flags & FLAGS_ONLINE)
+        err = wg_dump_online(shmptr,argv[i+1]);
+      else if(flags & FLAGS_COMPACT)
+        err = wg_dump_compact(shmptr,argv[i+1]);
       else
         err = wg_dump(shmptr,argv[i+1]);
 
@@ -373,6 +402,50 @@ int main(int argc, char **argv) {
         fprintf(stderr, "Export failed.\n");
       break;
     }
+    else if(argc>(i+2) && !strcmp(argv[i],"exportinc")){
+      wg_int err;
+
+      shmptr=wg_attach_existing_database(shmname);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+
+      err = wg_dump_incremental(shmptr,argv[i+1],argv[i+2]);
+      if(err<-1)
+        fprintf(stderr, "Fatal error in wg_dump_incremental, db may have"\
+          " become corrupt\n");
+      else if(err)
+        fprintf(stderr, "Export failed.\n");
+      break;
+    }
+    else if(argc>(i+2) && !strcmp(argv[i],"importinc")){
+      wg_int err, minsize, maxsize;
+
+      err = wg_check_dump(NULL, argv[i+1], &minsize, &maxsize);
+      if(err) {
+        fprintf(stderr, "Import failed.\n");
+        break;
+      }
+
+      /* increments may grow the image up to the original size */
+      shmptr=wg_attach_memsegment(shmname, maxsize, maxsize, 1, 0, 0);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+
+      err = wg_import_incremental(shmptr, argv[i+1], &argv[i+2],
+        argc-i-2);
+      if(!err)
+        printf("Database imported.\n");
+      else if(err<-1)
+        fprintf(stderr, "Fatal error in wg_import_incremental, db may have"\
+          " become corrupt\n");
+      else
+        fprintf(stderr, "Import failed.\n");
+      break;
+    }
 #ifdef USE_DBLOG
     else if(argc>(i+1) && !strcmp(argv[i],"replay")){
       wg_int err;
@@ -395,6 +468,37 @@ int main(int argc, char **argv) {
         fprintf(stderr, "Failed to import log (database unmodified).\n");
       break;
     }
+    else if(!strcmp(argv[i],"replicate")){
+      shmptr=wg_attach_existing_database(shmname);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+
+      /* Runs until the follower disconnects */
+      wg_ship_log(shmptr, fileno(stdout));
+      break;
+    }
+    else if(!strcmp(argv[i],"follow")){
+      wg_int err;
+
+      shmptr=wg_attach_database(shmname, shmsize);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+
+      /* Locking is handled internally by wg_follow_log() */
+      err = wg_follow_log(shmptr, fileno(stdin));
+      if(!err)
+        printf("Journal stream ended.\n");
+      else if(err<-1)
+        fprintf(stderr, "Fatal error when following, database may have "\
+          "become corrupt\n");
+      else
+        fprintf(stderr, "Failed to follow the journal stream.\n");
+      break;
+    }
 #endif
     else if(argc>(i+1) && !strcmp(argv[i],"exportcsv")){
       shmptr=wg_attach_existing_database(shmname);
@@ -694,6 +798,80 @@ int main(int argc, char **argv) {
       WULOCK(shmptr, wlock);
       break;
     }
+    else if(argc>(i+1) && !strcmp(argv[i], "createbtree")) {
+      int col;
+      shmptr = (void *) wg_attach_database(shmname, shmsize);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+      sscanf(argv[i+1], "%d", &col);
+      WLOCK(shmptr, wlock);
+      wg_create_index(shmptr, col, WG_INDEX_TYPE_BTREE, NULL, 0);
+      WULOCK(shmptr, wlock);
+      break;
+    }
+    else if(argc>(i+1) && !strcmp(argv[i], "createbitmap")) {
+      int col;
+      shmptr = (void *) wg_attach_database(shmname, shmsize);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+      sscanf(argv[i+1], "%d", &col);
+      WLOCK(shmptr, wlock);
+      wg_create_index(shmptr, col, WG_INDEX_TYPE_BITMAP, NULL, 0);
+      WULOCK(shmptr, wlock);
+      break;
+    }
+    else if(argc>(i+1) && !strcmp(argv[i], "createfulltext")) {
+      int col;
+      shmptr = (void *) wg_attach_database(shmname, shmsize);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+      sscanf(argv[i+1], "%d", &col);
+      WLOCK(shmptr, wlock);
+      wg_create_index(shmptr, col, WG_INDEX_TYPE_FULLTEXT, NULL, 0);
+      WULOCK(shmptr, wlock);
+      break;
+    }
+    else if(argc>(i+2) && !strcmp(argv[i], "createexpr")) {
+      int col;
+      gint expr = parse_expr(argv[i+2]);
+      if(!expr) {
+        fprintf(stderr, "Invalid expression %s.\n", argv[i+2]);
+        exit(1);
+      }
+      shmptr = (void *) wg_attach_database(shmname, shmsize);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+      sscanf(argv[i+1], "%d", &col);
+      WLOCK(shmptr, wlock);
+      wg_create_expr_index(shmptr, col, expr, NULL, 0);
+      WULOCK(shmptr, wlock);
+      break;
+    }
+    else if(argc>(i+2) && !strcmp(argv[i], "creatertree")) {
+      gint cols[2];
+      int col;
+      shmptr = (void *) wg_attach_database(shmname, shmsize);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+      sscanf(argv[i+1], "%d", &col);
+      cols[0] = col;
+      sscanf(argv[i+2], "%d", &col);
+      cols[1] = col;
+      WLOCK(shmptr, wlock);
+      wg_create_multi_index(shmptr, cols, 2, WG_INDEX_TYPE_RTREE, NULL, 0);
+      WULOCK(shmptr, wlock);
+      break;
+    }
     else if(argc>(i+1) && !strcmp(argv[i], "createhash")) {
       gint cols[MAX_INDEX_FIELDS], col_count, j;
       shmptr = (void *) wg_attach_database(shmname, shmsize);
@@ -713,6 +891,55 @@ int main(int argc, char **argv) {
       WULOCK(shmptr, wlock);
       break;
     }
+    else if(argc>(i+1) && !strcmp(argv[i], "createpath")) {
+      shmptr = (void *) wg_attach_database(shmname, shmsize);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+      WLOCK(shmptr, wlock);
+      wg_create_json_path_index(shmptr, argv[i+1]);
+      WULOCK(shmptr, wlock);
+      break;
+    }
+    else if(argc>(i+1) && !strcmp(argv[i], "createbloom")) {
+      int index_id, bits = 0;
+      shmptr = (void *) wg_attach_database(shmname, shmsize);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+      sscanf(argv[i+1], "%d", &index_id);
+      if(argc>(i+2))
+        sscanf(argv[i+2], "%d", &bits);
+      WLOCK(shmptr, wlock);
+      if(wg_create_bloom_filter(shmptr, index_id, bits))
+        fprintf(stderr, "Failed to create Bloom filter.\n");
+      else
+        printf("Bloom filter created.\n");
+      WULOCK(shmptr, wlock);
+      break;
+    }
+    else if(argc>(i+1) && !strcmp(argv[i], "bloomstats")) {
+      int index_id;
+      gint lookups, negatives, fp;
+      shmptr = (void *) wg_attach_database(shmname, shmsize);
+      if(!shmptr) {
+        fprintf(stderr, "Failed to attach to database.\n");
+        exit(1);
+      }
+      sscanf(argv[i+1], "%d", &index_id);
+      RLOCK(shmptr, rlock);
+      if(wg_get_bloom_stats(shmptr, index_id, &lookups, &negatives, &fp)) {
+        fprintf(stderr, "Index has no Bloom filter.\n");
+      } else {
+        printf("lookups: %d\nrejected by filter: %d\n"\
+          "false positives: %d (%.2f%%)\n", (int) lookups, (int) negatives,
+          (int) fp, (negatives + fp ? 100.0 * fp / (negatives + fp) : 0.0));
+      }
+      RULOCK(shmptr, rlock);
+      break;
+    }
     else if(argc>(i+1) && !strcmp(argv[i], "dropindex")) {
       int index_id;
       shmptr = (void *) wg_attach_database(shmname, shmsize);
@@ -756,6 +983,20 @@ int main(int argc, char **argv) {
   exit(0);
 }
 
+/** Parse the name of an index expression
+ *
+ *  returns WG_EXPR_* or 0 if the name is not recognized.
+ */
+gint parse_expr(char *name) {
+  if(!strcmp(name, "lower"))
+    return WG_EXPR_LOWER;
+  else if(!strcmp(name, "strlen"))
+    return WG_EXPR_STRLEN;
+  else if(!strcmp(name, "date"))
+    return WG_EXPR_DATE;
+  return 0;
+}
+
 /** Parse row matching parameters from the command line
  *
  *  argv should point to the part in argument list where the
@@ -767,9 +1008,9 @@ int main(int argc, char **argv) {
  */
 wg_query_arg *make_arglist(void *db, char **argv, int argc, int *sz) {
   int c, i, j, qargc;
-  char cond[80];
+  char cond[80], *condp;
   wg_query_arg *arglist;
-  gint encoded;
+  gint encoded, expr;
 
   qargc = argc / 3;
   *sz = qargc;
@@ -795,23 +1036,44 @@ wg_query_arg *make_arglist(void *db, char **argv, int argc, int *sz) {
 
     arglist[i].column = c;
     arglist[i].value = encoded;
-    if(!strncmp(cond, "=", 1))
+
+    /* "expr:cond" compares the expression of the column value */
+    expr = 0;
+    condp = strchr(cond, ':');
+    if(condp) {
+      *condp++ = '\0';
+      expr = parse_expr(cond);
+      if(!expr) {
+        fprintf(stderr, "invalid expression %s\n", cond);
+        free_arglist(db, arglist, qargc);
+        return NULL;
+      }
+    } else {
+      condp = cond;
+    }
+
+    if(!strcmp(condp, "contains"))
+        arglist[i].cond = WG_COND_CONTAINS_TERM;
+    else if(!strcmp(condp, "prefix"))
+        arglist[i].cond = WG_COND_PREFIX;
+    else if(!strncmp(condp, "=", 1))
         arglist[i].cond = WG_COND_EQUAL;
-    else if(!strncmp(cond, "!=", 2))
+    else if(!strncmp(condp, "!=", 2))
         arglist[i].cond = WG_COND_NOT_EQUAL;
-    else if(!strncmp(cond, "<=", 2))
+    else if(!strncmp(condp, "<=", 2))
         arglist[i].cond = WG_COND_LTEQUAL;
-    else if(!strncmp(cond, ">=", 2))
+    else if(!strncmp(condp, ">=", 2))
         arglist[i].cond = WG_COND_GTEQUAL;
-    else if(!strncmp(cond, "<", 1))
+    else if(!strncmp(condp, "<", 1))
         arglist[i].cond = WG_COND_LESSTHAN;
-    else if(!strncmp(cond, ">", 1))
+    else if(!strncmp(condp, ">", 1))
         arglist[i].cond = WG_COND_GREATER;
     else {
-      fprintf(stderr, "invalid condition %s\n", cond);
+      fprintf(stderr, "invalid condition %s\n", condp);
       free_arglist(db, arglist, qargc);
       return NULL;
     }
+    arglist[i].cond |= expr;
   }
 
   return arglist;
@@ -1087,7 +1349,7 @@ void segment_stats(void *db) {
 }
 
 void print_indexes(void *db, FILE *f) {
-  int column;
+  int i, column;
   db_memsegment_header* dbh = dbmemsegh(db);
   gint *ilist;
 
@@ -1099,8 +1361,18 @@ void print_indexes(void *db, FILE *f) {
     fprintf(f, "col\ttype\tmulti\tid\tmask\n");
   }
 
-  for(column=0; column<=MAX_INDEXED_FIELDNR; column++) {
-    ilist = &dbh->index_control_area_header.index_table[column];
+  for(i=0; i<=MAX_INDEXED_FIELDNR+\
+    dbh->index_control_area_header.column_map_count; i++) {
+    if(i <= MAX_INDEXED_FIELDNR) {
+      column = i;
+      ilist = &dbh->index_control_area_header.index_table[column];
+    } else {
+      /* the rest of the columns are in the column map */
+      wg_index_column *map = (wg_index_column *) offsettoptr(db,
+        dbh->index_control_area_header.column_map);
+      column = map[i-MAX_INDEXED_FIELDNR-1].column;
+      ilist = &map[i-MAX_INDEXED_FIELDNR-1].index_list;
+    }
     while(*ilist) {
       gcell *ilistelem = (gcell *) offsettoptr(db, *ilist);
       if(ilistelem->car) {
@@ -1119,12 +1391,28 @@ void print_indexes(void *db, FILE *f) {
             break;
           case WG_INDEX_TYPE_HASH:
             typestr[0] = '#';
-            typestr[1] = '\0';
+            typestr[1] = (hdr->expr ? 'E' : '\0');
             break;
           case WG_INDEX_TYPE_HASH_JSON:
             typestr[0] = '#';
             typestr[1] = 'J';
             break;
+          case WG_INDEX_TYPE_BTREE:
+            typestr[0] = 'B';
+            typestr[1] = '\0';
+            break;
+          case WG_INDEX_TYPE_BITMAP:
+            typestr[0] = 'B';
+            typestr[1] = 'M';
+            break;
+          case WG_INDEX_TYPE_FULLTEXT:
+            typestr[0] = 'F';
+            typestr[1] = 'T';
+            break;
+          case WG_INDEX_TYPE_RTREE:
+            typestr[0] = 'R';
+            typestr[1] = 'T';
+            break;
           default:
             break;
         }
@@ -1142,6 +1430,21 @@ void print_indexes(void *db, FILE *f) {
       ilist = &ilistelem->cdr;
     }
   }
+
+  /* JSON path indexes are not on columns, the path is printed */
+  ilist = &dbh->index_control_area_header.index_list;
+  while(*ilist) {
+    gcell *ilistelem = (gcell *) offsettoptr(db, *ilist);
+    wg_index_header *hdr = \
+      (wg_index_header *) offsettoptr(db, ilistelem->car);
+    if(hdr->type == WG_INDEX_TYPE_JSON_PATH) {
+      fprintf(f, "%s\tJP\t%d\t%d\t-\n",
+        (char *) offsettoptr(db, hdr->ctl.p.path_offset),
+        (int) hdr->fields,
+        (int) ilistelem->car);
+    }
+    ilist = &ilistelem->cdr;
+  }
 }
 
 
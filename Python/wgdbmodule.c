@@ -1874,6 +1874,8 @@ PyMODINIT_FUNC PyInit_wgdb(void)
   PyModule_AddIntConstant(m, "COND_GREATER", WG_COND_GREATER);
   PyModule_AddIntConstant(m, "COND_LTEQUAL", WG_COND_LTEQUAL);
   PyModule_AddIntConstant(m, "COND_GTEQUAL", WG_COND_GTEQUAL);
+  PyModule_AddIntConstant(m, "COND_CONTAINS_TERM", WG_COND_CONTAINS_TERM);
+  PyModule_AddIntConstant(m, "COND_PREFIX", WG_COND_PREFIX);
 
   /* Initialize PyDateTime C API */
   PyDateTime_IMPORT;
@@ -41,6 +41,7 @@
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <signal.h>
 #else
 #include <process.h>
 #include <errno.h>
@@ -61,15 +62,25 @@ extern "C" {
 #include "../Db/dbdata.h"
 #include "../Db/dbhash.h"
 #include "../Db/dbindex.h"
+#include "../Db/dbbtree.h"
+#include "../Db/dbbitmap.h"
+#include "../Db/dbfulltext.h"
+#include "../Db/dbrtree.h"
 #include "../Db/dbmem.h"
 #include "../Db/dbutil.h"
 #include "../Db/dbquery.h"
 #include "../Db/dbcompare.h"
+#include "../Db/dblock.h"
 #include "../Db/dblog.h"
+#include "../Db/dbdump.h"
 #include "../Db/dbschema.h"
 #include "../Db/dbjson.h"
 #include "dbtest.h"
 
+#if !defined(_WIN32) && defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
 /* ====== Private headers and defs ======== */
 
 #ifdef _WIN32
@@ -93,12 +104,28 @@ static gint wg_check_strhash(void* db, int printlevel);
 static gint wg_test_index1(void *db, int magnitude, int printlevel);
 static gint wg_test_index2(void *db, int printlevel);
 static gint wg_test_index3(void *db, int magnitude, int printlevel);
+static gint wg_test_index4(void *db, int magnitude, int printlevel);
+static gint wg_test_index5(void *db, int magnitude, int printlevel);
+static gint wg_test_index6(void *db, int magnitude, int printlevel);
+static gint wg_test_index7(void *db, int magnitude, int printlevel);
+static gint wg_test_index8(void *db, int magnitude, int printlevel);
+static gint wg_test_index9(void *db, int magnitude, int printlevel);
+static gint wg_test_index10(void *db, int magnitude, int printlevel);
+static gint wg_test_index11(void *db, int magnitude, int printlevel);
+static gint wg_test_index12(void *db, int magnitude, int printlevel);
+static gint wg_test_index13(void *db, int magnitude, int printlevel);
+static gint wg_test_index14(void *db, int magnitude, int printlevel);
+static gint wg_test_index15(void *db, int magnitude, int printlevel);
 static gint wg_check_childdb(void* db, int printlevel);
 static gint wg_check_schema(void* db, int printlevel);
 static gint wg_check_json_parsing(void* db, int printlevel);
 static gint wg_check_idxhash(void* db, int printlevel);
 static gint wg_test_query(void *db, int magnitude, int printlevel);
+static gint wg_check_dump_compact(void* db, int printlevel);
+static gint wg_check_dump_incremental(void* db, int printlevel);
 static gint wg_check_log(void* db, int printlevel);
+static gint wg_check_log_shipping(void* db, int printlevel);
+static gint wg_check_dump_online(void* db, int printlevel);
 
 static void wg_show_db_area_header(void* db, void* area_header);
 static void wg_show_bucket_freeobjects(void* db, gint freelist);
@@ -119,8 +146,43 @@ static int guarded_strcmp(char* a, char* b);
 static int bufguarded_strcmp(char* a, char* b);
 static int validate_index(void *db, void *rec, int rows, int column,
   int printlevel);
+static int validate_tnode_search(void *db, int column, int printlevel);
 static int validate_mc_index(void *db, void *rec, size_t rows, gint index_id,
   gint *columns, size_t col_count, int printlevel);
+static int validate_btree(void *db, gint index_id, int rows,
+  int printlevel);
+static gint check_bnode(void *db, gint offset, int printlevel);
+static int validate_rtree(void *db, gint index_id, int rows,
+  int printlevel);
+static gint check_rnode(void *db, wg_index_header *hdr, gint offset,
+  wg_rtree_box *box, int printlevel);
+static gint btree_test_value(void *db);
+static int check_btree_query(void *db, gint column, gint cond, gint value,
+  int printlevel);
+static int check_multi_btree_query(void *db, int eqcol, gint first,
+  gint cond, gint value, int printlevel);
+static gint test_multi_btree(void *db, int magnitude, int eqcol,
+  int printlevel);
+static int check_stats_query(void *db, int lo, int hi, int column,
+  int printlevel);
+static int check_range_query(void *db, int column, int lo, int hi,
+  int printlevel);
+static int check_bitmap_query(void *db, wg_query_arg *arglist, int argc,
+  int column, int printlevel);
+static int check_fulltext_query(void *db, wg_query_arg *arglist, int argc,
+  int column, int expected, int printlevel);
+static int set_rtree_point(void *db, void *rec, int x, int y, int kind);
+static int count_rtree_points(void *db);
+static int check_nearest_query(void *db, gint xcol, gint ycol,
+  double qx, double qy, int k, int printlevel);
+static int has_prefix(void *db, gint enc, gint prefix);
+static int check_prefix_query(void *db, wg_query_arg *arglist, int argc,
+  int column, int printlevel);
+static int expr_test_value(void *db, gint enc, gint expr, char *buf);
+static int check_expr_query(void *db, gint column, gint cond, gint value,
+  char *expected, int printlevel);
+static int json_path_expected(int i, int q);
+static int json_doc_id(void *db, void *doc);
 #ifdef USE_CHILD_DB
 static int childdb_mkindex(void *db, int cnt);
 static int childdb_ckindex(void *db, int cnt, int printlevel);
@@ -174,6 +236,18 @@ int wg_run_tests(int tests, int printlevel) {
       wg_delete_local_database(db);
     }
 
+    if (OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(800000);
+      tmp=wg_check_dump_compact(db,printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if (OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(800000);
+      tmp=wg_check_dump_incremental(db,printlevel);
+      wg_delete_local_database(db);
+    }
+
     if (OK_TO_CONTINUE(tmp)) {
       printf("\n***** Quick tests passed ******\n");
     } else {
@@ -193,6 +267,78 @@ int wg_run_tests(int tests, int printlevel) {
       wg_delete_local_database(db);
     }
 
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index4(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index5(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index6(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index7(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index8(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index9(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index10(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index11(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index12(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index13(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index14(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(20000000);
+      tmp = wg_test_index15(db, 50, printlevel);
+      wg_delete_local_database(db);
+    }
+
     if (!OK_TO_CONTINUE(tmp)) {
       printf("\n***** Index test failed ******\n");
       return tmp;
@@ -219,6 +365,18 @@ int wg_run_tests(int tests, int printlevel) {
     tmp = wg_check_log(db, printlevel);
     wg_delete_local_database(db);
 
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(800000);
+      tmp = wg_check_log_shipping(db, printlevel);
+      wg_delete_local_database(db);
+    }
+
+    if(OK_TO_CONTINUE(tmp)) {
+      db = wg_attach_local_database(800000);
+      tmp = wg_check_dump_online(db, printlevel);
+      wg_delete_local_database(db);
+    }
+
     if (!OK_TO_CONTINUE(tmp)) {
       printf("\n***** Log test failed ******\n");
       return tmp;
@@ -1595,6 +1753,44 @@ static gint wg_check_compare(void* db, int printlevel) {
     }
   }
 
+  /* Normalized keys should order the same way. Records have no
+   * normalized form, but their prefixes still order by type. */
+  for(i=0; i<28; i++) {
+    for(j=i; j<28; j++) {
+      unsigned char keya[64], keyb[64];
+      gint lena, lenb, cr;
+      wg_uint prefa, prefb;
+
+      lena = wg_encode_normkey(db, testdata[i], keya, 64);
+      lenb = wg_encode_normkey(db, testdata[j], keyb, 64);
+      prefa = wg_normkey_prefix(db, testdata[i]);
+      prefb = wg_normkey_prefix(db, testdata[j]);
+      if(lena < 0 || lenb < 0) {
+        cr = (i==j ? WG_EQUAL : WG_LESSTHAN);
+        if(prefa > prefb || ((prefa & WG_NORMKEY_EXACT) && lena < 0))
+          cr = WG_GREATER;
+      } else {
+        cr = memcmp(keya, keyb, (lena < lenb ? lena : lenb));
+        if(!cr)
+          cr = lena - lenb;
+        cr = (cr < 0 ? WG_LESSTHAN : (cr > 0 ? WG_GREATER : WG_EQUAL));
+        if(prefa > prefb || (i==j && prefa != prefb) ||\
+          (i!=j && prefa == prefb && (prefa & WG_NORMKEY_EXACT)))
+          cr = WG_GREATER;
+      }
+      if(cr != (i==j ? WG_EQUAL : WG_LESSTHAN)) {
+        if(printlevel) {
+          printf("value1: ");
+          wg_debug_print_value(db, testdata[i]);
+          printf(" value2: ");
+          wg_debug_print_value(db, testdata[j]);
+          printf("\nnormalized keys are not in the order of the values\n");
+        }
+        return 1;
+      }
+    }
+  }
+
   if(printlevel>1)
     printf("********* check_compare: no errors ************\n");
   return 0;
@@ -2895,7 +3091,8 @@ static gint wg_test_index1(void *db, int magnitude, int printlevel) {
       return -1;
     }
   }
-  if(validate_index(db, start, dbsize, 0, printlevel)) {
+  if(validate_index(db, start, dbsize, 0, printlevel) ||\
+    validate_tnode_search(db, 0, printlevel)) {
     if(printlevel)
       fprintf(stderr, "index validation failed after insert.\n");
     return -2;
@@ -2936,6 +3133,13 @@ static gint wg_test_index1(void *db, int magnitude, int printlevel) {
         return -2;
       }
     }
+    if(validate_tnode_search(db, 0, printlevel)) {
+      if(printlevel) {
+        printf("loop: %d\n", j);
+        fprintf(stderr, "index validation failed after update.\n");
+      }
+      return -2;
+    }
   }
 
   if(printlevel > 1) {
@@ -2950,40 +3154,119 @@ static gint wg_test_index1(void *db, int magnitude, int printlevel) {
  *  indexes existing data in database and validates the resulting index
  */
 static gint wg_test_index2(void *db, int printlevel) {
-  int i, dbsize;
+  int i, dbsize, btree_rows, nspecs = 0;
   void *rec, *start;
+  gint columns[10], hashcols[2] = { 0, 1 }, hash_id, btree_id, btreecol = 2;
+  gint ilist, before, after;
+  wg_index_spec specs[12];
   if (printlevel>1)
     printf("********* testing T-tree index ********** \n");
 
+  /* Create the missing indexes with a shared scan */
   for(i=0; i<10; i++) {
     if(wg_column_to_index_id(db, i, WG_INDEX_TYPE_TTREE, NULL, 0) == -1) {
-      if(wg_create_index(db, i, WG_INDEX_TYPE_TTREE, NULL, 0)) {
-        if (printlevel)
-          printf("index creation failed, aborting.\n");
-        return -3;
-      }
-    }
+      columns[i] = i;
+      memset(&specs[nspecs], 0, sizeof(wg_index_spec));
+      specs[nspecs].columns = &columns[i];
+      specs[nspecs].col_count = 1;
+      specs[nspecs].type = WG_INDEX_TYPE_TTREE;
+      nspecs++;
+    }
+  }
+  memset(&specs[nspecs], 0, sizeof(wg_index_spec));
+  specs[nspecs].columns = hashcols;
+  specs[nspecs].col_count = 2;
+  specs[nspecs].type = WG_INDEX_TYPE_HASH;
+  specs[nspecs].size_hint = 64; /* the test database is small */
+  nspecs++;
+  memset(&specs[nspecs], 0, sizeof(wg_index_spec));
+  specs[nspecs].columns = &btreecol;
+  specs[nspecs].col_count = 1;
+  specs[nspecs].type = WG_INDEX_TYPE_BTREE;
+  nspecs++;
+  if(wg_create_indexes(db, specs, nspecs, 4)) {
+    if (printlevel)
+      printf("index creation failed, aborting.\n");
+    return -3;
+  }
+  hash_id = wg_multi_column_to_index_id(db, hashcols, 2,
+    WG_INDEX_TYPE_HASH, NULL, 0);
+  btree_id = wg_column_to_index_id(db, btreecol,
+    WG_INDEX_TYPE_BTREE, NULL, 0);
+  if(hash_id == -1 || btree_id == -1) {
+    if (printlevel)
+      printf("index not found after creation.\n");
+    return -3;
   }
 
   start = rec = wg_get_first_record(db);
   dbsize = 0;
+  btree_rows = 0;
 
   /* Get the number of records in database */
   while(rec) {
     dbsize++;
+    if(wg_get_record_len(db, rec) > btreecol)
+      btree_rows++;
     rec = wg_get_next_record(db, rec);
   }
 
+  if(validate_btree(db, btree_id, btree_rows, printlevel) ||\
+    wg_drop_index(db, btree_id)) {
+    if (printlevel)
+      printf("B-tree index validation failed.\n");
+    return -2;
+  }
   if(!dbsize)
-    return 0; /* no data, so nothing more to do */
+    return wg_drop_index(db, hash_id); /* no data, so nothing more to do */
 
   for(i=0; i<10; i++) {
-    if(validate_index(db, start, dbsize, i, printlevel)) {
+    if(validate_index(db, start, dbsize, i, printlevel) ||\
+      validate_tnode_search(db, i, printlevel)) {
       if (printlevel)
         printf("index validation failed.\n");
       return -2;
     }
   }
+  if(validate_mc_index(db, start, dbsize, hash_id, hashcols, 2, printlevel)) {
+    if (printlevel)
+      printf("hash index validation failed.\n");
+    return -2;
+  }
+  if(wg_drop_index(db, hash_id)) {
+    if (printlevel)
+      printf("hash index drop failed.\n");
+    return -2;
+  }
+
+  /* A hash index that cannot be allocated is not left behind.
+   * The B-tree before it is still created. */
+  before = 0;
+  for(ilist = dbmemsegh(db)->index_control_area_header.index_table[0];
+    ilist; ilist = ((gcell *) offsettoptr(db, ilist))->cdr)
+    before++;
+  specs[0] = specs[nspecs-1];
+  specs[1] = specs[nspecs-2];
+  specs[1].size_hint = dbmemsegh(db)->size / sizeof(gint);
+  if(wg_create_indexes(db, specs, 2, 0) != -1) {
+    if (printlevel)
+      printf("hash index creation did not fail.\n");
+    return -2;
+  }
+  after = 0;
+  for(ilist = dbmemsegh(db)->index_control_area_header.index_table[0];
+    ilist; ilist = ((gcell *) offsettoptr(db, ilist))->cdr)
+    after++;
+  btree_id = wg_column_to_index_id(db, btreecol,
+    WG_INDEX_TYPE_BTREE, NULL, 0);
+  if(after != before || wg_multi_column_to_index_id(db, hashcols, 2,
+      WG_INDEX_TYPE_HASH, NULL, 0) != -1 || btree_id == -1 ||\
+    validate_btree(db, btree_id, btree_rows, printlevel) ||\
+    wg_drop_index(db, btree_id)) {
+    if (printlevel)
+      printf("failed index creation left an invalid state.\n");
+    return -2;
+  }
 
   if (printlevel>1)
     printf("********* index test successful ********** \n");
@@ -2998,7 +3281,7 @@ static gint wg_test_index3(void *db, int magnitude, int printlevel) {
   int i, j, k;
   void *start = NULL, *rec = NULL;
   long int newv, rnddata;
-  gint index1, index2;
+  gint index1, index2, index3, freesize;
   gint columns[2];
 
 #ifdef _WIN32
@@ -3032,9 +3315,11 @@ static gint wg_test_index3(void *db, int magnitude, int printlevel) {
       if(rnddata & 1) {
         enc = wg_encode_int(db, newv);
       } else {
-        char buf[30];
-        snprintf(buf, 29, "%ld", newv);
-        buf[29] = '\0';
+        char buf[250];
+        int pad = (rnddata & 2 ? 200 : 0); /* exceeds the hash key buffer */
+        memset(buf, '0', pad);
+        snprintf(buf + pad, 29, "%ld", newv);
+        buf[pad + 29] = '\0';
         enc = wg_encode_str(db, buf, NULL);
       }
 
@@ -3116,9 +3401,11 @@ static gint wg_test_index3(void *db, int magnitude, int printlevel) {
         if(rnddata & 1) {
           enc = wg_encode_int(db, newv);
         } else {
-          char buf[30];
-          snprintf(buf, 29, "%ld", newv);
-          buf[29] = '\0';
+          char buf[250];
+          int pad = (rnddata & 2 ? 200 : 0);
+          memset(buf, '0', pad);
+          snprintf(buf + pad, 29, "%ld", newv);
+          buf[pad + 29] = '\0';
           enc = wg_encode_str(db, buf, NULL);
         }
 
@@ -3152,6 +3439,57 @@ static gint wg_test_index3(void *db, int magnitude, int printlevel) {
     }
   }
 
+  if(printlevel > 1) {
+    printf("------- hash index test: replacing indexes --------\n");
+  }
+
+  /* Build the replacement first, so that the data stays indexed */
+  columns[0] = 2;
+  if(wg_create_multi_index(db, columns, 1, WG_INDEX_TYPE_HASH, NULL, 0) ||
+    (index3 = wg_multi_column_to_index_id(db,
+      columns, 1, WG_INDEX_TYPE_HASH, NULL, 0)) == -1) {
+    if(printlevel) {
+      fprintf(stderr, "index3 create failed.\n");
+    }
+    return -1;
+  }
+  if(wg_drop_index(db, index1) || wg_drop_index(db, index2)) {
+    if(printlevel) {
+      fprintf(stderr, "hash index drop failed.\n");
+    }
+    return -1;
+  }
+  if(validate_mc_index(db, start, dbsize, index3, columns, 1, printlevel)) {
+    if(printlevel) {
+      fprintf(stderr, "index3 validation failed after drop.\n");
+    }
+    return -2;
+  }
+
+  /* The memory of a dropped index should be reused */
+  if(wg_drop_index(db, index3)) {
+    if(printlevel) {
+      fprintf(stderr, "index3 drop failed.\n");
+    }
+    return -1;
+  }
+  freesize = wg_database_freesize(db);
+  if(wg_create_multi_index(db, columns, 1, WG_INDEX_TYPE_HASH, NULL, 0) ||
+    (index3 = wg_multi_column_to_index_id(db,
+      columns, 1, WG_INDEX_TYPE_HASH, NULL, 0)) == -1 ||
+    wg_drop_index(db, index3)) {
+    if(printlevel) {
+      fprintf(stderr, "index3 re-create failed.\n");
+    }
+    return -1;
+  }
+  if(wg_database_freesize(db) != freesize) {
+    if(printlevel) {
+      fprintf(stderr, "hash index memory was not released.\n");
+    }
+    return -2;
+  }
+
   if(printlevel > 1) {
     printf("------- hash index test: no errors found --------\n");
   }
@@ -3160,1877 +3498,6185 @@ static gint wg_test_index3(void *db, int magnitude, int printlevel) {
 }
 
 
-/** Validate a T-tree index
- *  1. validates a set of rows starting from *rec.
- *  2. checks tree balance
- *  3. checks tree min/max values
- *  returns 0 if no errors found
- *  returns -1 if value was not indexed
- *  returns -2 if there was another error
+/** Random value for the B-tree test
+ *  Mixes integers that do and do not fit in the key prefix, doubles
+ *  and strings with a long common prefix, so that both the inline
+ *  prefixes and the full comparison are exercised.
  */
-static int validate_index(void *db, void *rec, int rows, int column,
-  int printlevel) {
-  gint index_id = wg_column_to_index_id(db, column,
-    WG_INDEX_TYPE_TTREE, NULL, 0);
-  gint tnode_offset;
-  wg_index_header *hdr;
-
-  if(index_id == -1)
-    return -2;
+static gint btree_test_value(void *db) {
+  long int rnddata, newv;
+  char buf[60];
 
-  /* Check if all values are indexed */
-  while(rec && rows) {
-    if(wg_get_record_len(db, rec) > column) {
-      gint val = wg_get_field(db, rec, column);
-      if(wg_search_ttree_index(db, index_id, val) < 1) {
-        if(printlevel) {
-          printf("missing: %d\n", (int) val);
-        }
-        return -1;
-      }
-    }
-    rec = wg_get_next_record(db, rec);
-    rows--;
+#ifdef _WIN32
+  rnddata = rand();
+#else
+  rnddata = random();
+#endif
+  newv = rnddata>>4;
+
+  switch(rnddata & 7) {
+    case 0:
+    case 1:
+      return wg_encode_int(db, newv % 1000);
+    case 2:
+      /* shifted out of the prefix range on 64-bit platforms */
+      return wg_encode_int(db, (rnddata & 8 ? -1 : 1) *\
+        (((gint) newv) << (sizeof(gint)*8 - 32)));
+    case 3:
+    case 4:
+      return wg_encode_double(db, (newv % 2000) / 7.0 - 100.0);
+    case 5:
+      snprintf(buf, 60, "%ld", newv % 500);
+      return wg_encode_str(db, buf, NULL);
+    default:
+      snprintf(buf, 60, "000000000000000000000%ld", newv % 500);
+      return wg_encode_str(db, buf, NULL);
   }
+}
 
-  hdr = (wg_index_header *) offsettoptr(db, index_id);
-
-  if(((struct wg_tnode *)(offsettoptr(db,
-    TTREE_ROOT_NODE(hdr))))->parent_offset != 0) {
+/** Check B-tree query results against a scan
+ *  returns 0 if no errors found
+ */
+static int check_btree_query(void *db, gint column, gint cond, gint value,
+  int printlevel) {
+  wg_query_arg arg;
+  wg_query *query;
+  void *rec;
+  gint prev = 0, expected = 0, cnt = 0;
+
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    gint cr = WG_COMPARE(db, wg_get_field(db, rec, column), value);
+    if((cond == WG_COND_EQUAL && cr == WG_EQUAL) ||\
+      (cond == WG_COND_LESSTHAN && cr == WG_LESSTHAN) ||\
+      (cond == WG_COND_GREATER && cr == WG_GREATER) ||\
+      (cond == WG_COND_LTEQUAL && cr != WG_GREATER) ||\
+      (cond == WG_COND_GTEQUAL && cr != WG_LESSTHAN))
+      expected++;
+  }
+
+  arg.column = column;
+  arg.cond = cond;
+  arg.value = value;
+  query = wg_make_query(db, NULL, 0, &arg, 1);
+  if(!query) {
     if(printlevel)
-      printf("root node parent offset is not 0\n");
-    return -2;
+      printf("wg_make_query() failed\n");
+    return -1;
   }
-#ifdef TTREE_CHAINED_NODES
-  if(TTREE_MIN_NODE(hdr) == 0) {
-    if(printlevel)
-      printf("min node offset is 0\n");
-    return -2;
+  while((rec = wg_fetch(db, query))) {
+    gint val = wg_get_field(db, rec, column);
+    /* rows come in index order */
+    if(cnt && WG_COMPARE(db, prev, val) == WG_GREATER) {
+      if(printlevel)
+        printf("query result is not ordered, condition %d\n", (int) cond);
+      wg_free_query(db, query);
+      return -1;
+    }
+    prev = val;
+    cnt++;
   }
-  if(TTREE_MAX_NODE(hdr) == 0) {
+  wg_free_query(db, query);
+
+  if(cnt != expected) {
     if(printlevel)
-      printf("max node offset is 0\n");
-    return -2;
+      printf("query with condition %d returned %d rows, expected %d\n",
+        (int) cond, (int) cnt, (int) expected);
+    return -1;
   }
-#endif
-
-#ifdef TTREE_CHAINED_NODES
-  tnode_offset = TTREE_MIN_NODE(hdr);
-#else
-  tnode_offset = wg_ttree_find_lub_node(db, TTREE_ROOT_NODE(hdr));
-#endif
-  while(tnode_offset) {
-    int diff;
-    gint minval, maxval;
-    struct wg_tnode *node = (struct wg_tnode *) offsettoptr(db, tnode_offset);
-
-    /* Check index tree balance */
-    diff = node->left_subtree_height - node->right_subtree_height;
-    if(diff < -1 || diff > 1)
-      return -2;
 
-    /* Check min/max values */
-    minval = wg_get_field(db,
-      offsettoptr(db, node->array_of_values[0]), column);
-    maxval = wg_get_field(db,
-      offsettoptr(db, node->array_of_values[node->number_of_elements - 1]),
-      column);
-    if(minval != node->current_min) {
-      if(printlevel) {
-        printf("current_min invalid: %d is: %d should be: %d\n",
-          (int) tnode_offset, (int) node->current_min,
-          (int) minval);
-      }
-      return -2;
-    }
-    if(maxval != node->current_max) {
-      if(printlevel) {
-        printf("current_max invalid: %d is: %d should be: %d\n",
-          (int) tnode_offset, (int) node->current_max,
-          (int) maxval);
-      }
-      return -2;
+  if(cond == WG_COND_EQUAL) {
+    cnt = 0;
+    rec = NULL;
+    while((rec = wg_find_record(db, column, cond, value, rec)))
+      cnt++;
+    if(cnt != expected) {
+      if(printlevel)
+        printf("wg_find_record() found %d rows, expected %d\n",
+          (int) cnt, (int) expected);
+      return -1;
     }
-
-    tnode_offset = TNODE_SUCCESSOR(db, node);
   }
-
   return 0;
 }
 
-/** Validate a multi-column index
- *  validates a set of rows starting from *rec.
- *  uses the index_id provided (to facilitate separate testing of
- *   multiple indexes on the same column set).
- *
- *  returns 0 if no errors found
- *  returns -1 if value was not indexed or was indexed and shouldn't have been
- *  returns -2 if there was another error
+/** Test the B-tree index
+ *  Builds the tree from existing data, updates and deletes rows,
+ *  checks the tree structure and compares range queries to a scan.
  */
-static int validate_mc_index(void *db, void *rec, size_t rows, gint index_id,
-  gint *columns, size_t col_count, int printlevel) {
-  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
-  gint max_col = -1;
-  size_t i;
+static gint wg_test_index4(void *db, int magnitude, int printlevel) {
+  const int dbsize = 40*magnitude, rand_updates = 5;
+  const gint conds[] = { WG_COND_EQUAL, WG_COND_LESSTHAN, WG_COND_GREATER,
+    WG_COND_LTEQUAL, WG_COND_GTEQUAL };
+  int i, k, rows;
+  void *rec;
+  gint index_id, freesize, column = 1;
 
-  for(i=0; i<col_count; i++) {
-    if(columns[i] > max_col) {
-      max_col = columns[i];
-    }
-  }
+#ifdef _WIN32
+  srand(20150320);
+#else
+  srandom(20150320); /* fixed seed for repeatable sequences */
+#endif
 
-  if(hdr->type != WG_INDEX_TYPE_HASH_JSON &&
-    hdr->type != WG_INDEX_TYPE_HASH) {
+  if(printlevel > 1) {
+    printf("------- B-tree index test: inserting data --------\n");
   }
 
-  /* Check if all values are indexed */
-  while(rec && rows) {
-    if(wg_get_record_len(db, rec) > max_col) {
-      gint values[MAX_INDEX_FIELDS];
-      gint reclist_offset;
-      int found = 0;
-      for(i=0; i<col_count; i++) {
-        values[i] = wg_get_field(db, rec, columns[i]);
-      }
-
-      reclist_offset = wg_search_hash(db, index_id, values, col_count);
-      /* Check that our original record was among the matched.
-       * also check that the other records have correct values.
-       */
-      if(reclist_offset > 0) {
-        gint *nextoffset = &reclist_offset;
-        while(*nextoffset) {
-          gcell *rec_cell = (gcell *) offsettoptr(db, *nextoffset);
-          void *match = offsettoptr(db, rec_cell->car);
-          if(match == rec) {
-            found = 1;
-          } else {
-            for(i=0; i<col_count; i++) {
-              if(wg_get_field(db, match, columns[i]) != values[i]) {
-                if(printlevel) {
-                  printf("invalid value in matched record: %p col %d\n",
-                    match, (int) columns[i]);
-                }
-                return -1;
-              }
-            }
-          }
+  for(i=0; i<dbsize; i++) {
+    rec = wg_create_record(db, 2);
+    if(!rec || wg_set_field(db, rec, column, btree_test_value(db))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
+  }
 
-          if(hdr->type == WG_INDEX_TYPE_HASH_JSON && \
-            !is_plain_record(match)) {
-            if(printlevel) {
-              printf("record %p shouldn't be indexed\n", rec);
-            }
-            return -1;
-          }
-          nextoffset = &(rec_cell->cdr);
-        }
+  /* The first build is bulk loaded, the second one is created
+   * empty and gets the data by inserts. */
+  for(k=0; k<2; k++) {
+    if(wg_create_index(db, column, WG_INDEX_TYPE_BTREE, NULL, 0) ||\
+      (index_id = wg_column_to_index_id(db, column,
+        WG_INDEX_TYPE_BTREE, NULL, 0)) == -1) {
+      if(printlevel)
+        fprintf(stderr, "index creation failed, aborting.\n");
+      return -3;
+    }
+    if(validate_btree(db, index_id, (k ? dbsize / 2 : dbsize), printlevel)) {
+      if(printlevel)
+        fprintf(stderr, "index validation failed after create.\n");
+      return -2;
+    }
+    if(!k) {
+      /* Drop and delete half of the rows */
+      if(wg_drop_index(db, index_id)) {
+        if(printlevel)
+          fprintf(stderr, "index drop failed.\n");
+        return -1;
       }
-
-      /* check if the record was supposed to have been indexed */
-      if(hdr->type == WG_INDEX_TYPE_HASH || is_plain_record(rec)) {
-        if(!found) {
-          if(printlevel) {
-            printf("missing: record %p\n", rec);
-          }
+      for(i=0; i<dbsize/2; i++)
+        wg_delete_record(db, wg_get_first_record(db));
+    } else {
+      for(i=0; i<dbsize/2; i++) {
+        rec = wg_create_record(db, 2);
+        if(!rec || wg_set_field(db, rec, column, btree_test_value(db))) {
+          if(printlevel)
+            fprintf(stderr, "insert error, aborting.\n");
           return -1;
         }
       }
     }
-    rec = wg_get_next_record(db, rec);
-    rows--;
+  }
+  if(validate_btree(db, index_id, dbsize, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "index validation failed after insert.\n");
+    return -2;
   }
 
-  return 0;
-}
-
-
-/* -------------------- child db testing ------------------------ */
+  if(printlevel > 1) {
+    printf("------- B-tree index test: updating data --------\n");
+  }
 
-#ifdef USE_CHILD_DB
-static int childdb_mkindex(void *db, int cnt) {
-  int i;
-  for(i=0; i<cnt; i++) {
-    if(wg_column_to_index_id(db, i, WG_INDEX_TYPE_TTREE, NULL, 0) == -1) {
-      if(wg_create_index(db, i, WG_INDEX_TYPE_TTREE, NULL, 0)) {
-        return 0;
+  for(k=0; k<rand_updates; k++) {
+    for(rec = wg_get_first_record(db); rec;
+      rec = wg_get_next_record(db, rec)) {
+      if(wg_set_field(db, rec, column, btree_test_value(db))) {
+        if(printlevel)
+          fprintf(stderr, "update error, aborting.\n");
+        return -1;
+      }
+    }
+    if(validate_btree(db, index_id, dbsize, printlevel)) {
+      if(printlevel) {
+        printf("loop: %d\n", k);
+        fprintf(stderr, "index validation failed after update.\n");
+      }
+      return -2;
+    }
+    for(i=0; i<magnitude; i++) {
+      if(check_btree_query(db, column, conds[i % 5],
+        btree_test_value(db), printlevel)) {
+        if(printlevel)
+          fprintf(stderr, "query check failed.\n");
+        return -2;
       }
     }
   }
-  return 1;
-}
-
-static int childdb_ckindex(void *db, int cnt, int printlevel) {
-  void *start, *rec;
-  int i, dbsize;
-
-  start = rec = (void *) wg_get_first_record(db);
-  dbsize = 0;
 
-  /* Get the number of records in database */
-  while(rec) {
-    dbsize++;
-    rec = wg_get_next_record(db, rec);
+  if(printlevel > 1) {
+    printf("------- B-tree index test: deleting data --------\n");
   }
 
-  for(i=0; i<cnt; i++) {
-    if(printlevel > 1)
-      printf("checking (%p %d).\n", dbmemseg(db), i);
-    if(validate_index(db, start, dbsize, i, printlevel)) {
+  /* Remove the rows, the tree should shrink to an empty leaf */
+  for(rows=dbsize; rows>0; rows--) {
+    if(wg_delete_record(db, wg_get_first_record(db))) {
       if(printlevel)
-        printf("index validation failed (%p %d).\n", dbmemseg(db), i);
-      return 0;
+        fprintf(stderr, "delete error, aborting.\n");
+      return -1;
+    }
+    if(!(rows % 50) && validate_btree(db, index_id, rows - 1, printlevel)) {
+      if(printlevel)
+        fprintf(stderr, "index validation failed after delete.\n");
+      return -2;
     }
   }
-  return 1;
+  if(validate_btree(db, index_id, 0, printlevel) ||\
+    check_btree_query(db, column, WG_COND_GTEQUAL, wg_encode_null(db, 0),
+      printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "empty index is invalid.\n");
+    return -2;
+  }
+
+  /* The memory of a dropped index should be reused */
+  if(wg_drop_index(db, index_id)) {
+    if(printlevel)
+      fprintf(stderr, "index drop failed.\n");
+    return -1;
+  }
+  freesize = wg_database_freesize(db);
+  if(wg_create_index(db, column, WG_INDEX_TYPE_BTREE, NULL, 0) ||\
+    (index_id = wg_column_to_index_id(db, column,
+      WG_INDEX_TYPE_BTREE, NULL, 0)) == -1 ||\
+    wg_drop_index(db, index_id)) {
+    if(printlevel)
+      fprintf(stderr, "index re-create failed.\n");
+    return -1;
+  }
+  if(wg_database_freesize(db) != freesize) {
+    if(printlevel)
+      fprintf(stderr, "B-tree index memory was not released.\n");
+    return -2;
+  }
+
+  if(printlevel > 1) {
+    printf("------- B-tree index test: no errors found --------\n");
+  }
+  return 0;
 }
 
-static int childdb_dropindex(void *db, int cnt) {
-  int i;
-  for(i=0; i<cnt; i++) {
-    gint index_id;
-    if((index_id = \
-      wg_column_to_index_id(db, i, WG_INDEX_TYPE_TTREE, NULL, 0)) != -1) {
-      if(wg_drop_index(db, index_id)) {
-        return 0;
-      }
+/** Check a query on a multi-column B-tree index against a scan
+ *  The query has an equality condition on column eqcol (0 or 1) and,
+ *  unless value is WG_ILLEGAL, the given condition on the other column.
+ *  returns 0 if no errors found
+ */
+static int check_multi_btree_query(void *db, int eqcol, gint first,
+  gint cond, gint value, int printlevel) {
+  wg_query_arg arg[2];
+  wg_query *query;
+  void *rec;
+  gint prev = 0, expected = 0, cnt = 0;
+  int argc = (value == WG_ILLEGAL ? 1 : 2);
+  int rangecol = 1 - eqcol;
+
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    gint cr;
+    if(wg_get_record_len(db, rec) < 2)
+      continue;
+    cr = (argc > 1 ?
+      WG_COMPARE(db, wg_get_field(db, rec, rangecol), value) : WG_EQUAL);
+    if(WG_COMPARE(db, wg_get_field(db, rec, eqcol), first) != WG_EQUAL)
+      continue;
+    if(argc == 1 ||\
+      (cond == WG_COND_EQUAL && cr == WG_EQUAL) ||\
+      (cond == WG_COND_LESSTHAN && cr == WG_LESSTHAN) ||\
+      (cond == WG_COND_GREATER && cr == WG_GREATER) ||\
+      (cond == WG_COND_LTEQUAL && cr != WG_GREATER) ||\
+      (cond == WG_COND_GTEQUAL && cr != WG_LESSTHAN))
+      expected++;
+  }
+
+  arg[0].column = eqcol;
+  arg[0].cond = WG_COND_EQUAL;
+  arg[0].value = first;
+  arg[1].column = rangecol;
+  arg[1].cond = cond;
+  arg[1].value = value;
+  query = wg_make_query(db, NULL, 0, arg, argc);
+  if(!query) {
+    if(printlevel)
+      printf("wg_make_query() failed\n");
+    return -1;
+  }
+  while((rec = wg_fetch(db, query))) {
+    gint val = wg_get_field(db, rec, rangecol);
+    /* rows come in the order of the second indexed column if the
+     * index is used */
+    if(cnt && WG_COMPARE(db, prev, val) == WG_GREATER) {
+      if(printlevel)
+        printf("query result is not ordered, condition %d\n", (int) cond);
+      wg_free_query(db, query);
+      return -1;
     }
+    prev = val;
+    cnt++;
   }
-  return 1;
+  wg_free_query(db, query);
+
+  if(cnt != expected) {
+    if(printlevel)
+      printf("query with condition %d returned %d rows, expected %d\n",
+        (int) cond, (int) cnt, (int) expected);
+    return -1;
+  }
+  return 0;
 }
-#endif
 
-static gint wg_check_childdb(void* db, int printlevel) {
-#ifdef USE_CHILD_DB
-  void *foo;
-  void *rec1, *rec2, *foorec1, *foorec2, *foorec3, *foorec4;
-  gint tmp, str1, str2;
+/** Test a multi-column B-tree index
+ *  The index is on columns 0 and 1, the key is ordered by the column
+ *  with few distinct values first. This is done with both column
+ *  numbers for that column, so the key order differs from the column
+ *  number order in the second run.
+ */
+static gint wg_test_index5(void *db, int magnitude, int printlevel) {
+  gint err;
+  void *rec;
 
-  if(printlevel>1) {
-    printf("********* testing child database ********** \n");
+  err = test_multi_btree(db, magnitude, 0, printlevel);
+  if(err)
+    return err;
+  while((rec = wg_get_first_record(db))) {
+    if(wg_delete_record(db, rec)) {
+      if(printlevel)
+        fprintf(stderr, "delete error, aborting.\n");
+      return -1;
+    }
   }
+  return test_multi_btree(db, magnitude, 1, printlevel);
+}
 
-  foo = wg_attach_local_database(500000);
+/** Run the multi-column B-tree test
+ *  Column eqcol has few distinct values and is the first column of
+ *  the index key. Checks the tree structure after building, updates
+ *  and deletes, and compares the queries that use the index to a scan.
+ */
+static gint test_multi_btree(void *db, int magnitude, int eqcol,
+  int printlevel) {
+  const int dbsize = 40*magnitude, groups = 8;
+  const gint conds[] = { WG_COND_EQUAL, WG_COND_LESSTHAN, WG_COND_GREATER,
+    WG_COND_LTEQUAL, WG_COND_GTEQUAL };
+  int rangecol = 1 - eqcol;
+  gint columns[2];
+  int i;
+  void *rec;
+  gint index_id;
 
-  if(foo) {
-    if(printlevel>1) {
-#ifndef _WIN32
-      printf("Parent: %p free %td.\nChild: %p free %td extdbs %td size %td\n",
+#ifdef _WIN32
+  srand(20150321);
 #else
-      printf("Parent: %p free %Id.\nChild: %p free %Id extdbs %Id size %Id\n",
+  srandom(20150321);
 #endif
-        dbmemseg(db),
-        dbmemsegh(db)->free,
-        dbmemseg(foo),
-        dbmemsegh(foo)->free,
-        dbmemsegh(foo)->extdbs.count,
-        dbmemsegh(foo)->size);
-    }
-  } else {
-    printf("Failed to attach to local database.\n");
-    return 1;
+
+  /* the key is ordered by the columns in this order */
+  columns[0] = eqcol;
+  columns[1] = rangecol;
+
+  if(printlevel > 1) {
+    printf("------- Multi-column B-tree index test on columns (%d, %d): "\
+      "inserting data --------\n", eqcol, rangecol);
   }
 
-  if(dbmemsegh(db)->key != 0) {
-    /* Test invalid registering */
-    if(!wg_register_external_db(db, foo)) {
+  for(i=0; i<dbsize; i++) {
+    rec = wg_create_record(db, 2);
+    if(!rec || wg_set_field(db, rec, eqcol, wg_encode_int(db, i % groups)) ||\
+      wg_set_field(db, rec, rangecol, btree_test_value(db))) {
       if(printlevel)
-        printf("Registering the local db in a shared db succeeded, should have failed\n");
-      wg_delete_local_database(foo);
-      return 1;
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
     }
   }
+  /* too short for the index */
+  if(!wg_create_record(db, 1)) {
+    if(printlevel)
+      fprintf(stderr, "insert error, aborting.\n");
+    return -1;
+  }
 
-  /* Records in parent db */
-  rec1 = (void *) wg_create_raw_record(db, 3);
-  rec2 = (void *) wg_create_raw_record(db, 3);
+  if(wg_create_multi_index(db, columns, 2, WG_INDEX_TYPE_BTREE, NULL, 0) ||\
+    (index_id = wg_multi_column_to_index_id(db, columns, 2,
+      WG_INDEX_TYPE_BTREE, NULL, 0)) == -1) {
+    if(printlevel)
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
+  }
+  if(validate_btree(db, index_id, dbsize, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "index validation failed after create.\n");
+    return -2;
+  }
 
-  str1 = wg_encode_str(db, "hello", NULL);
-  wg_set_new_field(db, rec1, 0, str1);
-  wg_set_new_field(db, rec1, 1, wg_encode_str(db, "world", NULL));
-  wg_set_new_field(db, rec1, 2, wg_encode_double(db, 1.234));
-  wg_set_new_field(db, rec2, 0, wg_encode_record(db, rec1));
-  str2 = wg_encode_str(db, "bar", NULL);
-  wg_set_new_field(db, rec2, 1, str2);
-
-  /* Records in child db */
-  foorec1 = (void *) wg_create_raw_record(foo, 3);
-  foorec2 = (void *) wg_create_raw_record(foo, 3);
-
-  tmp = wg_encode_external_data(foo, db, str1);
+  if(printlevel > 1) {
+    printf("------- Multi-column B-tree index test: updating data --------\n");
+  }
 
-  /* Try storing external data */
-  if(printlevel>1) {
-    printf("Expecting an error: \"wg data handling error: "\
-      "External reference not recognized\".\n");
+  /* Change both columns, some rows move to another group */
+  i = 0;
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(wg_get_record_len(db, rec) < 2)
+      continue;
+    if(wg_set_field(db, rec, rangecol, btree_test_value(db)) ||\
+      (!(i++ % 4) && wg_set_field(db, rec, eqcol,
+        wg_encode_int(db, (i * 3) % groups)))) {
+      if(printlevel)
+        fprintf(stderr, "update error, aborting.\n");
+      return -1;
+    }
   }
-  if(!wg_set_new_field(foo, foorec1, 0, tmp)) {
+  if(validate_btree(db, index_id, dbsize, printlevel)) {
     if(printlevel)
-      printf("Storing external data succeeded, should have failed\n");
-    wg_delete_local_database(foo);
-    return 1;
+      fprintf(stderr, "index validation failed after update.\n");
+    return -2;
   }
 
-  /* Test indexes */
-  if(printlevel>1) {
-    printf("Testing child database index.\n");
-  }
-  if(!childdb_mkindex(foo, 3)) {
-    if(printlevel)
-      printf("Child database index creation failed\n");
-    wg_delete_local_database(foo);
-    return 1;
+  for(i=0; i<magnitude; i++) {
+    gint first = wg_encode_int(db, i % groups);
+    if(check_multi_btree_query(db, eqcol, first, conds[i % 5],
+        btree_test_value(db), printlevel) ||\
+      (!(i % 5) && check_multi_btree_query(db, eqcol, first, 0,
+        WG_ILLEGAL, printlevel))) {
+      if(printlevel)
+        fprintf(stderr, "query check failed.\n");
+      return -2;
+    }
   }
-  if(!childdb_ckindex(foo, 3, printlevel)) {
-    if(printlevel)
-      printf("Child database index test failed\n");
-    wg_delete_local_database(foo);
-    return 1;
+
+  if(printlevel > 1) {
+    printf("------- Multi-column B-tree index test: deleting data --------\n");
   }
 
-  /* Test registering (should fail, as we have indexes) */
-  if(printlevel>1) {
-    printf("Expecting an error: \"db memory allocation error: "\
-      "Database has indexes, external references not allowed\".\n");
+  for(i=0; i<dbsize/2; i++) {
+    if(wg_delete_record(db, wg_get_first_record(db))) {
+      if(printlevel)
+        fprintf(stderr, "delete error, aborting.\n");
+      return -1;
+    }
   }
-  if(!wg_register_external_db(foo, db)) {
+  if(validate_btree(db, index_id, dbsize - dbsize/2, printlevel) ||\
+    check_multi_btree_query(db, eqcol, wg_encode_int(db, 1),
+      WG_COND_GREATER, wg_encode_int(db, 0), printlevel)) {
     if(printlevel)
-      printf("Registering the external db succeeded, but we have indexes\n");
-    wg_delete_local_database(foo);
-    return 1;
+      fprintf(stderr, "index validation failed after delete.\n");
+    return -2;
   }
 
-  if(!childdb_dropindex(foo, 3)) {
+  if(wg_drop_index(db, index_id)) {
     if(printlevel)
-      printf("Dropping indexes failed\n");
-    wg_delete_local_database(foo);
-    return 1;
+      fprintf(stderr, "index drop failed.\n");
+    return -1;
   }
+  if(printlevel > 1) {
+    printf("------- Multi-column B-tree index test: no errors found --------\n");
+  }
+  return 0;
+}
 
-  /* Test registering again */
-  if(wg_register_external_db(foo, db)) {
+/** Run a query on the rows of the statistics test
+ *  The query is col0 = 1 AND col1 >= lo AND col1 <= hi. Checks
+ *  the number of rows and the column of the index that was used.
+ *  returns 0 if no errors found
+ *  returns -1 otherwise
+ */
+static int check_stats_query(void *db, int lo, int hi, int column,
+  int printlevel) {
+  wg_query_arg arg[3];
+  wg_query *query;
+  gint cnt = 0, expected = 0;
+  void *rec;
+
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    int val = wg_decode_int(db, wg_get_field(db, rec, 1));
+    if(wg_decode_int(db, wg_get_field(db, rec, 0)) == 1 &&\
+      val >= lo && val <= hi)
+      expected++;
+  }
+
+  arg[0].column = 0;
+  arg[0].cond = WG_COND_EQUAL;
+  arg[0].value = wg_encode_query_param_int(db, 1);
+  arg[1].column = 1;
+  arg[1].cond = WG_COND_GTEQUAL;
+  arg[1].value = wg_encode_query_param_int(db, lo);
+  arg[2].column = 1;
+  arg[2].cond = WG_COND_LTEQUAL;
+  arg[2].value = wg_encode_query_param_int(db, hi);
+  query = wg_make_query(db, NULL, 0, arg, 3);
+  if(!query) {
     if(printlevel)
-      printf("Registering the shared db in local db failed, should have succeeded\n");
-    wg_delete_local_database(foo);
-    return 1;
-  }
-  if(printlevel>1) {
-    printf("Expecting an error: \"index error: "\
-      "Database has external data, indexes disabled\".\n");
+      printf("wg_make_query() failed\n");
+    return -1;
   }
-  if(childdb_mkindex(foo, 1)) {
+  while(wg_fetch(db, query))
+    cnt++;
+  if(query->column != column) {
     if(printlevel)
-      printf("Child database index creation succeeded (should have failed)\n");
-    wg_delete_local_database(foo);
-    return 1;
+      printf("query on col1 in [%d, %d] used column %d, expected %d\n",
+        lo, hi, (int) query->column, column);
+    wg_free_query(db, query);
+    return -1;
   }
+  wg_free_query(db, query);
 
-  /* Storing external data should now work */
-  if(wg_set_new_field(foo, foorec1, 0, tmp)) {
+  if(cnt != expected) {
     if(printlevel)
-      printf("Storing external data failed, should have succeeded\n");
-    wg_delete_local_database(foo);
-    return 1;
+      printf("query on col1 in [%d, %d] returned %d rows, expected %d\n",
+        lo, hi, (int) cnt, (int) expected);
+    return -1;
   }
+  return 0;
+}
 
-  wg_set_new_field(foo, foorec1, 1, wg_encode_str(foo, "local data", NULL));
-
-  tmp = wg_encode_external_data(foo, db, wg_encode_record(db, rec1));
-  wg_set_new_field(foo, foorec2, 0, tmp);
-  wg_set_new_field(foo, foorec2, 1, wg_encode_str(foo, "more local data", NULL));
-  tmp = wg_encode_external_data(foo, db, str2);
-  wg_set_new_field(foo, foorec2, 2, tmp);
+/** Test index statistics
+ *  Column 0 has two values, column 1 is unique. Without statistics,
+ *  the equality condition on column 0 wins over a narrow range on
+ *  column 1. Checks that the statistics change that, follow the
+ *  updates and do not prefer column 1 when the range is wide.
+ */
+static gint wg_test_index6(void *db, int magnitude, int printlevel) {
+  const int dbsize = 40*magnitude;
+  int i;
+  void *rec;
+  gint tindex_id, bindex_id, rows, distinct;
 
-  if(printlevel>1) {
-    printf("Testing data comparing.\n");
+  if(printlevel > 1) {
+    printf("------- Index statistics test: inserting data --------\n");
   }
 
-  /* Test comparing */
-  foorec3 = (void *) wg_create_raw_record(foo, 3);
-  foorec4 = (void *) wg_create_raw_record(foo, 3);
-
-  wg_set_new_field(foo, foorec3, 0, wg_encode_str(foo, "hello", NULL));
-  wg_set_new_field(foo, foorec3, 1, wg_encode_str(foo, "world", NULL));
-  wg_set_new_field(foo, foorec3, 2, wg_encode_double(foo, 1.234));
-
-  wg_set_new_field(foo, foorec4, 0, wg_encode_record(foo, foorec3));
-  wg_set_new_field(foo, foorec4, 1, wg_encode_str(foo, "more local data", NULL));
-  tmp = wg_encode_external_data(foo, db, str2);
-  wg_set_new_field(foo, foorec4, 2, tmp);
-
-#if WG_COMPARE_REC_DEPTH > 2
-  /* foorec2 and foorec4 should be equal */
-  if(WG_COMPARE(foo,
-    wg_encode_record(foo, foorec2),
-    wg_encode_record(foo, foorec4)) != WG_EQUAL) {
-    if(printlevel)
-      printf("foorec2 and foorec4 were not equal, but should be.\n");
-    wg_delete_local_database(foo);
-    return 1;
+  for(i=0; i<dbsize; i++) {
+    rec = wg_create_record(db, 2);
+    if(!rec || wg_set_field(db, rec, 0, wg_encode_int(db, i % 2)) ||\
+      wg_set_field(db, rec, 1, wg_encode_int(db, i))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
   }
 
-  /* rec1 and foorec3 should be equal */
-  if(WG_COMPARE(foo,
-    wg_encode_external_data(foo, db, wg_encode_record(db, rec1)),
-    wg_encode_record(foo, foorec3)) != WG_EQUAL) {
+  if(wg_create_index(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0) ||\
+    wg_create_index(db, 1, WG_INDEX_TYPE_BTREE, NULL, 0) ||\
+    wg_create_index(db, 1, WG_INDEX_TYPE_HASH, NULL, 0)) {
     if(printlevel)
-      printf("rec1 and foorec3 were not equal, but should be.\n");
-    wg_delete_local_database(foo);
-    return 1;
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
   }
-#endif
+  tindex_id = wg_column_to_index_id(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0);
+  bindex_id = wg_column_to_index_id(db, 1, WG_INDEX_TYPE_BTREE, NULL, 0);
 
-  /* sanity check: foorec3 and foorec4 should not be equal */
-  if(WG_COMPARE(foo,
-    wg_encode_record(foo, foorec3),
-    wg_encode_record(foo, foorec4)) == WG_EQUAL) {
+  if(wg_get_index_stats(db, tindex_id, &rows, &distinct) != -1 ||\
+    check_stats_query(db, 100, 110, 0, printlevel)) {
     if(printlevel)
-      printf("foorec3 and foorec4 were equal, but should not be.\n");
-    wg_delete_local_database(foo);
-    return 1;
+      fprintf(stderr, "query check failed before analyze.\n");
+    return -2;
   }
 
-#ifdef USE_BACKLINKING
-  /* Test deleting */
-  if(wg_delete_record(db, rec1) != -1) {
-    if(printlevel)
-      printf("Deleting referenced parent rec1 succeeded (should have failed)\n");
-    wg_delete_local_database(foo);
-    return 1;
-  }
-#else
-  if(wg_delete_record(db, rec1) != 0) {
+  if(wg_analyze_index(db,
+      wg_column_to_index_id(db, 1, WG_INDEX_TYPE_HASH, NULL, 0)) != -1 ||\
+    wg_analyze(db)) {
     if(printlevel)
-      printf("Deleting parent rec1 failed (should have succeeded)\n");
-    wg_delete_local_database(foo);
-    return 1;
+      fprintf(stderr, "analyze failed.\n");
+    return -2;
   }
-#endif
-  if(wg_delete_record(db, rec2) != 0) {
+  if(wg_get_index_stats(db, tindex_id, &rows, &distinct) ||\
+    rows != dbsize || distinct != 2 ||\
+    wg_get_index_stats(db, bindex_id, &rows, &distinct) ||\
+    rows != dbsize || distinct < dbsize*9/10 || distinct > dbsize) {
     if(printlevel)
-      printf("Deleting non-referenced parent rec2 failed (should have succeeded)\n");
-    wg_delete_local_database(foo);
-    return 1;
+      fprintf(stderr, "wrong statistics after analyze.\n");
+    return -2;
   }
-  if(wg_delete_record(foo, foorec2) != 0) {
+  if(check_stats_query(db, 100, 110, 1, printlevel) ||\
+    check_stats_query(db, 0, dbsize, 0, printlevel)) {
     if(printlevel)
-      printf("Deleting child foorec2 failed (should have succeeded)\n");
-    wg_delete_local_database(foo);
-    return 1;
+      fprintf(stderr, "query check failed after analyze.\n");
+    return -2;
   }
 
-  /* right now string refcounts are a bit fishy... skip this */
-  /* wg_set_field(foo, foorec4, 2, tmp); */
-
-  /* this should fail, but we don't want to interact with the
-   * filesystem in these automated tests
-  wg_dump(foo, "invalid.bin");*/
+  if(printlevel > 1) {
+    printf("------- Index statistics test: updating data --------\n");
+  }
 
-  wg_delete_local_database(foo);
+  for(i=0; i<dbsize/2; i++) {
+    if(wg_delete_record(db, wg_get_first_record(db))) {
+      if(printlevel)
+        fprintf(stderr, "delete error, aborting.\n");
+      return -1;
+    }
+  }
+  for(i=0; i<magnitude; i++) {
+    rec = wg_create_record(db, 2);
+    if(!rec || wg_set_field(db, rec, 0, wg_encode_int(db, 2)) ||\
+      wg_set_field(db, rec, 1, wg_encode_int(db, dbsize + i))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
+  }
+  /* the distinct estimate grows with the new value, it does not
+   * forget the values of the deleted rows */
+  if(wg_get_index_stats(db, tindex_id, &rows, &distinct) ||\
+    rows != dbsize - dbsize/2 + magnitude || distinct < 3 ||\
+    check_stats_query(db, dbsize - 10, dbsize + 10, 1, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "statistics check failed after update.\n");
+    return -2;
+  }
 
-  if(printlevel>1)
-    printf("********* child database test successful ********** \n");
-#else
-  printf("child databases disabled, skipping checks\n");
-#endif
+  if(wg_drop_index(db, tindex_id) || wg_drop_index(db, bindex_id)) {
+    if(printlevel)
+      fprintf(stderr, "index drop failed.\n");
+    return -1;
+  }
+  if(printlevel > 1) {
+    printf("------- Index statistics test: no errors found --------\n");
+  }
   return 0;
 }
 
-/* ---------------- schema/JSON related tests ----------------- */
-
-/*
- * Run this on a dedicated database to check the effects
- * of param bits and deleting.
+/** Run a range query on one column
+ *  Checks the number of rows and that the query used an index
+ *  on the column.
+ *  returns 0 if no errors found
+ *  returns -1 otherwise
  */
-static gint wg_check_schema(void* db, int printlevel) {
-  void *rec, *arec, *orec, *trec;
-  gint *gptr;
-  gint tmp1, tmp2, tmp3;
+static int check_range_query(void *db, int column, int lo, int hi,
+  int printlevel) {
+  wg_query_arg arg[2];
+  wg_query *query;
+  gint cnt = 0, expected = 0;
+  void *rec;
 
-  if(printlevel>1) {
-    printf("********* testing schema functions ********** \n");
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    int val = wg_decode_int(db, wg_get_field(db, rec, column));
+    if(val >= lo && val <= hi)
+      expected++;
   }
 
-  tmp1 = wg_encode_int(db, 99);
-  tmp2 = wg_encode_int(db, 98);
-  tmp3 = wg_encode_int(db, 97);
-
-  /* Triple */
-  rec = wg_create_triple(db, tmp1, tmp2, tmp3, 0);
-
-  /* Check the record (fields and meta bits).
-   * it is not a param.
-   */
-  gptr = ((gint *) rec + RECORD_META_POS);
-  if(*gptr) {
-    if(printlevel) {
-      printf("plain triple is expected to have no meta bits\n");
-    }
-    return 1;
-  }
-  gptr = ((gint *) rec + RECORD_HEADER_GINTS + WG_SCHEMA_TRIPLE_OFFSET);
-  if(*gptr != tmp1) {
+  arg[0].column = column;
+  arg[0].cond = WG_COND_GTEQUAL;
+  arg[0].value = wg_encode_query_param_int(db, lo);
+  arg[1].column = column;
+  arg[1].cond = WG_COND_LTEQUAL;
+  arg[1].value = wg_encode_query_param_int(db, hi);
+  query = wg_make_query(db, NULL, 0, arg, 2);
+  if(!query) {
     if(printlevel)
-      printf("triple field 1 does not match\n");
-    return 1;
+      printf("wg_make_query() failed\n");
+    return -1;
   }
-  if(*(gptr+1) != tmp2) {
+  while(wg_fetch(db, query))
+    cnt++;
+  if(query->column != column) {
     if(printlevel)
-      printf("triple field 2 does not match\n");
-    return 1;
+      printf("query on col%d used column %d\n", column, (int) query->column);
+    wg_free_query(db, query);
+    return -1;
   }
-  if(*(gptr+2) != tmp3) {
+  wg_free_query(db, query);
+
+  if(cnt != expected) {
     if(printlevel)
-      printf("triple field 3 does not match\n");
-    return 1;
+      printf("query on col%d in [%d, %d] returned %d rows, expected %d\n",
+        column, lo, hi, (int) cnt, (int) expected);
+    return -1;
   }
+  return 0;
+}
 
-  /* the next triple is a param.
-   */
-  rec = wg_create_triple(db, tmp1, tmp2, tmp3, 1);
-  gptr = ((gint *) rec + RECORD_META_POS);
-  if(*gptr != (RECORD_META_NOTDATA|RECORD_META_MATCH)) {
-    if(printlevel) {
-#ifndef _WIN32
-      printf("param triple had invalid meta bits (%td)\n", *gptr);
-#else
-      printf("param triple had invalid meta bits (%Id)\n", *gptr);
+/** Test indexes on columns above MAX_INDEXED_FIELDNR
+ *  The indexes of these columns are kept in the column map. Checks
+ *  that queries use them, that they follow the updates and that
+ *  the map is emptied when the indexes are dropped.
+ */
+static gint wg_test_index7(void *db, int magnitude, int printlevel) {
+  const int dbsize = 10*magnitude, reclen = 300;
+  int i;
+  gint cols[2];
+  void *rec;
+  gint tindex_id, bindex_id, hindex_id;
+  db_index_area_header *ihdr = &dbmemsegh(db)->index_control_area_header;
+#ifdef USE_INDEX_TEMPLATE
+  gint matchrec[300];
+  gint mindex_id;
 #endif
-    }
-    return 1;
-  }
-
-  /* kv-pair */
-  rec = wg_create_kvpair(db, tmp2, tmp3, 1);
 
-  /* Check the record (fields and meta bits).
-   * it is a param.
-   */
-  gptr = ((gint *) rec + RECORD_META_POS);
-  if(*gptr != (RECORD_META_NOTDATA|RECORD_META_MATCH)) {
-    if(printlevel) {
-#ifndef _WIN32
-      printf("param kv-pair had invalid meta bits (%td)\n", *gptr);
-#else
-      printf("param kv-pair had invalid meta bits (%Id)\n", *gptr);
-#endif
-    }
-    return 1;
+  if(printlevel > 1) {
+    printf("------- High column index test: inserting data --------\n");
   }
-  gptr = ((gint *) rec + RECORD_HEADER_GINTS + WG_SCHEMA_TRIPLE_OFFSET);
-  if(*gptr != 0) {
+
+  /* column 200 is indexed while inserting, the rest are built
+   * from the data */
+  if(wg_create_index(db, 200, WG_INDEX_TYPE_TTREE, NULL, 0)) {
     if(printlevel)
-      printf("kv-pair prefix is not NULL\n");
-    return 1;
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
   }
-  if(*(gptr+1) != tmp2) {
-    if(printlevel)
-      printf("kv-pair key does not match\n");
-    return 1;
+  for(i=0; i<dbsize; i++) {
+    rec = wg_create_record(db, reclen);
+    if(!rec || wg_set_field(db, rec, 150, wg_encode_int(db, i % 7)) ||\
+      wg_set_field(db, rec, 200, wg_encode_int(db, i)) ||\
+      wg_set_field(db, rec, 250, wg_encode_int(db, i)) ||\
+      wg_set_field(db, rec, 260, wg_encode_int(db, i % 2)) ||\
+      wg_set_field(db, rec, 299, wg_encode_int(db, i % 10))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
   }
-  if(*(gptr+2) != tmp3) {
+
+  cols[0] = 250;
+  cols[1] = 150;
+  if(wg_create_index(db, 299, WG_INDEX_TYPE_BTREE, NULL, 0) ||\
+    wg_create_multi_index(db, cols, 2, WG_INDEX_TYPE_HASH, NULL, 0)) {
     if(printlevel)
-      printf("kv-pair value does not match\n");
-    return 1;
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
   }
-
-  /* this is not a param.
-   */
-  rec = wg_create_triple(db, tmp1, tmp2, tmp3, 0);
-  gptr = ((gint *) rec + RECORD_META_POS);
-  if(*gptr) {
-    if(printlevel) {
-      printf("plain kv-pair is expected to have no meta bits\n");
-    }
-    return 1;
+  tindex_id = wg_column_to_index_id(db, 200, WG_INDEX_TYPE_TTREE, NULL, 0);
+  bindex_id = wg_column_to_index_id(db, 299, WG_INDEX_TYPE_BTREE, NULL, 0);
+  hindex_id = wg_multi_column_to_index_id(db, cols, 2,
+    WG_INDEX_TYPE_HASH, NULL, 0);
+  if(tindex_id == -1 || bindex_id == -1 || hindex_id == -1 ||\
+    ihdr->column_map_count != 4) {
+    if(printlevel)
+      fprintf(stderr, "indexes not found in the column map.\n");
+    return -2;
   }
 
-  /* params should be invisible */
-  if(check_db_rows(db, 2, printlevel)) {
+#ifdef USE_INDEX_TEMPLATE
+  /* template on a high column */
+  for(i=0; i<reclen; i++)
+    matchrec[i] = wg_encode_var(db, 0);
+  matchrec[260] = wg_encode_int(db, 1);
+  if(wg_create_index(db, 200, WG_INDEX_TYPE_TTREE, matchrec, reclen)) {
     if(printlevel)
-      printf("row count check failed (should have 2 non-param rows).\n");
-    return 1;
+      fprintf(stderr, "template index creation failed, aborting.\n");
+    return -3;
   }
-
-  /* Object */
-  orec = wg_create_object(db, 1, 0, 0);
-  if(wg_get_record_len(db, orec) != 1) {
-    if(printlevel) {
-      printf("object had invalid length\n");
-    }
-    return 1;
+  mindex_id = wg_column_to_index_id(db, 200, WG_INDEX_TYPE_TTREE,
+    matchrec, reclen);
+  if(mindex_id == -1 || mindex_id == tindex_id ||\
+    ihdr->column_map_count != 5) {
+    if(printlevel)
+      fprintf(stderr, "template index not found in the column map.\n");
+    return -2;
   }
-
-  gptr = ((gint *) orec + RECORD_META_POS);
-  if(*gptr != RECORD_META_OBJECT) {
-    if(printlevel) {
-#ifndef _WIN32
-      printf("object (nonparam) had invalid meta bits (%td)\n", *gptr);
-#else
-      printf("object (nonparam) had invalid meta bits (%Id)\n", *gptr);
 #endif
-    }
-    return 1;
-  }
-
-  wg_set_field(db, orec, 0, wg_encode_record(db, rec));
 
-  /* Array. It has the document bit set.
-   */
-  arec = wg_create_array(db, 4, 1, 0);
-  if(wg_get_record_len(db, arec) != 4) {
-    if(printlevel) {
-      printf("array had invalid length\n");
-    }
-    return 1;
+  if(validate_index(db, wg_get_first_record(db), dbsize, 200, printlevel) ||\
+    validate_tnode_search(db, 200, printlevel) ||\
+    check_range_query(db, 200, 10, 20, printlevel) ||\
+    check_range_query(db, 299, 3, 3, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "index check failed after insert.\n");
+    return -2;
   }
 
-  gptr = ((gint *) arec + RECORD_META_POS);
-  if(*gptr != (RECORD_META_ARRAY|RECORD_META_DOC)) {
-    if(printlevel) {
-#ifndef _WIN32
-      printf("array (doc, nonparam) had invalid meta bits (%td)\n", *gptr);
-#else
-      printf("array (doc, nonparam) had invalid meta bits (%Id)\n", *gptr);
-#endif
-    }
-    return 1;
+  if(printlevel > 1) {
+    printf("------- High column index test: updating data --------\n");
   }
 
-  /* Form the document.
-   */
-  wg_set_field(db, arec, 0, tmp3);
-  wg_set_field(db, arec, 1, tmp2);
-  wg_set_field(db, arec, 2, tmp1);
-  wg_set_field(db, arec, 3, wg_encode_record(db, orec));
-
-#ifdef USE_BACKLINKING
-  /* Locate the document through an element.
-   */
-  trec = wg_find_document(db, rec);
-  if(trec != arec) {
-    if(printlevel) {
-      printf("wg_find_document() failed\n");
+  i = 0;
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(wg_set_field(db, rec, 200, wg_encode_int(db, dbsize + i)) ||\
+      wg_set_field(db, rec, 260, wg_encode_int(db, i++ % 3))) {
+      if(printlevel)
+        fprintf(stderr, "update error, aborting.\n");
+      return -1;
     }
-    return 1;
   }
-#endif
-
-  if(wg_delete_document(db, arec)) {
-    if(printlevel) {
-      printf("wg_delete_document() failed\n");
+  for(i=0; i<dbsize/2; i++) {
+    if(wg_delete_record(db, wg_get_first_record(db))) {
+      if(printlevel)
+        fprintf(stderr, "delete error, aborting.\n");
+      return -1;
     }
-    return 1;
   }
 
-  /* of the two rows in db earlier, one was included in the
-   * deleted document. One should be remaining.
-   */
-  if(check_db_rows(db, 1, printlevel)) {
+  if(validate_index(db, wg_get_first_record(db), dbsize, 200, printlevel) ||\
+    validate_tnode_search(db, 200, printlevel) ||\
+    check_range_query(db, 200, 10, 20, printlevel) ||\
+    check_range_query(db, 200, dbsize + 10, 2*dbsize - 10, printlevel) ||\
+    check_range_query(db, 299, 3, 5, printlevel)) {
     if(printlevel)
-      printf("Invalid number of remaining rows after deleting.\n");
-    return 1;
-  }
-
-  /* Check the param bits of object and array.
-   */
-  orec = wg_create_object(db, 5, 0, 1);
-  gptr = ((gint *) orec + RECORD_META_POS);
-  if(*gptr != (RECORD_META_OBJECT|RECORD_META_NOTDATA|RECORD_META_MATCH)) {
-    if(printlevel) {
-#ifndef _WIN32
-      printf("object (param) had invalid meta bits (%td)\n", *gptr);
-#else
-      printf("object (param) had invalid meta bits (%Id)\n", *gptr);
-#endif
-    }
-    return 1;
+      fprintf(stderr, "index check failed after update.\n");
+    return -2;
   }
 
-  arec = wg_create_array(db, 6, 0, 1);
-  gptr = ((gint *) arec + RECORD_META_POS);
-  if(*gptr != (RECORD_META_ARRAY|RECORD_META_NOTDATA|RECORD_META_MATCH)) {
-    if(printlevel) {
-#ifndef _WIN32
-      printf("array (param) had invalid meta bits (%td)\n", *gptr);
+  /* columns 150 and 250 are released, 200 is still in use with
+   * a template */
+#ifndef USE_INDEX_TEMPLATE
+  if(wg_drop_index(db, tindex_id) || wg_drop_index(db, hindex_id) ||\
+    ihdr->column_map_count != 1) {
 #else
-      printf("array (param) had invalid meta bits (%Id)\n", *gptr);
+  if(wg_drop_index(db, tindex_id) || wg_drop_index(db, hindex_id) ||\
+    ihdr->column_map_count != 3 || wg_drop_index(db, mindex_id)) {
 #endif
-    }
-    return 1;
+    if(printlevel)
+      fprintf(stderr, "index drop failed.\n");
+    return -1;
   }
-
-  /* we added params, row count should not increase. */
-  if(check_db_rows(db, 1, printlevel)) {
+  if(wg_drop_index(db, bindex_id) ||\
+    ihdr->column_map_count || ihdr->column_map) {
     if(printlevel)
-      printf("Invalid number of remaining rows after deleting.\n");
-    return 1;
+      fprintf(stderr, "column map not empty after dropping indexes.\n");
+    return -2;
   }
 
-  if(printlevel>1)
-    printf("********* schema test successful ********** \n");
-
+  if(printlevel > 1) {
+    printf("------- High column index test: no errors found --------\n");
+  }
   return 0;
 }
 
-/*
- * Test JSON parsing. This produces some errors in stderr
- * which is expected (rely on the return value to check for success).
+/** Run a query on integer columns and compare it to a scan
+ *  Checks the number of rows, that the rows match the conditions
+ *  and that the query used an index on the given column.
+ *  returns 0 if no errors found
+ *  returns -1 otherwise
  */
-static gint wg_check_json_parsing(void* db, int printlevel) {
-  void *doc, *rec;
-  gint enc;
-
-  char *json1 = "[7,8,9]"; /* ok */
-  char *json2 = "{ \"a\":{\n\"b\": 55.0\n}, \"c\"\n:\"hello\","\
-                    "\"d\"\t:[\n]}"; /* ok */
-  char *json3 = "25"; /* fail */
-  char *json4 = "{ \"a\":{\"b\": 55.0}, \"c\":\"hello\""; /* fail */
+static int check_bitmap_query(void *db, wg_query_arg *arglist, int argc,
+  int column, int printlevel) {
+  wg_query *query;
+  gint cnt = 0, expected = 0;
+  void *rec;
+  int i;
 
-  if(printlevel>1) {
-    printf("********* testing JSON parsing functions ********** \n");
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    for(i=0; i<argc; i++) {
+      gint cmp = WG_COMPARE(db, wg_get_field(db, rec, arglist[i].column),
+        arglist[i].value);
+      if((arglist[i].cond == WG_COND_EQUAL && cmp != WG_EQUAL) ||\
+        (arglist[i].cond == WG_COND_NOT_EQUAL && cmp == WG_EQUAL) ||\
+        (arglist[i].cond == WG_COND_LESSTHAN && cmp != WG_LESSTHAN) ||\
+        (arglist[i].cond == WG_COND_GREATER && cmp != WG_GREATER) ||\
+        (arglist[i].cond == WG_COND_LTEQUAL && cmp == WG_GREATER) ||\
+        (arglist[i].cond == WG_COND_GTEQUAL && cmp == WG_LESSTHAN))
+        break;
+    }
+    if(i == argc)
+      expected++;
   }
 
-  /* parse input buf. */
-  doc = NULL;
-  if(wg_parse_json_document(db, json1, &doc)) {
+  query = wg_make_query(db, NULL, 0, arglist, argc);
+  if(!query) {
     if(printlevel)
-      printf("Parsing a valid document failed.\n");
-    return 1;
+      printf("wg_make_query() failed\n");
+    return -1;
   }
-  if(!doc) {
+  while(wg_fetch(db, query))
+    cnt++;
+  if(query->column != column) {
     if(printlevel)
-      printf("JSON parser did not return a document.\n");
-    return 1;
+      printf("query expected to use col%d used column %d\n",
+        column, (int) query->column);
+    wg_free_query(db, query);
+    return -1;
   }
+  wg_free_query(db, query);
 
-  /* examine structure
-   */
-  if(wg_get_record_len(db, doc) != 3) {
+  if(cnt != expected) {
     if(printlevel)
-      printf("Document structure error: bad object length.\n");
-    return 1;
+      printf("query with %d conditions on col%d returned %d rows, "\
+        "expected %d\n", argc, column, (int) cnt, (int) expected);
+    return -1;
   }
-  if(is_special_record(doc) || !is_schema_document(doc) ||\
-   !is_schema_array(doc)) {
-    if(printlevel) {
-      printf("Document structure error: invalid meta type\n");
-    }
-    return 1;
+  return 0;
+}
+
+/** Test bitmap indexes
+ *  Column 1 has enough rows per value to use bitset containers. Checks
+ *  the queries that combine bitmaps, the choice between bitmap and
+ *  T-tree indexes and that the bitmaps follow updates and deletes.
+ */
+static gint wg_test_index8(void *db, int magnitude, int printlevel) {
+  const int dbsize = 400*magnitude;
+  int i;
+  void *rec;
+  gint index_id[4];
+  wg_index_spec specs[2];
+  gint cols[2];
+  wg_query_arg arg[4];
+  wg_index_header *hdr;
+  wg_bitmap_value *v;
+
+  if(printlevel > 1) {
+    printf("------- Bitmap index test: inserting data --------\n");
   }
 
-  /* field contents */
-  enc = wg_get_field(db, doc, 0);
-  if(wg_get_encoded_type(db, enc) != WG_INTTYPE) {
+  /* column 1 is indexed while inserting */
+  if(wg_create_index(db, 1, WG_INDEX_TYPE_BITMAP, NULL, 0)) {
     if(printlevel)
-      printf("Document structure error: bad array element(0).\n");
-    return 1;
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
   }
-  if(wg_decode_int(db, enc) != 7) {
-    if(printlevel)
-      printf("Document structure error: bad array element value(0).\n");
-    return 1;
+  for(i=0; i<dbsize; i++) {
+    rec = wg_create_record(db, 4);
+    if(!rec || wg_set_field(db, rec, 0, wg_encode_int(db, i % 3)) ||\
+      wg_set_field(db, rec, 1, wg_encode_int(db, i % 2)) ||\
+      wg_set_field(db, rec, 2, wg_encode_int(db, i % 5)) ||\
+      wg_set_field(db, rec, 3, wg_encode_int(db, i))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
   }
 
-  enc = wg_get_field(db, doc, 1);
-  if(wg_get_encoded_type(db, enc) != WG_INTTYPE) {
+  cols[0] = 0;
+  cols[1] = 2;
+  for(i=0; i<2; i++) {
+    specs[i].columns = &cols[i];
+    specs[i].col_count = 1;
+    specs[i].type = WG_INDEX_TYPE_BITMAP;
+    specs[i].matchrec = NULL;
+    specs[i].reclen = 0;
+    specs[i].size_hint = 0;
+  }
+  if(wg_create_indexes(db, specs, 2, 0) ||\
+    wg_create_index(db, 3, WG_INDEX_TYPE_TTREE, NULL, 0)) {
     if(printlevel)
-      printf("Document structure error: bad array element(1).\n");
-    return 1;
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
   }
-  if(wg_decode_int(db, enc) != 8) {
+  if(!wg_create_multi_index(db, cols, 2, WG_INDEX_TYPE_BITMAP, NULL, 0)) {
     if(printlevel)
-      printf("Document structure error: bad array element value(1).\n");
-    return 1;
+      fprintf(stderr, "multi-column bitmap index was created.\n");
+    return -2;
+  }
+  for(i=0; i<3; i++) {
+    index_id[i] = wg_column_to_index_id(db, i, WG_INDEX_TYPE_BITMAP,
+      NULL, 0);
+    if(index_id[i] == -1 || ((wg_index_header *) offsettoptr(db,
+      index_id[i]))->ctl.m.values != (i == 1 ? 2 : (i ? 5 : 3))) {
+      if(printlevel)
+        fprintf(stderr, "bad values in bitmap index on col%d.\n", i);
+      return -2;
+    }
   }
 
-  enc = wg_get_field(db, doc, 2);
-  if(wg_get_encoded_type(db, enc) != WG_INTTYPE) {
+  /* half of the rows in a container have the same value */
+  hdr = (wg_index_header *) offsettoptr(db, index_id[1]);
+  v = (wg_bitmap_value *) offsettoptr(db, BITMAP_VALUES(hdr));
+  for(i=0; i<v->count; i++) {
+    if(!((wg_bitmap_container *) offsettoptr(db, v->containers))[i].size)
+      break;
+  }
+  if(v->rows != dbsize/2 || i == v->count) {
     if(printlevel)
-      printf("Document structure error: bad array element(2).\n");
-    return 1;
+      fprintf(stderr, "bitmap of col1 does not use bitsets.\n");
+    return -2;
   }
-  if(wg_decode_int(db, enc) != 9) {
+
+  arg[0].column = 0;
+  arg[0].cond = WG_COND_EQUAL;
+  arg[0].value = wg_encode_query_param_int(db, 1);
+  arg[1].column = 1;
+  arg[1].cond = WG_COND_EQUAL;
+  arg[1].value = wg_encode_query_param_int(db, 0);
+  arg[2].column = 2;
+  arg[2].cond = WG_COND_LESSTHAN;
+  arg[2].value = wg_encode_query_param_int(db, 2);
+  arg[3].column = 3;
+  arg[3].cond = WG_COND_GREATER;
+  arg[3].value = wg_encode_query_param_int(db, dbsize/3);
+
+  if(check_bitmap_query(db, arg, 2, 0, printlevel) ||\
+    check_bitmap_query(db, arg, 3, 0, printlevel) ||\
+    check_bitmap_query(db, &arg[1], 1, 1, printlevel) ||\
+    check_bitmap_query(db, &arg[1], 2, 1, printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad array element value(2).\n");
-    return 1;
+      fprintf(stderr, "bitmap query failed after insert.\n");
+    return -2;
   }
 
-  /* Use the param parser to get direct access to the
-   * document structure. */
-  doc = NULL;
-  if(wg_parse_json_param(db, json2, &doc)) {
+  /* only one bitmap and a T-tree: the T-tree is used */
+  if(check_bitmap_query(db, &arg[2], 2, 3, printlevel)) {
     if(printlevel)
-      printf("Parsing a valid document failed.\n");
-    return 1;
+      fprintf(stderr, "T-tree was not used with a bitmap index.\n");
+    return -2;
   }
 
-  if(!doc) {
+  /* ranges and inequality select several values of a column */
+  arg[0].cond = WG_COND_NOT_EQUAL;
+  arg[2].cond = WG_COND_GTEQUAL;
+  if(check_bitmap_query(db, arg, 3, 0, printlevel) ||\
+    check_bitmap_query(db, arg, 4, 0, printlevel)) {
     if(printlevel)
-      printf("Param parser did not return a document.\n");
-    return 1;
+      fprintf(stderr, "bitmap range query failed after insert.\n");
+    return -2;
   }
 
-  /* examine structure
-   */
-  if(wg_get_record_len(db, doc) != 3) {
+  /* no matching values */
+  arg[2].cond = WG_COND_GREATER;
+  arg[2].value = wg_encode_query_param_int(db, 10);
+  if(check_bitmap_query(db, arg, 3, 0, printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad object length.\n");
-    return 1;
+      fprintf(stderr, "empty bitmap query failed.\n");
+    return -2;
   }
 
-  if(!is_special_record(doc) || !is_schema_document(doc) ||\
-   !is_schema_object(doc)) {
-    if(printlevel) {
-      printf("Document structure error: invalid meta type\n");
-    }
-    return 1;
+  if(printlevel > 1) {
+    printf("------- Bitmap index test: updating data --------\n");
   }
 
-  /* first kv-pair */
-  enc = wg_get_field(db, doc, 0);
-  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
-    if(printlevel)
-      printf("Document structure error: bad object element(0).\n");
-    return 1;
+  i = 0;
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(!(i++ % 3) && wg_set_field(db, rec, 1, wg_encode_int(db, 2))) {
+      if(printlevel)
+        fprintf(stderr, "update error, aborting.\n");
+      return -1;
+    }
+  }
+  for(i=0; i<dbsize/4; i++) {
+    if(wg_delete_record(db, wg_get_first_record(db))) {
+      if(printlevel)
+        fprintf(stderr, "delete error, aborting.\n");
+      return -1;
+    }
   }
-  rec = wg_decode_record(db, enc);
 
-  enc = wg_get_field(db, rec, WG_SCHEMA_KEY_OFFSET);
-  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+  arg[0].cond = WG_COND_EQUAL;
+  arg[2].cond = WG_COND_LESSTHAN;
+  arg[2].value = wg_encode_query_param_int(db, 2);
+  if(((wg_index_header *) offsettoptr(db, index_id[1]))->ctl.m.values != 3 ||\
+    check_bitmap_query(db, arg, 2, 0, printlevel) ||\
+    check_bitmap_query(db, arg, 3, 0, printlevel) ||\
+    check_bitmap_query(db, &arg[1], 1, 1, printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad key type.\n");
-    return 1;
+      fprintf(stderr, "bitmap query failed after update.\n");
+    return -2;
   }
-  if(strncmp("a", wg_decode_str(db, enc), 1)) {
+  arg[1].value = wg_encode_query_param_int(db, 2);
+  if(check_bitmap_query(db, arg, 2, 0, printlevel) ||\
+    check_bitmap_query(db, &arg[1], 1, 1, printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad key string.\n");
-    return 1;
+      fprintf(stderr, "bitmap query on new value failed.\n");
+    return -2;
   }
 
-  enc = wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET);
-  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
-    if(printlevel)
-      printf("Document structure error: bad value type.\n");
-    return 1;
+  /* the value disappears with its last row */
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(wg_decode_int(db, wg_get_field(db, rec, 1)) == 2 &&\
+      wg_set_field(db, rec, 1, wg_encode_int(db, 0))) {
+      if(printlevel)
+        fprintf(stderr, "update error, aborting.\n");
+      return -1;
+    }
   }
-  rec = wg_decode_record(db, enc);
-  if(wg_get_record_len(db, rec) != 1) {
+  arg[1].value = wg_encode_query_param_int(db, 0);
+  if(((wg_index_header *) offsettoptr(db, index_id[1]))->ctl.m.values != 2 ||\
+    check_bitmap_query(db, arg, 3, 0, printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad sub-object length.\n");
-    return 1;
+      fprintf(stderr, "bitmap query failed after removing a value.\n");
+    return -2;
   }
-  if(!is_schema_object(rec)) {
-    if(printlevel) {
-      printf("Document structure error: sub-object has invalid meta type\n");
+
+  /* sparse rows turn the bitsets back into arrays */
+  rec = wg_get_first_record(db);
+  while(rec) {
+    void *next = wg_get_next_record(db, rec);
+    if(wg_decode_int(db, wg_get_field(db, rec, 3)) % 4 &&\
+      wg_delete_record(db, rec)) {
+      if(printlevel)
+        fprintf(stderr, "delete error, aborting.\n");
+      return -1;
     }
+    rec = next;
   }
-
-  enc = wg_get_field(db, rec, 0);
-  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+  v = (wg_bitmap_value *) offsettoptr(db, BITMAP_VALUES(hdr));
+  for(i=0; i<v->count; i++) {
+    if(!((wg_bitmap_container *) offsettoptr(db, v->containers))[i].size)
+      break;
+  }
+  if(i < v->count ||\
+    check_bitmap_query(db, arg, 2, 0, printlevel) ||\
+    check_bitmap_query(db, arg, 3, 0, printlevel) ||\
+    check_bitmap_query(db, &arg[1], 1, 1, printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad sub-object element(0).\n");
-    return 1;
+      fprintf(stderr, "bitmap query failed on sparse rows.\n");
+    return -2;
   }
-  rec = wg_decode_record(db, enc);
 
-  enc = wg_get_field(db, rec, WG_SCHEMA_KEY_OFFSET);
-  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
-    if(printlevel)
-      printf("Document structure error: bad subobj key type.\n");
-    return 1;
+  for(i=0; i<3; i++) {
+    if(wg_drop_index(db, index_id[i])) {
+      if(printlevel)
+        fprintf(stderr, "index drop failed.\n");
+      return -1;
+    }
   }
-  if(strncmp("b", wg_decode_str(db, enc), 1)) {
+  if(check_bitmap_query(db, arg, 3, -1, printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad subobj key string.\n");
-    return 1;
+      fprintf(stderr, "query failed after dropping the bitmaps.\n");
+    return -2;
   }
 
-  enc = wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET);
-  if(wg_get_encoded_type(db, enc) != WG_DOUBLETYPE) {
-    if(printlevel)
-      printf("Document structure error: bad subobj value type.\n");
-    return 1;
+  if(printlevel > 1) {
+    printf("------- Bitmap index test: no errors found --------\n");
   }
+  return 0;
+}
 
-  if(wg_decode_double(db, enc) >= 55.1 ||\
-   wg_decode_double(db, enc) <= 54.9) {
+/** Run a term query and check the number of rows
+ *  Also checks that the query used an index on the given column.
+ *  returns 0 if no errors found
+ *  returns -1 otherwise
+ */
+static int check_fulltext_query(void *db, wg_query_arg *arglist, int argc,
+  int column, int expected, int printlevel) {
+  wg_query *query;
+  int cnt = 0;
+
+  query = wg_make_query(db, NULL, 0, arglist, argc);
+  if(!query) {
     if(printlevel)
-      printf("Document structure error: bad subobj value.\n");
-    return 1;
+      printf("wg_make_query() failed\n");
+    return -1;
   }
-
-  /* second kv-pair */
-  enc = wg_get_field(db, doc, 1);
-  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+  while(wg_fetch(db, query))
+    cnt++;
+  if(query->column != column) {
     if(printlevel)
-      printf("Document structure error: bad object element(1).\n");
-    return 1;
+      printf("query expected to use col%d used column %d\n",
+        column, (int) query->column);
+    wg_free_query(db, query);
+    return -1;
   }
-  rec = wg_decode_record(db, enc);
+  wg_free_query(db, query);
 
-  enc = wg_get_field(db, rec, WG_SCHEMA_KEY_OFFSET);
-  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+  if(cnt != expected) {
     if(printlevel)
-      printf("Document structure error: bad key type.\n");
-    return 1;
+      printf("term query with %d conditions returned %d rows, "\
+        "expected %d\n", argc, cnt, expected);
+    return -1;
   }
-  if(strncmp("c", wg_decode_str(db, enc), 1)) {
-    if(printlevel)
-      printf("Document structure error: bad key string.\n");
-    return 1;
+  return 0;
+}
+
+/** Test full-text indexes
+ *  Column 0 holds log lines, column 1 the line number. Row counts
+ *  of the term queries are computed from the line numbers. Checks
+ *  case folding, UTF-8 terms, updates, deletes, ranked search and
+ *  the scan when the index is dropped.
+ */
+static gint wg_test_index9(void *db, int magnitude, int printlevel) {
+  const int dbsize = 200*magnitude;
+  const char *status[] = { "error", "timeout", "ok" };
+  char buf[100];
+  int i, j, cnt[6];
+  void *rec, *rows[10];
+  double scores[10];
+  gint index_id, found, cols[2], terms[8];
+  wg_query_arg arg[3];
+
+  if(printlevel > 1) {
+    printf("------- Full-text index test: inserting data --------\n");
   }
 
-  enc = wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET);
-  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+  /* half of the rows exist when the index is created */
+  for(i=0; i<dbsize; i++) {
+    if(i == dbsize/2 && wg_create_fulltext_index(db, 0, 0, 0)) {
+      if(printlevel)
+        fprintf(stderr, "index creation failed, aborting.\n");
+      return -3;
+    }
+    snprintf(buf, 100, "Request %d from host%d: status %s%s", i, i % 7,
+      status[i % 3], (i % 10 == 1 ? " (J\xc3\xa4rv)" : ""));
+    rec = wg_create_record(db, 2);
+    if(!rec || wg_set_field(db, rec, 0, wg_encode_str(db, buf, NULL)) ||\
+      wg_set_field(db, rec, 1, wg_encode_int(db, i))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
+  }
+  cols[0] = 0;
+  cols[1] = 1;
+  if(!wg_create_multi_index(db, cols, 2, WG_INDEX_TYPE_FULLTEXT, NULL, 0)) {
     if(printlevel)
-      printf("Document structure error: value type.\n");
-    return 1;
+      fprintf(stderr, "multi-column full-text index was created.\n");
+    return -2;
   }
-  if(strncmp("hello", wg_decode_str(db, enc), 5)) {
+  index_id = wg_column_to_index_id(db, 0, WG_INDEX_TYPE_FULLTEXT, NULL, 0);
+  if(index_id == -1) {
     if(printlevel)
-      printf("Document structure error: bad value.\n");
-    return 1;
+      fprintf(stderr, "full-text index not found.\n");
+    return -2;
   }
 
-  /* third kv-pair */
-  enc = wg_get_field(db, doc, 2);
-  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+  /* the terms are matched regardless of case, also in UTF-8 */
+  terms[0] = wg_encode_query_param_str(db, "ERROR", NULL);
+  terms[1] = wg_encode_query_param_str(db, "host3", NULL);
+  terms[2] = wg_encode_query_param_str(db, "error, Host3", NULL);
+  terms[3] = wg_encode_query_param_str(db, "j\xc3\x84rv", NULL);
+  terms[4] = wg_encode_query_param_str(db, "timeout", NULL);
+  terms[5] = wg_encode_query_param_str(db, "retry", NULL);
+  terms[6] = wg_encode_query_param_str(db, "a", NULL); /* no terms */
+  terms[7] = wg_encode_query_param_str(db, "Request 2", NULL);
+
+  arg[0].column = 0;
+  arg[0].cond = WG_COND_CONTAINS_TERM;
+  arg[0].value = terms[0];
+  arg[1].column = 0;
+  arg[1].cond = WG_COND_CONTAINS_TERM;
+  arg[1].value = terms[1];
+  arg[2].column = 1;
+  arg[2].cond = WG_COND_LESSTHAN;
+  arg[2].value = wg_encode_query_param_int(db, dbsize/2);
+
+  /* error, error on host3, in the first half, the name, timeout,
+   * host3 in the first half */
+  memset(cnt, 0, sizeof(cnt));
+  for(i=0; i<dbsize; i++) {
+    if(!(i % 3)) {
+      cnt[0]++;
+      if(i % 7 == 3) {
+        cnt[1]++;
+        if(i < dbsize/2)
+          cnt[2]++;
+      }
+    }
+    if(i % 10 == 1)
+      cnt[3]++;
+    if(i % 3 == 1)
+      cnt[4]++;
+    if(i % 7 == 3 && i < dbsize/2)
+      cnt[5]++;
+  }
+
+  if(check_fulltext_query(db, arg, 1, 0, cnt[0], printlevel) ||\
+    check_fulltext_query(db, arg, 2, 0, cnt[1], printlevel) ||\
+    check_fulltext_query(db, arg, 3, 0, cnt[2], printlevel) ||\
+    check_fulltext_query(db, &arg[1], 2, 0, cnt[5], printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad object element(0).\n");
-    return 1;
+      fprintf(stderr, "term query failed after insert.\n");
+    return -2;
   }
-  rec = wg_decode_record(db, enc);
 
-  enc = wg_get_field(db, rec, WG_SCHEMA_KEY_OFFSET);
-  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+  /* several terms in one condition, no rows and no terms */
+  arg[1].value = terms[2];
+  if(check_fulltext_query(db, &arg[1], 1, 0, cnt[1], printlevel) ||\
+    check_fulltext_query(db, &arg[1], 2, 0, cnt[2], printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad key type.\n");
-    return 1;
+      fprintf(stderr, "query with several terms failed.\n");
+    return -2;
   }
-  if(strncmp("d", wg_decode_str(db, enc), 1)) {
+  arg[0].value = terms[3];
+  if(check_fulltext_query(db, arg, 1, 0, cnt[3], printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad key string.\n");
-    return 1;
+      fprintf(stderr, "UTF-8 term query failed.\n");
+    return -2;
   }
-
-  enc = wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET);
-  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+  arg[0].value = terms[0];
+  arg[1].value = terms[4];
+  if(check_fulltext_query(db, arg, 2, 0, 0, printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad value type.\n");
-    return 1;
-  }
-  rec = wg_decode_record(db, enc);
-  if(!is_schema_array(rec)) {
-    if(printlevel) {
-      printf("Document structure error: bad value (array expected)\n");
-    }
+      fprintf(stderr, "query without matching rows failed.\n");
+    return -2;
   }
-  if(wg_get_record_len(db, rec) != 0) {
+  arg[0].value = terms[6];
+  if(check_fulltext_query(db, arg, 1, 0, 0, printlevel)) {
     if(printlevel)
-      printf("Document structure error: bad array length.\n");
-    return 1;
+      fprintf(stderr, "query without terms returned rows.\n");
+    return -2;
   }
 
-  /* Invalid documents, expect a failure.
-   */
-  if(printlevel>1)
-    printf("testing invalid documents, the following errors are expected.\n");
-
-  if(!wg_check_json(db, NULL)) {
-    if(printlevel)
-      printf("Checking an invalid document succeeded (expected to fail).\n");
-    return 1;
-  }
-  if(!wg_check_json(db, json3)) {
-    if(printlevel)
-      printf("Checking an invalid document succeeded (expected to fail).\n");
-    return 1;
+  /* other conditions on the indexed column are checked for each row */
+  arg[0].value = terms[0];
+  arg[1].cond = WG_COND_LESSTHAN;
+  arg[1].value = terms[7];
+  for(i=0, j=0; i<dbsize; i++) {
+    snprintf(buf, 100, "%d", i);
+    if(!(i % 3) && buf[0] < '2')
+      j++;
   }
-  if(!wg_parse_json_document(db, json3, NULL)) {
+  if(check_fulltext_query(db, arg, 2, 0, j, printlevel)) {
     if(printlevel)
-      printf("Parsing an invalid document succeeded.\n");
-    return 1;
+      fprintf(stderr, "query with a range on the indexed column failed.\n");
+    return -2;
   }
+  arg[1].cond = WG_COND_CONTAINS_TERM;
 
-  if(!wg_check_json(db, json4)) {
+  /* ranked search: the rows with both terms come first */
+  found = wg_fulltext_search(db, index_id, "error host3", WG_FULLTEXT_OR,
+    10, rows, scores);
+  for(j=0; j<found; j++) {
+    i = wg_decode_int(db, wg_get_field(db, rows[j], 1));
+    if(i % 3 || i % 7 != 3 || (j && scores[j] > scores[j-1]))
+      break;
+  }
+  if(found != 10 || j < found) {
     if(printlevel)
-      printf("Checking an invalid document succeeded (expected to fail).\n");
-    return 1;
+      fprintf(stderr, "ranked search returned bad rows.\n");
+    return -2;
   }
-  if(!wg_parse_json_param(db, json4, &doc)) {
+  found = wg_fulltext_search(db, index_id, "error timeout", WG_FULLTEXT_AND,
+    10, rows, NULL);
+  if(found != 0 ||\
+    wg_fulltext_search(db, index_id, "error", 0, 10, rows, NULL) != -1) {
     if(printlevel)
-      printf("Parsing an invalid document succeeded.\n");
-    return 1;
+      fprintf(stderr, "ranked search failed.\n");
+    return -2;
   }
 
-  if(printlevel>1)
-    printf("********* JSON parsing test successful ********** \n");
-
-  return 0;
-}
+  if(printlevel > 1) {
+    printf("------- Full-text index test: updating data --------\n");
+  }
 
-/*
- * Returns 1 if the offset is in list.
- * Returns 0 otherwise.
- */
-static int is_offset_in_list(void *db, gint reclist_offset, gint offset) {
-  if(reclist_offset > 0) {
-    gint *nextoffset = &reclist_offset;
-    while(*nextoffset) {
-      gcell *rec_cell = (gcell *) offsettoptr(db, *nextoffset);
-      if(rec_cell->car == offset)
-        return 1;
-      nextoffset = &(rec_cell->cdr);
-    }
-  }
-  return 0;
-}
-
-/*
- * Test index hash (low-level functions)
- */
-static gint wg_check_idxhash(void* db, int printlevel) {
-  db_hash_area_header ha;
-  struct {
-    char *data;
-    gint offsets[10];
-    int delidx;
-  } rowdata[] = {
-    { "0iQ1vMvGX5wfsjLTssyx", { 5709281, 5769186, 0,
-                                0, 0, 0, 0, 0, 0, 0 }, 1 },
-    { "1jP3hJxO61QVscBEKu9", { 3510018, 8944261, 8172536,
-                                4346587, 0, 0, 0, 0, 0, 0 }, 2 },
-    { "yLMt2eSQuIi3ChQlI0", { 6587099, 6385516, 0,
-                                0, 0, 0, 0, 0, 0, 0 }, 1 },
-    { "ZlGS9cVX7fE1v7H6m", { 2059694, 1981000, 8360987,
-                             752526, 6435820, 240982,
-                             323628, 8875951, 0, 0 }, 1 },
-    { "duflillyRviJ1ZvH", { 6711262, 9685175, 4070003,
-                            5977585, 9671591, 5321015,
-                            7499127, 9101853, 0, 0 }, 2 },
-    { "USLP83gH6f4pNYJ", { 8759349, 436333, 0,
-                           0, 0, 0, 0, 0, 0, 0 }, 1 },
-    { "yHIDgxlEA7RLAx", { 7613500, 534106, 4361094,
-                          1506219, 0, 0, 0, 0, 0, 0 }, 1 },
-    { "             ", { 6588510, 6253610, 9020726,
-                         8514572, 9378303, 1100373, 0, 0, 0, 0 }, 2 },
-    { "            ", { 8185484, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, 0 },
-    { "yHIDgxlEA7R", { 2542797, 6481658, 214793,
-                       943434, 2934816, 9503963,
-                       1374313, 0, 0, 0 }, 4 },
-    { NULL, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, -1 }
-  };
-  int i;
-
-  if(printlevel>1) {
-    printf("********* testing index hash functions ********** \n");
-  }
-
-  /* Create a tiny hash table to allow hash chains to be created. */
-  if(wg_create_hash(db, &ha, 4)) {
-    if(printlevel)
-      printf("Failed to create the hash table.\n");
-    return 1;
-  }
-
-  /* Insert rows in order of columns */
-  for(i=0; i<10; i++) {
-    int j;
-    for(j=0; rowdata[j].data; j++) {
-      if(rowdata[j].offsets[i]) {
-        if(wg_idxhash_store(db, &ha, rowdata[j].data,
-         strlen(rowdata[j].data), rowdata[j].offsets[i])) {
-          if(printlevel)
-            printf("Hash table insertion failed (j=%d i=%d).\n", j, i);
-          return 1;
-        }
+  /* some lines are replaced, some become integers, some are deleted */
+  rec = wg_get_first_record(db);
+  while(rec) {
+    void *next = wg_get_next_record(db, rec);
+    i = wg_decode_int(db, wg_get_field(db, rec, 1));
+    if(!(i % 5)) {
+      if(wg_delete_record(db, rec)) {
+        if(printlevel)
+          fprintf(stderr, "delete error, aborting.\n");
+        return -1;
+      }
+    } else if(!(i % 11)) {
+      if(wg_set_field(db, rec, 0, wg_encode_int(db, i))) {
+        if(printlevel)
+          fprintf(stderr, "update error, aborting.\n");
+        return -1;
+      }
+    } else if(!(i % 4)) {
+      snprintf(buf, 100, "Retry %d on host%d: status timeout", i, i % 7);
+      if(wg_set_field(db, rec, 0, wg_encode_str(db, buf, NULL))) {
+        if(printlevel)
+          fprintf(stderr, "update error, aborting.\n");
+        return -1;
       }
     }
+    rec = next;
   }
 
-  /* Check that each offset is present */
-  for(i=0; rowdata[i].data; i++) {
-    int j;
-    gint list = wg_idxhash_find(db, &ha, rowdata[i].data,
-      strlen(rowdata[i].data));
-    for(j=0; j<10 && rowdata[i].offsets[j]; j++) {
-      if(!is_offset_in_list(db, list, rowdata[i].offsets[j])) {
-        if(printlevel)
-          printf("Offset missing in hash table (i=%d j=%d).\n", i, j);
-        return 1;
+  /* error, error on host3, error on host3 in the first half, the name,
+   * timeout, retry */
+  memset(cnt, 0, sizeof(cnt));
+  for(i=0; i<dbsize; i++) {
+    if(!(i % 5) || !(i % 11))
+      continue;
+    if(!(i % 4)) {
+      cnt[4]++;
+      cnt[5]++;
+      continue;
+    }
+    if(!(i % 3)) {
+      cnt[0]++;
+      if(i % 7 == 3) {
+        cnt[1]++;
+        if(i < dbsize/2)
+          cnt[2]++;
       }
     }
+    if(i % 10 == 1)
+      cnt[3]++;
+    if(i % 3 == 1)
+      cnt[4]++;
   }
 
-  /* Delete the rows designated by delidx */
-  for(i=0; rowdata[i].data; i++) {
-    if(wg_idxhash_remove(db, &ha, rowdata[i].data,
-     strlen(rowdata[i].data), rowdata[i].offsets[rowdata[i].delidx])) {
+  for(j=0; j<2; j++) {
+    arg[0].value = terms[0];
+    arg[1].value = terms[1];
+    if(check_fulltext_query(db, arg, 1, (j ? -1 : 0), cnt[0], printlevel) ||\
+      check_fulltext_query(db, arg, 2, (j ? -1 : 0), cnt[1], printlevel) ||\
+      check_fulltext_query(db, arg, 3, (j ? -1 : 0), cnt[2], printlevel)) {
       if(printlevel)
-        printf("Hash table deletion failed (i=%d delidx=%d).\n",
-          i, rowdata[i].delidx);
-      return 1;
+        fprintf(stderr, "term query failed after update.\n");
+      return -2;
+    }
+    arg[0].value = terms[3];
+    if(check_fulltext_query(db, arg, 1, (j ? -1 : 0), cnt[3], printlevel)) {
+      if(printlevel)
+        fprintf(stderr, "UTF-8 term query failed after update.\n");
+      return -2;
+    }
+    arg[0].value = terms[4];
+    arg[1].value = terms[5];
+    if(check_fulltext_query(db, arg, 1, (j ? -1 : 0), cnt[4], printlevel) ||\
+      check_fulltext_query(db, &arg[1], 1, (j ? -1 : 0), cnt[5], printlevel)) {
+      if(printlevel)
+        fprintf(stderr, "term query on new values failed.\n");
+      return -2;
     }
-  }
 
-  /* Check that the deleted row is not present and that all the others are */
-  for(i=0; rowdata[i].data; i++) {
-    int j;
-    gint list = wg_idxhash_find(db, &ha, rowdata[i].data,
-      strlen(rowdata[i].data));
-    for(j=0; j<10 && rowdata[i].offsets[j]; j++) {
-      if(j == rowdata[i].delidx) {
-        /* Should be missing */
-        if(is_offset_in_list(db, list, rowdata[i].offsets[j])) {
-          if(printlevel)
-            printf("Offset not correctly deleted (i=%d delidx=%d).\n",
-              i, rowdata[i].delidx);
-          return 1;
-        }
-      } else {
-        /* Should be present */
-        if(!is_offset_in_list(db, list, rowdata[i].offsets[j])) {
-          if(printlevel)
-            printf("Offset missing in hash table (i=%d j=%d).\n", i, j);
-          return 1;
-        }
-      }
+    /* the same queries are answered by a scan */
+    if(!j && wg_drop_index(db, index_id)) {
+      if(printlevel)
+        fprintf(stderr, "index drop failed.\n");
+      return -1;
     }
   }
 
-  if(printlevel>1)
-    printf("********* index hash test successful ********** \n");
+  for(i=0; i<8; i++)
+    wg_free_query_param(db, terms[i]);
 
+  if(printlevel > 1) {
+    printf("------- Full-text index test: no errors found --------\n");
+  }
   return 0;
 }
 
-/* --------------------- query testing ------------------------ */
-
-/**
- * Fetch all rows where "col" "cond" "val" is true
- *   (where cond is a comparison operator - equal, less than etc)
- * Check that the val matches the field value in returned records.
- * Check that the number of rows matches the expected value
+/** Store the point of a test row
+ *  The coordinates are integers on every third row, doubles with
+ *  a fraction otherwise. Some rows have a string as x and no point.
+ *  returns 0 on success, -1 on error.
  */
-static int check_matching_rows(void *db, int col, int cond,
- void *val, gint type, int expected, int printlevel) {
-  void *rec = NULL;
-  wg_query *query = NULL;
-  wg_query_arg arglist;
-  int cnt;
+static int set_rtree_point(void *db, void *rec, int x, int y, int kind) {
+  gint encx, ency;
 
-  arglist.column = col;
-  arglist.cond = cond;
-  switch(type) {
-    case WG_INTTYPE:
-      arglist.value = wg_encode_query_param_int(db, *((gint *) val));
-      break;
-    case WG_DOUBLETYPE:
-      arglist.value = wg_encode_query_param_double(db, *((double *) val));
-      break;
-    case WG_STRTYPE:
-      arglist.value = wg_encode_query_param_str(db, (char *) val, NULL);
-      break;
-    default:
-      return -1;
+  if(!(kind % 3)) {
+    encx = wg_encode_int(db, x);
+    ency = wg_encode_int(db, y);
+  } else {
+    encx = wg_encode_double(db, x + 0.5);
+    ency = wg_encode_double(db, y + 0.5);
   }
+  if(!(kind % 13))
+    encx = wg_encode_str(db, "n/a", NULL);
+  if(encx == WG_ILLEGAL || ency == WG_ILLEGAL ||\
+    wg_set_field(db, rec, 0, encx) || wg_set_field(db, rec, 1, ency))
+    return -1;
+  return 0;
+}
 
-  query = wg_make_query(db, NULL, 0, &arglist, 1);
-  if(!query) {
-    return -2;
+/** Count the rows that have a point in columns 0 and 1
+ */
+static int count_rtree_points(void *db) {
+  void *rec;
+  double x, y;
+  int cnt = 0;
+
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(!wg_rtree_coord(db, wg_get_field(db, rec, 0), &x) &&\
+      !wg_rtree_coord(db, wg_get_field(db, rec, 1), &y))
+      cnt++;
   }
+  return cnt;
+}
 
-  if(query->res_count != expected) {
+/** Run a nearest neighbour query and compare it to a scan
+ *  Checks that the rows come nearest first and that no row outside
+ *  the result is nearer than the last row returned.
+ *  returns 0 if no errors found
+ *  returns -1 otherwise
+ */
+static int check_nearest_query(void *db, gint xcol, gint ycol,
+  double qx, double qy, int k, int printlevel) {
+  wg_query *query;
+  void *rec;
+  double x, y, dist, last = 0;
+  int cnt = 0, ties = 0, nearer = 0, points = 0;
+
+  query = wg_make_nearest_query(db, xcol, ycol, qx, qy, k);
+  if(!query) {
     if(printlevel)
-      printf("check_matching_rows: res_count mismatch (%d != %d)\n",
-        (int) query->res_count, expected);
-    return -3;
+      printf("wg_make_nearest_query() failed\n");
+    return -1;
   }
-
-  cnt = 0;
   while((rec = wg_fetch(db, query))) {
-    gint enc = wg_get_field(db, rec, col);
-    if(cond == WG_COND_EQUAL) {
-      switch(type) {
-        case WG_INTTYPE:
-          if(wg_decode_int(db, enc) != *((int *) val)) {
-            if(printlevel)
-              printf("check_matching_rows: int value mismatch\n");
-            return -4;
-          }
-          break;
-        case WG_DOUBLETYPE:
-          if(wg_decode_double(db, enc) != *((double *) val)) {
-            if(printlevel)
-              printf("check_matching_rows: double value mismatch\n");
-            return -4;
-          }
-          break;
-        case WG_STRTYPE:
-          if(strcmp(wg_decode_str(db, enc), (char *) val)) {
-            if(printlevel)
-              printf("check_matching_rows: string value mismatch\n");
-            return -4;
-          }
-          break;
-        default:
-          break;
-      }
+    if(wg_rtree_coord(db, wg_get_field(db, rec, xcol), &x) ||\
+      wg_rtree_coord(db, wg_get_field(db, rec, ycol), &y)) {
+      if(printlevel)
+        printf("nearest query returned a row without a point\n");
+      wg_free_query(db, query);
+      return -1;
+    }
+    dist = (x - qx) * (x - qx) + (y - qy) * (y - qy);
+    if(cnt && dist < last) {
+      if(printlevel)
+        printf("nearest query returned rows out of order\n");
+      wg_free_query(db, query);
+      return -1;
     }
+    ties = (cnt && dist == last ? ties + 1 : 1);
+    last = dist;
     cnt++;
   }
+  wg_free_query(db, query);
 
-  if(cnt != expected) {
+  /* the rows nearer than the last one must all be in the result */
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(wg_rtree_coord(db, wg_get_field(db, rec, xcol), &x) ||\
+      wg_rtree_coord(db, wg_get_field(db, rec, ycol), &y))
+      continue;
+    points++;
+    if((x - qx) * (x - qx) + (y - qy) * (y - qy) < last)
+      nearer++;
+  }
+  if(cnt != (points < k ? points : k) || nearer > cnt - ties) {
     if(printlevel)
-      printf("check_matching_rows: actual count mismatch (%d != %d)\n",
-        cnt, expected);
-    return -5;
+      printf("nearest query returned %d rows, expected %d "\
+        "(%d rows are nearer than the last one)\n",
+        cnt, (points < k ? points : k), nearer);
+    return -1;
   }
-
-  wg_free_query(db, query);
-  wg_free_query_param(db, arglist.value);
   return 0;
 }
 
-/**
- * version of check_matching_rows() using wg_find_record_*()
+/** Test R-tree indexes
+ *  Columns 0 and 1 hold the points of a grid, column 2 the row
+ *  number. Half of the rows are packed into the tree when the index
+ *  is created, the rest are inserted. Box queries are compared to a
+ *  scan, nearest neighbour queries to the distances of all rows.
+ *  Checks updates, deletes and the scan when the index is dropped.
  */
-static int check_matching_rows_find(void *db, int col, int cond,
- void *val, gint type, int expected, int printlevel) {
-  void *rec = NULL;
-  int cnt = 0;
+static gint wg_test_index10(void *db, int magnitude, int printlevel) {
+  const int dbsize = 200*magnitude;
+  const int side = 100;
+  int i, j;
+  void *rec;
+  gint index_id, cols[3], vals[10];
+  wg_query_arg arg[5];
 
-  for(;;) {
-    switch(type) {
-      case WG_INTTYPE:
-        rec = wg_find_record_int(db, col, cond, *((int *) val), rec);
-        break;
-      case WG_DOUBLETYPE:
-        rec = wg_find_record_double(db, col, cond, *((double *) val), rec);
-        break;
-      case WG_STRTYPE:
-        rec = wg_find_record_str(db, col, cond, (char *) val, rec);
-        break;
-      default:
-        break;
-    }
-    if(!rec)
-      break;
-    cnt++;
-  }
-
-  if(cnt != expected) {
-    if(printlevel)
-      printf("check_matching_rows_find: actual count mismatch (%d != %d)\n",
-        cnt, expected);
-    return -5;
-  }
-
-  return 0;
-}
-
-
-/**
- * Count db rows
- */
-static int check_db_rows(void *db, int expected, int printlevel) {
-  void *rec = NULL;
-  int cnt;
-
-  rec = wg_get_first_record(db);
-  cnt = 0;
-  while(rec) {
-    cnt++;
-    rec = wg_get_next_record(db, rec);
+  if(printlevel > 1) {
+    printf("------- R-tree index test: inserting data --------\n");
   }
 
-  if(cnt != expected) {
+  cols[0] = 0;
+  cols[1] = 1;
+  cols[2] = 2;
+  if(!wg_create_multi_index(db, cols, 1, WG_INDEX_TYPE_RTREE, NULL, 0) ||\
+    !wg_create_multi_index(db, cols, 3, WG_INDEX_TYPE_RTREE, NULL, 0)) {
     if(printlevel)
-      printf("check_db_rows: actual count mismatch (%d != %d)\n",
-        cnt, expected);
-    return -1;
+      fprintf(stderr, "R-tree index was created on one or three columns.\n");
+    return -2;
   }
 
-  return 0;
-}
-
-/**
- * Basic query tests
- */
-static gint wg_test_query(void *db, int magnitude, int printlevel) {
-  const int dbsize = 50*magnitude;
-  int i, j, k;
-  void *rec = NULL;
-
-  if(wg_column_to_index_id(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0) == -1) {
-    if(printlevel > 1)
-      printf("no index found on column 0, creating.\n");
-    if(wg_create_index(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0)) {
+  for(i=0; i<dbsize; i++) {
+    if(i == dbsize/2 &&\
+      wg_create_multi_index(db, cols, 2, WG_INDEX_TYPE_RTREE, NULL, 0)) {
       if(printlevel)
-        printf("index creation failed, aborting.\n");
+        fprintf(stderr, "index creation failed, aborting.\n");
       return -3;
     }
+    rec = wg_create_record(db, 3);
+    if(!rec || set_rtree_point(db, rec, i % side, i / side, i) ||\
+      wg_set_field(db, rec, 2, wg_encode_int(db, i))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
+  }
+  index_id = wg_multi_column_to_index_id(db, cols, 2,
+    WG_INDEX_TYPE_RTREE, NULL, 0);
+  if(index_id == -1) {
+    if(printlevel)
+      fprintf(stderr, "R-tree index not found.\n");
+    return -2;
+  }
+  if(validate_rtree(db, index_id, count_rtree_points(db), printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "index validation failed after insert.\n");
+    return -2;
   }
 
-  if(printlevel > 1)
-    printf("------- Inserting test data --------\n");
-
-  /* Create predictable data */
-  for(i=0; i<dbsize; i++) {
-    for(j=0; j<50; j++) {
-      for(k=0; k<50; k++) {
-        char c1[20];
-        gint c2 = 100 * j;
-        double c3 = 10 * k;
-        snprintf(c1, 19, "%d", 1000 * i);
-        c1[19] = '\0';
-
-        rec = wg_create_record(db, 3);
-        if(!rec) {
-          if(printlevel)
-            printf("insert error, aborting.\n");
-          return -1;
-        }
-        if(wg_set_field(db, rec, 0, wg_encode_str(db, c1, NULL))) {
-          if(printlevel)
-            printf("insert error, aborting.\n");
-          return -1;
-        }
-        if(wg_set_field(db, rec, 1, wg_encode_int(db, c2))) {
-          if(printlevel)
-            printf("insert error, aborting.\n");
-          return -1;
+  vals[0] = wg_encode_query_param_int(db, 10);
+  vals[1] = wg_encode_query_param_int(db, 30);
+  vals[2] = wg_encode_query_param_int(db, 20);
+  vals[3] = wg_encode_query_param_int(db, 60);
+  vals[4] = wg_encode_query_param_double(db, 10.5);
+  vals[5] = wg_encode_query_param_double(db, 30.5);
+  vals[6] = wg_encode_query_param_double(db, 20.0);
+  vals[7] = wg_encode_query_param_double(db, 60.5);
+  vals[8] = wg_encode_query_param_int(db, 3030);
+  vals[9] = wg_encode_query_param_double(db, 15.5);
+  arg[0].column = 0;
+  arg[1].column = 0;
+  arg[2].column = 1;
+  arg[3].column = 1;
+  arg[4].column = 2;
+  arg[4].cond = WG_COND_NOT_EQUAL;
+  arg[4].value = vals[8];
+
+  for(j=0; j<4; j++) {
+    if(j == 1) {
+      if(printlevel > 1) {
+        printf("------- R-tree index test: updating data --------\n");
+      }
+
+      /* some points move, some rows lose the point, some are deleted */
+      rec = wg_get_first_record(db);
+      while(rec) {
+        void *next = wg_get_next_record(db, rec);
+        i = wg_decode_int(db, wg_get_field(db, rec, 2));
+        if(!(i % 7)) {
+          if(wg_delete_record(db, rec)) {
+            if(printlevel)
+              fprintf(stderr, "delete error, aborting.\n");
+            return -1;
+          }
+        } else if(i % 7 == 1) {
+          if(set_rtree_point(db, rec, (i + 50) % side, side - 1 - i / side,
+            i + 1)) {
+            if(printlevel)
+              fprintf(stderr, "update error, aborting.\n");
+            return -1;
+          }
+        } else if(!(i % 11)) {
+          if(wg_set_field(db, rec, 1, wg_encode_str(db, "n/a", NULL))) {
+            if(printlevel)
+              fprintf(stderr, "update error, aborting.\n");
+            return -1;
+          }
         }
-        if(wg_set_field(db, rec, 2, wg_encode_double(db, c3))) {
-          if(printlevel)
-            printf("insert error, aborting.\n");
-          return -1;
+        rec = next;
+      }
+    } else if(j == 2) {
+      /* most rows are deleted, the tree shrinks */
+      rec = wg_get_first_record(db);
+      while(rec) {
+        void *next = wg_get_next_record(db, rec);
+        i = wg_decode_int(db, wg_get_field(db, rec, 2));
+        if(i % side > 40 || i / side > 40) {
+          if(wg_delete_record(db, rec)) {
+            if(printlevel)
+              fprintf(stderr, "delete error, aborting.\n");
+            return -1;
+          }
         }
+        rec = next;
+      }
+    } else if(j == 3) {
+      /* the same queries are answered by a scan */
+      if(wg_drop_index(db, index_id)) {
+        if(printlevel)
+          fprintf(stderr, "index drop failed.\n");
+        return -1;
+      }
+      if(wg_make_nearest_query(db, 0, 1, 0, 0, 1)) {
+        if(printlevel)
+          fprintf(stderr, "nearest query without an index succeeded.\n");
+        return -2;
       }
     }
-  }
-
-  if(wg_column_to_index_id(db, 2, WG_INDEX_TYPE_TTREE, NULL, 0) == -1) {
-    if(printlevel > 1)
-      printf("no index found on column 2, creating.\n");
-    if(wg_create_index(db, 2, WG_INDEX_TYPE_TTREE, NULL, 0)) {
+    if(j && j < 3 &&\
+      validate_rtree(db, index_id, count_rtree_points(db), printlevel)) {
       if(printlevel)
-        printf("index creation failed, aborting.\n");
-      return -3;
+        fprintf(stderr, "index validation failed after update.\n");
+      return -2;
     }
-  }
-
-  if(printlevel > 1)
-    printf("------- Running read query tests --------\n");
-
-  /* Content check read queries */
-  for(i=0; i<dbsize; i++) {
-    char buf[20];
-    snprintf(buf, 19, "%d", 1000 * i);
-    buf[19] = '\0';
 
-    if(check_matching_rows(db, 0, WG_COND_EQUAL, (void *) buf,
-     WG_STRTYPE, 50*50, printlevel)) {
+    /* closed integer box, also with a condition on another column */
+    arg[0].cond = WG_COND_GTEQUAL;
+    arg[0].value = vals[0];
+    arg[1].cond = WG_COND_LTEQUAL;
+    arg[1].value = vals[1];
+    arg[2].cond = WG_COND_GTEQUAL;
+    arg[2].value = vals[2];
+    arg[3].cond = WG_COND_LTEQUAL;
+    arg[3].value = vals[3];
+    if(check_bitmap_query(db, arg, 4, -1, printlevel) ||\
+      check_bitmap_query(db, arg, 5, -1, printlevel)) {
       if(printlevel)
-        printf("content check col=0, i=%d failed.\n", i);
+        fprintf(stderr, "integer box query failed.\n");
       return -2;
     }
-  }
 
-  for(i=0; i<50; i++) {
-    gint val = 100 * i;
-    if(check_matching_rows(db, 1, WG_COND_EQUAL, (void *) &val,
-     WG_INTTYPE, dbsize*50, printlevel)) {
+    /* double bounds that exclude the values on the edge */
+    arg[0].cond = WG_COND_GREATER;
+    arg[0].value = vals[4];
+    arg[1].cond = WG_COND_LESSTHAN;
+    arg[1].value = vals[5];
+    arg[2].value = vals[6];
+    arg[3].value = vals[7];
+    if(check_bitmap_query(db, arg, 4, -1, printlevel)) {
       if(printlevel)
-        printf("content check col=1, i=%d failed.\n", i);
+        fprintf(stderr, "double box query failed.\n");
       return -2;
     }
-  }
 
-  for(i=0; i<50; i++) {
-    double val = 10 * i;
-    if(check_matching_rows(db, 2, WG_COND_EQUAL, (void *) &val,
-     WG_DOUBLETYPE, dbsize*50, printlevel)) {
+    /* bounds of different types, an empty box and a single point */
+    arg[0].cond = WG_COND_GTEQUAL;
+    arg[0].value = vals[0];
+    arg[1].cond = WG_COND_LTEQUAL;
+    arg[1].value = vals[5];
+    arg[2].value = vals[2];
+    arg[3].value = vals[3];
+    if(check_bitmap_query(db, arg, 4, -1, printlevel)) {
       if(printlevel)
-        printf("content check col=2, i=%d failed.\n", i);
+        fprintf(stderr, "query with mixed bounds failed.\n");
       return -2;
     }
-  }
-
-  if(printlevel > 1)
-    printf("------- Running find tests --------\n");
-
-  /* Content check read queries */
-  for(i=0; i<dbsize; i++) {
-    char buf[20];
-    snprintf(buf, 19, "%d", 1000 * i);
-    buf[19] = '\0';
-
-    if(check_matching_rows_find(db, 0, WG_COND_EQUAL, (void *) buf,
-     WG_STRTYPE, 50*50, printlevel)) {
+    arg[0].value = vals[1];
+    arg[1].value = vals[0];
+    if(check_bitmap_query(db, arg, 4, -1, printlevel)) {
       if(printlevel)
-        printf("find check col=0, i=%d failed.\n", i);
-      return -8;
+        fprintf(stderr, "empty box query failed.\n");
+      return -2;
     }
-  }
-
-  for(i=0; i<4; i++) {
-    gint val = 100 * i;
-    if(check_matching_rows_find(db, 1, WG_COND_LESSTHAN, (void *) &val,
-     WG_INTTYPE, dbsize*50*i, printlevel)) {
+    arg[0].cond = WG_COND_EQUAL;
+    arg[0].value = vals[9];
+    arg[1].cond = WG_COND_EQUAL;
+    arg[1].value = vals[7];
+    arg[1].column = 1;
+    if(check_bitmap_query(db, arg, 2, -1, printlevel)) {
       if(printlevel)
-        printf("find check col=1, i=%d failed.\n", i);
-      return -8;
+        fprintf(stderr, "point query failed.\n");
+      return -2;
     }
-  }
+    arg[1].column = 0;
 
-  for(i=47; i<50; i++) {
-    double val = 10 * i;
-    if(check_matching_rows_find(db, 2, WG_COND_GTEQUAL, (void *) &val,
-     WG_DOUBLETYPE, dbsize*50*(50-i), printlevel)) {
-      if(printlevel)
-        printf("find check col=2, i=%d failed.\n", i);
-      return -8;
+    if(j < 3) {
+      if(check_nearest_query(db, 0, 1, 50.2, 25.7, 10, printlevel) ||\
+        check_nearest_query(db, 1, 0, 25.7, 50.2, 10, printlevel) ||\
+        check_nearest_query(db, 0, 1, -1000.0, 1000.0, 5, printlevel) ||\
+        check_nearest_query(db, 0, 1, 20.0, 20.0, 2*dbsize, printlevel)) {
+        if(printlevel)
+          fprintf(stderr, "nearest query failed.\n");
+        return -2;
+      }
+      if(wg_make_nearest_query(db, 0, 2, 0, 0, 1)) {
+        if(printlevel)
+          fprintf(stderr, "nearest query on wrong columns succeeded.\n");
+        return -2;
+      }
     }
   }
 
-  if(printlevel > 1)
-    printf("------- Updating test data --------\n");
+  for(i=0; i<10; i++)
+    wg_free_query_param(db, vals[i]);
 
-  /* Update queries */
-  for(i=0; i<dbsize; i++) {
-    wg_query *query;
-    wg_query_arg arg;
-    char c1[20];
-    snprintf(c1, 19, "%d", 1000 * i);
-    c1[19] = '\0';
+  if(printlevel > 1) {
+    printf("------- R-tree index test: no errors found --------\n");
+  }
+  return 0;
+}
 
-    arg.column = 0;
-    arg.cond = WG_COND_EQUAL;
-    arg.value = wg_encode_query_param_str(db, c1, NULL);
+/** Check if a string or a URI starts with a prefix
+ *  Written independently of the query code, for comparing the
+ *  query results against.
+ */
+static int has_prefix(void *db, gint enc, gint prefix) {
+  gint type = wg_get_encoded_type(db, prefix);
+  char *str, *pre;
 
-    query = wg_make_query(db, NULL, 0, &arg, 1);
-    if(!query) {
-      if(printlevel)
-        printf("wg_make_query() failed\n");
-      wg_free_query_param(db, arg.value);
-      return -4;
+  if(wg_get_encoded_type(db, enc) != type)
+    return 0;
+  if(type == WG_URITYPE) {
+    char *ns = wg_decode_uri_prefix(db, enc);
+    char *pns = wg_decode_uri_prefix(db, prefix);
+    if(strcmp(ns ? ns : "", pns ? pns : ""))
+      return 0;
+    str = wg_decode_uri(db, enc);
+    pre = wg_decode_uri(db, prefix);
+  } else {
+    str = wg_decode_str(db, enc);
+    pre = wg_decode_str(db, prefix);
+  }
+  return strlen(str) >= strlen(pre) && !memcmp(str, pre, strlen(pre));
+}
+
+/** Run a query with prefix conditions and compare it to a scan
+ *  Also checks that the query used an index on the given column
+ *  and that wg_find_record() returns the same rows, when there is
+ *  a single condition.
+ *  returns 0 if no errors found
+ *  returns -1 otherwise
+ */
+static int check_prefix_query(void *db, wg_query_arg *arglist, int argc,
+  int column, int printlevel) {
+  wg_query *query;
+  gint cnt = 0, expected = 0;
+  void *rec;
+  int i;
+
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    for(i=0; i<argc; i++) {
+      gint enc = wg_get_field(db, rec, arglist[i].column);
+      if(arglist[i].cond == WG_COND_PREFIX) {
+        if(!has_prefix(db, enc, arglist[i].value))
+          break;
+      } else {
+        gint cmp = WG_COMPARE(db, enc, arglist[i].value);
+        if((arglist[i].cond == WG_COND_LESSTHAN && cmp != WG_LESSTHAN) ||\
+          (arglist[i].cond == WG_COND_GTEQUAL && cmp == WG_LESSTHAN))
+          break;
+      }
     }
+    if(i == argc)
+      expected++;
+  }
 
-    while((rec = wg_fetch(db, query))) {
-      gint c2 = wg_decode_int(db, wg_get_field(db, rec, 1));
-      if(wg_set_field(db, rec, 1, wg_encode_int(db, c2 + 21))) {
+  query = wg_make_query(db, NULL, 0, arglist, argc);
+  if(!query) {
+    if(printlevel)
+      printf("wg_make_query() failed\n");
+    return -1;
+  }
+  while((rec = wg_fetch(db, query))) {
+    for(i=0; i<argc; i++) {
+      if(arglist[i].cond == WG_COND_PREFIX &&\
+        !has_prefix(db, wg_get_field(db, rec, arglist[i].column),
+        arglist[i].value)) {
         if(printlevel)
-          printf("update error, aborting.\n");
-        wg_free_query_param(db, arg.value);
-        return -5;
+          printf("query returned a row without the prefix\n");
+        wg_free_query(db, query);
+        return -1;
       }
     }
+    cnt++;
+  }
+  if(query->column != column) {
+    if(printlevel)
+      printf("query expected to use col%d used column %d\n",
+        column, (int) query->column);
+    wg_free_query(db, query);
+    return -1;
+  }
+  wg_free_query(db, query);
 
-    wg_free_query_param(db, arg.value);
+  if(cnt != expected) {
+    if(printlevel)
+      printf("prefix query with %d conditions returned %d rows, "\
+        "expected %d\n", argc, (int) cnt, (int) expected);
+    return -1;
   }
 
-  for(i=0; i<50; i++) {
-    gint c2 = 100 * i + 21;
-    wg_query *query;
-    wg_query_arg arg;
+  if(argc == 1) {
+    cnt = 0;
+    rec = NULL;
+    while((rec = wg_find_record(db, arglist[0].column, WG_COND_PREFIX,
+      arglist[0].value, rec)))
+      cnt++;
+    if(cnt != expected) {
+      if(printlevel)
+        printf("wg_find_record() found %d rows with the prefix, "\
+          "expected %d\n", (int) cnt, (int) expected);
+      return -1;
+    }
+  }
+  return 0;
+}
 
-    arg.column = 1;
-    arg.cond = WG_COND_EQUAL;
-    arg.value = wg_encode_query_param_int(db, c2);
+/** Test prefix conditions
+ *  Column 0 has strings (some with a language, some starting with
+ *  byte 0xff) and integers, with a T-tree index. Column 1 has URIs
+ *  in two namespaces and without one, with a B-tree index. Prefix
+ *  queries are compared to a scan before and after updates and
+ *  when the indexes are dropped.
+ */
+static gint wg_test_index11(void *db, int magnitude, int printlevel) {
+  const int dbsize = 100*magnitude;
+  char *ns[3] = { "http://a.org/", "http://b.org/", NULL };
+  char buf[40];
+  int i, j, column;
+  void *rec;
+  gint vals[11];
+  wg_query_arg arg[2];
 
-    query = wg_make_query(db, NULL, 0, &arg, 1);
-    if(!query) {
+  if(printlevel > 1) {
+    printf("------- Prefix query test: inserting data --------\n");
+  }
+
+  if(wg_create_index(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0) ||\
+    wg_create_index(db, 1, WG_INDEX_TYPE_BTREE, NULL, 0)) {
+    if(printlevel)
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
+  }
+
+  for(i=0; i<dbsize; i++) {
+    gint enc;
+    switch(i % 5) {
+      case 0:
+        snprintf(buf, 40, "item/%02d/%d", (i / 5) % 40, i);
+        enc = wg_encode_str(db, buf, (i % 10 ? NULL : "en"));
+        break;
+      case 1:
+        snprintf(buf, 40, "item/\xff%d", i);
+        enc = wg_encode_str(db, buf, NULL);
+        break;
+      case 2:
+        snprintf(buf, 40, "Item/%d", i);
+        enc = wg_encode_str(db, buf, NULL);
+        break;
+      case 3:
+        enc = wg_encode_int(db, i);
+        break;
+      default:
+        snprintf(buf, 40, "\xff\xff%d", i);
+        enc = wg_encode_str(db, buf, NULL);
+        break;
+    }
+    rec = wg_create_record(db, 3);
+    if(!rec || wg_set_field(db, rec, 0, enc)) {
       if(printlevel)
-        printf("wg_make_query() failed\n");
-      wg_free_query_param(db, arg.value);
-      return -4;
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
+    snprintf(buf, 40, "x%d", i);
+    if(wg_set_field(db, rec, 1, wg_encode_uri(db, buf, ns[i % 3])) ||\
+      wg_set_field(db, rec, 2, wg_encode_int(db, i))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
     }
+  }
 
-    while((rec = wg_fetch(db, query))) {
-      double c3 = wg_decode_double(db, wg_get_field(db, rec, 2));
-      if(wg_set_field(db, rec, 2, wg_encode_double(db, c3 - 77.42))) {
+  vals[0] = wg_encode_query_param_str(db, "item/1", NULL);
+  vals[1] = wg_encode_query_param_str(db, "item/", NULL);
+  vals[2] = wg_encode_query_param_str(db, "item/05", NULL);
+  vals[3] = wg_encode_query_param_str(db, "item/\xff", "en");
+  vals[4] = wg_encode_query_param_str(db, "\xff\xff", NULL);
+  vals[5] = wg_encode_query_param_str(db, "", NULL);
+  vals[6] = wg_encode_query_param_uri(db, "x1", ns[0]);
+  vals[7] = wg_encode_query_param_uri(db, "x2", NULL);
+  vals[8] = wg_encode_query_param_uri(db, "x", "http://c.org/");
+  vals[9] = wg_encode_query_param_uri(db, "x", "");
+  vals[10] = wg_encode_query_param_int(db, 1);
+  arg[0].column = 0;
+  arg[0].cond = WG_COND_PREFIX;
+  arg[1].column = 0;
+  arg[1].cond = WG_COND_LESSTHAN;
+  arg[1].value = vals[2];
+
+  for(j=0; j<3; j++) {
+    if(j == 1) {
+      if(printlevel > 1) {
+        printf("------- Prefix query test: updating data --------\n");
+      }
+      rec = wg_get_first_record(db);
+      while(rec) {
+        void *next = wg_get_next_record(db, rec);
+        i = wg_decode_int(db, wg_get_field(db, rec, 2));
+        if(!(i % 7)) {
+          if(wg_delete_record(db, rec)) {
+            if(printlevel)
+              fprintf(stderr, "delete error, aborting.\n");
+            return -1;
+          }
+        } else if(i % 7 == 1) {
+          snprintf(buf, 40, "item/1%d", i);
+          if(wg_set_field(db, rec, 0, wg_encode_str(db, buf, NULL)) ||\
+            wg_set_field(db, rec, 1, wg_encode_uri(db, buf, ns[0]))) {
+            if(printlevel)
+              fprintf(stderr, "update error, aborting.\n");
+            return -1;
+          }
+        }
+        rec = next;
+      }
+    } else if(j == 2) {
+      /* the same queries are answered by a scan */
+      if(wg_drop_index(db, wg_column_to_index_id(db, 0,
+          WG_INDEX_TYPE_TTREE, NULL, 0)) ||\
+        wg_drop_index(db, wg_column_to_index_id(db, 1,
+          WG_INDEX_TYPE_BTREE, NULL, 0))) {
         if(printlevel)
-          printf("update error, aborting.\n");
-        wg_free_query_param(db, arg.value);
-        return -5;
+          fprintf(stderr, "index drop failed.\n");
+        return -1;
       }
     }
+    column = (j < 2 ? 0 : -1);
 
-    wg_free_query_param(db, arg.value);
-  }
-
-  for(i=0; i<50; i++) {
-    double c3 = 10 * i - 77.42;
-    wg_query *query;
-    wg_query_arg arg;
-
-    arg.column = 2;
-    arg.cond = WG_COND_EQUAL;
-    arg.value = wg_encode_query_param_double(db, c3);
+    /* prefixes that are answered as a range, also with another
+     * condition on the same column */
+    for(i=0; i<4; i++) {
+      arg[0].value = vals[i == 2 ? 1 : i];
+      if(check_prefix_query(db, arg, (i == 2 ? 2 : 1), column,
+        printlevel)) {
+        if(printlevel)
+          fprintf(stderr, "string prefix query failed.\n");
+        return -2;
+      }
+    }
 
-    query = wg_make_query(db, NULL, 0, &arg, 1);
-    if(!query) {
+    /* prefixes without an upper bound are checked for each row */
+    arg[0].value = vals[4];
+    if(check_prefix_query(db, arg, 1, -1, printlevel)) {
       if(printlevel)
-        printf("wg_make_query() failed\n");
-      wg_free_query_param(db, arg.value);
-      return -4;
+        fprintf(stderr, "prefix query with 0xff bytes failed.\n");
+      return -2;
+    }
+    arg[0].value = vals[5];
+    if(check_prefix_query(db, arg, 1, -1, printlevel)) {
+      if(printlevel)
+        fprintf(stderr, "empty prefix query failed.\n");
+      return -2;
     }
 
-    while((rec = wg_fetch(db, query))) {
-      char c1[20];
-      int c1val = atol(wg_decode_str(db, wg_get_field(db, rec, 0)));
-
-      snprintf(c1, 19, "%d", c1val * 7);
-      c1[19] = '\0';
-
-      if(wg_set_field(db, rec, 0, wg_encode_str(db, c1, NULL))) {
+    /* URIs: the namespace must match, a missing one equals "" */
+    arg[0].column = 1;
+    for(i=6; i<10; i++) {
+      arg[0].value = vals[i];
+      if(check_prefix_query(db, arg, 1, (j < 2 ? 1 : -1), printlevel)) {
         if(printlevel)
-          printf("update error, aborting.\n");
-        wg_free_query_param(db, arg.value);
-        return -5;
+          fprintf(stderr, "URI prefix query failed.\n");
+        return -2;
       }
     }
+    arg[0].column = 0;
 
-    wg_free_query_param(db, arg.value);
+    arg[0].value = vals[10];
+    if(wg_make_query(db, NULL, 0, arg, 1)) {
+      if(printlevel)
+        fprintf(stderr, "prefix query with an integer succeeded.\n");
+      return -2;
+    }
+    if(wg_find_record(db, 0, WG_COND_PREFIX, vals[10], NULL)) {
+      if(printlevel)
+        fprintf(stderr, "wg_find_record() matched an integer prefix.\n");
+      return -2;
+    }
   }
 
-  if(printlevel > 1)
-    printf("------- Running read query tests --------\n");
+  for(i=0; i<11; i++)
+    wg_free_query_param(db, vals[i]);
 
-  /* Content check read queries, iteration 2 */
-  for(i=0; i<dbsize; i++) {
-    char buf[20];
-    snprintf(buf, 19, "%d", 1000 * i * 7);
-    buf[19] = '\0';
+  if(printlevel > 1) {
+    printf("------- Prefix query test: no errors found --------\n");
+  }
+  return 0;
+}
 
-    if(check_matching_rows(db, 0, WG_COND_EQUAL, (void *) buf,
-     WG_STRTYPE, 50*50, printlevel)) {
-      if(printlevel)
-        printf("content check col=0, i=%d failed.\n", i);
-      return -2;
-    }
+/** Compute the expression of a value for checking the results
+ *  The value is printed in buf (at least 256 bytes), the dates
+ *  as the number of days since 1970.
+ *  returns 0 if the expression has a value, 1 otherwise
+ */
+static int expr_test_value(void *db, gint enc, gint expr, char *buf) {
+  gint type = wg_get_encoded_type(db, enc);
+
+  if(expr == WG_EXPR_LOWER && type == WG_STRTYPE) {
+    char *str = wg_decode_str(db, enc);
+    int i;
+    for(i=0; str[i] && i<255; i++)
+      buf[i] = (str[i] >= 'A' && str[i] <= 'Z' ? str[i] - 'A' + 'a' : str[i]);
+    buf[i] = '\0';
+    return 0;
+  } else if(expr == WG_EXPR_STRLEN && type == WG_STRTYPE) {
+    snprintf(buf, 256, "%d", (int) strlen(wg_decode_str(db, enc)));
+    return 0;
+  } else if(expr == WG_EXPR_DATE && type == WG_INTTYPE) {
+    gint secs = wg_decode_int(db, enc);
+    snprintf(buf, 256, "%d", (int) (secs >= 0 ? secs / 86400 :\
+      -((-secs + 86399) / 86400)));
+    return 0;
   }
+  return 1;
+}
 
-  for(i=0; i<50; i++) {
-    gint val = 100 * i + 21;
-    if(check_matching_rows(db, 1, WG_COND_EQUAL, (void *) &val,
-     WG_INTTYPE, dbsize*50, printlevel)) {
+/** Run an equality query on an expression and compare it to a scan
+ *  expected is the expression value of the matching rows, as
+ *  printed by expr_test_value(). wg_find_record() must return the
+ *  same rows and an expression index, if there is one, must have
+ *  the same number of rows for the value.
+ *  returns 0 if no errors found
+ *  returns -1 otherwise
+ */
+static int check_expr_query(void *db, gint column, gint cond, gint value,
+  char *expected, int printlevel) {
+  gint expr = cond & WG_EXPR_MASK, index_id;
+  gint cnt = 0, count = 0;
+  char buf[256];
+  wg_query_arg arg;
+  wg_query *query;
+  void *rec;
+
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(!expr_test_value(db, wg_get_field(db, rec, column), expr, buf) &&\
+      !strcmp(buf, expected))
+      count++;
+  }
+
+  arg.column = column;
+  arg.cond = cond;
+  arg.value = value;
+  query = wg_make_query(db, NULL, 0, &arg, 1);
+  if(!query) {
+    if(printlevel)
+      printf("wg_make_query() failed\n");
+    return -1;
+  }
+  while((rec = wg_fetch(db, query))) {
+    if(expr_test_value(db, wg_get_field(db, rec, column), expr, buf) ||\
+      strcmp(buf, expected)) {
       if(printlevel)
-        printf("content check col=1, i=%d failed.\n", i);
-      return -2;
+        printf("query returned a row where the expression is not %s\n",
+          expected);
+      wg_free_query(db, query);
+      return -1;
     }
+    cnt++;
+  }
+  wg_free_query(db, query);
+  if(cnt != count) {
+    if(printlevel)
+      printf("query on expression %s returned %d rows, expected %d\n",
+        expected, (int) cnt, (int) count);
+    return -1;
   }
 
-  for(i=0; i<50; i++) {
-    double val = 10 * i - 77.42;
-    if(check_matching_rows(db, 2, WG_COND_EQUAL, (void *) &val,
-     WG_DOUBLETYPE, dbsize*50, printlevel)) {
+  cnt = 0;
+  rec = NULL;
+  while((rec = wg_find_record(db, column, cond, value, rec)))
+    cnt++;
+  if(cnt != count) {
+    if(printlevel)
+      printf("wg_find_record() found %d rows with expression %s, "\
+        "expected %d\n", (int) cnt, expected, (int) count);
+    return -1;
+  }
+
+  index_id = wg_expr_to_index_id(db, column, expr, NULL, 0);
+  if(index_id > 0) {
+    gint list = wg_search_hash(db, index_id, &value, 1);
+    cnt = 0;
+    while(list > 0) {
+      gcell *rec_cell = (gcell *) offsettoptr(db, list);
+      cnt++;
+      list = rec_cell->cdr;
+    }
+    if(cnt != count) {
       if(printlevel)
-        printf("content check col=2, i=%d failed.\n", i);
-      return -2;
+        printf("expression index has %d rows for %s, expected %d\n",
+          (int) cnt, expected, (int) count);
+      return -1;
     }
   }
+  return 0;
+}
 
-  if(printlevel > 1)
-    printf("------- Running delete queries --------\n");
+/** Test expression indexes
+ *  Column 0 has short strings in mixed case, long strings (some with
+ *  a language), integer timestamps (some before 1970) and doubles.
+ *  It has lower case, length and date indexes next to a plain hash
+ *  index. Queries on the expressions are compared to a scan before
+ *  and after updates and when the expression indexes are dropped.
+ */
+static gint wg_test_index12(void *db, int magnitude, int printlevel) {
+  const int dbsize = 100*magnitude;
+  char *forms[3] = { "user", "User", "USER" };
+  gint exprs[3] = { WG_EXPR_LOWER, WG_EXPR_STRLEN, WG_EXPR_DATE };
+  char *expected[8] = { "user3", "UsEr7", "nobody", "5", "110",
+    "1", "-1", "1000" };
+  char buf[256];
+  int i, j, k;
+  void *rec;
+  gint vals[8], cond[8], epoch, hash_id, cnt, count;
+  wg_query_arg arg;
+  wg_query *query;
+
+  if(printlevel > 1) {
+    printf("------- Expression index test: inserting data --------\n");
+  }
+
+  if(wg_create_index(db, 0, WG_INDEX_TYPE_HASH, NULL, 0) ||\
+    wg_create_expr_index(db, 0, WG_EXPR_LOWER, NULL, 0)) {
+    if(printlevel)
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
+  }
 
-  /* Delete query */
   for(i=0; i<dbsize; i++) {
-    wg_query *query;
-    wg_query_arg arglist[3];
-    char c1[20];
-    snprintf(c1, 19, "%d", 1000 * i * 7);
-    c1[19] = '\0';
+    gint enc;
+    switch(i % 4) {
+      case 0:
+        snprintf(buf, 256, "%s%d", forms[(i / 4) % 3], (i / 12) % 10);
+        enc = wg_encode_str(db, buf, NULL);
+        break;
+      case 1:
+        enc = wg_encode_int(db, (i % 8 == 1 ? -(gint) i * 3600 :\
+          (gint) i * 25200));
+        break;
+      case 2:
+        k = 10 + ((i / 4) % 50) * 4;
+        for(j=0; j<k; j++)
+          buf[j] = (j % 2 ? 'B' : 'a');
+        buf[k] = '\0';
+        enc = wg_encode_str(db, buf, (i % 8 == 2 ? "en" : NULL));
+        break;
+      default:
+        enc = wg_encode_double(db, (double) i);
+        break;
+    }
+    rec = wg_create_record(db, 2);
+    if(!rec || wg_set_field(db, rec, 0, enc) ||\
+      wg_set_field(db, rec, 1, wg_encode_int(db, i))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
+  }
 
-    arglist[0].column = 0;
-    arglist[0].cond = WG_COND_EQUAL;
-    arglist[0].value = wg_encode_query_param_str(db, c1, NULL);
-    arglist[1].column = 1;
-    arglist[1].cond = WG_COND_LESSTHAN;
-    arglist[1].value = wg_encode_query_param_int(db, 2021); /* 20 matching */
-    arglist[2].column = 2;
-    arglist[2].cond = WG_COND_GREATER;
-    arglist[2].value = wg_encode_query_param_double(db, 112.58); /* 30 matching */
+  /* these are built from the existing rows */
+  if(wg_create_expr_index(db, 0, WG_EXPR_STRLEN, NULL, 0) ||\
+    wg_create_expr_index(db, 0, WG_EXPR_DATE, NULL, 0)) {
+    if(printlevel)
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
+  }
+  if(!wg_create_expr_index(db, 0, 0x0f00, NULL, 0)) {
+    if(printlevel)
+      fprintf(stderr, "index with an invalid expression was created.\n");
+    return -1;
+  }
 
-    query = wg_make_query(db, NULL, 0, arglist, 3);
-    if(!query) {
+  /* the plain hash index is not mixed with the expression indexes */
+  hash_id = wg_column_to_index_id(db, 0, WG_INDEX_TYPE_HASH, NULL, 0);
+  if(hash_id < 1 || ((wg_index_header *) offsettoptr(db, hash_id))->expr) {
+    if(printlevel)
+      fprintf(stderr, "plain hash index not found.\n");
+    return -1;
+  }
+  for(k=0; k<3; k++) {
+    gint index_id = wg_expr_to_index_id(db, 0, exprs[k], NULL, 0);
+    if(index_id < 1 || index_id == hash_id) {
       if(printlevel)
-        printf("wg_make_query() failed\n");
-      wg_free_query_param(db, arglist[0].value);
-      wg_free_query_param(db, arglist[1].value);
-      wg_free_query_param(db, arglist[2].value);
-      return -4;
+        fprintf(stderr, "expression index not found.\n");
+      return -1;
     }
+  }
 
-    while((rec = wg_fetch(db, query))) {
-      if(wg_delete_record(db, rec)) {
-        if(printlevel)
-          printf("delete failed, aborting.\n");
-        wg_free_query_param(db, arglist[0].value);
-        wg_free_query_param(db, arglist[1].value);
-        wg_free_query_param(db, arglist[2].value);
-        return -6;
+  epoch = wg_ymd_to_date(db, 1970, 1, 1);
+  vals[0] = wg_encode_query_param_str(db, "user3", NULL);
+  vals[1] = wg_encode_query_param_str(db, "UsEr7", NULL); /* no rows */
+  vals[2] = wg_encode_query_param_str(db, "nobody", NULL);
+  vals[3] = wg_encode_query_param_int(db, 5);
+  vals[4] = wg_encode_query_param_int(db, 110);
+  vals[5] = wg_encode_query_param_date(db, epoch + 1);
+  vals[6] = wg_encode_query_param_date(db, epoch - 1);
+  vals[7] = wg_encode_query_param_date(db, epoch + 1000);
+  for(k=0; k<8; k++)
+    cond[k] = WG_COND_EQUAL | exprs[k < 3 ? 0 : (k < 5 ? 1 : 2)];
+
+  for(j=0; j<3; j++) {
+    if(j == 1) {
+      if(printlevel > 1) {
+        printf("------- Expression index test: updating data --------\n");
+      }
+      rec = wg_get_first_record(db);
+      while(rec) {
+        void *next = wg_get_next_record(db, rec);
+        i = wg_decode_int(db, wg_get_field(db, rec, 1));
+        if(!(i % 7)) {
+          if(wg_delete_record(db, rec)) {
+            if(printlevel)
+              fprintf(stderr, "delete error, aborting.\n");
+            return -1;
+          }
+        } else if(i % 7 == 1 || i % 7 == 2) {
+          gint enc = (i % 7 == 1 ? wg_encode_str(db, "USER3", NULL) :\
+            wg_encode_int(db, (gint) 86400 * 1000 + i));
+          if(wg_set_field(db, rec, 0, enc)) {
+            if(printlevel)
+              fprintf(stderr, "update error, aborting.\n");
+            return -1;
+          }
+        }
+        rec = next;
+      }
+    } else if(j == 2) {
+      /* the same queries are answered by a scan */
+      for(k=0; k<3; k++) {
+        if(wg_drop_index(db, wg_expr_to_index_id(db, 0, exprs[k],
+          NULL, 0))) {
+          if(printlevel)
+            fprintf(stderr, "index drop failed.\n");
+          return -1;
+        }
+        if(wg_expr_to_index_id(db, 0, exprs[k], NULL, 0) != -1) {
+          if(printlevel)
+            fprintf(stderr, "dropped expression index was found.\n");
+          return -1;
+        }
       }
     }
 
-    wg_free_query_param(db, arglist[0].value);
-    wg_free_query_param(db, arglist[1].value);
-    wg_free_query_param(db, arglist[2].value);
-  }
-
-  if(printlevel > 1)
-    printf("------- Checking row count --------\n");
+    for(k=0; k<8; k++) {
+      if(check_expr_query(db, 0, cond[k], vals[k], expected[k],
+        printlevel)) {
+        if(printlevel)
+          fprintf(stderr, "expression query failed.\n");
+        return -2;
+      }
+    }
+
+    /* the plain hash index has the exact values only */
+    count = 0;
+    for(rec = wg_get_first_record(db); rec;
+      rec = wg_get_next_record(db, rec)) {
+      if(WG_COMPARE(db, wg_get_field(db, rec, 0), vals[0]) == WG_EQUAL)
+        count++;
+    }
+    cnt = 0;
+    k = wg_search_hash(db, hash_id, &vals[0], 1);
+    while(k > 0) {
+      cnt++;
+      k = ((gcell *) offsettoptr(db, k))->cdr;
+    }
+    if(cnt != count) {
+      if(printlevel)
+        fprintf(stderr, "hash index has %d rows, expected %d.\n",
+          (int) cnt, (int) count);
+      return -2;
+    }
+
+    /* other conditions on an expression are checked for each row */
+    count = 0;
+    for(rec = wg_get_first_record(db); rec;
+      rec = wg_get_next_record(db, rec)) {
+      if(!expr_test_value(db, wg_get_field(db, rec, 0), WG_EXPR_STRLEN,
+        buf) && atoi(buf) > 100)
+        count++;
+    }
+    arg.column = 0;
+    arg.cond = WG_COND_GREATER | WG_EXPR_STRLEN;
+    arg.value = wg_encode_query_param_int(db, 100);
+    query = wg_make_query(db, NULL, 0, &arg, 1);
+    if(!query) {
+      if(printlevel)
+        fprintf(stderr, "range query on an expression failed.\n");
+      return -2;
+    }
+    cnt = 0;
+    while(wg_fetch(db, query))
+      cnt++;
+    wg_free_query(db, query);
+    wg_free_query_param(db, arg.value);
+    if(cnt != count) {
+      if(printlevel)
+        fprintf(stderr, "range query on an expression returned %d rows, "\
+          "expected %d.\n", (int) cnt, (int) count);
+      return -2;
+    }
+  }
+
+  for(i=0; i<8; i++)
+    wg_free_query_param(db, vals[i]);
+
+  if(printlevel > 1) {
+    printf("------- Expression index test: no errors found --------\n");
+  }
+  return 0;
+}
+
+/** Check if a test document matches a JSON path query
+ *  The documents are made by wg_test_index13(), q selects the query
+ *  from the table there.
+ */
+static int json_path_expected(int i, int q) {
+  char *cities[4] = { "Tallinn", "Tartu", "Narva", "Paide" };
+
+  switch(q) {
+    case 0: /* user.address.city = Tallinn */
+    case 1: /* user.address.city = Tartu */
+      if(i % 6 == 0)
+        return !strcmp(cities[i % 4], (q ? "Tartu" : "Tallinn")) || q == 1;
+      if(i % 11 == 0)
+        return 0;
+      return !strcmp(cities[i % 4], (q ? "Tartu" : "Tallinn"));
+    case 2: /* tags = t2 */
+      return (i % 3 == 2 || i % 3 + 1 == 2);
+    case 3: /* orders.item = x2 */
+      return (i % 5 == 2);
+    case 4: /* orders.item = y */
+      return 1;
+    case 5: /* user.address.zip = 3 */
+      return (i % 6 != 0 && i % 11 != 0 && i % 7 == 3);
+    default:
+      break;
+  }
+  return 0;
+}
+
+/** Get the "id" of a test document
+ *  returns -1 if the document has no id
+ */
+static int json_doc_id(void *db, void *doc) {
+  gint i, reclen = wg_get_record_len(db, doc);
+
+  for(i=0; i<reclen; i++) {
+    gint enc = wg_get_field(db, doc, i);
+    if(wg_get_encoded_type(db, enc) == WG_RECORDTYPE) {
+      void *kv = wg_decode_record(db, enc);
+      gint key = wg_get_field(db, kv, WG_SCHEMA_KEY_OFFSET);
+      if(wg_get_encoded_type(db, key) == WG_STRTYPE &&\
+        !strcmp(wg_decode_str(db, key), "id"))
+        return (int) wg_decode_int(db,
+          wg_get_field(db, kv, WG_SCHEMA_VALUE_OFFSET));
+    }
+  }
+  return -1;
+}
+
+/** Get the key-value pair of a key in a JSON object
+ *  returns NULL if the object does not have the key
+ */
+static void *json_object_kv(void *db, void *obj, char *key) {
+  gint i, reclen = wg_get_record_len(db, obj);
+
+  for(i=0; i<reclen; i++) {
+    gint enc = wg_get_field(db, obj, i);
+    if(wg_get_encoded_type(db, enc) == WG_RECORDTYPE) {
+      void *kv = wg_decode_record(db, enc);
+      gint k = wg_get_field(db, kv, WG_SCHEMA_KEY_OFFSET);
+      if(wg_get_encoded_type(db, k) == WG_STRTYPE &&\
+        !strcmp(wg_decode_str(db, k), key))
+        return kv;
+    }
+  }
+  return NULL;
+}
+
+/** Test JSON path indexes
+ *  Documents have nested objects, arrays of objects and arrays of
+ *  values, some have the key of a path at another level. Queries on
+ *  the paths are compared to the expected documents when the
+ *  documents are inserted before and after creating the indexes,
+ *  after deleting documents, after a document is changed in place
+ *  and when an index is dropped. Keys without the path prefix are
+ *  ordinary keys also when an index has the path.
+ */
+static gint wg_test_index13(void *db, int magnitude, int printlevel) {
+  const int docs = 10*magnitude;
+  char *cities[4] = { "Tallinn", "Tartu", "Narva", "Paide" };
+  char *paths[3] = { "user.address.city", "tags", "orders.item" };
+  char *qpath[6] = { "$.user.address.city", "$.user.address.city", "$.tags",
+    "$.orders.item", "$.orders.item", "$.user.address.zip" };
+  char *qval[6] = { "Tallinn", "Tartu", "t2", "x2", "y", NULL };
+  char buf[400], user[160];
+  int i, j, q, *alive, changed = -1;
+  void *rec;
+  wg_json_query_arg arg[2];
+  wg_query *query;
+
+  if(printlevel > 1) {
+    printf("------- JSON path index test: inserting data --------\n");
+  }
+
+  alive = (int *) malloc(docs * sizeof(int));
+  if(!alive) {
+    if(printlevel)
+      fprintf(stderr, "memory allocation failed, aborting.\n");
+    return -1;
+  }
+
+  for(i=0; i<docs; i++) {
+    if(i == docs/2) {
+      /* half of the documents are added by creating the index */
+      for(j=0; j<3; j++) {
+        if(wg_create_json_path_index(db, paths[j])) {
+          if(printlevel)
+            fprintf(stderr, "index creation failed, aborting.\n");
+          free(alive);
+          return -3;
+        }
+      }
+      if(wg_create_json_path_index(db, "user.address.zip")) {
+        if(printlevel)
+          fprintf(stderr, "index creation failed, aborting.\n");
+        free(alive);
+        return -3;
+      }
+    }
+    if(i % 6 == 0) {
+      snprintf(user, 160, "[{\"address\": {\"city\": \"%s\"}}, "\
+        "{\"address\": {\"city\": \"Tartu\"}}]", cities[i % 4]);
+    } else if(i % 11 == 0) {
+      snprintf(user, 160, "{\"name\": \"u%d\", \"address\": \"none\"}",
+        i % 10);
+    } else {
+      snprintf(user, 160, "{\"name\": \"u%d\", \"address\": "\
+        "{\"city\": \"%s\", \"zip\": %d}}", i % 10, cities[i % 4], i % 7);
+    }
+    snprintf(buf, 400, "{\"id\": %d, \"user\": %s, \"other\": "\
+      "{\"city\": \"Tallinn\", \"address\": {\"city\": \"Tartu\"}}, "\
+      "\"tags\": [\"t%d\", \"t%d\"], "\
+      "\"orders\": [{\"item\": \"x%d\"}, {\"item\": \"y\"}]}",
+      i, user, i % 3, i % 3 + 1, i % 5);
+    if(wg_parse_json_document(db, buf, NULL)) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      free(alive);
+      return -1;
+    }
+    alive[i] = 1;
+  }
+
+  /* invalid and duplicate paths */
+  if(!wg_create_json_path_index(db, "") ||\
+    !wg_create_json_path_index(db, "a..b") ||\
+    !wg_create_json_path_index(db, ".a") ||\
+    !wg_create_json_path_index(db, "a.") ||\
+    !wg_create_json_path_index(db, paths[0])) {
+    if(printlevel)
+      fprintf(stderr, "invalid JSON path index was created.\n");
+    free(alive);
+    return -1;
+  }
+
+  for(j=0; j<3; j++) {
+    if(j == 1) {
+      if(printlevel > 1) {
+        printf("------- JSON path index test: deleting data --------\n");
+      }
+      rec = wg_get_first_record(db);
+      while(rec) {
+        void *next = wg_get_next_record(db, rec);
+        if(is_schema_document(rec)) {
+          i = json_doc_id(db, rec);
+          if(i % 5 == 0 || i % 5 == 1) {
+            /* skip the records of the document */
+            while(next && !is_schema_document(next))
+              next = wg_get_next_record(db, next);
+            if(i % 5 == 0 ? wg_delete_document(db, rec) :\
+              wg_delete_record(db, rec)) {
+              if(printlevel)
+                fprintf(stderr, "delete error, aborting.\n");
+              free(alive);
+              return -1;
+            }
+            alive[i] = 0;
+          }
+        }
+        rec = next;
+      }
+
+      /* the index still has a document changed in place by its old
+       * value, the query must check it again */
+      for(changed=0; changed<docs; changed++) {
+        if(alive[changed] && changed % 6 && changed % 11 &&\
+          changed % 4 == 0)
+          break;
+      }
+      for(rec = wg_get_first_record(db); rec;
+        rec = wg_get_next_record(db, rec)) {
+        if(is_schema_document(rec) && json_doc_id(db, rec) == changed)
+          break;
+      }
+      if(rec && (rec = json_object_kv(db, rec, "user")))
+        rec = json_object_kv(db, wg_decode_record(db,
+          wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET)), "address");
+      if(rec && (rec = json_object_kv(db, wg_decode_record(db,
+          wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET)), "city"))) {
+        if(wg_set_field(db, rec, WG_SCHEMA_VALUE_OFFSET,
+          wg_encode_str(db, "Paide", NULL)))
+          rec = NULL;
+      }
+      if(!rec) {
+        if(printlevel)
+          fprintf(stderr, "failed to change document %d.\n", changed);
+        free(alive);
+        return -1;
+      }
+    } else if(j == 2) {
+      if(wg_drop_index(db, wg_json_path_to_index_id(db, paths[1])) ||\
+        wg_json_path_to_index_id(db, paths[1]) != -1) {
+        if(printlevel)
+          fprintf(stderr, "index drop failed.\n");
+        free(alive);
+        return -1;
+      }
+    }
+
+    for(q=0; q<6; q++) {
+      int cnt = 0, expected = 0;
+
+      /* without the index, "$.tags" gives the same documents */
+      for(i=0; i<docs; i++) {
+        if(alive[i] && json_path_expected(i, q) && !(i == changed && !q))
+          expected++;
+      }
+      arg[0].key = wg_encode_query_param_str(db, qpath[q], NULL);
+      arg[0].value = (qval[q] ? wg_encode_query_param_str(db, qval[q], NULL) :\
+        wg_encode_query_param_int(db, 3));
+      query = wg_make_json_query(db, arg, 1);
+      if(!query) {
+        if(printlevel)
+          fprintf(stderr, "JSON path query failed.\n");
+        free(alive);
+        return -2;
+      }
+      while((rec = wg_fetch(db, query))) {
+        i = json_doc_id(db, rec);
+        if(i < 0 || i >= docs || !alive[i] || !json_path_expected(i, q) ||\
+          (i == changed && !q)) {
+          if(printlevel)
+            fprintf(stderr, "JSON path query %d returned document %d.\n",
+              q, i);
+          wg_free_query(db, query);
+          free(alive);
+          return -2;
+        }
+        cnt++;
+      }
+      wg_free_query(db, query);
+      wg_free_query_param(db, arg[0].key);
+      wg_free_query_param(db, arg[0].value);
+      if(cnt != expected) {
+        if(printlevel)
+          fprintf(stderr, "JSON path query %d returned %d documents, "\
+            "expected %d.\n", q, cnt, expected);
+        free(alive);
+        return -2;
+      }
+    }
+
+    /* ordinary keys: the path of an index matches nothing, a key
+     * matches at any depth. Checked before the deletes, a scan does
+     * not expect the records of a deleted top-level record. */
+    for(q=0; q<2 && !j; q++) {
+      int cnt = 0, expected = 0;
+
+      for(i=0; i<docs && q; i++) {
+        if(alive[i])
+          expected++;
+      }
+      arg[0].key = wg_encode_query_param_str(db, (q ? "city" : paths[0]),
+        NULL);
+      arg[0].value = wg_encode_query_param_str(db, "Tallinn", NULL);
+      query = wg_make_json_query(db, arg, 1);
+      wg_free_query_param(db, arg[0].key);
+      wg_free_query_param(db, arg[0].value);
+      if(!query) {
+        if(printlevel)
+          fprintf(stderr, "JSON query failed.\n");
+        free(alive);
+        return -2;
+      }
+      while(wg_fetch(db, query))
+        cnt++;
+      wg_free_query(db, query);
+      if(cnt != expected) {
+        if(printlevel)
+          fprintf(stderr, "JSON query on an ordinary key returned %d "\
+            "documents, expected %d.\n", cnt, expected);
+        free(alive);
+        return -2;
+      }
+    }
+
+    /* two paths, the documents must have both values */
+    arg[0].key = wg_encode_query_param_str(db, qpath[1], NULL);
+    arg[0].value = wg_encode_query_param_str(db, "Tartu", NULL);
+    arg[1].key = wg_encode_query_param_str(db, qpath[3], NULL);
+    arg[1].value = wg_encode_query_param_str(db, "x2", NULL);
+    query = wg_make_json_query(db, arg, 2);
+    if(query) {
+      int cnt = 0, expected = 0;
+      for(i=0; i<docs; i++) {
+        if(alive[i] && json_path_expected(i, 1) && json_path_expected(i, 3))
+          expected++;
+      }
+      while(wg_fetch(db, query))
+        cnt++;
+      wg_free_query(db, query);
+      if(cnt != expected) {
+        if(printlevel)
+          fprintf(stderr, "JSON query on two paths returned %d documents, "\
+            "expected %d.\n", cnt, expected);
+        free(alive);
+        return -2;
+      }
+    }
+    for(i=0; i<2; i++) {
+      wg_free_query_param(db, arg[i].key);
+      wg_free_query_param(db, arg[i].value);
+    }
+    if(!query) {
+      if(printlevel)
+        fprintf(stderr, "JSON query on two paths failed.\n");
+      free(alive);
+      return -2;
+    }
+  }
+
+  free(alive);
+  if(printlevel > 1) {
+    printf("------- JSON path index test: no errors found --------\n");
+  }
+  return 0;
+}
+
+/** Test Bloom filters of hash indexes
+ *  Rows have even keys, so the odd keys are missing from the
+ *  index. Searches must find all present keys (the filter has no
+ *  false negatives, also after it has grown and after rows are
+ *  deleted), and most missing keys must be rejected by the filter.
+ */
+static gint wg_test_index14(void *db, int magnitude, int printlevel) {
+  const int dbsize = 100*magnitude;
+  int i, cnt;
+  void *rec;
+  gint index_id, ttree_id, lookups, negatives, fp, expected, col;
+
+  if(printlevel > 1) {
+    printf("------- Bloom filter test: inserting data --------\n");
+  }
+
+  /* small hash and filter, they must grow while the rows are added */
+  col = 0;
+  if(wg_create_multi_index_sized(db, &col, 1, WG_INDEX_TYPE_HASH,
+      NULL, 0, 64) ||\
+    wg_create_index(db, 1, WG_INDEX_TYPE_HASH, NULL, 0) ||\
+    wg_create_index(db, 2, WG_INDEX_TYPE_TTREE, NULL, 0)) {
+    if(printlevel)
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
+  }
+  index_id = wg_column_to_index_id(db, 0, WG_INDEX_TYPE_HASH, NULL, 0);
+  ttree_id = wg_column_to_index_id(db, 2, WG_INDEX_TYPE_TTREE, NULL, 0);
+
+  if(wg_create_bloom_filter(db, index_id, 8) ||\
+    wg_create_bloom_filter(db, wg_column_to_index_id(db, 1,
+      WG_INDEX_TYPE_HASH, NULL, 0), 0)) {
+    if(printlevel)
+      fprintf(stderr, "Bloom filter creation failed, aborting.\n");
+    return -3;
+  }
+  if(!wg_create_bloom_filter(db, ttree_id, 0)) {
+    if(printlevel)
+      fprintf(stderr, "Bloom filter created on a T-tree index.\n");
+    return -1;
+  }
+
+  for(i=0; i<dbsize; i++) {
+    rec = wg_create_record(db, 3);
+    if(!rec) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
+    wg_set_field(db, rec, 0, wg_encode_int(db, 2*i));
+    wg_set_field(db, rec, 1, wg_encode_int(db, i % 7));
+    wg_set_field(db, rec, 2, wg_encode_int(db, i));
+  }
+
+  for(i=0; i<2*dbsize; i++) {
+    rec = wg_find_record_int(db, 0, WG_COND_EQUAL, i, NULL);
+    if((i % 2 == 0) != (rec != NULL) ||\
+      (rec && wg_decode_int(db, wg_get_field(db, rec, 0)) != i)) {
+      if(printlevel)
+        fprintf(stderr, "key %d: wrong result from the hash index.\n", i);
+      return -2;
+    }
+  }
+
+  if(wg_get_bloom_stats(db, index_id, &lookups, &negatives, &fp) ||\
+    lookups != 2*dbsize || negatives + fp != dbsize) {
+    if(printlevel)
+      fprintf(stderr, "Bloom filter statistics are invalid.\n");
+    return -2;
+  }
+  if(fp > dbsize / 20) {
+    if(printlevel)
+      fprintf(stderr, "Bloom filter passed %d missing keys of %d.\n",
+        (int) fp, dbsize);
+    return -2;
+  }
+
+  /* duplicate keys: all rows are found through the filter */
+  for(i=0; i<8; i++) {
+    cnt = 0;
+    rec = wg_find_record_int(db, 1, WG_COND_EQUAL, i, NULL);
+    while(rec) {
+      cnt++;
+      rec = wg_find_record_int(db, 1, WG_COND_EQUAL, i, rec);
+    }
+    expected = (i < 7 ? (dbsize - i + 6) / 7 : 0);
+    if(cnt != expected) {
+      if(printlevel)
+        fprintf(stderr, "value %d: %d rows found, expected %d.\n",
+          i, cnt, (int) expected);
+      return -2;
+    }
+  }
+
+  if(printlevel > 1) {
+    printf("------- Bloom filter test: deleting data --------\n");
+  }
+
+  rec = wg_get_first_record(db);
+  while(rec) {
+    void *next = wg_get_next_record(db, rec);
+    if(wg_decode_int(db, wg_get_field(db, rec, 2)) % 3 == 0) {
+      if(wg_delete_record(db, rec)) {
+        if(printlevel)
+          fprintf(stderr, "delete error, aborting.\n");
+        return -1;
+      }
+    }
+    rec = next;
+  }
+
+  /* the deleted keys remain in the filter until it is rebuilt */
+  for(i=0; i<2; i++) {
+    int j;
+    if(i && wg_create_bloom_filter(db, index_id, 0)) {
+      if(printlevel)
+        fprintf(stderr, "Bloom filter rebuild failed.\n");
+      return -3;
+    }
+    for(j=0; j<dbsize; j++) {
+      rec = wg_find_record_int(db, 0, WG_COND_EQUAL, 2*j, NULL);
+      if((j % 3 != 0) != (rec != NULL)) {
+        if(printlevel)
+          fprintf(stderr, "key %d: wrong result after delete.\n", 2*j);
+        return -2;
+      }
+    }
+  }
+  if(wg_get_bloom_stats(db, index_id, &lookups, &negatives, &fp) ||\
+    lookups != dbsize || negatives + fp != (dbsize + 2) / 3 ||\
+    fp > dbsize / 20) {
+    if(printlevel)
+      fprintf(stderr, "Bloom filter statistics are invalid after "\
+        "rebuild.\n");
+    return -2;
+  }
+
+  /* without the filter, the index is searched as before */
+  if(wg_drop_bloom_filter(db, index_id) ||\
+    !wg_get_bloom_stats(db, index_id, &lookups, &negatives, &fp) ||\
+    !wg_drop_bloom_filter(db, index_id)) {
+    if(printlevel)
+      fprintf(stderr, "Bloom filter drop failed.\n");
+    return -2;
+  }
+  if(!wg_find_record_int(db, 0, WG_COND_EQUAL, 2, NULL) ||\
+    wg_find_record_int(db, 0, WG_COND_EQUAL, 3, NULL)) {
+    if(printlevel)
+      fprintf(stderr, "hash index search failed without the filter.\n");
+    return -2;
+  }
+
+  /* dropping the index releases the filter of the other index */
+  if(wg_drop_index(db, wg_column_to_index_id(db, 1,
+    WG_INDEX_TYPE_HASH, NULL, 0))) {
+    if(printlevel)
+      fprintf(stderr, "index drop failed.\n");
+    return -2;
+  }
+
+  if(printlevel > 1) {
+    printf("------- Bloom filter test: no errors found --------\n");
+  }
+  return 0;
+}
+
+/** Test deferred index updates
+ *  Each row is updated several times, including both columns of a
+ *  multi-column index, while the index updates are deferred. Queries
+ *  made between the updates must see the new values, and the indexes
+ *  must be complete and in order after the updates are applied, also
+ *  when rows are deleted in between.
+ */
+static gint wg_test_index15(void *db, int magnitude, int printlevel) {
+  const int dbsize = 100*magnitude;
+  int i, j, rows, last = 0;
+  void *rec;
+  gint cols[2], ttree_id, btree_id, hash_id, lock;
+#ifdef USE_INDEX_TEMPLATE
+  gint matchrec[4];
+  gint mindex_id;
+  int mrows;
+#endif
+
+  if(printlevel > 1) {
+    printf("------- Deferred index update test: inserting data --------\n");
+  }
+
+#ifdef USE_INDEX_TEMPLATE
+  /* rows enter and leave the template index when column 3 changes.
+   * It is created first, so that the match record is not indexed. */
+  for(i=0; i<4; i++)
+    matchrec[i] = wg_encode_var(db, 0);
+  matchrec[3] = wg_encode_int(db, 1);
+  if(wg_create_index(db, 0, WG_INDEX_TYPE_BTREE, matchrec, 4)) {
+    if(printlevel)
+      fprintf(stderr, "template index creation failed, aborting.\n");
+    return -3;
+  }
+  mindex_id = wg_column_to_index_id(db, 0, WG_INDEX_TYPE_BTREE,
+    matchrec, 4);
+#endif
+
+  cols[0] = 1;
+  cols[1] = 2;
+  if(wg_create_index(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0) ||\
+    wg_create_index(db, 1, WG_INDEX_TYPE_BTREE, NULL, 0) ||\
+    wg_create_multi_index(db, cols, 2, WG_INDEX_TYPE_HASH, NULL, 0)) {
+    if(printlevel)
+      fprintf(stderr, "index creation failed, aborting.\n");
+    return -3;
+  }
+  ttree_id = wg_column_to_index_id(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0);
+  btree_id = wg_column_to_index_id(db, 1, WG_INDEX_TYPE_BTREE, NULL, 0);
+  hash_id = wg_multi_column_to_index_id(db, cols, 2,
+    WG_INDEX_TYPE_HASH, NULL, 0);
+
+  for(i=0; i<dbsize; i++) {
+    rec = wg_create_record(db, 4);
+    if(!rec || wg_set_field(db, rec, 0, wg_encode_int(db, i)) ||\
+      wg_set_field(db, rec, 1, wg_encode_int(db, i % 100)) ||\
+      wg_set_field(db, rec, 2, wg_encode_int(db, i % 7)) ||\
+      wg_set_field(db, rec, 3, wg_encode_int(db, i % 2))) {
+      if(printlevel)
+        fprintf(stderr, "insert error, aborting.\n");
+      return -1;
+    }
+  }
+
+  if(printlevel > 1) {
+    printf("------- Deferred index update test: updating data --------\n");
+  }
+
+  if(wg_defer_index_updates(db, 1)) {
+    if(printlevel)
+      fprintf(stderr, "failed to defer the index updates, aborting.\n");
+    return -3;
+  }
+
+  rec = wg_get_first_record(db);
+  for(i=0; rec; i++) {
+    for(j=0; j<3; j++) {
+      if(wg_set_field(db, rec, 1, wg_encode_int(db, (i*7 + j) % 1000))) {
+        if(printlevel)
+          fprintf(stderr, "update error, aborting.\n");
+        return -1;
+      }
+    }
+    /* the new keys are in the reverse order of the rows */
+    if(wg_set_field(db, rec, 0, wg_encode_int(db, 2*dbsize - i)) ||\
+      wg_set_field(db, rec, 2, wg_encode_int(db, i % 5)) ||\
+      wg_set_field(db, rec, 3, wg_encode_int(db, (i % 3 == 0)))) {
+      if(printlevel)
+        fprintf(stderr, "update error, aborting.\n");
+      return -1;
+    }
+    if(i % 500 == 0) {
+      /* a search sees the new value and not the old one */
+      if(wg_find_record_int(db, 0, WG_COND_EQUAL, 2*dbsize - i, NULL) !=\
+          rec ||\
+        wg_find_record_int(db, 0, WG_COND_EQUAL, i, NULL)) {
+        if(printlevel)
+          fprintf(stderr, "row %d: search did not see the update.\n", i);
+        return -2;
+      }
+      last = i;
+    }
+    else if(i % 500 == 250) {
+      /* so does the T-tree search function */
+      if(wg_search_ttree_index(db, ttree_id,
+          wg_encode_int(db, 2*dbsize - i)) <= 0 ||\
+        wg_search_ttree_index(db, ttree_id, wg_encode_int(db, i))) {
+        if(printlevel)
+          fprintf(stderr, "row %d: T-tree search did not see the update.\n",
+            i);
+        return -2;
+      }
+      last = i;
+    }
+    rec = wg_get_next_record(db, rec);
+  }
+
+  /* the rows updated after the last search are not in the index yet,
+   * the index counts them as missing */
+  if(wg_get_index_pending(db, btree_id) != dbsize - last - 1) {
+    if(printlevel)
+      fprintf(stderr, "wrong count of missing rows during the updates.\n");
+    return -2;
+  }
+  if(validate_btree(db, btree_id, last + 1, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "B-tree index is invalid during the updates.\n");
+    return -2;
+  }
+
+  if(printlevel > 1) {
+    printf("------- Deferred index update test: deleting data --------\n");
+  }
+
+  rec = wg_get_first_record(db);
+  for(i=0; rec; i++) {
+    void *next = wg_get_next_record(db, rec);
+    if(wg_set_field(db, rec, 2, wg_encode_int(db, i % 11))) {
+      if(printlevel)
+        fprintf(stderr, "update error, aborting.\n");
+      return -1;
+    }
+    if(i % 10 == 0 && wg_delete_record(db, rec)) {
+      if(printlevel)
+        fprintf(stderr, "delete error, aborting.\n");
+      return -1;
+    }
+    rec = next;
+  }
+  rows = dbsize - (dbsize + 9) / 10;
+
+  if(wg_flush_index_updates(db)) {
+    if(printlevel)
+      fprintf(stderr, "failed to apply the index updates.\n");
+    return -2;
+  }
+  if(validate_index(db, wg_get_first_record(db), rows, 0, printlevel) ||\
+    validate_tnode_search(db, 0, printlevel) ||\
+    validate_btree(db, btree_id, rows, printlevel) ||\
+    validate_mc_index(db, wg_get_first_record(db), rows, hash_id,
+      cols, 2, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "index is invalid after the updates.\n");
+    return -2;
+  }
+#ifdef USE_INDEX_TEMPLATE
+  mrows = 0;
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    if(wg_decode_int(db, wg_get_field(db, rec, 3)) == 1)
+      mrows++;
+  }
+  if(validate_btree(db, mindex_id, mrows, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "template index is invalid after the updates.\n");
+    return -2;
+  }
+#endif
+
+  /* the updates are applied when the write lock is released */
+  rec = wg_get_first_record(db);
+  if(!(lock = wg_start_write(db))) {
+    if(printlevel)
+      fprintf(stderr, "failed to get the write lock.\n");
+    return -2;
+  }
+  if(wg_set_field(db, rec, 1, wg_encode_int(db, 4000)) ||\
+    wg_end_write(db, lock) <= 0 ||\
+    validate_btree(db, btree_id, rows, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "index is invalid after the write transaction.\n");
+    return -2;
+  }
+
+  /* after deferring is turned off, the indexes are updated at once */
+  if(wg_defer_index_updates(db, 0) ||\
+    wg_set_field(db, rec, 1, wg_encode_int(db, 5000)) ||\
+    validate_btree(db, btree_id, rows, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "index is invalid after deferring was turned off.\n");
+    return -2;
+  }
+  if(wg_get_index_pending(db, ttree_id) || wg_get_index_pending(db, btree_id)\
+    || wg_get_index_pending(db, hash_id)) {
+    if(printlevel)
+      fprintf(stderr, "rows still missing after the updates.\n");
+    return -2;
+  }
+
+  /* updates that are lost (as if the process had exited) leave the
+   * index marked, it is not used until it is created again */
+  if(wg_defer_index_updates(db, 1) ||\
+    wg_set_field(db, rec, 0, wg_encode_int(db, 6000))) {
+    if(printlevel)
+      fprintf(stderr, "update error, aborting.\n");
+    return -1;
+  }
+  wg_index_free_delta(db);
+  if(wg_get_index_pending(db, ttree_id) != 1 ||\
+    wg_search_ttree_index(db, ttree_id, wg_encode_int(db, 6000)) != -1) {
+    if(printlevel)
+      fprintf(stderr, "lost updates were not detected.\n");
+    return -2;
+  }
+  if(wg_find_record_int(db, 0, WG_COND_EQUAL, 6000, NULL) != rec) {
+    if(printlevel)
+      fprintf(stderr, "search used an index with missing rows.\n");
+    return -2;
+  }
+  if(wg_drop_index(db, ttree_id) ||\
+    wg_create_index(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0)) {
+    if(printlevel)
+      fprintf(stderr, "index re-creation failed.\n");
+    return -2;
+  }
+  ttree_id = wg_column_to_index_id(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0);
+  if(wg_get_index_pending(db, ttree_id) ||\
+    validate_index(db, wg_get_first_record(db), rows, 0, printlevel)) {
+    if(printlevel)
+      fprintf(stderr, "index is invalid after it was created again.\n");
+    return -2;
+  }
+
+  if(printlevel > 1) {
+    printf("------- Deferred index update test: no errors found --------\n");
+  }
+  return 0;
+}
+
+/** Validate a T-tree index
+ *  1. validates a set of rows starting from *rec.
+ *  2. checks tree balance
+ *  3. checks tree min/max values
+ *  returns 0 if no errors found
+ *  returns -1 if value was not indexed
+ *  returns -2 if there was another error
+ */
+static int validate_index(void *db, void *rec, int rows, int column,
+  int printlevel) {
+  gint index_id = wg_column_to_index_id(db, column,
+    WG_INDEX_TYPE_TTREE, NULL, 0);
+  gint tnode_offset, prevmax = 0, prevnode = 0;
+  wg_index_header *hdr;
+
+  if(index_id == -1)
+    return -2;
+
+  /* Check if all values are indexed */
+  while(rec && rows) {
+    if(wg_get_record_len(db, rec) > column) {
+      gint val = wg_get_field(db, rec, column);
+      if(wg_search_ttree_index(db, index_id, val) < 1) {
+        if(printlevel) {
+          printf("missing: %d\n", (int) val);
+        }
+        return -1;
+      }
+    }
+    rec = wg_get_next_record(db, rec);
+    rows--;
+  }
+
+  hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+  if(((struct wg_tnode *)(offsettoptr(db,
+    TTREE_ROOT_NODE(hdr))))->parent_offset != 0) {
+    if(printlevel)
+      printf("root node parent offset is not 0\n");
+    return -2;
+  }
+#ifdef TTREE_CHAINED_NODES
+  if(TTREE_MIN_NODE(hdr) == 0) {
+    if(printlevel)
+      printf("min node offset is 0\n");
+    return -2;
+  }
+  if(TTREE_MAX_NODE(hdr) == 0) {
+    if(printlevel)
+      printf("max node offset is 0\n");
+    return -2;
+  }
+#endif
+
+#ifdef TTREE_CHAINED_NODES
+  tnode_offset = TTREE_MIN_NODE(hdr);
+#else
+  tnode_offset = wg_ttree_find_lub_node(db, TTREE_ROOT_NODE(hdr));
+#endif
+  while(tnode_offset) {
+    int diff;
+    gint minval, maxval;
+#ifdef TTREE_NODE_KEYS
+    int i;
+#endif
+    struct wg_tnode *node = (struct wg_tnode *) offsettoptr(db, tnode_offset);
+
+    /* Check index tree balance */
+    diff = node->left_subtree_height - node->right_subtree_height;
+    if(diff < -1 || diff > 1)
+      return -2;
+
+    /* Check min/max values */
+    minval = wg_get_field(db,
+      offsettoptr(db, node->array_of_values[0]), column);
+    maxval = wg_get_field(db,
+      offsettoptr(db, node->array_of_values[node->number_of_elements - 1]),
+      column);
+    if(minval != node->current_min) {
+      if(printlevel) {
+        printf("current_min invalid: %d is: %d should be: %d\n",
+          (int) tnode_offset, (int) node->current_min,
+          (int) minval);
+      }
+      return -2;
+    }
+    if(maxval != node->current_max) {
+      if(printlevel) {
+        printf("current_max invalid: %d is: %d should be: %d\n",
+          (int) tnode_offset, (int) node->current_max,
+          (int) maxval);
+      }
+      return -2;
+    }
+
+#ifdef TTREE_NODE_KEYS
+    /* Check the keys stored in the node. The search inside the
+     * node is checked by validate_tnode_search(). */
+    for(i=0; i<node->number_of_elements; i++) {
+      gint val = wg_get_field(db,
+        offsettoptr(db, node->array_of_values[i]), column);
+      if(node->keys[i] != val) {
+        if(printlevel) {
+          printf("key %d invalid in node %d\n", i, (int) tnode_offset);
+        }
+        return -2;
+      }
+    }
+#endif
+
+    /* Check the key order between nodes */
+    if(prevnode && WG_COMPARE(db, prevmax, minval) == WG_GREATER) {
+      if(printlevel) {
+        printf("node out of order: %d\n", (int) tnode_offset);
+      }
+      return -2;
+    }
+    prevmax = maxval;
+    prevnode = tnode_offset;
+
+    tnode_offset = TNODE_SUCCESSOR(db, node);
+  }
+
+  return 0;
+}
+
+/** Check the search inside the nodes of a T-tree index
+ *  Every key of every node and its neighbours are searched in the
+ *  node and the result is compared to a linear scan of the keys.
+ *  This is slower than validate_index(), so the tests run it at the
+ *  end of each phase rather than after every update.
+ *  returns 0 if no errors found
+ *  returns -2 if there was an error
+ */
+static int validate_tnode_search(void *db, int column, int printlevel) {
+#ifdef TTREE_NODE_KEYS
+  gint index_id = wg_column_to_index_id(db, column,
+    WG_INDEX_TYPE_TTREE, NULL, 0);
+  gint tnode_offset;
+  wg_index_header *hdr;
+
+  if(index_id == -1)
+    return -2;
+  hdr = (wg_index_header *) offsettoptr(db, index_id);
+
+#ifdef TTREE_CHAINED_NODES
+  tnode_offset = TTREE_MIN_NODE(hdr);
+#else
+  tnode_offset = wg_ttree_find_lub_node(db, TTREE_ROOT_NODE(hdr));
+#endif
+  while(tnode_offset) {
+    struct wg_tnode *node = (struct wg_tnode *) offsettoptr(db, tnode_offset);
+    int i;
+
+    for(i=0; i<3*node->number_of_elements; i++) {
+      gint key = node->keys[i/3], first = -1, last = -1;
+      int j;
+      if(i%3 == 1 && wg_get_encoded_type(db, key) == WG_INTTYPE)
+        key = wg_encode_int(db, wg_decode_int(db, key) - 1);
+      else if(i%3 == 2 && wg_get_encoded_type(db, key) == WG_INTTYPE)
+        key = wg_encode_int(db, wg_decode_int(db, key) + 1);
+      for(j=0; j<node->number_of_elements; j++) {
+        gint cr = WG_COMPARE(db, node->keys[j], key);
+        if(first < 0 && cr != WG_LESSTHAN)
+          first = j;
+        if(cr != WG_GREATER)
+          last = j;
+      }
+      if(wg_search_tnode_first(db, tnode_offset, key, column) != first ||\
+        wg_search_tnode_last(db, tnode_offset, key, column) != last) {
+        if(printlevel) {
+          printf("search in node %d failed\n", (int) tnode_offset);
+        }
+        return -2;
+      }
+    }
+    tnode_offset = TNODE_SUCCESSOR(db, node);
+  }
+#endif
+  return 0;
+}
+
+/** Validate a multi-column index
+ *  validates a set of rows starting from *rec.
+ *  uses the index_id provided (to facilitate separate testing of
+ *   multiple indexes on the same column set).
+ *
+ *  returns 0 if no errors found
+ *  returns -1 if value was not indexed or was indexed and shouldn't have been
+ *  returns -2 if there was another error
+ */
+static int validate_mc_index(void *db, void *rec, size_t rows, gint index_id,
+  gint *columns, size_t col_count, int printlevel) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  gint max_col = -1;
+  size_t i;
+
+  for(i=0; i<col_count; i++) {
+    if(columns[i] > max_col) {
+      max_col = columns[i];
+    }
+  }
+
+  if(hdr->type != WG_INDEX_TYPE_HASH_JSON &&
+    hdr->type != WG_INDEX_TYPE_HASH) {
+  }
+
+  /* Check if all values are indexed */
+  while(rec && rows) {
+    if(wg_get_record_len(db, rec) > max_col) {
+      gint values[MAX_INDEX_FIELDS];
+      gint reclist_offset;
+      int found = 0;
+      for(i=0; i<col_count; i++) {
+        values[i] = wg_get_field(db, rec, columns[i]);
+      }
+
+      reclist_offset = wg_search_hash(db, index_id, values, col_count);
+      /* Check that our original record was among the matched.
+       * also check that the other records have correct values.
+       */
+      if(reclist_offset > 0) {
+        gint *nextoffset = &reclist_offset;
+        while(*nextoffset) {
+          gcell *rec_cell = (gcell *) offsettoptr(db, *nextoffset);
+          void *match = offsettoptr(db, rec_cell->car);
+          if(match == rec) {
+            found = 1;
+          } else {
+            for(i=0; i<col_count; i++) {
+              if(wg_get_field(db, match, columns[i]) != values[i]) {
+                if(printlevel) {
+                  printf("invalid value in matched record: %p col %d\n",
+                    match, (int) columns[i]);
+                }
+                return -1;
+              }
+            }
+          }
+
+          if(hdr->type == WG_INDEX_TYPE_HASH_JSON && \
+            !is_plain_record(match)) {
+            if(printlevel) {
+              printf("record %p shouldn't be indexed\n", rec);
+            }
+            return -1;
+          }
+          nextoffset = &(rec_cell->cdr);
+        }
+      }
+
+      /* check if the record was supposed to have been indexed */
+      if(hdr->type == WG_INDEX_TYPE_HASH || is_plain_record(rec)) {
+        if(!found) {
+          if(printlevel) {
+            printf("missing: record %p\n", rec);
+          }
+          return -1;
+        }
+      }
+    }
+    rec = wg_get_next_record(db, rec);
+    rows--;
+  }
+
+  return 0;
+}
+
+
+/** Validate a B-tree index
+ *  1. checks that the leaves are in index order and the key
+ *     prefixes match the values of the rows
+ *  2. checks that the index contains the given number of rows
+ *  3. checks the separators in the inner nodes
+ *  returns 0 if no errors found
+ *  returns -2 if there was an error
+ */
+static int validate_btree(void *db, gint index_id, int rows,
+  int printlevel) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  gint column = hdr->rec_field_index[0];
+  gint offset = BTREE_MIN_LEAF(hdr), prev = 0, prevrec = 0;
+  int cnt = 0;
+
+  while(offset) {
+    struct wg_bnode *node = (struct wg_bnode *) offsettoptr(db, offset);
+    int i;
+
+    if(node->level || node->prev_offset != prev ||\
+      (!node->count && (prev || node->next_offset))) {
+      if(printlevel)
+        printf("invalid leaf %d in the leaf chain\n", (int) offset);
+      return -2;
+    }
+    for(i=0; i<node->count; i++) {
+      gint rec = node->u.leaf.rec[i];
+      gint val = wg_get_field(db, offsettoptr(db, rec), column);
+      gint cr = WG_LESSTHAN;
+      int j;
+
+      /* compare all the indexed columns to the previous row */
+      for(j=0; cnt && j<hdr->fields; j++) {
+        gint col = hdr->rec_field_index[j];
+        cr = WG_COMPARE(db, wg_get_field(db, offsettoptr(db, prevrec), col),
+          wg_get_field(db, offsettoptr(db, rec), col));
+        if(cr != WG_EQUAL)
+          break;
+      }
+      if(node->u.leaf.key[i] != wg_normkey_prefix(db, val)) {
+        if(printlevel)
+          printf("key prefix does not match the value of record %d\n",
+            (int) rec);
+        return -2;
+      }
+      if(cr == WG_GREATER || (cr == WG_EQUAL && prevrec >= rec)) {
+        if(printlevel)
+          printf("record %d is out of order\n", (int) rec);
+        return -2;
+      }
+      prevrec = rec;
+      cnt++;
+    }
+    prev = offset;
+    offset = node->next_offset;
+  }
+
+  if(prev != BTREE_MAX_LEAF(hdr)) {
+    if(printlevel)
+      printf("max leaf is %d, expected %d\n",
+        (int) BTREE_MAX_LEAF(hdr), (int) prev);
+    return -2;
+  }
+  if(cnt != rows) {
+    if(printlevel)
+      printf("index contains %d rows, expected %d\n", cnt, rows);
+    return -2;
+  }
+  if(check_bnode(db, BTREE_ROOT_NODE(hdr), printlevel) !=\
+    BTREE_MIN_LEAF(hdr))
+    return -2;
+  return 0;
+}
+
+/** Check the inner nodes of a B-tree subtree
+ *  Every separator should match the first entry of its subtree.
+ *  returns the offset of the first leaf in the subtree, 0 on error.
+ */
+static gint check_bnode(void *db, gint offset, int printlevel) {
+  struct wg_bnode *node = (struct wg_bnode *) offsettoptr(db, offset);
+  gint i, first = 0;
+
+  if(!node->level)
+    return offset;
+  for(i=0; i<node->count; i++) {
+    gint child = node->u.inner.child[i], leaf;
+    struct wg_bnode *leafnode;
+
+    if(((struct wg_bnode *) offsettoptr(db, child))->level !=\
+      node->level - 1) {
+      if(printlevel)
+        printf("invalid level in node %d\n", (int) child);
+      return 0;
+    }
+    if(!(leaf = check_bnode(db, child, printlevel)))
+      return 0;
+    leafnode = (struct wg_bnode *) offsettoptr(db, leaf);
+    if(!leafnode->count || (i > 0 &&\
+      (node->u.inner.key[i] != leafnode->u.leaf.key[0] ||\
+      node->u.inner.rec[i] != leafnode->u.leaf.rec[0]))) {
+      if(printlevel)
+        printf("invalid separator %d in node %d\n", (int) i, (int) offset);
+      return 0;
+    }
+    if(!i)
+      first = leaf;
+  }
+  return first;
+}
+
+/** Validate an R-tree index
+ *  1. checks that the boxes of the inner nodes bound their
+ *     subtrees and the points in the leaves match the rows
+ *  2. checks that the index contains the given number of rows
+ *  3. checks that a search finds each row by its point
+ *  returns 0 if no errors found
+ *  returns -2 if there was an error
+ */
+static int validate_rtree(void *db, gint index_id, int rows,
+  int printlevel) {
+  wg_index_header *hdr = (wg_index_header *) offsettoptr(db, index_id);
+  wg_rtree_box box;
+  void *rec;
+  gint cnt;
+
+  cnt = check_rnode(db, hdr, RTREE_ROOT_NODE(hdr), &box, printlevel);
+  if(cnt < 0)
+    return -2;
+  if(cnt != rows || hdr->ctl.r.rows != rows) {
+    if(printlevel)
+      printf("index contains %d rows (counter %d), expected %d\n",
+        (int) cnt, (int) hdr->ctl.r.rows, rows);
+    return -2;
+  }
+
+  for(rec = wg_get_first_record(db); rec; rec = wg_get_next_record(db, rec)) {
+    wg_rtree_cursor *cur;
+    gint offset;
+
+    if(wg_rtree_point(db, hdr, rec, &box.lo[0], &box.lo[1]))
+      continue;
+    box.hi[0] = box.lo[0];
+    box.hi[1] = box.lo[1];
+    cur = wg_rtree_new_cursor(db, hdr, &box);
+    if(!cur)
+      return -2;
+    while((offset = wg_rtree_next(db, cur))) {
+      if(offset == ptrtooffset(db, rec))
+        break;
+    }
+    wg_rtree_free_cursor(db, cur);
+    if(!offset) {
+      if(printlevel)
+        printf("record %d was not found by its point\n",
+          (int) ptrtooffset(db, rec));
+      return -2;
+    }
+  }
+  return 0;
+}
+
+/** Check an R-tree subtree
+ *  The bounding box of the subtree is stored in box.
+ *  returns the number of rows in the subtree, -1 on error.
+ */
+static gint check_rnode(void *db, wg_index_header *hdr, gint offset,
+  wg_rtree_box *box, int printlevel) {
+  struct wg_rnode *node = (struct wg_rnode *) offsettoptr(db, offset);
+  gint i, cnt = 0;
+
+  if(node->count < (offset == RTREE_ROOT_NODE(hdr) ? (node->level ? 2 : 0) : 1)\
+    || node->count > WG_RNODE_ENTRIES) {
+    if(printlevel)
+      printf("invalid entry count in node %d\n", (int) offset);
+    return -1;
+  }
+  for(i=0; i<node->count; i++) {
+    wg_rtree_box sub, *b = &node->box[i];
+
+    if(node->level) {
+      gint sc;
+      if(((struct wg_rnode *) offsettoptr(db, node->child[i]))->level !=\
+        node->level - 1) {
+        if(printlevel)
+          printf("invalid level in node %d\n", (int) node->child[i]);
+        return -1;
+      }
+      if((sc = check_rnode(db, hdr, node->child[i], &sub, printlevel)) < 0)
+        return -1;
+      cnt += sc;
+    } else {
+      if(wg_rtree_point(db, hdr, offsettoptr(db, node->child[i]),
+        &sub.lo[0], &sub.lo[1])) {
+        if(printlevel)
+          printf("record %d has no point\n", (int) node->child[i]);
+        return -1;
+      }
+      sub.hi[0] = sub.lo[0];
+      sub.hi[1] = sub.lo[1];
+      cnt++;
+    }
+    if(sub.lo[0] < b->lo[0] || sub.lo[1] < b->lo[1] ||\
+      sub.hi[0] > b->hi[0] || sub.hi[1] > b->hi[1]) {
+      if(printlevel)
+        printf("box %d of node %d does not bound its entry\n",
+          (int) i, (int) offset);
+      return -1;
+    }
+    if(!i)
+      *box = sub;
+    if(sub.lo[0] < box->lo[0]) box->lo[0] = sub.lo[0];
+    if(sub.lo[1] < box->lo[1]) box->lo[1] = sub.lo[1];
+    if(sub.hi[0] > box->hi[0]) box->hi[0] = sub.hi[0];
+    if(sub.hi[1] > box->hi[1]) box->hi[1] = sub.hi[1];
+  }
+  return cnt;
+}
+
+
+/* -------------------- child db testing ------------------------ */
+
+#ifdef USE_CHILD_DB
+static int childdb_mkindex(void *db, int cnt) {
+  int i;
+  for(i=0; i<cnt; i++) {
+    if(wg_column_to_index_id(db, i, WG_INDEX_TYPE_TTREE, NULL, 0) == -1) {
+      if(wg_create_index(db, i, WG_INDEX_TYPE_TTREE, NULL, 0)) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+static int childdb_ckindex(void *db, int cnt, int printlevel) {
+  void *start, *rec;
+  int i, dbsize;
+
+  start = rec = (void *) wg_get_first_record(db);
+  dbsize = 0;
+
+  /* Get the number of records in database */
+  while(rec) {
+    dbsize++;
+    rec = wg_get_next_record(db, rec);
+  }
+
+  for(i=0; i<cnt; i++) {
+    if(printlevel > 1)
+      printf("checking (%p %d).\n", dbmemseg(db), i);
+    if(validate_index(db, start, dbsize, i, printlevel) ||\
+      validate_tnode_search(db, i, printlevel)) {
+      if(printlevel)
+        printf("index validation failed (%p %d).\n", dbmemseg(db), i);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int childdb_dropindex(void *db, int cnt) {
+  int i;
+  for(i=0; i<cnt; i++) {
+    gint index_id;
+    if((index_id = \
+      wg_column_to_index_id(db, i, WG_INDEX_TYPE_TTREE, NULL, 0)) != -1) {
+      if(wg_drop_index(db, index_id)) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+#endif
+
+static gint wg_check_childdb(void* db, int printlevel) {
+#ifdef USE_CHILD_DB
+  void *foo;
+  void *rec1, *rec2, *foorec1, *foorec2, *foorec3, *foorec4;
+  gint tmp, str1, str2;
+
+  if(printlevel>1) {
+    printf("********* testing child database ********** \n");
+  }
+
+  foo = wg_attach_local_database(500000);
+
+  if(foo) {
+    if(printlevel>1) {
+#ifndef _WIN32
+      printf("Parent: %p free %td.\nChild: %p free %td extdbs %td size %td\n",
+#else
+      printf("Parent: %p free %Id.\nChild: %p free %Id extdbs %Id size %Id\n",
+#endif
+        dbmemseg(db),
+        dbmemsegh(db)->free,
+        dbmemseg(foo),
+        dbmemsegh(foo)->free,
+        dbmemsegh(foo)->extdbs.count,
+        dbmemsegh(foo)->size);
+    }
+  } else {
+    printf("Failed to attach to local database.\n");
+    return 1;
+  }
+
+  if(dbmemsegh(db)->key != 0) {
+    /* Test invalid registering */
+    if(!wg_register_external_db(db, foo)) {
+      if(printlevel)
+        printf("Registering the local db in a shared db succeeded, should have failed\n");
+      wg_delete_local_database(foo);
+      return 1;
+    }
+  }
+
+  /* Records in parent db */
+  rec1 = (void *) wg_create_raw_record(db, 3);
+  rec2 = (void *) wg_create_raw_record(db, 3);
+
+  str1 = wg_encode_str(db, "hello", NULL);
+  wg_set_new_field(db, rec1, 0, str1);
+  wg_set_new_field(db, rec1, 1, wg_encode_str(db, "world", NULL));
+  wg_set_new_field(db, rec1, 2, wg_encode_double(db, 1.234));
+  wg_set_new_field(db, rec2, 0, wg_encode_record(db, rec1));
+  str2 = wg_encode_str(db, "bar", NULL);
+  wg_set_new_field(db, rec2, 1, str2);
+
+  /* Records in child db */
+  foorec1 = (void *) wg_create_raw_record(foo, 3);
+  foorec2 = (void *) wg_create_raw_record(foo, 3);
+
+  tmp = wg_encode_external_data(foo, db, str1);
+
+  /* Try storing external data */
+  if(printlevel>1) {
+    printf("Expecting an error: \"wg data handling error: "\
+      "External reference not recognized\".\n");
+  }
+  if(!wg_set_new_field(foo, foorec1, 0, tmp)) {
+    if(printlevel)
+      printf("Storing external data succeeded, should have failed\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+
+  /* Test indexes */
+  if(printlevel>1) {
+    printf("Testing child database index.\n");
+  }
+  if(!childdb_mkindex(foo, 3)) {
+    if(printlevel)
+      printf("Child database index creation failed\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+  if(!childdb_ckindex(foo, 3, printlevel)) {
+    if(printlevel)
+      printf("Child database index test failed\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+
+  /* Test registering (should fail, as we have indexes) */
+  if(printlevel>1) {
+    printf("Expecting an error: \"db memory allocation error: "\
+      "Database has indexes, external references not allowed\".\n");
+  }
+  if(!wg_register_external_db(foo, db)) {
+    if(printlevel)
+      printf("Registering the external db succeeded, but we have indexes\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+
+  if(!childdb_dropindex(foo, 3)) {
+    if(printlevel)
+      printf("Dropping indexes failed\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+
+  /* Test registering again */
+  if(wg_register_external_db(foo, db)) {
+    if(printlevel)
+      printf("Registering the shared db in local db failed, should have succeeded\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+  if(printlevel>1) {
+    printf("Expecting an error: \"index error: "\
+      "Database has external data, indexes disabled\".\n");
+  }
+  if(childdb_mkindex(foo, 1)) {
+    if(printlevel)
+      printf("Child database index creation succeeded (should have failed)\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+
+  /* Storing external data should now work */
+  if(wg_set_new_field(foo, foorec1, 0, tmp)) {
+    if(printlevel)
+      printf("Storing external data failed, should have succeeded\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+
+  wg_set_new_field(foo, foorec1, 1, wg_encode_str(foo, "local data", NULL));
+
+  tmp = wg_encode_external_data(foo, db, wg_encode_record(db, rec1));
+  wg_set_new_field(foo, foorec2, 0, tmp);
+  wg_set_new_field(foo, foorec2, 1, wg_encode_str(foo, "more local data", NULL));
+  tmp = wg_encode_external_data(foo, db, str2);
+  wg_set_new_field(foo, foorec2, 2, tmp);
+
+  if(printlevel>1) {
+    printf("Testing data comparing.\n");
+  }
+
+  /* Test comparing */
+  foorec3 = (void *) wg_create_raw_record(foo, 3);
+  foorec4 = (void *) wg_create_raw_record(foo, 3);
+
+  wg_set_new_field(foo, foorec3, 0, wg_encode_str(foo, "hello", NULL));
+  wg_set_new_field(foo, foorec3, 1, wg_encode_str(foo, "world", NULL));
+  wg_set_new_field(foo, foorec3, 2, wg_encode_double(foo, 1.234));
+
+  wg_set_new_field(foo, foorec4, 0, wg_encode_record(foo, foorec3));
+  wg_set_new_field(foo, foorec4, 1, wg_encode_str(foo, "more local data", NULL));
+  tmp = wg_encode_external_data(foo, db, str2);
+  wg_set_new_field(foo, foorec4, 2, tmp);
+
+#if WG_COMPARE_REC_DEPTH > 2
+  /* foorec2 and foorec4 should be equal */
+  if(WG_COMPARE(foo,
+    wg_encode_record(foo, foorec2),
+    wg_encode_record(foo, foorec4)) != WG_EQUAL) {
+    if(printlevel)
+      printf("foorec2 and foorec4 were not equal, but should be.\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+
+  /* rec1 and foorec3 should be equal */
+  if(WG_COMPARE(foo,
+    wg_encode_external_data(foo, db, wg_encode_record(db, rec1)),
+    wg_encode_record(foo, foorec3)) != WG_EQUAL) {
+    if(printlevel)
+      printf("rec1 and foorec3 were not equal, but should be.\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+#endif
+
+  /* sanity check: foorec3 and foorec4 should not be equal */
+  if(WG_COMPARE(foo,
+    wg_encode_record(foo, foorec3),
+    wg_encode_record(foo, foorec4)) == WG_EQUAL) {
+    if(printlevel)
+      printf("foorec3 and foorec4 were equal, but should not be.\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+
+#ifdef USE_BACKLINKING
+  /* Test deleting */
+  if(wg_delete_record(db, rec1) != -1) {
+    if(printlevel)
+      printf("Deleting referenced parent rec1 succeeded (should have failed)\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+#else
+  if(wg_delete_record(db, rec1) != 0) {
+    if(printlevel)
+      printf("Deleting parent rec1 failed (should have succeeded)\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+#endif
+  if(wg_delete_record(db, rec2) != 0) {
+    if(printlevel)
+      printf("Deleting non-referenced parent rec2 failed (should have succeeded)\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+  if(wg_delete_record(foo, foorec2) != 0) {
+    if(printlevel)
+      printf("Deleting child foorec2 failed (should have succeeded)\n");
+    wg_delete_local_database(foo);
+    return 1;
+  }
+
+  /* right now string refcounts are a bit fishy... skip this */
+  /* wg_set_field(foo, foorec4, 2, tmp); */
+
+  /* this should fail, but we don't want to interact with the
+   * filesystem in these automated tests
+  wg_dump(foo, "invalid.bin");*/
+
+  wg_delete_local_database(foo);
+
+  if(printlevel>1)
+    printf("********* child database test successful ********** \n");
+#else
+  printf("child databases disabled, skipping checks\n");
+#endif
+  return 0;
+}
+
+/* ---------------- schema/JSON related tests ----------------- */
+
+/*
+ * Run this on a dedicated database to check the effects
+ * of param bits and deleting.
+ */
+static gint wg_check_schema(void* db, int printlevel) {
+  void *rec, *arec, *orec, *trec;
+  gint *gptr;
+  gint tmp1, tmp2, tmp3;
+
+  if(printlevel>1) {
+    printf("********* testing schema functions ********** \n");
+  }
+
+  tmp1 = wg_encode_int(db, 99);
+  tmp2 = wg_encode_int(db, 98);
+  tmp3 = wg_encode_int(db, 97);
+
+  /* Triple */
+  rec = wg_create_triple(db, tmp1, tmp2, tmp3, 0);
+
+  /* Check the record (fields and meta bits).
+   * it is not a param.
+   */
+  gptr = ((gint *) rec + RECORD_META_POS);
+  if(*gptr) {
+    if(printlevel) {
+      printf("plain triple is expected to have no meta bits\n");
+    }
+    return 1;
+  }
+  gptr = ((gint *) rec + RECORD_HEADER_GINTS + WG_SCHEMA_TRIPLE_OFFSET);
+  if(*gptr != tmp1) {
+    if(printlevel)
+      printf("triple field 1 does not match\n");
+    return 1;
+  }
+  if(*(gptr+1) != tmp2) {
+    if(printlevel)
+      printf("triple field 2 does not match\n");
+    return 1;
+  }
+  if(*(gptr+2) != tmp3) {
+    if(printlevel)
+      printf("triple field 3 does not match\n");
+    return 1;
+  }
+
+  /* the next triple is a param.
+   */
+  rec = wg_create_triple(db, tmp1, tmp2, tmp3, 1);
+  gptr = ((gint *) rec + RECORD_META_POS);
+  if(*gptr != (RECORD_META_NOTDATA|RECORD_META_MATCH)) {
+    if(printlevel) {
+#ifndef _WIN32
+      printf("param triple had invalid meta bits (%td)\n", *gptr);
+#else
+      printf("param triple had invalid meta bits (%Id)\n", *gptr);
+#endif
+    }
+    return 1;
+  }
+
+  /* kv-pair */
+  rec = wg_create_kvpair(db, tmp2, tmp3, 1);
+
+  /* Check the record (fields and meta bits).
+   * it is a param.
+   */
+  gptr = ((gint *) rec + RECORD_META_POS);
+  if(*gptr != (RECORD_META_NOTDATA|RECORD_META_MATCH)) {
+    if(printlevel) {
+#ifndef _WIN32
+      printf("param kv-pair had invalid meta bits (%td)\n", *gptr);
+#else
+      printf("param kv-pair had invalid meta bits (%Id)\n", *gptr);
+#endif
+    }
+    return 1;
+  }
+  gptr = ((gint *) rec + RECORD_HEADER_GINTS + WG_SCHEMA_TRIPLE_OFFSET);
+  if(*gptr != 0) {
+    if(printlevel)
+      printf("kv-pair prefix is not NULL\n");
+    return 1;
+  }
+  if(*(gptr+1) != tmp2) {
+    if(printlevel)
+      printf("kv-pair key does not match\n");
+    return 1;
+  }
+  if(*(gptr+2) != tmp3) {
+    if(printlevel)
+      printf("kv-pair value does not match\n");
+    return 1;
+  }
+
+  /* this is not a param.
+   */
+  rec = wg_create_triple(db, tmp1, tmp2, tmp3, 0);
+  gptr = ((gint *) rec + RECORD_META_POS);
+  if(*gptr) {
+    if(printlevel) {
+      printf("plain kv-pair is expected to have no meta bits\n");
+    }
+    return 1;
+  }
+
+  /* params should be invisible */
+  if(check_db_rows(db, 2, printlevel)) {
+    if(printlevel)
+      printf("row count check failed (should have 2 non-param rows).\n");
+    return 1;
+  }
+
+  /* Object */
+  orec = wg_create_object(db, 1, 0, 0);
+  if(wg_get_record_len(db, orec) != 1) {
+    if(printlevel) {
+      printf("object had invalid length\n");
+    }
+    return 1;
+  }
+
+  gptr = ((gint *) orec + RECORD_META_POS);
+  if(*gptr != RECORD_META_OBJECT) {
+    if(printlevel) {
+#ifndef _WIN32
+      printf("object (nonparam) had invalid meta bits (%td)\n", *gptr);
+#else
+      printf("object (nonparam) had invalid meta bits (%Id)\n", *gptr);
+#endif
+    }
+    return 1;
+  }
+
+  wg_set_field(db, orec, 0, wg_encode_record(db, rec));
+
+  /* Array. It has the document bit set.
+   */
+  arec = wg_create_array(db, 4, 1, 0);
+  if(wg_get_record_len(db, arec) != 4) {
+    if(printlevel) {
+      printf("array had invalid length\n");
+    }
+    return 1;
+  }
+
+  gptr = ((gint *) arec + RECORD_META_POS);
+  if(*gptr != (RECORD_META_ARRAY|RECORD_META_DOC)) {
+    if(printlevel) {
+#ifndef _WIN32
+      printf("array (doc, nonparam) had invalid meta bits (%td)\n", *gptr);
+#else
+      printf("array (doc, nonparam) had invalid meta bits (%Id)\n", *gptr);
+#endif
+    }
+    return 1;
+  }
+
+  /* Form the document.
+   */
+  wg_set_field(db, arec, 0, tmp3);
+  wg_set_field(db, arec, 1, tmp2);
+  wg_set_field(db, arec, 2, tmp1);
+  wg_set_field(db, arec, 3, wg_encode_record(db, orec));
+
+#ifdef USE_BACKLINKING
+  /* Locate the document through an element.
+   */
+  trec = wg_find_document(db, rec);
+  if(trec != arec) {
+    if(printlevel) {
+      printf("wg_find_document() failed\n");
+    }
+    return 1;
+  }
+#endif
+
+  if(wg_delete_document(db, arec)) {
+    if(printlevel) {
+      printf("wg_delete_document() failed\n");
+    }
+    return 1;
+  }
+
+  /* of the two rows in db earlier, one was included in the
+   * deleted document. One should be remaining.
+   */
+  if(check_db_rows(db, 1, printlevel)) {
+    if(printlevel)
+      printf("Invalid number of remaining rows after deleting.\n");
+    return 1;
+  }
+
+  /* Check the param bits of object and array.
+   */
+  orec = wg_create_object(db, 5, 0, 1);
+  gptr = ((gint *) orec + RECORD_META_POS);
+  if(*gptr != (RECORD_META_OBJECT|RECORD_META_NOTDATA|RECORD_META_MATCH)) {
+    if(printlevel) {
+#ifndef _WIN32
+      printf("object (param) had invalid meta bits (%td)\n", *gptr);
+#else
+      printf("object (param) had invalid meta bits (%Id)\n", *gptr);
+#endif
+    }
+    return 1;
+  }
+
+  arec = wg_create_array(db, 6, 0, 1);
+  gptr = ((gint *) arec + RECORD_META_POS);
+  if(*gptr != (RECORD_META_ARRAY|RECORD_META_NOTDATA|RECORD_META_MATCH)) {
+    if(printlevel) {
+#ifndef _WIN32
+      printf("array (param) had invalid meta bits (%td)\n", *gptr);
+#else
+      printf("array (param) had invalid meta bits (%Id)\n", *gptr);
+#endif
+    }
+    return 1;
+  }
+
+  /* we added params, row count should not increase. */
+  if(check_db_rows(db, 1, printlevel)) {
+    if(printlevel)
+      printf("Invalid number of remaining rows after deleting.\n");
+    return 1;
+  }
+
+  if(printlevel>1)
+    printf("********* schema test successful ********** \n");
+
+  return 0;
+}
+
+/*
+ * Test JSON parsing. This produces some errors in stderr
+ * which is expected (rely on the return value to check for success).
+ */
+static gint wg_check_json_parsing(void* db, int printlevel) {
+  void *doc, *rec;
+  gint enc;
+
+  char *json1 = "[7,8,9]"; /* ok */
+  char *json2 = "{ \"a\":{\n\"b\": 55.0\n}, \"c\"\n:\"hello\","\
+                    "\"d\"\t:[\n]}"; /* ok */
+  char *json3 = "25"; /* fail */
+  char *json4 = "{ \"a\":{\"b\": 55.0}, \"c\":\"hello\""; /* fail */
+
+  if(printlevel>1) {
+    printf("********* testing JSON parsing functions ********** \n");
+  }
+
+  /* parse input buf. */
+  doc = NULL;
+  if(wg_parse_json_document(db, json1, &doc)) {
+    if(printlevel)
+      printf("Parsing a valid document failed.\n");
+    return 1;
+  }
+  if(!doc) {
+    if(printlevel)
+      printf("JSON parser did not return a document.\n");
+    return 1;
+  }
+
+  /* examine structure
+   */
+  if(wg_get_record_len(db, doc) != 3) {
+    if(printlevel)
+      printf("Document structure error: bad object length.\n");
+    return 1;
+  }
+  if(is_special_record(doc) || !is_schema_document(doc) ||\
+   !is_schema_array(doc)) {
+    if(printlevel) {
+      printf("Document structure error: invalid meta type\n");
+    }
+    return 1;
+  }
+
+  /* field contents */
+  enc = wg_get_field(db, doc, 0);
+  if(wg_get_encoded_type(db, enc) != WG_INTTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad array element(0).\n");
+    return 1;
+  }
+  if(wg_decode_int(db, enc) != 7) {
+    if(printlevel)
+      printf("Document structure error: bad array element value(0).\n");
+    return 1;
+  }
+
+  enc = wg_get_field(db, doc, 1);
+  if(wg_get_encoded_type(db, enc) != WG_INTTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad array element(1).\n");
+    return 1;
+  }
+  if(wg_decode_int(db, enc) != 8) {
+    if(printlevel)
+      printf("Document structure error: bad array element value(1).\n");
+    return 1;
+  }
+
+  enc = wg_get_field(db, doc, 2);
+  if(wg_get_encoded_type(db, enc) != WG_INTTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad array element(2).\n");
+    return 1;
+  }
+  if(wg_decode_int(db, enc) != 9) {
+    if(printlevel)
+      printf("Document structure error: bad array element value(2).\n");
+    return 1;
+  }
+
+  /* Use the param parser to get direct access to the
+   * document structure. */
+  doc = NULL;
+  if(wg_parse_json_param(db, json2, &doc)) {
+    if(printlevel)
+      printf("Parsing a valid document failed.\n");
+    return 1;
+  }
+
+  if(!doc) {
+    if(printlevel)
+      printf("Param parser did not return a document.\n");
+    return 1;
+  }
+
+  /* examine structure
+   */
+  if(wg_get_record_len(db, doc) != 3) {
+    if(printlevel)
+      printf("Document structure error: bad object length.\n");
+    return 1;
+  }
+
+  if(!is_special_record(doc) || !is_schema_document(doc) ||\
+   !is_schema_object(doc)) {
+    if(printlevel) {
+      printf("Document structure error: invalid meta type\n");
+    }
+    return 1;
+  }
+
+  /* first kv-pair */
+  enc = wg_get_field(db, doc, 0);
+  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad object element(0).\n");
+    return 1;
+  }
+  rec = wg_decode_record(db, enc);
+
+  enc = wg_get_field(db, rec, WG_SCHEMA_KEY_OFFSET);
+  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad key type.\n");
+    return 1;
+  }
+  if(strncmp("a", wg_decode_str(db, enc), 1)) {
+    if(printlevel)
+      printf("Document structure error: bad key string.\n");
+    return 1;
+  }
+
+  enc = wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET);
+  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad value type.\n");
+    return 1;
+  }
+  rec = wg_decode_record(db, enc);
+  if(wg_get_record_len(db, rec) != 1) {
+    if(printlevel)
+      printf("Document structure error: bad sub-object length.\n");
+    return 1;
+  }
+  if(!is_schema_object(rec)) {
+    if(printlevel) {
+      printf("Document structure error: sub-object has invalid meta type\n");
+    }
+  }
+
+  enc = wg_get_field(db, rec, 0);
+  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad sub-object element(0).\n");
+    return 1;
+  }
+  rec = wg_decode_record(db, enc);
+
+  enc = wg_get_field(db, rec, WG_SCHEMA_KEY_OFFSET);
+  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad subobj key type.\n");
+    return 1;
+  }
+  if(strncmp("b", wg_decode_str(db, enc), 1)) {
+    if(printlevel)
+      printf("Document structure error: bad subobj key string.\n");
+    return 1;
+  }
+
+  enc = wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET);
+  if(wg_get_encoded_type(db, enc) != WG_DOUBLETYPE) {
+    if(printlevel)
+      printf("Document structure error: bad subobj value type.\n");
+    return 1;
+  }
+
+  if(wg_decode_double(db, enc) >= 55.1 ||\
+   wg_decode_double(db, enc) <= 54.9) {
+    if(printlevel)
+      printf("Document structure error: bad subobj value.\n");
+    return 1;
+  }
+
+  /* second kv-pair */
+  enc = wg_get_field(db, doc, 1);
+  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad object element(1).\n");
+    return 1;
+  }
+  rec = wg_decode_record(db, enc);
+
+  enc = wg_get_field(db, rec, WG_SCHEMA_KEY_OFFSET);
+  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad key type.\n");
+    return 1;
+  }
+  if(strncmp("c", wg_decode_str(db, enc), 1)) {
+    if(printlevel)
+      printf("Document structure error: bad key string.\n");
+    return 1;
+  }
+
+  enc = wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET);
+  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+    if(printlevel)
+      printf("Document structure error: value type.\n");
+    return 1;
+  }
+  if(strncmp("hello", wg_decode_str(db, enc), 5)) {
+    if(printlevel)
+      printf("Document structure error: bad value.\n");
+    return 1;
+  }
+
+  /* third kv-pair */
+  enc = wg_get_field(db, doc, 2);
+  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad object element(0).\n");
+    return 1;
+  }
+  rec = wg_decode_record(db, enc);
+
+  enc = wg_get_field(db, rec, WG_SCHEMA_KEY_OFFSET);
+  if(wg_get_encoded_type(db, enc) != WG_STRTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad key type.\n");
+    return 1;
+  }
+  if(strncmp("d", wg_decode_str(db, enc), 1)) {
+    if(printlevel)
+      printf("Document structure error: bad key string.\n");
+    return 1;
+  }
+
+  enc = wg_get_field(db, rec, WG_SCHEMA_VALUE_OFFSET);
+  if(wg_get_encoded_type(db, enc) != WG_RECORDTYPE) {
+    if(printlevel)
+      printf("Document structure error: bad value type.\n");
+    return 1;
+  }
+  rec = wg_decode_record(db, enc);
+  if(!is_schema_array(rec)) {
+    if(printlevel) {
+      printf("Document structure error: bad value (array expected)\n");
+    }
+  }
+  if(wg_get_record_len(db, rec) != 0) {
+    if(printlevel)
+      printf("Document structure error: bad array length.\n");
+    return 1;
+  }
+
+  /* Invalid documents, expect a failure.
+   */
+  if(printlevel>1)
+    printf("testing invalid documents, the following errors are expected.\n");
+
+  if(!wg_check_json(db, NULL)) {
+    if(printlevel)
+      printf("Checking an invalid document succeeded (expected to fail).\n");
+    return 1;
+  }
+  if(!wg_check_json(db, json3)) {
+    if(printlevel)
+      printf("Checking an invalid document succeeded (expected to fail).\n");
+    return 1;
+  }
+  if(!wg_parse_json_document(db, json3, NULL)) {
+    if(printlevel)
+      printf("Parsing an invalid document succeeded.\n");
+    return 1;
+  }
+
+  if(!wg_check_json(db, json4)) {
+    if(printlevel)
+      printf("Checking an invalid document succeeded (expected to fail).\n");
+    return 1;
+  }
+  if(!wg_parse_json_param(db, json4, &doc)) {
+    if(printlevel)
+      printf("Parsing an invalid document succeeded.\n");
+    return 1;
+  }
+
+  if(printlevel>1)
+    printf("********* JSON parsing test successful ********** \n");
+
+  return 0;
+}
+
+/*
+ * Returns 1 if the offset is in list.
+ * Returns 0 otherwise.
+ */
+static int is_offset_in_list(void *db, gint reclist_offset, gint offset) {
+  if(reclist_offset > 0) {
+    gint *nextoffset = &reclist_offset;
+    while(*nextoffset) {
+      gcell *rec_cell = (gcell *) offsettoptr(db, *nextoffset);
+      if(rec_cell->car == offset)
+        return 1;
+      nextoffset = &(rec_cell->cdr);
+    }
+  }
+  return 0;
+}
+
+/*
+ * Test index hash (low-level functions)
+ */
+static gint wg_check_idxhash(void* db, int printlevel) {
+  db_hash_area_header ha;
+  struct {
+    char *data;
+    gint offsets[10];
+    int delidx;
+  } rowdata[] = {
+    { "0iQ1vMvGX5wfsjLTssyx", { 5709281, 5769186, 0,
+                                0, 0, 0, 0, 0, 0, 0 }, 1 },
+    { "1jP3hJxO61QVscBEKu9", { 3510018, 8944261, 8172536,
+                                4346587, 0, 0, 0, 0, 0, 0 }, 2 },
+    { "yLMt2eSQuIi3ChQlI0", { 6587099, 6385516, 0,
+                                0, 0, 0, 0, 0, 0, 0 }, 1 },
+    { "ZlGS9cVX7fE1v7H6m", { 2059694, 1981000, 8360987,
+                             752526, 6435820, 240982,
+                             323628, 8875951, 0, 0 }, 1 },
+    { "duflillyRviJ1ZvH", { 6711262, 9685175, 4070003,
+                            5977585, 9671591, 5321015,
+                            7499127, 9101853, 0, 0 }, 2 },
+    { "USLP83gH6f4pNYJ", { 8759349, 436333, 0,
+                           0, 0, 0, 0, 0, 0, 0 }, 1 },
+    { "yHIDgxlEA7RLAx", { 7613500, 534106, 4361094,
+                          1506219, 0, 0, 0, 0, 0, 0 }, 1 },
+    { "             ", { 6588510, 6253610, 9020726,
+                         8514572, 9378303, 1100373, 0, 0, 0, 0 }, 2 },
+    { "            ", { 8185484, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, 0 },
+    { "yHIDgxlEA7R", { 2542797, 6481658, 214793,
+                       943434, 2934816, 9503963,
+                       1374313, 0, 0, 0 }, 4 },
+    { NULL, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, -1 }
+  };
+  int i;
+
+  if(printlevel>1) {
+    printf("********* testing index hash functions ********** \n");
+  }
+
+  /* Create a tiny hash table to allow hash chains to be created. */
+  if(wg_create_hash(db, &ha, 4)) {
+    if(printlevel)
+      printf("Failed to create the hash table.\n");
+    return 1;
+  }
+
+  /* Insert rows in order of columns */
+  for(i=0; i<10; i++) {
+    int j;
+    for(j=0; rowdata[j].data; j++) {
+      if(rowdata[j].offsets[i]) {
+        if(wg_idxhash_store(db, &ha, rowdata[j].data,
+         strlen(rowdata[j].data), rowdata[j].offsets[i])) {
+          if(printlevel)
+            printf("Hash table insertion failed (j=%d i=%d).\n", j, i);
+          return 1;
+        }
+      }
+    }
+  }
+
+  /* Check that each offset is present */
+  for(i=0; rowdata[i].data; i++) {
+    int j;
+    gint list = wg_idxhash_find(db, &ha, rowdata[i].data,
+      strlen(rowdata[i].data));
+    for(j=0; j<10 && rowdata[i].offsets[j]; j++) {
+      if(!is_offset_in_list(db, list, rowdata[i].offsets[j])) {
+        if(printlevel)
+          printf("Offset missing in hash table (i=%d j=%d).\n", i, j);
+        return 1;
+      }
+    }
+  }
+
+  /* Delete the rows designated by delidx */
+  for(i=0; rowdata[i].data; i++) {
+    if(wg_idxhash_remove(db, &ha, rowdata[i].data,
+     strlen(rowdata[i].data), rowdata[i].offsets[rowdata[i].delidx])) {
+      if(printlevel)
+        printf("Hash table deletion failed (i=%d delidx=%d).\n",
+          i, rowdata[i].delidx);
+      return 1;
+    }
+  }
+
+  /* Check that the deleted row is not present and that all the others are */
+  for(i=0; rowdata[i].data; i++) {
+    int j;
+    gint list = wg_idxhash_find(db, &ha, rowdata[i].data,
+      strlen(rowdata[i].data));
+    for(j=0; j<10 && rowdata[i].offsets[j]; j++) {
+      if(j == rowdata[i].delidx) {
+        /* Should be missing */
+        if(is_offset_in_list(db, list, rowdata[i].offsets[j])) {
+          if(printlevel)
+            printf("Offset not correctly deleted (i=%d delidx=%d).\n",
+              i, rowdata[i].delidx);
+          return 1;
+        }
+      } else {
+        /* Should be present */
+        if(!is_offset_in_list(db, list, rowdata[i].offsets[j])) {
+          if(printlevel)
+            printf("Offset missing in hash table (i=%d j=%d).\n", i, j);
+          return 1;
+        }
+      }
+    }
+  }
+
+  /* Fill the table with enough keys to resize it several times,
+   * checking the lookups while the old arrays are being migrated.
+   */
+  for(i=0; i<2000; i++) {
+    char buf[20];
+    int j;
+    snprintf(buf, 19, "resize%d", i);
+    if(wg_idxhash_store(db, &ha, buf, strlen(buf), 8*(i+1))) {
+      if(printlevel)
+        printf("Hash table insertion failed (i=%d).\n", i);
+      return 1;
+    }
+    for(j=(i>50 ? i-50 : 0); j<=i; j++) {
+      snprintf(buf, 19, "resize%d", j);
+      if(!is_offset_in_list(db,
+        wg_idxhash_find(db, &ha, buf, strlen(buf)), 8*(j+1))) {
+        if(printlevel)
+          printf("Offset missing after resize (i=%d j=%d).\n", i, j);
+        return 1;
+      }
+    }
+  }
+  if(ha.arraylength < 1000) {
+    if(printlevel)
+      printf("Hash table was not resized (length %d).\n",
+        (int) ha.arraylength);
+    return 1;
+  }
+  if(ha.arraylength & (ha.arraylength - 1)) {
+    if(printlevel)
+      printf("Hash table length is not a power of 2 (length %d).\n",
+        (int) ha.arraylength);
+    return 1;
+  }
+  for(i=0; i<2000; i++) {
+    char buf[20];
+    snprintf(buf, 19, "resize%d", i);
+    if(wg_idxhash_remove(db, &ha, buf, strlen(buf), 8*(i+1))) {
+      if(printlevel)
+        printf("Hash table deletion failed (i=%d).\n", i);
+      return 1;
+    }
+  }
+
+  /* Release the remaining keys and the array */
+  if(wg_idxhash_free(db, &ha) || ha.arraystart || ha.entries) {
+    if(printlevel)
+      printf("Hash table release failed.\n");
+    return 1;
+  }
+
+  if(printlevel>1)
+    printf("********* index hash test successful ********** \n");
+
+  return 0;
+}
+
+/* --------------------- query testing ------------------------ */
+
+/**
+ * Fetch all rows where "col" "cond" "val" is true
+ *   (where cond is a comparison operator - equal, less than etc)
+ * Check that the val matches the field value in returned records.
+ * Check that the number of rows matches the expected value
+ */
+static int check_matching_rows(void *db, int col, int cond,
+ void *val, gint type, int expected, int printlevel) {
+  void *rec = NULL;
+  wg_query *query = NULL;
+  wg_query_arg arglist;
+  int cnt;
+
+  arglist.column = col;
+  arglist.cond = cond;
+  switch(type) {
+    case WG_INTTYPE:
+      arglist.value = wg_encode_query_param_int(db, *((gint *) val));
+      break;
+    case WG_DOUBLETYPE:
+      arglist.value = wg_encode_query_param_double(db, *((double *) val));
+      break;
+    case WG_STRTYPE:
+      arglist.value = wg_encode_query_param_str(db, (char *) val, NULL);
+      break;
+    default:
+      return -1;
+  }
+
+  query = wg_make_query(db, NULL, 0, &arglist, 1);
+  if(!query) {
+    return -2;
+  }
+
+  if(query->res_count != expected) {
+    if(printlevel)
+      printf("check_matching_rows: res_count mismatch (%d != %d)\n",
+        (int) query->res_count, expected);
+    return -3;
+  }
+
+  cnt = 0;
+  while((rec = wg_fetch(db, query))) {
+    gint enc = wg_get_field(db, rec, col);
+    if(cond == WG_COND_EQUAL) {
+      switch(type) {
+        case WG_INTTYPE:
+          if(wg_decode_int(db, enc) != *((int *) val)) {
+            if(printlevel)
+              printf("check_matching_rows: int value mismatch\n");
+            return -4;
+          }
+          break;
+        case WG_DOUBLETYPE:
+          if(wg_decode_double(db, enc) != *((double *) val)) {
+            if(printlevel)
+              printf("check_matching_rows: double value mismatch\n");
+            return -4;
+          }
+          break;
+        case WG_STRTYPE:
+          if(strcmp(wg_decode_str(db, enc), (char *) val)) {
+            if(printlevel)
+              printf("check_matching_rows: string value mismatch\n");
+            return -4;
+          }
+          break;
+        default:
+          break;
+      }
+    }
+    cnt++;
+  }
+
+  if(cnt != expected) {
+    if(printlevel)
+      printf("check_matching_rows: actual count mismatch (%d != %d)\n",
+        cnt, expected);
+    return -5;
+  }
+
+  wg_free_query(db, query);
+  wg_free_query_param(db, arglist.value);
+  return 0;
+}
+
+/**
+ * version of check_matching_rows() using wg_find_record_*()
+ */
+static int check_matching_rows_find(void *db, int col, int cond,
+ void *val, gint type, int expected, int printlevel) {
+  void *rec = NULL;
+  int cnt = 0;
+
+  for(;;) {
+    switch(type) {
+      case WG_INTTYPE:
+        rec = wg_find_record_int(db, col, cond, *((int *) val), rec);
+        break;
+      case WG_DOUBLETYPE:
+        rec = wg_find_record_double(db, col, cond, *((double *) val), rec);
+        break;
+      case WG_STRTYPE:
+        rec = wg_find_record_str(db, col, cond, (char *) val, rec);
+        break;
+      default:
+        break;
+    }
+    if(!rec)
+      break;
+    cnt++;
+  }
+
+  if(cnt != expected) {
+    if(printlevel)
+      printf("check_matching_rows_find: actual count mismatch (%d != %d)\n",
+        cnt, expected);
+    return -5;
+  }
+
+  return 0;
+}
+
+
+/**
+ * Count db rows
+ */
+static int check_db_rows(void *db, int expected, int printlevel) {
+  void *rec = NULL;
+  int cnt;
+
+  rec = wg_get_first_record(db);
+  cnt = 0;
+  while(rec) {
+    cnt++;
+    rec = wg_get_next_record(db, rec);
+  }
+
+  if(cnt != expected) {
+    if(printlevel)
+      printf("check_db_rows: actual count mismatch (%d != %d)\n",
+        cnt, expected);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Basic query tests
+ */
+static gint wg_test_query(void *db, int magnitude, int printlevel) {
+  const int dbsize = 50*magnitude;
+  int i, j, k;
+  void *rec = NULL;
+
+  if(wg_column_to_index_id(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0) == -1) {
+    if(printlevel > 1)
+      printf("no index found on column 0, creating.\n");
+    if(wg_create_index(db, 0, WG_INDEX_TYPE_TTREE, NULL, 0)) {
+      if(printlevel)
+        printf("index creation failed, aborting.\n");
+      return -3;
+    }
+  }
+
+  if(printlevel > 1)
+    printf("------- Inserting test data --------\n");
+
+  /* Create predictable data */
+  for(i=0; i<dbsize; i++) {
+    for(j=0; j<50; j++) {
+      for(k=0; k<50; k++) {
+        char c1[20];
+        gint c2 = 100 * j;
+        double c3 = 10 * k;
+        snprintf(c1, 19, "%d", 1000 * i);
+        c1[19] = '\0';
+
+        rec = wg_create_record(db, 3);
+        if(!rec) {
+          if(printlevel)
+            printf("insert error, aborting.\n");
+          return -1;
+        }
+        if(wg_set_field(db, rec, 0, wg_encode_str(db, c1, NULL))) {
+          if(printlevel)
+            printf("insert error, aborting.\n");
+          return -1;
+        }
+        if(wg_set_field(db, rec, 1, wg_encode_int(db, c2))) {
+          if(printlevel)
+            printf("insert error, aborting.\n");
+          return -1;
+        }
+        if(wg_set_field(db, rec, 2, wg_encode_double(db, c3))) {
+          if(printlevel)
+            printf("insert error, aborting.\n");
+          return -1;
+        }
+      }
+    }
+  }
+
+  if(wg_column_to_index_id(db, 2, WG_INDEX_TYPE_TTREE, NULL, 0) == -1) {
+    if(printlevel > 1)
+      printf("no index found on column 2, creating.\n");
+    if(wg_create_index(db, 2, WG_INDEX_TYPE_TTREE, NULL, 0)) {
+      if(printlevel)
+        printf("index creation failed, aborting.\n");
+      return -3;
+    }
+  }
+
+  if(printlevel > 1)
+    printf("------- Running read query tests --------\n");
+
+  /* Content check read queries */
+  for(i=0; i<dbsize; i++) {
+    char buf[20];
+    snprintf(buf, 19, "%d", 1000 * i);
+    buf[19] = '\0';
+
+    if(check_matching_rows(db, 0, WG_COND_EQUAL, (void *) buf,
+     WG_STRTYPE, 50*50, printlevel)) {
+      if(printlevel)
+        printf("content check col=0, i=%d failed.\n", i);
+      return -2;
+    }
+  }
+
+  for(i=0; i<50; i++) {
+    gint val = 100 * i;
+    if(check_matching_rows(db, 1, WG_COND_EQUAL, (void *) &val,
+     WG_INTTYPE, dbsize*50, printlevel)) {
+      if(printlevel)
+        printf("content check col=1, i=%d failed.\n", i);
+      return -2;
+    }
+  }
+
+  for(i=0; i<50; i++) {
+    double val = 10 * i;
+    if(check_matching_rows(db, 2, WG_COND_EQUAL, (void *) &val,
+     WG_DOUBLETYPE, dbsize*50, printlevel)) {
+      if(printlevel)
+        printf("content check col=2, i=%d failed.\n", i);
+      return -2;
+    }
+  }
+
+  if(printlevel > 1)
+    printf("------- Running find tests --------\n");
+
+  /* Content check read queries */
+  for(i=0; i<dbsize; i++) {
+    char buf[20];
+    snprintf(buf, 19, "%d", 1000 * i);
+    buf[19] = '\0';
+
+    if(check_matching_rows_find(db, 0, WG_COND_EQUAL, (void *) buf,
+     WG_STRTYPE, 50*50, printlevel)) {
+      if(printlevel)
+        printf("find check col=0, i=%d failed.\n", i);
+      return -8;
+    }
+  }
+
+  for(i=0; i<4; i++) {
+    gint val = 100 * i;
+    if(check_matching_rows_find(db, 1, WG_COND_LESSTHAN, (void *) &val,
+     WG_INTTYPE, dbsize*50*i, printlevel)) {
+      if(printlevel)
+        printf("find check col=1, i=%d failed.\n", i);
+      return -8;
+    }
+  }
+
+  for(i=47; i<50; i++) {
+    double val = 10 * i;
+    if(check_matching_rows_find(db, 2, WG_COND_GTEQUAL, (void *) &val,
+     WG_DOUBLETYPE, dbsize*50*(50-i), printlevel)) {
+      if(printlevel)
+        printf("find check col=2, i=%d failed.\n", i);
+      return -8;
+    }
+  }
+
+  if(printlevel > 1)
+    printf("------- Updating test data --------\n");
+
+  /* Update queries */
+  for(i=0; i<dbsize; i++) {
+    wg_query *query;
+    wg_query_arg arg;
+    char c1[20];
+    snprintf(c1, 19, "%d", 1000 * i);
+    c1[19] = '\0';
+
+    arg.column = 0;
+    arg.cond = WG_COND_EQUAL;
+    arg.value = wg_encode_query_param_str(db, c1, NULL);
+
+    query = wg_make_query(db, NULL, 0, &arg, 1);
+    if(!query) {
+      if(printlevel)
+        printf("wg_make_query() failed\n");
+      wg_free_query_param(db, arg.value);
+      return -4;
+    }
+
+    while((rec = wg_fetch(db, query))) {
+      gint c2 = wg_decode_int(db, wg_get_field(db, rec, 1));
+      if(wg_set_field(db, rec, 1, wg_encode_int(db, c2 + 21))) {
+        if(printlevel)
+          printf("update error, aborting.\n");
+        wg_free_query_param(db, arg.value);
+        return -5;
+      }
+    }
+
+    wg_free_query_param(db, arg.value);
+  }
+
+  for(i=0; i<50; i++) {
+    gint c2 = 100 * i + 21;
+    wg_query *query;
+    wg_query_arg arg;
+
+    arg.column = 1;
+    arg.cond = WG_COND_EQUAL;
+    arg.value = wg_encode_query_param_int(db, c2);
+
+    query = wg_make_query(db, NULL, 0, &arg, 1);
+    if(!query) {
+      if(printlevel)
+        printf("wg_make_query() failed\n");
+      wg_free_query_param(db, arg.value);
+      return -4;
+    }
+
+    while((rec = wg_fetch(db, query))) {
+      double c3 = wg_decode_double(db, wg_get_field(db, rec, 2));
+      if(wg_set_field(db, rec, 2, wg_encode_double(db, c3 - 77.42))) {
+        if(printlevel)
+          printf("update error, aborting.\n");
+        wg_free_query_param(db, arg.value);
+        return -5;
+      }
+    }
+
+    wg_free_query_param(db, arg.value);
+  }
+
+  for(i=0; i<50; i++) {
+    double c3 = 10 * i - 77.42;
+    wg_query *query;
+    wg_query_arg arg;
+
+    arg.column = 2;
+    arg.cond = WG_COND_EQUAL;
+    arg.value = wg_encode_query_param_double(db, c3);
+
+    query = wg_make_query(db, NULL, 0, &arg, 1);
+    if(!query) {
+      if(printlevel)
+        printf("wg_make_query() failed\n");
+      wg_free_query_param(db, arg.value);
+      return -4;
+    }
+
+    while((rec = wg_fetch(db, query))) {
+      char c1[20];
+      int c1val = atol(wg_decode_str(db, wg_get_field(db, rec, 0)));
+
+      snprintf(c1, 19, "%d", c1val * 7);
+      c1[19] = '\0';
+
+      if(wg_set_field(db, rec, 0, wg_encode_str(db, c1, NULL))) {
+        if(printlevel)
+          printf("update error, aborting.\n");
+        wg_free_query_param(db, arg.value);
+        return -5;
+      }
+    }
+
+    wg_free_query_param(db, arg.value);
+  }
+
+  if(printlevel > 1)
+    printf("------- Running read query tests --------\n");
+
+  /* Content check read queries, iteration 2 */
+  for(i=0; i<dbsize; i++) {
+    char buf[20];
+    snprintf(buf, 19, "%d", 1000 * i * 7);
+    buf[19] = '\0';
+
+    if(check_matching_rows(db, 0, WG_COND_EQUAL, (void *) buf,
+     WG_STRTYPE, 50*50, printlevel)) {
+      if(printlevel)
+        printf("content check col=0, i=%d failed.\n", i);
+      return -2;
+    }
+  }
+
+  for(i=0; i<50; i++) {
+    gint val = 100 * i + 21;
+    if(check_matching_rows(db, 1, WG_COND_EQUAL, (void *) &val,
+     WG_INTTYPE, dbsize*50, printlevel)) {
+      if(printlevel)
+        printf("content check col=1, i=%d failed.\n", i);
+      return -2;
+    }
+  }
+
+  for(i=0; i<50; i++) {
+    double val = 10 * i - 77.42;
+    if(check_matching_rows(db, 2, WG_COND_EQUAL, (void *) &val,
+     WG_DOUBLETYPE, dbsize*50, printlevel)) {
+      if(printlevel)
+        printf("content check col=2, i=%d failed.\n", i);
+      return -2;
+    }
+  }
+
+  if(printlevel > 1)
+    printf("------- Running delete queries --------\n");
+
+  /* Delete query */
+  for(i=0; i<dbsize; i++) {
+    wg_query *query;
+    wg_query_arg arglist[3];
+    char c1[20];
+    snprintf(c1, 19, "%d", 1000 * i * 7);
+    c1[19] = '\0';
+
+    arglist[0].column = 0;
+    arglist[0].cond = WG_COND_EQUAL;
+    arglist[0].value = wg_encode_query_param_str(db, c1, NULL);
+    arglist[1].column = 1;
+    arglist[1].cond = WG_COND_LESSTHAN;
+    arglist[1].value = wg_encode_query_param_int(db, 2021); /* 20 matching */
+    arglist[2].column = 2;
+    arglist[2].cond = WG_COND_GREATER;
+    arglist[2].value = wg_encode_query_param_double(db, 112.58); /* 30 matching */
+
+    query = wg_make_query(db, NULL, 0, arglist, 3);
+    if(!query) {
+      if(printlevel)
+        printf("wg_make_query() failed\n");
+      wg_free_query_param(db, arglist[0].value);
+      wg_free_query_param(db, arglist[1].value);
+      wg_free_query_param(db, arglist[2].value);
+      return -4;
+    }
+
+    while((rec = wg_fetch(db, query))) {
+      if(wg_delete_record(db, rec)) {
+        if(printlevel)
+          printf("delete failed, aborting.\n");
+        wg_free_query_param(db, arglist[0].value);
+        wg_free_query_param(db, arglist[1].value);
+        wg_free_query_param(db, arglist[2].value);
+        return -6;
+      }
+    }
+
+    wg_free_query_param(db, arglist[0].value);
+    wg_free_query_param(db, arglist[1].value);
+    wg_free_query_param(db, arglist[2].value);
+  }
+
+  if(printlevel > 1)
+    printf("------- Checking row count --------\n");
 
   /* Database scan */
   if(check_db_rows(db, dbsize * (50 * 50 - 30 * 20), printlevel)) {
     if(printlevel)
-      printf("row count check failed.\n");
-    return -7;
+      printf("row count check failed.\n");
+    return -7;
+  }
+
+  return 0;
+}
+
+/* ------------------------- dump testing ----------------------- */
+
+#ifndef _WIN32
+#define DUMP_TESTFILE  "/tmp/wgdb.dumptest"
+#else
+#define DUMP_TESTFILE  "c:\\windows\\temp\\wgdb.dumptest"
+#endif
+
+/** Compare the contents of a database and its copy restored from
+ *  the journal or a dump.
+ *  returns 0 if the databases are identical.
+ */
+static int compare_db_contents(void *db, void *clonedb, int printlevel) {
+  void *rec1, *rec2;
+  int i;
+
+  rec1 = wg_get_first_record(db);
+  rec2 = wg_get_first_record(clonedb);
+  while(rec1) {
+    int len1, len2;
+    gint meta1, meta2;
+
+    if(!rec2) {
+      if(printlevel)
+        printf("Error: clone database had fewer records\n");
+      return 1;
+    }
+
+    len1 = wg_get_record_len(db, rec1);
+    len2 = wg_get_record_len(clonedb, rec2);
+    if(len1 != len2) {
+      if(printlevel)
+        printf("Error: records had different lengths\n");
+      return 1;
+    }
+
+    meta1 = *((gint *) rec1 + RECORD_META_POS);
+    meta2 = *((gint *) rec2 + RECORD_META_POS);
+    if(meta1 != meta2) {
+      if(printlevel)
+        printf("Error: records had different metadata\n");
+      return 1;
+    }
+
+    for(i=0; i<len1; i++) {
+      gint type1, type2;
+      int intdata1, intdata2;
+      double doubledata1, doubledata2;
+      char *strdata1, *strdata2;
+
+      type1 = wg_get_field_type(db, rec1, i);
+      type2 = wg_get_field_type(clonedb, rec2, i);
+
+      if(type1 != type2) {
+        if(printlevel)
+          printf("Error: fields had different type\n");
+        return 1;
+      }
+
+      switch(type1) {
+        case WG_NULLTYPE:
+          break;
+        case WG_INTTYPE:
+          intdata1 = wg_decode_int(db, wg_get_field(db, rec1, i));
+          intdata2 = wg_decode_int(db, wg_get_field(clonedb, rec2, i));
+          if(intdata1 != intdata2) {
+            if(printlevel)
+              printf("Error: fields had different value\n");
+            return 1;
+          }
+          break;
+        case WG_DOUBLETYPE:
+          doubledata1 = wg_decode_double(db, wg_get_field(db, rec1, i));
+          doubledata2 = wg_decode_double(db, wg_get_field(clonedb, rec2, i));
+          if(doubledata1 != doubledata2) {
+            if(printlevel)
+              printf("Error: fields had different value\n");
+            return 1;
+          }
+          break;
+        case WG_STRTYPE:
+          strdata1 = wg_decode_str(db, wg_get_field(db, rec1, i));
+          strdata2 = wg_decode_str(db, wg_get_field(clonedb, rec2, i));
+          if(strcmp(strdata1, strdata2)) {
+            if(printlevel)
+              printf("Error: fields had different value\n");
+            return 1;
+          }
+          break;
+        default:
+          if(printlevel)
+            printf("Error: unexpected type\n");
+          return 1;
+      }
+    }
+    rec1 = wg_get_next_record(db, rec1);
+    rec2 = wg_get_next_record(clonedb, rec2);
+  }
+  if(rec2) {
+    if(printlevel)
+      printf("Error: clone database had more records\n");
+    return 1;
+  }
+  return 0;
+}
+
+/** Test the compact dump format.
+ *  Creates records, deletes some of them so that the database has
+ *  free objects, dumps it, checks the dump and restores it into
+ *  a separate database.
+ *  returns 0 if no errors.
+ */
+static gint wg_check_dump_compact(void* db, int printlevel) {
+  void *clonedb, *rec;
+  gint minsize, maxsize, err;
+  char buf[200];
+  FILE *f;
+  long filesize = 0;
+  int i;
+
+  if(printlevel>1)
+    printf("********* testing compact dump ********** \n");
+
+  for(i=0; i<300; i++) {
+    if(!(rec = wg_create_record(db, 3))) {
+      if(printlevel)
+        printf("Error: failed to create record %d\n", i);
+      return 1;
+    }
+    snprintf(buf, 199, "compact dump test string number %d "\
+      "long enough to be stored as a long string", i);
+    wg_set_field(db, rec, 0, wg_encode_int(db, i));
+    wg_set_field(db, rec, 1, wg_encode_str(db, buf, NULL));
+    wg_set_field(db, rec, 2, wg_encode_double(db, i/3.0));
+  }
+
+  rec = wg_get_first_record(db);
+  for(i=0; rec; i++) {
+    void *next = wg_get_next_record(db, rec);
+    if(i%3 == 1) {
+      if(wg_delete_record(db, rec)) {
+        if(printlevel)
+          printf("Error: failed to delete record %d\n", i);
+        return 1;
+      }
+    }
+    rec = next;
+  }
+
+  if(wg_dump_compact(db, DUMP_TESTFILE)) {
+    if(printlevel)
+      printf("Error: wg_dump_compact() failed\n");
+    return 1;
+  }
+
+  err = wg_check_dump(db, DUMP_TESTFILE, &minsize, &maxsize);
+  if(err || minsize != dbmemsegh(db)->free ||\
+    maxsize != dbmemsegh(db)->size) {
+    if(printlevel)
+      printf("Error: wg_check_dump() failed on compact dump\n");
+    remove(DUMP_TESTFILE);
+    return 1;
+  }
+
+#ifdef _WIN32
+  if(!fopen_s(&f, DUMP_TESTFILE, "rb")) {
+#else
+  if((f = fopen(DUMP_TESTFILE, "rb"))) {
+#endif
+    fseek(f, 0, SEEK_END);
+    filesize = ftell(f);
+    fclose(f);
+  }
+  if(filesize <= 0 || filesize >= minsize) {
+    if(printlevel)
+      printf("Error: compact dump was not smaller than the image\n");
+    remove(DUMP_TESTFILE);
+    return 1;
+  }
+
+  clonedb = wg_attach_local_database(maxsize);
+  if(!clonedb) {
+    if(printlevel)
+      printf("Error: failed to create a local database\n");
+    remove(DUMP_TESTFILE);
+    return 1;
+  }
+
+  err = wg_import_dump(clonedb, DUMP_TESTFILE);
+  remove(DUMP_TESTFILE);
+  if(err) {
+    if(printlevel)
+      printf("Error: failed to import compact dump\n");
+    wg_delete_local_database(clonedb);
+    return 1;
+  }
+
+  err = compare_db_contents(db, clonedb, printlevel);
+  if(!err && wg_check_db(clonedb)) {
+    if(printlevel)
+      printf("Error: imported database failed the area checks\n");
+    err = 1;
+  }
+  wg_delete_local_database(clonedb);
+  if(err)
+    return err;
+
+  if(printlevel>1)
+    printf("********* compact dump test successful ********** \n");
+  return 0;
+}
+
+/** Test incremental dumps.
+ *  Creates a chain of a full dump and two increments, restores it
+ *  into a separate database and checks that an increment is not
+ *  accepted on a wrong base. Then checks that an increment of an
+ *  unchanged database contains no pages when the base is a regular
+ *  dump that has free objects.
+ *  returns 0 if no errors.
+ */
+static gint wg_check_dump_incremental(void* db, int printlevel) {
+  void *clonedb, *rec;
+  char *files[2] = { DUMP_TESTFILE ".inc1", DUMP_TESTFILE ".inc2" };
+  gint err = 0;
+  int i;
+  FILE *f;
+  long filesize, hdrsize;
+
+  if(printlevel>1)
+    printf("********* testing incremental dump ********** \n");
+
+  for(i=0; i<100; i++) {
+    rec = wg_create_record(db, 2);
+    if(!rec)
+      return 1;
+    wg_set_field(db, rec, 0, wg_encode_int(db, i));
+    wg_set_field(db, rec, 1, wg_encode_str(db, "base", NULL));
+  }
+  if(wg_dump_compact(db, DUMP_TESTFILE)) {
+    if(printlevel)
+      printf("Error: wg_dump_compact() failed\n");
+    return 1;
+  }
+
+  /* modify some fields, then add records */
+  rec = wg_get_first_record(db);
+  wg_set_field(db, rec, 1, wg_encode_str(db, "first increment", NULL));
+  if(wg_dump_incremental(db, DUMP_TESTFILE, files[0])) {
+    if(printlevel)
+      printf("Error: wg_dump_incremental() failed\n");
+    err = 1;
+    goto done;
+  }
+  for(i=0; i<2000; i++) {
+    rec = wg_create_record(db, 2);
+    if(!rec) {
+      err = 1;
+      goto done;
+    }
+    wg_set_field(db, rec, 0, wg_encode_double(db, i/7.0));
+  }
+  if(wg_dump_incremental(db, files[0], files[1])) {
+    if(printlevel)
+      printf("Error: wg_dump_incremental() failed on increment base\n");
+    err = 1;
+    goto done;
+  }
+
+  clonedb = wg_attach_local_database(dbmemsegh(db)->size);
+  if(!clonedb) {
+    err = 1;
+    goto done;
+  }
+  if(wg_import_incremental(clonedb, DUMP_TESTFILE, files, 2)) {
+    if(printlevel)
+      printf("Error: failed to import incremental dumps\n");
+    err = 1;
+  }
+  else if(compare_db_contents(db, clonedb, printlevel))
+    err = 1;
+  wg_delete_local_database(clonedb);
+  if(err)
+    goto done;
+
+  /* second increment does not apply directly to the base */
+  clonedb = wg_attach_local_database(dbmemsegh(db)->size);
+  if(!clonedb) {
+    err = 1;
+    goto done;
+  }
+  if(!wg_import_incremental(clonedb, DUMP_TESTFILE, &files[1], 1)) {
+    if(printlevel)
+      printf("Error: increment was applied to a wrong base\n");
+    err = 1;
+  }
+  wg_delete_local_database(clonedb);
+  if(err)
+    goto done;
+
+  /* regular dump keeps the contents of the deleted records */
+  rec = wg_get_first_record(db);
+  for(i=0; i<500 && rec; i++) {
+    void *next = wg_get_next_record(db, rec);
+    if(i%2 && wg_delete_record(db, rec)) {
+      err = 1;
+      goto done;
+    }
+    rec = next;
+  }
+  if(wg_dump(db, DUMP_TESTFILE) ||\
+    wg_dump_incremental(db, DUMP_TESTFILE, files[0])) {
+    if(printlevel)
+      printf("Error: failed to dump on a regular base\n");
+    err = 1;
+    goto done;
+  }
+  hdrsize = WG_DUMP_INC_MAGIC_BYTES + WG_DUMP_INC_HDR_INTS*sizeof(gint) +\
+    2*sizeof(gint32) + 2*sizeof(gint32)*\
+    ((dbmemsegh(db)->free + WG_DUMP_PAGESIZE - 1)/WG_DUMP_PAGESIZE);
+  filesize = -1;
+  f = fopen(files[0], "rb");
+  if(f) {
+    fseek(f, 0, SEEK_END);
+    filesize = ftell(f);
+    fclose(f);
+  }
+  if(filesize != hdrsize) {
+    if(printlevel)
+      printf("Error: increment of an unchanged database has pages "\
+        "(%ld bytes, expected %ld)\n", filesize, hdrsize);
+    err = 1;
+    goto done;
+  }
+
+  clonedb = wg_attach_local_database(dbmemsegh(db)->size);
+  if(!clonedb) {
+    err = 1;
+    goto done;
+  }
+  if(wg_import_incremental(clonedb, DUMP_TESTFILE, files, 1)) {
+    if(printlevel)
+      printf("Error: failed to import increment on a regular base\n");
+    err = 1;
+  }
+  else if(compare_db_contents(db, clonedb, printlevel))
+    err = 1;
+  wg_delete_local_database(clonedb);
+
+done:
+  remove(DUMP_TESTFILE);
+  remove(files[0]);
+  remove(files[1]);
+  if(!err && printlevel>1)
+    printf("********* incremental dump test successful ********** \n");
+  return err;
+}
+
+/* ------------------------- log testing ------------------------ */
+
+#ifndef _WIN32
+#define LOG_TESTFILE  "/tmp/wgdb.logtest"
+#else
+#define LOG_TESTFILE  "c:\\windows\\temp\\wgdb.logtest"
+#endif
+
+#if defined(USE_DBLOG)
+/** Check the change events decoded from the test journal.
+ *  firstrec is the offset of the first created record.
+ *  returns 0 if the events match the logged operations.
+ */
+static int check_change_feed(void *db, char *logfn, gint firstrec,
+  int printlevel)
+{
+  wg_change_event ev;
+  void *feed;
+  int creates = 0, deletes = 0, sets = 0, strs = 0, doubles = 0, ints = 0;
+  gint del_lsn = 0;
+
+  feed = wg_subscribe_journal_file(db, logfn, 0);
+  if(!feed) {
+    if(printlevel)
+      printf("Failed to open the change feed\n");
+    return 1;
+  }
+  while(wg_fetch_change(db, feed, &ev, 0) == 1) {
+    switch(ev.type) {
+      case WG_CHANGE_CREATE:
+        if(!creates && (ev.record != firstrec || ev.column != 7)) {
+          if(printlevel)
+            printf("Error: unexpected first create event\n");
+          wg_unsubscribe_changes(db, feed);
+          return 1;
+        }
+        creates++;
+        break;
+      case WG_CHANGE_DELETE:
+        if(ev.record != firstrec) {
+          if(printlevel)
+            printf("Error: unexpected delete event\n");
+          wg_unsubscribe_changes(db, feed);
+          return 1;
+        }
+        del_lsn = ev.lsn;
+        deletes++;
+        break;
+      case WG_CHANGE_SET:
+        /* the values are decoded from the journal */
+        if(ev.valtype == WG_STRTYPE && ev.str && !ev.extstr &&\
+          ev.len == (gint) strlen(ev.str) &&\
+          (!strcmp(ev.str, "0000000001000000000200000000030000000004") ||\
+          !strcmp(ev.str, "00000000010000000002")))
+          strs++;
+        else if(ev.valtype == WG_DOUBLETYPE && ev.doubleval == -6543.3412)
+          doubles++;
+        else if(ev.valtype == WG_INTTYPE &&\
+          ev.intval == (~((gint) 0)) - ev.column)
+          ints++;
+        sets++;
+        break;
+      default:
+        break;
+    }
+  }
+  wg_unsubscribe_changes(db, feed);
+
+  if(creates != 5 || deletes != 1 || sets != 16) {
+    if(printlevel)
+      printf("Error: wrong number of change events (%d, %d, %d)\n",
+        creates, deletes, sets);
+    return 1;
+  }
+  if(strs != 4 || doubles != 2 || ints != 10) {
+    if(printlevel)
+      printf("Error: wrong values in the change events (%d, %d, %d)\n",
+        strs, doubles, ints);
+    return 1;
+  }
+
+  /* Resume from a known position */
+  feed = wg_subscribe_journal_file(db, logfn, del_lsn);
+  if(!feed) {
+    if(printlevel)
+      printf("Failed to open the change feed\n");
+    return 1;
+  }
+  if(wg_fetch_change(db, feed, &ev, 0) != 1 ||\
+    ev.type != WG_CHANGE_DELETE || ev.lsn != del_lsn) {
+    if(printlevel)
+      printf("Error: resuming the change feed failed\n");
+    wg_unsubscribe_changes(db, feed);
+    return 1;
+  }
+  wg_unsubscribe_changes(db, feed);
+  return 0;
+}
+#endif
+
+static gint wg_check_log(void* db, int printlevel) {
+#if defined(USE_DBLOG)
+  db_memsegment_header* dbh = dbmemsegh(db);
+  db_handle_logdata *ld = ((db_handle *) db)->logdata;
+  void *clonedb;
+  void *rec1, *rec2;
+  gint tmp, str1, str2, firstrec;
+  char logfn[100];
+  int i, err, pid;
+  int fd;
+
+  if(printlevel>1) {
+    printf("********* testing journal logging ********** \n");
+  }
+
+  /* Set up the temporary log. We don't use the standard method as
+   * that might interfere with real database logs. Also, normally
+   * local databases are not logged.
+   */
+#ifndef _WIN32
+  pid = getpid();
+#else
+  pid = _getpid();
+#endif
+  snprintf(logfn, 99, "%s.%d", LOG_TESTFILE, pid);
+  logfn[99] = '\0';
+#ifdef _WIN32
+  if(_sopen_s(&fd, logfn, _O_CREAT|_O_APPEND|_O_BINARY|_O_RDWR, _SH_DENYNO,
+    _S_IREAD|_S_IWRITE)) {
+#else
+  if((fd = open(logfn, O_CREAT|O_APPEND|O_RDWR,
+    S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH)) == -1) {
+#endif
+    if(printlevel)
+      printf("Failed to open the test journal\n");
+    return 1;
+  }
+
+#ifndef _WIN32
+  if(write(fd, WG_JOURNAL_MAGIC, WG_JOURNAL_MAGIC_BYTES) != \
+                                          WG_JOURNAL_MAGIC_BYTES) {
+    if(printlevel)
+      printf("Failed to initialize the test journal\n");
+    close(fd);
+    return 1;
+  }
+#else
+  if(_write(fd, WG_JOURNAL_MAGIC, WG_JOURNAL_MAGIC_BYTES) != \
+                                          WG_JOURNAL_MAGIC_BYTES) {
+    if(printlevel)
+      printf("Failed to initialize the test journal\n");
+    _close(fd);
+    return 1;
+  }
+#endif
+
+  ld->fd = fd;
+  ld->serial = dbh->logging.serial;
+  dbh->logging.active = 1;
+
+  /* Do various operations in the database:
+   * Encode short/long strings, doubles, ints
+   * Create records (also with different meta bits)
+   * Delete records
+   * Set fields
+   */
+  str1 = wg_encode_str(db, "0000000001000000000200000000030000000004", NULL);
+  str2 = wg_encode_str(db, "00000000010000000002", NULL);
+  tmp = wg_encode_double(db, -6543.3412);
+  rec1 = wg_create_record(db, 7);
+  firstrec = ptrtooffset(db, rec1);
+  wg_set_field(db, rec1, 4, str1);
+  wg_set_field(db, rec1, 5, str2);
+  wg_set_field(db, rec1, 6, tmp);
+
+  if(printlevel)
+    printf("Expecting a field index error:\n");
+  wg_set_field(db, rec1, 7, 0); /* Failed operation, shouldn't be logged */
+
+  rec2 = wg_create_record(db, 6);
+  wg_set_field(db, rec2, 1, str1);
+  wg_set_field(db, rec2, 3, str2);
+  wg_set_field(db, rec2, 5, tmp);
+
+  wg_delete_record(db, rec1);
+
+  rec1 = wg_create_record(db, 10);
+  for(i=0; i<10; i++)
+    wg_set_field(db, rec1, i, wg_encode_int(db, (~((gint) 0))-i));
+
+  rec1 = wg_create_object(db, 1, 0, 0);
+  rec1 = wg_create_array(db, 4, 1, 0);
+
+#ifndef _WIN32
+  close(ld->fd);
+#else
+  _close(ld->fd);
+#endif
+  ld->fd = -1;
+
+  /* Decode the journal as change events */
+  if(check_change_feed(db, logfn, firstrec, printlevel)) {
+    remove(logfn);
+    return 1;
+  }
+
+  /* Replay the log in a clone database.
+   * Note that replay normally restarts logging using the
+   * standard configuration, but here this is not the case as
+   * the logging.active flag is not set in the local database.
+   */
+
+  clonedb = wg_attach_local_database(800000);
+  if(!clonedb) {
+    if(printlevel)
+      printf("Failed to create a second memory database\n");
+    remove(logfn);
+    return 1;
+  }
+
+  if(wg_replay_log(clonedb, logfn)) {
+    if(printlevel)
+      printf("Failed to replay the journal\n");
+    wg_delete_local_database(clonedb);
+    remove(logfn);
+    return 1;
+  }
+
+  /* Compare the databases */
+  err = compare_db_contents(db, clonedb, printlevel);
+  wg_delete_local_database(clonedb);
+  if(err) {
+    remove(logfn);
+    return err;
+  }
+
+  /* Apply the same journal as a replication stream */
+  clonedb = wg_attach_local_database(800000);
+  if(!clonedb) {
+    if(printlevel)
+      printf("Failed to create a second memory database\n");
+    remove(logfn);
+    return 1;
+  }
+
+#ifndef _WIN32
+  if((fd = open(logfn, O_RDONLY)) == -1) {
+#else
+  if(_sopen_s(&fd, logfn, _O_RDONLY|_O_BINARY, _SH_DENYNO, 0)) {
+#endif
+    if(printlevel)
+      printf("Failed to open the test journal\n");
+    wg_delete_local_database(clonedb);
+    remove(logfn);
+    return 1;
+  }
+
+  /* closes fd */
+  if(wg_follow_log(clonedb, fd)) {
+    if(printlevel)
+      printf("Failed to follow the journal\n");
+    wg_delete_local_database(clonedb);
+    remove(logfn);
+    return 1;
+  }
+
+  err = compare_db_contents(db, clonedb, printlevel);
+
+  wg_delete_local_database(clonedb);
+  remove(logfn);
+  if(err)
+    return err;
+
+  if(printlevel>1)
+    printf("********* journal logging test successful ********** \n");
+  return 0;
+#else
+  printf("logging disabled, skipping checks\n");
+  return 77;
+#endif
+}
+
+#if defined(USE_DBLOG) && !defined(_WIN32) && defined(HAVE_PTHREAD)
+/** Arguments of the journal shipping, following and reader threads */
+typedef struct {
+  void *db;
+  int fd;
+  volatile gint err;
+} ship_thread_arg;
+
+static void *ship_thread(void *arg) {
+  ship_thread_arg *a = (ship_thread_arg *) arg;
+  a->err = wg_ship_log(a->db, a->fd);
+  return NULL;
+}
+
+static void *follow_thread(void *arg) {
+  ship_thread_arg *a = (ship_thread_arg *) arg;
+  a->err = wg_follow_log(a->db, a->fd);
+  return NULL;
+}
+
+/* sets err to 1 once the read lock was acquired */
+static void *read_lock_thread(void *arg) {
+  ship_thread_arg *a = (ship_thread_arg *) arg;
+  gint lock = wg_start_read(a->db);
+  if(lock) {
+    wg_end_read(a->db, lock);
+    a->err = 1;
+  } else {
+    a->err = -1;
+  }
+  return NULL;
+}
+
+/** Return the size of a file, -1 if it does not exist.
+ */
+static long log_file_size(char *fn) {
+  struct stat st;
+  if(stat(fn, &st))
+    return -1;
+  return (long) st.st_size;
+}
+
+/** Read the stream into buf until it contains len bytes.
+ *  got is the number of bytes already in the buffer.
+ *  returns 0 if the bytes arrived in time.
+ */
+static int read_ship_stream(int fd, char *buf, long got, long len) {
+  int i;
+  struct timespec ts;
+
+  ts.tv_sec = 0;
+  ts.tv_nsec = 10000000;
+  for(i=0; i<500 && got < len; i++) {
+    ssize_t n = read(fd, buf + got, len - got);
+    if(n > 0)
+      got += n;
+    else
+      nanosleep(&ts, NULL);
+  }
+  return (got == len ? 0 : -1);
+}
+
+/** Follow a shipped stream that stalls in the middle of an entry.
+ *  The first stall bytes of the stream are written, then a reader
+ *  must be able to lock the following database while the rest of
+ *  the entry has not arrived. The result is compared with db.
+ *  returns 0 if no errors.
+ */
+static gint check_follow_stall(void *db, char *buf, long len, long stall,
+  int printlevel) {
+  ship_thread_arg farg, rarg;
+  pthread_t fthread, rthread;
+  struct timespec ts;
+  void *clonedb;
+  int i, pipefd[2], locked = 0;
+  gint err = 1;
+
+  clonedb = wg_attach_local_database(800000);
+  if(!clonedb) {
+    if(printlevel)
+      printf("Failed to create a second memory database\n");
+    return 1;
+  }
+  if(pipe(pipefd)) {
+    if(printlevel)
+      printf("Failed to create a pipe\n");
+    wg_delete_local_database(clonedb);
+    return 1;
+  }
+  farg.db = clonedb;
+  farg.fd = pipefd[0]; /* closed by wg_follow_log() */
+  farg.err = 0;
+  if(pthread_create(&fthread, NULL, follow_thread, &farg)) {
+    if(printlevel)
+      printf("Failed to start the follower\n");
+    close(pipefd[0]);
+    close(pipefd[1]);
+    wg_delete_local_database(clonedb);
+    return 1;
+  }
+
+  ts.tv_sec = 0;
+  ts.tv_nsec = 10000000;
+  if(write(pipefd[1], buf, stall) == stall) {
+    /* give the follower time to apply everything before the stall */
+    for(i=0; i<10; i++)
+      nanosleep(&ts, NULL);
+    rarg.db = clonedb;
+    rarg.err = 0;
+    if(!pthread_create(&rthread, NULL, read_lock_thread, &rarg)) {
+      for(i=0; i<100 && !rarg.err; i++)
+        nanosleep(&ts, NULL);
+      locked = (rarg.err == 1);
+      /* the rest of the stream releases a reader that is still waiting */
+      if(write(pipefd[1], buf + stall, len - stall) != len - stall) {
+        if(printlevel)
+          printf("Failed to write the stream\n");
+        locked = 0;
+      }
+      close(pipefd[1]);
+      pthread_join(fthread, NULL);
+      pthread_join(rthread, NULL);
+
+      if(!locked) {
+        if(printlevel)
+          printf("The follower held the lock while the stream stalled\n");
+      } else if(farg.err) {
+        if(printlevel)
+          printf("Failed to follow the shipped journal\n");
+      } else {
+        err = compare_db_contents(db, clonedb, printlevel);
+      }
+      wg_delete_local_database(clonedb);
+      return err;
+    }
   }
 
-  return 0;
+  if(printlevel)
+    printf("Failed to start following the stream\n");
+  close(pipefd[1]);
+  pthread_join(fthread, NULL);
+  wg_delete_local_database(clonedb);
+  return 1;
 }
-
-/* ------------------------- log testing ------------------------ */
-
-#ifndef _WIN32
-#define LOG_TESTFILE  "/tmp/wgdb.logtest"
-#else
-#define LOG_TESTFILE  "c:\\windows\\temp\\wgdb.logtest"
 #endif
 
-static gint wg_check_log(void* db, int printlevel) {
-#if defined(USE_DBLOG)
+/** Test journal shipping across a journal rotation.
+ *  The journal is rotated in two steps while the shipper is running:
+ *  first the old journal is moved away and the serial incremented,
+ *  then the new journal is created empty and its header is written
+ *  later. The shipper must wait for the new journal and continue
+ *  with it. The stream is replayed in a clone database and followed
+ *  with a stall in the middle of an entry.
+ *  returns 0 if no errors.
+ */
+static gint wg_check_log_shipping(void* db, int printlevel) {
+#if defined(USE_DBLOG) && !defined(_WIN32) && defined(HAVE_PTHREAD)
   db_memsegment_header* dbh = dbmemsegh(db);
-  db_handle_logdata *ld = ((db_handle *) db)->logdata;
-  void *clonedb;
-  void *rec1, *rec2;
-  gint tmp, str1, str2;
-  char logfn[100];
-  int i, err, pid;
-  int fd;
+  char journal_fn[WG_JOURNAL_FN_BUFSIZE], backup_fn[WG_JOURNAL_FN_BUFSIZE + 10];
+  char stream_fn[100];
+  ship_thread_arg arg;
+  pthread_t thread;
+  void (*oldhandler)(int);
+  void *clonedb, *rec;
+  struct timespec ts;
+  char *buf = NULL, *tmpbuf;
+  long len = 0;
+  int i, fd, pipefd[2], err = 1;
 
   if(printlevel>1) {
-    printf("********* testing journal logging ********** \n");
+    printf("********* testing journal shipping ********** \n");
   }
 
-  /* Set up the temporary log. We don't use the standard method as
-   * that might interfere with real database logs. Also, normally
-   * local databases are not logged.
-   */
-#ifndef _WIN32
-  pid = getpid();
-#else
-  pid = _getpid();
-#endif
-  snprintf(logfn, 99, "%s.%d", LOG_TESTFILE, pid);
-  logfn[99] = '\0';
-#ifdef _WIN32
-  if(_sopen_s(&fd, logfn, _O_CREAT|_O_APPEND|_O_BINARY|_O_RDWR, _SH_DENYNO,
-    _S_IREAD|_S_IWRITE)) {
-#else
-  if((fd = open(logfn, O_CREAT|O_APPEND|O_RDWR,
-    S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH)) == -1) {
-#endif
+  /* A journal of our own. The database is local, so the key is only
+   * used for the journal name. */
+  dbh->key = 90000 + getpid() % 10000;
+  wg_journal_filename(db, journal_fn, WG_JOURNAL_FN_BUFSIZE);
+  snprintf(backup_fn, sizeof(backup_fn), "%s.0", journal_fn);
+  snprintf(stream_fn, 99, "%s.ship.%d", LOG_TESTFILE, (int) getpid());
+  stream_fn[99] = '\0';
+  remove(journal_fn);
+  remove(backup_fn);
+
+  if(wg_start_logging(db)) {
     if(printlevel)
-      printf("Failed to open the test journal\n");
+      printf("Failed to start logging\n");
     return 1;
   }
-
-#ifndef _WIN32
-  if(write(fd, WG_JOURNAL_MAGIC, WG_JOURNAL_MAGIC_BYTES) != \
-                                          WG_JOURNAL_MAGIC_BYTES) {
+  if(pipe(pipefd)) {
     if(printlevel)
-      printf("Failed to initialize the test journal\n");
-    close(fd);
+      printf("Failed to create a pipe\n");
+    remove(journal_fn);
     return 1;
   }
-#else
-  if(_write(fd, WG_JOURNAL_MAGIC, WG_JOURNAL_MAGIC_BYTES) != \
-                                          WG_JOURNAL_MAGIC_BYTES) {
+  fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+  arg.db = db;
+  arg.fd = pipefd[1];
+  arg.err = 0;
+  if(pthread_create(&thread, NULL, ship_thread, &arg)) {
     if(printlevel)
-      printf("Failed to initialize the test journal\n");
-    _close(fd);
+      printf("Failed to start the shipper\n");
+    close(pipefd[0]);
+    close(pipefd[1]);
+    remove(journal_fn);
     return 1;
   }
-#endif
 
-  ld->fd = fd;
-  ld->serial = dbh->logging.serial;
-  dbh->logging.active = 1;
+  for(i=0; i<50; i++) {
+    rec = wg_create_record(db, 2);
+    wg_set_field(db, rec, 0, wg_encode_int(db, i));
+    wg_set_field(db, rec, 1, wg_encode_str(db, "before rotation", NULL));
+  }
 
-  /* Do various operations in the database:
-   * Encode short/long strings, doubles, ints
-   * Create records (also with different meta bits)
-   * Delete records
-   * Set fields
-   */
-  str1 = wg_encode_str(db, "0000000001000000000200000000030000000004", NULL);
-  str2 = wg_encode_str(db, "00000000010000000002", NULL);
-  tmp = wg_encode_double(db, -6543.3412);
-  rec1 = wg_create_record(db, 7);
-  wg_set_field(db, rec1, 4, str1);
-  wg_set_field(db, rec1, 5, str2);
-  wg_set_field(db, rec1, 6, tmp);
+  /* The shipper has the journal open when everything so far
+   * has arrived */
+  len = log_file_size(journal_fn);
+  buf = (char *) malloc(len);
+  if(!buf || read_ship_stream(pipefd[0], buf, 0, len)) {
+    if(printlevel)
+      printf("Failed to receive the journal\n");
+    goto cancel;
+  }
 
+  /* Rotate like backup_journal() and open_journal() do, but with
+   * pauses longer than the polling interval of the shipper */
+  ts.tv_sec = 0;
+  ts.tv_nsec = 200000000;
   if(printlevel)
-    printf("Expecting a field index error:\n");
-  wg_set_field(db, rec1, 7, 0); /* Failed operation, shouldn't be logged */
-
-  rec2 = wg_create_record(db, 6);
-  wg_set_field(db, rec2, 1, str1);
-  wg_set_field(db, rec2, 3, str2);
-  wg_set_field(db, rec2, 5, tmp);
-
-  wg_delete_record(db, rec1);
-
-  rec1 = wg_create_record(db, 10);
-  for(i=0; i<10; i++)
-    wg_set_field(db, rec1, i, wg_encode_int(db, (~((gint) 0))-i));
-
-  rec1 = wg_create_object(db, 1, 0, 0);
-  rec1 = wg_create_array(db, 4, 1, 0);
+    printf("Expecting log file errors while the journal is rotated:\n");
+  wg_stop_logging(db);
+  if(rename(journal_fn, backup_fn)) {
+    if(printlevel)
+      printf("Failed to rotate the journal\n");
+    goto cancel;
+  }
+  dbh->logging.serial++;
+  nanosleep(&ts, NULL);
+  if((fd = open(journal_fn, O_CREAT|O_APPEND|O_RDWR,
+    S_IRUSR|S_IWUSR)) == -1) {
+    if(printlevel)
+      printf("Failed to create the new journal\n");
+    goto cancel;
+  }
+  nanosleep(&ts, NULL);
+  if(write(fd, WG_JOURNAL_MAGIC, WG_JOURNAL_MAGIC_BYTES) != \
+                                          WG_JOURNAL_MAGIC_BYTES) {
+    if(printlevel)
+      printf("Failed to initialize the new journal\n");
+    close(fd);
+    goto cancel;
+  }
+  close(fd);
+  dbh->logging.active = 1;
 
-#ifndef _WIN32
-  close(ld->fd);
-#else
-  _close(ld->fd);
-#endif
-  ld->fd = -1;
+  rec = wg_get_first_record(db);
+  for(i=0; rec; i++) {
+    if(i % 2)
+      wg_set_field(db, rec, 1, wg_encode_str(db, "after rotation", NULL));
+    rec = wg_get_next_record(db, rec);
+  }
+  rec = wg_create_record(db, 3);
+  wg_set_field(db, rec, 2, wg_encode_double(db, 0.25));
 
-  /* Replay the log in a clone database.
-   * Note that replay normally restarts logging using the
-   * standard configuration, but here this is not the case as
-   * the logging.active flag is not set in the local database.
-   */
+  /* The new journal follows in the stream, without the header */
+  i = len;
+  len += log_file_size(journal_fn) - WG_JOURNAL_MAGIC_BYTES;
+  tmpbuf = (char *) realloc(buf, len);
+  if(!tmpbuf) {
+    if(printlevel)
+      printf("Failed to allocate the stream buffer\n");
+    goto cancel;
+  }
+  buf = tmpbuf;
+  if(read_ship_stream(pipefd[0], buf, i, len)) {
+    if(printlevel)
+      printf("Shipping did not continue after the journal rotation\n");
+    goto cancel;
+  }
+
+  /* A write to the closed stream ends the shipper */
+  oldhandler = signal(SIGPIPE, SIG_IGN);
+  close(pipefd[0]);
+  rec = wg_create_record(db, 1);
+  pthread_join(thread, NULL);
+  signal(SIGPIPE, oldhandler);
+  close(pipefd[1]);
+  wg_delete_record(db, rec);
+  if(arg.err != -1) {
+    if(printlevel)
+      printf("Shipper did not stop at the closed stream\n");
+    goto done;
+  }
 
+  /* Replay the stream */
+  if((fd = open(stream_fn, O_CREAT|O_TRUNC|O_WRONLY, S_IRUSR|S_IWUSR)) == -1 ||\
+    write(fd, buf, len) != len) {
+    if(printlevel)
+      printf("Failed to save the stream\n");
+    if(fd != -1)
+      close(fd);
+    goto done;
+  }
+  close(fd);
   clonedb = wg_attach_local_database(800000);
   if(!clonedb) {
     if(printlevel)
       printf("Failed to create a second memory database\n");
-    remove(logfn);
-    return 1;
+    goto done;
   }
-
-  if(wg_replay_log(clonedb, logfn)) {
+  if(wg_replay_log(clonedb, stream_fn)) {
     if(printlevel)
-      printf("Failed to replay the journal\n");
-    wg_delete_local_database(clonedb);
-    remove(logfn);
-    return 1;
+      printf("Failed to replay the shipped journal\n");
+  } else {
+    err = compare_db_contents(db, clonedb, printlevel);
   }
+  wg_delete_local_database(clonedb);
 
-  err = 0;
-
-  /* Compare the databases */
-  rec1 = wg_get_first_record(db);
-  rec2 = wg_get_first_record(clonedb);
-  while(rec1) {
-    int len1, len2;
-    gint meta1, meta2;
-
-    if(!rec2) {
+  /* Follow the stream, stalling inside the first string value */
+  if(!err) {
+    for(i=0; i + 15 <= len && memcmp(buf + i, "before rotation", 15); i++);
+    if(i + 15 > len) {
       if(printlevel)
-        printf("Error: clone database had fewer records\n");
+        printf("String value not found in the shipped journal\n");
       err = 1;
-      break;
+    } else {
+      err = check_follow_stall(db, buf, len, i + 7, printlevel);
     }
+  }
+  goto done;
 
-    len1 = wg_get_record_len(db, rec1);
-    len2 = wg_get_record_len(clonedb, rec2);
-    if(len1 != len2) {
-      if(printlevel)
-        printf("Error: records had different lengths\n");
-      err = 1;
-      break;
-    }
+cancel:
+  pthread_cancel(thread);
+  pthread_join(thread, NULL);
+  close(pipefd[0]);
+  close(pipefd[1]);
 
-    meta1 = *((gint *) rec1 + RECORD_META_POS);
-    meta2 = *((gint *) rec2 + RECORD_META_POS);
-    if(meta1 != meta2) {
+done:
+  dbh->logging.active = 0;
+  if(buf)
+    free(buf);
+  remove(stream_fn);
+  remove(journal_fn);
+  remove(backup_fn);
+  if(!err && printlevel>1)
+    printf("********* journal shipping test successful ********** \n");
+  return err;
+#else
+  printf("logging or threads disabled, skipping journal shipping test\n");
+  return 77;
+#endif
+}
+
+/** Test the online dump with logging active.
+ *  The dump is imported into a clone database and compared with the
+ *  source. The source is then updated and the journal that was
+ *  restarted by the dump is replayed in the clone.
+ *  returns 0 if no errors.
+ */
+static gint wg_check_dump_online(void* db, int printlevel) {
+#ifdef USE_DBLOG
+  db_memsegment_header* dbh = dbmemsegh(db);
+  char journal_fn[WG_JOURNAL_FN_BUFSIZE], backup_fn[WG_JOURNAL_FN_BUFSIZE + 10];
+  char buf[100];
+  void *clonedb = NULL, *rec, *next;
+  gint err = 1;
+  int i;
+
+  if(printlevel>1) {
+    printf("********* testing online dump ********** \n");
+  }
+
+  /* A journal of our own, see wg_check_log_shipping() */
+  dbh->key = 80000 + getpid() % 10000;
+  wg_journal_filename(db, journal_fn, WG_JOURNAL_FN_BUFSIZE);
+  snprintf(backup_fn, sizeof(backup_fn), "%s.0", journal_fn);
+  remove(journal_fn);
+  remove(backup_fn);
+
+  if(wg_start_logging(db)) {
+    if(printlevel)
+      printf("Failed to start logging\n");
+    return 1;
+  }
+
+  for(i=0; i<100; i++) {
+    if(!(rec = wg_create_record(db, 3))) {
       if(printlevel)
-        printf("Error: records had different metadata\n");
-      err = 1;
-      break;
+        printf("Error: failed to create record %d\n", i);
+      goto done;
     }
+    snprintf(buf, 99, "online dump test string number %d", i);
+    wg_set_field(db, rec, 0, wg_encode_int(db, i));
+    wg_set_field(db, rec, 1, wg_encode_str(db, buf, NULL));
+    wg_set_field(db, rec, 2, wg_encode_double(db, i/3.0));
+  }
 
-    for(i=0; i<len1; i++) {
-      gint type1, type2;
-      int intdata1, intdata2;
-      double doubledata1, doubledata2;
-      char *strdata1, *strdata2;
-
-      type1 = wg_get_field_type(db, rec1, i);
-      type2 = wg_get_field_type(clonedb, rec2, i);
+  if(wg_dump_online(db, DUMP_TESTFILE)) {
+    if(printlevel)
+      printf("Error: wg_dump_online() failed\n");
+    goto done;
+  }
 
-      if(type1 != type2) {
-        if(printlevel)
-          printf("Error: fields had different type\n");
-        err = 1;
-        goto done;
-      }
+  clonedb = wg_attach_local_database(800000);
+  if(!clonedb) {
+    if(printlevel)
+      printf("Error: failed to create a local database\n");
+    goto done;
+  }
+  if(wg_import_dump(clonedb, DUMP_TESTFILE)) {
+    if(printlevel)
+      printf("Error: failed to import the online dump\n");
+    goto done;
+  }
+  if(compare_db_contents(db, clonedb, printlevel))
+    goto done;
 
-      switch(type1) {
-        case WG_NULLTYPE:
-          break;
-        case WG_INTTYPE:
-          intdata1 = wg_decode_int(db, wg_get_field(db, rec1, i));
-          intdata2 = wg_decode_int(db, wg_get_field(clonedb, rec2, i));
-          if(intdata1 != intdata2) {
-            if(printlevel)
-              printf("Error: fields had different value\n");
-            err = 1;
-            goto done;
-          }
-          break;
-        case WG_DOUBLETYPE:
-          doubledata1 = wg_decode_double(db, wg_get_field(db, rec1, i));
-          doubledata2 = wg_decode_double(db, wg_get_field(clonedb, rec2, i));
-          if(doubledata1 != doubledata2) {
-            if(printlevel)
-              printf("Error: fields had different value\n");
-            err = 1;
-            goto done;
-          }
-          break;
-        case WG_STRTYPE:
-          strdata1 = wg_decode_str(db, wg_get_field(db, rec1, i));
-          strdata2 = wg_decode_str(db, wg_get_field(clonedb, rec2, i));
-          if(strcmp(strdata1, strdata2)) {
-            if(printlevel)
-              printf("Error: fields had different value\n");
-            err = 1;
-            goto done;
-          }
-          break;
-        default:
-          if(printlevel)
-            printf("Error: unexpected type\n");
-          err = 1;
-          goto done;
-      }
+  /* These updates go to the journal restarted by the dump */
+  rec = wg_get_first_record(db);
+  for(i=0; rec; i++) {
+    next = wg_get_next_record(db, rec);
+    if(i%3 == 1) {
+      wg_delete_record(db, rec);
+    } else if(i%3 == 2) {
+      wg_set_field(db, rec, 1, wg_encode_str(db, "updated after dump", NULL));
     }
-    rec1 = wg_get_next_record(db, rec1);
-    rec2 = wg_get_next_record(clonedb, rec2);
+    rec = next;
   }
-  if(rec2) {
+  for(i=0; i<10; i++) {
+    if((rec = wg_create_record(db, 2)))
+      wg_set_field(db, rec, 0, wg_encode_int(db, 1000 + i));
+  }
+
+  if(wg_replay_log(clonedb, journal_fn)) {
     if(printlevel)
-      printf("Error: clone database had more records\n");
+      printf("Error: failed to replay the journal after the online dump\n");
+    goto done;
   }
+  err = compare_db_contents(db, clonedb, printlevel);
 
 done:
-  wg_delete_local_database(clonedb);
-  remove(logfn);
-  if(err)
-    return err;
-
-  if(printlevel>1)
-    printf("********* journal logging test successful ********** \n");
-  return 0;
+  if(clonedb)
+    wg_delete_local_database(clonedb);
+  dbh->logging.active = 0;
+  remove(DUMP_TESTFILE);
+  remove(journal_fn);
+  remove(backup_fn);
+  if(!err && printlevel>1)
+    printf("********* online dump test successful ********** \n");
+  return err;
 #else
-  printf("logging disabled, skipping checks\n");
+  printf("logging disabled, skipping online dump test\n");
   return 77;
 #endif
 }
@@ -5259,6 +9905,10 @@ void wg_debug_print_value(void *db, gint data) {
  * General sanity checks
  */
 static int check_sanity(void *db) {
+  db_memsegment_header* dbh = dbmemsegh(db);
+  gint32 version = dbh->version;
+  int err;
+
 #ifdef HAVE_64BIT_GINT
   if(sizeof(gint) != 8) {
     printf("gint size sanity check failed\n");
@@ -5270,6 +9920,16 @@ static int check_sanity(void *db) {
     return 1;
   }
 #endif
+
+  /* An image of the same release with an older segment layout
+   * must not be accepted */
+  dbh->version = version & 0xffffff;
+  err = wg_check_header_compat(dbh);
+  dbh->version = version;
+  if(err != -3) {
+    printf("segment layout check failed\n");
+    return 1;
+  }
   return 0;
 }
 
@@ -16,15 +16,15 @@ if [ config-gcc.h -nt config.h ]; then
   echo "Warning: config.h is older than config-gcc.h, consider updating it"
 fi
 ${CC} -O2 -Wall -o Main/wgdb Main/wgdb.c Db/dbmem.c \
-  Db/dballoc.c Db/dbdata.c Db/dblock.c Db/dbindex.c Db/dbdump.c  \
+  Db/dballoc.c Db/dbdata.c Db/dblock.c Db/dbindex.c Db/dbbtree.c Db/dbstats.c Db/dbbitmap.c Db/dbfulltext.c Db/dbrtree.c Db/dbdump.c  \
   Db/dblog.c Db/dbhash.c Db/dbcompare.c Db/dbquery.c Db/dbutil.c Db/dbmpool.c \
-  Db/dbjson.c Db/dbschema.c json/yajl_all.c -lm
+  Db/dbjson.c Db/dbschema.c json/yajl_all.c -lm -lpthread
 # debug and testing programs: uncomment as needed
 #$CC  -O2 -Wall -o Main/indextool  Main/indextool.c Db/dbmem.c \
-#  Db/dballoc.c Db/dbdata.c Db/dblock.c Db/dbindex.c Db/dblog.c \
+#  Db/dballoc.c Db/dbdata.c Db/dblock.c Db/dbindex.c Db/dbbtree.c Db/dbstats.c Db/dbbitmap.c Db/dbfulltext.c Db/dbrtree.c Db/dblog.c \
 #  Db/dbhash.c Db/dbcompare.c Db/dbquery.c Db/dbutil.c Db/dbmpool.c \
-#  Db/dbjson.c Db/dbschema.c json/yajl_all.c -lm
+#  Db/dbjson.c Db/dbschema.c json/yajl_all.c -lm -lpthread
 #$CC  -O2 -Wall -o Main/selftest Main/selftest.c Db/dbmem.c \
-#  Db/dballoc.c Db/dbdata.c Db/dblock.c Db/dbindex.c Test/dbtest.c Db/dbdump.c \
+#  Db/dballoc.c Db/dbdata.c Db/dblock.c Db/dbindex.c Db/dbbtree.c Db/dbstats.c Db/dbbitmap.c Db/dbfulltext.c Db/dbrtree.c Test/dbtest.c Db/dbdump.c \
 #  Db/dblog.c Db/dbhash.c Db/dbcompare.c Db/dbquery.c Db/dbutil.c Db/dbmpool.c \
-#  Db/dbjson.c Db/dbschema.c json/yajl_all.c -lm
+#  Db/dbjson.c Db/dbschema.c json/yajl_all.c -lm -lpthread
@@ -63,6 +63,9 @@
 /* Use chained T-tree index nodes */
 #define TTREE_CHAINED_NODES 1
 
+/* Store the keys in T-tree nodes */
+#define TTREE_NODE_KEYS 1
+
 /* Use single-compare T-tree mode */
 #define TTREE_SINGLE_COMPARE 1
 
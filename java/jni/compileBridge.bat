@@ -1,3 +1,3 @@
 cd library
-"C:\Program Files\Microsoft Visual Studio 9.0\VC\bin\cl.exe" /LD /I"C:\Program Files\Java\jdk1.7.0_25\include" /I"C:\Program Files\Java\jdk1.7.0_25\include\win32" /W3 ..\src\native\whitedbDriver.c ..\..\..\Db\dbmem.c ..\..\..\Db\dballoc.c ..\..\..\Db\dbdata.c ..\..\..\Db\dbindex.c ..\..\..\Db\dbquery.c ..\..\..\Db\dbutil.c ..\..\..\Db\dbmpool.c ..\..\..\Db\dblock.c ..\..\..\Db\dbcompare.c ..\..\..\Db\dbhash.c
+"C:\Program Files\Microsoft Visual Studio 9.0\VC\bin\cl.exe" /LD /I"C:\Program Files\Java\jdk1.7.0_25\include" /I"C:\Program Files\Java\jdk1.7.0_25\include\win32" /W3 ..\src\native\whitedbDriver.c ..\..\..\Db\dbmem.c ..\..\..\Db\dballoc.c ..\..\..\Db\dbdata.c ..\..\..\Db\dbindex.c ..\..\..\Db\dbbtree.c ..\..\..\Db\dbstats.c ..\..\..\Db\dbbitmap.c ..\..\..\Db\dbfulltext.c ..\..\..\Db\dbrtree.c ..\..\..\Db\dbquery.c ..\..\..\Db\dbutil.c ..\..\..\Db\dbmpool.c ..\..\..\Db\dblock.c ..\..\..\Db\dbcompare.c ..\..\..\Db\dbhash.c
 cd ..
@@ -23,6 +23,11 @@ $(amal Db/dblog.h)
 $(amal Db/dbdump.h)
 $(amal Db/dbhash.h)
 $(amal Db/dbindex.h)
+$(amal Db/dbbtree.h)
+$(amal Db/dbstats.h)
+$(amal Db/dbbitmap.h)
+$(amal Db/dbfulltext.h)
+$(amal Db/dbrtree.h)
 $(amal Db/dbcompare.h)
 $(amal Db/dbquery.h)
 $(amal Db/dbutil.h)
@@ -44,6 +49,11 @@ $(amal Db/dblog.c)
 $(amal Db/dbdump.c)
 $(amal Db/dbhash.c)
 $(amal Db/dbindex.c)
+$(amal Db/dbbtree.c)
+$(amal Db/dbstats.c)
+$(amal Db/dbbitmap.c)
+$(amal Db/dbfulltext.c)
+$(amal Db/dbrtree.c)
 $(amal Db/dbcompare.c)
 $(amal Db/dbquery.c)
 $(amal Db/dbutil.c)